@@ -60,11 +60,13 @@ static inline void ukarch_spin_lock(struct __spinlock *lock)
 		"	jnz	2b\n"		/* if unsuccessful, retry */
 		:
 		: "r" (&lock->lock), "r" (locked)
-		: "eax");
+		: "eax", "memory");
 }
 
 static inline void ukarch_spin_unlock(struct __spinlock *lock)
 {
+	/* Keep the accesses of the critical section before the release */
+	barrier();
 	UK_WRITE_ONCE(lock->lock, 0);
 }
 
@@ -81,7 +83,7 @@ static inline int ukarch_spin_trylock(struct __spinlock *lock)
 		"1:\n"
 		: "+&r" (r)
 		: "r" (&lock->lock), "r" (locked)
-		: "eax");
+		: "eax", "memory");
 
 	return r;
 }
@@ -120,10 +120,30 @@ struct ukplat_lcpu_func {
 	void *user;
 };
 
+#if defined(__X86_64__)
+/*
+ * Offset of the logical CPU ID in the per-CPU data that the GS base of each
+ * CPU points to. The platform lays out its per-CPU structure accordingly.
+ */
+#define UKPLAT_LCPU_ID_OFFSET	0x08
+
+/**
+ * Returns the ID of the current logical CPU
+ */
+static inline __lcpuid ukplat_lcpu_id(void)
+{
+	__lcpuid id;
+
+	__asm__ __volatile__("movl %%gs:%c1, %0"
+			     : "=r" (id) : "i" (UKPLAT_LCPU_ID_OFFSET));
+	return id;
+}
+#else /* !__X86_64__ */
 /**
  * Returns the ID of the current logical CPU
  */
 __lcpuid ukplat_lcpu_id(void);
+#endif /* !__X86_64__ */
 
 /**
  * Returns the number of logical CPUs present on the system
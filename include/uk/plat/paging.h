@@ -0,0 +1,175 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __UKPLAT_PAGING_H__
+#define __UKPLAT_PAGING_H__
+
+#include <uk/arch/types.h>
+#include <uk/config.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if CONFIG_HAVE_PAGING
+
+/* Page attributes */
+#define UKPLAT_PAGE_ATTR_PROT_READ	(0x1)	/* Page is readable */
+#define UKPLAT_PAGE_ATTR_PROT_WRITE	(0x2)	/* Page is writable */
+#define UKPLAT_PAGE_ATTR_PROT_EXEC	(0x4)	/* Page is executable */
+#define UKPLAT_PAGE_ATTR_NOCACHE	(0x8)	/* Page bypasses the caches
+						 * (e.g., device memory)
+						 */
+
+#define UKPLAT_PAGE_ATTR_PROT_RW	(UKPLAT_PAGE_ATTR_PROT_READ \
+					 | UKPLAT_PAGE_ATTR_PROT_WRITE)
+
+/* Page fault flags */
+#define UKPLAT_PAGE_FAULT_PRESENT	(0x1)	/* Page is mapped, the access
+						 * violated its attributes
+						 */
+#define UKPLAT_PAGE_FAULT_WRITE		(0x2)	/* Faulting access is a write */
+#define UKPLAT_PAGE_FAULT_EXEC		(0x4)	/* Faulting access is an
+						 * instruction fetch
+						 */
+
+/**
+ * Context of the UKPLAT_EVENT_PAGE_FAULT event, which is raised on page
+ * faults before the platform crashes (see uk/event.h). Handlers run with
+ * interrupts disabled and return UK_EVENT_HANDLED if they resolved the fault,
+ * in which case the faulting instruction is restarted.
+ */
+struct ukplat_page_fault_ctx {
+	struct __regs *regs;
+	__uptr addr;		/* Faulting virtual address */
+	unsigned long flags;	/* UKPLAT_PAGE_FAULT_* flags */
+};
+
+/**
+ * Maps a range of physical memory at the given virtual address. Existing
+ * mappings in the range are replaced. The largest page size that the
+ * alignment of the addresses and the length permit is used.
+ *
+ * Some architectures cannot map pages that are not readable. There,
+ * UKPLAT_PAGE_ATTR_PROT_READ is implied.
+ *
+ * @param vaddr virtual address of the mapping, page-aligned
+ * @param paddr physical address that is mapped at vaddr, page-aligned
+ * @param len length of the mapping in bytes, multiple of the page size
+ * @param attr attributes of the mapping (see UKPLAT_PAGE_ATTR_* flags)
+ *
+ * @return 0 on success, an errno-type error value otherwise
+ */
+int ukplat_page_map(void *vaddr, __phys_addr paddr, __sz len,
+		    unsigned long attr);
+
+/**
+ * Removes the mappings of a range of virtual memory. Large pages that are
+ * only partially covered by the range are split. Unmapped pages in the range
+ * are skipped.
+ *
+ * @param vaddr start of the range, page-aligned
+ * @param len length of the range in bytes, multiple of the page size
+ *
+ * @return 0 on success, an errno-type error value otherwise
+ */
+int ukplat_page_unmap(void *vaddr, __sz len);
+
+/**
+ * Changes the attributes of the mappings in a range of virtual memory. Large
+ * pages that are only partially covered by the range are split.
+ *
+ * @param vaddr start of the range, page-aligned
+ * @param len length of the range in bytes, multiple of the page size
+ * @param attr new attributes of the mappings (see UKPLAT_PAGE_ATTR_* flags)
+ *
+ * @return 0 on success, -ENOENT if the range contains unmapped pages (the
+ *   pages in front of the first unmapped page are changed), an errno-type
+ *   error value otherwise
+ */
+int ukplat_page_set_attr(void *vaddr, __sz len, unsigned long attr);
+
+/**
+ * Allocates the page tables that are needed to map pages into a range of
+ * virtual memory. The tables are kept when pages of the range are unmapped,
+ * so that pages can be mapped into the range with ukplat_page_map_prepared()
+ * afterwards. The range must not be mapped with large pages.
+ *
+ * @param vaddr start of the range, page-aligned
+ * @param len length of the range in bytes, multiple of the page size
+ *
+ * @return 0 on success, an errno-type error value otherwise
+ */
+int ukplat_page_prepare(void *vaddr, __sz len);
+
+/**
+ * Maps a single page into a range that was prepared with
+ * ukplat_page_prepare(). Unlike ukplat_page_map(), this function neither
+ * takes locks nor allocates memory. It can be called from the page fault
+ * handler, even if the faulting code was changing the page tables.
+ *
+ * @param vaddr virtual address of the page, page-aligned
+ * @param paddr physical address that is mapped at vaddr, page-aligned
+ * @param attr attributes of the mapping (see UKPLAT_PAGE_ATTR_* flags)
+ *
+ * @return 0 on success, -EEXIST if the page is mapped already, -ENOENT if
+ *   the range was not prepared, an errno-type error value otherwise
+ */
+int ukplat_page_map_prepared(void *vaddr, __phys_addr paddr,
+			     unsigned long attr);
+
+/**
+ * Looks up the physical address that a virtual address is mapped to.
+ *
+ * @param vaddr virtual address to look up
+ * @param paddr pointer that receives the physical address
+ *
+ * @return 0 on success, -ENOENT if the address is not mapped
+ */
+int ukplat_page_lookup(const void *vaddr, __phys_addr *paddr);
+
+/**
+ * Allocates a range of virtual addresses that the platform does not use for
+ * its own mappings. The range is not backed by memory: pages are mapped into
+ * it with ukplat_page_map(). Ranges cannot be returned.
+ *
+ * @param len length of the range in bytes
+ *
+ * @return start of the range, or NULL if the address space is exhausted
+ */
+void *ukplat_page_vaddr_alloc(__sz len);
+
+#endif /* CONFIG_HAVE_PAGING */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UKPLAT_PAGING_H__ */
@@ -45,6 +45,18 @@ void ukplat_time_init(void);
 void ukplat_time_fini(void);
 uint32_t ukplat_time_get_irq(void);
 
+/**
+ * Requests the timer IRQ (see ukplat_time_get_irq()) on the current logical
+ * CPU at the given deadline. The interrupt may happen earlier, for instance
+ * when the CPU halts with an earlier timeout, and slightly later if the
+ * deadline is too close to program the timer. Requesting a new deadline
+ * replaces the previous one.
+ *
+ * @param deadline Monotonic clock time in nanoseconds, 0 to cancel the
+ *   request
+ */
+void ukplat_time_set_deadline(__nsec deadline);
+
 __nsec ukplat_time_get_ticks(void);
 __nsec ukplat_monotonic_clock(void);
 __nsec ukplat_wall_clock(void);
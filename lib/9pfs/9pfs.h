@@ -34,7 +34,13 @@
 #define __UK_9PFS__
 
 #include <stdbool.h>
+#include <sys/types.h>
+#include <uk/config.h>
+#include <uk/arch/time.h>
+#include <uk/list.h>
+#include <uk/mutex.h>
 #include <uk/9pdev.h>
+#include <uk/9preq.h>
 #include <uk/9pfid.h>
 
 #include <vfscore/prex.h>
@@ -47,6 +53,25 @@ enum uk_9pfs_proto {
 	UK_9P_PROTO_MAX
 };
 
+/*
+ * Caching modes, selected with the "cache=" mount option. The names follow
+ * the Linux v9fs client.
+ */
+enum uk_9pfs_cache_mode {
+	/* Every lookup, stat and open goes to the server (default). */
+	UK_9PFS_CACHE_NONE,
+	/*
+	 * Attributes and walked fids are cached for the attribute timeout,
+	 * opened fids are reused. Changes made by other clients of the same
+	 * export may go unnoticed until the cached data expires.
+	 */
+	UK_9PFS_CACHE_LOOSE,
+	UK_9PFS_CACHE_MAX
+};
+
+/* Number of buckets of the per-mount walk cache. */
+#define UK_9PFS_WALK_BUCKETS	64
+
 struct uk_9pfs_mount_data {
 	/* 9P device. */
 	struct uk_9pdev		*dev;
@@ -58,8 +83,33 @@ struct uk_9pfs_mount_data {
 	const char		*uname;
 	/* File tree to access when offered multiple exported filesystems. */
 	const char		*aname;
+	/* Caching mode. */
+	enum uk_9pfs_cache_mode	cache;
+	/* Lifetime of cached attributes and walk results. */
+	__nsec			attr_timeout;
+	/* Protects the walk cache. */
+	struct uk_mutex		walk_lock;
+	/* Walk results, hashed by parent qid and name. */
+	struct uk_hlist_head	walk_hash[UK_9PFS_WALK_BUCKETS];
+	/* Walk results in least recently used order. */
+	struct uk_list_head	walk_lru;
+	/* Number of entries in the walk cache. */
+	unsigned int		walk_count;
+};
+
+/* Subset of the 9P stat fields used by 9pfs. */
+struct uk_9pfs_attr {
+	uint32_t               mode;
+	uint64_t               length;
+	uint32_t               atime;
+	uint32_t               mtime;
+	/* Time after which the attributes are stale, 0 if invalid. */
+	__nsec                 expiry;
 };
 
+/* Number of opened fids a vnode keeps for reuse. */
+#define UK_9PFS_OPEN_FIDS	2
+
 struct uk_9pfs_file_data {
 	/* Fid associated with the 9pfs file. */
 	struct uk_9pfid        *fid;
@@ -75,6 +125,22 @@ struct uk_9pfs_file_data {
 	int                    readdir_off;
 	/* Total size of the data in the readdir buf. */
 	int                    readdir_sz;
+	/* 9P open mode of fid, without OTRUNC/OEXCL. */
+	uint32_t               open_mode;
+#if CONFIG_LIB9PFS_READAHEAD
+	/* File offset at which the previous read() ended. */
+	off_t                  next_off;
+	/* In-flight read-ahead request, NULL if none. */
+	struct uk_9preq        *ra_req;
+	/* Buffer holding read-ahead data. */
+	char                   *ra_buf;
+	/* File offset of the first byte in ra_buf. */
+	off_t                  ra_off;
+	/* Number of valid bytes in ra_buf. */
+	uint32_t               ra_len;
+	/* Node write generation at the time the read-ahead was issued. */
+	unsigned long          ra_wgen;
+#endif
 };
 
 struct uk_9pfs_node_data {
@@ -84,11 +150,47 @@ struct uk_9pfs_node_data {
 	int                    nb_open_files;
 	/* Is a 9P remove call required when nb_open_files reaches 0? */
 	bool                   removed;
+	/* Incremented on every write, invalidates read-ahead data. */
+	unsigned long          wgen;
+	/* Cached attributes (cache=loose). */
+	struct uk_9pfs_attr    attr;
+	/* Opened fids kept after close for reuse, and their modes. */
+	struct uk_9pfid        *open_fids[UK_9PFS_OPEN_FIDS];
+	uint32_t               open_modes[UK_9PFS_OPEN_FIDS];
 };
 
 int uk_9pfs_allocate_vnode_data(struct vnode *vp, struct uk_9pfid *fid);
 void uk_9pfs_free_vnode_data(struct vnode *vp);
 
+/*
+ * Cache helpers, see 9pfs_cache.c. All of them are no-ops if the mount
+ * uses cache=none.
+ */
+void uk_9pfs_cache_init(struct uk_9pfs_mount_data *md);
+void uk_9pfs_cache_destroy(struct uk_9pfs_mount_data *md);
+
+struct uk_9pfid *uk_9pfs_walk_cache_get(struct uk_9pfs_mount_data *md,
+		struct uk_9pfid *dfid, const char *name,
+		struct uk_9pfs_attr *attr);
+void uk_9pfs_walk_cache_add(struct uk_9pfs_mount_data *md,
+		struct uk_9pfid *dfid, const char *name,
+		struct uk_9pfid *fid, const struct uk_9pfs_attr *attr);
+void uk_9pfs_walk_cache_remove(struct uk_9pfs_mount_data *md,
+		struct uk_9pfid *dfid, const char *name);
+void uk_9pfs_walk_cache_forget(struct uk_9pfs_mount_data *md,
+		struct uk_9pfid *fid);
+
+void uk_9pfs_attr_from_stat(struct uk_9pfs_mount_data *md,
+		struct uk_9pfs_attr *attr, const struct uk_9p_stat *stat);
+bool uk_9pfs_attr_get(struct vnode *vp, struct uk_9pfs_attr *attr);
+void uk_9pfs_attr_set(struct vnode *vp, const struct uk_9pfs_attr *attr);
+void uk_9pfs_attr_invalidate(struct vnode *vp);
+
+struct uk_9pfid *uk_9pfs_open_fid_get(struct vnode *vp, uint32_t mode);
+bool uk_9pfs_open_fid_put(struct vnode *vp, struct uk_9pfid *fid,
+		uint32_t mode);
+void uk_9pfs_open_fids_release(struct vnode *vp);
+
 /* Default readdir buffer size. */
 #define UK_9PFS_READDIR_BUFSZ	8192
 
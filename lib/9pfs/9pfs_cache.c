@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <uk/config.h>
+#include <uk/assert.h>
+#include <uk/plat/time.h>
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+
+#include "9pfs.h"
+
+/*
+ * Walk cache. Remembers the fid and attributes obtained by walking to a name
+ * from a directory so that looking up the same name again while the entry is
+ * fresh needs no Twalk/Tstat round trip. The cached fid is shared with the
+ * vnodes created from it; it is never opened, only cloned and stat'ed.
+ */
+struct uk_9pfs_walk_entry {
+	struct uk_hlist_node   link;
+	struct uk_list_head    lru;
+	/* Qid path of the directory the name was walked from. */
+	uint64_t               dir;
+	struct uk_9pfid        *fid;
+	struct uk_9pfs_attr    attr;
+	char                   name[];
+};
+
+static unsigned int uk_9pfs_walk_hash(uint64_t dir, const char *name)
+{
+	unsigned int val = (unsigned int)(dir ^ (dir >> 32));
+
+	while (*name)
+		val = ((val << 5) + val) + *name++;
+
+	return val & (UK_9PFS_WALK_BUCKETS - 1);
+}
+
+static inline bool uk_9pfs_cache_enabled(struct uk_9pfs_mount_data *md)
+{
+	return md->cache != UK_9PFS_CACHE_NONE && md->attr_timeout;
+}
+
+void uk_9pfs_cache_init(struct uk_9pfs_mount_data *md)
+{
+	int i;
+
+	uk_mutex_init(&md->walk_lock);
+	for (i = 0; i < UK_9PFS_WALK_BUCKETS; i++)
+		UK_INIT_HLIST_HEAD(&md->walk_hash[i]);
+	UK_INIT_LIST_HEAD(&md->walk_lru);
+	md->walk_count = 0;
+}
+
+static struct uk_9pfs_walk_entry *
+uk_9pfs_walk_find(struct uk_9pfs_mount_data *md, uint64_t dir,
+		  const char *name)
+{
+	struct uk_9pfs_walk_entry *we;
+
+	uk_hlist_for_each_entry(we, &md->walk_hash[uk_9pfs_walk_hash(dir, name)],
+				link) {
+		if (we->dir == dir && !strcmp(we->name, name))
+			return we;
+	}
+
+	return NULL;
+}
+
+/* Must be called with walk_lock held. The caller frees the entry. */
+static void uk_9pfs_walk_unlink(struct uk_9pfs_mount_data *md,
+				struct uk_9pfs_walk_entry *we)
+{
+	uk_hlist_del(&we->link);
+	uk_list_del(&we->lru);
+	md->walk_count--;
+}
+
+/* Dropping the fid may clunk it, so never call this with walk_lock held. */
+static void uk_9pfs_walk_free(struct uk_9pfs_walk_entry *we)
+{
+	if (!we)
+		return;
+
+	uk_9pfid_put(we->fid);
+	free(we);
+}
+
+void uk_9pfs_cache_destroy(struct uk_9pfs_mount_data *md)
+{
+	struct uk_9pfs_walk_entry *we;
+
+	for (;;) {
+		uk_mutex_lock(&md->walk_lock);
+		we = uk_list_first_entry_or_null(&md->walk_lru,
+				struct uk_9pfs_walk_entry, lru);
+		if (we)
+			uk_9pfs_walk_unlink(md, we);
+		uk_mutex_unlock(&md->walk_lock);
+
+		if (!we)
+			break;
+		uk_9pfs_walk_free(we);
+	}
+}
+
+struct uk_9pfid *uk_9pfs_walk_cache_get(struct uk_9pfs_mount_data *md,
+		struct uk_9pfid *dfid, const char *name,
+		struct uk_9pfs_attr *attr)
+{
+	struct uk_9pfs_walk_entry *we, *stale = NULL;
+	struct uk_9pfid *fid = NULL;
+
+	if (!uk_9pfs_cache_enabled(md))
+		return NULL;
+
+	uk_mutex_lock(&md->walk_lock);
+	we = uk_9pfs_walk_find(md, dfid->qid.path, name);
+	if (we && ukplat_monotonic_clock() >= we->attr.expiry) {
+		uk_9pfs_walk_unlink(md, we);
+		stale = we;
+	} else if (we) {
+		uk_list_del(&we->lru);
+		uk_list_add(&we->lru, &md->walk_lru);
+		uk_9pfid_get(we->fid);
+		fid = we->fid;
+		*attr = we->attr;
+	}
+	uk_mutex_unlock(&md->walk_lock);
+
+	uk_9pfs_walk_free(stale);
+	return fid;
+}
+
+void uk_9pfs_walk_cache_add(struct uk_9pfs_mount_data *md,
+		struct uk_9pfid *dfid, const char *name,
+		struct uk_9pfid *fid, const struct uk_9pfs_attr *attr)
+{
+	struct uk_9pfs_walk_entry *we, *old, *evicted = NULL;
+	size_t len;
+
+	if (!uk_9pfs_cache_enabled(md))
+		return;
+
+	len = strlen(name);
+	we = malloc(sizeof(*we) + len + 1);
+	if (!we)
+		return;
+
+	we->dir = dfid->qid.path;
+	we->fid = fid;
+	we->attr = *attr;
+	memcpy(we->name, name, len + 1);
+	uk_9pfid_get(fid);
+
+	uk_mutex_lock(&md->walk_lock);
+	old = uk_9pfs_walk_find(md, we->dir, name);
+	if (old) {
+		uk_9pfs_walk_unlink(md, old);
+	} else if (md->walk_count >= CONFIG_LIB9PFS_WALK_CACHE_SIZE) {
+		evicted = uk_list_entry(md->walk_lru.prev,
+				struct uk_9pfs_walk_entry, lru);
+		uk_9pfs_walk_unlink(md, evicted);
+	}
+	uk_hlist_add_head(&we->link,
+			  &md->walk_hash[uk_9pfs_walk_hash(we->dir, name)]);
+	uk_list_add(&we->lru, &md->walk_lru);
+	md->walk_count++;
+	uk_mutex_unlock(&md->walk_lock);
+
+	uk_9pfs_walk_free(old);
+	uk_9pfs_walk_free(evicted);
+}
+
+void uk_9pfs_walk_cache_remove(struct uk_9pfs_mount_data *md,
+		struct uk_9pfid *dfid, const char *name)
+{
+	struct uk_9pfs_walk_entry *we;
+
+	if (md->cache == UK_9PFS_CACHE_NONE)
+		return;
+
+	uk_mutex_lock(&md->walk_lock);
+	we = uk_9pfs_walk_find(md, dfid->qid.path, name);
+	if (we)
+		uk_9pfs_walk_unlink(md, we);
+	uk_mutex_unlock(&md->walk_lock);
+
+	uk_9pfs_walk_free(we);
+}
+
+void uk_9pfs_walk_cache_forget(struct uk_9pfs_mount_data *md,
+		struct uk_9pfid *fid)
+{
+	struct uk_9pfs_walk_entry *we, *found;
+
+	if (md->cache == UK_9PFS_CACHE_NONE)
+		return;
+
+	do {
+		found = NULL;
+		uk_mutex_lock(&md->walk_lock);
+		uk_list_for_each_entry(we, &md->walk_lru, lru) {
+			if (we->fid == fid) {
+				uk_9pfs_walk_unlink(md, we);
+				found = we;
+				break;
+			}
+		}
+		uk_mutex_unlock(&md->walk_lock);
+
+		uk_9pfs_walk_free(found);
+	} while (found);
+}
+
+void uk_9pfs_attr_from_stat(struct uk_9pfs_mount_data *md,
+		struct uk_9pfs_attr *attr, const struct uk_9p_stat *stat)
+{
+	attr->mode = stat->mode;
+	attr->length = stat->length;
+	attr->atime = stat->atime;
+	attr->mtime = stat->mtime;
+	attr->expiry = uk_9pfs_cache_enabled(md)
+		? ukplat_monotonic_clock() + md->attr_timeout : 0;
+}
+
+bool uk_9pfs_attr_get(struct vnode *vp, struct uk_9pfs_attr *attr)
+{
+	struct uk_9pfs_node_data *nd = UK_9PFS_ND(vp);
+
+	if (!nd->attr.expiry)
+		return false;
+
+	if (ukplat_monotonic_clock() >= nd->attr.expiry) {
+		nd->attr.expiry = 0;
+		return false;
+	}
+
+	*attr = nd->attr;
+	return true;
+}
+
+void uk_9pfs_attr_set(struct vnode *vp, const struct uk_9pfs_attr *attr)
+{
+	UK_9PFS_ND(vp)->attr = *attr;
+}
+
+void uk_9pfs_attr_invalidate(struct vnode *vp)
+{
+	UK_9PFS_ND(vp)->attr.expiry = 0;
+}
+
+struct uk_9pfid *uk_9pfs_open_fid_get(struct vnode *vp, uint32_t mode)
+{
+	struct uk_9pfs_node_data *nd = UK_9PFS_ND(vp);
+	struct uk_9pfid *fid;
+	int i;
+
+	for (i = 0; i < UK_9PFS_OPEN_FIDS; i++) {
+		if (nd->open_fids[i] && nd->open_modes[i] == mode) {
+			fid = nd->open_fids[i];
+			nd->open_fids[i] = NULL;
+			return fid;
+		}
+	}
+
+	return NULL;
+}
+
+bool uk_9pfs_open_fid_put(struct vnode *vp, struct uk_9pfid *fid,
+		uint32_t mode)
+{
+	struct uk_9pfs_node_data *nd = UK_9PFS_ND(vp);
+	int i;
+
+	/*
+	 * Directory fids carry the server side readdir offset, so only
+	 * regular files may have their opened fids reused.
+	 */
+	if (UK_9PFS_MD(vp->v_mount)->cache == UK_9PFS_CACHE_NONE ||
+	    vp->v_type != VREG || nd->removed)
+		return false;
+
+	for (i = 0; i < UK_9PFS_OPEN_FIDS; i++) {
+		if (!nd->open_fids[i]) {
+			nd->open_fids[i] = fid;
+			nd->open_modes[i] = mode;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void uk_9pfs_open_fids_release(struct vnode *vp)
+{
+	struct uk_9pfs_node_data *nd = UK_9PFS_ND(vp);
+	struct uk_9pfid *fid;
+	int i;
+
+	for (i = 0; i < UK_9PFS_OPEN_FIDS; i++) {
+		fid = nd->open_fids[i];
+		nd->open_fids[i] = NULL;
+		if (fid)
+			uk_9pfid_put(fid);
+	}
+}
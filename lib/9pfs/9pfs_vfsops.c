@@ -37,6 +37,7 @@
 #include <vfscore/mount.h>
 #include <vfscore/dentry.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "9pfs.h"
 
@@ -72,20 +73,86 @@ static const char *uk_9pfs_proto_str[UK_9P_PROTO_MAX] = {
 	[UK_9P_PROTO_2000U] = "9P2000.u"
 };
 
+static const char *uk_9pfs_cache_str[UK_9PFS_CACHE_MAX] = {
+	[UK_9PFS_CACHE_NONE]  = "none",
+	[UK_9PFS_CACHE_LOOSE] = "loose"
+};
+
+static int uk_9pfs_parse_cache(struct uk_9pfs_mount_data *md, const char *val)
+{
+	if (!strcmp(val, "none") || !strcmp(val, "mmap")) {
+		/* No page cache, mmap() is served by regular reads. */
+		md->cache = UK_9PFS_CACHE_NONE;
+	} else if (!strcmp(val, "loose") || !strcmp(val, "fscache")) {
+		/* There is no persistent cache backend, fscache is loose. */
+		md->cache = UK_9PFS_CACHE_LOOSE;
+	} else {
+		uk_pr_err("Unknown 9pfs cache mode: %s\n", val);
+		return EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Options are given as a comma-separated list:
+ *   cache=<none|loose|fscache|mmap>  Caching mode, see uk_9pfs_cache_mode
+ *   actimeo=<seconds>                Lifetime of cached attributes and walk
+ *                                    results, 0 disables caching
+ * Unknown options are ignored, they may be meant for the transport.
+ */
 static int uk_9pfs_parse_options(struct uk_9pfs_mount_data *md,
-		const void *data __unused)
+		const void *data)
 {
+	char *opts, *opt, *val, *end, *saveptr;
+	unsigned long sec;
 	int rc = 0;
 
 	md->trans = uk_9pdev_trans_get_default();
 	if (!md->trans)
 		goto out;
 
-	/* Currently, no options are supported. */
-
 	md->proto = UK_9P_PROTO_2000U;
 	md->uname = "";
 	md->aname = "";
+#if CONFIG_LIB9PFS_CACHE_LOOSE
+	md->cache = UK_9PFS_CACHE_LOOSE;
+#else
+	md->cache = UK_9PFS_CACHE_NONE;
+#endif
+	md->attr_timeout =
+		ukarch_time_sec_to_nsec(CONFIG_LIB9PFS_ATTR_TIMEOUT);
+
+	if (!data || !*(const char *)data)
+		goto out;
+
+	opts = strdup(data);
+	if (!opts)
+		return ENOMEM;
+
+	for (opt = strtok_r(opts, ",", &saveptr); opt;
+	     opt = strtok_r(NULL, ",", &saveptr)) {
+		val = strchr(opt, '=');
+		if (!val)
+			continue;
+		*val++ = '\0';
+
+		if (!strcmp(opt, "cache")) {
+			rc = uk_9pfs_parse_cache(md, val);
+			if (rc)
+				break;
+		} else if (!strcmp(opt, "actimeo")) {
+			sec = strtoul(val, &end, 10);
+			if (*end != '\0') {
+				uk_pr_err("Invalid 9pfs actimeo: %s\n", val);
+				rc = EINVAL;
+				break;
+			}
+			md->attr_timeout = ukarch_time_sec_to_nsec(sec);
+		}
+	}
+
+	free(opts);
 
 out:
 	return rc;
@@ -105,7 +172,7 @@ static int uk_9pfs_mount(struct mount *mp, const char *dev,
 	mp->m_root->d_vnode->v_data = NULL;
 
 	/* Allocate mount data, parse options. */
-	md = malloc(sizeof(*md));
+	md = calloc(1, sizeof(*md));
 	if (!md)
 		return ENOMEM;
 
@@ -113,8 +180,19 @@ static int uk_9pfs_mount(struct mount *mp, const char *dev,
 	if (rc)
 		goto out_free_mdata;
 
+	uk_9pfs_cache_init(md);
+	uk_pr_debug("9pfs: cache=%s actimeo=%" __PRInsec "ns\n",
+		    uk_9pfs_cache_str[md->cache], md->attr_timeout);
+
 	mp->m_data = md;
 
+	/*
+	 * Files created on the host are hidden by negative dentries until
+	 * they expire, so they are only used with cache=loose.
+	 */
+	if (md->cache == UK_9PFS_CACHE_LOOSE)
+		mp->m_dneg_timeout = md->attr_timeout;
+
 	/* Establish connection with the given 9P endpoint. */
 	md->dev = uk_9pdev_connect(md->trans, dev, data, NULL);
 	if (PTRISERR(md->dev)) {
@@ -180,6 +258,7 @@ static int uk_9pfs_unmount(struct mount *mp, int flags __unused)
 
 	uk_9pfs_release_tree_fids(mp->m_root);
 	vfscore_release_mp_dentries(mp);
+	uk_9pfs_cache_destroy(md);
 	uk_9pdev_disconnect(md->dev);
 	free(md);
 
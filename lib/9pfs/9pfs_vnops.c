@@ -35,7 +35,9 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <stdlib.h>
+#include <string.h>
 #include <uk/config.h>
+#include <uk/assert.h>
 #include <uk/9p.h>
 #include <uk/errptr.h>
 #include <vfscore/mount.h>
@@ -129,13 +131,14 @@ int uk_9pfs_allocate_vnode_data(struct vnode *vp, struct uk_9pfid *fid)
 {
 	struct uk_9pfs_node_data *nd;
 
-	nd = malloc(sizeof(*nd));
+	nd = calloc(1, sizeof(*nd));
 	if (nd == NULL)
 		return -ENOMEM;
 
 	nd->fid = fid;
 	nd->nb_open_files = 0;
 	nd->removed = false;
+	nd->wgen = 0;
 	vp->v_data = nd;
 
 	return 0;
@@ -149,6 +152,12 @@ void uk_9pfs_free_vnode_data(struct vnode *vp)
 	if (!vp->v_data)
 		return;
 
+	uk_9pfs_open_fids_release(vp);
+
+	/* Cached walk results of a written file carry a stale length. */
+	if (nd->wgen)
+		uk_9pfs_walk_cache_forget(UK_9PFS_MD(vp->v_mount), nd->fid);
+
 	if (nd->removed)
 		uk_9p_remove(dev, nd->fid);
 
@@ -160,8 +169,10 @@ void uk_9pfs_free_vnode_data(struct vnode *vp)
 static int uk_9pfs_open(struct vfscore_file *file)
 {
 	struct uk_9pdev *dev = UK_9PFS_MD(file->f_dentry->d_mount)->dev;
+	struct vnode *vp = file->f_dentry->d_vnode;
 	struct uk_9pfid *openedfid;
 	struct uk_9pfs_file_data *fd;
+	uint32_t mode;
 	int rc;
 
 	/* Allocate memory for file data. */
@@ -169,21 +180,35 @@ static int uk_9pfs_open(struct vfscore_file *file)
 	if (!fd)
 		return ENOMEM;
 
+	mode = uk_9pfs_open_mode_from_posix_flags(file->f_flags);
+	fd->open_mode = mode & ~(UK_9P_OEXCL | UK_9P_OTRUNC);
+
+	/* Reuse a fid opened by a previous open(), unless truncating. */
+	if (!(mode & UK_9P_OTRUNC)) {
+		openedfid = uk_9pfs_open_fid_get(vp, fd->open_mode);
+		if (openedfid)
+			goto out_opened;
+	}
+
 	/* Clone fid. */
-	openedfid = uk_9p_walk(dev, UK_9PFS_VFID(file->f_dentry->d_vnode),
-			NULL);
+	openedfid = uk_9p_walk(dev, UK_9PFS_VFID(vp), NULL);
 	if (PTRISERR(openedfid)) {
 		rc = PTR2ERR(openedfid);
 		goto out;
 	}
 
 	/* Open cloned fid. */
-	rc = uk_9p_open(dev, openedfid,
-		uk_9pfs_open_mode_from_posix_flags(file->f_flags));
+	rc = uk_9p_open(dev, openedfid, mode);
 
 	if (rc)
 		goto out_err;
 
+	if (mode & UK_9P_OTRUNC) {
+		vp->v_size = 0;
+		uk_9pfs_attr_invalidate(vp);
+	}
+
+out_opened:
 	fd->fid = openedfid;
 	file->f_data = fd;
  	UK_9PFS_ND(file->f_dentry->d_vnode)->nb_open_files++;
@@ -197,33 +222,137 @@ out:
 	return -rc;
 }
 
-static int uk_9pfs_close(struct vnode *vn __unused, struct vfscore_file *file)
+#if CONFIG_LIB9PFS_READAHEAD
+static void uk_9pfs_ra_drop(struct uk_9pdev *dev, struct uk_9pfs_file_data *fd)
+{
+	/* The reply still targets ra_buf, wait for it before reusing. */
+	if (fd->ra_req) {
+		uk_9p_read_complete(dev, fd->ra_req);
+		fd->ra_req = NULL;
+	}
+	fd->ra_len = 0;
+}
+
+static void uk_9pfs_ra_start(struct vnode *vp, struct uk_9pfs_file_data *fd,
+			     off_t offset)
+{
+	struct uk_9pdev *dev = UK_9PFS_MD(vp->v_mount)->dev;
+	uint32_t count = uk_9p_read_maxcount(dev, fd->fid);
+	struct uk_9preq *req;
+
+	UK_ASSERT(!fd->ra_req && !fd->ra_len);
+
+	if (offset >= (off_t) vp->v_size)
+		return;
+
+	if (!fd->ra_buf) {
+		fd->ra_buf = malloc(count);
+		if (!fd->ra_buf)
+			return;
+	}
+
+	req = uk_9p_read_submit(dev, fd->fid, offset, count, fd->ra_buf);
+	if (PTRISERR(req))
+		return;
+
+	fd->ra_req = req;
+	fd->ra_off = offset;
+	fd->ra_wgen = UK_9PFS_ND(vp)->wgen;
+}
+
+/*
+ * Serves the beginning of the read from the read-ahead buffer, if it
+ * covers the read offset. Returns a positive errno on failure.
+ */
+static int uk_9pfs_ra_consume(struct vnode *vp, struct uk_9pfs_file_data *fd,
+			      struct uio *uio)
+{
+	struct uk_9pdev *dev = UK_9PFS_MD(vp->v_mount)->dev;
+	int64_t rc;
+	size_t skip, len;
+
+	if (!fd->ra_req && !fd->ra_len)
+		return 0;
+
+	if (fd->ra_wgen != UK_9PFS_ND(vp)->wgen ||
+	    uio->uio_offset < fd->ra_off ||
+	    uio->uio_offset >= fd->ra_off + uk_9p_read_maxcount(dev, fd->fid)) {
+		uk_9pfs_ra_drop(dev, fd);
+		return 0;
+	}
+
+	if (fd->ra_req) {
+		rc = uk_9p_read_complete(dev, fd->ra_req);
+		fd->ra_req = NULL;
+		/* Errors are reported by the regular read path. */
+		fd->ra_len = rc > 0 ? rc : 0;
+	}
+
+	skip = uio->uio_offset - fd->ra_off;
+	if (skip >= fd->ra_len) {
+		fd->ra_len = 0;
+		return 0;
+	}
+
+	len = MIN(fd->ra_len - skip, (size_t) uio->uio_resid);
+	rc = vfscore_uiomove(fd->ra_buf + skip, len, uio);
+	if (rc)
+		return rc;
+
+	if (skip + len == fd->ra_len) {
+		fd->ra_len = 0;
+	} else {
+		/* Keep the remaining data at the start of the buffer. */
+		memmove(fd->ra_buf, fd->ra_buf + skip + len,
+			fd->ra_len - skip - len);
+		fd->ra_len -= skip + len;
+		fd->ra_off += skip + len;
+	}
+
+	return 0;
+}
+#endif /* CONFIG_LIB9PFS_READAHEAD */
+
+static int uk_9pfs_close(struct vnode *vn, struct vfscore_file *file)
 {
 	struct uk_9pfs_file_data *fd = UK_9PFS_FD(file);
 
 	if (fd->readdir_buf)
 		free(fd->readdir_buf);
 
-	uk_9pfid_put(fd->fid);
+#if CONFIG_LIB9PFS_READAHEAD
+	uk_9pfs_ra_drop(UK_9PFS_MD(file->f_dentry->d_mount)->dev, fd);
+	if (fd->ra_buf)
+		free(fd->ra_buf);
+#endif
+
+	if (!uk_9pfs_open_fid_put(vn, fd->fid, fd->open_mode))
+		uk_9pfid_put(fd->fid);
 	free(fd);
-	UK_9PFS_ND(file->f_dentry->d_vnode)->nb_open_files--;
+	UK_9PFS_ND(vn)->nb_open_files--;
 
 	return 0;
 }
 
 static int uk_9pfs_lookup(struct vnode *dvp, char *name, struct vnode **vpp)
 {
-	struct uk_9pdev *dev = UK_9PFS_MD(dvp->v_mount)->dev;
+	struct uk_9pfs_mount_data *md = UK_9PFS_MD(dvp->v_mount);
+	struct uk_9pdev *dev = md->dev;
 	struct uk_9pfid *dfid = UK_9PFS_VFID(dvp);
 	struct uk_9pfid *fid;
 	struct uk_9p_stat stat;
 	struct uk_9preq *stat_req;
+	struct uk_9pfs_attr attr;
 	struct vnode *vp;
 	int rc;
 
 	if (strlen(name) > NAME_MAX)
 		return ENAMETOOLONG;
 
+	fid = uk_9pfs_walk_cache_get(md, dfid, name, &attr);
+	if (fid)
+		goto out_walked;
+
 	fid = uk_9p_walk(dev, dfid, name);
 	if (PTRISERR(fid)) {
 		rc = PTR2ERR(fid);
@@ -239,7 +368,12 @@ static int uk_9pfs_lookup(struct vnode *dvp, char *name, struct vnode **vpp)
 	/* No stat string fields are used below. */
 	uk_9pdev_req_remove(dev, stat_req);
 
-	if (vfscore_vget(dvp->v_mount, uk_9pfs_ino(&stat), &vp)) {
+	uk_9pfs_attr_from_stat(md, &attr, &stat);
+	uk_9pfs_walk_cache_add(md, dfid, name, fid, &attr);
+
+out_walked:
+	/* The qid of a walked fid is the one of the walk's target. */
+	if (vfscore_vget(dvp->v_mount, fid->qid.path, &vp)) {
 		/* Already in cache. */
 		rc = 0;
 		*vpp = vp;
@@ -254,14 +388,16 @@ static int uk_9pfs_lookup(struct vnode *dvp, char *name, struct vnode **vpp)
 	}
 
 	vp->v_flags = 0;
-	vp->v_mode = uk_9pfs_posix_mode_from_mode(stat.mode);
-	vp->v_type = uk_9pfs_vtype_from_mode(stat.mode);
-	vp->v_size = stat.length;
+	vp->v_mode = uk_9pfs_posix_mode_from_mode(attr.mode);
+	vp->v_type = uk_9pfs_vtype_from_mode(attr.mode);
+	vp->v_size = attr.length;
 
 	rc = uk_9pfs_allocate_vnode_data(vp, fid);
 	if (rc != 0)
 		goto out_fid;
 
+	uk_9pfs_attr_set(vp, &attr);
+
 	*vpp = vp;
 
 	return 0;
@@ -296,6 +432,7 @@ static int uk_9pfs_create_generic(struct vnode *dvp, char *name, mode_t mode)
 			UK_9P_OTRUNC | UK_9P_OWRITE, NULL);
 
 	uk_9pfid_put(fid);
+	uk_9pfs_attr_invalidate(dvp);
 	return -rc;
 }
 
@@ -307,6 +444,17 @@ static int uk_9pfs_create(struct vnode *dvp, char *name, mode_t mode)
 	return uk_9pfs_create_generic(dvp, name, mode);
 }
 
+static void uk_9pfs_remove_uncache(struct vnode *dvp, struct vnode *vp,
+		char *name)
+{
+	struct uk_9pfs_mount_data *md = UK_9PFS_MD(dvp->v_mount);
+
+	uk_9pfs_walk_cache_remove(md, UK_9PFS_VFID(dvp), name);
+	uk_9pfs_walk_cache_forget(md, UK_9PFS_VFID(vp));
+	uk_9pfs_open_fids_release(vp);
+	uk_9pfs_attr_invalidate(dvp);
+}
+
 static int uk_9pfs_remove_generic(struct vnode *dvp, struct vnode *vp)
 {
 	struct uk_9pdev *dev = UK_9PFS_MD(dvp->v_mount)->dev;
@@ -315,12 +463,13 @@ static int uk_9pfs_remove_generic(struct vnode *dvp, struct vnode *vp)
 	return -uk_9p_remove(dev, nd->fid);
 }
 
-static int uk_9pfs_remove(struct vnode *dvp, struct vnode *vp,
-		char *name __unused)
+static int uk_9pfs_remove(struct vnode *dvp, struct vnode *vp, char *name)
 {
 	struct uk_9pfs_node_data *nd = UK_9PFS_ND(vp);
 	int rc = 0;
 
+	uk_9pfs_remove_uncache(dvp, vp, name);
+
 	if (!nd->nb_open_files)
 		rc = uk_9pfs_remove_generic(dvp, vp);
 	else
@@ -337,9 +486,9 @@ static int uk_9pfs_mkdir(struct vnode *dvp, char *name, mode_t mode)
 	return uk_9pfs_create_generic(dvp, name, mode);
 }
 
-static int uk_9pfs_rmdir(struct vnode *dvp, struct vnode *vp,
-		char *name __unused)
+static int uk_9pfs_rmdir(struct vnode *dvp, struct vnode *vp, char *name)
 {
+	uk_9pfs_remove_uncache(dvp, vp, name);
 	return uk_9pfs_remove_generic(dvp, vp);
 }
 
@@ -427,13 +576,142 @@ out:
 	return -rc;
 }
 
+static void uk_9pfs_uio_advance(struct uio *uio, size_t len)
+{
+	struct iovec *iov;
+	size_t step;
+
+	while (len) {
+		iov = uio->uio_iov;
+		if (!iov->iov_len) {
+			uio->uio_iov++;
+			uio->uio_iovcnt--;
+			continue;
+		}
+
+		step = MIN(len, iov->iov_len);
+		iov->iov_base = (char *)iov->iov_base + step;
+		iov->iov_len -= step;
+		uio->uio_resid -= step;
+		uio->uio_offset += step;
+		len -= step;
+	}
+}
+
+/*
+ * Transfers the uio with up to CONFIG_LIB9PFS_IO_DEPTH TREAD/TWRITE requests
+ * in flight, each of at most one message size. Replies are consumed in
+ * submission order; a short transfer ends the operation and the replies to
+ * the requests behind it are discarded. Sets *partial if that happened.
+ *
+ * Returns a positive errno if nothing could be transferred.
+ */
+static int uk_9pfs_rw(struct uk_9pdev *dev, struct uk_9pfid *fid,
+		      struct uio *uio, bool *partial)
+{
+	struct uk_9preq *req[CONFIG_LIB9PFS_IO_DEPTH];
+	uint32_t len[CONFIG_LIB9PFS_IO_DEPTH];
+	unsigned int head = 0, inflight = 0, slot;
+	struct iovec *iov = uio->uio_iov;
+	int iovcnt = uio->uio_iovcnt;
+	char *base = iov->iov_base;
+	size_t left = iov->iov_len;
+	size_t resid = uio->uio_resid;
+	uint64_t offset = uio->uio_offset;
+	bool write = uio->uio_rw == UIO_WRITE;
+	uint32_t maxcount, count;
+	bool done = false;
+	ssize_t total = 0;
+	int64_t rc;
+	int err = 0;
+
+	maxcount = write ? uk_9p_write_maxcount(dev, fid)
+			 : uk_9p_read_maxcount(dev, fid);
+	*partial = false;
+
+	for (;;) {
+		/*
+		 * The submission cursor (iov, base, left) runs ahead of the
+		 * uio, which is only advanced as replies come in.
+		 */
+		while (!done && inflight < CONFIG_LIB9PFS_IO_DEPTH && resid) {
+			while (!left && iovcnt > 1) {
+				iov++;
+				iovcnt--;
+				base = iov->iov_base;
+				left = iov->iov_len;
+			}
+			if (!left) {
+				done = true;
+				break;
+			}
+
+			count = MIN(MIN(left, resid), maxcount);
+			slot = (head + inflight) % CONFIG_LIB9PFS_IO_DEPTH;
+			if (write)
+				req[slot] = uk_9p_write_submit(dev, fid, offset,
+							       count, base);
+			else
+				req[slot] = uk_9p_read_submit(dev, fid, offset,
+							      count, base);
+			if (PTRISERR(req[slot])) {
+				err = -PTR2ERR(req[slot]);
+				done = true;
+				break;
+			}
+
+			len[slot] = count;
+			inflight++;
+			base += count;
+			left -= count;
+			resid -= count;
+			offset += count;
+		}
+
+		if (!inflight)
+			break;
+
+		slot = head;
+		head = (head + 1) % CONFIG_LIB9PFS_IO_DEPTH;
+		inflight--;
+		rc = write ? uk_9p_write_complete(dev, req[slot])
+			   : uk_9p_read_complete(dev, req[slot]);
+
+		/* Still waiting for requests behind a short transfer. */
+		if (done)
+			continue;
+
+		if (rc < 0) {
+			err = -rc;
+			done = true;
+			continue;
+		}
+
+		uk_9pfs_uio_advance(uio, rc);
+		total += rc;
+		if ((uint32_t) rc < len[slot]) {
+			*partial = true;
+			done = true;
+		}
+	}
+
+	/* Report partial transfers as such, like read(2) and write(2). */
+	if (total)
+		return 0;
+	return err;
+}
+
 static int uk_9pfs_read(struct vnode *vp, struct vfscore_file *fp,
 			struct uio *uio, int ioflag __unused)
 {
 	struct uk_9pdev *dev = UK_9PFS_MD(vp->v_mount)->dev;
-	struct uk_9pfid *fid = UK_9PFS_FD(fp)->fid;
-	struct iovec *iov;
+	struct uk_9pfs_file_data *fd = UK_9PFS_FD(fp);
+	bool partial = false;
+	ssize_t resid;
 	int rc;
+#if CONFIG_LIB9PFS_READAHEAD
+	bool sequential;
+#endif
 
 	if (vp->v_type == VDIR)
 		return EISDIR;
@@ -447,21 +725,29 @@ static int uk_9pfs_read(struct vnode *vp, struct vfscore_file *fp,
 	if (!uio->uio_resid)
 		return 0;
 
-	iov = uio->uio_iov;
-	while (!iov->iov_len) {
-		uio->uio_iov++;
-		uio->uio_iovcnt--;
+	resid = uio->uio_resid;
+#if CONFIG_LIB9PFS_READAHEAD
+	sequential = (uio->uio_offset == fd->next_off);
+	rc = uk_9pfs_ra_consume(vp, fd, uio);
+	if (rc)
+		return rc;
+#endif
+
+	if (uio->uio_resid) {
+		rc = uk_9pfs_rw(dev, fd->fid, uio, &partial);
+		if (rc) {
+			/* Data from the read-ahead buffer is a short read. */
+			if (uio->uio_resid == resid)
+				return rc;
+			partial = true;
+		}
 	}
 
-	rc = uk_9p_read(dev, fid, uio->uio_offset,
-			   iov->iov_len, iov->iov_base);
-	if (rc < 0)
-		return -rc;
-
-	iov->iov_base = (char *)iov->iov_base + rc;
-	iov->iov_len -= rc;
-	uio->uio_resid -= rc;
-	uio->uio_offset += rc;
+#if CONFIG_LIB9PFS_READAHEAD
+	fd->next_off = uio->uio_offset;
+	if (sequential && !partial && !fd->ra_req && !fd->ra_len)
+		uk_9pfs_ra_start(vp, fd, uio->uio_offset);
+#endif
 
 	return 0;
 }
@@ -470,7 +756,8 @@ static int uk_9pfs_write(struct vnode *vp, struct uio *uio, int ioflag)
 {
 	struct uk_9pdev *dev = UK_9PFS_MD(vp->v_mount)->dev;
 	struct uk_9pfid *fid;
-	struct iovec *iov;
+	uint32_t mode;
+	bool partial;
 	int rc;
 
 	if (vp->v_type == VDIR)
@@ -487,39 +774,34 @@ static int uk_9pfs_write(struct vnode *vp, struct uio *uio, int ioflag)
 	if (ioflag & IO_APPEND)
 		uio->uio_offset = vp->v_size;
 
-	/* Clone vnode fid. */
-	fid = uk_9p_walk(dev, UK_9PFS_VFID(vp), NULL);
-	if (PTRISERR(fid))
-		return -PTR2ERR(fid);
-
-	rc = uk_9p_open(dev, fid, UK_9P_OWRITE);
-	if (rc < 0)
-		goto out;
-
-	if (!uio->uio_resid)
-		return 0;
-
-	iov = uio->uio_iov;
-	while (!iov->iov_len) {
-		uio->uio_iov++;
-		uio->uio_iovcnt--;
+	/* Reuse an opened fid if there is one, otherwise clone and open. */
+	mode = UK_9P_OWRITE;
+	fid = uk_9pfs_open_fid_get(vp, mode);
+	if (!fid) {
+		mode = UK_9P_ORDWR;
+		fid = uk_9pfs_open_fid_get(vp, mode);
 	}
+	if (!fid) {
+		mode = UK_9P_OWRITE;
+		fid = uk_9p_walk(dev, UK_9PFS_VFID(vp), NULL);
+		if (PTRISERR(fid))
+			return -PTR2ERR(fid);
 
-	rc = uk_9p_write(dev, fid, uio->uio_offset,
-			    iov->iov_len, iov->iov_base);
-	if (rc < 0)
-		return -rc;
+		rc = uk_9p_open(dev, fid, mode);
+		if (rc < 0) {
+			rc = -rc;
+			goto out;
+		}
+	}
 
-	iov->iov_base = (char *)iov->iov_base + rc;
-	iov->iov_len -= rc;
-	uio->uio_resid -= rc;
-	uio->uio_offset += rc;
+	/* Any read-ahead data and cached size is stale from now on. */
+	UK_9PFS_ND(vp)->wgen++;
+	uk_9pfs_attr_invalidate(vp);
 
-	if (rc < 0)
+	rc = uk_9pfs_rw(dev, fid, uio, &partial);
+	if (rc)
 		goto out;
 
-	rc = 0;
-
 	/*
 	 * If the uio offset after completion of the write requests is bigger
 	 * than the vnode's associated size, then the size must be updated
@@ -529,35 +811,44 @@ static int uk_9pfs_write(struct vnode *vp, struct uio *uio, int ioflag)
 		vp->v_size = uio->uio_offset;
 
 out:
-	uk_9pfid_put(fid);
-	return -rc;
+	if (rc || !uk_9pfs_open_fid_put(vp, fid, mode))
+		uk_9pfid_put(fid);
+	return rc;
 }
 
 static int uk_9pfs_getattr(struct vnode *vp, struct vattr *attr)
 {
-	struct uk_9pdev *dev = UK_9PFS_MD(vp->v_mount)->dev;
+	struct uk_9pfs_mount_data *md = UK_9PFS_MD(vp->v_mount);
 	struct uk_9pfid *fid = UK_9PFS_VFID(vp);
 	struct uk_9p_stat stat;
 	struct uk_9preq *stat_req;
+	struct uk_9pfs_attr cattr;
 	int rc = 0;
 
-	stat_req = uk_9p_stat(dev, fid, &stat);
+	if (uk_9pfs_attr_get(vp, &cattr))
+		goto out_fill;
+
+	stat_req = uk_9p_stat(md->dev, fid, &stat);
 	if (PTRISERR(stat_req)) {
 		rc = PTR2ERR(stat_req);
 		goto out;
 	}
 
 	/* No stat string fields are used below. */
-	uk_9pdev_req_remove(dev, stat_req);
+	uk_9pdev_req_remove(md->dev, stat_req);
+
+	uk_9pfs_attr_from_stat(md, &cattr, &stat);
+	uk_9pfs_attr_set(vp, &cattr);
 
-	attr->va_type = uk_9pfs_vtype_from_mode(stat.mode);
-	attr->va_mode = uk_9pfs_posix_mode_from_mode(stat.mode);
+out_fill:
+	attr->va_type = uk_9pfs_vtype_from_mode(cattr.mode);
+	attr->va_mode = uk_9pfs_posix_mode_from_mode(cattr.mode);
 	attr->va_nodeid = vp->v_ino;
-	attr->va_size = stat.length;
+	attr->va_size = cattr.length;
 
-	attr->va_atime.tv_sec = stat.atime;
+	attr->va_atime.tv_sec = cattr.atime;
 	attr->va_atime.tv_nsec = 0;
-	attr->va_mtime.tv_sec = stat.mtime;
+	attr->va_mtime.tv_sec = cattr.mtime;
 	attr->va_mtime.tv_nsec = 0;
 	attr->va_ctime.tv_sec = 0;
 	attr->va_ctime.tv_nsec = 0;
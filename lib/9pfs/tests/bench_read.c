@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/test.h>
+
+#define READ_BENCH_MAXBYTES	(1UL << 30)
+#define READ_BENCH_MAXCHUNK	(1UL << 20)
+
+static char read_bench_buf[READ_BENCH_MAXCHUNK];
+
+/* Reads the file from the start, returns the throughput in KiB/s */
+static unsigned long read_bench_run(int fd, unsigned long len,
+				    unsigned long chunk)
+{
+	unsigned long total = 0;
+	__nsec start, elapsed;
+	ssize_t ret;
+
+	if (lseek(fd, 0, SEEK_SET))
+		return 0;
+
+	start = ukplat_monotonic_clock();
+	while (total < len) {
+		ret = read(fd, read_bench_buf, MIN(chunk, len - total));
+		if (ret <= 0)
+			break;
+		total += ret;
+	}
+	elapsed = ukplat_monotonic_clock() - start;
+
+	if (total != len || !elapsed)
+		return 0;
+	return (unsigned long)((total >> 10) * 1000000000ULL / elapsed);
+}
+
+UK_TESTCASE(lib9pfs_read_benchsuite, lib9pfs_bench_read)
+{
+	static const unsigned long chunks[] = {
+		4UL << 10, 64UL << 10, 1UL << 20
+	};
+	unsigned long len, kibps;
+	struct stat st;
+	unsigned int i;
+	int fd;
+
+	fd = open(CONFIG_LIB9PFS_BENCH_FILE, O_RDONLY);
+	if (fd < 0) {
+		uk_test_printf("9pfs read: %s: %s, skipped\n",
+			       CONFIG_LIB9PFS_BENCH_FILE, strerror(errno));
+		return;
+	}
+	UK_TEST_EXPECT_ZERO(fstat(fd, &st));
+	len = MIN((unsigned long) st.st_size, READ_BENCH_MAXBYTES);
+
+	for (i = 0; i < ARRAY_SIZE(chunks); i++) {
+		kibps = read_bench_run(fd, len, chunks[i]);
+		UK_TEST_EXPECT_SNUM_GT(kibps, 0);
+
+		uk_test_printf("9pfs read: %lu MiB in %lu KiB chunks, "
+			       "io depth %d: %lu MiB/s\n",
+			       len >> 20, chunks[i] >> 10,
+			       CONFIG_LIB9PFS_IO_DEPTH, kibps >> 10);
+	}
+
+	close(fd);
+}
+
+uk_testsuite_register(lib9pfs_read_benchsuite, NULL);
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/test.h>
+
+#define STARTUP_BENCH_PASSES	3
+#define STARTUP_BENCH_MAXDEPTH	16
+#define STARTUP_BENCH_READSZ	512
+
+/*
+ * Mimics the startup of an interpreter that imports modules from a
+ * source tree: every file is looked up in a search path where it does not
+ * exist first, then stat()ed, opened and its header read.
+ */
+struct startup_bench {
+	char path[PATH_MAX];
+	char buf[STARTUP_BENCH_READSZ];
+	unsigned long files;
+	unsigned long dirs;
+	unsigned long errors;
+};
+
+static struct startup_bench sb;
+
+static void startup_bench_file(size_t len)
+{
+	struct stat st;
+	int fd;
+
+	/* The module is not in the first directory of the search path */
+	if (len + 5 >= sizeof(sb.path)) {
+		sb.errors++;
+		return;
+	}
+	memcpy(sb.path + len, ".pyc", 5);
+	if (stat(sb.path, &st) == 0 || errno != ENOENT)
+		sb.errors++;
+	sb.path[len] = '\0';
+
+	if (stat(sb.path, &st)) {
+		sb.errors++;
+		return;
+	}
+	fd = open(sb.path, O_RDONLY);
+	if (fd < 0) {
+		sb.errors++;
+		return;
+	}
+	if (read(fd, sb.buf, sizeof(sb.buf)) < 0)
+		sb.errors++;
+	close(fd);
+	sb.files++;
+}
+
+/* Walks the directory whose path is in sb.path, of length len */
+static void startup_bench_dir(size_t len, unsigned int depth)
+{
+	struct dirent *de;
+	struct stat st;
+	size_t nlen;
+	DIR *d;
+
+	d = opendir(sb.path);
+	if (!d) {
+		sb.errors++;
+		return;
+	}
+	sb.dirs++;
+
+	while ((de = readdir(d))) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+
+		nlen = strlen(de->d_name);
+		if (len + 1 + nlen >= sizeof(sb.path)) {
+			sb.errors++;
+			continue;
+		}
+		sb.path[len] = '/';
+		memcpy(sb.path + len + 1, de->d_name, nlen + 1);
+
+		if (lstat(sb.path, &st))
+			sb.errors++;
+		else if (S_ISDIR(st.st_mode) &&
+			 depth < STARTUP_BENCH_MAXDEPTH)
+			startup_bench_dir(len + 1 + nlen, depth + 1);
+		else if (S_ISREG(st.st_mode))
+			startup_bench_file(len + 1 + nlen);
+		sb.path[len] = '\0';
+	}
+	closedir(d);
+}
+
+UK_TESTCASE(lib9pfs_startup_benchsuite, lib9pfs_bench_startup)
+{
+	__nsec start, elapsed;
+	struct stat st;
+	unsigned int i;
+	size_t len;
+
+	len = strlen(CONFIG_LIB9PFS_BENCH_TREE);
+	if (stat(CONFIG_LIB9PFS_BENCH_TREE, &st) || !S_ISDIR(st.st_mode) ||
+	    len >= sizeof(sb.path)) {
+		uk_test_printf("9pfs startup: %s: not a directory, skipped\n",
+			       CONFIG_LIB9PFS_BENCH_TREE);
+		return;
+	}
+
+	/* The first pass is cold, the others may hit the caches */
+	for (i = 0; i < STARTUP_BENCH_PASSES; i++) {
+		memcpy(sb.path, CONFIG_LIB9PFS_BENCH_TREE, len + 1);
+		sb.files = sb.dirs = sb.errors = 0;
+
+		start = ukplat_monotonic_clock();
+		startup_bench_dir(len, 0);
+		elapsed = ukplat_monotonic_clock() - start;
+
+		UK_TEST_EXPECT_ZERO(sb.errors);
+		UK_TEST_EXPECT_SNUM_GT(sb.files, 0);
+		uk_test_printf("9pfs startup: pass %u: %lu files in %lu "
+			       "directories: %lu ms\n", i + 1, sb.files,
+			       sb.dirs, (unsigned long)
+			       ukarch_time_nsec_to_msec(elapsed));
+	}
+}
+
+uk_testsuite_register(lib9pfs_startup_benchsuite, NULL);
@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/refcount.h>
+#include <uk/9pfid.h>
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+#include <uk/test.h>
+
+#include "../9pfs.h"
+
+/*
+ * The caches only take and drop references on fids. The tests keep one
+ * reference on each fid, so no fid is ever clunked and no 9P device is
+ * needed.
+ */
+static void cache_fid_init(struct uk_9pfid *fid, uint64_t path)
+{
+	*fid = (struct uk_9pfid) { .qid = { .path = path } };
+	uk_refcount_init(&fid->refcount, 1);
+}
+
+static void cache_md_init(struct uk_9pfs_mount_data *md,
+			  enum uk_9pfs_cache_mode cache)
+{
+	*md = (struct uk_9pfs_mount_data) {
+		.cache = cache,
+		.attr_timeout = ukarch_time_sec_to_nsec(60),
+	};
+	uk_9pfs_cache_init(md);
+}
+
+static struct uk_9pfs_attr cache_attr(__nsec lifetime, uint64_t length)
+{
+	return (struct uk_9pfs_attr) {
+		.length = length,
+		.expiry = ukplat_monotonic_clock() + lifetime,
+	};
+}
+
+UK_TESTCASE(lib9pfs_cache_testsuite, lib9pfs_test_walk_cache)
+{
+	struct uk_9pfs_attr attr = cache_attr(ukarch_time_sec_to_nsec(60), 42);
+	struct uk_9pfs_mount_data md;
+	struct uk_9pfid dir, other, fid;
+
+	cache_fid_init(&dir, 1);
+	cache_fid_init(&other, 2);
+	cache_fid_init(&fid, 3);
+
+	/* cache=none caches nothing */
+	cache_md_init(&md, UK_9PFS_CACHE_NONE);
+	uk_9pfs_walk_cache_add(&md, &dir, "a", &fid, &attr);
+	UK_TEST_EXPECT_ZERO(md.walk_count);
+	UK_TEST_EXPECT_NULL(uk_9pfs_walk_cache_get(&md, &dir, "a", &attr));
+
+	/* A hit returns the fid with a new reference and its attributes */
+	cache_md_init(&md, UK_9PFS_CACHE_LOOSE);
+	uk_9pfs_walk_cache_add(&md, &dir, "a", &fid, &attr);
+	UK_TEST_EXPECT_SNUM_EQ(uk_refcount_read(&fid.refcount), 2);
+	attr.length = 0;
+	UK_TEST_EXPECT_PTR_EQ(uk_9pfs_walk_cache_get(&md, &dir, "a", &attr),
+			      &fid);
+	UK_TEST_EXPECT_SNUM_EQ(attr.length, 42);
+	UK_TEST_EXPECT_SNUM_EQ(uk_refcount_read(&fid.refcount), 3);
+	uk_9pfid_put(&fid);
+
+	/* Entries are keyed by directory and name */
+	UK_TEST_EXPECT_NULL(uk_9pfs_walk_cache_get(&md, &other, "a", &attr));
+	UK_TEST_EXPECT_NULL(uk_9pfs_walk_cache_get(&md, &dir, "b", &attr));
+
+	/* Adding the same name again replaces the entry */
+	uk_9pfs_walk_cache_add(&md, &dir, "a", &fid, &attr);
+	UK_TEST_EXPECT_SNUM_EQ(md.walk_count, 1);
+	UK_TEST_EXPECT_SNUM_EQ(uk_refcount_read(&fid.refcount), 2);
+
+	/* Removing the name drops the entry and its reference */
+	uk_9pfs_walk_cache_remove(&md, &dir, "a");
+	UK_TEST_EXPECT_ZERO(md.walk_count);
+	UK_TEST_EXPECT_SNUM_EQ(uk_refcount_read(&fid.refcount), 1);
+	UK_TEST_EXPECT_NULL(uk_9pfs_walk_cache_get(&md, &dir, "a", &attr));
+
+	/* Forgetting a fid drops every entry that refers to it */
+	uk_9pfs_walk_cache_add(&md, &dir, "a", &fid, &attr);
+	uk_9pfs_walk_cache_add(&md, &other, "a", &fid, &attr);
+	uk_9pfs_walk_cache_add(&md, &dir, "b", &other, &attr);
+	uk_9pfs_walk_cache_forget(&md, &fid);
+	UK_TEST_EXPECT_SNUM_EQ(md.walk_count, 1);
+	UK_TEST_EXPECT_SNUM_EQ(uk_refcount_read(&fid.refcount), 1);
+
+	/* Expired entries are not returned and are dropped on lookup */
+	attr = cache_attr(0, 0);
+	uk_9pfs_walk_cache_add(&md, &dir, "a", &fid, &attr);
+	UK_TEST_EXPECT_NULL(uk_9pfs_walk_cache_get(&md, &dir, "a", &attr));
+	UK_TEST_EXPECT_SNUM_EQ(md.walk_count, 1);
+	UK_TEST_EXPECT_SNUM_EQ(uk_refcount_read(&fid.refcount), 1);
+
+	uk_9pfs_cache_destroy(&md);
+	UK_TEST_EXPECT_ZERO(md.walk_count);
+	UK_TEST_EXPECT_SNUM_EQ(uk_refcount_read(&other.refcount), 1);
+}
+
+UK_TESTCASE(lib9pfs_cache_testsuite, lib9pfs_test_walk_cache_lru)
+{
+	struct uk_9pfs_attr attr = cache_attr(ukarch_time_sec_to_nsec(60), 0);
+	struct uk_9pfs_mount_data md;
+	struct uk_9pfid dir, fid;
+	char name[16];
+	unsigned int i;
+
+	cache_fid_init(&dir, 1);
+	cache_fid_init(&fid, 2);
+	cache_md_init(&md, UK_9PFS_CACHE_LOOSE);
+
+	for (i = 0; i < CONFIG_LIB9PFS_WALK_CACHE_SIZE; i++) {
+		snprintf(name, sizeof(name), "f%u", i);
+		uk_9pfs_walk_cache_add(&md, &dir, name, &fid, &attr);
+	}
+	UK_TEST_EXPECT_SNUM_EQ(md.walk_count, CONFIG_LIB9PFS_WALK_CACHE_SIZE);
+
+	/* A lookup makes the oldest entry the most recently used one... */
+	UK_TEST_EXPECT_PTR_EQ(uk_9pfs_walk_cache_get(&md, &dir, "f0", &attr),
+			      &fid);
+	uk_9pfid_put(&fid);
+
+	/* ...so the next one is evicted when the cache is full */
+	uk_9pfs_walk_cache_add(&md, &dir, "new", &fid, &attr);
+	UK_TEST_EXPECT_SNUM_EQ(md.walk_count, CONFIG_LIB9PFS_WALK_CACHE_SIZE);
+	UK_TEST_EXPECT_NOT_NULL(uk_9pfs_walk_cache_get(&md, &dir, "f0", &attr));
+	uk_9pfid_put(&fid);
+	if (CONFIG_LIB9PFS_WALK_CACHE_SIZE > 1)
+		UK_TEST_EXPECT_NULL(uk_9pfs_walk_cache_get(&md, &dir, "f1",
+							   &attr));
+	UK_TEST_EXPECT_SNUM_EQ(uk_refcount_read(&fid.refcount),
+			       CONFIG_LIB9PFS_WALK_CACHE_SIZE + 1);
+
+	uk_9pfs_cache_destroy(&md);
+	UK_TEST_EXPECT_SNUM_EQ(uk_refcount_read(&fid.refcount), 1);
+}
+
+static struct mount cache_mnt;
+
+UK_TESTCASE(lib9pfs_cache_testsuite, lib9pfs_test_node_cache)
+{
+	struct uk_9pfs_node_data nd = { .fid = NULL };
+	struct uk_9pfs_mount_data md;
+	struct uk_9pfid fid[3];
+	struct uk_9p_stat stat = { .length = 42 };
+	struct uk_9pfs_attr attr;
+	struct vnode vp = {
+		.v_mount = &cache_mnt,
+		.v_data = &nd,
+		.v_type = VREG,
+	};
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(fid); i++)
+		cache_fid_init(&fid[i], i + 1);
+	cache_mnt.m_data = &md;
+
+	/* Attributes are served until they expire or are invalidated */
+	cache_md_init(&md, UK_9PFS_CACHE_LOOSE);
+	uk_9pfs_attr_from_stat(&md, &attr, &stat);
+	uk_9pfs_attr_set(&vp, &attr);
+	attr.length = 0;
+	UK_TEST_EXPECT_NOT_ZERO(uk_9pfs_attr_get(&vp, &attr));
+	UK_TEST_EXPECT_SNUM_EQ(attr.length, 42);
+	uk_9pfs_attr_invalidate(&vp);
+	UK_TEST_EXPECT_ZERO(uk_9pfs_attr_get(&vp, &attr));
+
+	nd.attr = cache_attr(0, 42);
+	UK_TEST_EXPECT_ZERO(uk_9pfs_attr_get(&vp, &attr));
+
+	/* Opened fids are kept per mode, up to UK_9PFS_OPEN_FIDS */
+	UK_TEST_EXPECT_NOT_ZERO(uk_9pfs_open_fid_put(&vp, &fid[0], 0));
+	UK_TEST_EXPECT_NOT_ZERO(uk_9pfs_open_fid_put(&vp, &fid[1], 1));
+	UK_TEST_EXPECT_ZERO(uk_9pfs_open_fid_put(&vp, &fid[2], 0));
+	UK_TEST_EXPECT_PTR_EQ(uk_9pfs_open_fid_get(&vp, 1), &fid[1]);
+	UK_TEST_EXPECT_NULL(uk_9pfs_open_fid_get(&vp, 1));
+	UK_TEST_EXPECT_NULL(uk_9pfs_open_fid_get(&vp, 2));
+
+	/* Releasing drops the references of the kept fids */
+	uk_refcount_acquire(&fid[0].refcount);
+	uk_9pfs_open_fids_release(&vp);
+	UK_TEST_EXPECT_SNUM_EQ(uk_refcount_read(&fid[0].refcount), 1);
+	UK_TEST_EXPECT_NULL(uk_9pfs_open_fid_get(&vp, 0));
+
+	/* Only regular files that still exist keep fids */
+	nd.removed = true;
+	UK_TEST_EXPECT_ZERO(uk_9pfs_open_fid_put(&vp, &fid[0], 0));
+	nd.removed = false;
+	vp.v_type = VDIR;
+	UK_TEST_EXPECT_ZERO(uk_9pfs_open_fid_put(&vp, &fid[0], 0));
+	vp.v_type = VREG;
+
+	/* cache=none keeps nothing */
+	cache_md_init(&md, UK_9PFS_CACHE_NONE);
+	uk_9pfs_attr_from_stat(&md, &attr, &stat);
+	UK_TEST_EXPECT_ZERO(attr.expiry);
+	UK_TEST_EXPECT_ZERO(uk_9pfs_open_fid_put(&vp, &fid[0], 0));
+}
+
+uk_testsuite_register(lib9pfs_cache_testsuite, NULL);
@@ -0,0 +1,337 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/errptr.h>
+#include <uk/essentials.h>
+#include <uk/plat/spinlock.h>
+#include <uk/9p.h>
+#include <uk/9pdev.h>
+#include <uk/9pdev_trans.h>
+#include <uk/9preq.h>
+#include <uk/9pfid.h>
+#include <vfscore/dentry.h>
+#include <vfscore/file.h>
+#include <vfscore/mount.h>
+#include <vfscore/uio.h>
+#include <vfscore/vnode.h>
+#include <uk/test.h>
+
+#include "../9pfs.h"
+
+extern struct vnops uk_9pfs_vnops;
+
+/*
+ * Loopback transport that answers TREAD from a memory buffer right away.
+ * Everything else (e.g., the TCLUNK sent when the fid is released) gets an
+ * empty reply.
+ */
+#define LOOP_MAXCOUNT		256
+#define LOOP_MSIZE		(UK_9P_HEADER_SIZE + 4 + LOOP_MAXCOUNT)
+#define LOOP_FILE_SIZE		(16 * LOOP_MAXCOUNT + 100)
+
+struct loop_ctx {
+	char file[LOOP_FILE_SIZE];
+	/* Size of the file on the server */
+	uint64_t size;
+	/* Reads at or beyond this offset fail with EIO */
+	uint64_t err_off;
+	unsigned int nb_reads;
+	/* Largest number of requests seen in flight at the same time */
+	unsigned int max_inflight;
+};
+
+static struct loop_ctx loop;
+
+static void loop_put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void loop_put32(uint8_t *p, uint32_t v)
+{
+	loop_put16(p, v);
+	loop_put16(p + 2, v >> 16);
+}
+
+static uint32_t loop_get32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t loop_get64(const uint8_t *p)
+{
+	return loop_get32(p) | ((uint64_t) loop_get32(p + 4) << 32);
+}
+
+static void loop_header(struct uk_9preq *req, uint32_t size, uint8_t type)
+{
+	loop_put32(req->recv.buf, size);
+	((uint8_t *) req->recv.buf)[4] = type;
+	loop_put16((uint8_t *) req->recv.buf + 5, req->tag);
+}
+
+static void loop_reply_read(struct uk_9preq *req)
+{
+	const uint8_t *t = (const uint8_t *) req->xmit.buf + UK_9P_HEADER_SIZE;
+	uint8_t *r = (uint8_t *) req->recv.buf + UK_9P_HEADER_SIZE;
+	uint64_t off = loop_get64(t + 4);
+	uint32_t count = loop_get32(t + 12);
+	uint32_t size;
+
+	if (off >= loop.err_off) {
+		size = UK_9P_HEADER_SIZE + 2 + 4;
+		loop_put16(r, 0);
+		loop_put32(r + 2, EIO);
+		loop_header(req, size, UK_9P_RERROR);
+		uk_9preq_receive_cb(req, size);
+		return;
+	}
+
+	if (off > loop.size)
+		off = loop.size;
+	count = MIN(count, loop.size - off);
+	memcpy(req->recv.zc_buf, loop.file + off, count);
+	loop_put32(r, count);
+	size = UK_9P_HEADER_SIZE + 4 + count;
+	loop_header(req, size, UK_9P_RREAD);
+	uk_9preq_receive_cb(req, size);
+}
+
+/* Number of requests that were sent and not yet completed */
+static unsigned int loop_inflight(struct uk_9pdev *dev)
+{
+	struct uk_9preq *req;
+	unsigned long flags;
+	unsigned int n = 0;
+
+	ukplat_spin_lock_irqsave(&dev->_req_mgmt.spinlock, flags);
+	uk_list_for_each_entry(req, &dev->_req_mgmt.req_list, _list)
+		n++;
+	ukplat_spin_unlock_irqrestore(&dev->_req_mgmt.spinlock, flags);
+	return n;
+}
+
+static int loop_connect(struct uk_9pdev *dev,
+			const char *device_identifier __unused,
+			const char *mount_args __unused)
+{
+	dev->max_msize = LOOP_MSIZE;
+	return 0;
+}
+
+static int loop_disconnect(struct uk_9pdev *dev __unused)
+{
+	return 0;
+}
+
+static int loop_request(struct uk_9pdev *dev, struct uk_9preq *req)
+{
+	UK_WRITE_ONCE(req->state, UK_9PREQ_SENT);
+
+	if (req->xmit.type == UK_9P_TREAD) {
+		loop.nb_reads++;
+		loop.max_inflight = MAX(loop.max_inflight,
+					loop_inflight(dev));
+		loop_reply_read(req);
+	} else {
+		loop_header(req, UK_9P_HEADER_SIZE, req->xmit.type + 1);
+		uk_9preq_receive_cb(req, UK_9P_HEADER_SIZE);
+	}
+	return 0;
+}
+
+static const struct uk_9pdev_trans_ops loop_ops = {
+	.connect = loop_connect,
+	.disconnect = loop_disconnect,
+	.request = loop_request,
+};
+
+static struct uk_9pdev_trans loop_trans = {
+	.name = "loop",
+	.ops = &loop_ops,
+};
+
+/* A regular file opened for reading on a 9pfs mount */
+struct rw_ctx {
+	struct uk_9pfs_mount_data md;
+	struct uk_9pfs_node_data nd;
+	struct mount mnt;
+	struct dentry dentry;
+	struct vnode vn;
+	struct vfscore_file file;
+};
+
+static int rw_open(struct rw_ctx *c)
+{
+	struct uk_9pfs_file_data *fd;
+	struct uk_9pdev *dev;
+	struct uk_9pfid *fid;
+	unsigned int i;
+
+	memset(&loop, 0, sizeof(loop));
+	for (i = 0; i < LOOP_FILE_SIZE; i++)
+		loop.file[i] = (char) (i * 7);
+	loop.size = LOOP_FILE_SIZE;
+	loop.err_off = UINT64_MAX;
+
+	dev = uk_9pdev_connect(&loop_trans, "loop", NULL,
+			       uk_alloc_get_default());
+	if (PTRISERR(dev))
+		return -1;
+
+	fid = uk_9pdev_fid_create(dev);
+	fd = calloc(1, sizeof(*fd));
+	if (PTRISERR(fid) || !fd) {
+		if (!PTRISERR(fid))
+			uk_9pfid_put(fid);
+		free(fd);
+		uk_9pdev_disconnect(dev);
+		return -1;
+	}
+	fd->fid = fid;
+
+	memset(c, 0, sizeof(*c));
+	c->md.dev = dev;
+	c->nd.nb_open_files = 1;
+	c->mnt.m_data = &c->md;
+	c->vn.v_mount = &c->mnt;
+	c->vn.v_op = &uk_9pfs_vnops;
+	c->vn.v_type = VREG;
+	c->vn.v_size = LOOP_FILE_SIZE;
+	c->vn.v_data = &c->nd;
+	c->dentry.d_mount = &c->mnt;
+	c->dentry.d_vnode = &c->vn;
+	c->file.f_dentry = &c->dentry;
+	c->file.f_data = fd;
+	return 0;
+}
+
+static void rw_close(struct rw_ctx *c)
+{
+	VOP_CLOSE(&c->vn, &c->file);
+	uk_9pdev_disconnect(c->md.dev);
+}
+
+/* Returns the number of bytes read, or a negative errno */
+static ssize_t rw_read(struct rw_ctx *c, off_t off, char *buf, size_t len)
+{
+	struct iovec iov = { .iov_base = buf, .iov_len = len };
+	struct uio uio = {
+		.uio_iov = &iov,
+		.uio_iovcnt = 1,
+		.uio_offset = off,
+		.uio_resid = len,
+		.uio_rw = UIO_READ,
+	};
+	int rc;
+
+	rc = VOP_READ(&c->vn, &c->file, &uio, 0);
+	if (rc)
+		return -rc;
+	return len - uio.uio_resid;
+}
+
+static char rw_buf[LOOP_FILE_SIZE];
+
+UK_TESTCASE(lib9pfs_rw_testsuite, lib9pfs_test_read_depth)
+{
+	struct rw_ctx c;
+
+	UK_TEST_EXPECT_ZERO(rw_open(&c));
+
+	/* Large reads keep up to IO_DEPTH requests in flight */
+	UK_TEST_EXPECT_SNUM_EQ(rw_read(&c, 0, rw_buf, LOOP_FILE_SIZE),
+			       LOOP_FILE_SIZE);
+	UK_TEST_EXPECT_BYTES_EQ(rw_buf, loop.file, LOOP_FILE_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(loop.nb_reads,
+			       DIV_ROUND_UP(LOOP_FILE_SIZE, LOOP_MAXCOUNT));
+	UK_TEST_EXPECT_SNUM_EQ(loop.max_inflight,
+			       MIN(CONFIG_LIB9PFS_IO_DEPTH,
+				   DIV_ROUND_UP(LOOP_FILE_SIZE,
+						LOOP_MAXCOUNT)));
+
+	/* A short reply ends the read, later replies are discarded */
+	loop.size = 1000;
+	memset(rw_buf, 0, sizeof(rw_buf));
+	UK_TEST_EXPECT_SNUM_EQ(rw_read(&c, 10, rw_buf, 2000), 990);
+	UK_TEST_EXPECT_BYTES_EQ(rw_buf, loop.file + 10, 990);
+	loop.size = LOOP_FILE_SIZE;
+
+	/* An error after some data makes a short read */
+	loop.err_off = 3 * LOOP_MAXCOUNT;
+	UK_TEST_EXPECT_SNUM_EQ(rw_read(&c, 0, rw_buf, 2000),
+			       3 * LOOP_MAXCOUNT);
+	UK_TEST_EXPECT_SNUM_EQ(rw_read(&c, 3 * LOOP_MAXCOUNT, rw_buf, 2000),
+			       -EIO);
+
+	rw_close(&c);
+}
+
+#if CONFIG_LIB9PFS_READAHEAD
+UK_TESTCASE(lib9pfs_rw_testsuite, lib9pfs_test_readahead)
+{
+	struct rw_ctx c;
+
+	UK_TEST_EXPECT_ZERO(rw_open(&c));
+
+	/* A sequential read requests the next chunk in the background */
+	UK_TEST_EXPECT_SNUM_EQ(rw_read(&c, 0, rw_buf, 100), 100);
+	UK_TEST_EXPECT_SNUM_EQ(loop.nb_reads, 2);
+	UK_TEST_EXPECT_SNUM_EQ(rw_read(&c, 100, rw_buf, 100), 100);
+	UK_TEST_EXPECT_SNUM_EQ(loop.nb_reads, 2);
+	UK_TEST_EXPECT_BYTES_EQ(rw_buf, loop.file + 100, 100);
+
+	/* The rest of the buffer is used before reading from the server */
+	UK_TEST_EXPECT_SNUM_EQ(rw_read(&c, 200, rw_buf, 400), 400);
+	UK_TEST_EXPECT_BYTES_EQ(rw_buf, loop.file + 200, 400);
+	UK_TEST_EXPECT_SNUM_EQ(loop.nb_reads, 4);
+
+	/* A write to the file drops the read-ahead data */
+	memset(loop.file + 600, 'x', 100);
+	c.nd.wgen++;
+	UK_TEST_EXPECT_SNUM_EQ(rw_read(&c, 600, rw_buf, 100), 100);
+	UK_TEST_EXPECT_BYTES_EQ(rw_buf, loop.file + 600, 100);
+
+	/* Data served from the read-ahead buffer before an error is kept */
+	loop.err_off = 700 + LOOP_MAXCOUNT;
+	UK_TEST_EXPECT_SNUM_EQ(rw_read(&c, 700, rw_buf, 400), LOOP_MAXCOUNT);
+	UK_TEST_EXPECT_BYTES_EQ(rw_buf, loop.file + 700, LOOP_MAXCOUNT);
+
+	rw_close(&c);
+}
+#endif /* CONFIG_LIB9PFS_READAHEAD */
+
+uk_testsuite_register(lib9pfs_rw_testsuite, NULL);
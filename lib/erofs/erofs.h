@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __EROFS_H__
+#define __EROFS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <uk/config.h>
+#include <uk/list.h>
+#include <uk/mutex.h>
+#include <uk/wait_types.h>
+#include <uk/blkdev.h>
+
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+
+#include "erofs_fs.h"
+
+/* Block cache buffer states. */
+#define EROFS_BUF_EMPTY		0
+#define EROFS_BUF_LOADING	1
+#define EROFS_BUF_VALID		2
+#define EROFS_BUF_ERROR		3
+
+struct erofs_sb;
+
+/* One filesystem block held in the block cache. */
+struct erofs_buf {
+	/* Link in the hash bucket of blkaddr. */
+	struct uk_hlist_node	link;
+	/* Link in the LRU list of unpinned buffers. */
+	struct uk_list_head	lru;
+	struct erofs_sb		*sb;
+	uint32_t		blkaddr;
+	int			state;
+	/* Number of users currently reading data. */
+	int			pins;
+	struct uk_blkreq	req;
+	char			*data;
+};
+
+/* Number of buckets of the block cache hash table. */
+#define EROFS_BCACHE_BUCKETS	256
+
+struct erofs_sb {
+	struct uk_blkdev	*dev;
+	/* Whether requests complete through queue interrupts. */
+	bool			intr;
+	/* Woken up whenever a block read completes. */
+	struct uk_waitq		wq;
+
+	uint8_t			blkszbits;
+	uint32_t		blksz;
+	/* Device sectors per filesystem block. */
+	uint32_t		sects_per_blk;
+	uint32_t		meta_blkaddr;
+	uint64_t		root_nid;
+	uint64_t		build_time;
+	uint32_t		build_time_nsec;
+	uint32_t		blocks;
+
+	/* Block cache. */
+	struct uk_mutex		bc_lock;
+	struct erofs_buf	*bc_bufs;
+	unsigned int		bc_nbufs;
+	struct uk_hlist_head	bc_hash[EROFS_BCACHE_BUCKETS];
+	/* Unpinned buffers, least recently used last. */
+	struct uk_list_head	bc_lru;
+};
+
+struct erofs_node {
+	uint64_t		nid;
+	uint16_t		datalayout;
+	uint16_t		chunkformat;
+	uint32_t		mode;
+	uint32_t		nlink;
+	uint32_t		uid;
+	uint32_t		gid;
+	uint64_t		size;
+	uint64_t		mtime;
+	uint32_t		mtime_nsec;
+	union {
+		uint32_t	raw_blkaddr;
+		uint32_t	rdev;
+	};
+	/*
+	 * Byte offset on the device right after the inode and its xattrs:
+	 * the inline tail of FLAT_INLINE files, or the chunk table.
+	 */
+	uint64_t		meta_pos;
+};
+
+#define EROFS_SB(mount)		((struct erofs_sb *) (mount)->m_data)
+#define EROFS_NODE(vnode)	((struct erofs_node *) (vnode)->v_data)
+
+/* erofs_bcache.c */
+int erofs_dev_open(struct erofs_sb *sb, const char *devname);
+void erofs_dev_close(struct erofs_sb *sb);
+int erofs_dev_read(struct erofs_sb *sb, uint64_t pos, void *buf,
+		   size_t len);
+int erofs_bcache_init(struct erofs_sb *sb);
+void erofs_bcache_destroy(struct erofs_sb *sb);
+struct erofs_buf *erofs_bread(struct erofs_sb *sb, uint32_t blkaddr);
+void erofs_brelse(struct erofs_buf *buf);
+void erofs_breadahead(struct erofs_sb *sb, uint32_t blkaddr,
+		      uint32_t count);
+int erofs_copy(struct erofs_sb *sb, uint64_t pos, size_t len,
+	       void *buf, struct uio *uio);
+
+/* erofs_vnops.c */
+int erofs_read_node(struct erofs_sb *sb, uint64_t nid,
+		    struct erofs_node **np);
+void erofs_vnode_init(struct vnode *vp, struct erofs_node *np);
+
+#endif /* __EROFS_H__ */
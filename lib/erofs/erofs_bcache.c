@@ -0,0 +1,455 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Block device access for erofs: a fixed-size cache of filesystem blocks
+ * that are read on demand through uk_blkdev_queue_submit_one().
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uk/config.h>
+#include <uk/alloc.h>
+#include <uk/arch/atomic.h>
+#include <uk/assert.h>
+#include <uk/errptr.h>
+#include <uk/essentials.h>
+#include <uk/page.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/wait.h>
+#include <vfscore/uio.h>
+
+#include "erofs.h"
+
+static void erofs_queue_event(struct uk_blkdev *dev, uint16_t queue_id,
+			      void *argp __unused)
+{
+	uk_blkdev_queue_finish_reqs(dev, queue_id);
+}
+
+static void erofs_req_done(struct uk_blkreq *req, void *cookie)
+{
+	struct erofs_buf *buf = cookie;
+
+	ukarch_store_n(&buf->state, req->result < 0 ? EROFS_BUF_ERROR
+						     : EROFS_BUF_VALID);
+	uk_waitq_wake_up(&buf->sb->wq);
+}
+
+static int erofs_submit(struct erofs_buf *buf, __sector start,
+			__sector nb_sectors)
+{
+	struct erofs_sb *sb = buf->sb;
+	int rc;
+
+	ukarch_store_n(&buf->state, EROFS_BUF_LOADING);
+	uk_blkreq_init(&buf->req, UK_BLKREQ_READ, start, nb_sectors,
+		       buf->data, erofs_req_done, buf);
+
+	for (;;) {
+		rc = uk_blkdev_queue_submit_one(sb->dev, 0, &buf->req);
+		if (!uk_blkdev_status_notready(rc))
+			break;
+
+		/*
+		 * The queue is full. Completions are reaped by the queue
+		 * event handler if interrupts are on, otherwise by us.
+		 */
+		if (!sb->intr)
+			uk_blkdev_queue_finish_reqs(sb->dev, 0);
+		uk_sched_yield();
+	}
+
+	if (unlikely(!uk_blkdev_status_successful(rc))) {
+		uk_pr_err("erofs: Failed to submit read of sector %"__PRIsctr
+			  ": %d\n", start, rc);
+		ukarch_store_n(&buf->state, EROFS_BUF_ERROR);
+		return (rc < 0) ? rc : -EIO;
+	}
+
+	return 0;
+}
+
+static void erofs_wait(struct erofs_buf *buf)
+{
+	struct erofs_sb *sb = buf->sb;
+
+	if (sb->intr) {
+		uk_waitq_wait_event(&sb->wq, ukarch_load_n(&buf->state)
+				    != EROFS_BUF_LOADING);
+		return;
+	}
+
+	while (ukarch_load_n(&buf->state) == EROFS_BUF_LOADING) {
+		uk_blkdev_queue_finish_reqs(sb->dev, 0);
+		if (ukarch_load_n(&buf->state) == EROFS_BUF_LOADING)
+			uk_sched_yield();
+	}
+}
+
+static int erofs_parse_devname(const char *devname, unsigned int *id)
+{
+	char *end;
+
+	if (!devname)
+		return ENODEV;
+
+	if (!strncmp(devname, "blkdev", 6))
+		devname += 6;
+	else if (!strncmp(devname, "blk", 3))
+		devname += 3;
+
+	if (!*devname)
+		return ENODEV;
+
+	*id = strtoul(devname, &end, 10);
+	if (*end != '\0')
+		return ENODEV;
+
+	return 0;
+}
+
+int erofs_dev_open(struct erofs_sb *sb, const char *devname)
+{
+	struct uk_blkdev_conf conf = { .nb_queues = 1 };
+	struct uk_blkdev_queue_conf qconf;
+	unsigned int id;
+	int rc;
+
+	rc = erofs_parse_devname(devname, &id);
+	if (rc) {
+		uk_pr_err("erofs: Invalid block device name: %s\n",
+			  devname ? devname : "(null)");
+		return rc;
+	}
+
+	sb->dev = uk_blkdev_get(id);
+	if (!sb->dev)
+		return ENODEV;
+
+	if (uk_blkdev_state_get(sb->dev) != UK_BLKDEV_UNCONFIGURED) {
+		uk_pr_err("erofs: blkdev%u is already in use\n", id);
+		return EBUSY;
+	}
+
+	rc = uk_blkdev_configure(sb->dev, &conf);
+	if (rc)
+		return -rc;
+
+	memset(&qconf, 0, sizeof(qconf));
+	qconf.a = uk_alloc_get_default();
+	qconf.callback = erofs_queue_event;
+	qconf.callback_cookie = sb;
+#if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
+	qconf.s = uk_sched_current();
+#endif
+	rc = uk_blkdev_queue_configure(sb->dev, 0, 0, &qconf);
+	if (rc)
+		goto err_unconfigure;
+
+	rc = uk_blkdev_start(sb->dev);
+	if (rc)
+		goto err_queue_unconfigure;
+
+	uk_waitq_init(&sb->wq);
+	sb->intr = (uk_blkdev_queue_intr_enable(sb->dev, 0) == 0);
+	if (!sb->intr)
+		uk_pr_info("erofs: blkdev%u: No queue interrupts, polling\n",
+			   id);
+
+	return 0;
+
+err_queue_unconfigure:
+	uk_blkdev_queue_unconfigure(sb->dev, 0);
+err_unconfigure:
+	uk_blkdev_unconfigure(sb->dev);
+	return -rc;
+}
+
+void erofs_dev_close(struct erofs_sb *sb)
+{
+	uk_blkdev_stop(sb->dev);
+	uk_blkdev_queue_unconfigure(sb->dev, 0);
+	uk_blkdev_unconfigure(sb->dev);
+}
+
+int erofs_dev_read(struct erofs_sb *sb, uint64_t pos, void *out, size_t len)
+{
+	const struct uk_blkdev_cap *cap = uk_blkdev_capabilities(sb->dev);
+	struct erofs_buf buf = { .sb = sb };
+	__sector start, end;
+	int rc;
+
+	start = pos / cap->ssize;
+	end = DIV_ROUND_UP(pos + len, cap->ssize);
+	if (end > cap->sectors || end - start > cap->max_sectors_per_req)
+		return EINVAL;
+
+	buf.data = uk_memalign(uk_alloc_get_default(), __PAGE_SIZE,
+			       (end - start) * cap->ssize);
+	if (!buf.data)
+		return ENOMEM;
+
+	rc = erofs_submit(&buf, start, end - start);
+	if (!rc) {
+		erofs_wait(&buf);
+		if (buf.state == EROFS_BUF_VALID)
+			memcpy(out, buf.data + (pos - start * cap->ssize), len);
+		else
+			rc = -EIO;
+	}
+
+	uk_free(uk_alloc_get_default(), buf.data);
+	return -rc;
+}
+
+int erofs_bcache_init(struct erofs_sb *sb)
+{
+	struct erofs_buf *buf;
+	unsigned int i;
+
+	sb->bc_nbufs = MAX(CONFIG_LIBEROFS_BCACHE_SIZE * 1024UL / sb->blksz,
+			   16UL);
+	sb->bc_bufs = calloc(sb->bc_nbufs, sizeof(*sb->bc_bufs));
+	if (!sb->bc_bufs)
+		return ENOMEM;
+
+	sb->bc_bufs[0].data = uk_memalign(uk_alloc_get_default(), __PAGE_SIZE,
+					  (size_t) sb->bc_nbufs * sb->blksz);
+	if (!sb->bc_bufs[0].data) {
+		free(sb->bc_bufs);
+		return ENOMEM;
+	}
+
+	uk_mutex_init(&sb->bc_lock);
+	for (i = 0; i < EROFS_BCACHE_BUCKETS; i++)
+		UK_INIT_HLIST_HEAD(&sb->bc_hash[i]);
+	UK_INIT_LIST_HEAD(&sb->bc_lru);
+
+	for (i = 0; i < sb->bc_nbufs; i++) {
+		buf = &sb->bc_bufs[i];
+		buf->sb = sb;
+		buf->state = EROFS_BUF_EMPTY;
+		buf->data = sb->bc_bufs[0].data + (size_t) i * sb->blksz;
+		uk_list_add_tail(&buf->lru, &sb->bc_lru);
+	}
+
+	return 0;
+}
+
+void erofs_bcache_destroy(struct erofs_sb *sb)
+{
+	unsigned int i;
+
+	/* Read-ahead requests may still be in flight. */
+	for (i = 0; i < sb->bc_nbufs; i++) {
+		UK_ASSERT(!sb->bc_bufs[i].pins);
+		erofs_wait(&sb->bc_bufs[i]);
+	}
+
+	uk_free(uk_alloc_get_default(), sb->bc_bufs[0].data);
+	free(sb->bc_bufs);
+}
+
+static inline struct uk_hlist_head *erofs_bhash(struct erofs_sb *sb,
+						uint32_t blkaddr)
+{
+	return &sb->bc_hash[blkaddr & (EROFS_BCACHE_BUCKETS - 1)];
+}
+
+/* Must be called with bc_lock held. */
+static struct erofs_buf *erofs_bfind(struct erofs_sb *sb, uint32_t blkaddr)
+{
+	struct erofs_buf *buf;
+
+	uk_hlist_for_each_entry(buf, erofs_bhash(sb, blkaddr), link) {
+		if (buf->blkaddr == blkaddr)
+			return buf;
+	}
+
+	return NULL;
+}
+
+/*
+ * Take the least recently used buffer whose data is not needed anymore
+ * and bind it to blkaddr. Must be called with bc_lock held. The buffer is
+ * returned unpinned, still on the LRU list.
+ */
+static struct erofs_buf *erofs_bget(struct erofs_sb *sb, uint32_t blkaddr)
+{
+	struct erofs_buf *buf;
+
+	uk_list_for_each_entry_reverse(buf, &sb->bc_lru, lru) {
+		if (ukarch_load_n(&buf->state) == EROFS_BUF_LOADING)
+			continue;
+
+		if (buf->state != EROFS_BUF_EMPTY)
+			uk_hlist_del(&buf->link);
+		buf->blkaddr = blkaddr;
+		buf->state = EROFS_BUF_EMPTY;
+		uk_hlist_add_head(&buf->link, erofs_bhash(sb, blkaddr));
+		return buf;
+	}
+
+	return NULL;
+}
+
+static inline __sector erofs_blk2sect(struct erofs_sb *sb, uint32_t blkaddr)
+{
+	return (__sector) blkaddr * sb->sects_per_blk;
+}
+
+struct erofs_buf *erofs_bread(struct erofs_sb *sb, uint32_t blkaddr)
+{
+	struct erofs_buf *buf;
+	bool load = false;
+	int rc;
+
+	uk_mutex_lock(&sb->bc_lock);
+	buf = erofs_bfind(sb, blkaddr);
+	if (!buf) {
+		buf = erofs_bget(sb, blkaddr);
+		if (!buf) {
+			uk_mutex_unlock(&sb->bc_lock);
+			return ERR2PTR(-ENOMEM);
+		}
+	}
+
+	if (!buf->pins++)
+		uk_list_del(&buf->lru);
+
+	/* Failed read-ahead is retried here. */
+	if (buf->state == EROFS_BUF_EMPTY ||
+	    (buf->state == EROFS_BUF_ERROR && buf->pins == 1)) {
+		ukarch_store_n(&buf->state, EROFS_BUF_LOADING);
+		load = true;
+	}
+	uk_mutex_unlock(&sb->bc_lock);
+
+	if (load) {
+		rc = erofs_submit(buf, erofs_blk2sect(sb, blkaddr),
+				  sb->sects_per_blk);
+		if (unlikely(rc))
+			uk_waitq_wake_up(&sb->wq);
+	}
+
+	erofs_wait(buf);
+	if (unlikely(ukarch_load_n(&buf->state) != EROFS_BUF_VALID)) {
+		erofs_brelse(buf);
+		return ERR2PTR(-EIO);
+	}
+
+	return buf;
+}
+
+void erofs_brelse(struct erofs_buf *buf)
+{
+	struct erofs_sb *sb = buf->sb;
+
+	uk_mutex_lock(&sb->bc_lock);
+	UK_ASSERT(buf->pins > 0);
+	if (!--buf->pins) {
+		if (buf->state == EROFS_BUF_ERROR) {
+			uk_hlist_del(&buf->link);
+			buf->state = EROFS_BUF_EMPTY;
+			uk_list_add_tail(&buf->lru, &sb->bc_lru);
+		} else {
+			uk_list_add(&buf->lru, &sb->bc_lru);
+		}
+	}
+	uk_mutex_unlock(&sb->bc_lock);
+}
+
+void erofs_breadahead(struct erofs_sb *sb, uint32_t blkaddr, uint32_t count)
+{
+	struct erofs_buf *buf;
+
+	/* Leave most of the cache to blocks that are actually in use. */
+	count = MIN(count, sb->bc_nbufs / 4);
+
+	for (; count; count--, blkaddr++) {
+		if (blkaddr >= sb->blocks)
+			break;
+
+		uk_mutex_lock(&sb->bc_lock);
+		if (erofs_bfind(sb, blkaddr)) {
+			uk_mutex_unlock(&sb->bc_lock);
+			continue;
+		}
+
+		buf = erofs_bget(sb, blkaddr);
+		if (buf) {
+			/* Move to the front so that it is not reclaimed. */
+			uk_list_del(&buf->lru);
+			uk_list_add(&buf->lru, &sb->bc_lru);
+			ukarch_store_n(&buf->state, EROFS_BUF_LOADING);
+		}
+		uk_mutex_unlock(&sb->bc_lock);
+
+		if (!buf || erofs_submit(buf, erofs_blk2sect(sb, blkaddr),
+					 sb->sects_per_blk))
+			break;
+	}
+}
+
+int erofs_copy(struct erofs_sb *sb, uint64_t pos, size_t len,
+	       void *out, struct uio *uio)
+{
+	struct erofs_buf *buf;
+	uint32_t off;
+	size_t n;
+	int rc = 0;
+
+	while (len) {
+		off = pos & (sb->blksz - 1);
+		n = MIN(len, (size_t) (sb->blksz - off));
+
+		buf = erofs_bread(sb, pos >> sb->blkszbits);
+		if (PTRISERR(buf))
+			return -PTR2ERR(buf);
+
+		if (uio) {
+			rc = vfscore_uiomove(buf->data + off, n, uio);
+		} else {
+			memcpy(out, buf->data + off, n);
+			out = (char *) out + n;
+		}
+		erofs_brelse(buf);
+		if (rc)
+			return rc;
+
+		pos += n;
+		len -= n;
+	}
+
+	return 0;
+}
@@ -0,0 +1,194 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * On-disk format of the Enhanced Read-Only File System (EROFS), as written
+ * by mkfs.erofs. All fields are little-endian.
+ */
+
+#ifndef __EROFS_FS_H__
+#define __EROFS_FS_H__
+
+#include <stdint.h>
+#include <uk/essentials.h>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "erofs: on-disk structures are read in host byte order"
+#endif
+
+#define EROFS_SUPER_OFFSET		1024
+#define EROFS_SUPER_MAGIC_V1		0xE0F5E1E2
+
+#define EROFS_FEATURE_INCOMPAT_ZERO_PADDING	0x00000001
+#define EROFS_FEATURE_INCOMPAT_COMPR_CFGS	0x00000002
+#define EROFS_FEATURE_INCOMPAT_CHUNKED_FILE	0x00000004
+#define EROFS_FEATURE_INCOMPAT_DEVICE_TABLE	0x00000008
+#define EROFS_FEATURE_INCOMPAT_ZTAILPACKING	0x00000010
+#define EROFS_FEATURE_INCOMPAT_FRAGMENTS	0x00000020
+#define EROFS_FEATURE_INCOMPAT_XATTR_PREFIXES	0x00000040
+#define EROFS_FEATURE_INCOMPAT_SUPP			\
+	(EROFS_FEATURE_INCOMPAT_ZERO_PADDING |		\
+	 EROFS_FEATURE_INCOMPAT_COMPR_CFGS |		\
+	 EROFS_FEATURE_INCOMPAT_CHUNKED_FILE |		\
+	 EROFS_FEATURE_INCOMPAT_DEVICE_TABLE |		\
+	 EROFS_FEATURE_INCOMPAT_ZTAILPACKING |		\
+	 EROFS_FEATURE_INCOMPAT_FRAGMENTS |		\
+	 EROFS_FEATURE_INCOMPAT_XATTR_PREFIXES)
+
+struct erofs_super_block {
+	uint32_t magic;
+	uint32_t checksum;
+	uint32_t feature_compat;
+	uint8_t  blkszbits;
+	uint8_t  sb_extslots;
+	uint16_t root_nid;
+	uint64_t inos;
+	uint64_t build_time;
+	uint32_t build_time_nsec;
+	uint32_t blocks;
+	uint32_t meta_blkaddr;
+	uint32_t xattr_blkaddr;
+	uint8_t  uuid[16];
+	uint8_t  volume_name[16];
+	uint32_t feature_incompat;
+	uint16_t available_compr_algs;
+	uint16_t extra_devices;
+	uint16_t devt_slotoff;
+	uint8_t  dirblkbits;
+	uint8_t  xattr_prefix_count;
+	uint32_t xattr_prefix_start;
+	uint64_t packed_nid;
+	uint8_t  xattr_filter_reserved;
+	uint8_t  reserved2[23];
+} __packed;
+
+/* i_format: bit 0 is the inode version, bits 1-3 the data layout. */
+#define EROFS_I_VERSION_MASK		0x01
+#define EROFS_I_DATALAYOUT_BIT		1
+#define EROFS_I_DATALAYOUT_MASK		0x07
+
+#define EROFS_INODE_LAYOUT_COMPACT	0
+#define EROFS_INODE_LAYOUT_EXTENDED	1
+
+/* Data blocks stored contiguously from raw_blkaddr. */
+#define EROFS_INODE_FLAT_PLAIN		0
+#define EROFS_INODE_COMPRESSED_FULL	1
+/* Like FLAT_PLAIN, but the last partial block follows the inode. */
+#define EROFS_INODE_FLAT_INLINE		2
+#define EROFS_INODE_COMPRESSED_COMPACT	3
+/* Data located through a per-chunk block address table. */
+#define EROFS_INODE_CHUNK_BASED		4
+
+#define EROFS_CHUNK_FORMAT_BLKBITS_MASK	0x001F
+#define EROFS_CHUNK_FORMAT_INDEXES	0x0020
+
+#define EROFS_NULL_ADDR			((uint32_t) -1)
+
+/* Nids are counted in slots of this size from meta_blkaddr. */
+#define EROFS_ISLOTBITS			5
+
+union erofs_inode_i_u {
+	uint32_t raw_blkaddr;
+	uint32_t rdev;
+	struct {
+		uint16_t format;
+		uint16_t reserved;
+	} c;
+};
+
+struct erofs_inode_compact {
+	uint16_t i_format;
+	uint16_t i_xattr_icount;
+	uint16_t i_mode;
+	uint16_t i_nlink;
+	uint32_t i_size;
+	uint32_t i_reserved;
+	union erofs_inode_i_u i_u;
+	uint32_t i_ino;
+	uint16_t i_uid;
+	uint16_t i_gid;
+	uint32_t i_reserved2;
+} __packed;
+
+struct erofs_inode_extended {
+	uint16_t i_format;
+	uint16_t i_xattr_icount;
+	uint16_t i_mode;
+	uint16_t i_reserved;
+	uint64_t i_size;
+	union erofs_inode_i_u i_u;
+	uint32_t i_ino;
+	uint32_t i_uid;
+	uint32_t i_gid;
+	uint64_t i_mtime;
+	uint32_t i_mtime_nsec;
+	uint32_t i_nlink;
+	uint8_t  i_reserved2[16];
+} __packed;
+
+/* Size of the inline xattr area for a given i_xattr_icount. */
+#define EROFS_XATTR_IBODY_HDRSZ		12
+#define EROFS_XATTR_ISIZE(icount)					\
+	((icount) ? EROFS_XATTR_IBODY_HDRSZ + ((icount) - 1) * 4 : 0)
+
+struct erofs_inode_chunk_index {
+	uint16_t advise;
+	uint16_t device_id;
+	uint32_t blkaddr;
+} __packed;
+
+/*
+ * A directory block starts with an array of dirents sorted by name. The
+ * nameoff of the first dirent gives the size of the array, names are
+ * stored back to back after it and are not NUL-terminated, except that
+ * the last one may be padded with NULs up to the end of the block.
+ */
+struct erofs_dirent {
+	uint64_t nid;
+	uint16_t nameoff;
+	uint8_t  file_type;
+	uint8_t  reserved;
+} __packed;
+
+#define EROFS_FT_UNKNOWN		0
+#define EROFS_FT_REG_FILE		1
+#define EROFS_FT_DIR			2
+#define EROFS_FT_CHRDEV			3
+#define EROFS_FT_BLKDEV			4
+#define EROFS_FT_FIFO			5
+#define EROFS_FT_SOCK			6
+#define EROFS_FT_SYMLINK		7
+
+UK_CTASSERT(sizeof(struct erofs_super_block) == 128);
+UK_CTASSERT(sizeof(struct erofs_inode_compact) == 32);
+UK_CTASSERT(sizeof(struct erofs_inode_extended) == 64);
+UK_CTASSERT(sizeof(struct erofs_dirent) == 12);
+
+#endif /* __EROFS_FS_H__ */
@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <uk/page.h>
+#include <uk/print.h>
+#include <vfscore/mount.h>
+#include <vfscore/dentry.h>
+#include <vfscore/vnode.h>
+
+#include "erofs.h"
+
+extern struct vnops erofs_vnops;
+
+static int erofs_mount(struct mount *mp, const char *dev, int flags,
+		       const void *data);
+
+static int erofs_unmount(struct mount *mp, int flags);
+
+#define erofs_sync		((vfsop_sync_t)vfscore_nullop)
+#define erofs_vget		((vfsop_vget_t)vfscore_nullop)
+#define erofs_statfs		((vfsop_statfs_t)vfscore_nullop)
+
+struct vfsops erofs_vfsops = {
+	.vfs_mount	= erofs_mount,
+	.vfs_unmount	= erofs_unmount,
+	.vfs_sync	= erofs_sync,
+	.vfs_vget	= erofs_vget,
+	.vfs_statfs	= erofs_statfs,
+	.vfs_vnops	= &erofs_vnops
+};
+
+static struct vfscore_fs_type erofs_fs = {
+	.vs_name	= "erofs",
+	.vs_init	= NULL,
+	.vs_op		= &erofs_vfsops
+};
+
+UK_FS_REGISTER(erofs_fs);
+
+static int erofs_read_super(struct erofs_sb *sb)
+{
+	const struct uk_blkdev_cap *cap = uk_blkdev_capabilities(sb->dev);
+	struct erofs_super_block dsb;
+	int rc;
+
+	rc = erofs_dev_read(sb, EROFS_SUPER_OFFSET, &dsb, sizeof(dsb));
+	if (rc)
+		return rc;
+
+	if (dsb.magic != EROFS_SUPER_MAGIC_V1) {
+		uk_pr_err("erofs: Bad superblock magic 0x%08"__PRIx32"\n",
+			  dsb.magic);
+		return EINVAL;
+	}
+
+	if (dsb.blkszbits < 9 || dsb.blkszbits > __PAGE_SHIFT) {
+		uk_pr_err("erofs: Unsupported block size 2^%u\n",
+			  dsb.blkszbits);
+		return EINVAL;
+	}
+
+	if (dsb.feature_incompat & ~EROFS_FEATURE_INCOMPAT_SUPP) {
+		uk_pr_err("erofs: Unsupported features 0x%08"__PRIx32"\n",
+			  dsb.feature_incompat & ~EROFS_FEATURE_INCOMPAT_SUPP);
+		return EINVAL;
+	}
+
+	if (dsb.extra_devices) {
+		uk_pr_err("erofs: Multiple devices are not supported\n");
+		return EINVAL;
+	}
+
+	sb->blkszbits = dsb.blkszbits;
+	sb->blksz = 1U << dsb.blkszbits;
+	if (sb->blksz < cap->ssize || sb->blksz % cap->ssize) {
+		uk_pr_err("erofs: Block size %"__PRIu32" does not fit sector size %"__PRIsz"\n",
+			  sb->blksz, cap->ssize);
+		return EINVAL;
+	}
+
+	sb->sects_per_blk = sb->blksz / cap->ssize;
+	if (sb->sects_per_blk > cap->max_sectors_per_req)
+		return EINVAL;
+
+	sb->blocks = cap->sectors / sb->sects_per_blk;
+	sb->meta_blkaddr = dsb.meta_blkaddr;
+	sb->root_nid = dsb.root_nid;
+	sb->build_time = dsb.build_time;
+	sb->build_time_nsec = dsb.build_time_nsec;
+
+	uk_pr_info("erofs: %"__PRIu32" blocks of %"__PRIu32" bytes, root nid %"__PRIu64"\n",
+		   dsb.blocks, sb->blksz, sb->root_nid);
+	return 0;
+}
+
+static int erofs_mount(struct mount *mp, const char *dev,
+		       int flags __unused, const void *data __unused)
+{
+	struct erofs_node *root;
+	struct erofs_sb *sb;
+	int rc;
+
+	sb = calloc(1, sizeof(*sb));
+	if (!sb)
+		return ENOMEM;
+
+	rc = erofs_dev_open(sb, dev);
+	if (rc)
+		goto err_free;
+
+	rc = erofs_read_super(sb);
+	if (rc)
+		goto err_close;
+
+	rc = erofs_bcache_init(sb);
+	if (rc)
+		goto err_close;
+
+	rc = erofs_read_node(sb, sb->root_nid, &root);
+	if (rc)
+		goto err_bcache;
+
+	if (!S_ISDIR(root->mode)) {
+		free(root);
+		rc = EINVAL;
+		goto err_bcache;
+	}
+
+	mp->m_data = sb;
+	mp->m_flags |= MNT_RDONLY;
+	erofs_vnode_init(mp->m_root->d_vnode, root);
+
+	return 0;
+
+err_bcache:
+	erofs_bcache_destroy(sb);
+err_close:
+	erofs_dev_close(sb);
+err_free:
+	free(sb);
+	return rc;
+}
+
+static int erofs_unmount(struct mount *mp, int flags __unused)
+{
+	struct erofs_sb *sb = EROFS_SB(mp);
+
+	vfscore_release_mp_dentries(mp);
+	erofs_bcache_destroy(sb);
+	erofs_dev_close(sb);
+	free(sb);
+
+	return 0;
+}
@@ -0,0 +1,678 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <uk/errptr.h>
+#include <uk/print.h>
+#include <vfscore/mount.h>
+#include <vfscore/dentry.h>
+#include <vfscore/vnode.h>
+#include <vfscore/file.h>
+#include <vfscore/fs.h>
+#include <vfscore/uio.h>
+
+#include "erofs.h"
+
+/* Device position returned by erofs_map() for unallocated chunks. */
+#define EROFS_HOLE		((uint64_t) -1)
+
+/* Vnode number 0 is taken by the root vnode that vfscore creates. */
+#define EROFS_INO(nid)		((nid) + 1)
+
+static const char erofs_zeroes[512];
+
+int erofs_read_node(struct erofs_sb *sb, uint64_t nid, struct erofs_node **np)
+{
+	union {
+		struct erofs_inode_compact c;
+		struct erofs_inode_extended e;
+	} di;
+	struct erofs_node *node;
+	uint64_t pos;
+	size_t isize;
+	int rc;
+
+	pos = ((uint64_t) sb->meta_blkaddr << sb->blkszbits) +
+	      (nid << EROFS_ISLOTBITS);
+
+	rc = erofs_copy(sb, pos, sizeof(di.c), &di.c, NULL);
+	if (rc)
+		return rc;
+
+	if ((di.c.i_format & EROFS_I_VERSION_MASK) ==
+	    EROFS_INODE_LAYOUT_EXTENDED) {
+		/* The extended inode may continue in the next block. */
+		rc = erofs_copy(sb, pos + sizeof(di.c),
+				sizeof(di.e) - sizeof(di.c),
+				(char *) &di + sizeof(di.c), NULL);
+		if (rc)
+			return rc;
+	}
+
+	node = calloc(1, sizeof(*node));
+	if (!node)
+		return ENOMEM;
+
+	node->nid = nid;
+	node->datalayout = (di.c.i_format >> EROFS_I_DATALAYOUT_BIT) &
+			   EROFS_I_DATALAYOUT_MASK;
+
+	if ((di.c.i_format & EROFS_I_VERSION_MASK) ==
+	    EROFS_INODE_LAYOUT_EXTENDED) {
+		isize = sizeof(di.e);
+		node->mode = di.e.i_mode;
+		node->nlink = di.e.i_nlink;
+		node->uid = di.e.i_uid;
+		node->gid = di.e.i_gid;
+		node->size = di.e.i_size;
+		node->mtime = di.e.i_mtime;
+		node->mtime_nsec = di.e.i_mtime_nsec;
+	} else {
+		isize = sizeof(di.c);
+		node->mode = di.c.i_mode;
+		node->nlink = di.c.i_nlink;
+		node->uid = di.c.i_uid;
+		node->gid = di.c.i_gid;
+		node->size = di.c.i_size;
+		node->mtime = sb->build_time;
+		node->mtime_nsec = sb->build_time_nsec;
+	}
+
+	/* i_u is at the same offset in both inode layouts. */
+	node->raw_blkaddr = di.c.i_u.raw_blkaddr;
+	node->meta_pos = pos + isize + EROFS_XATTR_ISIZE(di.c.i_xattr_icount);
+
+	if (node->datalayout == EROFS_INODE_CHUNK_BASED) {
+		node->chunkformat = di.c.i_u.c.format;
+		node->meta_pos = ALIGN_UP(node->meta_pos,
+			(node->chunkformat & EROFS_CHUNK_FORMAT_INDEXES)
+			? sizeof(struct erofs_inode_chunk_index)
+			: sizeof(uint32_t));
+	}
+
+	*np = node;
+	return 0;
+}
+
+static int erofs_vtype_from_mode(uint32_t mode)
+{
+	switch (mode & S_IFMT) {
+	case S_IFREG:
+		return VREG;
+	case S_IFDIR:
+		return VDIR;
+	case S_IFLNK:
+		return VLNK;
+	case S_IFCHR:
+		return VCHR;
+	case S_IFBLK:
+		return VBLK;
+	case S_IFIFO:
+		return VFIFO;
+	case S_IFSOCK:
+		return VSOCK;
+	default:
+		return VBAD;
+	}
+}
+
+void erofs_vnode_init(struct vnode *vp, struct erofs_node *np)
+{
+	vp->v_data = np;
+	vp->v_type = erofs_vtype_from_mode(np->mode);
+	vp->v_mode = np->mode;
+	vp->v_size = np->size;
+}
+
+/*
+ * Map the file offset off of np to a byte position on the device. *lenp is
+ * set to the number of bytes that are contiguous on the device from there.
+ * *posp is EROFS_HOLE if the data is not allocated and reads as zeroes.
+ * Data that would extend past the end of the image is rejected with EIO.
+ */
+static int erofs_map(struct erofs_sb *sb, struct erofs_node *np,
+		     uint64_t off, uint64_t *posp, uint64_t *lenp)
+{
+	struct erofs_inode_chunk_index ci;
+	uint64_t tail, chunksz, idx;
+	uint32_t blkaddr;
+	int rc;
+
+	switch (np->datalayout) {
+	case EROFS_INODE_FLAT_PLAIN:
+		*posp = ((uint64_t) np->raw_blkaddr << sb->blkszbits) + off;
+		*lenp = np->size - off;
+		break;
+
+	case EROFS_INODE_FLAT_INLINE:
+		/* The last block of data follows the inode. */
+		tail = (DIV_ROUND_UP(np->size, sb->blksz) - 1) << sb->blkszbits;
+		if (off < tail) {
+			*posp = ((uint64_t) np->raw_blkaddr << sb->blkszbits) +
+				off;
+			*lenp = tail - off;
+		} else {
+			*posp = np->meta_pos + (off - tail);
+			*lenp = np->size - off;
+		}
+		break;
+
+	case EROFS_INODE_CHUNK_BASED:
+		chunksz = 1ULL << (sb->blkszbits +
+			  (np->chunkformat & EROFS_CHUNK_FORMAT_BLKBITS_MASK));
+		idx = off / chunksz;
+
+		if (np->chunkformat & EROFS_CHUNK_FORMAT_INDEXES) {
+			rc = erofs_copy(sb, np->meta_pos + idx * sizeof(ci),
+					sizeof(ci), &ci, NULL);
+			if (rc)
+				return rc;
+			/* Chunks on extra devices are not supported. */
+			if (ci.device_id)
+				return EOPNOTSUPP;
+			blkaddr = ci.blkaddr;
+		} else {
+			rc = erofs_copy(sb, np->meta_pos + idx * sizeof(blkaddr),
+					sizeof(blkaddr), &blkaddr, NULL);
+			if (rc)
+				return rc;
+		}
+
+		*lenp = MIN(chunksz - (off & (chunksz - 1)), np->size - off);
+		if (blkaddr == EROFS_NULL_ADDR) {
+			*posp = EROFS_HOLE;
+			return 0;
+		}
+		*posp = ((uint64_t) blkaddr << sb->blkszbits) +
+			(off & (chunksz - 1));
+		break;
+
+	default:
+		/* Compressed files are not supported. */
+		return EOPNOTSUPP;
+	}
+
+	if (unlikely(*posp + *lenp < *posp ||
+		     *posp + *lenp > ((uint64_t) sb->blocks << sb->blkszbits))) {
+		uk_pr_err("erofs: Data of nid %"__PRIu64" is past the end of the image\n",
+			  np->nid);
+		return EIO;
+	}
+	return 0;
+}
+
+/*
+ * Read len bytes of file data at off, either into buf or, if uio is not
+ * NULL, into uio. The caller makes sure that the range is within the file.
+ */
+static int erofs_node_read(struct erofs_sb *sb, struct erofs_node *np,
+			   uint64_t off, size_t len, void *buf,
+			   struct uio *uio)
+{
+	uint64_t pos, maplen, ra_len;
+	size_t n, z, zn;
+	int rc;
+
+	while (len) {
+		rc = erofs_map(sb, np, off, &pos, &maplen);
+		if (rc)
+			return rc;
+
+		n = MIN(len, maplen);
+
+		if (pos == EROFS_HOLE) {
+			if (!uio) {
+				memset(buf, 0, n);
+			} else {
+				for (z = n; z; z -= zn) {
+					zn = MIN(z, sizeof(erofs_zeroes));
+					rc = vfscore_uiomove((void *) erofs_zeroes,
+							     zn, uio);
+					if (rc)
+						return rc;
+				}
+			}
+		} else {
+			/*
+			 * Submit the blocks after the first one of this and,
+			 * for file reads, of the next few reads before
+			 * waiting for the first one.
+			 */
+			ra_len = n;
+			if (uio)
+				ra_len = MIN(maplen, n + ((uint64_t)
+					CONFIG_LIBEROFS_READAHEAD << sb->blkszbits));
+			if ((pos & (sb->blksz - 1)) + ra_len > sb->blksz)
+				erofs_breadahead(sb, (pos >> sb->blkszbits) + 1,
+					DIV_ROUND_UP((pos & (sb->blksz - 1)) +
+						     ra_len, sb->blksz) - 1);
+
+			rc = erofs_copy(sb, pos, n, buf, uio);
+			if (rc)
+				return rc;
+		}
+
+		off += n;
+		len -= n;
+		if (!uio)
+			buf = (char *) buf + n;
+	}
+
+	return 0;
+}
+
+/*
+ * Read directory block blk of np into buf. Returns the number of valid
+ * bytes and the number of dirents in the block.
+ */
+static int erofs_dir_block(struct erofs_sb *sb, struct erofs_node *np,
+			   uint64_t blk, char *buf, size_t *lenp,
+			   unsigned int *nentp)
+{
+	struct erofs_dirent *de = (struct erofs_dirent *) buf;
+	uint64_t off = blk << sb->blkszbits;
+	size_t len;
+	int rc;
+
+	if (off >= np->size)
+		return ENOENT;
+
+	len = MIN((uint64_t) sb->blksz, np->size - off);
+	rc = erofs_node_read(sb, np, off, len, buf, NULL);
+	if (rc)
+		return rc;
+
+	if (len < sizeof(*de) || de->nameoff < sizeof(*de) ||
+	    de->nameoff >= len || de->nameoff % sizeof(*de)) {
+		uk_pr_err("erofs: Corrupted directory block %"__PRIu64
+			  " of nid %"__PRIu64"\n", blk, np->nid);
+		return EIO;
+	}
+
+	*lenp = len;
+	*nentp = de->nameoff / sizeof(*de);
+	return 0;
+}
+
+/* Returns the name of dirent i and its length, NULL if corrupted. */
+static const char *erofs_dirent_name(const char *buf, size_t len,
+				     unsigned int nent, unsigned int i,
+				     size_t *namelen)
+{
+	const struct erofs_dirent *de = (const struct erofs_dirent *) buf;
+	size_t start = de[i].nameoff;
+	size_t end = (i + 1 < nent) ? de[i + 1].nameoff : len;
+
+	if (start > end || end > len)
+		return NULL;
+
+	*namelen = strnlen(buf + start, end - start);
+	return buf + start;
+}
+
+/* Names are sorted bytewise, with a prefix sorting before longer names. */
+static int erofs_dirnamecmp(const char *name, size_t len,
+			    const char *dname, size_t dlen)
+{
+	int rc = memcmp(name, dname, MIN(len, dlen));
+
+	if (rc)
+		return rc;
+	return (len > dlen) - (len < dlen);
+}
+
+static int erofs_dir_find(struct erofs_sb *sb, struct erofs_node *np,
+			  const char *name, uint64_t *nid)
+{
+	const struct erofs_dirent *de;
+	size_t len, namelen, dlen;
+	unsigned int nent, lo, hi, mid;
+	const char *dname;
+	uint64_t blk;
+	char *buf;
+	int rc, cmp;
+
+	buf = malloc(sb->blksz);
+	if (!buf)
+		return ENOMEM;
+
+	de = (const struct erofs_dirent *) buf;
+	namelen = strlen(name);
+
+	for (blk = 0; ; blk++) {
+		rc = erofs_dir_block(sb, np, blk, buf, &len, &nent);
+		if (rc)
+			break;
+
+		/* Binary search, dirents are sorted by name. */
+		lo = 0;
+		hi = nent;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			dname = erofs_dirent_name(buf, len, nent, mid, &dlen);
+			if (!dname) {
+				rc = EIO;
+				goto out;
+			}
+
+			cmp = erofs_dirnamecmp(name, namelen, dname, dlen);
+			if (!cmp) {
+				*nid = de[mid].nid;
+				goto out;
+			}
+			if (cmp < 0)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+
+		/* Blocks are sorted as well, no later block can match. */
+		if (lo < nent) {
+			rc = ENOENT;
+			break;
+		}
+	}
+
+out:
+	free(buf);
+	return rc;
+}
+
+static int erofs_vget(struct mount *mp, uint64_t nid, struct vnode **vpp)
+{
+	struct erofs_node *np;
+	struct vnode *vp;
+	int rc;
+
+	/*
+	 * Read the inode first so that the vnode is fully set up before
+	 * anyone else can find it.
+	 */
+	rc = erofs_read_node(EROFS_SB(mp), nid, &np);
+	if (rc)
+		return rc;
+
+	if (vfscore_vget(mp, EROFS_INO(nid), &vp)) {
+		/* Already in cache. */
+		free(np);
+		*vpp = vp;
+		return 0;
+	}
+
+	if (!vp) {
+		free(np);
+		return ENOMEM;
+	}
+
+	erofs_vnode_init(vp, np);
+	*vpp = vp;
+	return 0;
+}
+
+static int erofs_lookup(struct vnode *dvp, char *name, struct vnode **vpp)
+{
+	uint64_t nid;
+	int rc;
+
+	*vpp = NULL;
+
+	if (*name == '\0')
+		return ENOENT;
+	if (dvp->v_type != VDIR)
+		return ENOTDIR;
+
+	rc = erofs_dir_find(EROFS_SB(dvp->v_mount), EROFS_NODE(dvp), name,
+			    &nid);
+	if (rc)
+		return rc;
+
+	return erofs_vget(dvp->v_mount, nid, vpp);
+}
+
+static int erofs_dttype_from_ft(uint8_t ft)
+{
+	switch (ft) {
+	case EROFS_FT_REG_FILE:
+		return DT_REG;
+	case EROFS_FT_DIR:
+		return DT_DIR;
+	case EROFS_FT_CHRDEV:
+		return DT_CHR;
+	case EROFS_FT_BLKDEV:
+		return DT_BLK;
+	case EROFS_FT_FIFO:
+		return DT_FIFO;
+	case EROFS_FT_SOCK:
+		return DT_SOCK;
+	case EROFS_FT_SYMLINK:
+		return DT_LNK;
+	default:
+		return DT_UNKNOWN;
+	}
+}
+
+/*
+ * The file offset of a directory is the position of the next dirent in
+ * the directory data.
+ */
+static int erofs_readdir(struct vnode *vp, struct vfscore_file *fp,
+			 struct dirent *dir)
+{
+	struct erofs_sb *sb = EROFS_SB(vp->v_mount);
+	const struct erofs_dirent *de;
+	unsigned int nent, i;
+	size_t len, namelen;
+	const char *name;
+	uint64_t blk;
+	char *buf;
+	int rc;
+
+	if (fp->f_offset < 0)
+		return ENOENT;
+
+	buf = malloc(sb->blksz);
+	if (!buf)
+		return ENOMEM;
+
+	de = (const struct erofs_dirent *) buf;
+	blk = (uint64_t) fp->f_offset >> sb->blkszbits;
+	i = (fp->f_offset & (sb->blksz - 1)) / sizeof(*de);
+
+	for (;;) {
+		rc = erofs_dir_block(sb, EROFS_NODE(vp), blk, buf, &len, &nent);
+		if (rc)
+			goto out;
+		if (i < nent)
+			break;
+		blk++;
+		i = 0;
+	}
+
+	name = erofs_dirent_name(buf, len, nent, i, &namelen);
+	if (!name) {
+		rc = EIO;
+		goto out;
+	}
+
+	namelen = MIN(namelen, sizeof(dir->d_name) - 1);
+	memcpy(dir->d_name, name, namelen);
+	dir->d_name[namelen] = '\0';
+	dir->d_type = erofs_dttype_from_ft(de[i].file_type);
+	dir->d_fileno = de[i].nid;
+
+	if (i + 1 < nent)
+		fp->f_offset = (blk << sb->blkszbits) + (i + 1) * sizeof(*de);
+	else
+		fp->f_offset = (blk + 1) << sb->blkszbits;
+
+out:
+	free(buf);
+	return rc;
+}
+
+static int erofs_read(struct vnode *vp, struct vfscore_file *fp __unused,
+		      struct uio *uio, int ioflag __unused)
+{
+	size_t len;
+
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (vp->v_type != VREG)
+		return EINVAL;
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_resid == 0)
+		return 0;
+
+	if (uio->uio_offset >= (off_t) vp->v_size)
+		return 0;
+
+	if (vp->v_size - uio->uio_offset < uio->uio_resid)
+		len = vp->v_size - uio->uio_offset;
+	else
+		len = uio->uio_resid;
+
+	return erofs_node_read(EROFS_SB(vp->v_mount), EROFS_NODE(vp),
+			       uio->uio_offset, len, NULL, uio);
+}
+
+static int erofs_readlink(struct vnode *vp, struct uio *uio)
+{
+	size_t len;
+
+	if (vp->v_type != VLNK)
+		return EINVAL;
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_resid == 0)
+		return 0;
+	if (uio->uio_offset >= (off_t) vp->v_size)
+		return 0;
+	if (vp->v_size - uio->uio_offset < uio->uio_resid)
+		len = vp->v_size - uio->uio_offset;
+	else
+		len = uio->uio_resid;
+
+	return erofs_node_read(EROFS_SB(vp->v_mount), EROFS_NODE(vp),
+			       uio->uio_offset, len, NULL, uio);
+}
+
+static int erofs_getattr(struct vnode *vp, struct vattr *attr)
+{
+	struct erofs_node *np = EROFS_NODE(vp);
+
+	attr->va_type = vp->v_type;
+	attr->va_mode = np->mode;
+	attr->va_nlink = np->nlink;
+	attr->va_uid = np->uid;
+	attr->va_gid = np->gid;
+	attr->va_nodeid = vp->v_ino;
+	attr->va_size = np->size;
+	attr->va_nblocks = DIV_ROUND_UP(np->size, 512);
+
+	attr->va_atime.tv_sec = np->mtime;
+	attr->va_atime.tv_nsec = np->mtime_nsec;
+	attr->va_mtime = attr->va_atime;
+	attr->va_ctime = attr->va_atime;
+
+	if (vp->v_type == VCHR || vp->v_type == VBLK)
+		attr->va_rdev = np->rdev;
+
+	return 0;
+}
+
+static int erofs_inactive(struct vnode *vp)
+{
+	free(vp->v_data);
+	vp->v_data = NULL;
+	return 0;
+}
+
+static int erofs_open(struct vfscore_file *fp)
+{
+	if (fp->f_flags & (UK_FWRITE | O_TRUNC))
+		return EROFS;
+
+	return 0;
+}
+
+#define erofs_close		((vnop_close_t)vfscore_vop_nullop)
+#define erofs_write		((vnop_write_t)vfscore_vop_erofs)
+#define erofs_seek		((vnop_seek_t)vfscore_vop_nullop)
+#define erofs_ioctl		((vnop_ioctl_t)vfscore_vop_einval)
+#define erofs_fsync		((vnop_fsync_t)vfscore_vop_nullop)
+#define erofs_create		((vnop_create_t)vfscore_vop_erofs)
+#define erofs_remove		((vnop_remove_t)vfscore_vop_erofs)
+#define erofs_rename		((vnop_rename_t)vfscore_vop_erofs)
+#define erofs_mkdir		((vnop_mkdir_t)vfscore_vop_erofs)
+#define erofs_rmdir		((vnop_rmdir_t)vfscore_vop_erofs)
+#define erofs_setattr		((vnop_setattr_t)vfscore_vop_erofs)
+#define erofs_truncate		((vnop_truncate_t)vfscore_vop_erofs)
+#define erofs_link		((vnop_link_t)vfscore_vop_erofs)
+#define erofs_cache		((vnop_cache_t)NULL)
+#define erofs_fallocate		((vnop_fallocate_t)vfscore_vop_erofs)
+#define erofs_symlink		((vnop_symlink_t)vfscore_vop_erofs)
+#define erofs_poll		((vnop_poll_t)vfscore_vop_einval)
+
+struct vnops erofs_vnops = {
+	.vop_open	= erofs_open,
+	.vop_close	= erofs_close,
+	.vop_read	= erofs_read,
+	.vop_write	= erofs_write,
+	.vop_seek	= erofs_seek,
+	.vop_ioctl	= erofs_ioctl,
+	.vop_fsync	= erofs_fsync,
+	.vop_readdir	= erofs_readdir,
+	.vop_lookup	= erofs_lookup,
+	.vop_create	= erofs_create,
+	.vop_remove	= erofs_remove,
+	.vop_rename	= erofs_rename,
+	.vop_mkdir	= erofs_mkdir,
+	.vop_rmdir	= erofs_rmdir,
+	.vop_getattr	= erofs_getattr,
+	.vop_setattr	= erofs_setattr,
+	.vop_inactive	= erofs_inactive,
+	.vop_truncate	= erofs_truncate,
+	.vop_link	= erofs_link,
+	.vop_cache	= erofs_cache,
+	.vop_fallocate	= erofs_fallocate,
+	.vop_readlink	= erofs_readlink,
+	.vop_symlink	= erofs_symlink,
+	.vop_poll	= erofs_poll
+};
@@ -0,0 +1,465 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <uk/alloc.h>
+#include <uk/essentials.h>
+#include <uk/blkdev.h>
+#include <uk/blkdev_driver.h>
+#include <uk/syscall.h>
+#include <uk/test.h>
+#include "../erofs_fs.h"
+
+/*
+ * The tests mount a small image that is put together at init time in the
+ * memory of a polled RAM block device:
+ *
+ *   block  2	superblock (at byte 1024)
+ *   block  4	inodes (meta_blkaddr), see the ETEST_NID_* below
+ *   block  8	root directory
+ *   block 10	"plain" (FLAT_PLAIN, 3 blocks)
+ *   block 13	second chunk of "sparse" (CHUNK_BASED, first chunk a hole)
+ *
+ * "bad" is a FLAT_PLAIN file whose data runs past the end of the image.
+ */
+#define ETEST_DIR		"/erofs_test"
+#define ETEST_PATH(name)	ETEST_DIR "/" name
+
+#define ETEST_BLKSZBITS		9
+#define ETEST_BLKSZ		(1U << ETEST_BLKSZBITS)
+#define ETEST_BLOCKS		16
+#define ETEST_META_BLKADDR	4
+#define ETEST_DEPTH		4
+
+#define ETEST_NID_ROOT		0
+#define ETEST_NID_HELLO		2
+#define ETEST_NID_PLAIN		4
+#define ETEST_NID_BAD		5
+#define ETEST_NID_SPARSE	6
+#define ETEST_NID_LINK		8
+
+#define ETEST_HELLO		"Hello, EROFS\n"
+#define ETEST_PLAIN_SIZE	1500
+#define ETEST_LINK		"hello"
+
+struct uk_blkdev_queue {
+	struct uk_blkreq *reqs[ETEST_DEPTH];
+	unsigned int nb_reqs;
+};
+
+static struct {
+	struct uk_blkdev blkdev;
+	struct uk_blkdev_queue queue;
+	char data[ETEST_BLOCKS * ETEST_BLKSZ];
+	/* Requests for sectors past the end of the device */
+	unsigned int nb_oob;
+} edisk;
+
+static void edisk_get_info(struct uk_blkdev *dev __unused,
+			   struct uk_blkdev_info *dev_info)
+{
+	dev_info->max_queues = 1;
+}
+
+static int edisk_configure(struct uk_blkdev *dev __unused,
+			   const struct uk_blkdev_conf *conf __unused)
+{
+	return 0;
+}
+
+static int edisk_queue_get_info(struct uk_blkdev *dev __unused,
+				uint16_t queue_id __unused,
+				struct uk_blkdev_queue_info *q_info)
+{
+	q_info->nb_min = 1;
+	q_info->nb_max = ETEST_DEPTH;
+	return 0;
+}
+
+static struct uk_blkdev_queue *edisk_queue_configure(
+		struct uk_blkdev *dev __unused, uint16_t queue_id __unused,
+		uint16_t nb_desc __unused,
+		const struct uk_blkdev_queue_conf *queue_conf __unused)
+{
+	edisk.queue.nb_reqs = 0;
+	return &edisk.queue;
+}
+
+static int edisk_nullop(struct uk_blkdev *dev __unused)
+{
+	return 0;
+}
+
+static int edisk_queue_unconfigure(struct uk_blkdev *dev __unused,
+				   struct uk_blkdev_queue *queue __unused)
+{
+	return 0;
+}
+
+static int edisk_submit_one(struct uk_blkdev *dev,
+			    struct uk_blkdev_queue *queue,
+			    struct uk_blkreq *req)
+{
+	if (queue->nb_reqs == ETEST_DEPTH)
+		return 0;
+	if (req->start_sector + req->nb_sectors > uk_blkdev_sectors(dev)) {
+		edisk.nb_oob++;
+		return -EINVAL;
+	}
+	if (req->operation != UK_BLKREQ_READ)
+		return -EROFS;
+
+	memcpy(req->aio_buf, edisk.data + req->start_sector * ETEST_BLKSZ,
+	       req->nb_sectors * ETEST_BLKSZ);
+	queue->reqs[queue->nb_reqs++] = req;
+	return UK_BLKDEV_STATUS_SUCCESS;
+}
+
+static int edisk_finish_reqs(struct uk_blkdev *dev __unused,
+			     struct uk_blkdev_queue *queue)
+{
+	struct uk_blkreq *reqs[ETEST_DEPTH];
+	unsigned int i, nb_reqs = queue->nb_reqs;
+
+	/* Callbacks may hand new requests to the driver */
+	memcpy(reqs, queue->reqs, nb_reqs * sizeof(*reqs));
+	queue->nb_reqs = 0;
+
+	for (i = 0; i < nb_reqs; i++) {
+		reqs[i]->result = 0;
+		uk_blkreq_finished(reqs[i]);
+		if (reqs[i]->cb)
+			reqs[i]->cb(reqs[i], reqs[i]->cb_cookie);
+	}
+	return 0;
+}
+
+static const struct uk_blkdev_ops edisk_ops = {
+	.get_info = edisk_get_info,
+	.dev_configure = edisk_configure,
+	.queue_get_info = edisk_queue_get_info,
+	.queue_configure = edisk_queue_configure,
+	.dev_start = edisk_nullop,
+	.dev_stop = edisk_nullop,
+	.queue_unconfigure = edisk_queue_unconfigure,
+	.dev_unconfigure = edisk_nullop,
+};
+
+/* Contents of the data blocks, different for every byte of a block */
+static char etest_pattern(uint32_t blkaddr, uint32_t off)
+{
+	return (char) (blkaddr * 31 + off * 7 + 3);
+}
+
+static void etest_fill(uint32_t blkaddr, uint32_t count)
+{
+	uint32_t off;
+
+	for (; count; count--, blkaddr++)
+		for (off = 0; off < ETEST_BLKSZ; off++)
+			edisk.data[blkaddr * ETEST_BLKSZ + off] =
+				etest_pattern(blkaddr, off);
+}
+
+static char *etest_slot(uint64_t nid)
+{
+	return edisk.data + ETEST_META_BLKADDR * ETEST_BLKSZ +
+	       (nid << EROFS_ISLOTBITS);
+}
+
+static void etest_inode(uint64_t nid, uint16_t layout, uint16_t mode,
+			uint32_t size, uint32_t u)
+{
+	struct erofs_inode_compact *di = (void *) etest_slot(nid);
+
+	di->i_format = (layout << EROFS_I_DATALAYOUT_BIT) |
+		       EROFS_INODE_LAYOUT_COMPACT;
+	di->i_mode = mode;
+	di->i_nlink = S_ISDIR(mode) ? 2 : 1;
+	di->i_size = size;
+	di->i_u.raw_blkaddr = u;
+	di->i_ino = nid;
+}
+
+static void etest_mkimage(void)
+{
+	static const struct {
+		const char *name;
+		uint64_t nid;
+		uint8_t type;
+	} ents[] = {
+		{ ".", ETEST_NID_ROOT, EROFS_FT_DIR },
+		{ "..", ETEST_NID_ROOT, EROFS_FT_DIR },
+		{ "bad", ETEST_NID_BAD, EROFS_FT_REG_FILE },
+		{ "hello", ETEST_NID_HELLO, EROFS_FT_REG_FILE },
+		{ "link", ETEST_NID_LINK, EROFS_FT_SYMLINK },
+		{ "plain", ETEST_NID_PLAIN, EROFS_FT_REG_FILE },
+		{ "sparse", ETEST_NID_SPARSE, EROFS_FT_REG_FILE },
+	};
+	struct erofs_super_block *dsb;
+	struct erofs_dirent *de;
+	uint32_t *chunks;
+	uint16_t nameoff;
+	unsigned int i;
+
+	memset(edisk.data, 0, sizeof(edisk.data));
+
+	dsb = (void *) (edisk.data + EROFS_SUPER_OFFSET);
+	dsb->magic = EROFS_SUPER_MAGIC_V1;
+	dsb->blkszbits = ETEST_BLKSZBITS;
+	dsb->root_nid = ETEST_NID_ROOT;
+	dsb->inos = ARRAY_SIZE(ents) - 1;
+	dsb->blocks = ETEST_BLOCKS;
+	dsb->meta_blkaddr = ETEST_META_BLKADDR;
+
+	etest_inode(ETEST_NID_ROOT, EROFS_INODE_FLAT_PLAIN, S_IFDIR | 0755,
+		    ETEST_BLKSZ, 8);
+	de = (void *) (edisk.data + 8 * ETEST_BLKSZ);
+	nameoff = ARRAY_SIZE(ents) * sizeof(*de);
+	for (i = 0; i < ARRAY_SIZE(ents); i++) {
+		de[i].nid = ents[i].nid;
+		de[i].nameoff = nameoff;
+		de[i].file_type = ents[i].type;
+		memcpy((char *) de + nameoff, ents[i].name,
+		       strlen(ents[i].name));
+		nameoff += strlen(ents[i].name);
+	}
+
+	/* The data of FLAT_INLINE files follows the inode */
+	etest_inode(ETEST_NID_HELLO, EROFS_INODE_FLAT_INLINE, S_IFREG | 0644,
+		    sizeof(ETEST_HELLO) - 1, 0);
+	memcpy(etest_slot(ETEST_NID_HELLO + 1), ETEST_HELLO,
+	       sizeof(ETEST_HELLO) - 1);
+
+	etest_inode(ETEST_NID_LINK, EROFS_INODE_FLAT_INLINE, S_IFLNK | 0777,
+		    sizeof(ETEST_LINK) - 1, 0);
+	memcpy(etest_slot(ETEST_NID_LINK + 1), ETEST_LINK,
+	       sizeof(ETEST_LINK) - 1);
+
+	etest_inode(ETEST_NID_PLAIN, EROFS_INODE_FLAT_PLAIN, S_IFREG | 0644,
+		    ETEST_PLAIN_SIZE, 10);
+	etest_fill(10, 3);
+
+	/* One block per chunk, a block address table after the inode */
+	etest_inode(ETEST_NID_SPARSE, EROFS_INODE_CHUNK_BASED, S_IFREG | 0644,
+		    2 * ETEST_BLKSZ, 0);
+	chunks = (void *) etest_slot(ETEST_NID_SPARSE + 1);
+	chunks[0] = EROFS_NULL_ADDR;
+	chunks[1] = 13;
+	etest_fill(13, 1);
+
+	/* Two blocks from the last one of the image */
+	etest_inode(ETEST_NID_BAD, EROFS_INODE_FLAT_PLAIN, S_IFREG | 0644,
+		    2 * ETEST_BLKSZ, ETEST_BLOCKS - 1);
+}
+
+static int etest_init(struct uk_testsuite *suite __unused)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	char devname[16];
+	int id;
+
+	etest_mkimage();
+
+	edisk.blkdev.submit_one = edisk_submit_one;
+	edisk.blkdev.finish_reqs = edisk_finish_reqs;
+	edisk.blkdev.dev_ops = &edisk_ops;
+	edisk.blkdev.capabilities.sectors = ETEST_BLOCKS;
+	edisk.blkdev.capabilities.ssize = ETEST_BLKSZ;
+	edisk.blkdev.capabilities.mode = O_RDONLY;
+	edisk.blkdev.capabilities.max_sectors_per_req = ETEST_BLOCKS;
+	edisk.blkdev.capabilities.ioalign = ETEST_BLKSZ;
+
+	id = uk_blkdev_drv_register(&edisk.blkdev, a, "erofs_test");
+	if (id < 0)
+		return -1;
+	snprintf(devname, sizeof(devname), "blk%d", id);
+
+	/* Provide a root file system to mount on if there is none */
+	if (mkdir(ETEST_DIR, 0755) && errno != EEXIST &&
+	    (mount("", "/", "ramfs", 0, NULL) || mkdir(ETEST_DIR, 0755)))
+		return -1;
+	if (mount(devname, ETEST_DIR, "erofs", 0, NULL))
+		return -1;
+	return 0;
+}
+
+/* Reads len bytes at off of path into buf, returns the count or -errno */
+static ssize_t etest_pread(const char *path, void *buf, size_t len, off_t off)
+{
+	ssize_t rc;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	if (lseek(fd, off, SEEK_SET) != off) {
+		rc = -errno;
+		goto out;
+	}
+	rc = read(fd, buf, len);
+	if (rc < 0)
+		rc = -errno;
+out:
+	close(fd);
+	return rc;
+}
+
+UK_TESTCASE(erofs_testsuite, erofs_test_lookup)
+{
+	static const char * const names[] = {
+		"bad", "hello", "link", "plain", "sparse"
+	};
+	struct dirent *d;
+	struct stat st;
+	unsigned int n = 0;
+	DIR *dir;
+
+	UK_TEST_EXPECT_ZERO(stat(ETEST_PATH("hello"), &st));
+	UK_TEST_EXPECT(S_ISREG(st.st_mode));
+	UK_TEST_EXPECT_SNUM_EQ(st.st_size, sizeof(ETEST_HELLO) - 1);
+	UK_TEST_EXPECT_ZERO(stat(ETEST_PATH("sparse"), &st));
+	UK_TEST_EXPECT_SNUM_EQ(st.st_size, 2 * ETEST_BLKSZ);
+	UK_TEST_EXPECT_ZERO(lstat(ETEST_PATH("link"), &st));
+	UK_TEST_EXPECT(S_ISLNK(st.st_mode));
+
+	/* Names that sort before, between and after the dirents */
+	UK_TEST_EXPECT_SNUM_EQ(stat(ETEST_PATH("a"), &st), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, ENOENT);
+	UK_TEST_EXPECT_SNUM_EQ(stat(ETEST_PATH("hell"), &st), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, ENOENT);
+	UK_TEST_EXPECT_SNUM_EQ(stat(ETEST_PATH("zzz"), &st), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, ENOENT);
+
+	dir = opendir(ETEST_DIR);
+	UK_TEST_EXPECT_NOT_NULL(dir);
+	if (!dir)
+		return;
+	while ((d = readdir(dir))) {
+		if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+			continue;
+		if (n < ARRAY_SIZE(names))
+			UK_TEST_EXPECT_ZERO(strcmp(d->d_name, names[n]));
+		n++;
+	}
+	closedir(dir);
+	UK_TEST_EXPECT_SNUM_EQ(n, ARRAY_SIZE(names));
+}
+
+UK_TESTCASE(erofs_testsuite, erofs_test_read)
+{
+	char buf[ETEST_PLAIN_SIZE + 16];
+	ssize_t i;
+
+	/* Tail-packed data after the inode */
+	UK_TEST_EXPECT_SNUM_EQ(etest_pread(ETEST_PATH("hello"), buf,
+					   sizeof(buf), 0),
+			       sizeof(ETEST_HELLO) - 1);
+	UK_TEST_EXPECT_ZERO(memcmp(buf, ETEST_HELLO, sizeof(ETEST_HELLO) - 1));
+
+	/* Contiguous blocks, read whole and across a block boundary */
+	UK_TEST_EXPECT_SNUM_EQ(etest_pread(ETEST_PATH("plain"), buf,
+					   sizeof(buf), 0),
+			       ETEST_PLAIN_SIZE);
+	for (i = 0; i < ETEST_PLAIN_SIZE; i++)
+		if (buf[i] != etest_pattern(10 + i / ETEST_BLKSZ,
+					    i % ETEST_BLKSZ))
+			break;
+	UK_TEST_EXPECT_SNUM_EQ(i, ETEST_PLAIN_SIZE);
+
+	UK_TEST_EXPECT_SNUM_EQ(etest_pread(ETEST_PATH("plain"), buf, 100,
+					   ETEST_BLKSZ - 50), 100);
+	UK_TEST_EXPECT_SNUM_EQ(buf[0], etest_pattern(10, ETEST_BLKSZ - 50));
+	UK_TEST_EXPECT_SNUM_EQ(buf[99], etest_pattern(11, 49));
+
+	/* A hole reads as zeroes, the allocated chunk from its block */
+	memset(buf, 0xff, sizeof(buf));
+	UK_TEST_EXPECT_SNUM_EQ(etest_pread(ETEST_PATH("sparse"), buf,
+					   sizeof(buf), 0),
+			       2 * ETEST_BLKSZ);
+	for (i = 0; i < ETEST_BLKSZ; i++)
+		if (buf[i])
+			break;
+	UK_TEST_EXPECT_SNUM_EQ(i, ETEST_BLKSZ);
+	for (; i < 2 * ETEST_BLKSZ; i++)
+		if (buf[i] != etest_pattern(13, i - ETEST_BLKSZ))
+			break;
+	UK_TEST_EXPECT_SNUM_EQ(i, 2 * ETEST_BLKSZ);
+
+	/* Nothing is read at or past the end of the file */
+	UK_TEST_EXPECT_ZERO(etest_pread(ETEST_PATH("plain"), buf, 1,
+					ETEST_PLAIN_SIZE));
+}
+
+UK_TESTCASE(erofs_testsuite, erofs_test_readlink)
+{
+	char buf[16];
+
+	UK_TEST_EXPECT_SNUM_EQ(uk_syscall_r_readlink((long) ETEST_PATH("link"),
+						     (long) buf, sizeof(buf)),
+			       sizeof(ETEST_LINK) - 1);
+	UK_TEST_EXPECT_ZERO(memcmp(buf, ETEST_LINK, sizeof(ETEST_LINK) - 1));
+
+	/* Reading through the link ends up at the target */
+	UK_TEST_EXPECT_SNUM_EQ(etest_pread(ETEST_PATH("link"), buf,
+					   sizeof(buf), 0),
+			       sizeof(ETEST_HELLO) - 1);
+}
+
+UK_TESTCASE(erofs_testsuite, erofs_test_past_end)
+{
+	char buf[ETEST_BLKSZ];
+	unsigned int nb_oob = edisk.nb_oob;
+
+	/* Data past the end of the image is refused before any request */
+	UK_TEST_EXPECT_SNUM_EQ(etest_pread(ETEST_PATH("bad"), buf,
+					   sizeof(buf), 0), -EIO);
+	UK_TEST_EXPECT_SNUM_EQ(edisk.nb_oob - nb_oob, 0);
+}
+
+UK_TESTCASE(erofs_testsuite, erofs_test_rdonly)
+{
+	UK_TEST_EXPECT_SNUM_EQ(open(ETEST_PATH("hello"), O_WRONLY), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EROFS);
+	UK_TEST_EXPECT_SNUM_EQ(open(ETEST_PATH("new"), O_CREAT | O_RDWR,
+				    0644), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EROFS);
+}
+
+uk_testsuite_register(erofs_testsuite, etest_init);
@@ -40,6 +40,8 @@ extern "C" {
 
 #include <stdint.h>
 
+#define __NEED_time_t
+#define __NEED_struct_timespec
 #define __NEED_sigset_t
 #include <nolibc-internal/shareddefs.h>
 
@@ -94,6 +96,8 @@ int epoll_wait(int epfd, struct epoll_event *events, int maxevents,
 	       int timeout);
 int epoll_pwait(int epfd, struct epoll_event *events, int maxevents,
 		int timeout, const sigset_t *sigmask);
+int epoll_pwait2(int epfd, struct epoll_event *events, int maxevents,
+		 const struct timespec *timeout, const sigset_t *sigmask);
 
 #ifdef __cplusplus
 }
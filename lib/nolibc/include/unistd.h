@@ -90,6 +90,7 @@ int dup(int oldfd);
 int dup2(int oldfd, int newfd);
 int dup3(int oldfd, int newfd, int flags);
 int unlink(const char *pathname);
+int pipe(int pipefd[2]);
 off_t lseek(int fd, off_t offset, int whence);
 #endif
 
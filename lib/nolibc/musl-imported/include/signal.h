@@ -61,6 +61,8 @@ extern "C" {
 #define __NEED_pid_t
 #define __NEED_sig_atomic_t
 #define __NEED_sigset_t
+#define __NEED_time_t
+#define __NEED_struct_timespec
 #include <nolibc-internal/shareddefs.h>
 
 #define NSIG _NSIG
@@ -102,6 +104,9 @@ int sigprocmask(int how, const sigset_t *set,
 		sigset_t *oldset);
 int sigsuspend(const sigset_t *mask);
 int sigwait(const sigset_t *set, int *sig);
+int sigwaitinfo(const sigset_t *set, siginfo_t *info);
+int sigtimedwait(const sigset_t *set, siginfo_t *info,
+		 const struct timespec *timeout);
 
 int kill(pid_t pid, int sig);
 int killpg(int pgrp, int sig);
@@ -119,16 +124,23 @@ int sigaddset(sigset_t *set, int signo);
 int sigdelset(sigset_t *set, int signo);
 int sigismember(const sigset_t *set, int signo);
 
-/* TODO: not used - defined just for newlib */
 union sigval {
 	int    sival_int;	/* Integer signal value */
 	void  *sival_ptr;	/* Pointer signal value */
 };
 
+#define SIGEV_SIGNAL 0
+#define SIGEV_NONE   1
+#define SIGEV_THREAD 2
+
+/* Same layout as the Linux kernel */
 struct sigevent {
-	int              sigev_notify;	/* Notification type */
-	int              sigev_signo;	/* Signal number */
 	union sigval     sigev_value;	/* Signal value */
+	int              sigev_signo;	/* Signal number */
+	int              sigev_notify;	/* Notification type */
+	void (*sigev_notify_function)(union sigval); /* SIGEV_THREAD */
+	void            *sigev_notify_attributes;
+	char __pad[64 - 2 * sizeof(int) - 3 * sizeof(void *)];
 };
 
 /* TODO: not used - defined just for v8 */
@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <uk/syscall.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+
+#include "process.h"
+
+#if !CONFIG_LIBPOSIX_PROCESS_PIDS
+#define UNIKRAFT_TID      1
+#endif /* !CONFIG_LIBPOSIX_PROCESS_PIDS */
+
+#define AFFINITY_MASK_SIZE \
+	(UK_SCHED_LCPU_MASK_LONGS * sizeof(unsigned long))
+
+static struct uk_thread *affinity_thread(pid_t tid)
+{
+	if (tid == 0)
+		return uk_thread_current();
+#if CONFIG_LIBPOSIX_PROCESS_PIDS
+	return tid2ukthread(tid);
+#else /* !CONFIG_LIBPOSIX_PROCESS_PIDS */
+	if (tid == UNIKRAFT_TID)
+		return uk_thread_current();
+	return NULL;
+#endif /* !CONFIG_LIBPOSIX_PROCESS_PIDS */
+}
+
+/* NOTE: Like Linux, we ignore bits for CPUs that we cannot have and treat
+ *       missing bits of a shorter mask as cleared.
+ */
+UK_LLSYSCALL_R_DEFINE(int, sched_setaffinity, pid_t, tid,
+		      size_t, len, const unsigned long *, user_mask)
+{
+	unsigned long mask[UK_SCHED_LCPU_MASK_LONGS];
+	struct uk_thread *t;
+
+	if (unlikely(!user_mask))
+		return -EFAULT;
+
+	t = affinity_thread(tid);
+	if (!t)
+		return -ESRCH;
+
+	memset(mask, 0, sizeof(mask));
+	memcpy(mask, user_mask, MIN(len, sizeof(mask)));
+	return uk_sched_thread_set_affinity(t, mask);
+}
+
+/* NOTE: The raw system call returns the number of bytes that were written
+ *       to the mask, the libc wrapper returns 0.
+ */
+UK_LLSYSCALL_R_DEFINE(int, sched_getaffinity, pid_t, tid,
+		      size_t, len, unsigned long *, user_mask)
+{
+	unsigned long mask[UK_SCHED_LCPU_MASK_LONGS];
+	struct uk_thread *t;
+
+	if (unlikely(len < AFFINITY_MASK_SIZE))
+		return -EINVAL;
+	if (unlikely(len & (sizeof(unsigned long) - 1)))
+		return -EINVAL;
+	if (unlikely(!user_mask))
+		return -EFAULT;
+
+	t = affinity_thread(tid);
+	if (!t)
+		return -ESRCH;
+
+	uk_sched_thread_get_affinity(t, mask);
+	memcpy(user_mask, mask, AFFINITY_MASK_SIZE);
+	return (int) AFFINITY_MASK_SIZE;
+}
@@ -346,7 +346,8 @@ typedef int (*posix_socket_ioctl_func_t)(struct posix_socket_file *sock,
  * @param ecb Reference to the eventpoll control block. It can be used to
  *    configure a cleanup function that should be called when the eventpoll
  *    is destroyed and further calls of eventpoll_signal by the driver are no
- *    longer desired
+ *    longer desired. A control block is already set up if either its
+ *    unregister callback or its data field is set (see eventpoll_cb)
  *
  * NOTE: the driver must ensure that the destructor callback synchronizes
  *    with incoming events and poll calls
@@ -86,6 +86,9 @@ ramfs_mount(struct mount *mp, const char *dev __unused,
 	if (np == NULL)
 		return ENOMEM;
 	mp->m_root->d_vnode->v_data = np;
+
+	/* All changes go through vfscore, negative dentries never go stale */
+	mp->m_dneg_timeout = DNEG_NOEXPIRE;
 	return 0;
 }
 
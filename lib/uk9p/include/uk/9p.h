@@ -225,6 +225,107 @@ int64_t uk_9p_read(struct uk_9pdev *dev, struct uk_9pfid *fid,
 int64_t uk_9p_write(struct uk_9pdev *dev, struct uk_9pfid *fid,
 		uint64_t offset, uint32_t count, const char *buf);
 
+/**
+ * Returns the maximum number of bytes a single TREAD on the given fid can
+ * transfer, given the negotiated message size and the fid's iounit.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param fid
+ *   9P fid to read from.
+ * @return
+ *   Maximum read count per request.
+ */
+uint32_t uk_9p_read_maxcount(struct uk_9pdev *dev, struct uk_9pfid *fid);
+
+/**
+ * Returns the maximum number of bytes a single TWRITE on the given fid can
+ * transfer, given the negotiated message size and the fid's iounit.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param fid
+ *   9P fid to write to.
+ * @return
+ *   Maximum write count per request.
+ */
+uint32_t uk_9p_write_maxcount(struct uk_9pdev *dev, struct uk_9pfid *fid);
+
+/**
+ * Sends a TREAD request without waiting for the reply, so that several
+ * requests can be in flight at the same time. The count is truncated to
+ * uk_9p_read_maxcount(). The buffer must stay valid until the request is
+ * passed to uk_9p_read_complete(), which must be called for every request
+ * returned by this function.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param fid
+ *   9P fid to read from.
+ * @param offset
+ *   Offset at which to start reading.
+ * @param count
+ *   Maximum number of bytes to read.
+ * @param buf
+ *   Buffer to read into.
+ * @return
+ *   - (!ERRPTR): The in-flight request.
+ *   - ERRPTR: The request could not be sent.
+ */
+struct uk_9preq *uk_9p_read_submit(struct uk_9pdev *dev, struct uk_9pfid *fid,
+		uint64_t offset, uint32_t count, char *buf);
+
+/**
+ * Waits for the reply to a request sent with uk_9p_read_submit() and
+ * releases the request.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param req
+ *   The in-flight TREAD request.
+ * @return
+ *   - (>= 0): Amount of bytes read.
+ *   - (< 0): An error occurred.
+ */
+int64_t uk_9p_read_complete(struct uk_9pdev *dev, struct uk_9preq *req);
+
+/**
+ * Sends a TWRITE request without waiting for the reply. The count is
+ * truncated to uk_9p_write_maxcount(). The buffer must stay valid until the
+ * request is passed to uk_9p_write_complete(), which must be called for
+ * every request returned by this function.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param fid
+ *   9P fid to write to.
+ * @param offset
+ *   Offset at which to start writing.
+ * @param count
+ *   Maximum number of bytes to write.
+ * @param buf
+ *   Data to be written.
+ * @return
+ *   - (!ERRPTR): The in-flight request.
+ *   - ERRPTR: The request could not be sent.
+ */
+struct uk_9preq *uk_9p_write_submit(struct uk_9pdev *dev, struct uk_9pfid *fid,
+		uint64_t offset, uint32_t count, const char *buf);
+
+/**
+ * Waits for the reply to a request sent with uk_9p_write_submit() and
+ * releases the request.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param req
+ *   The in-flight TWRITE request.
+ * @return
+ *   - (>= 0): Amount of bytes written.
+ *   - (< 0): An error occurred.
+ */
+int64_t uk_9p_write_complete(struct uk_9pdev *dev, struct uk_9preq *req);
+
 /**
  * Stats the given fid and places the data into the given stat structure.
  *
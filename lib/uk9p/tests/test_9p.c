@@ -0,0 +1,342 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/errptr.h>
+#include <uk/essentials.h>
+#include <uk/9p.h>
+#include <uk/9pdev.h>
+#include <uk/9pdev_trans.h>
+#include <uk/9preq.h>
+#include <uk/9pfid.h>
+#include <uk/test.h>
+
+/*
+ * Loopback transport that serves TREAD and TWRITE from a memory buffer.
+ * Requests are either answered right away or held back until the test
+ * answers them, in any order. Everything else (e.g., the TCLUNK sent when
+ * the fid is released) gets an empty reply.
+ */
+#define LOOP_MSIZE		(UK_9P_HEADER_SIZE + 4 + 256)
+#define LOOP_FILE_SIZE		4096
+#define LOOP_MAX_PENDING	8
+
+/* Sizes of the fixed parts of TREAD/TWRITE and their replies */
+#define LOOP_RREAD_HDRSZ	(UK_9P_HEADER_SIZE + 4)
+#define LOOP_TWRITE_HDRSZ	(UK_9P_HEADER_SIZE + 4 + 8 + 4)
+
+struct loop_ctx {
+	char file[LOOP_FILE_SIZE];
+	/* Hold requests back instead of answering them right away */
+	int hold;
+	struct uk_9preq *pending[LOOP_MAX_PENDING];
+	unsigned int nb_pending;
+	unsigned int max_pending;
+	/* Count requested by the last TREAD or TWRITE */
+	uint32_t last_count;
+};
+
+static struct loop_ctx loop;
+
+static void loop_put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void loop_put32(uint8_t *p, uint32_t v)
+{
+	loop_put16(p, v);
+	loop_put16(p + 2, v >> 16);
+}
+
+static uint32_t loop_get32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t loop_get64(const uint8_t *p)
+{
+	return loop_get32(p) | ((uint64_t) loop_get32(p + 4) << 32);
+}
+
+static void loop_header(struct uk_9preq *req, uint32_t size, uint8_t type)
+{
+	loop_put32(req->recv.buf, size);
+	((uint8_t *) req->recv.buf)[4] = type;
+	loop_put16((uint8_t *) req->recv.buf + 5, req->tag);
+}
+
+/* Answers a request with an Rerror carrying `errcode` */
+static void loop_reply_error(struct uk_9preq *req, uint32_t errcode)
+{
+	uint8_t *p = (uint8_t *) req->recv.buf + UK_9P_HEADER_SIZE;
+	uint32_t size = UK_9P_HEADER_SIZE + 2 + 4;
+
+	loop_put16(p, 0);
+	loop_put32(p + 2, errcode);
+	loop_header(req, size, UK_9P_RERROR);
+	uk_9preq_receive_cb(req, size);
+	uk_9preq_put(req);
+}
+
+static void loop_reply(struct uk_9preq *req)
+{
+	const uint8_t *t = (const uint8_t *) req->xmit.buf + UK_9P_HEADER_SIZE;
+	uint64_t off;
+	uint32_t count;
+
+	switch (req->xmit.type) {
+	case UK_9P_TREAD:
+		off = loop_get64(t + 4);
+		count = loop_get32(t + 12);
+		if (off > LOOP_FILE_SIZE)
+			off = LOOP_FILE_SIZE;
+		count = MIN(count, LOOP_FILE_SIZE - off);
+		memcpy(req->recv.zc_buf, loop.file + off, count);
+		loop_put32((uint8_t *) req->recv.buf + UK_9P_HEADER_SIZE,
+			   count);
+		loop_header(req, LOOP_RREAD_HDRSZ + count, UK_9P_RREAD);
+		uk_9preq_receive_cb(req, LOOP_RREAD_HDRSZ + count);
+		break;
+	case UK_9P_TWRITE:
+		off = loop_get64(t + 4);
+		count = loop_get32(t + 12);
+		if (off > LOOP_FILE_SIZE)
+			off = LOOP_FILE_SIZE;
+		count = MIN(count, LOOP_FILE_SIZE - off);
+		memcpy(loop.file + off, req->xmit.zc_buf, count);
+		loop_put32((uint8_t *) req->recv.buf + UK_9P_HEADER_SIZE,
+			   count);
+		loop_header(req, UK_9P_HEADER_SIZE + 4, UK_9P_RWRITE);
+		uk_9preq_receive_cb(req, UK_9P_HEADER_SIZE + 4);
+		break;
+	default:
+		loop_header(req, UK_9P_HEADER_SIZE, req->xmit.type + 1);
+		uk_9preq_receive_cb(req, UK_9P_HEADER_SIZE);
+		break;
+	}
+	uk_9preq_put(req);
+}
+
+static int loop_connect(struct uk_9pdev *dev,
+			const char *device_identifier __unused,
+			const char *mount_args __unused)
+{
+	dev->max_msize = LOOP_MSIZE;
+	return 0;
+}
+
+static int loop_disconnect(struct uk_9pdev *dev __unused)
+{
+	return 0;
+}
+
+static int loop_request(struct uk_9pdev *dev __unused, struct uk_9preq *req)
+{
+	if (req->xmit.type == UK_9P_TREAD || req->xmit.type == UK_9P_TWRITE)
+		loop.last_count = loop_get32((uint8_t *) req->xmit.buf
+					     + UK_9P_HEADER_SIZE + 12);
+
+	/* Keep the request alive until it is answered */
+	uk_9preq_get(req);
+	UK_WRITE_ONCE(req->state, UK_9PREQ_SENT);
+
+	if (!loop.hold || req->xmit.type == UK_9P_TCLUNK) {
+		loop_reply(req);
+		return 0;
+	}
+
+	if (loop.nb_pending == LOOP_MAX_PENDING) {
+		uk_9preq_put(req);
+		return -ENOSPC;
+	}
+	loop.pending[loop.nb_pending++] = req;
+	loop.max_pending = MAX(loop.max_pending, loop.nb_pending);
+	return 0;
+}
+
+static const struct uk_9pdev_trans_ops loop_ops = {
+	.connect = loop_connect,
+	.disconnect = loop_disconnect,
+	.request = loop_request,
+};
+
+static struct uk_9pdev_trans loop_trans = {
+	.name = "loop",
+	.ops = &loop_ops,
+};
+
+static struct uk_9pdev *loop_dev_create(struct uk_9pfid **fid)
+{
+	struct uk_9pdev *dev;
+	unsigned int i;
+
+	memset(&loop, 0, sizeof(loop));
+	for (i = 0; i < LOOP_FILE_SIZE; i++)
+		loop.file[i] = (char) (i * 7);
+
+	dev = uk_9pdev_connect(&loop_trans, "loop", NULL,
+			       uk_alloc_get_default());
+	if (PTRISERR(dev))
+		return NULL;
+
+	*fid = uk_9pdev_fid_create(dev);
+	if (PTRISERR(*fid)) {
+		uk_9pdev_disconnect(dev);
+		return NULL;
+	}
+	return dev;
+}
+
+static void loop_dev_destroy(struct uk_9pdev *dev, struct uk_9pfid *fid)
+{
+	/* Releasing the last reference clunks the fid */
+	loop.hold = 0;
+	uk_9pfid_put(fid);
+	uk_9pdev_disconnect(dev);
+}
+
+UK_TESTCASE(uk9p_testsuite, uk9p_test_maxcount)
+{
+	struct uk_9pfid *fid;
+	struct uk_9pdev *dev;
+	char buf[LOOP_MSIZE];
+
+	dev = loop_dev_create(&fid);
+	UK_TEST_EXPECT_NOT_NULL(dev);
+
+	/* Limited by the message size, and by the iounit if there is one */
+	UK_TEST_EXPECT_SNUM_EQ(uk_9p_read_maxcount(dev, fid),
+			       LOOP_MSIZE - LOOP_RREAD_HDRSZ);
+	UK_TEST_EXPECT_SNUM_EQ(uk_9p_write_maxcount(dev, fid),
+			       LOOP_MSIZE - LOOP_TWRITE_HDRSZ);
+	fid->iounit = 100;
+	UK_TEST_EXPECT_SNUM_EQ(uk_9p_read_maxcount(dev, fid), 100);
+	UK_TEST_EXPECT_SNUM_EQ(uk_9p_write_maxcount(dev, fid), 100);
+
+	/* Requests are truncated to that size */
+	UK_TEST_EXPECT_SNUM_EQ(uk_9p_read(dev, fid, 0, sizeof(buf), buf),
+			       100);
+	UK_TEST_EXPECT_SNUM_EQ(loop.last_count, 100);
+	UK_TEST_EXPECT_SNUM_EQ(uk_9p_write(dev, fid, 0, sizeof(buf), buf),
+			       100);
+	UK_TEST_EXPECT_SNUM_EQ(loop.last_count, 100);
+
+	/* An iounit of 0 means no limit, for writes as well */
+	fid->iounit = 0;
+	UK_TEST_EXPECT_SNUM_EQ(uk_9p_write(dev, fid, 0, sizeof(buf), buf),
+			       LOOP_MSIZE - LOOP_TWRITE_HDRSZ);
+
+	loop_dev_destroy(dev, fid);
+}
+
+UK_TESTCASE(uk9p_testsuite, uk9p_test_read_pipelined)
+{
+	struct uk_9preq *req[4];
+	char buf[ARRAY_SIZE(req)][200];
+	struct uk_9pfid *fid;
+	struct uk_9pdev *dev;
+	unsigned int i;
+
+	dev = loop_dev_create(&fid);
+	UK_TEST_EXPECT_NOT_NULL(dev);
+
+	/* All reads are in flight before the first reply arrives */
+	loop.hold = 1;
+	for (i = 0; i < ARRAY_SIZE(req); i++) {
+		req[i] = uk_9p_read_submit(dev, fid, i * sizeof(buf[0]),
+					   sizeof(buf[0]), buf[i]);
+		UK_TEST_EXPECT_ZERO(PTRISERR(req[i]));
+	}
+	UK_TEST_EXPECT_SNUM_EQ(loop.max_pending, ARRAY_SIZE(req));
+
+	/* Replies are matched by tag, whatever their order */
+	while (loop.nb_pending)
+		loop_reply(loop.pending[--loop.nb_pending]);
+
+	for (i = 0; i < ARRAY_SIZE(req); i++) {
+		UK_TEST_EXPECT_SNUM_EQ(uk_9p_read_complete(dev, req[i]),
+				       sizeof(buf[0]));
+		UK_TEST_EXPECT_BYTES_EQ(buf[i], loop.file + i * sizeof(buf[0]),
+					sizeof(buf[0]));
+	}
+
+	/* An error affects its own request only */
+	req[0] = uk_9p_read_submit(dev, fid, 0, sizeof(buf[0]), buf[0]);
+	req[1] = uk_9p_read_submit(dev, fid, LOOP_FILE_SIZE - 10,
+				   sizeof(buf[1]), buf[1]);
+	UK_TEST_EXPECT_SNUM_EQ(loop.nb_pending, 2);
+	loop_reply_error(loop.pending[0], EACCES);
+	loop_reply(loop.pending[1]);
+	loop.nb_pending = 0;
+	UK_TEST_EXPECT_SNUM_EQ(uk_9p_read_complete(dev, req[0]), -EACCES);
+	UK_TEST_EXPECT_SNUM_EQ(uk_9p_read_complete(dev, req[1]), 10);
+
+	loop_dev_destroy(dev, fid);
+}
+
+UK_TESTCASE(uk9p_testsuite, uk9p_test_write_pipelined)
+{
+	struct uk_9preq *req[4];
+	char buf[ARRAY_SIZE(req)][200];
+	struct uk_9pfid *fid;
+	struct uk_9pdev *dev;
+	unsigned int i;
+
+	dev = loop_dev_create(&fid);
+	UK_TEST_EXPECT_NOT_NULL(dev);
+
+	loop.hold = 1;
+	for (i = 0; i < ARRAY_SIZE(req); i++) {
+		memset(buf[i], 'a' + i, sizeof(buf[i]));
+		req[i] = uk_9p_write_submit(dev, fid, i * sizeof(buf[0]),
+					    sizeof(buf[0]), buf[i]);
+		UK_TEST_EXPECT_ZERO(PTRISERR(req[i]));
+	}
+	UK_TEST_EXPECT_SNUM_EQ(loop.max_pending, ARRAY_SIZE(req));
+
+	/* Complete in submission order, reply in the opposite one */
+	while (loop.nb_pending)
+		loop_reply(loop.pending[--loop.nb_pending]);
+	for (i = 0; i < ARRAY_SIZE(req); i++) {
+		UK_TEST_EXPECT_SNUM_EQ(uk_9p_write_complete(dev, req[i]),
+				       sizeof(buf[0]));
+		UK_TEST_EXPECT_BYTES_EQ(loop.file + i * sizeof(buf[0]), buf[i],
+					sizeof(buf[0]));
+	}
+
+	loop_dev_destroy(dev, fid);
+}
+
+uk_testsuite_register(uk9p_testsuite, NULL);
@@ -1,133 +1,473 @@
 #include <uk/futex.h>
 #include <uk/syscall.h>
 #include <uk/arch/atomic.h>
+#include <uk/arch/spinlock.h>
+#include <uk/arch/time.h>
 #include <uk/thread.h>
 #include <uk/list.h>
+#include <uk/init.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
 #include <stdio.h>
 #include <uk/assert.h>
 #include <uk/print.h>
 #include <errno.h>
 
-static UK_LIST_HEAD(futex_list);
+/*
+ * Waiters are kept in a hash table keyed by the futex address, so that a
+ * wake-up only walks the waiters that share its bucket. There is a single
+ * address space, thus FUTEX_PRIVATE_FLAG has no effect.
+ *
+ * Lock order: bucket (lower address first), thread, scheduler.
+ */
+#define FUTEX_HASH_SIZE		(1UL << CONFIG_LIBUKATOMIC_FUTEX_HASH_ORDER)
 
-static int futex_wait(uint32_t *uaddr, uint32_t val, const struct timespec *tm)
+struct uk_futex_bucket {
+#if CONFIG_HAVE_SMP
+	__spinlock lock;
+#endif /* CONFIG_HAVE_SMP */
+	struct uk_list_head waiters;
+};
+
+static struct uk_futex_bucket futex_table[FUTEX_HASH_SIZE];
+
+static inline struct uk_futex_bucket *futex_bucket(uint32_t *uaddr)
 {
-	struct uk_thread *current = uk_thread_current();
-	struct uk_futex f = {.uaddr = uaddr, .thread = current};
-	int ret;
+	/* Fibonacci hashing of the word index */
+	__u64 h = ((__uptr) uaddr >> 2) * 0x9e3779b97f4a7c15ULL;
 
-	if (ukarch_load_n(uaddr) == val) {
+	return &futex_table[h >> (64 - CONFIG_LIBUKATOMIC_FUTEX_HASH_ORDER)];
+}
 
-		/* Enqueue thread to wait list */
-		uk_list_add_tail(&f.list_node, &futex_list);
+static inline unsigned long
+futex_bucket_lock(struct uk_futex_bucket *b __maybe_unused)
+{
+	unsigned long flags;
 
-		if (tm)
-			/* Block for at most timeout nanosecs */
-			uk_thread_block_timeout(current, tm->tv_nsec);
-		else
-			/* Block indefinitely */
-			uk_thread_block(current);
+	flags = ukplat_lcpu_save_irqf();
+#if CONFIG_HAVE_SMP
+	ukarch_spin_lock(&b->lock);
+#endif /* CONFIG_HAVE_SMP */
+	return flags;
+}
 
-		uk_sched_yield();
+static inline void
+futex_bucket_unlock(struct uk_futex_bucket *b __maybe_unused,
+		    unsigned long flags)
+{
+#if CONFIG_HAVE_SMP
+	ukarch_spin_unlock(&b->lock);
+#endif /* CONFIG_HAVE_SMP */
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+static unsigned long futex_bucket_lock2(struct uk_futex_bucket *b1,
+					struct uk_futex_bucket *b2)
+{
+	unsigned long flags;
 
-		/* Thread is no longer blocked. Remove it from the futex list */
-		uk_list_del(&f.list_node);
+	if (b1 > b2)
+		return futex_bucket_lock2(b2, b1);
 
-		/* TODO: Should return -ETIMEDOUT if appropriate */
-		return 0;
+	flags = futex_bucket_lock(b1);
+#if CONFIG_HAVE_SMP
+	if (b1 != b2)
+		ukarch_spin_lock(&b2->lock);
+#endif /* CONFIG_HAVE_SMP */
+	return flags;
+}
+
+static void futex_bucket_unlock2(struct uk_futex_bucket *b1,
+				 struct uk_futex_bucket *b2 __maybe_unused,
+				 unsigned long flags)
+{
+#if CONFIG_HAVE_SMP
+	if (b1 != b2)
+		ukarch_spin_unlock(&b2->lock);
+#endif /* CONFIG_HAVE_SMP */
+	futex_bucket_unlock(b1, flags);
+}
+
+/*
+ * Locks the bucket that a waiter is queued on. A concurrent requeue may
+ * move the waiter to another bucket until we hold the lock.
+ */
+static struct uk_futex_bucket *futex_waiter_lock(struct uk_futex *f,
+						 unsigned long *flags)
+{
+	struct uk_futex_bucket *b;
+
+	for (;;) {
+		b = UK_READ_ONCE(f->bucket);
+		*flags = futex_bucket_lock(b);
+		if (b == UK_READ_ONCE(f->bucket))
+			return b;
+		futex_bucket_unlock(b, *flags);
 	}
+}
 
-	/* Futex word does not contain expected val */
-	return -EAGAIN;
+/*
+ * Dequeues and wakes up a waiter. The caller must hold the bucket lock,
+ * which keeps the waiter from returning until the lock is released.
+ */
+static void futex_wake_waiter(struct uk_futex *f)
+{
+	uk_list_del_init(&f->list_node);
+	uk_thread_wakeup(f->thread);
 }
 
-static int futex_wake(uint32_t *uaddr, uint32_t val)
+/*
+ * Converts a timeout to a deadline on the monotonic clock. FUTEX_WAIT takes
+ * a relative timeout, FUTEX_WAIT_BITSET an absolute time on the monotonic
+ * or, with FUTEX_CLOCK_REALTIME, the realtime clock.
+ */
+static int futex_deadline(const struct timespec *tm, int absolute,
+			  int realtime, __nsec *deadline)
 {
-	struct uk_list_head *itr, *tmp;
-	struct uk_futex *f;
-	int count = 0;
+	__nsec now, t;
 
-	if (val == 0)
+	if (!tm) {
+		*deadline = 0; /* Wait indefinitely */
 		return 0;
+	}
+
+	if (unlikely(tm->tv_sec < 0 || tm->tv_nsec < 0
+		     || tm->tv_nsec >= (long) ukarch_time_sec_to_nsec(1)))
+		return -EINVAL;
+
+	t = ukarch_time_sec_to_nsec((__nsec) tm->tv_sec) + tm->tv_nsec;
+	now = ukplat_monotonic_clock();
+
+	if (!absolute) {
+		*deadline = now + t;
+	} else if (realtime) {
+		__nsec wall = ukplat_wall_clock();
 
-	uk_list_for_each_safe(itr, tmp, &futex_list) {
-		f = uk_list_entry(itr, struct uk_futex, list_node);
+		*deadline = (t > wall) ? now + (t - wall) : now;
+	} else {
+		*deadline = (t > now) ? t : now;
+	}
+
+	return 0;
+}
+
+static int futex_wait(uint32_t *uaddr, uint32_t val, __nsec deadline,
+		      uint32_t bitset)
+{
+	struct uk_thread *current = uk_thread_current();
+	struct uk_futex f = {
+		.uaddr = uaddr,
+		.bitset = bitset,
+		.thread = current,
+		.bucket = futex_bucket(uaddr),
+	};
+	struct uk_futex_bucket *b;
+	unsigned long flags;
+	int ret = 0;
 
-		if (f->uaddr == uaddr) {
-			uk_thread_wakeup(f->thread);
+	if (unlikely(!bitset))
+		return -EINVAL;
+
+	/*
+	 * Compare and enqueue under the bucket lock, so that a waker that
+	 * changes the futex word before it takes the lock cannot be missed.
+	 */
+	b = f.bucket;
+	flags = futex_bucket_lock(b);
+	if (ukarch_load_n(uaddr) != val) {
+		futex_bucket_unlock(b, flags);
+		/* Futex word does not contain expected val */
+		return -EAGAIN;
+	}
+	uk_list_add_tail(&f.list_node, &b->waiters);
+
+	for (;;) {
+		uk_thread_block_until(current, deadline);
+		futex_bucket_unlock(b, flags);
+
+		uk_sched_yield();
 
-			/* Wake at most val threads */
-			if (++count >= val)
-				break;
+		b = futex_waiter_lock(&f, &flags);
+		if (uk_list_empty(&f.list_node))
+			break; /* Dequeued by a waker */
+		if (deadline && ukplat_monotonic_clock() >= deadline) {
+			uk_list_del_init(&f.list_node);
+			ret = -ETIMEDOUT;
+			break;
 		}
 	}
+	futex_bucket_unlock(b, flags);
+
+	return ret;
+}
+
+/*
+ * Wakes up to nr waiters of uaddr in bucket b whose bitset intersects
+ * bitset. The bucket lock must be held. A count of zero wakes nobody.
+ */
+static int futex_wake_locked(struct uk_futex_bucket *b, uint32_t *uaddr,
+			     uint32_t nr, uint32_t bitset)
+{
+	struct uk_futex *f, *tmp;
+	uint32_t count = 0;
+
+	if (nr == 0)
+		return 0;
+
+	uk_list_for_each_entry_safe(f, tmp, &b->waiters, list_node) {
+		if (f->uaddr != uaddr || !(f->bitset & bitset))
+			continue;
+
+		futex_wake_waiter(f);
+
+		/* Wake at most nr threads */
+		if (++count >= nr)
+			break;
+	}
+
+	return (int) count;
+}
+
+static int futex_wake(uint32_t *uaddr, uint32_t val, uint32_t bitset)
+{
+	struct uk_futex_bucket *b = futex_bucket(uaddr);
+	unsigned long flags;
+	int count;
+
+	if (unlikely(!bitset))
+		return -EINVAL;
+
+	flags = futex_bucket_lock(b);
+	count = futex_wake_locked(b, uaddr, val, bitset);
+	futex_bucket_unlock(b, flags);
 
 	return count;
 }
 
-static int futex_cmp_requeue(uint32_t *uaddr, uint32_t val,
-			     const struct timespec *timeout, uint32_t *uaddr2,
-			     uint32_t val3)
-{
-	/* For several blocking operations, the timeout argument is a
-	   pointer to a timespec structure that specifies a timeout for the
-	   operation.  However,  notwithstanding the prototype shown above,
-	   for some operations, the least significant four bytes of this
-	   argument are instead used as an integer whose meaning is
-	   determined by the operation.  For these operations, the kernel
-	   casts the timeout value first to unsigned long, then to uint32_t,
-	   and in the remainder of this page, this argument is referred to
-	   as val2 when interpreted in this fashion.*/
-	// TODO: probably better to use val2 directly from call to futex
-	unsigned long tmp = (unsigned long)(timeout->tv_nsec);
-	uint32_t val2 = tmp & 0xFFFFFFFF;
-
-	if (!((uint32_t)val3 == ukarch_load_n(uaddr))) {
+/*
+ * Wakes up to nr_wake waiters of uaddr and moves up to nr_requeue of the
+ * remaining ones to uaddr2, where they wait without being woken up. This
+ * way, a condition variable broadcast wakes a single thread instead of all
+ * waiters, which would only contend for the mutex.
+ */
+static int futex_requeue(uint32_t *uaddr, uint32_t nr_wake,
+			 uint32_t nr_requeue, uint32_t *uaddr2,
+			 int cmp, uint32_t val3)
+{
+	struct uk_futex_bucket *b1 = futex_bucket(uaddr);
+	struct uk_futex_bucket *b2 = futex_bucket(uaddr2);
+	struct uk_futex *f, *tmp;
+	unsigned long flags;
+	uint32_t woken = 0, requeued = 0;
+
+	if (unlikely(!uaddr2 || ((__uptr) uaddr2 & 3)))
+		return -EINVAL;
+	/* Requeueing onto the same futex would loop forever in userspace */
+	if (unlikely(uaddr == uaddr2))
+		return -EINVAL;
+
+	flags = futex_bucket_lock2(b1, b2);
+	if (cmp && ukarch_load_n(uaddr) != val3) {
+		futex_bucket_unlock2(b1, b2, flags);
 		return -EAGAIN;
 	}
 
-	int ret = futex_wake(uaddr, val);
-	// TODO:
-	/*uint32_t waiters_uaddr2 = 0;
-	if (val > ret) {
-
-	}*/
-	/*Otherwise, the operation
-	          wakes up a maximum of val waiters that are waiting on the
-	          futex at uaddr.  If there are more than val waiters, then
-	          the remaining waiters are removed from the wait queue of
-	          the source futex at uaddr and added to the wait queue of
-	          the target futex at uaddr2.  The val2 argument specifies
-	          an upper limit on the number of waiters that are requeued
-	          to the futex at uaddr2.*/
+	uk_list_for_each_entry_safe(f, tmp, &b1->waiters, list_node) {
+		if (f->uaddr != uaddr)
+			continue;
+
+		if (woken < nr_wake) {
+			futex_wake_waiter(f);
+			woken++;
+		} else if (requeued < nr_requeue) {
+			f->uaddr = uaddr2;
+			if (b1 != b2) {
+				uk_list_del(&f->list_node);
+				uk_list_add_tail(&f->list_node, &b2->waiters);
+				UK_WRITE_ONCE(f->bucket, b2);
+			}
+			requeued++;
+		} else {
+			break;
+		}
+	}
+	futex_bucket_unlock2(b1, b2, flags);
+
+	/*
+	 * FUTEX_REQUEUE only reports the woken waiters, FUTEX_CMP_REQUEUE
+	 * the requeued ones as well
+	 */
+	return cmp ? (int) (woken + requeued) : (int) woken;
+}
+
+/* Applies the operation encoded in val3 to *uaddr2, returns the old value */
+static int futex_atomic_op(uint32_t *uaddr2, uint32_t val3, uint32_t *oldval)
+{
+	unsigned int op = (val3 >> 28) & 0xf;
+	int oparg = (int) (val3 << 8) >> 20;
+	uint32_t old, new;
+
+	if (op & FUTEX_OP_OPARG_SHIFT) {
+		if (unlikely(oparg < 0 || oparg > 31))
+			return -EINVAL;
+		oparg = 1 << oparg;
+		op &= ~FUTEX_OP_OPARG_SHIFT;
+	}
+
+	old = ukarch_load_n(uaddr2);
+	do {
+		switch (op) {
+		case FUTEX_OP_SET:
+			new = oparg;
+			break;
+		case FUTEX_OP_ADD:
+			new = old + oparg;
+			break;
+		case FUTEX_OP_OR:
+			new = old | oparg;
+			break;
+		case FUTEX_OP_ANDN:
+			new = old & ~oparg;
+			break;
+		case FUTEX_OP_XOR:
+			new = old ^ oparg;
+			break;
+		default:
+			return -ENOSYS;
+		}
+	} while (!__atomic_compare_exchange_n(uaddr2, &old, new, 0,
+					      __ATOMIC_SEQ_CST,
+					      __ATOMIC_SEQ_CST));
+
+	*oldval = old;
 	return 0;
 }
 
+static int futex_op_cmp(uint32_t val3, uint32_t oldval)
+{
+	int cmparg = (int) (val3 << 20) >> 20;
+	int old = (int) oldval;
+
+	switch ((val3 >> 24) & 0xf) {
+	case FUTEX_OP_CMP_EQ:
+		return old == cmparg;
+	case FUTEX_OP_CMP_NE:
+		return old != cmparg;
+	case FUTEX_OP_CMP_LT:
+		return old < cmparg;
+	case FUTEX_OP_CMP_LE:
+		return old <= cmparg;
+	case FUTEX_OP_CMP_GT:
+		return old > cmparg;
+	case FUTEX_OP_CMP_GE:
+		return old >= cmparg;
+	default:
+		return -ENOSYS;
+	}
+}
+
+/*
+ * Modifies *uaddr2, wakes up to val waiters of uaddr and, if the old value
+ * of *uaddr2 passes the comparison, up to val2 waiters of uaddr2.
+ */
+static int futex_wake_op(uint32_t *uaddr, uint32_t val, uint32_t val2,
+			 uint32_t *uaddr2, uint32_t val3)
+{
+	struct uk_futex_bucket *b1 = futex_bucket(uaddr);
+	struct uk_futex_bucket *b2 = futex_bucket(uaddr2);
+	unsigned long flags;
+	uint32_t oldval;
+	int count, count2 = 0;
+	int rc;
+
+	if (unlikely(!uaddr2 || ((__uptr) uaddr2 & 3)))
+		return -EINVAL;
+
+	flags = futex_bucket_lock2(b1, b2);
+	rc = futex_atomic_op(uaddr2, val3, &oldval);
+	if (unlikely(rc < 0))
+		goto out;
+
+	count = futex_wake_locked(b1, uaddr, val, FUTEX_BITSET_MATCH_ANY);
+
+	rc = futex_op_cmp(val3, oldval);
+	if (unlikely(rc < 0))
+		goto out;
+	if (rc)
+		count2 = futex_wake_locked(b2, uaddr2, val2,
+					   FUTEX_BITSET_MATCH_ANY);
+	rc = count + count2;
+
+out:
+	futex_bucket_unlock2(b1, b2, flags);
+	return rc;
+}
+
 int do_futex(uint32_t *uaddr, int futex_op, uint32_t val,
 	     const struct timespec *timeout, uint32_t *uaddr2, uint32_t val3)
 {
-	switch (futex_op) {
+	int cmd = futex_op & FUTEX_CMD_MASK;
+	int realtime = futex_op & FUTEX_CLOCK_REALTIME;
+	/* Some operations pass an integer (val2) in place of the timeout */
+	uint32_t val2 = (uint32_t) (__uptr) timeout;
+	__nsec deadline;
+	int rc;
+
+	if (unlikely(!uaddr || ((__uptr) uaddr & 3)))
+		return -EINVAL;
+	if (unlikely(realtime && cmd != FUTEX_WAIT && cmd != FUTEX_WAIT_BITSET))
+		return -ENOSYS;
+
+	switch (cmd) {
 	case FUTEX_WAIT:
-	case FUTEX_WAIT_PRIVATE:
-		return futex_wait(uaddr, val, timeout);
+		rc = futex_deadline(timeout, 0, 0, &deadline);
+		if (unlikely(rc < 0))
+			return rc;
+		return futex_wait(uaddr, val, deadline, FUTEX_BITSET_MATCH_ANY);
+
+	case FUTEX_WAIT_BITSET:
+		rc = futex_deadline(timeout, 1, realtime, &deadline);
+		if (unlikely(rc < 0))
+			return rc;
+		return futex_wait(uaddr, val, deadline, val3);
 
 	case FUTEX_WAKE:
-	case FUTEX_WAKE_PRIVATE:
-		return futex_wake(uaddr, val);
+		return futex_wake(uaddr, val, FUTEX_BITSET_MATCH_ANY);
+
+	case FUTEX_WAKE_BITSET:
+		return futex_wake(uaddr, val, val3);
 
-	case FUTEX_FD:
 	case FUTEX_REQUEUE:
-		return -ENOSYS;
+		return futex_requeue(uaddr, val, val2, uaddr2, 0, 0);
 
 	case FUTEX_CMP_REQUEUE:
-		return futex_cmp_requeue(uaddr, val, timeout, uaddr2, val3);
+		return futex_requeue(uaddr, val, val2, uaddr2, 1, val3);
 
+	case FUTEX_WAKE_OP:
+		return futex_wake_op(uaddr, val, val2, uaddr2, val3);
+
+	case FUTEX_FD:
 	default:
+		/* TODO: Priority-inheritance futexes */
 		return -ENOSYS;
-		// TODO: other operations?
 	}
 }
 
+static int futex_init(void)
+{
+	unsigned long i;
+
+	for (i = 0; i < FUTEX_HASH_SIZE; i++) {
+#if CONFIG_HAVE_SMP
+		ukarch_spin_init(&futex_table[i].lock);
+#endif /* CONFIG_HAVE_SMP */
+		UK_INIT_LIST_HEAD(&futex_table[i].waiters);
+	}
+
+	return 0;
+}
+uk_early_initcall(futex_init);
+
 UK_SYSCALL_DEFINE(int, futex, uint32_t *, uaddr, int, futex_op, uint32_t, val,
 		  const struct timespec *, timeout, uint32_t *, uaddr2,
 		  uint32_t, val3)
@@ -40,9 +40,37 @@
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
 
+/* Bitset that matches every waiter (FUTEX_WAIT/FUTEX_WAKE) */
+#define FUTEX_BITSET_MATCH_ANY	0xffffffff
+
+/* FUTEX_WAKE_OP operations and comparisons */
+#define FUTEX_OP_SET		0	/* uaddr2 = oparg */
+#define FUTEX_OP_ADD		1	/* uaddr2 += oparg */
+#define FUTEX_OP_OR		2	/* uaddr2 |= oparg */
+#define FUTEX_OP_ANDN		3	/* uaddr2 &= ~oparg */
+#define FUTEX_OP_XOR		4	/* uaddr2 ^= oparg */
+#define FUTEX_OP_OPARG_SHIFT	8	/* Use (1 << oparg) as operand */
+
+#define FUTEX_OP_CMP_EQ		0
+#define FUTEX_OP_CMP_NE		1
+#define FUTEX_OP_CMP_LT		2
+#define FUTEX_OP_CMP_LE		3
+#define FUTEX_OP_CMP_GT		4
+#define FUTEX_OP_CMP_GE		5
+
+/* Encodes a FUTEX_WAKE_OP operation into val3 */
+#define FUTEX_OP(op, oparg, cmp, cmparg)				\
+	((((op) & 0xf) << 28) | (((cmp) & 0xf) << 24)			\
+	 | (((oparg) & 0xfff) << 12) | ((cmparg) & 0xfff))
+
+struct uk_futex_bucket;
+
+/* Waiter on a futex */
 struct uk_futex {
 	uint32_t *uaddr;
+	uint32_t bitset;	/* FUTEX_WAIT_BITSET mask */
 	struct uk_thread *thread;
+	struct uk_futex_bucket *bucket;
 	struct uk_list_head list_node;
 };
 
@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <uk/arch/atomic.h>
+#include <uk/essentials.h>
+#include <uk/futex.h>
+#include <uk/plat/time.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+
+#define BENCH_THREADS	4
+#define BENCH_LOOPS	100000
+
+/*
+ * Futex-based mutex: 0 is unlocked, 1 locked and 2 locked with (possible)
+ * waiters, as described in "Futexes Are Tricky" by U. Drepper.
+ */
+struct bench_mutex {
+	uint32_t word;
+	unsigned long waits;
+	unsigned long wakes;
+};
+
+static void bench_mutex_lock(struct bench_mutex *m)
+{
+	uint32_t c = 0;
+
+	if (__atomic_compare_exchange_n(&m->word, &c, 1, 0, __ATOMIC_SEQ_CST,
+					__ATOMIC_SEQ_CST))
+		return; /* Uncontended */
+
+	if (c != 2)
+		c = ukarch_exchange_n(&m->word, 2);
+	while (c != 0) {
+		ukarch_inc(&m->waits);
+		futex(&m->word, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+		c = ukarch_exchange_n(&m->word, 2);
+	}
+}
+
+static void bench_mutex_unlock(struct bench_mutex *m)
+{
+	if (ukarch_exchange_n(&m->word, 0) == 2) {
+		ukarch_inc(&m->wakes);
+		futex(&m->word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	}
+}
+
+struct bench_ctx {
+	struct bench_mutex mutex;
+	unsigned long counter;
+	unsigned int done;
+};
+
+static __noreturn void bench_fn(void *arg)
+{
+	struct bench_ctx *ctx = (struct bench_ctx *) arg;
+	unsigned int i;
+
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		bench_mutex_lock(&ctx->mutex);
+		ctx->counter++;
+		/* Give up the CPU inside the critical section now and then */
+		if ((i & 15) == 0)
+			uk_sched_yield();
+		bench_mutex_unlock(&ctx->mutex);
+	}
+
+	ukarch_inc(&ctx->done);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(ukatomic_futex_benchsuite, ukatomic_bench_futex_mutex)
+{
+	struct bench_ctx ctx = { 0 };
+	struct uk_thread *t;
+	__nsec start, elapsed;
+	unsigned int i;
+
+	start = ukplat_monotonic_clock();
+	for (i = 0; i < BENCH_THREADS; i++) {
+		t = uk_sched_thread_create(uk_sched_current(), bench_fn, &ctx,
+					   "bench-futex");
+		UK_TEST_EXPECT_NOT_NULL(t);
+	}
+	while (UK_READ_ONCE(ctx.done) < BENCH_THREADS)
+		uk_sched_yield();
+	elapsed = ukplat_monotonic_clock() - start;
+
+	UK_TEST_EXPECT_SNUM_EQ(ctx.counter,
+			       BENCH_THREADS * BENCH_LOOPS);
+	UK_TEST_EXPECT_ZERO(ctx.mutex.word);
+
+	uk_test_printf("futex mutex: %u threads, %lu lock/unlock in %lu us "
+		       "(%lu ops/s), %lu waits, %lu wakes\n",
+		       BENCH_THREADS, ctx.counter,
+		       (unsigned long) (elapsed / 1000),
+		       elapsed ? (unsigned long) (ctx.counter
+						  * 1000000000ULL / elapsed)
+			       : 0UL,
+		       ctx.mutex.waits, ctx.mutex.wakes);
+}
+
+uk_testsuite_register(ukatomic_futex_benchsuite, NULL);
@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <uk/arch/atomic.h>
+#include <uk/essentials.h>
+#include <uk/futex.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+
+#define TEST_WAITERS		4
+
+/* Passes val2 in place of the timeout */
+#define FUTEX_VAL2(v)		((const struct timespec *) (__uptr) (v))
+
+struct futex_waiter {
+	uint32_t *uaddr;
+	struct uk_thread *thread;
+	int rc;
+	int done;
+};
+
+static __noreturn void futex_waiter_fn(void *arg)
+{
+	struct futex_waiter *w = (struct futex_waiter *) arg;
+	int rc;
+
+	rc = futex(w->uaddr, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+	w->rc = (rc < 0) ? -errno : rc;
+	UK_WRITE_ONCE(w->done, 1);
+	uk_sched_thread_exit();
+}
+
+/* Starts n waiters and returns once all of them are blocked on uaddr */
+static int futex_waiters_start(struct futex_waiter *w, unsigned int n,
+			       uint32_t *uaddr)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		w[i].uaddr = uaddr;
+		w[i].rc = -1;
+		w[i].done = 0;
+		w[i].thread = uk_sched_thread_create(uk_sched_current(),
+						     futex_waiter_fn, &w[i],
+						     "test-futex-waiter");
+		if (!w[i].thread)
+			return -ENOMEM;
+	}
+
+	/* A waiter is blocked only after it is queued on the futex */
+	for (i = 0; i < n; i++)
+		while (!UK_READ_ONCE(w[i].done) && is_runnable(w[i].thread))
+			uk_sched_yield();
+
+	return 0;
+}
+
+/* Lets woken waiters run and returns how many of them returned so far */
+static unsigned int futex_waiters_done(struct futex_waiter *w, unsigned int n)
+{
+	unsigned int i, done = 0;
+
+	for (i = 0; i < 16; i++)
+		uk_sched_yield();
+	for (i = 0; i < n; i++)
+		if (UK_READ_ONCE(w[i].done))
+			done++;
+
+	return done;
+}
+
+static int futex_errno(int rc)
+{
+	return (rc < 0) ? -errno : rc;
+}
+
+UK_TESTCASE(ukatomic_futex_testsuite, ukatomic_test_futex_wake_zero)
+{
+	struct futex_waiter w1[1], w2[1];
+	uint32_t f1 = 0, f2 = 0;
+	int rc;
+
+	rc = futex_waiters_start(w1, ARRAY_SIZE(w1), &f1);
+	UK_TEST_EXPECT_ZERO(rc);
+	rc = futex_waiters_start(w2, ARRAY_SIZE(w2), &f2);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	/* A count of zero wakes nobody, with either operation */
+	rc = futex(&f1, FUTEX_WAKE_PRIVATE, 0, NULL, NULL, 0);
+	UK_TEST_EXPECT_ZERO(rc);
+	rc = futex(&f1, FUTEX_WAKE_OP_PRIVATE, 0, FUTEX_VAL2(0), &f2,
+		   FUTEX_OP(FUTEX_OP_ADD, 1, FUTEX_OP_CMP_EQ, 0));
+	UK_TEST_EXPECT_ZERO(rc);
+	UK_TEST_EXPECT_SNUM_EQ(f2, 1);
+	UK_TEST_EXPECT_ZERO(futex_waiters_done(w1, ARRAY_SIZE(w1)));
+	UK_TEST_EXPECT_ZERO(futex_waiters_done(w2, ARRAY_SIZE(w2)));
+
+	rc = futex(&f1, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	UK_TEST_EXPECT_SNUM_EQ(rc, 1);
+	rc = futex(&f2, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	UK_TEST_EXPECT_SNUM_EQ(rc, 1);
+	UK_TEST_EXPECT_SNUM_EQ(futex_waiters_done(w1, ARRAY_SIZE(w1)), 1);
+	UK_TEST_EXPECT_SNUM_EQ(futex_waiters_done(w2, ARRAY_SIZE(w2)), 1);
+	UK_TEST_EXPECT_ZERO(w1[0].rc);
+	UK_TEST_EXPECT_ZERO(w2[0].rc);
+}
+
+UK_TESTCASE(ukatomic_futex_testsuite, ukatomic_test_futex_requeue)
+{
+	struct futex_waiter w[TEST_WAITERS];
+	uint32_t f1 = 0, f2 = 0;
+	unsigned int i;
+	int rc;
+
+	rc = futex_waiters_start(w, TEST_WAITERS, &f1);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	/* Requeueing onto the same futex is refused */
+	rc = futex(&f1, FUTEX_REQUEUE_PRIVATE, 1, FUTEX_VAL2(1), &f1, 0);
+	UK_TEST_EXPECT_SNUM_EQ(futex_errno(rc), -EINVAL);
+
+	/* FUTEX_REQUEUE only reports the woken waiter */
+	rc = futex(&f1, FUTEX_REQUEUE_PRIVATE, 1, FUTEX_VAL2(2), &f2, 0);
+	UK_TEST_EXPECT_SNUM_EQ(rc, 1);
+	UK_TEST_EXPECT_SNUM_EQ(futex_waiters_done(w, TEST_WAITERS), 1);
+
+	/* Two waiters moved to f2, one stayed on f1 */
+	rc = futex(&f1, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+	UK_TEST_EXPECT_SNUM_EQ(rc, 1);
+	rc = futex(&f2, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+	UK_TEST_EXPECT_SNUM_EQ(rc, 2);
+	UK_TEST_EXPECT_SNUM_EQ(futex_waiters_done(w, TEST_WAITERS),
+			       TEST_WAITERS);
+
+	for (i = 0; i < TEST_WAITERS; i++)
+		UK_TEST_EXPECT_ZERO(w[i].rc);
+}
+
+UK_TESTCASE(ukatomic_futex_testsuite, ukatomic_test_futex_cmp_requeue)
+{
+	struct futex_waiter w[TEST_WAITERS];
+	uint32_t f1 = 0, f2 = 0;
+	unsigned int i;
+	int rc;
+
+	rc = futex_waiters_start(w, TEST_WAITERS, &f1);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	/* Nothing happens if the futex word changed */
+	rc = futex(&f1, FUTEX_CMP_REQUEUE_PRIVATE, 1, FUTEX_VAL2(2), &f2, 1);
+	UK_TEST_EXPECT_SNUM_EQ(futex_errno(rc), -EAGAIN);
+	UK_TEST_EXPECT_ZERO(futex_waiters_done(w, TEST_WAITERS));
+
+	/* FUTEX_CMP_REQUEUE reports the woken and the requeued waiters */
+	rc = futex(&f1, FUTEX_CMP_REQUEUE_PRIVATE, 1, FUTEX_VAL2(2), &f2, 0);
+	UK_TEST_EXPECT_SNUM_EQ(rc, 3);
+	UK_TEST_EXPECT_SNUM_EQ(futex_waiters_done(w, TEST_WAITERS), 1);
+
+	/* Requeueing without waking anybody */
+	rc = futex(&f2, FUTEX_CMP_REQUEUE_PRIVATE, 0, FUTEX_VAL2(1), &f1, 0);
+	UK_TEST_EXPECT_SNUM_EQ(rc, 1);
+	UK_TEST_EXPECT_SNUM_EQ(futex_waiters_done(w, TEST_WAITERS), 1);
+
+	rc = futex(&f1, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+	UK_TEST_EXPECT_SNUM_EQ(rc, 2);
+	rc = futex(&f2, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+	UK_TEST_EXPECT_SNUM_EQ(rc, 1);
+	UK_TEST_EXPECT_SNUM_EQ(futex_waiters_done(w, TEST_WAITERS),
+			       TEST_WAITERS);
+
+	for (i = 0; i < TEST_WAITERS; i++)
+		UK_TEST_EXPECT_ZERO(w[i].rc);
+}
+
+UK_TESTCASE(ukatomic_futex_testsuite, ukatomic_test_futex_wake_op)
+{
+	struct futex_waiter w1[TEST_WAITERS / 2], w2[TEST_WAITERS / 2];
+	uint32_t f1 = 0, f2 = 0;
+	unsigned int i;
+	int rc;
+
+	rc = futex_waiters_start(w1, ARRAY_SIZE(w1), &f1);
+	UK_TEST_EXPECT_ZERO(rc);
+	rc = futex_waiters_start(w2, ARRAY_SIZE(w2), &f2);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	/* Unknown operations are rejected without side effects */
+	rc = futex(&f1, FUTEX_WAKE_OP_PRIVATE, 1, FUTEX_VAL2(1), &f2,
+		   FUTEX_OP(7, 1, FUTEX_OP_CMP_EQ, 0));
+	UK_TEST_EXPECT_SNUM_EQ(futex_errno(rc), -ENOSYS);
+	UK_TEST_EXPECT_ZERO(f2);
+
+	/* f2 was 0: one waiter of f1 and both of f2 are woken */
+	rc = futex(&f1, FUTEX_WAKE_OP_PRIVATE, 1, FUTEX_VAL2(2), &f2,
+		   FUTEX_OP(FUTEX_OP_ADD, 1, FUTEX_OP_CMP_EQ, 0));
+	UK_TEST_EXPECT_SNUM_EQ(rc, 3);
+	UK_TEST_EXPECT_SNUM_EQ(f2, 1);
+	UK_TEST_EXPECT_SNUM_EQ(futex_waiters_done(w1, ARRAY_SIZE(w1)), 1);
+	UK_TEST_EXPECT_SNUM_EQ(futex_waiters_done(w2, ARRAY_SIZE(w2)),
+			       ARRAY_SIZE(w2));
+
+	/* The comparison fails: only the waiter of f1 is woken */
+	rc = futex(&f1, FUTEX_WAKE_OP_PRIVATE, 1, FUTEX_VAL2(2), &f2,
+		   FUTEX_OP(FUTEX_OP_OR | FUTEX_OP_OPARG_SHIFT, 4,
+			    FUTEX_OP_CMP_EQ, 0));
+	UK_TEST_EXPECT_SNUM_EQ(rc, 1);
+	UK_TEST_EXPECT_SNUM_EQ(f2, 0x11);
+	UK_TEST_EXPECT_SNUM_EQ(futex_waiters_done(w1, ARRAY_SIZE(w1)),
+			       ARRAY_SIZE(w1));
+
+	for (i = 0; i < ARRAY_SIZE(w1); i++) {
+		UK_TEST_EXPECT_ZERO(w1[i].rc);
+		UK_TEST_EXPECT_ZERO(w2[i].rc);
+	}
+}
+
+uk_testsuite_register(ukatomic_futex_testsuite, NULL);
@@ -43,6 +43,9 @@
 #include <uk/ctors.h>
 #include <uk/arch/atomic.h>
 #include <uk/blkdev.h>
+#if CONFIG_LIBUKBLKDEV_REQUEST_QUEUE
+#include "blkrq.h"
+#endif
 
 struct uk_blkdev_list uk_blkdev_list =
 UK_TAILQ_HEAD_INITIALIZER(uk_blkdev_list);
@@ -219,6 +222,17 @@ static void _dispatcher(void *args)
 				handler->queue_id, handler->cookie);
 	}
 }
+#elif CONFIG_LIBUKBLKDEV_DISPATCH_WORK
+static void _dispatch_work(struct uk_work *work __unused, void *args)
+{
+	struct uk_blkdev_event_handler *handler =
+		(struct uk_blkdev_event_handler *) args;
+
+	UK_ASSERT(handler);
+	UK_ASSERT(handler->callback);
+
+	handler->callback(handler->dev, handler->queue_id, handler->cookie);
+}
 #endif
 
 static int _create_event_handler(uk_blkdev_queue_event_t callback,
@@ -226,6 +240,8 @@ static int _create_event_handler(uk_blkdev_queue_event_t callback,
 #if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
 		struct uk_blkdev *dev, uint16_t queue_id,
 		struct uk_sched *s,
+#elif CONFIG_LIBUKBLKDEV_DISPATCH_WORK
+		struct uk_blkdev *dev, uint16_t queue_id,
 #endif
 		struct uk_blkdev_event_handler *event_handler)
 {
@@ -267,6 +283,10 @@ static int _create_event_handler(uk_blkdev_queue_event_t callback,
 
 		return -ENOMEM;
 	}
+#elif CONFIG_LIBUKBLKDEV_DISPATCH_WORK
+	event_handler->dev = dev;
+	event_handler->queue_id = queue_id;
+	uk_work_init(&event_handler->work, _dispatch_work, event_handler);
 #endif
 
 	return 0;
@@ -289,6 +309,8 @@ static void _destroy_event_handler(struct uk_blkdev_event_handler *h
 		free(h->dispatcher_name);
 		h->dispatcher_name = NULL;
 	}
+#elif CONFIG_LIBUKBLKDEV_DISPATCH_WORK
+	uk_work_cancel_sync(&h->work);
 #endif
 }
 
@@ -334,6 +356,8 @@ int uk_blkdev_queue_configure(struct uk_blkdev *dev, uint16_t queue_id,
 			queue_conf->callback_cookie,
 #if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
 			dev, queue_id, queue_conf->s,
+#elif CONFIG_LIBUKBLKDEV_DISPATCH_WORK
+			dev, queue_id,
 #endif
 			&dev->_data->queue_handler[queue_id]);
 	if (err)
@@ -349,10 +373,24 @@ int uk_blkdev_queue_configure(struct uk_blkdev *dev, uint16_t queue_id,
 		goto err_destroy_handler;
 	}
 
+#if CONFIG_LIBUKBLKDEV_REQUEST_QUEUE
+	err = uk_blkdev_rq_init(dev, queue_id);
+	if (err) {
+		uk_pr_err("blkdev%"PRIu16"-q%"PRIu16": Failed to allocate request queue: %d\n",
+				dev->_data->id, queue_id, err);
+		goto err_unconfigure_queue;
+	}
+#endif
+
 	uk_pr_info("blkdev%"PRIu16": Configured queue %"PRIu16"\n",
 			dev->_data->id, queue_id);
 	return 0;
 
+#if CONFIG_LIBUKBLKDEV_REQUEST_QUEUE
+err_unconfigure_queue:
+	dev->dev_ops->queue_unconfigure(dev, dev->_queue[queue_id]);
+	dev->_queue[queue_id] = NULL;
+#endif
 err_destroy_handler:
 	_destroy_event_handler(&dev->_data->queue_handler[queue_id]);
 err_out:
@@ -400,6 +438,10 @@ int uk_blkdev_queue_submit_one(struct uk_blkdev *dev,
 int uk_blkdev_queue_finish_reqs(struct uk_blkdev *dev,
 		uint16_t queue_id)
 {
+#if CONFIG_LIBUKBLKDEV_REQUEST_QUEUE
+	int rc;
+
+#endif
 	UK_ASSERT(dev);
 	UK_ASSERT(dev->finish_reqs);
 	UK_ASSERT(dev->_data);
@@ -407,7 +449,14 @@ int uk_blkdev_queue_finish_reqs(struct uk_blkdev *dev,
 	UK_ASSERT(dev->_data->state == UK_BLKDEV_RUNNING);
 	UK_ASSERT(!PTRISERR(dev->_queue[queue_id]));
 
+#if CONFIG_LIBUKBLKDEV_REQUEST_QUEUE
+	rc = dev->finish_reqs(dev, dev->_queue[queue_id]);
+	/* Completions made room in the driver queue */
+	uk_blkdev_rq_kick(dev, queue_id);
+	return rc;
+#else
 	return dev->finish_reqs(dev, dev->_queue[queue_id]);
+#endif
 }
 
 #if CONFIG_LIBUKBLKDEV_SYNC_IO_BLOCKED_WAITING
@@ -456,8 +505,13 @@ int uk_blkdev_sync_io(struct uk_blkdev *dev,
 			__sync_io_callback, (void *)&sync_io_req);
 	uk_semaphore_init(&sync_io_req.s, 0);
 
+#if CONFIG_LIBUKBLKDEV_REQUEST_QUEUE
+	rc = uk_blkdev_queue_submit(dev, queue_id, req);
+	if (unlikely(rc < 0)) {
+#else
 	rc = uk_blkdev_queue_submit_one(dev, queue_id, req);
 	if (unlikely(!uk_blkdev_status_successful(rc))) {
+#endif
 		uk_pr_err("blkdev%"PRIu16"-q%"PRIu16": Failed to submit I/O req: %d\n",
 				dev->_data->id, queue_id, rc);
 		return rc;
@@ -510,7 +564,10 @@ int uk_blkdev_queue_unconfigure(struct uk_blkdev *dev, uint16_t queue_id)
 		uk_pr_err("Failed to unconfigure blkdev%"PRIu16"-q%"PRIu16": %d\n",
 				dev->_data->id, queue_id, rc);
 	else {
-#if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
+#if CONFIG_LIBUKBLKDEV_REQUEST_QUEUE
+		uk_blkdev_rq_fini(dev, queue_id);
+#endif
+#if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS || CONFIG_LIBUKBLKDEV_DISPATCH_WORK
 		if (dev->_data->queue_handler[queue_id].callback)
 			_destroy_event_handler(
 					&dev->_data->queue_handler[queue_id]);
@@ -0,0 +1,437 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <uk/alloc.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/arch/limits.h>
+#include <uk/plat/spinlock.h>
+#include <uk/plat/time.h>
+#include <uk/blkdev.h>
+#include <uk/blkdev_driver.h>
+#include "blkrq.h"
+
+#define RQ_MERGE_BUF_SIZE	(CONFIG_LIBUKBLKDEV_RQ_MERGE_MAX * 1024UL)
+
+static inline struct uk_blkdev_rq *_rq_get(struct uk_blkdev *dev,
+		uint16_t queue_id)
+{
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->_data);
+	UK_ASSERT(queue_id < CONFIG_LIBUKBLKDEV_MAXNBQUEUES);
+
+	return &dev->_data->rq[queue_id];
+}
+
+static inline size_t _rq_len(struct uk_blkdev_rq *rq, struct uk_blkreq *req)
+{
+	return (size_t) req->nb_sectors * uk_blkdev_ssize(rq->dev);
+}
+
+static void _rq_complete(struct uk_blkreq *req, int result)
+{
+	req->result = result;
+	uk_blkreq_finished(req);
+	if (req->cb)
+		req->cb(req, req->cb_cookie);
+}
+
+int uk_blkdev_rq_init(struct uk_blkdev *dev, uint16_t queue_id)
+{
+	struct uk_blkdev_rq *rq = _rq_get(dev, queue_id);
+	struct uk_alloc *a = dev->_data->a;
+	struct uk_blkdev_rq_merge *m;
+	size_t align;
+	int i;
+
+	memset(rq, 0, sizeof(*rq));
+	ukarch_spin_init(&rq->lock);
+	UK_TAILQ_INIT(&rq->pending);
+	rq->dev = dev;
+	rq->queue_id = queue_id;
+
+	rq->max_sectors = RQ_MERGE_BUF_SIZE / uk_blkdev_ssize(dev);
+	if (uk_blkdev_max_sec_per_req(dev))
+		rq->max_sectors = MIN(rq->max_sectors,
+				      uk_blkdev_max_sec_per_req(dev));
+
+	/* Merging does not make sense if a request is limited to one sector */
+	if (rq->max_sectors < 2 || CONFIG_LIBUKBLKDEV_RQ_MERGE_BUFS <= 0)
+		return 0;
+
+	rq->merges = uk_calloc(a, CONFIG_LIBUKBLKDEV_RQ_MERGE_BUFS,
+			       sizeof(*rq->merges));
+	if (unlikely(!rq->merges))
+		return -ENOMEM;
+
+	align = MAX((size_t) uk_blkdev_ioalign(dev), (size_t) __PAGE_SIZE);
+	for (i = 0; i < CONFIG_LIBUKBLKDEV_RQ_MERGE_BUFS; i++) {
+		m = &rq->merges[i];
+		m->buf = uk_memalign(a, align,
+				     rq->max_sectors * uk_blkdev_ssize(dev));
+		if (unlikely(!m->buf))
+			goto err_free;
+		UK_TAILQ_INIT(&m->reqs);
+		m->rq = rq;
+		m->next_free = rq->free_merges;
+		rq->free_merges = m;
+	}
+	return 0;
+
+err_free:
+	uk_blkdev_rq_fini(dev, queue_id);
+	return -ENOMEM;
+}
+
+void uk_blkdev_rq_fini(struct uk_blkdev *dev, uint16_t queue_id)
+{
+	struct uk_blkdev_rq *rq = _rq_get(dev, queue_id);
+	struct uk_alloc *a = dev->_data->a;
+	int i;
+
+	UK_ASSERT(UK_TAILQ_EMPTY(&rq->pending));
+
+	if (rq->merges) {
+		for (i = 0; i < CONFIG_LIBUKBLKDEV_RQ_MERGE_BUFS; i++) {
+			UK_ASSERT(UK_TAILQ_EMPTY(&rq->merges[i].reqs));
+			if (rq->merges[i].buf)
+				uk_free(a, rq->merges[i].buf);
+		}
+		uk_free(a, rq->merges);
+	}
+	rq->merges = NULL;
+	rq->free_merges = NULL;
+}
+
+/* Completion of a merged request, completes each of the merged requests */
+static void _rq_merge_cb(struct uk_blkreq *mreq, void *cookie)
+{
+	struct uk_blkdev_rq_merge *m = (struct uk_blkdev_rq_merge *) cookie;
+	struct uk_blkdev_rq *rq = m->rq;
+	struct uk_blkreq *req, *next;
+	char *buf = m->buf;
+	unsigned long irqf;
+
+	UK_TAILQ_FOREACH_SAFE(req, &m->reqs, _rq_link, next) {
+		if (m->bounce && req->operation == UK_BLKREQ_READ
+		    && mreq->result >= 0)
+			memcpy(req->aio_buf, buf, _rq_len(rq, req));
+		buf += _rq_len(rq, req);
+
+		/* The callback may reuse the request */
+		UK_TAILQ_REMOVE(&m->reqs, req, _rq_link);
+		_rq_complete(req, mreq->result);
+	}
+
+	ukplat_spin_lock_irqsave(&rq->lock, irqf);
+	m->next_free = rq->free_merges;
+	rq->free_merges = m;
+	ukplat_spin_unlock_irqrestore(&rq->lock, irqf);
+}
+
+#if CONFIG_LIBUKBLKDEV_RQ_DEADLINE
+static inline __nsec _rq_expire(struct uk_blkreq *req)
+{
+	if (req->operation == UK_BLKREQ_READ)
+		return ukarch_time_msec_to_nsec(
+				CONFIG_LIBUKBLKDEV_RQ_READ_EXPIRE);
+	return ukarch_time_msec_to_nsec(CONFIG_LIBUKBLKDEV_RQ_WRITE_EXPIRE);
+}
+#endif
+
+/*
+ * Without deadline ordering the pending list is kept in submission order.
+ * With deadline ordering it is sorted by start sector between flush
+ * requests, which act as barriers and stay in place.
+ */
+static void _rq_insert(struct uk_blkdev_rq *rq, struct uk_blkreq *req)
+{
+#if CONFIG_LIBUKBLKDEV_RQ_DEADLINE
+	struct uk_blkreq *prev;
+
+	req->_rq_deadline = ukplat_monotonic_clock() + _rq_expire(req);
+	if (req->operation != UK_BLKREQ_FFLUSH) {
+		UK_TAILQ_FOREACH_REVERSE(prev, &rq->pending,
+					 uk_blkdev_rq_list, _rq_link) {
+			if (prev->operation == UK_BLKREQ_FFLUSH
+			    || prev->start_sector <= req->start_sector)
+				break;
+		}
+		if (prev)
+			UK_TAILQ_INSERT_AFTER(&rq->pending, prev, req,
+					      _rq_link);
+		else
+			UK_TAILQ_INSERT_HEAD(&rq->pending, req, _rq_link);
+		rq->nb_pending++;
+		return;
+	}
+#endif
+	UK_TAILQ_INSERT_TAIL(&rq->pending, req, _rq_link);
+	rq->nb_pending++;
+}
+
+/*
+ * Selects the request to dispatch next. With deadline ordering this is the
+ * oldest expired request or else the next one in an ascending sweep over
+ * the sectors, considering only the requests in front of the first flush.
+ */
+static struct uk_blkreq *_rq_next(struct uk_blkdev_rq *rq)
+{
+#if CONFIG_LIBUKBLKDEV_RQ_DEADLINE
+	struct uk_blkreq *req, *expired = NULL, *sweep = NULL;
+	__nsec now = ukplat_monotonic_clock();
+
+	UK_TAILQ_FOREACH(req, &rq->pending, _rq_link) {
+		if (req->operation == UK_BLKREQ_FFLUSH)
+			break;
+		if (req->_rq_deadline <= now && (!expired
+		    || req->_rq_deadline < expired->_rq_deadline))
+			expired = req;
+		if (!sweep && req->start_sector >= rq->next_sector)
+			sweep = req;
+	}
+	if (expired)
+		return expired;
+	if (sweep)
+		return sweep;
+#endif
+	return UK_TAILQ_FIRST(&rq->pending);
+}
+
+static inline void _rq_remove(struct uk_blkdev_rq *rq, struct uk_blkreq *req)
+{
+	UK_TAILQ_REMOVE(&rq->pending, req, _rq_link);
+	rq->nb_pending--;
+}
+
+/*
+ * Hands the next request to the driver, merged with the requests that
+ * follow it when they continue it on the device. Requests the driver
+ * rejects are moved to `failed` with their result set, so that they are
+ * completed after the queue lock is dropped.
+ * Returns the status of the driver submission.
+ */
+static int _rq_dispatch_one(struct uk_blkdev_rq *rq,
+			    struct uk_blkdev_rq_list *failed)
+{
+	struct uk_blkdev *dev = rq->dev;
+	struct uk_blkdev_queue *queue = dev->_queue[rq->queue_id];
+	struct uk_blkdev_rq_merge *m;
+	struct uk_blkreq *first, *last, *req, *next;
+	__sector nb_sectors;
+	bool contiguous = true;
+	unsigned int count = 1;
+	char *buf;
+	int rc;
+
+	first = last = _rq_next(rq);
+	nb_sectors = first->nb_sectors;
+	if (first->operation != UK_BLKREQ_FFLUSH && rq->free_merges) {
+		for (req = UK_TAILQ_NEXT(first, _rq_link); req;
+		     req = UK_TAILQ_NEXT(req, _rq_link)) {
+			if (req->operation != first->operation
+			    || req->start_sector != last->start_sector
+						    + last->nb_sectors
+			    || nb_sectors + req->nb_sectors > rq->max_sectors)
+				break;
+			if ((char *) req->aio_buf
+			    != (char *) last->aio_buf + _rq_len(rq, last))
+				contiguous = false;
+			nb_sectors += req->nb_sectors;
+			last = req;
+			count++;
+		}
+	}
+
+	if (count == 1) {
+		rc = dev->submit_one(dev, queue, first);
+		if (uk_blkdev_status_notready(rc))
+			return rc;
+
+		_rq_remove(rq, first);
+		if (unlikely(rc < 0)) {
+			first->result = rc;
+			UK_TAILQ_INSERT_TAIL(failed, first, _rq_link);
+		} else
+			rq->next_sector = first->start_sector
+					  + first->nb_sectors;
+		return rc;
+	}
+
+	m = rq->free_merges;
+	m->bounce = !contiguous;
+	if (m->bounce && first->operation == UK_BLKREQ_WRITE) {
+		buf = m->buf;
+		for (req = first; req != UK_TAILQ_NEXT(last, _rq_link);
+		     req = UK_TAILQ_NEXT(req, _rq_link)) {
+			memcpy(buf, req->aio_buf, _rq_len(rq, req));
+			buf += _rq_len(rq, req);
+		}
+	}
+	uk_blkreq_init(&m->req, first->operation, first->start_sector,
+		       nb_sectors, m->bounce ? m->buf : first->aio_buf,
+		       _rq_merge_cb, m);
+
+	rc = dev->submit_one(dev, queue, &m->req);
+	if (uk_blkdev_status_notready(rc))
+		return rc;
+
+	if (likely(rc >= 0)) {
+		rq->free_merges = m->next_free;
+		rq->next_sector = last->start_sector + last->nb_sectors;
+	}
+	next = UK_TAILQ_NEXT(last, _rq_link);
+	for (req = first; req != next; req = first) {
+		first = UK_TAILQ_NEXT(req, _rq_link);
+		_rq_remove(rq, req);
+		if (likely(rc >= 0)) {
+			UK_TAILQ_INSERT_TAIL(&m->reqs, req, _rq_link);
+		} else {
+			req->result = rc;
+			UK_TAILQ_INSERT_TAIL(failed, req, _rq_link);
+		}
+	}
+	return rc;
+}
+
+static void _rq_dispatch(struct uk_blkdev_rq *rq, bool force)
+{
+	struct uk_blkdev_rq_list failed = UK_TAILQ_HEAD_INITIALIZER(failed);
+	struct uk_blkreq *req, *next;
+	unsigned long irqf;
+	int rc;
+
+	ukplat_spin_lock_irqsave(&rq->lock, irqf);
+	if (rq->dispatching || (rq->plugged && !force))
+		goto out;
+
+	rq->dispatching = true;
+	while (!UK_TAILQ_EMPTY(&rq->pending)) {
+		rc = _rq_dispatch_one(rq, &failed);
+		/* The driver queue is full, retried after completions */
+		if (uk_blkdev_status_notready(rc))
+			break;
+		if (unlikely(rc < 0))
+			uk_pr_debug("blkdev%"PRIu16"-q%"PRIu16": Failed to submit request: %d\n",
+				    rq->dev->_data->id, rq->queue_id, rc);
+	}
+	rq->dispatching = false;
+
+out:
+	ukplat_spin_unlock_irqrestore(&rq->lock, irqf);
+
+	/* The callbacks may submit new requests to this queue */
+	UK_TAILQ_FOREACH_SAFE(req, &failed, _rq_link, next)
+		_rq_complete(req, req->result);
+}
+
+void uk_blkdev_rq_kick(struct uk_blkdev *dev, uint16_t queue_id)
+{
+	_rq_dispatch(_rq_get(dev, queue_id), false);
+}
+
+int uk_blkdev_queue_submit(struct uk_blkdev *dev, uint16_t queue_id,
+		struct uk_blkreq *req)
+{
+	struct uk_blkdev_rq *rq;
+	unsigned long irqf;
+	bool full;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->_data);
+	UK_ASSERT(dev->submit_one);
+	UK_ASSERT(queue_id < CONFIG_LIBUKBLKDEV_MAXNBQUEUES);
+	UK_ASSERT(dev->_data->state == UK_BLKDEV_RUNNING);
+	UK_ASSERT(!PTRISERR(dev->_queue[queue_id]));
+	UK_ASSERT(req != NULL);
+
+	if (unlikely(req->operation != UK_BLKREQ_READ
+		     && req->operation != UK_BLKREQ_WRITE
+		     && req->operation != UK_BLKREQ_FFLUSH))
+		return -EINVAL;
+
+	rq = _rq_get(dev, queue_id);
+	ukplat_spin_lock_irqsave(&rq->lock, irqf);
+	_rq_insert(rq, req);
+	full = (rq->nb_pending >= CONFIG_LIBUKBLKDEV_RQ_DEPTH);
+	ukplat_spin_unlock_irqrestore(&rq->lock, irqf);
+
+	_rq_dispatch(rq, full);
+	return 0;
+}
+
+int uk_blkdev_queue_submit_batch(struct uk_blkdev *dev, uint16_t queue_id,
+		struct uk_blkreq *reqs[], unsigned int count)
+{
+	unsigned int i;
+	int rc = 0;
+
+	UK_ASSERT(reqs || !count);
+
+	uk_blkdev_queue_plug(dev, queue_id);
+	for (i = 0; i < count; i++) {
+		rc = uk_blkdev_queue_submit(dev, queue_id, reqs[i]);
+		if (unlikely(rc < 0))
+			break;
+	}
+	uk_blkdev_queue_unplug(dev, queue_id);
+
+	return (i > 0) ? (int) i : rc;
+}
+
+void uk_blkdev_queue_plug(struct uk_blkdev *dev, uint16_t queue_id)
+{
+	struct uk_blkdev_rq *rq = _rq_get(dev, queue_id);
+	unsigned long irqf;
+
+	ukplat_spin_lock_irqsave(&rq->lock, irqf);
+	rq->plugged++;
+	ukplat_spin_unlock_irqrestore(&rq->lock, irqf);
+}
+
+void uk_blkdev_queue_unplug(struct uk_blkdev *dev, uint16_t queue_id)
+{
+	struct uk_blkdev_rq *rq = _rq_get(dev, queue_id);
+	unsigned long irqf;
+	bool dispatch;
+
+	ukplat_spin_lock_irqsave(&rq->lock, irqf);
+	UK_ASSERT(rq->plugged > 0);
+	dispatch = (--rq->plugged == 0);
+	ukplat_spin_unlock_irqrestore(&rq->lock, irqf);
+
+	if (dispatch)
+		_rq_dispatch(rq, false);
+}
@@ -424,6 +424,73 @@ int uk_blkdev_queue_submit_one(struct uk_blkdev *dev, uint16_t queue_id,
  */
 int uk_blkdev_queue_finish_reqs(struct uk_blkdev *dev, uint16_t queue_id);
 
+#if CONFIG_LIBUKBLKDEV_REQUEST_QUEUE
+/**
+ * Queue a request on the request queue of a device queue.
+ * The request is handed to the driver when the request queue is not plugged
+ * and the driver queue has free descriptors, possibly merged with other
+ * pending requests that continue it on the device. Pending requests are
+ * handed to the driver again whenever `uk_blkdev_queue_finish_reqs()`
+ * completed requests. There is no ordering between overlapping requests;
+ * a flush request is only dispatched after all requests queued before it.
+ *
+ * @param dev
+ *	The Unikraft Block Device
+ * @param queue_id
+ *	queue id
+ * @param req
+ *	Request structure, which must not be modified until it completed
+ * @return
+ *	- 0: The request was queued
+ *	- (-EINVAL): Unsupported operation
+ */
+int uk_blkdev_queue_submit(struct uk_blkdev *dev, uint16_t queue_id,
+		struct uk_blkreq *req);
+
+/**
+ * Queue several requests on the request queue of a device queue at once.
+ * The request queue is plugged while the requests are queued so that they
+ * are merged and handed to the driver together.
+ *
+ * @param dev
+ *	The Unikraft Block Device
+ * @param queue_id
+ *	queue id
+ * @param reqs
+ *	Array of requests
+ * @param count
+ *	Number of requests in `reqs`
+ * @return
+ *	- (>=0): Number of queued requests
+ *	- (<0): Error code of the first request
+ */
+int uk_blkdev_queue_submit_batch(struct uk_blkdev *dev, uint16_t queue_id,
+		struct uk_blkreq *reqs[], unsigned int count);
+
+/**
+ * Plug the request queue of a device queue: requests are collected without
+ * being handed to the driver until the queue is unplugged or
+ * CONFIG_LIBUKBLKDEV_RQ_DEPTH requests are pending. Plugs nest.
+ *
+ * @param dev
+ *	The Unikraft Block Device
+ * @param queue_id
+ *	queue id
+ */
+void uk_blkdev_queue_plug(struct uk_blkdev *dev, uint16_t queue_id);
+
+/**
+ * Release a plug taken with `uk_blkdev_queue_plug()`. The pending requests
+ * are handed to the driver when the last plug is released.
+ *
+ * @param dev
+ *	The Unikraft Block Device
+ * @param queue_id
+ *	queue id
+ */
+void uk_blkdev_queue_unplug(struct uk_blkdev *dev, uint16_t queue_id);
+#endif /* CONFIG_LIBUKBLKDEV_REQUEST_QUEUE */
+
 #if CONFIG_LIBUKBLKDEV_SYNC_IO_BLOCKED_WAITING
 /**
  * Make a sync io request on a specific queue.
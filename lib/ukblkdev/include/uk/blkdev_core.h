@@ -34,6 +34,7 @@
 #ifndef __UK_BLKDEV_CORE__
 #define __UK_BLKDEV_CORE__
 
+#include <stdbool.h>
 #include <uk/list.h>
 #include <uk/config.h>
 #include <uk/blkreq.h>
@@ -43,6 +44,12 @@
 #include <uk/sched.h>
 #include <uk/semaphore.h>
 #endif
+#if CONFIG_LIBUKBLKDEV_DISPATCH_WORK
+#include <uk/work.h>
+#endif
+#if CONFIG_LIBUKBLKDEV_REQUEST_QUEUE
+#include <uk/arch/spinlock.h>
+#endif
 
 /**
  * Unikraft block API common declarations.
@@ -263,9 +270,62 @@ struct uk_blkdev_event_handler {
 	char	*dispatcher_name;
 	/* Scheduler for dispatcher. */
 	struct uk_sched     *dispatcher_s;
+#elif CONFIG_LIBUKBLKDEV_DISPATCH_WORK
+	/* Deferred callback. */
+	struct uk_work      work;
+	/* Reference to blk device. */
+	struct uk_blkdev    *dev;
+	/* Queue id which caused event. */
+	uint16_t            queue_id;
 #endif
 };
 
+#if CONFIG_LIBUKBLKDEV_REQUEST_QUEUE
+struct uk_blkdev_rq;
+
+UK_TAILQ_HEAD(uk_blkdev_rq_list, struct uk_blkreq);
+
+/**
+ * @internal
+ * A request built from several contiguous requests of the request queue.
+ */
+struct uk_blkdev_rq_merge {
+	/* Request handed to the driver. */
+	struct uk_blkreq req;
+	/* The merged requests, in sector order. */
+	struct uk_blkdev_rq_list reqs;
+	/* Bounce buffer, used if the request buffers are not contiguous. */
+	void *buf;
+	bool bounce;
+	struct uk_blkdev_rq *rq;
+	struct uk_blkdev_rq_merge *next_free;
+};
+
+/**
+ * @internal
+ * Software request queue placed in front of a device queue.
+ */
+struct uk_blkdev_rq {
+	/* Protects the fields below and the free merge list. */
+	__spinlock lock;
+	/* Requests waiting to be handed to the driver. */
+	struct uk_blkdev_rq_list pending;
+	unsigned int nb_pending;
+	/* Plug nesting depth, nothing is dispatched while non-zero. */
+	unsigned int plugged;
+	/* Set while the queue is being dispatched. */
+	bool dispatching;
+	/* Sector following the last dispatched request. */
+	__sector next_sector;
+	/* Upper limit of merged request size, in sectors. */
+	__sector max_sectors;
+	struct uk_blkdev_rq_merge *merges;
+	struct uk_blkdev_rq_merge *free_merges;
+	struct uk_blkdev *dev;
+	uint16_t queue_id;
+};
+#endif
+
 /**
  * @internal
  * libukblkdev internal data associated with each block device.
@@ -282,6 +342,10 @@ struct uk_blkdev_data {
 	const char *drv_name;
 	/* Allocator */
 	struct uk_alloc *a;
+#if CONFIG_LIBUKBLKDEV_REQUEST_QUEUE
+	/* Request queue for each queue */
+	struct uk_blkdev_rq rq[CONFIG_LIBUKBLKDEV_MAXNBQUEUES];
+#endif
 };
 
 struct uk_blkdev {
@@ -89,6 +89,9 @@ static inline void uk_blkdev_drv_queue_event(struct uk_blkdev *dev,
 
 #if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
 	uk_semaphore_up(&queue_handler->events);
+#elif CONFIG_LIBUKBLKDEV_DISPATCH_WORK
+	if (queue_handler->callback)
+		uk_work_schedule(&queue_handler->work);
 #else
 	if (queue_handler->callback)
 		queue_handler->callback(dev, queue_id, queue_handler->cookie);
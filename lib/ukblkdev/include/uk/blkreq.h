@@ -34,6 +34,9 @@
 #define UK_BLKREQ_H_
 
 #include <uk/arch/types.h>
+#include <uk/arch/time.h>
+#include <uk/config.h>
+#include <uk/list.h>
 
 /**
  * Unikraft block API request declaration.
@@ -105,6 +108,12 @@ struct uk_blkreq {
 	/* Result status of operation (< 0 on errors)*/
 	int					result;
 
+#if CONFIG_LIBUKBLKDEV_REQUEST_QUEUE
+	/* @internal Link in the request queue or a merged request */
+	UK_TAILQ_ENTRY(struct uk_blkreq)	_rq_link;
+	/* @internal Time by which the request should be dispatched */
+	__nsec					_rq_deadline;
+#endif
 };
 
 /**
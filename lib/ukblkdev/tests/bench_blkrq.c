@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdbool.h>
+#include <uk/alloc.h>
+#include <uk/essentials.h>
+#include <uk/arch/time.h>
+#include <uk/plat/time.h>
+#include <uk/blkdev.h>
+#include <uk/test.h>
+
+#include "ramdisk.h"
+
+/*
+ * An fio-like benchmark: each job issues BENCH_NR_IOS requests of BENCH_BS
+ * bytes with BENCH_DEPTH requests in flight, either directly to the driver
+ * or through the request queue in batches.
+ */
+#define BENCH_BS		4096
+#define BENCH_BS_SECTORS	(BENCH_BS / RAMDISK_SSIZE)
+#define BENCH_DEPTH		RAMDISK_DEPTH
+#define BENCH_NR_IOS		16384
+
+struct blkrq_bench_job {
+	const char *name;
+	bool random;
+	/* Share of reads, in percent */
+	unsigned int read_pct;
+};
+
+static const struct blkrq_bench_job blkrq_bench_jobs[] = {
+	{ "seqread",   false, 100 },
+	{ "seqwrite",  false,   0 },
+	{ "seqrw",     false,  50 },
+	{ "randread",  true,  100 },
+	{ "randwrite", true,    0 },
+	{ "randrw",    true,   70 },
+};
+
+static inline unsigned int bench_rand(unsigned int *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return *seed;
+}
+
+static __nsec blkrq_bench_run(const struct blkrq_bench_job *job,
+			      bool use_rq, char *buf)
+{
+	struct uk_blkreq reqs[BENCH_DEPTH], *preqs[BENCH_DEPTH];
+	unsigned int seed = 0x2545f491;
+	__sector sector = 0;
+	unsigned int i, n;
+	__nsec start;
+
+	start = ukplat_monotonic_clock();
+	for (n = 0; n < BENCH_NR_IOS; n += BENCH_DEPTH) {
+		for (i = 0; i < BENCH_DEPTH; i++) {
+			if (job->random)
+				sector = (bench_rand(&seed)
+					  % (RAMDISK_SECTORS / BENCH_BS_SECTORS))
+					 * BENCH_BS_SECTORS;
+			uk_blkreq_init(&reqs[i],
+				       (bench_rand(&seed) % 100 < job->read_pct)
+				       ? UK_BLKREQ_READ : UK_BLKREQ_WRITE,
+				       sector, BENCH_BS_SECTORS,
+				       buf + i * BENCH_BS, NULL, NULL);
+			preqs[i] = &reqs[i];
+			if (!job->random)
+				sector = (sector + BENCH_BS_SECTORS)
+					 % RAMDISK_SECTORS;
+		}
+
+		if (use_rq)
+			uk_blkdev_queue_submit_batch(&rd.blkdev, 0, preqs,
+						     BENCH_DEPTH);
+		else
+			for (i = 0; i < BENCH_DEPTH; i++)
+				uk_blkdev_queue_submit_one(&rd.blkdev, 0,
+							   &reqs[i]);
+
+		for (i = 0; i < BENCH_DEPTH; i++)
+			ramdisk_wait(&reqs[i]);
+	}
+	return ukplat_monotonic_clock() - start;
+}
+
+UK_TESTCASE(ukblkdev_blkrq_benchsuite, ukblkdev_bench_blkrq)
+{
+	const struct blkrq_bench_job *job;
+	unsigned int i, j, nb_submitted;
+	char *buf;
+	__nsec t;
+
+	UK_TEST_EXPECT_ZERO(ramdisk_setup(0));
+	buf = uk_memalign(uk_alloc_get_default(), RAMDISK_SSIZE,
+			  BENCH_DEPTH * BENCH_BS);
+	UK_TEST_EXPECT_NOT_NULL(buf);
+
+	for (i = 0; i < ARRAY_SIZE(blkrq_bench_jobs); i++) {
+		job = &blkrq_bench_jobs[i];
+		for (j = 0; j < 2; j++) {
+			nb_submitted = rd.nb_submitted;
+			t = blkrq_bench_run(job, j, buf);
+			nb_submitted = rd.nb_submitted - nb_submitted;
+			uk_test_printf("%-9s bs=%u iodepth=%u %-6s: %"__PRInsec" ns, %llu IOPS, %u driver requests\n",
+				       job->name, BENCH_BS, BENCH_DEPTH,
+				       j ? "rq" : "direct", t,
+				       (unsigned long long) (BENCH_NR_IOS
+				       * UKARCH_NSEC_PER_SEC / MAX(t, 1ULL)),
+				       nb_submitted);
+			UK_TEST_EXPECT_SNUM_LE(nb_submitted, BENCH_NR_IOS);
+		}
+	}
+
+	uk_free(uk_alloc_get_default(), buf);
+	ramdisk_teardown();
+}
+
+uk_testsuite_register(ukblkdev_blkrq_benchsuite, NULL);
@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __UKBLKDEV_TESTS_RAMDISK_H__
+#define __UKBLKDEV_TESTS_RAMDISK_H__
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <uk/alloc.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/blkdev.h>
+#include <uk/blkdev_driver.h>
+
+/*
+ * The request queue is tested in front of a RAM disk driver that completes
+ * requests when its queue is polled and records what it was handed.
+ */
+#define RAMDISK_SSIZE		512
+#define RAMDISK_SECTORS		4096
+#define RAMDISK_DEPTH		8
+
+struct uk_blkdev_queue {
+	/* Requests handed to the driver and not yet completed */
+	struct uk_blkreq *reqs[RAMDISK_DEPTH];
+	unsigned int nb_reqs;
+};
+
+struct ramdisk {
+	struct uk_blkdev blkdev;
+	struct uk_blkdev_queue queue;
+	char *data;
+	/* Number of requests handed to the driver */
+	unsigned int nb_submitted;
+	/* Number of requests refused because the queue was full */
+	unsigned int nb_busy;
+	/* Largest request handed to the driver, in sectors */
+	__sector max_sectors;
+	/* Start sectors of the first requests, in submission order */
+	__sector order[16];
+};
+
+static struct ramdisk rd;
+
+static void ramdisk_get_info(struct uk_blkdev *dev __unused,
+			     struct uk_blkdev_info *dev_info)
+{
+	dev_info->max_queues = 1;
+}
+
+static int ramdisk_configure(struct uk_blkdev *dev __unused,
+			     const struct uk_blkdev_conf *conf __unused)
+{
+	return 0;
+}
+
+static int ramdisk_queue_get_info(struct uk_blkdev *dev __unused,
+				  uint16_t queue_id __unused,
+				  struct uk_blkdev_queue_info *q_info)
+{
+	q_info->nb_min = 1;
+	q_info->nb_max = RAMDISK_DEPTH;
+	return 0;
+}
+
+static struct uk_blkdev_queue *ramdisk_queue_configure(
+		struct uk_blkdev *dev, uint16_t queue_id __unused,
+		uint16_t nb_desc __unused,
+		const struct uk_blkdev_queue_conf *queue_conf __unused)
+{
+	struct ramdisk *d = __containerof(dev, struct ramdisk, blkdev);
+
+	d->queue.nb_reqs = 0;
+	return &d->queue;
+}
+
+static int ramdisk_start(struct uk_blkdev *dev __unused)
+{
+	return 0;
+}
+
+static int ramdisk_stop(struct uk_blkdev *dev __unused)
+{
+	return 0;
+}
+
+static int ramdisk_queue_unconfigure(struct uk_blkdev *dev __unused,
+				     struct uk_blkdev_queue *queue)
+{
+	UK_ASSERT(queue->nb_reqs == 0);
+	return 0;
+}
+
+static int ramdisk_unconfigure(struct uk_blkdev *dev __unused)
+{
+	return 0;
+}
+
+static int ramdisk_submit_one(struct uk_blkdev *dev,
+			      struct uk_blkdev_queue *queue,
+			      struct uk_blkreq *req)
+{
+	struct ramdisk *d = __containerof(dev, struct ramdisk, blkdev);
+	size_t len = (size_t) req->nb_sectors * RAMDISK_SSIZE;
+	char *p = d->data + (size_t) req->start_sector * RAMDISK_SSIZE;
+
+	if (queue->nb_reqs == RAMDISK_DEPTH) {
+		d->nb_busy++;
+		return 0;
+	}
+	if (req->start_sector + req->nb_sectors > uk_blkdev_sectors(dev))
+		return -EINVAL;
+
+	if (req->operation == UK_BLKREQ_WRITE)
+		memcpy(p, req->aio_buf, len);
+	else if (req->operation == UK_BLKREQ_READ)
+		memcpy(req->aio_buf, p, len);
+
+	if (d->nb_submitted < ARRAY_SIZE(d->order))
+		d->order[d->nb_submitted] = req->start_sector;
+	d->nb_submitted++;
+	d->max_sectors = MAX(d->max_sectors, req->nb_sectors);
+
+	queue->reqs[queue->nb_reqs++] = req;
+	if (queue->nb_reqs < RAMDISK_DEPTH)
+		return UK_BLKDEV_STATUS_SUCCESS | UK_BLKDEV_STATUS_MORE;
+	return UK_BLKDEV_STATUS_SUCCESS;
+}
+
+static int ramdisk_finish_reqs(struct uk_blkdev *dev __unused,
+			       struct uk_blkdev_queue *queue)
+{
+	struct uk_blkreq *reqs[RAMDISK_DEPTH];
+	unsigned int i, nb_reqs = queue->nb_reqs;
+
+	/* Callbacks may hand new requests to the driver */
+	memcpy(reqs, queue->reqs, nb_reqs * sizeof(*reqs));
+	queue->nb_reqs = 0;
+
+	for (i = 0; i < nb_reqs; i++) {
+		reqs[i]->result = 0;
+		uk_blkreq_finished(reqs[i]);
+		if (reqs[i]->cb)
+			reqs[i]->cb(reqs[i], reqs[i]->cb_cookie);
+	}
+	return 0;
+}
+
+static const struct uk_blkdev_ops ramdisk_ops = {
+	.get_info = ramdisk_get_info,
+	.dev_configure = ramdisk_configure,
+	.queue_get_info = ramdisk_queue_get_info,
+	.queue_configure = ramdisk_queue_configure,
+	.dev_start = ramdisk_start,
+	.dev_stop = ramdisk_stop,
+	.queue_unconfigure = ramdisk_queue_unconfigure,
+	.dev_unconfigure = ramdisk_unconfigure,
+};
+
+static int ramdisk_setup(__sector max_sectors_per_req)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct uk_blkdev_conf conf = { .nb_queues = 1 };
+	struct uk_blkdev_queue_conf queue_conf = { .a = a };
+	int rc;
+
+	memset(&rd, 0, sizeof(rd));
+	rd.data = uk_calloc(a, RAMDISK_SECTORS, RAMDISK_SSIZE);
+	if (!rd.data)
+		return -ENOMEM;
+
+	rd.blkdev.submit_one = ramdisk_submit_one;
+	rd.blkdev.finish_reqs = ramdisk_finish_reqs;
+	rd.blkdev.dev_ops = &ramdisk_ops;
+	rd.blkdev.capabilities.sectors = RAMDISK_SECTORS;
+	rd.blkdev.capabilities.ssize = RAMDISK_SSIZE;
+	rd.blkdev.capabilities.mode = O_RDWR;
+	rd.blkdev.capabilities.max_sectors_per_req = max_sectors_per_req;
+	rd.blkdev.capabilities.ioalign = RAMDISK_SSIZE;
+
+	rc = uk_blkdev_drv_register(&rd.blkdev, a, "ramdisk");
+	if (rc < 0)
+		goto err_free;
+	rc = uk_blkdev_configure(&rd.blkdev, &conf);
+	if (rc)
+		goto err_unregister;
+	rc = uk_blkdev_queue_configure(&rd.blkdev, 0, RAMDISK_DEPTH,
+				       &queue_conf);
+	if (rc)
+		goto err_unconfigure;
+	rc = uk_blkdev_start(&rd.blkdev);
+	if (rc)
+		goto err_unconfigure_queue;
+	return 0;
+
+err_unconfigure_queue:
+	uk_blkdev_queue_unconfigure(&rd.blkdev, 0);
+err_unconfigure:
+	uk_blkdev_unconfigure(&rd.blkdev);
+err_unregister:
+	uk_blkdev_drv_unregister(&rd.blkdev);
+err_free:
+	uk_free(a, rd.data);
+	return rc;
+}
+
+static void ramdisk_teardown(void)
+{
+	uk_blkdev_stop(&rd.blkdev);
+	uk_blkdev_queue_unconfigure(&rd.blkdev, 0);
+	uk_blkdev_unconfigure(&rd.blkdev);
+	uk_blkdev_drv_unregister(&rd.blkdev);
+	uk_free(uk_alloc_get_default(), rd.data);
+}
+
+/* Polls the driver until the request completed */
+static void ramdisk_wait(struct uk_blkreq *req)
+{
+	while (!uk_blkreq_is_done(req))
+		uk_blkdev_queue_finish_reqs(&rd.blkdev, 0);
+}
+
+#endif /* __UKBLKDEV_TESTS_RAMDISK_H__ */
@@ -0,0 +1,238 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <uk/alloc.h>
+#include <uk/essentials.h>
+#include <uk/arch/time.h>
+#include <uk/plat/time.h>
+#include <uk/blkdev.h>
+#include <uk/blkdev_driver.h>
+#include <uk/test.h>
+
+#include "ramdisk.h"
+
+static void fill_pattern(char *buf, size_t len, unsigned int seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (char) (seed + i * 7);
+}
+
+UK_TESTCASE(ukblkdev_blkrq_testsuite, ukblkdev_test_plug_merge)
+{
+	struct uk_blkreq reqs[8];
+	char *buf;
+	unsigned int i;
+
+	UK_TEST_EXPECT_ZERO(ramdisk_setup(0));
+	buf = uk_memalign(uk_alloc_get_default(), RAMDISK_SSIZE,
+			  ARRAY_SIZE(reqs) * RAMDISK_SSIZE);
+	UK_TEST_EXPECT_NOT_NULL(buf);
+	fill_pattern(buf, ARRAY_SIZE(reqs) * RAMDISK_SSIZE, 1);
+
+	uk_blkdev_queue_plug(&rd.blkdev, 0);
+	for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+		uk_blkreq_init(&reqs[i], UK_BLKREQ_WRITE, 16 + i, 1,
+			       buf + i * RAMDISK_SSIZE, NULL, NULL);
+		UK_TEST_EXPECT_ZERO(uk_blkdev_queue_submit(&rd.blkdev, 0,
+							   &reqs[i]));
+	}
+	/* Nothing reaches the driver while the queue is plugged */
+	UK_TEST_EXPECT_SNUM_EQ(rd.nb_submitted, 0);
+	uk_blkdev_queue_unplug(&rd.blkdev, 0);
+
+	/* Contiguous requests reach the driver as a single request */
+	UK_TEST_EXPECT_SNUM_EQ(rd.nb_submitted, 1);
+	UK_TEST_EXPECT_SNUM_EQ(rd.max_sectors, ARRAY_SIZE(reqs));
+
+	for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+		ramdisk_wait(&reqs[i]);
+		UK_TEST_EXPECT_SNUM_EQ(reqs[i].result, 0);
+	}
+	UK_TEST_EXPECT_BYTES_EQ(rd.data + 16 * RAMDISK_SSIZE, buf,
+				ARRAY_SIZE(reqs) * RAMDISK_SSIZE);
+
+	uk_free(uk_alloc_get_default(), buf);
+	ramdisk_teardown();
+}
+
+UK_TESTCASE(ukblkdev_blkrq_testsuite, ukblkdev_test_merge_bounce)
+{
+	struct uk_blkreq reqs[4];
+	char *bufs[4];
+	unsigned int i;
+
+	UK_TEST_EXPECT_ZERO(ramdisk_setup(0));
+	fill_pattern(rd.data, RAMDISK_SECTORS * RAMDISK_SSIZE, 3);
+
+	/* Separate buffers are merged through the bounce buffer */
+	uk_blkdev_queue_plug(&rd.blkdev, 0);
+	for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+		bufs[i] = uk_memalign(uk_alloc_get_default(), RAMDISK_SSIZE,
+				      2 * RAMDISK_SSIZE);
+		UK_TEST_EXPECT_NOT_NULL(bufs[i]);
+		uk_blkreq_init(&reqs[i], UK_BLKREQ_READ, 40 + i, 1,
+			       bufs[i], NULL, NULL);
+		uk_blkdev_queue_submit(&rd.blkdev, 0, &reqs[i]);
+	}
+	uk_blkdev_queue_unplug(&rd.blkdev, 0);
+	UK_TEST_EXPECT_SNUM_EQ(rd.nb_submitted, 1);
+
+	for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+		ramdisk_wait(&reqs[i]);
+		UK_TEST_EXPECT_SNUM_EQ(reqs[i].result, 0);
+		UK_TEST_EXPECT_BYTES_EQ(bufs[i],
+					rd.data + (40 + i) * RAMDISK_SSIZE,
+					RAMDISK_SSIZE);
+		uk_free(uk_alloc_get_default(), bufs[i]);
+	}
+	ramdisk_teardown();
+}
+
+UK_TESTCASE(ukblkdev_blkrq_testsuite, ukblkdev_test_merge_limit)
+{
+	struct uk_blkreq reqs[8], *preqs[8];
+	char *buf;
+	unsigned int i;
+
+	/* The device accepts at most 4 sectors per request */
+	UK_TEST_EXPECT_ZERO(ramdisk_setup(4));
+	buf = uk_memalign(uk_alloc_get_default(), RAMDISK_SSIZE,
+			  ARRAY_SIZE(reqs) * RAMDISK_SSIZE);
+	UK_TEST_EXPECT_NOT_NULL(buf);
+
+	for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+		uk_blkreq_init(&reqs[i], UK_BLKREQ_READ, i, 1,
+			       buf + i * RAMDISK_SSIZE, NULL, NULL);
+		preqs[i] = &reqs[i];
+	}
+	UK_TEST_EXPECT_SNUM_EQ(uk_blkdev_queue_submit_batch(&rd.blkdev, 0,
+							    preqs,
+							    ARRAY_SIZE(reqs)),
+			       ARRAY_SIZE(reqs));
+	UK_TEST_EXPECT_SNUM_EQ(rd.nb_submitted, 2);
+	UK_TEST_EXPECT_SNUM_EQ(rd.max_sectors, 4);
+
+	for (i = 0; i < ARRAY_SIZE(reqs); i++)
+		ramdisk_wait(&reqs[i]);
+	uk_free(uk_alloc_get_default(), buf);
+	ramdisk_teardown();
+}
+
+UK_TESTCASE(ukblkdev_blkrq_testsuite, ukblkdev_test_flush_barrier)
+{
+	struct uk_blkreq reqs[3];
+	char buf[2 * RAMDISK_SSIZE];
+	unsigned int i;
+
+	UK_TEST_EXPECT_ZERO(ramdisk_setup(0));
+
+	/* Requests are not merged across a flush */
+	uk_blkdev_queue_plug(&rd.blkdev, 0);
+	uk_blkreq_init(&reqs[0], UK_BLKREQ_WRITE, 1, 1, buf, NULL, NULL);
+	uk_blkreq_init(&reqs[1], UK_BLKREQ_FFLUSH, 0, 0, NULL, NULL, NULL);
+	uk_blkreq_init(&reqs[2], UK_BLKREQ_WRITE, 2, 1, buf + RAMDISK_SSIZE,
+		       NULL, NULL);
+	for (i = 0; i < ARRAY_SIZE(reqs); i++)
+		uk_blkdev_queue_submit(&rd.blkdev, 0, &reqs[i]);
+	uk_blkdev_queue_unplug(&rd.blkdev, 0);
+
+	UK_TEST_EXPECT_SNUM_EQ(rd.nb_submitted, 3);
+	UK_TEST_EXPECT_SNUM_EQ(rd.order[0], 1);
+	UK_TEST_EXPECT_SNUM_EQ(rd.order[2], 2);
+
+	for (i = 0; i < ARRAY_SIZE(reqs); i++)
+		ramdisk_wait(&reqs[i]);
+	ramdisk_teardown();
+}
+
+UK_TESTCASE(ukblkdev_blkrq_testsuite, ukblkdev_test_queue_full)
+{
+	struct uk_blkreq reqs[RAMDISK_DEPTH + 4];
+	char buf[RAMDISK_SSIZE];
+	unsigned int i;
+
+	UK_TEST_EXPECT_ZERO(ramdisk_setup(0));
+
+	/* Requests that do not fit in the driver queue are held back */
+	for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+		uk_blkreq_init(&reqs[i], UK_BLKREQ_READ, 2 * i, 1, buf,
+			       NULL, NULL);
+		UK_TEST_EXPECT_ZERO(uk_blkdev_queue_submit(&rd.blkdev, 0,
+							   &reqs[i]));
+	}
+	UK_TEST_EXPECT_SNUM_EQ(rd.nb_submitted, RAMDISK_DEPTH);
+	UK_TEST_EXPECT_SNUM_GT(rd.nb_busy, 0);
+
+	/* They are handed to the driver as completions make room */
+	for (i = 0; i < ARRAY_SIZE(reqs); i++)
+		ramdisk_wait(&reqs[i]);
+	UK_TEST_EXPECT_SNUM_EQ(rd.nb_submitted, ARRAY_SIZE(reqs));
+	ramdisk_teardown();
+}
+
+UK_TESTCASE(ukblkdev_blkrq_testsuite, ukblkdev_test_dispatch_order)
+{
+	static const __sector sectors[] = { 30, 10, 20 };
+	struct uk_blkreq reqs[ARRAY_SIZE(sectors)];
+	char buf[RAMDISK_SSIZE];
+	unsigned int i;
+
+	UK_TEST_EXPECT_ZERO(ramdisk_setup(0));
+
+	uk_blkdev_queue_plug(&rd.blkdev, 0);
+	for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+		uk_blkreq_init(&reqs[i], UK_BLKREQ_READ, sectors[i], 1, buf,
+			       NULL, NULL);
+		uk_blkdev_queue_submit(&rd.blkdev, 0, &reqs[i]);
+	}
+	uk_blkdev_queue_unplug(&rd.blkdev, 0);
+
+#if CONFIG_LIBUKBLKDEV_RQ_DEADLINE
+	/* Deadline ordering dispatches in an ascending sweep */
+	UK_TEST_EXPECT_SNUM_EQ(rd.order[0], 10);
+	UK_TEST_EXPECT_SNUM_EQ(rd.order[1], 20);
+	UK_TEST_EXPECT_SNUM_EQ(rd.order[2], 30);
+#else
+	for (i = 0; i < ARRAY_SIZE(reqs); i++)
+		UK_TEST_EXPECT_SNUM_EQ(rd.order[i], sectors[i]);
+#endif
+
+	for (i = 0; i < ARRAY_SIZE(reqs); i++)
+		ramdisk_wait(&reqs[i]);
+	ramdisk_teardown();
+}
+
+uk_testsuite_register(ukblkdev_blkrq_testsuite, NULL);
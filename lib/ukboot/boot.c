@@ -54,6 +54,7 @@
 #include <uk/sched.h>
 #endif
 #include <uk/arch/lcpu.h>
+#include <uk/arch/limits.h>
 #include <uk/plat/bootstrap.h>
 #include <uk/plat/memory.h>
 #include <uk/plat/lcpu.h>
@@ -74,6 +75,41 @@
 
 int main(int argc, char *argv[]) __weak;
 
+#if CONFIG_HAVE_SMP && CONFIG_LIBUKALLOC && !CONFIG_LIBUKSCHEDMP
+/*
+ * Start the secondary CPUs, each on a stack of its own. They wait in the
+ * low-power state of the platform until they get work with
+ * ukplat_lcpu_run(). The multi-core scheduler starts them on its own.
+ */
+static void lcpus_start(struct uk_alloc *a)
+{
+	static __lcpuid lcpuid[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	static void *sp[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	__lcpuid count = ukplat_lcpu_count();
+	unsigned int i, num = 0;
+	void *stack;
+	int rc;
+
+	for (i = 1; i < count; i++) {
+		stack = uk_memalign(a, __PAGE_SIZE, __STACK_SIZE);
+		if (unlikely(!stack)) {
+			uk_pr_err("Failed to allocate stack of CPU %u\n", i);
+			break;
+		}
+		lcpuid[num] = i;
+		sp[num] = (__u8 *) stack + __STACK_SIZE;
+		num++;
+	}
+	if (!num)
+		return;
+
+	uk_pr_info("Start %u secondary CPUs...\n", num);
+	rc = ukplat_lcpu_start(lcpuid, sp, NULL, num);
+	if (unlikely(rc < 0))
+		uk_pr_err("Failed to start secondary CPUs: %d\n", rc);
+}
+#endif /* CONFIG_HAVE_SMP && CONFIG_LIBUKALLOC && !CONFIG_LIBUKSCHEDMP */
+
 /* defined in <uk/plat.h> */
 void ukplat_entry_argp(char *arg0, char *argb, __sz argb_len)
 {
@@ -204,6 +240,12 @@ void ukplat_entry(int argc, char *argv[])
 	uk_pr_info("Initialize platform time...\n");
 	ukplat_time_init();
 
+#if CONFIG_HAVE_SMP && CONFIG_LIBUKALLOC && !CONFIG_LIBUKSCHEDMP
+	/* Secondary CPUs need the local timer and interrupt controller */
+	if (a)
+		lcpus_start(a);
+#endif
+
 #if CONFIG_LIBUKSCHED
 	/* Init scheduler. */
 	s = uk_sched_default_init(a);
@@ -43,9 +43,10 @@
 #include <uk/wait_types.h>
 #include <uk/plat/time.h>
 
+#include <uk/arch/atomic.h>
+
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
 #include <uk/plat/spinlock.h>
-#include <string.h>
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
 #ifdef __cplusplus
@@ -55,6 +56,12 @@ extern "C" {
 /*
  * Mutex that relies on a scheduler
  * uses wait queues for threads
+ *
+ * The mutex is owned as soon as `owner` is set. A contended lock operation
+ * first spins as long as the owner is running on another logical CPU and
+ * goes to sleep on `wait` otherwise. An unlock operation hands the mutex
+ * directly over to the first sleeping waiter, so that a woken up thread
+ * never has to race for it again.
  */
 struct uk_mutex {
 	int lock_count;
@@ -62,6 +69,9 @@ struct uk_mutex {
 	struct uk_waitq wait;
 };
 
+/* Number of buckets of the wait time histogram */
+#define UK_MUTEX_WAIT_HIST_BUCKETS 16
+
 /*
  * Mutex statistics for ukstore.
  */
@@ -79,6 +89,20 @@ struct uk_mutex_metrics {
 	size_t total_failed_trylocks;
 	/** Successful unlock operations since startup */
 	size_t total_unlocks;
+
+	/** Blocking lock operations that found the mutex owned by another
+	 *  thread since startup
+	 */
+	size_t total_contended;
+	/** Contended lock operations that got the mutex while spinning */
+	size_t total_spin_acquired;
+	/** Unlock operations that handed the mutex over to a waiter */
+	size_t total_handoffs;
+	/** Wait time of contended lock operations: bucket 0 counts waits
+	 *  below 1us, bucket i waits in [2^(i-1), 2^i) us; the last bucket
+	 *  also counts all longer waits
+	 */
+	size_t wait_hist[UK_MUTEX_WAIT_HIST_BUCKETS];
 };
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
@@ -87,7 +111,15 @@ struct uk_mutex_metrics {
  */
 extern struct uk_mutex_metrics _uk_mutex_metrics;
 extern __spinlock              _uk_mutex_metrics_lock;
-#endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
+
+void _uk_mutex_account_lock(struct uk_mutex *m);
+void _uk_mutex_account_trylock(struct uk_mutex *m, int ret);
+void _uk_mutex_account_unlock(struct uk_mutex *m);
+#else /* !CONFIG_LIBUKLOCK_MUTEX_METRICS */
+#define _uk_mutex_account_lock(m) do { } while (0)
+#define _uk_mutex_account_trylock(m, ret) do { } while (0)
+#define _uk_mutex_account_unlock(m) do { } while (0)
+#endif /* !CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
 #define	UK_MUTEX_INITIALIZER(name)				\
 	{ 0, NULL, __WAIT_QUEUE_INITIALIZER((name).wait) }
@@ -95,100 +127,83 @@ extern __spinlock              _uk_mutex_metrics_lock;
 void uk_mutex_init(struct uk_mutex *m);
 void uk_mutex_get_metrics(struct uk_mutex_metrics *dst);
 
+/* Slow paths (see mutex.c) */
+void _uk_mutex_lock_contended(struct uk_mutex *m, struct uk_thread *current);
+void _uk_mutex_unlock_contended(struct uk_mutex *m);
+
+static inline int _uk_mutex_acquire(struct uk_mutex *m,
+				    struct uk_thread *owner)
+{
+	struct uk_thread *expected = NULL;
+
+	return __atomic_compare_exchange_n(&m->owner, &expected, owner, 0,
+					   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
 static inline void uk_mutex_lock(struct uk_mutex *m)
 {
 	struct uk_thread *current;
-	unsigned long irqf;
 
 	UK_ASSERT(m);
 
 	current = uk_thread_current();
 
-	for (;;) {
-		uk_waitq_wait_event(&m->wait,
-			m->lock_count == 0 || m->owner == current);
-		irqf = ukplat_lcpu_save_irqf();
-		if (m->lock_count == 0 || m->owner == current)
-			break;
-		ukplat_lcpu_restore_irqf(irqf);
+	/* Only the owner itself can set `owner` to its own thread */
+	if (UK_READ_ONCE(m->owner) == current) {
+		m->lock_count++;
+	} else {
+		if (!_uk_mutex_acquire(m, current))
+			_uk_mutex_lock_contended(m, current);
+		UK_ASSERT(m->lock_count == 0);
+		m->lock_count = 1;
 	}
-#ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-	ukarch_spin_lock(&_uk_mutex_metrics_lock);
-#endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
-
-	m->lock_count++;
-	m->owner = current;
-
-#ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-	_uk_mutex_metrics.active_locked   += (m->lock_count == 1);
-	_uk_mutex_metrics.active_unlocked -= (m->lock_count == 1);
-	_uk_mutex_metrics.total_locks++;
-
-	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
-#endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
-	ukplat_lcpu_restore_irqf(irqf);
+	_uk_mutex_account_lock(m);
 }
 
 static inline int uk_mutex_trylock(struct uk_mutex *m)
 {
 	struct uk_thread *current;
-	unsigned long irqf;
 	int ret = 0;
 
 	UK_ASSERT(m);
 
 	current = uk_thread_current();
 
-	irqf = ukplat_lcpu_save_irqf();
-	if (m->lock_count == 0 || m->owner == current) {
-		ret = 1;
+	if (UK_READ_ONCE(m->owner) == current) {
 		m->lock_count++;
-		m->owner = current;
+		ret = 1;
+	} else if (_uk_mutex_acquire(m, current)) {
+		UK_ASSERT(m->lock_count == 0);
+		m->lock_count = 1;
+		ret = 1;
 	}
-
-#ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-	_uk_mutex_metrics.active_locked += (ret == 1) && (m->lock_count == 1);
-	_uk_mutex_metrics.active_unlocked += (ret == 1) && (m->lock_count == 1);
-	_uk_mutex_metrics.total_ok_trylocks += ret;
-	_uk_mutex_metrics.total_failed_trylocks += !ret;
-#endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
-
-	ukplat_lcpu_restore_irqf(irqf);
+	_uk_mutex_account_trylock(m, ret);
 	return ret;
 }
 
 static inline int uk_mutex_is_locked(struct uk_mutex *m)
 {
-	return m->lock_count > 0;
+	return UK_READ_ONCE(m->owner) != NULL;
 }
 
 static inline void uk_mutex_unlock(struct uk_mutex *m)
 {
-	unsigned long irqf;
-
 	UK_ASSERT(m);
-
-	irqf = ukplat_lcpu_save_irqf();
-
-#ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-	ukarch_spin_lock(&_uk_mutex_metrics_lock);
-#endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
-
 	UK_ASSERT(m->lock_count > 0);
-	if (--m->lock_count == 0) {
-		m->owner = NULL;
-		uk_waitq_wake_up(&m->wait);
-	}
-
-#ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-	_uk_mutex_metrics.active_locked   -= (m->lock_count == 0);
-	_uk_mutex_metrics.active_unlocked += (m->lock_count == 0);
-	_uk_mutex_metrics.total_unlocks++;
-
-	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
-#endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
-
-	ukplat_lcpu_restore_irqf(irqf);
+	UK_ASSERT(m->owner == uk_thread_current());
+
+	_uk_mutex_account_unlock(m);
+	if (--m->lock_count > 0)
+		return;
+
+	/* Release the mutex before looking for waiters. Pairs with the
+	 * barrier between queueing and retrying in the contended lock path:
+	 * either the waiter sees the released mutex or we see the waiter.
+	 */
+	__atomic_store_n(&m->owner, NULL, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!uk_waitq_empty(&m->wait))
+		_uk_mutex_unlock_contended(m);
 }
 
 #define uk_waitq_wait_event_mutex(wq, condition, mutex) \
@@ -200,6 +215,17 @@ static inline void uk_mutex_unlock(struct uk_mutex *m)
 					    uk_mutex_lock, uk_mutex_unlock, \
 					    mutex)
 
+#define uk_waitq_wait_event_exclusive_mutex(wq, condition, mutex) \
+	uk_waitq_wait_event_exclusive_locked(wq, condition, uk_mutex_lock, \
+					     uk_mutex_unlock, mutex)
+
+#define uk_waitq_wait_event_deadline_exclusive_mutex(wq, condition, \
+						     deadline, mutex) \
+	uk_waitq_wait_event_deadline_exclusive_locked(wq, condition, \
+						      deadline, \
+						      uk_mutex_lock, \
+						      uk_mutex_unlock, mutex)
+
 #ifdef __cplusplus
 }
 #endif
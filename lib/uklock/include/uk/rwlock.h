@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __UK_RWLOCK_H__
+#define __UK_RWLOCK_H__
+
+#include <uk/config.h>
+
+#if CONFIG_LIBUKLOCK_RWLOCK
+#include <uk/thread.h>
+#include <uk/wait_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Reader-writer lock that relies on a scheduler
+ * uses a wait queue for threads
+ *
+ * Any number of readers or a single writer may hold the lock. Waiting
+ * writers are preferred over new readers, so that a steady stream of
+ * readers cannot starve them. As a consequence, read locks must not be
+ * taken recursively. The lock state is protected by the lock of `wait`.
+ */
+struct uk_rwlock {
+	unsigned int nr_readers;	/* Threads holding the lock shared */
+	unsigned int nr_writers_waiting;
+	struct uk_thread *writer;	/* Thread holding the lock exclusive */
+	struct uk_waitq wait;
+};
+
+#define UK_RWLOCK_INITIALIZER(name)				\
+	{ 0, 0, NULL, __WAIT_QUEUE_INITIALIZER((name).wait) }
+
+void uk_rwlock_init(struct uk_rwlock *rwl);
+
+void uk_rwlock_rlock(struct uk_rwlock *rwl);
+int uk_rwlock_tryrlock(struct uk_rwlock *rwl);
+void uk_rwlock_runlock(struct uk_rwlock *rwl);
+
+void uk_rwlock_wlock(struct uk_rwlock *rwl);
+int uk_rwlock_trywlock(struct uk_rwlock *rwl);
+void uk_rwlock_wunlock(struct uk_rwlock *rwl);
+
+static inline int uk_rwlock_is_wlocked(struct uk_rwlock *rwl)
+{
+	return rwl->writer != NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONFIG_LIBUKLOCK_RWLOCK */
+
+#endif /* __UK_RWLOCK_H__ */
@@ -31,6 +31,7 @@
 #include <uk/print.h>
 #include <uk/assert.h>
 #include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
 #include <uk/thread.h>
 #include <uk/wait.h>
 #include <uk/wait_types.h>
@@ -43,42 +44,58 @@ extern "C" {
 /*
  * Semaphore that relies on a scheduler
  * uses wait queues for threads
+ *
+ * The count is protected by an irq-safe spinlock, so that the semaphore
+ * can be used across CPUs and from interrupt context. Waiters are queued
+ * before the lock is dropped, thus an up() cannot slip in between the
+ * check of the count and going to sleep.
  */
 struct uk_semaphore {
 	long count;
+	__spinlock sl;
+	unsigned long irqf; /* irq flags saved by the lock holder */
 	struct uk_waitq wait;
 };
 
 void uk_semaphore_init(struct uk_semaphore *s, long count);
 
-static inline void uk_semaphore_down(struct uk_semaphore *s)
+static inline void _uk_semaphore_lock(struct uk_semaphore *s)
 {
 	unsigned long irqf;
 
+	ukplat_spin_lock_irqsave(&s->sl, irqf);
+	s->irqf = irqf;
+}
+
+static inline void _uk_semaphore_unlock(struct uk_semaphore *s)
+{
+	unsigned long irqf = s->irqf;
+
+	ukplat_spin_unlock_irqrestore(&s->sl, irqf);
+}
+
+static inline void uk_semaphore_down(struct uk_semaphore *s)
+{
 	UK_ASSERT(s);
 
-	for (;;) {
-		uk_waitq_wait_event(&s->wait, s->count > 0);
-		irqf = ukplat_lcpu_save_irqf();
-		if (s->count > 0)
-			break;
-		ukplat_lcpu_restore_irqf(irqf);
-	}
+	_uk_semaphore_lock(s);
+	uk_waitq_wait_event_exclusive_locked(&s->wait, s->count > 0,
+					     _uk_semaphore_lock,
+					     _uk_semaphore_unlock, s);
 	--s->count;
 #ifdef UK_SEMAPHORE_DEBUG
 	uk_pr_debug("Decreased semaphore %p to %ld\n", s, s->count);
 #endif
-	ukplat_lcpu_restore_irqf(irqf);
+	_uk_semaphore_unlock(s);
 }
 
 static inline int uk_semaphore_down_try(struct uk_semaphore *s)
 {
-	unsigned long irqf;
 	int ret = 0;
 
 	UK_ASSERT(s);
 
-	irqf = ukplat_lcpu_save_irqf();
+	_uk_semaphore_lock(s);
 	if (s->count > 0) {
 		ret = 1;
 		--s->count;
@@ -87,7 +104,7 @@ static inline int uk_semaphore_down_try(struct uk_semaphore *s)
 			    s, s->count);
 #endif
 	}
-	ukplat_lcpu_restore_irqf(irqf);
+	_uk_semaphore_unlock(s);
 	return ret;
 }
 
@@ -95,7 +112,6 @@ static inline int uk_semaphore_down_try(struct uk_semaphore *s)
 static inline __nsec uk_semaphore_down_to(struct uk_semaphore *s,
 					  __nsec timeout)
 {
-	unsigned long irqf;
 	__nsec then = ukplat_monotonic_clock();
 	__nsec deadline;
 
@@ -103,25 +119,22 @@ static inline __nsec uk_semaphore_down_to(struct uk_semaphore *s,
 
 	deadline = then + timeout;
 
-	for (;;) {
-		uk_waitq_wait_event_deadline(&s->wait, s->count > 0, deadline);
-		irqf = ukplat_lcpu_save_irqf();
-		if (s->count > 0 || (deadline &&
-				     ukplat_monotonic_clock() >= deadline))
-			break;
-		ukplat_lcpu_restore_irqf(irqf);
-	}
+	_uk_semaphore_lock(s);
+	uk_waitq_wait_event_deadline_exclusive_locked(&s->wait, s->count > 0,
+						      deadline,
+						      _uk_semaphore_lock,
+						      _uk_semaphore_unlock, s);
 	if (s->count > 0) {
 		s->count--;
 #ifdef UK_SEMAPHORE_DEBUG
 		uk_pr_debug("Decreased semaphore %p to %ld\n",
 			    s, s->count);
 #endif
-		ukplat_lcpu_restore_irqf(irqf);
+		_uk_semaphore_unlock(s);
 		return ukplat_monotonic_clock() - then;
 	}
 
-	ukplat_lcpu_restore_irqf(irqf);
+	_uk_semaphore_unlock(s);
 #ifdef UK_SEMAPHORE_DEBUG
 	uk_pr_debug("Timed out while waiting for semaphore %p\n", s);
 #endif
@@ -130,18 +143,17 @@ static inline __nsec uk_semaphore_down_to(struct uk_semaphore *s,
 
 static inline void uk_semaphore_up(struct uk_semaphore *s)
 {
-	unsigned long irqf;
-
 	UK_ASSERT(s);
 
-	irqf = ukplat_lcpu_save_irqf();
+	_uk_semaphore_lock(s);
 	++s->count;
 #ifdef UK_SEMAPHORE_DEBUG
 	uk_pr_debug("Increased semaphore %p to %ld\n",
 		    s, s->count);
 #endif
-	uk_waitq_wake_up(&s->wait);
-	ukplat_lcpu_restore_irqf(irqf);
+	/* One unit of count can only be taken by a single waiter */
+	uk_waitq_wake_up_one(&s->wait);
+	_uk_semaphore_unlock(s);
 }
 
 #ifdef __cplusplus
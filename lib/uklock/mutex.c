@@ -1,8 +1,12 @@
 #include <uk/mutex.h>
+#include <uk/sched.h>
+#include <uk/arch/lcpu.h>
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
+#include <string.h>
 #include <uk/init.h>
 #include <uk/assert.h>
+#include <uk/plat/time.h>
 
 struct uk_mutex_metrics _uk_mutex_metrics = { 0 };
 __spinlock              _uk_mutex_metrics_lock;
@@ -10,15 +14,135 @@ __spinlock              _uk_mutex_metrics_lock;
 
 void uk_mutex_init(struct uk_mutex *m)
 {
+#ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
+	unsigned long flags;
+#endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
+
 	m->lock_count = 0;
 	m->owner = NULL;
 	uk_waitq_init(&m->wait);
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-	ukarch_spin_lock(&_uk_mutex_metrics_lock);
+	ukplat_spin_lock_irqsave(&_uk_mutex_metrics_lock, flags);
 	_uk_mutex_metrics.active_unlocked++;
-	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
+	ukplat_spin_unlock_irqrestore(&_uk_mutex_metrics_lock, flags);
+#endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
+}
+
+#ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
+static void mutex_account_wait(__nsec wait_ns, int spin_acquired)
+{
+	unsigned long flags;
+	__nsec wait_us = wait_ns / 1000;
+	unsigned int b = 0;
+
+	while (wait_us && b < UK_MUTEX_WAIT_HIST_BUCKETS - 1) {
+		wait_us >>= 1;
+		b++;
+	}
+
+	ukplat_spin_lock_irqsave(&_uk_mutex_metrics_lock, flags);
+	_uk_mutex_metrics.total_contended++;
+	_uk_mutex_metrics.total_spin_acquired += !!spin_acquired;
+	_uk_mutex_metrics.wait_hist[b]++;
+	ukplat_spin_unlock_irqrestore(&_uk_mutex_metrics_lock, flags);
+}
+#else /* !CONFIG_LIBUKLOCK_MUTEX_METRICS */
+#define mutex_account_wait(wait_ns, spin_acquired) do { } while (0)
+#endif /* !CONFIG_LIBUKLOCK_MUTEX_METRICS */
+
+#if CONFIG_HAVE_SMP
+/*
+ * Spins as long as the owner of the mutex is running on another logical CPU
+ * and is thus likely to release it soon. Gives up after
+ * CONFIG_LIBUKLOCK_MUTEX_SPIN iterations or as soon as the owner is switched
+ * out, in which case sleeping is cheaper than burning the CPU.
+ * @return 1 if the mutex was acquired, 0 otherwise.
+ */
+static int mutex_spin(struct uk_mutex *m, struct uk_thread *current)
+{
+	struct uk_thread *owner;
+	unsigned int i;
+
+	for (i = 0; i < CONFIG_LIBUKLOCK_MUTEX_SPIN; i++) {
+		owner = UK_READ_ONCE(m->owner);
+		if (!owner) {
+			if (_uk_mutex_acquire(m, current))
+				return 1;
+			continue;
+		}
+		/* Thread objects are not unmapped when freed, reading
+		 * `on_lcpu` of a stale owner is harmless.
+		 */
+		if (!UK_READ_ONCE(owner->on_lcpu))
+			break;
+		ukarch_spinwait();
+	}
+	return 0;
+}
+#else /* !CONFIG_HAVE_SMP */
+/* The owner cannot run while we do */
+#define mutex_spin(m, current) 0
+#endif /* !CONFIG_HAVE_SMP */
+
+void _uk_mutex_lock_contended(struct uk_mutex *m, struct uk_thread *current)
+{
+	DEFINE_WAIT(wait);
+	unsigned long flags;
+#ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
+	__nsec start = ukplat_monotonic_clock();
+#endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
+
+	if (mutex_spin(m, current)) {
+		mutex_account_wait(ukplat_monotonic_clock() - start, 1);
+		return;
+	}
+
+	for (;;) {
+		flags = uk_waitq_lock_irqsave(&m->wait);
+		uk_waitq_add(&m->wait, &wait);
+
+		/* Pairs with the barrier in `uk_mutex_unlock()` */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (_uk_mutex_acquire(m, current)) {
+			uk_waitq_remove(&m->wait, &wait);
+			uk_waitq_unlock_irqrestore(&m->wait, flags);
+			break;
+		}
+
+		uk_thread_block(current);
+		uk_waitq_unlock_irqrestore(&m->wait, flags);
+		uk_sched_yield();
+
+		/* The unlocking thread dequeued us and made us the owner */
+		if (UK_READ_ONCE(m->owner) == current) {
+			UK_ASSERT(!wait.waiting);
+			break;
+		}
+	}
+	mutex_account_wait(ukplat_monotonic_clock() - start, 0);
+}
+
+void _uk_mutex_unlock_contended(struct uk_mutex *m)
+{
+	struct uk_waitq_entry *w;
+	unsigned long flags;
+
+	flags = uk_waitq_lock_irqsave(&m->wait);
+	w = UK_STAILQ_FIRST(&m->wait.list);
+	/* If another thread grabbed the mutex meanwhile, the waiters stay
+	 * queued until it unlocks again.
+	 */
+	if (w && _uk_mutex_acquire(m, w->thread)) {
+		uk_waitq_remove(&m->wait, w);
+		uk_thread_wakeup(w->thread);
+#ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
+		ukarch_spin_lock(&_uk_mutex_metrics_lock);
+		_uk_mutex_metrics.total_handoffs++;
+		ukarch_spin_unlock(&_uk_mutex_metrics_lock);
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
+	}
+	uk_waitq_unlock_irqrestore(&m->wait, flags);
 }
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
@@ -36,17 +160,54 @@ static int mutex_metrics_ctor(void)
 }
 uk_lib_initcall_prio(mutex_metrics_ctor, 1);
 
+void _uk_mutex_account_lock(struct uk_mutex *m)
+{
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&_uk_mutex_metrics_lock, flags);
+	_uk_mutex_metrics.active_locked   += (m->lock_count == 1);
+	_uk_mutex_metrics.active_unlocked -= (m->lock_count == 1);
+	_uk_mutex_metrics.total_locks++;
+	ukplat_spin_unlock_irqrestore(&_uk_mutex_metrics_lock, flags);
+}
+
+void _uk_mutex_account_trylock(struct uk_mutex *m, int ret)
+{
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&_uk_mutex_metrics_lock, flags);
+	_uk_mutex_metrics.active_locked   += ret && (m->lock_count == 1);
+	_uk_mutex_metrics.active_unlocked -= ret && (m->lock_count == 1);
+	_uk_mutex_metrics.total_ok_trylocks += !!ret;
+	_uk_mutex_metrics.total_failed_trylocks += !ret;
+	ukplat_spin_unlock_irqrestore(&_uk_mutex_metrics_lock, flags);
+}
+
+/* Called before the lock count is decremented */
+void _uk_mutex_account_unlock(struct uk_mutex *m)
+{
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&_uk_mutex_metrics_lock, flags);
+	_uk_mutex_metrics.active_locked   -= (m->lock_count == 1);
+	_uk_mutex_metrics.active_unlocked += (m->lock_count == 1);
+	_uk_mutex_metrics.total_unlocks++;
+	ukplat_spin_unlock_irqrestore(&_uk_mutex_metrics_lock, flags);
+}
+
 /**
  * Makes a copy of mutex metrics to avoid direct user access.
  * @dst : destination buffer (must have been already allocated)
  */
 void uk_mutex_get_metrics(struct uk_mutex_metrics *dst)
 {
+	unsigned long flags;
+
 	UK_ASSERT(dst);
 
-	ukarch_spin_lock(&_uk_mutex_metrics_lock);
+	ukplat_spin_lock_irqsave(&_uk_mutex_metrics_lock, flags);
 	memcpy(dst, &_uk_mutex_metrics, sizeof(*dst));
-	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
+	ukplat_spin_unlock_irqrestore(&_uk_mutex_metrics_lock, flags);
 }
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
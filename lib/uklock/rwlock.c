@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <uk/rwlock.h>
+#include <uk/assert.h>
+#include <uk/sched.h>
+#include <uk/wait.h>
+
+void uk_rwlock_init(struct uk_rwlock *rwl)
+{
+	rwl->nr_readers = 0;
+	rwl->nr_writers_waiting = 0;
+	rwl->writer = NULL;
+	uk_waitq_init(&rwl->wait);
+}
+
+/*
+ * Puts the current thread to sleep until the lock is released. Called and
+ * returns with the wait queue lock held; `*flags` is updated accordingly.
+ */
+static void rwlock_sleep(struct uk_rwlock *rwl, struct uk_waitq_entry *w,
+			 unsigned long *flags)
+{
+	uk_waitq_add(&rwl->wait, w);
+	uk_thread_block(w->thread);
+	uk_waitq_unlock_irqrestore(&rwl->wait, *flags);
+	uk_sched_yield();
+	*flags = uk_waitq_lock_irqsave(&rwl->wait);
+}
+
+/*
+ * Wakes up all waiters; each of them re-evaluates the lock state and goes
+ * back to sleep if it still cannot take the lock. Writers are rare for the
+ * read-mostly data this lock is meant for, so this keeps the queue simple.
+ * NOTE: The caller must hold the wait queue lock
+ */
+static void rwlock_wake_all(struct uk_rwlock *rwl)
+{
+	struct uk_waitq_entry *w, *next;
+
+	UK_STAILQ_FOREACH_SAFE(w, &rwl->wait.list, thread_list, next) {
+		uk_waitq_remove(&rwl->wait, w);
+		uk_thread_wakeup(w->thread);
+	}
+}
+
+void uk_rwlock_rlock(struct uk_rwlock *rwl)
+{
+	DEFINE_WAIT(wait);
+	unsigned long flags;
+
+	UK_ASSERT(rwl);
+	UK_ASSERT(rwl->writer != wait.thread);
+
+	flags = uk_waitq_lock_irqsave(&rwl->wait);
+	while (rwl->writer || rwl->nr_writers_waiting)
+		rwlock_sleep(rwl, &wait, &flags);
+	uk_waitq_remove(&rwl->wait, &wait);
+	rwl->nr_readers++;
+	uk_waitq_unlock_irqrestore(&rwl->wait, flags);
+}
+
+int uk_rwlock_tryrlock(struct uk_rwlock *rwl)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	UK_ASSERT(rwl);
+
+	flags = uk_waitq_lock_irqsave(&rwl->wait);
+	if (!rwl->writer && !rwl->nr_writers_waiting) {
+		rwl->nr_readers++;
+		ret = 1;
+	}
+	uk_waitq_unlock_irqrestore(&rwl->wait, flags);
+	return ret;
+}
+
+void uk_rwlock_runlock(struct uk_rwlock *rwl)
+{
+	unsigned long flags;
+
+	UK_ASSERT(rwl);
+
+	flags = uk_waitq_lock_irqsave(&rwl->wait);
+	UK_ASSERT(rwl->nr_readers > 0);
+	if (--rwl->nr_readers == 0 && rwl->nr_writers_waiting)
+		rwlock_wake_all(rwl);
+	uk_waitq_unlock_irqrestore(&rwl->wait, flags);
+}
+
+void uk_rwlock_wlock(struct uk_rwlock *rwl)
+{
+	DEFINE_WAIT(wait);
+	unsigned long flags;
+
+	UK_ASSERT(rwl);
+	UK_ASSERT(rwl->writer != wait.thread);
+
+	flags = uk_waitq_lock_irqsave(&rwl->wait);
+	rwl->nr_writers_waiting++;
+	while (rwl->writer || rwl->nr_readers)
+		rwlock_sleep(rwl, &wait, &flags);
+	uk_waitq_remove(&rwl->wait, &wait);
+	rwl->nr_writers_waiting--;
+	rwl->writer = wait.thread;
+	uk_waitq_unlock_irqrestore(&rwl->wait, flags);
+}
+
+int uk_rwlock_trywlock(struct uk_rwlock *rwl)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	UK_ASSERT(rwl);
+
+	flags = uk_waitq_lock_irqsave(&rwl->wait);
+	if (!rwl->writer && !rwl->nr_readers) {
+		rwl->writer = uk_thread_current();
+		ret = 1;
+	}
+	uk_waitq_unlock_irqrestore(&rwl->wait, flags);
+	return ret;
+}
+
+void uk_rwlock_wunlock(struct uk_rwlock *rwl)
+{
+	unsigned long flags;
+
+	UK_ASSERT(rwl);
+
+	flags = uk_waitq_lock_irqsave(&rwl->wait);
+	UK_ASSERT(rwl->writer == uk_thread_current());
+	rwl->writer = NULL;
+	rwlock_wake_all(rwl);
+	uk_waitq_unlock_irqrestore(&rwl->wait, flags);
+}
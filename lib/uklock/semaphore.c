@@ -3,6 +3,7 @@
 void uk_semaphore_init(struct uk_semaphore *s, long count)
 {
 	s->count = count;
+	ukarch_spin_init(&s->sl);
 	uk_waitq_init(&s->wait);
 
 #ifdef UK_SEMAPHORE_DEBUG
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <uk/arch/atomic.h>
+#include <uk/essentials.h>
+#include <uk/mutex.h>
+#include <uk/semaphore.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/wait.h>
+#include <uk/test.h>
+
+#define BENCH_THREADS	16
+#define BENCH_OPS	2000	/* per thread */
+
+/*
+ * Each benchmark runs BENCH_THREADS threads that contend for a single
+ * resource and yield while they hold it, so that the others pile up on
+ * the wait queue. The result is the number of context switches to the
+ * contending threads per acquisition of the resource.
+ */
+struct bench_ctx {
+	void (*acquire)(struct bench_ctx *ctx);
+	void (*release)(struct bench_ctx *ctx);
+
+	struct uk_waitq wq;
+	unsigned int avail;
+	struct uk_mutex mutex;
+	struct uk_semaphore sem;
+
+	unsigned long switches;
+	unsigned int done;
+};
+
+static __noreturn void bench_fn(void *arg)
+{
+	struct bench_ctx *ctx = (struct bench_ctx *) arg;
+	unsigned int i;
+
+	for (i = 0; i < BENCH_OPS; i++) {
+		ctx->acquire(ctx);
+		uk_sched_yield();
+		ctx->release(ctx);
+	}
+
+	ukarch_fetch_add(&ctx->switches, uk_thread_current()->nr_switches);
+	ukarch_inc(&ctx->done);
+	uk_sched_thread_exit();
+}
+
+/* Returns the context switches per operation, in hundredths */
+static unsigned long bench_run(struct bench_ctx *ctx)
+{
+	unsigned int n;
+
+	ctx->switches = 0;
+	ctx->done = 0;
+	for (n = 0; n < BENCH_THREADS; n++)
+		if (!uk_sched_thread_create(uk_sched_current(), bench_fn, ctx,
+					    "bench-wake"))
+			break;
+
+	while (UK_READ_ONCE(ctx->done) < n)
+		uk_sched_yield();
+
+	return n ? ctx->switches * 100 / (n * BENCH_OPS) : 0;
+}
+
+/* A token on a wait queue, every release wakes up all waiters */
+static void bench_token_acquire_all(struct bench_ctx *ctx)
+{
+	unsigned int avail;
+
+	for (;;) {
+		uk_waitq_wait_event(&ctx->wq, UK_READ_ONCE(ctx->avail) > 0);
+		avail = 1;
+		if (__atomic_compare_exchange_n(&ctx->avail, &avail, 0, 0,
+						__ATOMIC_SEQ_CST,
+						__ATOMIC_SEQ_CST))
+			return;
+	}
+}
+
+static void bench_token_release_all(struct bench_ctx *ctx)
+{
+	UK_WRITE_ONCE(ctx->avail, 1);
+	uk_waitq_wake_up(&ctx->wq);
+}
+
+/* The same token, with exclusive waiters that are woken up one by one */
+static void bench_token_acquire_one(struct bench_ctx *ctx)
+{
+	unsigned int avail;
+
+	for (;;) {
+		uk_waitq_wait_event_exclusive(&ctx->wq,
+					      UK_READ_ONCE(ctx->avail) > 0);
+		avail = 1;
+		if (__atomic_compare_exchange_n(&ctx->avail, &avail, 0, 0,
+						__ATOMIC_SEQ_CST,
+						__ATOMIC_SEQ_CST))
+			return;
+	}
+}
+
+static void bench_token_release_one(struct bench_ctx *ctx)
+{
+	UK_WRITE_ONCE(ctx->avail, 1);
+	uk_waitq_wake_up_one(&ctx->wq);
+}
+
+static void bench_mutex_acquire(struct bench_ctx *ctx)
+{
+	uk_mutex_lock(&ctx->mutex);
+}
+
+static void bench_mutex_release(struct bench_ctx *ctx)
+{
+	uk_mutex_unlock(&ctx->mutex);
+}
+
+static void bench_sem_acquire(struct bench_ctx *ctx)
+{
+	uk_semaphore_down(&ctx->sem);
+}
+
+static void bench_sem_release(struct bench_ctx *ctx)
+{
+	uk_semaphore_up(&ctx->sem);
+}
+
+UK_TESTCASE(uklock_wake_benchsuite, uklock_bench_wake)
+{
+	static const struct {
+		const char *name;
+		void (*acquire)(struct bench_ctx *ctx);
+		void (*release)(struct bench_ctx *ctx);
+	} benches[] = {
+		{ "waitq, wake all", bench_token_acquire_all,
+		  bench_token_release_all },
+		{ "waitq, wake one", bench_token_acquire_one,
+		  bench_token_release_one },
+		{ "mutex", bench_mutex_acquire, bench_mutex_release },
+		{ "semaphore", bench_sem_acquire, bench_sem_release },
+	};
+	struct bench_ctx ctx;
+	unsigned long cs;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(benches); i++) {
+		uk_waitq_init(&ctx.wq);
+		ctx.avail = 1;
+		uk_mutex_init(&ctx.mutex);
+		uk_semaphore_init(&ctx.sem, 1);
+		ctx.acquire = benches[i].acquire;
+		ctx.release = benches[i].release;
+
+		cs = bench_run(&ctx);
+		UK_TEST_EXPECT_NOT_ZERO(cs);
+		uk_test_printf("%s: %u threads, %lu.%02lu context switches/op\n",
+			       benches[i].name, BENCH_THREADS,
+			       cs / 100, cs % 100);
+	}
+}
+
+uk_testsuite_register(uklock_wake_benchsuite, NULL);
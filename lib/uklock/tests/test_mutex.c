@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <uk/arch/atomic.h>
+#include <uk/essentials.h>
+#include <uk/mutex.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+
+#define MUTEX_WAITERS		3
+
+UK_TESTCASE(uklock_mutex_testsuite, uklock_test_mutex_recursive)
+{
+	struct uk_mutex m;
+
+	uk_mutex_init(&m);
+	UK_TEST_EXPECT_ZERO(uk_mutex_is_locked(&m));
+
+	/* The owner can take the mutex again */
+	uk_mutex_lock(&m);
+	UK_TEST_EXPECT_SNUM_EQ(uk_mutex_trylock(&m), 1);
+	uk_mutex_lock(&m);
+	UK_TEST_EXPECT_SNUM_EQ(m.lock_count, 3);
+	UK_TEST_EXPECT_PTR_EQ(m.owner, uk_thread_current());
+
+	/* It is released by the last unlock only */
+	uk_mutex_unlock(&m);
+	uk_mutex_unlock(&m);
+	UK_TEST_EXPECT_SNUM_EQ(uk_mutex_is_locked(&m), 1);
+	uk_mutex_unlock(&m);
+	UK_TEST_EXPECT_ZERO(uk_mutex_is_locked(&m));
+	UK_TEST_EXPECT_NULL(m.owner);
+}
+
+struct mutex_ctx {
+	struct uk_mutex m;
+	struct uk_thread *t[MUTEX_WAITERS];
+	/* Threads in the order in which they got the mutex */
+	struct uk_thread *order[MUTEX_WAITERS];
+	unsigned int done;
+};
+
+static __noreturn void mutex_waiter_fn(void *arg)
+{
+	struct mutex_ctx *ctx = (struct mutex_ctx *) arg;
+
+	uk_mutex_lock(&ctx->m);
+	ctx->order[ctx->done] = uk_thread_current();
+	ctx->done++;
+	uk_mutex_unlock(&ctx->m);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(uklock_mutex_testsuite, uklock_test_mutex_handoff)
+{
+	struct mutex_ctx ctx = { .done = 0 };
+	unsigned int i;
+
+	uk_mutex_init(&ctx.m);
+	uk_mutex_lock(&ctx.m);
+
+	/* Queue the waiters one after the other */
+	for (i = 0; i < MUTEX_WAITERS; i++) {
+		ctx.t[i] = uk_sched_thread_create(uk_sched_current(),
+						  mutex_waiter_fn, &ctx,
+						  "test-mutex-waiter");
+		UK_TEST_EXPECT_NOT_NULL(ctx.t[i]);
+		if (!ctx.t[i])
+			return;
+		while (is_runnable(ctx.t[i]))
+			uk_sched_yield();
+	}
+	UK_TEST_EXPECT_ZERO(ctx.done);
+
+	/*
+	 * The unlock makes the first waiter the owner before it runs, so
+	 * that the mutex cannot be taken away from it anymore
+	 */
+	uk_mutex_unlock(&ctx.m);
+	UK_TEST_EXPECT_PTR_EQ(UK_READ_ONCE(ctx.m.owner), ctx.t[0]);
+	UK_TEST_EXPECT_ZERO(uk_mutex_trylock(&ctx.m));
+
+	/* Each waiter hands the mutex over to the next one in FIFO order */
+	for (i = 0; i < 16 && UK_READ_ONCE(ctx.done) < MUTEX_WAITERS; i++)
+		uk_sched_yield();
+	UK_TEST_EXPECT_SNUM_EQ(ctx.done, MUTEX_WAITERS);
+	for (i = 0; i < MUTEX_WAITERS; i++)
+		UK_TEST_EXPECT_PTR_EQ(ctx.order[i], ctx.t[i]);
+	UK_TEST_EXPECT_ZERO(uk_mutex_is_locked(&ctx.m));
+}
+
+uk_testsuite_register(uklock_mutex_testsuite, NULL);
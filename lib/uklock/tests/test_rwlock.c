@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <uk/essentials.h>
+#include <uk/rwlock.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+
+UK_TESTCASE(uklock_rwlock_testsuite, uklock_test_rwlock_try)
+{
+	struct uk_rwlock rwl;
+
+	uk_rwlock_init(&rwl);
+
+	/* Readers share the lock and keep writers out */
+	UK_TEST_EXPECT_SNUM_EQ(uk_rwlock_tryrlock(&rwl), 1);
+	uk_rwlock_rlock(&rwl);
+	UK_TEST_EXPECT_SNUM_EQ(rwl.nr_readers, 2);
+	UK_TEST_EXPECT_ZERO(uk_rwlock_trywlock(&rwl));
+	uk_rwlock_runlock(&rwl);
+	UK_TEST_EXPECT_ZERO(uk_rwlock_trywlock(&rwl));
+	uk_rwlock_runlock(&rwl);
+
+	/* A writer keeps out everybody else */
+	UK_TEST_EXPECT_SNUM_EQ(uk_rwlock_trywlock(&rwl), 1);
+	UK_TEST_EXPECT_SNUM_EQ(uk_rwlock_is_wlocked(&rwl), 1);
+	UK_TEST_EXPECT_ZERO(uk_rwlock_tryrlock(&rwl));
+	uk_rwlock_wunlock(&rwl);
+	UK_TEST_EXPECT_ZERO(uk_rwlock_is_wlocked(&rwl));
+
+	uk_rwlock_wlock(&rwl);
+	UK_TEST_EXPECT_PTR_EQ(rwl.writer, uk_thread_current());
+	uk_rwlock_wunlock(&rwl);
+	UK_TEST_EXPECT_ZERO(rwl.nr_readers);
+}
+
+struct rwlock_ctx {
+	struct uk_rwlock rwl;
+	int wlocked;
+	int done;
+};
+
+static __noreturn void rwlock_writer_fn(void *arg)
+{
+	struct rwlock_ctx *ctx = (struct rwlock_ctx *) arg;
+
+	uk_rwlock_wlock(&ctx->rwl);
+	UK_WRITE_ONCE(ctx->wlocked, 1);
+	uk_rwlock_wunlock(&ctx->rwl);
+	UK_WRITE_ONCE(ctx->done, 1);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(uklock_rwlock_testsuite, uklock_test_rwlock_writer_pref)
+{
+	struct rwlock_ctx ctx = { .wlocked = 0, .done = 0 };
+	struct uk_thread *t;
+	unsigned int i;
+
+	uk_rwlock_init(&ctx.rwl);
+	uk_rwlock_rlock(&ctx.rwl);
+
+	t = uk_sched_thread_create(uk_sched_current(), rwlock_writer_fn, &ctx,
+				   "test-rwlock-writer");
+	UK_TEST_EXPECT_NOT_NULL(t);
+	if (!t)
+		return;
+	while (!UK_READ_ONCE(ctx.done) && is_runnable(t))
+		uk_sched_yield();
+	UK_TEST_EXPECT_ZERO(ctx.wlocked);
+	UK_TEST_EXPECT_SNUM_EQ(ctx.rwl.nr_writers_waiting, 1);
+
+	/* A waiting writer keeps new readers out */
+	UK_TEST_EXPECT_ZERO(uk_rwlock_tryrlock(&ctx.rwl));
+
+	/* It gets the lock when the last reader leaves */
+	uk_rwlock_runlock(&ctx.rwl);
+	for (i = 0; i < 16 && !UK_READ_ONCE(ctx.done); i++)
+		uk_sched_yield();
+	UK_TEST_EXPECT_SNUM_EQ(ctx.wlocked, 1);
+	UK_TEST_EXPECT_SNUM_EQ(ctx.done, 1);
+	UK_TEST_EXPECT_ZERO(ctx.rwl.nr_writers_waiting);
+
+	UK_TEST_EXPECT_SNUM_EQ(uk_rwlock_tryrlock(&ctx.rwl), 1);
+	uk_rwlock_runlock(&ctx.rwl);
+}
+
+uk_testsuite_register(uklock_rwlock_testsuite, NULL);
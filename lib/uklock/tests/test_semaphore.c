@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <uk/arch/atomic.h>
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/sched.h>
+#include <uk/semaphore.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+
+#define SEM_WAITERS		3
+
+UK_TESTCASE(uklock_semaphore_testsuite, uklock_test_semaphore_try)
+{
+	struct uk_semaphore s;
+	__nsec start;
+
+	uk_semaphore_init(&s, 1);
+	UK_TEST_EXPECT_SNUM_EQ(uk_semaphore_down_try(&s), 1);
+	UK_TEST_EXPECT_ZERO(uk_semaphore_down_try(&s));
+
+	/* A timed down gives up after the timeout */
+	start = ukplat_monotonic_clock();
+	UK_TEST_EXPECT_SNUM_EQ(uk_semaphore_down_to(&s,
+					ukarch_time_msec_to_nsec(2)),
+			       __NSEC_MAX);
+	UK_TEST_EXPECT_SNUM_GE(ukplat_monotonic_clock() - start,
+			       ukarch_time_msec_to_nsec(2));
+
+	uk_semaphore_up(&s);
+	UK_TEST_EXPECT_SNUM_LT(uk_semaphore_down_to(&s,
+					ukarch_time_msec_to_nsec(2)),
+			       __NSEC_MAX);
+	UK_TEST_EXPECT_ZERO(s.count);
+}
+
+struct sem_ctx {
+	struct uk_semaphore s;
+	unsigned int done;
+};
+
+static __noreturn void sem_waiter_fn(void *arg)
+{
+	struct sem_ctx *ctx = (struct sem_ctx *) arg;
+
+	uk_semaphore_down(&ctx->s);
+	ukarch_inc(&ctx->done);
+	uk_sched_thread_exit();
+}
+
+/* Lets woken waiters run and returns how many of them got a unit */
+static unsigned int sem_waiters_done(struct sem_ctx *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < 16; i++)
+		uk_sched_yield();
+	return UK_READ_ONCE(ctx->done);
+}
+
+UK_TESTCASE(uklock_semaphore_testsuite, uklock_test_semaphore_wake)
+{
+	struct uk_thread *t[SEM_WAITERS];
+	struct sem_ctx ctx = { .done = 0 };
+	unsigned int i;
+
+	uk_semaphore_init(&ctx.s, 0);
+	for (i = 0; i < SEM_WAITERS; i++) {
+		t[i] = uk_sched_thread_create(uk_sched_current(),
+					      sem_waiter_fn, &ctx,
+					      "test-sem-waiter");
+		UK_TEST_EXPECT_NOT_NULL(t[i]);
+	}
+	for (i = 0; i < SEM_WAITERS; i++)
+		while (UK_READ_ONCE(ctx.done) < SEM_WAITERS &&
+		       is_runnable(t[i]))
+			uk_sched_yield();
+	UK_TEST_EXPECT_ZERO(ctx.done);
+
+	/* Every up lets exactly one waiter through */
+	for (i = 1; i <= SEM_WAITERS; i++) {
+		uk_semaphore_up(&ctx.s);
+		UK_TEST_EXPECT_SNUM_EQ(sem_waiters_done(&ctx), i);
+	}
+	UK_TEST_EXPECT_ZERO(ctx.s.count);
+}
+
+uk_testsuite_register(uklock_semaphore_testsuite, NULL);
@@ -58,6 +58,37 @@ void uk_mbox_recv(struct uk_mbox *m, void **msg);
 int uk_mbox_recv_try(struct uk_mbox *m, void **msg);
 __nsec uk_mbox_recv_to(struct uk_mbox *m, void **msg, __nsec timeout);
 
+/*
+ * Batched operations
+ *
+ * A mailbox may be shared by any number of senders and receivers. The
+ * batched functions move several messages within one critical section and
+ * wake up the other side at most once per batch.
+ */
+
+/* Posts all messages, blocking while the mailbox is full. Returns `count`. */
+size_t uk_mbox_post_n(struct uk_mbox *m, void * const *msgs, size_t count);
+/* Posts as many messages as fit. Can be called from interrupt context. */
+size_t uk_mbox_post_n_try(struct uk_mbox *m, void * const *msgs,
+			  size_t count);
+/* Like uk_mbox_post_n() but gives up after `timeout`. Returns the number of
+ * posted messages.
+ */
+size_t uk_mbox_post_n_to(struct uk_mbox *m, void * const *msgs,
+			 size_t count, __nsec timeout);
+
+/* Receives up to `count` messages, blocking until there is at least one.
+ * Returns the number of received messages.
+ */
+size_t uk_mbox_recv_n(struct uk_mbox *m, void **msgs, size_t count);
+/* Receives up to `count` messages without blocking */
+size_t uk_mbox_recv_n_try(struct uk_mbox *m, void **msgs, size_t count);
+/* Like uk_mbox_recv_n() but returns 0 if no message arrived within
+ * `timeout`.
+ */
+size_t uk_mbox_recv_n_to(struct uk_mbox *m, void **msgs, size_t count,
+			 __nsec timeout);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -1,13 +1,32 @@
 #include <uk/mbox.h>
 #include <uk/assert.h>
 #include <uk/arch/limits.h>
+#include <uk/essentials.h>
+#include <uk/plat/spinlock.h>
+#include <uk/wait.h>
 
+/*
+ * The mailbox state is protected by a spinlock that is taken with
+ * interrupts disabled, so messages can be posted from interrupt context
+ * with the _try variants. Senders and receivers only touch the wait queues
+ * if the other side is actually sleeping: while both sides keep up with
+ * each other, a message costs a single short critical section.
+ */
 struct uk_mbox {
 	size_t len;
-	struct uk_semaphore readsem;
-	long readpos;
-	struct uk_semaphore writesem;
-	long writepos;
+	size_t count;
+	size_t readpos;
+	size_t writepos;
+
+	__spinlock lock;
+	/* Interrupt flags saved by the lock holder */
+	unsigned long irqf;
+
+	/* Number of sleeping receivers and senders */
+	unsigned int nr_readers;
+	unsigned int nr_writers;
+	struct uk_waitq readwq;
+	struct uk_waitq writewq;
 
 	void *msgs[];
 };
@@ -17,19 +36,23 @@ struct uk_mbox *uk_mbox_create(struct uk_alloc *a, size_t size)
 	struct uk_mbox *m;
 
 	UK_ASSERT(size <= __L_MAX);
+	UK_ASSERT(size > 0);
 
-	m = uk_malloc(a, sizeof(*m) + (sizeof(void *) * (size + 1)));
+	m = uk_malloc(a, sizeof(*m) + (sizeof(void *) * size));
 	if (!m)
 		return NULL;
 
-	m->len = size + 1;
-
-	uk_semaphore_init(&m->readsem, 0);
+	m->len = size;
+	m->count = 0;
 	m->readpos = 0;
-
-	uk_semaphore_init(&m->writesem, (long) size);
 	m->writepos = 0;
 
+	ukarch_spin_init(&m->lock);
+	m->nr_readers = 0;
+	m->nr_writers = 0;
+	uk_waitq_init(&m->readwq);
+	uk_waitq_init(&m->writewq);
+
 	uk_pr_debug("Created mailbox %p\n", m);
 	return m;
 }
@@ -44,87 +67,186 @@ void uk_mbox_free(struct uk_alloc *a, struct uk_mbox *m)
 
 	UK_ASSERT(a);
 	UK_ASSERT(m);
-	UK_ASSERT(m->readpos == m->writepos);
+	UK_ASSERT(m->count == 0);
 
 	uk_free(a, m);
 }
 
-/* Posts the "msg" to the mailbox, internal version that actually does the
- * post.
- */
-static inline void _do_mbox_post(struct uk_mbox *m, void *msg)
+static void mbox_lock(struct uk_mbox *m)
 {
-	/* The caller got a semaphore token, so we are now allowed to increment
-	 * writer, but we still need to prevent concurrency between writers
-	 * (interrupt handler vs main)
-	 */
 	unsigned long irqf;
 
-	UK_ASSERT(m);
+	ukplat_spin_lock_irqsave(&m->lock, irqf);
+	m->irqf = irqf;
+}
 
-	irqf = ukplat_lcpu_save_irqf();
-	m->msgs[m->writepos] = msg;
-	m->writepos = (m->writepos + 1) % m->len;
-	UK_ASSERT(m->readpos != m->writepos);
-	ukplat_lcpu_restore_irqf(irqf);
-	uk_pr_debug("Posted message %p to mailbox %p\n", msg, m);
+static void mbox_unlock(struct uk_mbox *m)
+{
+	unsigned long irqf = m->irqf;
 
-	uk_semaphore_up(&m->readsem);
+	ukplat_spin_unlock_irqrestore(&m->lock, irqf);
 }
 
-void uk_mbox_post(struct uk_mbox *m, void *msg)
+/* Returns the deadline for a timeout as used by the wait queues */
+static inline __nsec mbox_deadline(__nsec timeout)
 {
-	/* The caller got a semaphore token, so we are now allowed to increment
-	 * writer, but we still need to prevent concurrency between writers
-	 * (interrupt handler vs main)
-	 */
+	return ukplat_monotonic_clock() + timeout;
+}
+
+/*
+ * Stores up to `count` messages in the mailbox and wakes up receivers.
+ * NOTE: The caller must hold the mailbox lock
+ */
+static size_t mbox_put(struct uk_mbox *m, void * const *msgs, size_t count)
+{
+	size_t n, i;
+
+	n = MIN(count, m->len - m->count);
+	for (i = 0; i < n; i++) {
+		m->msgs[m->writepos] = msgs[i];
+		m->writepos = (m->writepos + 1) % m->len;
+		uk_pr_debug("Posted message %p to mailbox %p\n", msgs[i], m);
+	}
+	m->count += n;
+
+	if (n && m->nr_readers)
+		uk_waitq_wake_up(&m->readwq);
+
+	return n;
+}
+
+/*
+ * Takes up to `count` messages out of the mailbox and wakes up senders.
+ * If `msgs` is NULL, the messages are dropped.
+ * NOTE: The caller must hold the mailbox lock
+ */
+static size_t mbox_get(struct uk_mbox *m, void **msgs, size_t count)
+{
+	size_t n, i;
+
+	n = MIN(count, m->count);
+	for (i = 0; i < n; i++) {
+		uk_pr_debug("Receive message from mailbox %p\n", m);
+		if (msgs)
+			msgs[i] = m->msgs[m->readpos];
+		m->readpos = (m->readpos + 1) % m->len;
+	}
+	m->count -= n;
+
+	if (n && m->nr_writers)
+		uk_waitq_wake_up(&m->writewq);
+
+	return n;
+}
+
+/*
+ * Posts all `count` messages, waiting for free slots if `block` is set.
+ * A zero `deadline` waits forever. Returns the number of posted messages.
+ */
+static size_t _do_mbox_post(struct uk_mbox *m, void * const *msgs,
+			    size_t count, int block, __nsec deadline)
+{
+	size_t posted = 0;
+	int timedout;
+
 	UK_ASSERT(m);
 
-	uk_semaphore_down(&m->writesem);
-	_do_mbox_post(m, msg);
+	mbox_lock(m);
+	for (;;) {
+		posted += mbox_put(m, msgs + posted, count - posted);
+		if (posted == count || !block)
+			break;
+
+		m->nr_writers++;
+		timedout = uk_waitq_wait_event_deadline_locked(&m->writewq,
+						m->count < m->len, deadline,
+						mbox_lock, mbox_unlock, m);
+		m->nr_writers--;
+		if (timedout)
+			break;
+	}
+	mbox_unlock(m);
+
+	return posted;
 }
 
-int uk_mbox_post_try(struct uk_mbox *m, void *msg)
+/*
+ * Receives at least one and up to `count` messages, waiting for messages
+ * if `block` is set. A zero `deadline` waits forever. Returns the number of
+ * received messages.
+ */
+static size_t _do_mbox_recv(struct uk_mbox *m, void **msgs, size_t count,
+			    int block, __nsec deadline)
 {
+	size_t received;
+	int timedout;
+
 	UK_ASSERT(m);
 
-	if (!uk_semaphore_down_try(&m->writesem))
+	if (unlikely(!count))
+		return 0;
+
+	mbox_lock(m);
+	for (;;) {
+		received = mbox_get(m, msgs, count);
+		if (received || !block)
+			break;
+
+		m->nr_readers++;
+		timedout = uk_waitq_wait_event_deadline_locked(&m->readwq,
+						m->count > 0, deadline,
+						mbox_lock, mbox_unlock, m);
+		m->nr_readers--;
+		if (timedout)
+			break;
+	}
+	mbox_unlock(m);
+
+	return received;
+}
+
+void uk_mbox_post(struct uk_mbox *m, void *msg)
+{
+	_do_mbox_post(m, &msg, 1, 1, 0);
+}
+
+int uk_mbox_post_try(struct uk_mbox *m, void *msg)
+{
+	if (!_do_mbox_post(m, &msg, 1, 0, 0))
 		return -ENOBUFS;
-	_do_mbox_post(m, msg);
 	return 0;
 }
 
 __nsec uk_mbox_post_to(struct uk_mbox *m, void *msg, __nsec timeout)
 {
-	__nsec ret;
+	__nsec then = ukplat_monotonic_clock();
 
-	UK_ASSERT(m);
+	if (!_do_mbox_post(m, &msg, 1, 1, then + timeout))
+		return __NSEC_MAX;
+	return ukplat_monotonic_clock() - then;
+}
+
+size_t uk_mbox_post_n(struct uk_mbox *m, void * const *msgs, size_t count)
+{
+	UK_ASSERT(msgs || !count);
 
-	ret = uk_semaphore_down_to(&m->writesem, timeout);
-	if (ret != __NSEC_MAX)
-		_do_mbox_post(m, msg);
-	return ret;
+	return _do_mbox_post(m, msgs, count, 1, 0);
 }
 
-/*
- * Fetch a message from a mailbox. Internal version that actually does the
- * fetch.
- */
-static inline void *_do_mbox_recv(struct uk_mbox *m)
+size_t uk_mbox_post_n_try(struct uk_mbox *m, void * const *msgs,
+			  size_t count)
 {
-	unsigned long irqf;
-	void *ret;
+	UK_ASSERT(msgs || !count);
 
-	uk_pr_debug("Receive message from mailbox %p\n", m);
-	irqf = ukplat_lcpu_save_irqf();
-	UK_ASSERT(m->readpos != m->writepos);
-	ret = m->msgs[m->readpos];
-	m->readpos = (m->readpos + 1) % m->len;
-	ukplat_lcpu_restore_irqf(irqf);
+	return _do_mbox_post(m, msgs, count, 0, 0);
+}
 
-	uk_semaphore_up(&m->writesem);
+size_t uk_mbox_post_n_to(struct uk_mbox *m, void * const *msgs,
+			 size_t count, __nsec timeout)
+{
+	UK_ASSERT(msgs || !count);
 
-	return ret;
+	return _do_mbox_post(m, msgs, count, 1, mbox_deadline(timeout));
 }
 
 /* Blocks the thread until a message arrives in the mailbox.
@@ -133,14 +255,7 @@ static inline void *_do_mbox_recv(struct uk_mbox *m)
  */
 void uk_mbox_recv(struct uk_mbox *m, void **msg)
 {
-	void *rmsg;
-
-	UK_ASSERT(m);
-
-	uk_semaphore_down(&m->readsem);
-	rmsg =  _do_mbox_recv(m);
-	if (msg)
-		*msg = rmsg;
+	_do_mbox_recv(m, msg, 1, 1, 0);
 }
 
 
@@ -157,16 +272,8 @@ void uk_mbox_recv(struct uk_mbox *m, void **msg)
  */
 int uk_mbox_recv_try(struct uk_mbox *m, void **msg)
 {
-	void *rmsg;
-
-	UK_ASSERT(m);
-
-	if (!uk_semaphore_down_try(&m->readsem))
+	if (!_do_mbox_recv(m, msg, 1, 0, 0))
 		return -ENOMSG;
-
-	rmsg =  _do_mbox_recv(m);
-	if (msg)
-		*msg = rmsg;
 	return 0;
 }
 
@@ -184,16 +291,34 @@ int uk_mbox_recv_try(struct uk_mbox *m, void **msg)
  */
 __nsec uk_mbox_recv_to(struct uk_mbox *m, void **msg, __nsec timeout)
 {
-	void *rmsg = NULL;
-	__nsec ret;
+	__nsec then = ukplat_monotonic_clock();
+
+	if (!_do_mbox_recv(m, msg, 1, 1, then + timeout)) {
+		if (msg)
+			*msg = NULL;
+		return __NSEC_MAX;
+	}
+	return ukplat_monotonic_clock() - then;
+}
+
+size_t uk_mbox_recv_n(struct uk_mbox *m, void **msgs, size_t count)
+{
+	UK_ASSERT(msgs || !count);
 
-	UK_ASSERT(m);
+	return _do_mbox_recv(m, msgs, count, 1, 0);
+}
 
-	ret = uk_semaphore_down_to(&m->readsem, timeout);
-	if (ret != __NSEC_MAX)
-		rmsg = _do_mbox_recv(m);
+size_t uk_mbox_recv_n_try(struct uk_mbox *m, void **msgs, size_t count)
+{
+	UK_ASSERT(msgs || !count);
+
+	return _do_mbox_recv(m, msgs, count, 0, 0);
+}
+
+size_t uk_mbox_recv_n_to(struct uk_mbox *m, void **msgs, size_t count,
+			 __nsec timeout)
+{
+	UK_ASSERT(msgs || !count);
 
-	if (msg)
-		*msg = rmsg;
-	return ret;
+	return _do_mbox_recv(m, msgs, count, 1, mbox_deadline(timeout));
 }
@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <uk/alloc.h>
+#include <uk/arch/atomic.h>
+#include <uk/essentials.h>
+#include <uk/mbox.h>
+#include <uk/plat/time.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+
+#define BENCH_PINGPONG_MSGS	100000
+#define BENCH_PIPE_MSGS		(1UL << 20)
+#define BENCH_PIPE_STAGES	3	/* mailboxes between the threads */
+#define BENCH_MBOX_SIZE		64
+#define BENCH_BATCH		32
+
+#define BENCH_MSG(i)		((void *)(uintptr_t)((i) + 1))
+
+static unsigned long bench_rate(unsigned long msgs, __nsec elapsed)
+{
+	return elapsed ? (unsigned long) (msgs * 1000000000ULL / elapsed) : 0;
+}
+
+/*
+ * Ping-pong: a message goes back and forth between two threads through two
+ * mailboxes.
+ */
+struct bench_pingpong {
+	struct uk_mbox *m[2];
+	int done;
+};
+
+static __noreturn void bench_pong_fn(void *arg)
+{
+	struct bench_pingpong *pp = (struct bench_pingpong *) arg;
+	unsigned long i;
+	void *msg;
+
+	for (i = 0; i < BENCH_PINGPONG_MSGS; i++) {
+		uk_mbox_recv(pp->m[0], &msg);
+		uk_mbox_post(pp->m[1], msg);
+	}
+
+	UK_WRITE_ONCE(pp->done, 1);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(ukmpi_mbox_benchsuite, ukmpi_bench_mbox_pingpong)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct bench_pingpong pp = { 0 };
+	unsigned long i, mismatches = 0;
+	__nsec start, elapsed;
+	void *msg;
+
+	pp.m[0] = uk_mbox_create(a, 1);
+	pp.m[1] = uk_mbox_create(a, 1);
+	UK_TEST_EXPECT_NOT_NULL(pp.m[0]);
+	UK_TEST_EXPECT_NOT_NULL(pp.m[1]);
+	UK_TEST_EXPECT_NOT_NULL(uk_sched_thread_create(uk_sched_current(),
+						       bench_pong_fn, &pp,
+						       "bench-mbox-pong"));
+
+	start = ukplat_monotonic_clock();
+	for (i = 0; i < BENCH_PINGPONG_MSGS; i++) {
+		uk_mbox_post(pp.m[0], BENCH_MSG(i));
+		uk_mbox_recv(pp.m[1], &msg);
+		if (msg != BENCH_MSG(i))
+			mismatches++;
+	}
+	elapsed = ukplat_monotonic_clock() - start;
+	UK_TEST_EXPECT_ZERO(mismatches);
+
+	while (!UK_READ_ONCE(pp.done))
+		uk_sched_yield();
+	uk_mbox_free(a, pp.m[0]);
+	uk_mbox_free(a, pp.m[1]);
+
+	uk_test_printf("mbox ping-pong: %lu round trips/s\n",
+		       bench_rate(BENCH_PINGPONG_MSGS, elapsed));
+}
+
+/*
+ * Pipeline: the test thread feeds messages through a chain of forwarding
+ * threads and mailboxes and receives them at the end. The messages are
+ * moved either one by one or in batches.
+ */
+struct bench_stage {
+	struct uk_mbox *in;
+	struct uk_mbox *out;
+	unsigned long batch;
+	int *done;
+};
+
+/* Moves BENCH_PIPE_MSGS messages from `in` to `out` */
+static void bench_forward(struct uk_mbox *in, struct uk_mbox *out,
+			  unsigned long batch)
+{
+	void *msgs[BENCH_BATCH];
+	unsigned long moved = 0;
+	size_t n;
+
+	while (moved < BENCH_PIPE_MSGS) {
+		if (batch == 1) {
+			uk_mbox_recv(in, &msgs[0]);
+			uk_mbox_post(out, msgs[0]);
+			n = 1;
+		} else {
+			n = uk_mbox_recv_n(in, msgs,
+					   MIN(batch, BENCH_PIPE_MSGS - moved));
+			uk_mbox_post_n(out, msgs, n);
+		}
+		moved += n;
+	}
+}
+
+static __noreturn void bench_stage_fn(void *arg)
+{
+	struct bench_stage *st = (struct bench_stage *) arg;
+
+	bench_forward(st->in, st->out, st->batch);
+	ukarch_inc(st->done);
+	uk_sched_thread_exit();
+}
+
+static __noreturn void bench_source_fn(void *arg)
+{
+	struct bench_stage *st = (struct bench_stage *) arg;
+	void *msgs[BENCH_BATCH];
+	unsigned long i, j, n;
+
+	for (i = 0; i < BENCH_PIPE_MSGS; i += n) {
+		n = MIN(st->batch, BENCH_PIPE_MSGS - i);
+		for (j = 0; j < n; j++)
+			msgs[j] = BENCH_MSG(i + j);
+		if (n == 1)
+			uk_mbox_post(st->out, msgs[0]);
+		else
+			uk_mbox_post_n(st->out, msgs, n);
+	}
+
+	ukarch_inc(st->done);
+	uk_sched_thread_exit();
+}
+
+/* Returns the throughput of the pipeline in messages/s */
+static unsigned long bench_pipeline_run(unsigned long batch)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct uk_mbox *m[BENCH_PIPE_STAGES] = { NULL };
+	struct bench_stage st[BENCH_PIPE_STAGES];
+	struct uk_thread *t;
+	__nsec start, elapsed = 0;
+	unsigned long rate = 0;
+	void *msgs[BENCH_BATCH];
+	unsigned long recvd = 0, expected = 0;
+	int done = 0, ok = 1;
+	unsigned int i;
+	size_t n, j;
+
+	for (i = 0; i < BENCH_PIPE_STAGES; i++) {
+		m[i] = uk_mbox_create(a, BENCH_MBOX_SIZE);
+		if (!m[i])
+			goto out;
+	}
+
+	start = ukplat_monotonic_clock();
+	/* The source feeds m[0], stage i forwards from m[i - 1] to m[i] */
+	for (i = 0; i < BENCH_PIPE_STAGES; i++) {
+		st[i] = (struct bench_stage) {
+			.in = i ? m[i - 1] : NULL,
+			.out = m[i],
+			.batch = batch,
+			.done = &done,
+		};
+		t = uk_sched_thread_create(uk_sched_current(),
+					   i ? bench_stage_fn
+					     : bench_source_fn,
+					   &st[i], "bench-mbox-stage");
+		/* The started threads still use the mailboxes */
+		if (!t)
+			return 0;
+	}
+
+	while (recvd < BENCH_PIPE_MSGS) {
+		n = uk_mbox_recv_n(m[BENCH_PIPE_STAGES - 1], msgs,
+				   MIN(batch, BENCH_PIPE_MSGS - recvd));
+		for (j = 0; j < n; j++)
+			if (msgs[j] != BENCH_MSG(expected++))
+				ok = 0;
+		recvd += n;
+	}
+	elapsed = ukplat_monotonic_clock() - start;
+
+	while (UK_READ_ONCE(done) < BENCH_PIPE_STAGES)
+		uk_sched_yield();
+	if (ok)
+		rate = bench_rate(BENCH_PIPE_MSGS, elapsed);
+
+out:
+	for (i = 0; i < BENCH_PIPE_STAGES; i++)
+		if (m[i])
+			uk_mbox_free(a, m[i]);
+	return rate;
+}
+
+UK_TESTCASE(ukmpi_mbox_benchsuite, ukmpi_bench_mbox_pipeline)
+{
+	unsigned long single, batched;
+
+	single = bench_pipeline_run(1);
+	UK_TEST_EXPECT_NOT_ZERO(single);
+	batched = bench_pipeline_run(BENCH_BATCH);
+	UK_TEST_EXPECT_NOT_ZERO(batched);
+
+	uk_test_printf("mbox pipeline, %u stages: %lu msgs/s one by one, "
+		       "%lu msgs/s in batches of %u\n",
+		       BENCH_PIPE_STAGES, single, batched, BENCH_BATCH);
+}
+
+uk_testsuite_register(ukmpi_mbox_benchsuite, NULL);
@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <uk/alloc.h>
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/mbox.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+
+#define MBOX_SIZE		4
+#define MBOX_STREAM_MSGS	64
+#define MBOX_STREAM_BATCH	3
+
+#define MBOX_MSG(i)		((void *)(uintptr_t)(i))
+
+UK_TESTCASE(ukmpi_mbox_testsuite, ukmpi_test_mbox_batch_partial)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	void *in[MBOX_SIZE + 2], *out[MBOX_SIZE + 2];
+	struct uk_mbox *m;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(in); i++)
+		in[i] = MBOX_MSG(i + 1);
+
+	m = uk_mbox_create(a, MBOX_SIZE);
+	UK_TEST_EXPECT_NOT_NULL(m);
+
+	/* Posting stops when the mailbox is full... */
+	UK_TEST_EXPECT_SNUM_EQ(uk_mbox_post_n_try(m, in, ARRAY_SIZE(in)),
+			       MBOX_SIZE);
+	UK_TEST_EXPECT_ZERO(uk_mbox_post_n_try(m, in, 1));
+	/* ...also after waiting for room in vain */
+	UK_TEST_EXPECT_ZERO(uk_mbox_post_n_to(m, in, 2,
+					      ukarch_time_msec_to_nsec(1)));
+
+	UK_TEST_EXPECT_SNUM_EQ(uk_mbox_recv_n_try(m, out, 1), 1);
+	UK_TEST_EXPECT_PTR_EQ(out[0], in[0]);
+
+	/* A timed post returns the messages that fit */
+	UK_TEST_EXPECT_SNUM_EQ(uk_mbox_post_n_to(m, &in[MBOX_SIZE], 2,
+						 ukarch_time_msec_to_nsec(1)),
+			       1);
+
+	/* Receiving returns what is there, in order */
+	UK_TEST_EXPECT_SNUM_EQ(uk_mbox_recv_n_try(m, out, ARRAY_SIZE(out)),
+			       MBOX_SIZE);
+	for (i = 0; i < MBOX_SIZE; i++)
+		UK_TEST_EXPECT_PTR_EQ(out[i], in[i + 1]);
+
+	/* and nothing if the mailbox is empty */
+	UK_TEST_EXPECT_ZERO(uk_mbox_recv_n_try(m, out, ARRAY_SIZE(out)));
+	UK_TEST_EXPECT_ZERO(uk_mbox_recv_n_to(m, out, ARRAY_SIZE(out),
+					      ukarch_time_msec_to_nsec(1)));
+
+	/* A blocking receive returns as soon as there is one message */
+	UK_TEST_EXPECT_SNUM_EQ(uk_mbox_post_n(m, in, 2), 2);
+	UK_TEST_EXPECT_SNUM_EQ(uk_mbox_recv_n(m, out, ARRAY_SIZE(out)), 2);
+	UK_TEST_EXPECT_PTR_EQ(out[0], in[0]);
+	UK_TEST_EXPECT_PTR_EQ(out[1], in[1]);
+
+	/* Single and batched operations share the mailbox */
+	UK_TEST_EXPECT_ZERO(uk_mbox_post_try(m, in[0]));
+	UK_TEST_EXPECT_SNUM_EQ(uk_mbox_post_n_try(m, &in[1], 2), 2);
+	UK_TEST_EXPECT_SNUM_EQ(uk_mbox_recv_n_try(m, out, 2), 2);
+	UK_TEST_EXPECT_ZERO(uk_mbox_recv_try(m, &out[2]));
+	for (i = 0; i < 3; i++)
+		UK_TEST_EXPECT_PTR_EQ(out[i], in[i]);
+
+	uk_mbox_free(a, m);
+}
+
+struct mbox_stream {
+	struct uk_mbox *m;
+	unsigned int received;
+	unsigned int errors;
+	int done;
+};
+
+static __noreturn void mbox_stream_receiver(void *arg)
+{
+	struct mbox_stream *s = (struct mbox_stream *) arg;
+	void *msgs[MBOX_STREAM_BATCH];
+	size_t i, n;
+
+	while (s->received < MBOX_STREAM_MSGS) {
+		n = uk_mbox_recv_n(s->m, msgs, ARRAY_SIZE(msgs));
+		if (!n)
+			s->errors++;
+		for (i = 0; i < n; i++)
+			if (msgs[i] != MBOX_MSG(++s->received))
+				s->errors++;
+	}
+
+	UK_WRITE_ONCE(s->done, 1);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(ukmpi_mbox_testsuite, ukmpi_test_mbox_batch_stream)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct mbox_stream s = { 0 };
+	void *msgs[MBOX_STREAM_MSGS];
+	struct uk_thread *t;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(msgs); i++)
+		msgs[i] = MBOX_MSG(i + 1);
+
+	s.m = uk_mbox_create(a, MBOX_SIZE);
+	UK_TEST_EXPECT_NOT_NULL(s.m);
+
+	t = uk_sched_thread_create(uk_sched_current(), mbox_stream_receiver,
+				   &s, "test-mbox-receiver");
+	UK_TEST_EXPECT_NOT_NULL(t);
+
+	/* The batch is larger than the mailbox: the sender has to wait
+	 * for the receiver several times
+	 */
+	UK_TEST_EXPECT_SNUM_EQ(uk_mbox_post_n(s.m, msgs, ARRAY_SIZE(msgs)),
+			       MBOX_STREAM_MSGS);
+
+	while (!UK_READ_ONCE(s.done))
+		uk_sched_yield();
+	UK_TEST_EXPECT_SNUM_EQ(s.received, MBOX_STREAM_MSGS);
+	UK_TEST_EXPECT_ZERO(s.errors);
+
+	uk_mbox_free(a, s.m);
+}
+
+uk_testsuite_register(ukmpi_mbox_testsuite, NULL);
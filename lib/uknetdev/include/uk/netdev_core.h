@@ -46,6 +46,8 @@
 #ifdef CONFIG_LIBUKNETDEV_DISPATCHERTHREADS
 #include <uk/sched.h>
 #include <uk/semaphore.h>
+#elif defined(CONFIG_LIBUKNETDEV_DISPATCH_WORK)
+#include <uk/work.h>
 #endif
 
 /**
@@ -416,6 +418,10 @@ struct uk_netdev_event_handler {
 	struct uk_thread    *dispatcher; /**< dispatcher thread */
 	char                *dispatcher_name; /**< reference to thread name */
 	struct uk_sched     *dispatcher_s;    /**< Scheduler for dispatcher. */
+#elif defined(CONFIG_LIBUKNETDEV_DISPATCH_WORK)
+	struct uk_work      work;        /**< deferred callback */
+	struct uk_netdev    *dev;        /**< reference to net device */
+	uint16_t            queue_id;    /**< queue id which caused event */
 #endif
 };
 
@@ -87,6 +87,9 @@ static inline void uk_netdev_drv_rx_event(struct uk_netdev *dev,
 
 #ifdef CONFIG_LIBUKNETDEV_DISPATCHERTHREADS
 	uk_semaphore_up(&rxq_handler->events);
+#elif defined(CONFIG_LIBUKNETDEV_DISPATCH_WORK)
+	if (rxq_handler->callback)
+		uk_work_schedule(&rxq_handler->work);
 #else
 	if (rxq_handler->callback)
 		rxq_handler->callback(dev, queue_id, rxq_handler->cookie);
@@ -349,6 +349,17 @@ static void _dispatcher(void *arg)
 				  handler->cookie);
 	}
 }
+#elif defined(CONFIG_LIBUKNETDEV_DISPATCH_WORK)
+static void _dispatch_work(struct uk_work *work __unused, void *arg)
+{
+	struct uk_netdev_event_handler *handler =
+		(struct uk_netdev_event_handler *) arg;
+
+	UK_ASSERT(handler);
+	UK_ASSERT(handler->callback);
+
+	handler->callback(handler->dev, handler->queue_id, handler->cookie);
+}
 #endif
 
 static int _create_event_handler(uk_netdev_queue_event_t callback,
@@ -357,6 +368,8 @@ static int _create_event_handler(uk_netdev_queue_event_t callback,
 				 struct uk_netdev *dev, uint16_t queue_id,
 				 const char *queue_type_str,
 				 struct uk_sched *s,
+#elif defined(CONFIG_LIBUKNETDEV_DISPATCH_WORK)
+				 struct uk_netdev *dev, uint16_t queue_id,
 #endif
 				 struct uk_netdev_event_handler *h)
 {
@@ -397,6 +410,10 @@ static int _create_event_handler(uk_netdev_queue_event_t callback,
 		h->dispatcher_name = NULL;
 		return -ENOMEM;
 	}
+#elif defined(CONFIG_LIBUKNETDEV_DISPATCH_WORK)
+	h->dev = dev;
+	h->queue_id = queue_id;
+	uk_work_init(&h->work, _dispatch_work, h);
 #endif
 
 	return 0;
@@ -418,6 +435,9 @@ static void _destroy_event_handler(struct uk_netdev_event_handler *h
 	if (h->dispatcher_name)
 		free(h->dispatcher_name);
 	h->dispatcher_name = NULL;
+#elif defined(CONFIG_LIBUKNETDEV_DISPATCH_WORK)
+	if (h->callback)
+		uk_work_cancel_sync(&h->work);
 #endif
 }
 
@@ -449,6 +469,8 @@ int uk_netdev_rxq_configure(struct uk_netdev *dev, uint16_t queue_id,
 	err = _create_event_handler(rx_conf->callback, rx_conf->callback_cookie,
 #ifdef CONFIG_LIBUKNETDEV_DISPATCHERTHREADS
 				    dev, queue_id, "rxq", rx_conf->s,
+#elif defined(CONFIG_LIBUKNETDEV_DISPATCH_WORK)
+				    dev, queue_id,
 #endif
 				    &dev->_data->rxq_handler[queue_id]);
 	if (err)
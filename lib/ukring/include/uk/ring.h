@@ -45,6 +45,9 @@
 #define critical_enter()  uk_preempt_disable()
 #define critical_exit()   uk_preempt_enable()
 
+#define __uk_ring_cas(ptr, old, new)					\
+	__atomic_compare_exchange_n((uint32_t *)(ptr), &(old), (new), 0,	\
+				    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)
 
 struct uk_ring {
 	volatile uint32_t br_prod_head;
@@ -52,14 +55,17 @@ struct uk_ring {
 	int               br_prod_size;
 	int               br_prod_mask;
 	uint64_t          br_drops;
-	volatile uint32_t br_cons_head __aligned(CACHE_LINE_SIZE);
+	/* Consumer state lives on its own cache line so that producers
+	 * and consumers do not invalidate each other's indices
+	 */
+	volatile uint32_t br_cons_head __align(CACHE_LINE_SIZE);
 	volatile uint32_t br_cons_tail;
 	int               br_cons_size;
 	int               br_cons_mask;
 #ifdef DEBUG_BUFRING
 	struct uk_mutex  *br_lock;
 #endif
-	void             *br_ring[0] __aligned(CACHE_LINE_SIZE);
+	void             *br_ring[0] __align(CACHE_LINE_SIZE);
 };
 
 /*
@@ -99,8 +105,7 @@ uk_ring_enqueue(struct uk_ring *br, void *buf)
 			}
 			continue;
 		}
-	} while (!ukarch_compare_exchange_sync((uint32_t *) &br->br_prod_head,
-			prod_head, prod_next));
+	} while (!__uk_ring_cas(&br->br_prod_head, prod_head, prod_next));
 
 #ifdef DEBUG_BUFRING
 	if (br->br_ring[prod_head] != NULL)
@@ -139,8 +144,7 @@ uk_ring_dequeue_mc(struct uk_ring *br)
 			critical_exit();
 			return NULL;
 		}
-	} while (!ukarch_compare_exchange_sync((uint32_t *) &br->br_cons_head,
-			cons_head, cons_next));
+	} while (!__uk_ring_cas(&br->br_cons_head, cons_head, cons_next));
 
 	buf = br->br_ring[cons_head];
 #ifdef DEBUG_BUFRING
@@ -236,6 +240,166 @@ uk_ring_dequeue_sc(struct uk_ring *br)
 	return buf;
 }
 
+/*
+ * Bulk operations
+ *
+ * The following functions move up to `n` entries at once and return the
+ * number of entries that were actually moved, which is less than `n` if
+ * the ring runs full or empty. The indices are claimed and published only
+ * once per call, so the cost of the atomic operations and barriers is
+ * shared by all entries of a batch.
+ * The single-producer (`_sp`) and single-consumer (`_sc`) variants skip
+ * the compare-and-swap and must be serialized by the caller, e.g., by a
+ * lock or because only one thread uses that end of the ring.
+ * Failed bulk enqueues are not accounted in `br_drops`: the caller keeps
+ * the remaining entries.
+ */
+static __inline unsigned int
+__uk_ring_enqueue_n(struct uk_ring *br, void * const *bufs, unsigned int n,
+		    int single)
+{
+	uint32_t prod_head, prod_next, cons_tail, free;
+	unsigned int i;
+
+	if (!single)
+		critical_enter();
+	do {
+		prod_head = br->br_prod_head;
+		cons_tail = __atomic_load_n(&br->br_cons_tail, __ATOMIC_ACQUIRE);
+
+		free = (cons_tail - prod_head - 1) & br->br_prod_mask;
+		if (n > free)
+			n = free;
+		if (n == 0) {
+			if (!single)
+				critical_exit();
+			return 0;
+		}
+
+		prod_next = (prod_head + n) & br->br_prod_mask;
+		if (single) {
+			br->br_prod_head = prod_next;
+			break;
+		}
+	} while (!__uk_ring_cas(&br->br_prod_head, prod_head, prod_next));
+
+	for (i = 0; i < n; i++) {
+#ifdef DEBUG_BUFRING
+		if (br->br_ring[(prod_head + i) & br->br_prod_mask] != NULL)
+			UK_CRASH("dangling value in enqueue");
+#endif
+		br->br_ring[(prod_head + i) & br->br_prod_mask] = bufs[i];
+	}
+
+	if (!single) {
+		/* Wait for preceding enqueues to complete */
+		while (br->br_prod_tail != prod_head)
+			ukarch_spinwait();
+	}
+	__atomic_store_n(&br->br_prod_tail, prod_next, __ATOMIC_RELEASE);
+	if (!single)
+		critical_exit();
+
+	return n;
+}
+
+static __inline unsigned int
+__uk_ring_dequeue_n(struct uk_ring *br, void **bufs, unsigned int n,
+		    int single)
+{
+	uint32_t cons_head, cons_next, prod_tail, avail;
+	unsigned int i;
+
+	if (!single)
+		critical_enter();
+	do {
+		cons_head = br->br_cons_head;
+		prod_tail = __atomic_load_n(&br->br_prod_tail, __ATOMIC_ACQUIRE);
+
+		avail = (prod_tail - cons_head) & br->br_cons_mask;
+		if (n > avail)
+			n = avail;
+		if (n == 0) {
+			if (!single)
+				critical_exit();
+			return 0;
+		}
+
+		cons_next = (cons_head + n) & br->br_cons_mask;
+		if (single) {
+			br->br_cons_head = cons_next;
+			break;
+		}
+	} while (!__uk_ring_cas(&br->br_cons_head, cons_head, cons_next));
+
+	for (i = 0; i < n; i++) {
+		bufs[i] = br->br_ring[(cons_head + i) & br->br_cons_mask];
+#ifdef DEBUG_BUFRING
+		br->br_ring[(cons_head + i) & br->br_cons_mask] = NULL;
+#endif
+	}
+
+	if (!single) {
+		/* Wait for preceding dequeues to complete */
+		while (br->br_cons_tail != cons_head)
+			ukarch_spinwait();
+	}
+	__atomic_store_n(&br->br_cons_tail, cons_next, __ATOMIC_RELEASE);
+	if (!single)
+		critical_exit();
+
+	return n;
+}
+
+/*
+ * multi-producer safe bulk enqueue
+ */
+static __inline unsigned int
+uk_ring_enqueue_n(struct uk_ring *br, void * const *bufs, unsigned int n)
+{
+	return __uk_ring_enqueue_n(br, bufs, n, 0);
+}
+
+/*
+ * single-producer bulk enqueue
+ */
+static __inline unsigned int
+uk_ring_enqueue_n_sp(struct uk_ring *br, void * const *bufs, unsigned int n)
+{
+	return __uk_ring_enqueue_n(br, bufs, n, 1);
+}
+
+/*
+ * single-producer enqueue
+ */
+static __inline int
+uk_ring_enqueue_sp(struct uk_ring *br, void *buf)
+{
+	if (__uk_ring_enqueue_n(br, &buf, 1, 1) == 0) {
+		br->br_drops++;
+		return -ENOBUFS;
+	}
+	return 0;
+}
+
+/*
+ * multi-consumer safe bulk dequeue
+ */
+static __inline unsigned int
+uk_ring_dequeue_n_mc(struct uk_ring *br, void **bufs, unsigned int n)
+{
+	return __uk_ring_dequeue_n(br, bufs, n, 0);
+}
+
+/*
+ * single-consumer bulk dequeue
+ */
+static __inline unsigned int
+uk_ring_dequeue_n_sc(struct uk_ring *br, void **bufs, unsigned int n)
+{
+	return __uk_ring_dequeue_n(br, bufs, n, 1);
+}
+
 /*
  * single-consumer advance after a peek
  * use where it is protected by a lock
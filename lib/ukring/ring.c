@@ -46,7 +46,9 @@ uk_ring_alloc(int count, struct uk_alloc *a
 	/* buf ring must be size power of 2 */
 	UK_ASSERT(POWER_OF_2(count));
 
-	br = uk_malloc(a, sizeof(struct uk_ring) + count * sizeof(caddr_t));
+	/* The producer and consumer indices are on separate cache lines */
+	br = uk_memalign(a, CACHE_LINE_SIZE,
+			 sizeof(struct uk_ring) + count * sizeof(void *));
 	if (br == NULL)
 		return NULL;
 #ifdef DEBUG_BUFRING
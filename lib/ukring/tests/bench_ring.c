@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <uk/alloc.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/ring.h>
+#include <uk/test.h>
+
+#define RING_BENCH_SIZE		1024
+#define RING_BENCH_ITEMS	(1UL << 20)
+
+static struct uk_ring *ring_alloc(int count)
+{
+	return uk_ring_alloc(count, uk_alloc_get_default()
+#ifdef DEBUG_BUFRING
+			     , NULL
+#endif
+			     );
+}
+
+static void ring_free(struct uk_ring *br)
+{
+	uk_ring_free(br, uk_alloc_get_default());
+}
+
+/*
+ * Moves RING_BENCH_ITEMS entries through the ring in batches. Returns the
+ * time per entry and the longest time for a batch in nanoseconds.
+ */
+static unsigned long ring_bench_run(struct uk_ring *br, unsigned int batch,
+				    int single, __nsec *max_lat)
+{
+	void *bufs[RING_BENCH_SIZE / 2] = { NULL };
+	unsigned long moved = 0;
+	__nsec start, t0, t1;
+	unsigned int n;
+
+	*max_lat = 0;
+	start = ukplat_monotonic_clock();
+	while (moved < RING_BENCH_ITEMS) {
+		t0 = ukplat_monotonic_clock();
+		if (single) {
+			n = uk_ring_enqueue_n_sp(br, bufs, batch);
+			n = uk_ring_dequeue_n_sc(br, bufs, n);
+		} else {
+			n = uk_ring_enqueue_n(br, bufs, batch);
+			n = uk_ring_dequeue_n_mc(br, bufs, n);
+		}
+		t1 = ukplat_monotonic_clock();
+
+		if (t1 - t0 > *max_lat)
+			*max_lat = t1 - t0;
+		moved += n;
+	}
+
+	return (unsigned long) ((ukplat_monotonic_clock() - start) / moved);
+}
+
+UK_TESTCASE(ukring_benchsuite, ukring_bench_batch)
+{
+	static const unsigned int batches[] = { 1, 8, 32, 128 };
+	struct uk_ring *br;
+	unsigned long sp_ns, mp_ns;
+	__nsec sp_lat, mp_lat;
+	unsigned int i;
+
+	br = ring_alloc(RING_BENCH_SIZE);
+	UK_TEST_EXPECT_NOT_NULL(br);
+
+	for (i = 0; i < ARRAY_SIZE(batches); i++) {
+		sp_ns = ring_bench_run(br, batches[i], 1, &sp_lat);
+		mp_ns = ring_bench_run(br, batches[i], 0, &mp_lat);
+		UK_TEST_EXPECT_NOT_ZERO(uk_ring_empty(br));
+
+		uk_test_printf("ring: batch %3u: sp/sc %lu ns/entry "
+			       "(max %lu ns/batch), mp/mc %lu ns/entry "
+			       "(max %lu ns/batch)\n",
+			       batches[i], sp_ns, (unsigned long) sp_lat,
+			       mp_ns, (unsigned long) mp_lat);
+	}
+
+	ring_free(br);
+}
+
+uk_testsuite_register(ukring_benchsuite, NULL);
@@ -0,0 +1,303 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <uk/alloc.h>
+#include <uk/arch/atomic.h>
+#include <uk/essentials.h>
+#include <uk/ring.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+
+#define RING_SIZE		8	/* Holds RING_SIZE - 1 entries */
+
+#define RING_STRESS_SIZE	64
+#define RING_STRESS_THREADS	2
+#define RING_STRESS_ITEMS	10000
+#define RING_STRESS_BATCH	5
+
+#define RING_VAL(i)		((void *)(uintptr_t)(i))
+
+static struct uk_ring *ring_alloc(int count)
+{
+	return uk_ring_alloc(count, uk_alloc_get_default()
+#ifdef DEBUG_BUFRING
+			     , NULL
+#endif
+			     );
+}
+
+static void ring_free(struct uk_ring *br)
+{
+	uk_ring_free(br, uk_alloc_get_default());
+}
+
+UK_TESTCASE(ukring_testsuite, ukring_test_single)
+{
+	struct uk_ring *br;
+	uintptr_t i;
+
+	br = ring_alloc(RING_SIZE);
+	UK_TEST_EXPECT_NOT_NULL(br);
+	UK_TEST_EXPECT_NOT_ZERO(uk_ring_empty(br));
+
+	for (i = 1; i < RING_SIZE; i++)
+		UK_TEST_EXPECT_ZERO(uk_ring_enqueue(br, RING_VAL(i)));
+	UK_TEST_EXPECT_NOT_ZERO(uk_ring_full(br));
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_count(br), RING_SIZE - 1);
+
+	/* A full ring drops and counts the entry */
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_enqueue(br, RING_VAL(i)), -ENOBUFS);
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_enqueue_sp(br, RING_VAL(i)), -ENOBUFS);
+	UK_TEST_EXPECT_SNUM_EQ(br->br_drops, 2);
+
+	UK_TEST_EXPECT_PTR_EQ(uk_ring_peek(br), RING_VAL(1));
+	UK_TEST_EXPECT_PTR_EQ(uk_ring_dequeue_mc(br), RING_VAL(1));
+	UK_TEST_EXPECT_PTR_EQ(uk_ring_dequeue_sc(br), RING_VAL(2));
+	UK_TEST_EXPECT_ZERO(uk_ring_enqueue_sp(br, RING_VAL(RING_SIZE)));
+
+	for (i = 3; i <= RING_SIZE; i++)
+		UK_TEST_EXPECT_PTR_EQ(uk_ring_dequeue_mc(br), RING_VAL(i));
+	UK_TEST_EXPECT_NULL(uk_ring_dequeue_mc(br));
+	UK_TEST_EXPECT_NULL(uk_ring_dequeue_sc(br));
+
+	ring_free(br);
+}
+
+UK_TESTCASE(ukring_testsuite, ukring_test_bulk_partial)
+{
+	void *in[RING_SIZE + 2], *out[RING_SIZE + 2];
+	struct uk_ring *br;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(in); i++)
+		in[i] = RING_VAL(i + 1);
+
+	br = ring_alloc(RING_SIZE);
+	UK_TEST_EXPECT_NOT_NULL(br);
+
+	/* Bulk operations move as many entries as fit... */
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_enqueue_n(br, in, ARRAY_SIZE(in)),
+			       RING_SIZE - 1);
+	UK_TEST_EXPECT_ZERO(uk_ring_enqueue_n(br, in, 1));
+	UK_TEST_EXPECT_ZERO(uk_ring_enqueue_n_sp(br, in, 1));
+	/* ...without accounting drops */
+	UK_TEST_EXPECT_ZERO(br->br_drops);
+
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_dequeue_n_sc(br, out, 3), 3);
+	for (i = 0; i < 3; i++)
+		UK_TEST_EXPECT_PTR_EQ(out[i], in[i]);
+
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_enqueue_n_sp(br, &in[RING_SIZE - 1], 3),
+			       3);
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_count(br), RING_SIZE - 1);
+
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_dequeue_n_mc(br, out, ARRAY_SIZE(out)),
+			       RING_SIZE - 1);
+	for (i = 0; i < RING_SIZE - 1; i++)
+		UK_TEST_EXPECT_PTR_EQ(out[i], in[i + 3]);
+
+	UK_TEST_EXPECT_ZERO(uk_ring_dequeue_n_mc(br, out, 1));
+	UK_TEST_EXPECT_ZERO(uk_ring_dequeue_n_sc(br, out, 1));
+
+	ring_free(br);
+}
+
+UK_TESTCASE(ukring_testsuite, ukring_test_wrap)
+{
+	void *in[RING_SIZE], *out[RING_SIZE];
+	struct uk_ring *br;
+	uintptr_t next_in = 1, next_out = 1;
+	unsigned int round, i, n, m;
+
+	br = ring_alloc(RING_SIZE);
+	UK_TEST_EXPECT_NOT_NULL(br);
+
+	/* Batches of varying sizes that straddle the end of the ring */
+	for (round = 0; round < 10 * RING_SIZE; round++) {
+		n = 1 + round % (RING_SIZE - 1);
+		for (i = 0; i < n; i++)
+			in[i] = RING_VAL(next_in + i);
+
+		if (round & 1)
+			m = uk_ring_enqueue_n(br, in, n);
+		else
+			m = uk_ring_enqueue_n_sp(br, in, n);
+		next_in += m;
+
+		if (round & 2)
+			m = uk_ring_dequeue_n_mc(br, out, n);
+		else
+			m = uk_ring_dequeue_n_sc(br, out, n);
+		for (i = 0; i < m; i++)
+			UK_TEST_EXPECT_PTR_EQ(out[i], RING_VAL(next_out + i));
+		next_out += m;
+	}
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_count(br), next_in - next_out);
+
+	ring_free(br);
+}
+
+/*
+ * The multi-producer enqueue and multi-consumer dequeue used to take a
+ * compare-and-swap that wrapped an index around to 0 for a failed one and
+ * claimed the same slots a second time.
+ */
+UK_TESTCASE(ukring_testsuite, ukring_test_wrap_to_zero)
+{
+	void *bufs[RING_SIZE];
+	struct uk_ring *br;
+	unsigned int i;
+
+	br = ring_alloc(RING_SIZE);
+	UK_TEST_EXPECT_NOT_NULL(br);
+
+	/* Move the indices to the last slot */
+	for (i = 0; i < RING_SIZE - 1; i++) {
+		UK_TEST_EXPECT_ZERO(uk_ring_enqueue(br, RING_VAL(i + 1)));
+		UK_TEST_EXPECT_PTR_EQ(uk_ring_dequeue_mc(br), RING_VAL(i + 1));
+	}
+	UK_TEST_EXPECT_SNUM_EQ(br->br_prod_head, RING_SIZE - 1);
+
+	/* Single entries wrap the indices to 0 */
+	UK_TEST_EXPECT_ZERO(uk_ring_enqueue(br, RING_VAL(1)));
+	UK_TEST_EXPECT_ZERO(br->br_prod_head);
+	UK_TEST_EXPECT_ZERO(br->br_prod_tail);
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_count(br), 1);
+	UK_TEST_EXPECT_PTR_EQ(uk_ring_dequeue_mc(br), RING_VAL(1));
+	UK_TEST_EXPECT_ZERO(br->br_cons_head);
+	UK_TEST_EXPECT_ZERO(br->br_cons_tail);
+	UK_TEST_EXPECT_NOT_ZERO(uk_ring_empty(br));
+
+	/* So do batches that end at the last slot */
+	for (i = 0; i < RING_SIZE - 1; i++)
+		bufs[i] = RING_VAL(i + 1);
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_enqueue_n(br, bufs, RING_SIZE - 2),
+			       RING_SIZE - 2);
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_dequeue_n_mc(br, bufs, RING_SIZE - 2),
+			       RING_SIZE - 2);
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_enqueue_n(br, bufs, 2), 2);
+	UK_TEST_EXPECT_ZERO(br->br_prod_tail);
+	UK_TEST_EXPECT_SNUM_EQ(uk_ring_dequeue_n_mc(br, bufs, RING_SIZE), 2);
+	UK_TEST_EXPECT_ZERO(br->br_cons_tail);
+	UK_TEST_EXPECT_NOT_ZERO(uk_ring_empty(br));
+
+	ring_free(br);
+}
+
+struct ring_stress {
+	struct uk_ring *br;
+	unsigned long sum;
+	unsigned long count;
+	unsigned int producers;
+	unsigned int done;
+};
+
+static __noreturn void ring_stress_producer(void *arg)
+{
+	struct ring_stress *s = (struct ring_stress *) arg;
+	void *bufs[RING_STRESS_BATCH];
+	uintptr_t next = 1;
+	unsigned int i, n;
+
+	while (next <= RING_STRESS_ITEMS) {
+		n = MIN(RING_STRESS_BATCH, RING_STRESS_ITEMS - next + 1);
+		for (i = 0; i < n; i++)
+			bufs[i] = RING_VAL(next + i);
+
+		next += uk_ring_enqueue_n(s->br, bufs, n);
+		uk_sched_yield();
+	}
+
+	ukarch_dec(&s->producers);
+	ukarch_inc(&s->done);
+	uk_sched_thread_exit();
+}
+
+static __noreturn void ring_stress_consumer(void *arg)
+{
+	struct ring_stress *s = (struct ring_stress *) arg;
+	void *bufs[RING_STRESS_BATCH];
+	unsigned int i, n;
+
+	for (;;) {
+		n = uk_ring_dequeue_n_mc(s->br, bufs, ARRAY_SIZE(bufs));
+		if (!n) {
+			if (!UK_READ_ONCE(s->producers) &&
+			    uk_ring_empty(s->br))
+				break;
+			uk_sched_yield();
+			continue;
+		}
+
+		for (i = 0; i < n; i++)
+			ukarch_fetch_add(&s->sum, (uintptr_t) bufs[i]);
+		ukarch_fetch_add(&s->count, n);
+	}
+
+	ukarch_inc(&s->done);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(ukring_testsuite, ukring_test_mpmc)
+{
+	const unsigned long sum = (unsigned long) RING_STRESS_ITEMS
+				  * (RING_STRESS_ITEMS + 1) / 2;
+	struct ring_stress s = { .producers = RING_STRESS_THREADS };
+	struct uk_thread *t;
+	unsigned int i;
+
+	s.br = ring_alloc(RING_STRESS_SIZE);
+	UK_TEST_EXPECT_NOT_NULL(s.br);
+
+	for (i = 0; i < RING_STRESS_THREADS; i++) {
+		t = uk_sched_thread_create(uk_sched_current(),
+					   ring_stress_producer, &s,
+					   "test-ring-producer");
+		UK_TEST_EXPECT_NOT_NULL(t);
+		t = uk_sched_thread_create(uk_sched_current(),
+					   ring_stress_consumer, &s,
+					   "test-ring-consumer");
+		UK_TEST_EXPECT_NOT_NULL(t);
+	}
+	while (UK_READ_ONCE(s.done) < 2 * RING_STRESS_THREADS)
+		uk_sched_yield();
+
+	/* Every entry was dequeued exactly once */
+	UK_TEST_EXPECT_SNUM_EQ(s.count,
+			       RING_STRESS_THREADS * RING_STRESS_ITEMS);
+	UK_TEST_EXPECT_SNUM_EQ(s.sum, RING_STRESS_THREADS * sum);
+
+	ring_free(s.br);
+}
+
+uk_testsuite_register(ukring_testsuite, NULL);
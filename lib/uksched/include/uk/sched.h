@@ -39,6 +39,7 @@
 #include <uk/assert.h>
 #include <uk/arch/types.h>
 #include <uk/essentials.h>
+#include <uk/bitops.h>
 #include <errno.h>
 
 #ifdef __cplusplus
@@ -74,6 +75,10 @@ typedef void  (*uk_sched_thread_blocked_func_t)
 typedef void  (*uk_sched_thread_wokeup_func_t)
 		(struct uk_sched *s, struct uk_thread *t);
 
+typedef int   (*uk_sched_thread_set_affinity_func_t)
+		(struct uk_sched *s, struct uk_thread *t,
+		 const unsigned long *lcpus);
+
 typedef int   (*uk_sched_start_t)(struct uk_sched *s, struct uk_thread *main);
 
 struct uk_sched {
@@ -83,11 +88,15 @@ struct uk_sched {
 	uk_sched_thread_remove_func_t   thread_remove;
 	uk_sched_thread_blocked_func_t  thread_blocked;
 	uk_sched_thread_wokeup_func_t   thread_wokeup;
+	uk_sched_thread_set_affinity_func_t thread_set_affinity; /* optional */
 
 	uk_sched_start_t sched_start;
 
 	/* internal */
 	bool is_started;
+#if CONFIG_HAVE_SMP
+	__spinlock lock;          /**< protects thread_list, exited_threads */
+#endif /* CONFIG_HAVE_SMP */
 	struct uk_thread_list thread_list;
 	struct uk_thread_list exited_threads;
 	struct uk_alloc *a;       /**< default allocator for struct uk_thread */
@@ -152,6 +161,7 @@ static inline void uk_sched_thread_wokeup(struct uk_thread *t)
 		(s)->thread_remove   = thread_remove_func; \
 		(s)->thread_blocked  = thread_blocked_func; \
 		(s)->thread_wokeup   = thread_wokeup_func; \
+		(s)->thread_set_affinity = NULL; \
 		uk_sched_register((s)); \
 		\
 		(s)->a = (def_allocator); \
@@ -159,8 +169,23 @@ static inline void uk_sched_thread_wokeup(struct uk_thread *t)
 		(s)->a_uktls = (def_allocator); \
 		UK_TAILQ_INIT(&(s)->thread_list); \
 		UK_TAILQ_INIT(&(s)->exited_threads); \
+		uk_sched_lock_init((s)); \
 	} while (0)
 
+/*
+ * Protects the thread lists of a scheduler against concurrent access from
+ * other logical CPUs. Interrupts must be disabled by the caller.
+ */
+#if CONFIG_HAVE_SMP
+#define uk_sched_lock_init(s)	ukarch_spin_init(&(s)->lock)
+#define uk_sched_lock(s)	ukarch_spin_lock(&(s)->lock)
+#define uk_sched_unlock(s)	ukarch_spin_unlock(&(s)->lock)
+#else /* !CONFIG_HAVE_SMP */
+#define uk_sched_lock_init(s)	do { (void) (s); } while (0)
+#define uk_sched_lock(s)	do { (void) (s); } while (0)
+#define uk_sched_unlock(s)	do { (void) (s); } while (0)
+#endif /* !CONFIG_HAVE_SMP */
+
 /*
  * Public scheduler functions
  */
@@ -258,11 +283,13 @@ unsigned int uk_sched_thread_gc(struct uk_sched *sched);
 static inline
 void uk_sched_thread_switch(struct uk_thread *next)
 {
-	struct uk_thread *prev = __uk_sched_thread_current;
+	struct uk_thread **current = &__uk_sched_thread_current[ukplat_lcpu_id()];
+	struct uk_thread *prev = *current;
 
 	UK_ASSERT(prev);
 
-	__uk_sched_thread_current = next;
+	*current = next;
+	next->nr_switches++;
 	prev->tlsp = ukplat_tlsp_get();
 	if (prev->ectx)
 		ukarch_ectx_store(prev->ectx);
@@ -297,6 +324,40 @@ void uk_sched_thread_exit(void) __noreturn;
 /* terminate another thread */
 void uk_sched_thread_terminate(struct uk_thread *thread);
 
+/* Number of longs in a logical CPU mask (see `uk_sched_thread_*_affinity()`) */
+#define UK_SCHED_LCPU_MASK_LONGS \
+	UK_BITS_TO_LONGS(CONFIG_UKPLAT_LCPU_MAXCOUNT)
+
+/**
+ * Restricts the logical CPUs on which a thread may be executed. If the
+ * thread is currently queued on a logical CPU that is no longer allowed,
+ * the scheduler migrates it (if it is blocked or waiting to run) or moves it
+ * away on its next yield (if it is running).
+ *
+ * @param t
+ *   Reference to the thread
+ * @param lcpus
+ *   Bitmap of `UK_SCHED_LCPU_MASK_LONGS` longs. Bits for logical CPUs that
+ *   are not present are ignored.
+ * @return
+ *   - (0): Success
+ *   - (-EINVAL): The mask does not contain a logical CPU on which the
+ *                scheduler of the thread can run it
+ */
+int uk_sched_thread_set_affinity(struct uk_thread *t,
+				 const unsigned long *lcpus);
+
+/**
+ * Returns the logical CPUs on which a thread may be executed, limited to the
+ * logical CPUs that are present
+ *
+ * @param t
+ *   Reference to the thread
+ * @param lcpus
+ *   Bitmap of `UK_SCHED_LCPU_MASK_LONGS` longs that is filled
+ */
+void uk_sched_thread_get_affinity(struct uk_thread *t, unsigned long *lcpus);
+
 #ifdef __cplusplus
 }
 #endif
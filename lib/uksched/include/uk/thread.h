@@ -35,10 +35,15 @@
 #include <uk/arch/time.h>
 #include <uk/arch/ctx.h>
 #include <uk/plat/tls.h>
+#include <uk/plat/lcpu.h>
 #include <uk/wait_types.h>
 #include <uk/list.h>
 #include <uk/prio.h>
 #include <uk/essentials.h>
+#if CONFIG_HAVE_SMP
+#include <uk/arch/spinlock.h>
+#include <uk/bitops.h>
+#endif /* CONFIG_HAVE_SMP */
 
 #ifdef __cplusplus
 extern "C" {
@@ -75,9 +80,32 @@ struct uk_thread {
 	} _mem;				/**< Associated allocs (internal!) */
 	uk_thread_dtor_t dtor;		/**< User provided destructor */
 	void *priv;			/**< Private field, free for use */
+	unsigned long nr_switches;	/**< Number of times the thread was
+					 *   switched to
+					 */
 
 	const char *name;		/**< Reference to thread name */
 	UK_TAILQ_ENTRY(struct uk_thread) thread_list;
+
+#if CONFIG_HAVE_SMP
+	__spinlock lock;		/**< Serializes state changes between
+					 *   logical CPUs
+					 */
+	__lcpuid lcpu;			/**< Logical CPU the thread is queued
+					 *   on (managed by the scheduler)
+					 */
+	volatile int on_lcpu;		/**< Set while the context of the
+					 *   thread is in use by a logical CPU
+					 *   (managed by the scheduler)
+					 */
+	int queued;			/**< Scheduler queue the thread is on
+					 *   (managed by the scheduler)
+					 */
+	unsigned long affinity[UK_BITS_TO_LONGS(CONFIG_UKPLAT_LCPU_MAXCOUNT)];
+					/**< Logical CPUs the thread may run
+					 *   on
+					 */
+#endif /* CONFIG_HAVE_SMP */
 };
 
 UK_TAILQ_HEAD(uk_thread_list, struct uk_thread);
@@ -89,15 +117,27 @@ UK_TAILQ_HEAD(uk_thread_list, struct uk_thread);
 #define uk_thread_exit() \
 	uk_sched_thread_exit()
 
-/* managed by sched.c */
-extern struct uk_thread *__uk_sched_thread_current;
+/* managed by sched.c, one entry per logical CPU */
+extern struct uk_thread *__uk_sched_thread_current[CONFIG_UKPLAT_LCPU_MAXCOUNT];
 
 static inline
 struct uk_thread *uk_thread_current(void)
 {
-	return __uk_sched_thread_current;
+	return __uk_sched_thread_current[ukplat_lcpu_id()];
 }
 
+/*
+ * Serialize state changes (block, wakeup) of a thread with other logical
+ * CPUs. Interrupts must be disabled by the caller.
+ */
+#if CONFIG_HAVE_SMP
+#define uk_thread_lock(_thread)		ukarch_spin_lock(&(_thread)->lock)
+#define uk_thread_unlock(_thread)	ukarch_spin_unlock(&(_thread)->lock)
+#else /* !CONFIG_HAVE_SMP */
+#define uk_thread_lock(_thread)		do { (void) (_thread); } while (0)
+#define uk_thread_unlock(_thread)	do { (void) (_thread); } while (0)
+#endif /* !CONFIG_HAVE_SMP */
+
 /*
  * STATES OF THREADS
  * =================
@@ -512,6 +552,10 @@ struct uk_thread *uk_thread_create_fn2(struct uk_alloc *a,
 				       uk_thread_dtor_t dtor);
 
 void uk_thread_release(struct uk_thread *t);
+/* Blocks a thread until woken up or the absolute time `until` (0: no
+ * timeout) is reached
+ */
+void uk_thread_block_until(struct uk_thread *thread, __snsec until);
 void uk_thread_block_timeout(struct uk_thread *thread, __nsec nsec);
 void uk_thread_block(struct uk_thread *thread);
 void uk_thread_wakeup(struct uk_thread *thread);
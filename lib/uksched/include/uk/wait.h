@@ -39,7 +39,10 @@ extern "C" {
 static inline
 void uk_waitq_init(struct uk_waitq *wq)
 {
-	UK_STAILQ_INIT(wq);
+	UK_STAILQ_INIT(&wq->list);
+#if CONFIG_HAVE_SMP
+	ukarch_spin_init(&wq->lock);
+#endif /* CONFIG_HAVE_SMP */
 }
 
 static inline
@@ -48,30 +51,99 @@ void uk_waitq_entry_init(struct uk_waitq_entry *entry,
 {
 	entry->thread = thread;
 	entry->waiting = 0;
+	entry->flags = 0;
+	entry->wake = NULL;
+	entry->data = NULL;
 }
 
 static inline
 int uk_waitq_empty(struct uk_waitq *wq)
 {
-	return UK_STAILQ_EMPTY(wq);
+	return UK_STAILQ_EMPTY(&wq->list);
 }
 
+/*
+ * Disables interrupts and locks the wait queue against other logical CPUs.
+ * Lock order: wait queue, thread (see `uk_thread_lock()`), scheduler.
+ */
+static inline
+unsigned long uk_waitq_lock_irqsave(struct uk_waitq *wq __maybe_unused)
+{
+	unsigned long flags;
+
+	flags = ukplat_lcpu_save_irqf();
+#if CONFIG_HAVE_SMP
+	ukarch_spin_lock(&wq->lock);
+#endif /* CONFIG_HAVE_SMP */
+	return flags;
+}
+
+static inline
+void uk_waitq_unlock_irqrestore(struct uk_waitq *wq __maybe_unused,
+				unsigned long flags)
+{
+#if CONFIG_HAVE_SMP
+	ukarch_spin_unlock(&wq->lock);
+#endif /* CONFIG_HAVE_SMP */
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+/*
+ * Queues a waiter at the tail. This keeps the waiters in FIFO order for
+ * users that implement their own wakeup policy on top of the queue.
+ * NOTE: The caller must hold the wait queue lock
+ */
 static inline
 void uk_waitq_add(struct uk_waitq *wq,
 		struct uk_waitq_entry *entry)
 {
 	if (!entry->waiting) {
-		UK_STAILQ_INSERT_TAIL(wq, entry, thread_list);
+		UK_STAILQ_INSERT_TAIL(&wq->list, entry, thread_list);
+		entry->waiting = 1;
+	}
+}
+
+/*
+ * Queues a waiter that is woken up by every wakeup. It is put in front of
+ * exclusive waiters so that a wakeup can stop scanning the queue as soon
+ * as it has woken up enough exclusive waiters.
+ * NOTE: The caller must hold the wait queue lock
+ */
+static inline
+void uk_waitq_add_shared(struct uk_waitq *wq,
+			 struct uk_waitq_entry *entry)
+{
+	if (!entry->waiting) {
+		entry->flags &= ~UK_WAITQ_EXCLUSIVE;
+		UK_STAILQ_INSERT_HEAD(&wq->list, entry, thread_list);
 		entry->waiting = 1;
 	}
 }
 
+/*
+ * Queues an exclusive waiter at the tail. A wakeup wakes up all shared
+ * waiters but only the requested number of exclusive ones, in FIFO order.
+ * NOTE: The caller must hold the wait queue lock
+ */
+static inline
+void uk_waitq_add_exclusive(struct uk_waitq *wq,
+			    struct uk_waitq_entry *entry)
+{
+	if (!entry->waiting) {
+		entry->flags |= UK_WAITQ_EXCLUSIVE;
+		UK_STAILQ_INSERT_TAIL(&wq->list, entry, thread_list);
+		entry->waiting = 1;
+	}
+}
+
+/* NOTE: The caller must hold the wait queue lock */
 static inline
 void uk_waitq_remove(struct uk_waitq *wq,
 		struct uk_waitq_entry *entry)
 {
 	if (entry->waiting) {
-		UK_STAILQ_REMOVE(wq, entry, struct uk_waitq_entry, thread_list);
+		UK_STAILQ_REMOVE(&wq->list, entry, struct uk_waitq_entry,
+				 thread_list);
 		entry->waiting = 0;
 	}
 }
@@ -79,22 +151,28 @@ void uk_waitq_remove(struct uk_waitq *wq,
 #define uk_waitq_add_waiter(wq, w) \
 do { \
 	unsigned long flags; \
-	flags = ukplat_lcpu_save_irqf(); \
+	flags = uk_waitq_lock_irqsave(wq); \
 	uk_waitq_add(wq, w); \
 	uk_thread_block(uk_thread_current()); \
-	ukplat_lcpu_restore_irqf(flags); \
+	uk_waitq_unlock_irqrestore(wq, flags); \
 } while (0)
 
 #define uk_waitq_remove_waiter(wq, w) \
 do { \
 	unsigned long flags; \
-	flags = ukplat_lcpu_save_irqf(); \
+	flags = uk_waitq_lock_irqsave(wq); \
 	uk_waitq_remove(wq, w); \
-	ukplat_lcpu_restore_irqf(flags); \
+	uk_waitq_unlock_irqrestore(wq, flags); \
 } while (0)
 
+/*
+ * A waiter that is dequeued by a wakeup has been woken up by it, whereas
+ * one that is still queued was woken up by its deadline. An exclusive
+ * waiter that gives up after having consumed a wakeup hands it on, so
+ * that it is not lost for the other exclusive waiters.
+ */
 #define __wq_wait_event_deadline(wq, condition, deadline, deadline_condition, \
-				 lock_fn, unlock_fn, lock) \
+				 lock_fn, unlock_fn, lock, exclusive) \
 ({ \
 	struct uk_thread *__current; \
 	unsigned long flags; \
@@ -104,12 +182,19 @@ do { \
 		__current = uk_thread_current(); \
 		for (;;) { \
 			/* protect the list */ \
-			flags = ukplat_lcpu_save_irqf(); \
-			uk_waitq_add(wq, &__wait); \
-			__current->wakeup_time = deadline; \
-			clear_runnable(__current); \
-			uk_sched_thread_blocked(__current); \
-			ukplat_lcpu_restore_irqf(flags); \
+			flags = uk_waitq_lock_irqsave(wq); \
+			if (exclusive) \
+				uk_waitq_add_exclusive(wq, &__wait); \
+			else \
+				uk_waitq_add_shared(wq, &__wait); \
+			uk_thread_block_until(__current, deadline); \
+			uk_waitq_unlock_irqrestore(wq, flags); \
+			/* The condition may have been met before we were \
+			 * queued, e.g., by another CPU. Nobody wakes us up \
+			 * then. \
+			 */ \
+			if (condition) \
+				break; \
 			if (lock) \
 				unlock_fn(lock); \
 			uk_sched_yield(); \
@@ -122,11 +207,13 @@ do { \
 				break; \
 			} \
 		} \
-		flags = ukplat_lcpu_save_irqf(); \
+		flags = uk_waitq_lock_irqsave(wq); \
 		/* need to wake up */ \
 		uk_thread_wakeup(__current); \
+		if ((exclusive) && timedout && !__wait.waiting) \
+			__uk_waitq_wake_up_locked(wq, 1, NULL); \
 		uk_waitq_remove(wq, &__wait); \
-		ukplat_lcpu_restore_irqf(flags); \
+		uk_waitq_unlock_irqrestore(wq, flags); \
 	} \
 	timedout; \
 })
@@ -135,35 +222,133 @@ static inline void __lock_dummy(void *lock __unused) {}
 
 #define uk_waitq_wait_event(wq, condition) \
 	__wq_wait_event_deadline(wq, (condition), 0, 0, \
-				 __lock_dummy, __lock_dummy, NULL)
+				 __lock_dummy, __lock_dummy, NULL, 0)
 
 #define uk_waitq_wait_event_locked(wq, condition, lock_fn, unlock_fn, lock) \
 	__wq_wait_event_deadline(wq, (condition), 0, 0, \
-				 lock_fn, unlock_fn, lock)
+				 lock_fn, unlock_fn, lock, 0)
 
 #define uk_waitq_wait_event_deadline(wq, condition, deadline) \
 	__wq_wait_event_deadline(wq, (condition), \
 		(deadline), \
 		(deadline) && ukplat_monotonic_clock() >= (deadline), \
-		__lock_dummy, __lock_dummy, NULL)
+		__lock_dummy, __lock_dummy, NULL, 0)
 
 #define uk_waitq_wait_event_deadline_locked(wq, condition, deadline, \
 					    lock_fn, unlock_fn, lock) \
 	__wq_wait_event_deadline(wq, (condition), \
 		(deadline), \
 		(deadline) && ukplat_monotonic_clock() >= (deadline), \
-		lock_fn, unlock_fn, lock)
+		lock_fn, unlock_fn, lock, 0)
+
+/*
+ * Exclusive variants: the waiter is woken up only if fewer than the
+ * requested number of exclusive waiters have been woken up before it by
+ * the same wakeup. Use them when a single waiter can consume the event
+ * (e.g., a semaphore count or a buffer), to avoid waking up all waiters
+ * just to have all but one go back to sleep.
+ */
+#define uk_waitq_wait_event_exclusive(wq, condition) \
+	__wq_wait_event_deadline(wq, (condition), 0, 0, \
+				 __lock_dummy, __lock_dummy, NULL, 1)
+
+#define uk_waitq_wait_event_exclusive_locked(wq, condition, \
+					     lock_fn, unlock_fn, lock) \
+	__wq_wait_event_deadline(wq, (condition), 0, 0, \
+				 lock_fn, unlock_fn, lock, 1)
+
+#define uk_waitq_wait_event_deadline_exclusive(wq, condition, deadline) \
+	__wq_wait_event_deadline(wq, (condition), \
+		(deadline), \
+		(deadline) && ukplat_monotonic_clock() >= (deadline), \
+		__lock_dummy, __lock_dummy, NULL, 1)
 
+#define uk_waitq_wait_event_deadline_exclusive_locked(wq, condition, \
+						      deadline, lock_fn, \
+						      unlock_fn, lock) \
+	__wq_wait_event_deadline(wq, (condition), \
+		(deadline), \
+		(deadline) && ukplat_monotonic_clock() >= (deadline), \
+		lock_fn, unlock_fn, lock, 1)
+
+/*
+ * Wakes up all shared waiters and at most `nr` exclusive waiters. Woken
+ * waiters are removed from the queue.
+ * Returns the number of woken exclusive waiters.
+ * NOTE: The caller must hold the wait queue lock
+ */
 static inline
-void uk_waitq_wake_up(struct uk_waitq *wq)
+unsigned int __uk_waitq_wake_up_locked(struct uk_waitq *wq, unsigned int nr,
+				       void *key)
+{
+	struct uk_waitq_entry *curr, *prev = NULL, *next;
+	unsigned int woken = 0;
+	int exclusive;
+
+	for (curr = UK_STAILQ_FIRST(&wq->list); curr; curr = next) {
+		next = UK_STAILQ_NEXT(curr, thread_list);
+		exclusive = curr->flags & UK_WAITQ_EXCLUSIVE;
+
+		if (exclusive && woken >= nr)
+			break;
+
+		if (curr->wake && !curr->wake(curr, key)) {
+			/* The waiter is not interested, it stays queued */
+			prev = curr;
+			continue;
+		}
+		if (!curr->wake)
+			uk_thread_wakeup(curr->thread);
+
+		if (prev)
+			UK_STAILQ_REMOVE_AFTER(&wq->list, prev, thread_list);
+		else
+			UK_STAILQ_REMOVE_HEAD(&wq->list, thread_list);
+		curr->waiting = 0;
+
+		if (exclusive)
+			woken++;
+	}
+
+	return woken;
+}
+
+/*
+ * Wakes up all shared waiters and at most `nr` exclusive waiters. `key`
+ * is passed to the wake functions of the waiters.
+ * Returns the number of woken exclusive waiters.
+ */
+static inline
+unsigned int uk_waitq_wake_up_key(struct uk_waitq *wq, unsigned int nr,
+				  void *key)
 {
 	unsigned long flags;
-	struct uk_waitq_entry *curr, *tmp;
+	unsigned int woken;
 
-	flags = ukplat_lcpu_save_irqf();
-	UK_STAILQ_FOREACH_SAFE(curr, wq, thread_list, tmp)
-		uk_thread_wakeup(curr->thread);
-	ukplat_lcpu_restore_irqf(flags);
+	flags = uk_waitq_lock_irqsave(wq);
+	woken = __uk_waitq_wake_up_locked(wq, nr, key);
+	uk_waitq_unlock_irqrestore(wq, flags);
+
+	return woken;
+}
+
+static inline
+unsigned int uk_waitq_wake_up_nr(struct uk_waitq *wq, unsigned int nr)
+{
+	return uk_waitq_wake_up_key(wq, nr, NULL);
+}
+
+static inline
+unsigned int uk_waitq_wake_up_one(struct uk_waitq *wq)
+{
+	return uk_waitq_wake_up_key(wq, 1, NULL);
+}
+
+/* Wakes up all waiters, including all exclusive ones */
+static inline
+void uk_waitq_wake_up(struct uk_waitq *wq)
+{
+	uk_waitq_wake_up_key(wq, UK_WAITQ_WAKE_ALL, NULL);
 }
 
 #ifdef __cplusplus
@@ -26,33 +26,80 @@
 #ifndef __UK_SCHED_WAIT_TYPES_H__
 #define __UK_SCHED_WAIT_TYPES_H__
 
+#include <uk/config.h>
 #include <uk/list.h>
+#if CONFIG_HAVE_SMP
+#include <uk/arch/spinlock.h>
+#endif /* CONFIG_HAVE_SMP */
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct uk_waitq_entry;
+
+/*
+ * Wake function of a wait queue entry. It is called by the waking thread
+ * with the wait queue lock held, together with the key that was passed to
+ * the wakeup (e.g., an event mask). It returns non-zero if it woke up the
+ * waiter (e.g., with `uk_thread_wakeup()`), in which case the entry is
+ * removed from the queue. Returning zero leaves the waiter sleeping and
+ * queued, and it does not count against the number of exclusive waiters
+ * to wake up.
+ */
+typedef int (*uk_waitq_wake_func_t)(struct uk_waitq_entry *entry, void *key);
+
+/* Only a limited number of exclusive waiters is woken up per wakeup */
+#define UK_WAITQ_EXCLUSIVE	0x1
+
+/* Number of exclusive waiters to wake up to wake up all of them */
+#define UK_WAITQ_WAKE_ALL	(~0U)
+
 struct uk_waitq_entry {
 	int waiting;
+	unsigned int flags;
 	struct uk_thread *thread;
+	/* NULL wakes up `thread` unconditionally */
+	uk_waitq_wake_func_t wake;
+	/* Optional context for the wake function */
+	void *data;
 	UK_STAILQ_ENTRY(struct uk_waitq_entry) thread_list;
 };
 
-/* TODO - lock required? */
-UK_STAILQ_HEAD(uk_waitq, struct uk_waitq_entry);
+UK_STAILQ_HEAD(uk_waitq_list, struct uk_waitq_entry);
 
-#define __WAIT_QUEUE_INITIALIZER(name) UK_STAILQ_HEAD_INITIALIZER(name)
+struct uk_waitq {
+	struct uk_waitq_list list;
+#if CONFIG_HAVE_SMP
+	__spinlock lock;	/* protects `list` between logical CPUs */
+#endif /* CONFIG_HAVE_SMP */
+};
+
+#if CONFIG_HAVE_SMP
+#define __WAIT_QUEUE_INITIALIZER(name)				\
+	{ UK_STAILQ_HEAD_INITIALIZER((name).list),		\
+	  UKARCH_SPINLOCK_INITIALIZER() }
+#else /* !CONFIG_HAVE_SMP */
+#define __WAIT_QUEUE_INITIALIZER(name)				\
+	{ UK_STAILQ_HEAD_INITIALIZER((name).list) }
+#endif /* !CONFIG_HAVE_SMP */
 
 #define DEFINE_WAIT_QUEUE(name) \
 	struct uk_waitq name = __WAIT_QUEUE_INITIALIZER(name)
 
-#define DEFINE_WAIT(name) \
+#define DEFINE_WAIT_FUNC(name, func, ctx) \
 struct uk_waitq_entry name = { \
 	.waiting      = 0, \
+	.flags        = 0, \
 	.thread       = uk_thread_current(), \
+	.wake         = (func), \
+	.data         = (ctx), \
 	.thread_list  = { NULL } \
 }
 
+#define DEFINE_WAIT(name) \
+	DEFINE_WAIT_FUNC(name, NULL, NULL)
+
 #ifdef __cplusplus
 }
 #endif
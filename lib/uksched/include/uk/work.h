@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __UK_SCHED_WORK_H__
+#define __UK_SCHED_WORK_H__
+
+#include <uk/config.h>
+#include <uk/arch/atomic.h>
+#include <uk/list.h>
+#include <uk/essentials.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct uk_work;
+
+/**
+ * Function that is deferred to thread context. It is called from the kernel
+ * work thread and may block briefly, but it delays all other deferred work
+ * while doing so. The work is no longer pending and may be scheduled again
+ * by the function.
+ */
+typedef void (*uk_work_func_t)(struct uk_work *work, void *arg);
+
+struct uk_work {
+	uk_work_func_t func;
+	void *arg;
+
+	/* Internal, protected by the lock of the work queue */
+	UK_TAILQ_ENTRY(struct uk_work) _entry;
+	int _pending;
+};
+
+/**
+ * Initializes deferred work.
+ *
+ * @param work
+ *   Work to initialize
+ * @param func
+ *   Function to call from the work thread
+ * @param arg
+ *   Argument passed to `func`
+ */
+static inline void uk_work_init(struct uk_work *work,
+				uk_work_func_t func, void *arg)
+{
+	work->func = func;
+	work->arg = arg;
+	work->_pending = 0;
+}
+
+/**
+ * Returns non-zero if the work is scheduled and its function was not
+ * called yet.
+ */
+static inline int uk_work_pending(const struct uk_work *work)
+{
+	return UK_READ_ONCE(work->_pending);
+}
+
+/**
+ * Schedules the function of the work to be called from the work thread.
+ * Can be called from interrupt context, e.g., to move the processing of a
+ * device event out of the interrupt handler. Scheduling work that is
+ * pending already has no effect, so events that arrive before the function
+ * runs are handled by a single call.
+ *
+ * @return
+ *   1 if the work was scheduled, 0 if it was pending already
+ */
+int uk_work_schedule(struct uk_work *work);
+
+/**
+ * Removes the work from the work queue and waits until its function has
+ * returned, if it is running. Afterwards, the work may be freed unless the
+ * function scheduled it again. Must not be called from the work function.
+ *
+ * @return
+ *   1 if the work was pending, 0 otherwise
+ */
+int uk_work_cancel_sync(struct uk_work *work);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_SCHED_WORK_H__ */
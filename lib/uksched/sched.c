@@ -39,19 +39,25 @@
 #if CONFIG_LIBUKSCHEDCOOP
 #include <uk/schedcoop.h>
 #endif
+#if CONFIG_LIBUKSCHEDMP
+#include <uk/schedmp.h>
+#endif
+#include <uk/bitmap.h>
 #include <uk/syscall.h>
 
 struct uk_sched *uk_sched_head;
 
-/* TODO: Define per CPU */
-struct uk_thread *__uk_sched_thread_current;
+/* Current thread of each logical CPU */
+struct uk_thread *__uk_sched_thread_current[CONFIG_UKPLAT_LCPU_MAXCOUNT];
 
 /* FIXME Support for external schedulers */
 struct uk_sched *uk_sched_default_init(struct uk_alloc *a)
 {
 	struct uk_sched *s = NULL;
 
-#if CONFIG_LIBUKSCHEDCOOP
+#if CONFIG_LIBUKSCHEDMP
+	s = uk_schedmp_create(a);
+#elif CONFIG_LIBUKSCHEDCOOP
 	s = uk_schedcoop_create(a);
 #endif
 
@@ -232,7 +238,7 @@ int uk_sched_start(struct uk_sched *s)
 	main->flags |= UK_THREADF_RUNNABLE;
 
 	/* Set main as current scheduled thread */
-	__uk_sched_thread_current = main;
+	__uk_sched_thread_current[ukplat_lcpu_id()] = main;
 
 	/* Add main to the scheduler's thread list */
 	UK_TAILQ_INSERT_TAIL(&s->thread_list, main, thread_list);
@@ -247,7 +253,7 @@ int uk_sched_start(struct uk_sched *s)
 	return 0;
 
 err_unset_thread_current:
-	__uk_sched_thread_current = NULL;
+	__uk_sched_thread_current[ukplat_lcpu_id()] = NULL;
 	uk_thread_release(main);
 err_out:
 	return ret;
@@ -255,19 +261,36 @@ err_out:
 
 unsigned int uk_sched_thread_gc(struct uk_sched *sched)
 {
+	struct uk_thread_list gc_list = UK_TAILQ_HEAD_INITIALIZER(gc_list);
 	struct uk_thread *thread, *tmp;
 	unsigned int num = 0;
+	unsigned long flags;
 
-	/* Cleanup finished threads */
+	if (UK_TAILQ_EMPTY(&sched->exited_threads))
+		return 0;
+
+	flags = ukplat_lcpu_save_irqf();
+	uk_sched_lock(sched);
 	UK_TAILQ_FOREACH_SAFE(thread, &sched->exited_threads,
 			      thread_list, tmp) {
 		UK_ASSERT(thread != uk_thread_current());
+#if CONFIG_HAVE_SMP
+		/* The thread is still switching away on another CPU */
+		if (thread->on_lcpu)
+			continue;
+#endif /* CONFIG_HAVE_SMP */
+		UK_TAILQ_REMOVE(&sched->exited_threads, thread, thread_list);
+		UK_TAILQ_INSERT_TAIL(&gc_list, thread, thread_list);
+	}
+	uk_sched_unlock(sched);
+	ukplat_lcpu_restore_irqf(flags);
 
+	/* Cleanup finished threads */
+	UK_TAILQ_FOREACH_SAFE(thread, &gc_list, thread_list, tmp) {
 		uk_pr_debug("%p: garbage collect thread %p (%s)\n",
 			    sched, thread,
 			    thread->name ? thread->name : "<unnamed>");
 
-		UK_TAILQ_REMOVE(&sched->exited_threads, thread, thread_list);
 		uk_thread_release(thread);
 		++num;
 	}
@@ -300,16 +323,29 @@ void uk_sched_thread_terminate(struct uk_thread *thread)
 	clear_runnable(thread);
 
 	if (thread == uk_thread_current()) {
+		unsigned long flags;
+
 		/* enqueue thread for garbage collecting */
 		uk_pr_debug("%p: thread %p (%s) on gc list\n",
 			    sched, thread, thread->name ? thread->name : "<unnamed>");
+		flags = ukplat_lcpu_save_irqf();
+		uk_sched_lock(sched);
 		UK_TAILQ_INSERT_TAIL(&sched->exited_threads, thread,
 				     thread_list);
+		uk_sched_unlock(sched);
+		ukplat_lcpu_restore_irqf(flags);
 
 		/* leave this thread */
 		sched->yield(sched); /* we won't return */
 		UK_CRASH("Unexpectedly returned to exited thread %p\n", thread);
 	} else {
+#if CONFIG_HAVE_SMP
+		/* Another CPU may still execute the thread or switch away
+		 * from its context. Wait until the thread yielded there.
+		 */
+		while (UK_READ_ONCE(thread->on_lcpu))
+			ukarch_spinwait();
+#endif /* CONFIG_HAVE_SMP */
 		/* free thread resources immediately */
 		uk_thread_release(thread);
 	}
@@ -344,13 +380,22 @@ int uk_sched_thread_add(struct uk_sched *s, struct uk_thread *t)
 
 	flags = ukplat_lcpu_save_irqf();
 
-	rc = s->thread_add(s, t);
-	if (rc < 0)
-		goto out;
-
+	/* With multiple CPUs, the thread may run (and exit) as soon as the
+	 * scheduler queued it, so it has to be fully assigned before
+	 */
 	t->sched = s;
+	uk_sched_lock(s);
 	UK_TAILQ_INSERT_TAIL(&s->thread_list, t, thread_list);
-out:
+	uk_sched_unlock(s);
+
+	rc = s->thread_add(s, t);
+	if (rc < 0) {
+		uk_sched_lock(s);
+		UK_TAILQ_REMOVE(&s->thread_list, t, thread_list);
+		uk_sched_unlock(s);
+		t->sched = NULL;
+	}
+
 	ukplat_lcpu_restore_irqf(flags);
 	return rc;
 }
@@ -367,11 +412,62 @@ int uk_sched_thread_remove(struct uk_thread *t)
 	s = t->sched;
 	s->thread_remove(s, t);
 	t->sched = NULL;
+	uk_sched_lock(s);
 	UK_TAILQ_REMOVE(&s->thread_list, t, thread_list);
+	uk_sched_unlock(s);
 	ukplat_lcpu_restore_irqf(flags);
 	return 0;
 }
 
+int uk_sched_thread_set_affinity(struct uk_thread *t,
+				 const unsigned long *lcpus)
+{
+	unsigned long mask[UK_SCHED_LCPU_MASK_LONGS];
+	unsigned long online[UK_SCHED_LCPU_MASK_LONGS];
+	struct uk_sched *s;
+	unsigned long flags;
+	int rc = 0;
+
+	UK_ASSERT(t);
+	UK_ASSERT(lcpus);
+
+	uk_bitmap_zero(online, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	uk_bitmap_set(online, 0, ukplat_lcpu_count());
+	uk_bitmap_and(mask, lcpus, online, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	if (uk_bitmap_empty(mask, CONFIG_UKPLAT_LCPU_MAXCOUNT))
+		return -EINVAL;
+
+	flags = ukplat_lcpu_save_irqf();
+	s = t->sched;
+	if (s && s->thread_set_affinity) {
+		rc = s->thread_set_affinity(s, t, mask);
+	} else if (!uk_test_bit(0, mask)) {
+		/* Without support by the scheduler, everything is
+		 * executed on the boot CPU
+		 */
+		rc = -EINVAL;
+	}
+#if CONFIG_HAVE_SMP
+	else {
+		memcpy(t->affinity, mask, sizeof(t->affinity));
+	}
+#endif /* CONFIG_HAVE_SMP */
+	ukplat_lcpu_restore_irqf(flags);
+	return rc;
+}
+
+void uk_sched_thread_get_affinity(struct uk_thread *t, unsigned long *lcpus)
+{
+	UK_ASSERT(t);
+	UK_ASSERT(lcpus);
+
+	uk_bitmap_zero(lcpus, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	uk_bitmap_set(lcpus, 0, ukplat_lcpu_count());
+#if CONFIG_HAVE_SMP
+	uk_bitmap_and(lcpus, lcpus, t->affinity, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+#endif /* CONFIG_HAVE_SMP */
+}
+
 UK_SYSCALL_R_DEFINE(int, sched_yield)
 {
 	uk_sched_yield();
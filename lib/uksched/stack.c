@@ -0,0 +1,346 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Lazily committed thread stacks: each stack gets a slot in a dedicated
+ * virtual address range and sits at the top of it. Only the topmost page is
+ * mapped when the stack is allocated; further pages are mapped by the page
+ * fault handler when the thread first touches them. The pages of a slot below
+ * the stack are never mapped, so that a stack overflow faults instead of
+ * corrupting neighboring memory.
+ *
+ * The page fault handler may interrupt any code, including the memory
+ * allocator, the page table functions and this file, so it takes neither
+ * locks nor memory from the allocator: the page tables of a slot are
+ * allocated in thread context before the slot is used and kept afterwards,
+ * and the pages come from a reserve that is refilled in thread context.
+ */
+#include <errno.h>
+#include <uk/alloc.h>
+#include <uk/arch/atomic.h>
+#include <uk/arch/limits.h>
+#include <uk/arch/spinlock.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/event.h>
+#include <uk/plat/io.h>
+#include <uk/plat/paging.h>
+#include <uk/plat/spinlock.h>
+#include <uk/print.h>
+#include "stack.h"
+
+#define STACK_SLOTS		CONFIG_LIBUKSCHED_STACK_VMEM_SLOTS
+#define STACK_SLOT_SIZE		(__PAGE_SIZE \
+				 << CONFIG_LIBUKSCHED_STACK_VMEM_SLOT_ORDER)
+/* The lowest page of a slot is the guard page of the largest stacks */
+#define STACK_LEN_MAX		(STACK_SLOT_SIZE - __PAGE_SIZE)
+#define STACK_RESERVE		CONFIG_LIBUKSCHED_STACK_VMEM_RESERVE
+
+/* Protects the slot allocation, which is done in thread context only */
+static __spinlock stack_lock;
+/* Start of the slots, 0 until the first stack is allocated */
+static __uptr stack_base;
+/* Allocator that backs all lazily committed stacks */
+static struct uk_alloc *stack_a;
+/* Number of pages of the stack in each slot, 0 for free slots */
+static __u32 stack_pages[STACK_SLOTS];
+/*
+ * Lowest slot that may be free. Slots are reused lowest first, so that
+ * the page tables that were allocated for them are used again.
+ */
+static unsigned int stack_next;
+
+/*
+ * Free pages for the page fault handler. The handler may interrupt a thread
+ * that is using the reserve, so pages are taken and returned with atomic
+ * operations on the entries.
+ */
+static void *stack_reserve[STACK_RESERVE];
+static int stack_reserve_count;
+/*
+ * Pages that the fault handler could not return to the reserve, linked
+ * through their first word. The list is only emptied as a whole.
+ */
+static void *stack_reserve_spill;
+
+static inline __uptr stack_slot_top(unsigned int slot)
+{
+	return stack_base + (__uptr) (slot + 1) * STACK_SLOT_SIZE;
+}
+
+static inline int stack_in_range(__uptr va)
+{
+	return stack_base && va >= stack_base
+	       && va - stack_base < (__uptr) STACK_SLOTS * STACK_SLOT_SIZE;
+}
+
+static void *stack_reserve_get(void)
+{
+	unsigned int i;
+	void *page;
+
+	for (i = 0; i < STACK_RESERVE; i++) {
+		if (!UK_READ_ONCE(stack_reserve[i]))
+			continue;
+		page = ukarch_exchange_n(&stack_reserve[i], NULL);
+		if (page) {
+			ukarch_dec(&stack_reserve_count);
+			return page;
+		}
+	}
+
+	return NULL;
+}
+
+/* Returns 0 if the reserve is full and the page was not taken */
+static int stack_reserve_put(void *page)
+{
+	unsigned int i;
+
+	for (i = 0; i < STACK_RESERVE; i++) {
+		if (UK_READ_ONCE(stack_reserve[i]))
+			continue;
+		if (ukarch_compare_exchange_sync(&stack_reserve[i], NULL, page)
+		    == page) {
+			ukarch_inc(&stack_reserve_count);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Returns a page to the reserve from the page fault handler */
+static void stack_reserve_put_fault(void *page)
+{
+	void *next;
+
+	if (stack_reserve_put(page))
+		return;
+
+	do {
+		next = UK_READ_ONCE(stack_reserve_spill);
+		*(void **) page = next;
+	} while (ukarch_compare_exchange_sync(&stack_reserve_spill, next, page)
+		 != page);
+}
+
+/* Must be called in thread context */
+static void stack_reserve_fill(void)
+{
+	void *page, *next;
+
+	for (page = ukarch_exchange_n(&stack_reserve_spill, NULL); page;
+	     page = next) {
+		next = *(void **) page;
+		if (!stack_reserve_put(page))
+			uk_pfree(stack_a, page, 1);
+	}
+
+	while (UK_READ_ONCE(stack_reserve_count) < STACK_RESERVE) {
+		page = uk_palloc(stack_a, 1);
+		if (unlikely(!page))
+			break;
+		if (!stack_reserve_put(page)) {
+			uk_pfree(stack_a, page, 1);
+			break;
+		}
+	}
+}
+
+/* Maps a page from the reserve at va, also called from the fault handler */
+static int stack_page_map(__uptr va)
+{
+	void *page;
+	int rc;
+
+	page = stack_reserve_get();
+	if (unlikely(!page))
+		return -ENOMEM;
+
+	rc = ukplat_page_map_prepared((void *) va, ukplat_virt_to_phys(page),
+				      UKPLAT_PAGE_ATTR_PROT_RW);
+	if (unlikely(rc))
+		stack_reserve_put_fault(page);
+
+	return rc;
+}
+
+static int stack_init(struct uk_alloc *a)
+{
+	void *base;
+
+	base = ukplat_page_vaddr_alloc((__sz) STACK_SLOTS * STACK_SLOT_SIZE);
+	if (unlikely(!base))
+		return -ENOMEM;
+
+	stack_a = a;
+	UK_WRITE_ONCE(stack_base, (__uptr) base);
+
+	uk_pr_info("Lazily committed stacks at %p (%u slots of %lu KiB)\n",
+		   base, STACK_SLOTS, (unsigned long) STACK_SLOT_SIZE >> 10);
+	return 0;
+}
+
+static void stack_slot_free(unsigned int slot)
+{
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&stack_lock, flags);
+	UK_WRITE_ONCE(stack_pages[slot], 0);
+	if (slot < stack_next)
+		stack_next = slot;
+	ukplat_spin_unlock_irqrestore(&stack_lock, flags);
+}
+
+void *_uk_thread_stack_alloc(struct uk_alloc *a, size_t len)
+{
+	unsigned long flags;
+	unsigned int slot;
+	__uptr top;
+	int rc;
+
+	len = ALIGN_UP(len, __PAGE_SIZE);
+	if (unlikely(!len || len > STACK_LEN_MAX))
+		return uk_malloc(a, len);
+
+	ukplat_spin_lock_irqsave(&stack_lock, flags);
+	if (!stack_base && stack_init(a) < 0)
+		goto err_malloc;
+	/* All slots are backed by the same allocator */
+	if (a != stack_a)
+		goto err_malloc;
+
+	for (slot = stack_next; slot < STACK_SLOTS; slot++) {
+		if (!stack_pages[slot])
+			break;
+	}
+	if (unlikely(slot == STACK_SLOTS))
+		goto err_malloc;
+
+	stack_pages[slot] = len >> __PAGE_SHIFT;
+	stack_next = slot + 1;
+	ukplat_spin_unlock_irqrestore(&stack_lock, flags);
+
+	/* The fault handler cannot allocate page tables */
+	top = stack_slot_top(slot);
+	rc = ukplat_page_prepare((void *) (top - STACK_SLOT_SIZE),
+				 STACK_SLOT_SIZE);
+	if (unlikely(rc))
+		goto err_free_slot;
+
+	stack_reserve_fill();
+
+	/* The initial context of the thread is pushed onto the top page */
+	rc = stack_page_map(top - __PAGE_SIZE);
+	if (unlikely(rc))
+		goto err_free_slot;
+
+	return (void *) (top - len);
+
+err_free_slot:
+	stack_slot_free(slot);
+	return NULL;
+
+err_malloc:
+	ukplat_spin_unlock_irqrestore(&stack_lock, flags);
+	return uk_malloc(a, len);
+}
+
+void _uk_thread_stack_free(struct uk_alloc *a, void *stack)
+{
+	__uptr va = (__uptr) stack;
+	__uptr top, p;
+	__phys_addr paddr;
+	unsigned int slot;
+
+	if (!stack_in_range(va)) {
+		uk_free(a, stack);
+		return;
+	}
+
+	UK_ASSERT(a == stack_a);
+
+	slot = (va - stack_base) / STACK_SLOT_SIZE;
+	top = stack_slot_top(slot);
+	UK_ASSERT(va == top - ((__uptr) stack_pages[slot] << __PAGE_SHIFT));
+
+	/*
+	 * Nobody accesses the stack anymore, so the pages can be given away
+	 * before they are unmapped (which flushes the TLBs only once).
+	 * Memory from the allocator is identity-mapped. The page tables of
+	 * the slot are kept.
+	 */
+	for (p = va; p < top; p += __PAGE_SIZE) {
+		if (ukplat_page_lookup((void *) p, &paddr) < 0)
+			continue;
+		if (!stack_reserve_put((void *) paddr))
+			uk_pfree(stack_a, (void *) paddr, 1);
+	}
+	ukplat_page_unmap(stack, top - va);
+
+	stack_slot_free(slot);
+}
+
+static int stack_page_fault(void *data)
+{
+	struct ukplat_page_fault_ctx *ctx = data;
+	unsigned int slot;
+	__uptr top, bottom;
+	int rc;
+
+	if (!stack_in_range(ctx->addr)
+	    || (ctx->flags & UKPLAT_PAGE_FAULT_PRESENT))
+		return UK_EVENT_NOT_HANDLED;
+
+	slot = (ctx->addr - stack_base) / STACK_SLOT_SIZE;
+	top = stack_slot_top(slot);
+	bottom = top - ((__uptr) UK_READ_ONCE(stack_pages[slot])
+			<< __PAGE_SHIFT);
+	if (unlikely(ctx->addr < bottom)) {
+		uk_pr_crit("Stack overflow at %p (stack %p-%p)\n",
+			   (void *) ctx->addr, (void *) bottom, (void *) top);
+		return UK_EVENT_NOT_HANDLED;
+	}
+
+	rc = stack_page_map(ALIGN_DOWN(ctx->addr, __PAGE_SIZE));
+	/* Another CPU committed the page at the same time */
+	if (rc == -EEXIST)
+		return UK_EVENT_HANDLED;
+	if (unlikely(rc)) {
+		uk_pr_crit("Failed to commit stack page at %p: %d\n",
+			   (void *) ctx->addr, rc);
+		return UK_EVENT_NOT_HANDLED;
+	}
+
+	return UK_EVENT_HANDLED;
+}
+
+UK_EVENT_HANDLER(UKPLAT_EVENT_PAGE_FAULT, stack_page_fault);
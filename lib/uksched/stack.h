@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __UKSCHED_STACK_H__
+#define __UKSCHED_STACK_H__
+
+#include <stddef.h>
+#include <uk/alloc.h>
+#include <uk/config.h>
+
+#if CONFIG_LIBUKSCHED_STACK_VMEM
+/*
+ * Reserves a stack in the stack address range and maps its topmost page.
+ * The remaining pages are mapped on the first access. Falls back to
+ * uk_malloc() for stacks that do not fit into a slot.
+ */
+void *_uk_thread_stack_alloc(struct uk_alloc *a, size_t len);
+
+/* Frees a stack allocated with _uk_thread_stack_alloc() */
+void _uk_thread_stack_free(struct uk_alloc *a, void *stack);
+#else /* CONFIG_LIBUKSCHED_STACK_VMEM */
+static inline void *_uk_thread_stack_alloc(struct uk_alloc *a, size_t len)
+{
+	return uk_malloc(a, len);
+}
+
+static inline void _uk_thread_stack_free(struct uk_alloc *a, void *stack)
+{
+	uk_free(a, stack);
+}
+#endif /* CONFIG_LIBUKSCHED_STACK_VMEM */
+
+#endif /* __UKSCHED_STACK_H__ */
@@ -0,0 +1,264 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <uk/arch/time.h>
+#include <uk/bitmap.h>
+#include <uk/essentials.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+
+#define AFFINITY_WAIT_MS	100
+
+UK_TESTCASE(uksched_affinity_testsuite, uksched_test_affinity_mask)
+{
+	unsigned long mask[UK_SCHED_LCPU_MASK_LONGS];
+	unsigned long old[UK_SCHED_LCPU_MASK_LONGS];
+	unsigned long exp[UK_SCHED_LCPU_MASK_LONGS];
+	struct uk_thread *self = uk_thread_current();
+	unsigned int lcpu;
+
+	/* By default, a thread may run on every logical CPU that is present */
+	uk_sched_thread_get_affinity(self, old);
+	uk_bitmap_zero(exp, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	uk_bitmap_set(exp, 0, ukplat_lcpu_count());
+	UK_TEST_EXPECT_NOT_ZERO(uk_bitmap_equal(old, exp,
+						CONFIG_UKPLAT_LCPU_MAXCOUNT));
+
+	/* An empty mask is rejected */
+	uk_bitmap_zero(mask, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	UK_TEST_EXPECT_SNUM_EQ(uk_sched_thread_set_affinity(self, mask),
+			       -EINVAL);
+
+	/* CPUs that are not present are dropped from the mask */
+	uk_bitmap_fill(mask, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	UK_TEST_EXPECT_ZERO(uk_sched_thread_set_affinity(self, mask));
+	uk_sched_thread_get_affinity(self, mask);
+	UK_TEST_EXPECT_NOT_ZERO(uk_bitmap_equal(mask, exp,
+						CONFIG_UKPLAT_LCPU_MAXCOUNT));
+	if (ukplat_lcpu_count() < CONFIG_UKPLAT_LCPU_MAXCOUNT) {
+		uk_bitmap_zero(mask, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+		uk_bitmap_set(mask, ukplat_lcpu_count(), 1);
+		UK_TEST_EXPECT_SNUM_EQ(uk_sched_thread_set_affinity(self,
+								    mask),
+				       -EINVAL);
+	}
+
+	/* Pinning the running thread to its own CPU keeps it there */
+	lcpu = ukplat_lcpu_id();
+	uk_bitmap_zero(mask, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	uk_bitmap_set(mask, lcpu, 1);
+	UK_TEST_EXPECT_ZERO(uk_sched_thread_set_affinity(self, mask));
+	uk_sched_thread_get_affinity(self, exp);
+	UK_TEST_EXPECT_NOT_ZERO(uk_bitmap_equal(mask, exp,
+						CONFIG_UKPLAT_LCPU_MAXCOUNT));
+	uk_sched_yield();
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_lcpu_id(), lcpu);
+
+	UK_TEST_EXPECT_ZERO(uk_sched_thread_set_affinity(self, old));
+}
+
+#if CONFIG_LIBUKSCHEDMP
+struct affinity_ctx {
+	/* Number of threads that are running at the same time */
+	unsigned int arrived;
+	unsigned int expected;
+	unsigned int misplaced;
+	unsigned int done;
+};
+
+struct affinity_thread {
+	struct affinity_ctx *ctx;
+	struct uk_thread *thread;
+	unsigned int lcpu;
+};
+
+static __noreturn void affinity_thread_fn(void *arg)
+{
+	struct affinity_thread *at = (struct affinity_thread *) arg;
+	struct affinity_ctx *ctx = at->ctx;
+	__nsec until;
+
+	if (ukplat_lcpu_id() != at->lcpu)
+		ukarch_inc(&ctx->misplaced);
+
+	/* Wait for the others without yielding: this only finishes if all
+	 * threads run in parallel
+	 */
+	ukarch_inc(&ctx->arrived);
+	until = ukplat_monotonic_clock()
+		+ ukarch_time_msec_to_nsec(AFFINITY_WAIT_MS);
+	while (UK_READ_ONCE(ctx->arrived) < ctx->expected
+	       && ukplat_monotonic_clock() < until)
+		;
+
+	/* Yielding does not move the thread to another CPU */
+	uk_sched_yield();
+	if (ukplat_lcpu_id() != at->lcpu)
+		ukarch_inc(&ctx->misplaced);
+
+	ukarch_inc(&ctx->done);
+	uk_sched_thread_exit();
+}
+
+/*
+ * Pins one thread to each logical CPU other than the one of the test
+ * thread. All of them, together with the test thread, must run at the
+ * same time, each on its own CPU.
+ */
+UK_TESTCASE(uksched_affinity_testsuite, uksched_test_affinity_parallel)
+{
+	struct affinity_thread at[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	unsigned long mask[UK_SCHED_LCPU_MASK_LONGS];
+	unsigned long old[UK_SCHED_LCPU_MASK_LONGS];
+	struct uk_thread *self = uk_thread_current();
+	struct affinity_ctx ctx = { 0 };
+	unsigned int count = ukplat_lcpu_count();
+	unsigned int self_lcpu, i;
+	unsigned int n = 0;
+	__nsec until;
+
+	if (count < 2) {
+		uk_test_printf("Skipped: only one logical CPU\n");
+		return;
+	}
+
+	uk_sched_thread_get_affinity(self, old);
+	self_lcpu = ukplat_lcpu_id();
+	uk_bitmap_zero(mask, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	uk_bitmap_set(mask, self_lcpu, 1);
+	UK_TEST_EXPECT_ZERO(uk_sched_thread_set_affinity(self, mask));
+
+	ctx.expected = count;
+	for (i = 0; i < count; i++) {
+		if (i == self_lcpu)
+			continue;
+		at[n] = (struct affinity_thread) { .ctx = &ctx, .lcpu = i };
+		at[n].thread = uk_sched_thread_create(uk_sched_current(),
+						      affinity_thread_fn,
+						      &at[n],
+						      "test-affinity");
+		UK_TEST_EXPECT_NOT_NULL(at[n].thread);
+		if (!at[n].thread)
+			break;
+
+		/* The new thread has not run yet, so it is migrated */
+		uk_bitmap_zero(mask, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+		uk_bitmap_set(mask, i, 1);
+		UK_TEST_EXPECT_ZERO(uk_sched_thread_set_affinity(at[n].thread,
+								 mask));
+		n++;
+	}
+
+	ukarch_inc(&ctx.arrived);
+	until = ukplat_monotonic_clock()
+		+ ukarch_time_msec_to_nsec(AFFINITY_WAIT_MS);
+	while (UK_READ_ONCE(ctx.arrived) < ctx.expected
+	       && ukplat_monotonic_clock() < until)
+		;
+	UK_TEST_EXPECT_SNUM_EQ(UK_READ_ONCE(ctx.arrived), count);
+
+	while (UK_READ_ONCE(ctx.done) < n)
+		uk_sched_yield();
+	UK_TEST_EXPECT_ZERO(ctx.misplaced);
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_lcpu_id(), self_lcpu);
+
+	UK_TEST_EXPECT_ZERO(uk_sched_thread_set_affinity(self, old));
+}
+
+struct affinity_busy {
+	unsigned int lcpu;
+	int stop;
+	int done;
+};
+
+static __noreturn void affinity_busy_fn(void *arg)
+{
+	struct affinity_busy *b = (struct affinity_busy *) arg;
+	__nsec until;
+
+	/* Keep the CPU busy, but give up on a thread that never arrives */
+	until = ukplat_monotonic_clock()
+		+ ukarch_time_msec_to_nsec(10 * AFFINITY_WAIT_MS);
+	while (!UK_READ_ONCE(b->stop) && ukplat_monotonic_clock() < until)
+		uk_sched_yield();
+
+	UK_WRITE_ONCE(b->done, 1);
+	uk_sched_thread_exit();
+}
+
+/*
+ * The test thread pins itself to a CPU that is busy running another
+ * thread. It must get there nevertheless, as the busy CPU never goes idle
+ * or steals work.
+ */
+UK_TESTCASE(uksched_affinity_testsuite, uksched_test_affinity_busy)
+{
+	unsigned long mask[UK_SCHED_LCPU_MASK_LONGS];
+	unsigned long old[UK_SCHED_LCPU_MASK_LONGS];
+	struct uk_thread *self = uk_thread_current();
+	struct affinity_busy b = { 0 };
+	struct uk_thread *t;
+
+	if (ukplat_lcpu_count() < 2) {
+		uk_test_printf("Skipped: only one logical CPU\n");
+		return;
+	}
+
+	uk_sched_thread_get_affinity(self, old);
+	b.lcpu = (ukplat_lcpu_id() + 1) % ukplat_lcpu_count();
+	uk_bitmap_zero(mask, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	uk_bitmap_set(mask, b.lcpu, 1);
+
+	t = uk_sched_thread_create(uk_sched_current(), affinity_busy_fn, &b,
+				   "test-affinity-busy");
+	UK_TEST_EXPECT_NOT_NULL(t);
+	if (!t)
+		return;
+	UK_TEST_EXPECT_ZERO(uk_sched_thread_set_affinity(t, mask));
+
+	/* Leave the current CPU on the next yield */
+	UK_TEST_EXPECT_ZERO(uk_sched_thread_set_affinity(self, mask));
+	uk_sched_yield();
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_lcpu_id(), b.lcpu);
+	UK_TEST_EXPECT_ZERO(UK_READ_ONCE(b.done));
+
+	UK_WRITE_ONCE(b.stop, 1);
+	while (!UK_READ_ONCE(b.done))
+		uk_sched_yield();
+
+	UK_TEST_EXPECT_ZERO(uk_sched_thread_set_affinity(self, old));
+}
+#endif /* CONFIG_LIBUKSCHEDMP */
+
+uk_testsuite_register(uksched_affinity_testsuite, NULL);
@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <uk/alloc.h>
+#include <uk/essentials.h>
+#include <uk/plat/io.h>
+#include <uk/plat/paging.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+#include "../stack.h"
+
+#define TEST_STACK_PAGES	16
+
+UK_TESTCASE(uksched_stack_testsuite, uksched_test_stack_commit)
+{
+	struct uk_alloc *a = uk_sched_current()->a_stack;
+	__phys_addr paddr, paddr2;
+	char *stack, *top;
+
+	stack = _uk_thread_stack_alloc(a, TEST_STACK_PAGES * __PAGE_SIZE);
+	UK_TEST_EXPECT_NOT_NULL(stack);
+	top = stack + TEST_STACK_PAGES * __PAGE_SIZE;
+
+	/* Only the topmost page is committed */
+	UK_TEST_EXPECT_ZERO(ukplat_page_lookup(top - __PAGE_SIZE, &paddr));
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_lookup(stack, &paddr), -ENOENT);
+
+	/* The first access commits a page */
+	stack[0] = 1;
+	UK_TEST_EXPECT_ZERO(ukplat_page_lookup(stack, &paddr));
+	UK_TEST_EXPECT_SNUM_EQ(stack[0], 1);
+
+	/* DMA addresses are taken from the page tables */
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_virt_to_phys(stack + 8), paddr + 8);
+
+	/* and pages are committed when their DMA address is looked up */
+	paddr = ukplat_virt_to_phys(stack + __PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(ukplat_page_lookup(stack + __PAGE_SIZE, &paddr2));
+	UK_TEST_EXPECT_SNUM_EQ(paddr, paddr2);
+
+	_uk_thread_stack_free(a, stack);
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_lookup(top - __PAGE_SIZE, &paddr),
+			       -ENOENT);
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_lookup(stack, &paddr), -ENOENT);
+}
+
+static __noreturn void stack_grow_fn(void *arg)
+{
+	volatile char buf[4 * __PAGE_SIZE];
+	unsigned int i;
+
+	/* Grow the stack page by page */
+	for (i = sizeof(buf); i > 0; i -= __PAGE_SIZE)
+		buf[i - __PAGE_SIZE] = 1;
+
+	UK_WRITE_ONCE(*(int *) arg, buf[0]);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(uksched_stack_testsuite, uksched_test_stack_grow)
+{
+	struct uk_thread *t;
+	int done = 0;
+
+	t = uk_sched_thread_create(uk_sched_current(), stack_grow_fn, &done,
+				   "test-stack-grow");
+	UK_TEST_EXPECT_NOT_NULL(t);
+
+	while (!UK_READ_ONCE(done))
+		uk_sched_yield();
+	UK_TEST_EXPECT_SNUM_EQ(done, 1);
+}
+
+uk_testsuite_register(uksched_stack_testsuite, NULL);
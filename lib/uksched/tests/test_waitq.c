@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/wait.h>
+#include <uk/test.h>
+
+#define WAITQ_TIMEOUT_MS	5
+
+struct waitq_waiter {
+	struct uk_waitq *wq;
+	struct uk_thread *thread;
+	int *avail;
+	int need;
+	__nsec deadline;
+	int timedout;
+	int done;
+};
+
+static __noreturn void waitq_waiter_fn(void *arg)
+{
+	struct waitq_waiter *w = (struct waitq_waiter *) arg;
+	__nsec deadline = w->deadline;
+
+	w->timedout = uk_waitq_wait_event_deadline_exclusive(w->wq,
+			UK_READ_ONCE(*w->avail) >= w->need, deadline);
+	UK_WRITE_ONCE(w->done, 1);
+	uk_sched_thread_exit();
+}
+
+/* Starts a waiter and returns once it sleeps on the wait queue */
+static void waitq_waiter_start(struct waitq_waiter *w)
+{
+	w->timedout = -1;
+	w->done = 0;
+	w->thread = uk_sched_thread_create(uk_sched_current(), waitq_waiter_fn,
+					   w, "test-waitq-waiter");
+	if (!w->thread)
+		return;
+
+	while (!UK_READ_ONCE(w->done) && is_runnable(w->thread))
+		uk_sched_yield();
+}
+
+/* Lets woken waiters run for up to `ms` and returns how many are done */
+static int waitq_waiters_done(struct waitq_waiter *w, unsigned int n,
+			      int expected, unsigned long ms)
+{
+	__nsec until = ukplat_monotonic_clock() + ukarch_time_msec_to_nsec(ms);
+	unsigned int i;
+	int done;
+
+	do {
+		uk_sched_yield();
+		for (i = 0, done = 0; i < n; i++)
+			if (UK_READ_ONCE(w[i].done))
+				done++;
+	} while (done < expected && ukplat_monotonic_clock() < until);
+
+	return done;
+}
+
+UK_TESTCASE(uksched_waitq_testsuite, uksched_test_waitq_exclusive)
+{
+	struct waitq_waiter w[2];
+	struct uk_waitq wq;
+	int avail = 0;
+	unsigned int i;
+
+	uk_waitq_init(&wq);
+	for (i = 0; i < ARRAY_SIZE(w); i++) {
+		w[i] = (struct waitq_waiter) {
+			.wq = &wq, .avail = &avail, .need = 1,
+		};
+		waitq_waiter_start(&w[i]);
+		UK_TEST_EXPECT_NOT_NULL(w[i].thread);
+	}
+
+	/* Each wakeup reaches a single exclusive waiter */
+	avail = 1;
+	uk_waitq_wake_up_one(&wq);
+	UK_TEST_EXPECT_SNUM_EQ(waitq_waiters_done(w, 2, 2, 1), 1);
+	uk_waitq_wake_up_one(&wq);
+	UK_TEST_EXPECT_SNUM_EQ(waitq_waiters_done(w, 2, 2, 100), 2);
+
+	for (i = 0; i < ARRAY_SIZE(w); i++)
+		UK_TEST_EXPECT_ZERO(w[i].timedout);
+	UK_TEST_EXPECT_NOT_ZERO(uk_waitq_empty(&wq));
+}
+
+/*
+ * An exclusive waiter that is woken up but then times out must pass the
+ * wakeup on. Otherwise, the next waiter keeps sleeping although it could
+ * proceed.
+ */
+UK_TESTCASE(uksched_waitq_testsuite, uksched_test_waitq_timeout_handoff)
+{
+	__nsec deadline = ukplat_monotonic_clock() +
+			  ukarch_time_msec_to_nsec(WAITQ_TIMEOUT_MS);
+	struct waitq_waiter w[2];
+	struct uk_waitq wq;
+	int avail = 0;
+
+	uk_waitq_init(&wq);
+
+	/* The first waiter needs more than will be available and gives up
+	 * at its deadline, the second one is content with what there is
+	 */
+	w[0] = (struct waitq_waiter) {
+		.wq = &wq, .avail = &avail, .need = 2, .deadline = deadline,
+	};
+	w[1] = (struct waitq_waiter) {
+		.wq = &wq, .avail = &avail, .need = 1,
+	};
+	waitq_waiter_start(&w[0]);
+	UK_TEST_EXPECT_NOT_NULL(w[0].thread);
+	waitq_waiter_start(&w[1]);
+	UK_TEST_EXPECT_NOT_NULL(w[1].thread);
+
+	/* Wake up the first waiter only after its deadline */
+	while (ukplat_monotonic_clock() < deadline)
+		;
+	avail = 1;
+	uk_waitq_wake_up_one(&wq);
+
+	UK_TEST_EXPECT_SNUM_EQ(waitq_waiters_done(w, 2, 2, 100), 2);
+	UK_TEST_EXPECT_SNUM_EQ(w[0].timedout, 1);
+	UK_TEST_EXPECT_ZERO(w[1].timedout);
+	UK_TEST_EXPECT_NOT_ZERO(uk_waitq_empty(&wq));
+}
+
+uk_testsuite_register(uksched_waitq_testsuite, NULL);
@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <uk/essentials.h>
+#include <uk/sched.h>
+#include <uk/test.h>
+#include <uk/work.h>
+
+#define WORK_ITEMS		3
+
+struct work_ctx {
+	struct uk_work work[WORK_ITEMS];
+	/* Indexes of the work items in the order in which they ran */
+	unsigned int order[WORK_ITEMS];
+	unsigned int calls;
+	/* Number of times the function schedules its work again */
+	unsigned int again;
+	/* Number of yields the function does before it returns */
+	unsigned int yields;
+	int running;
+	int done;
+};
+
+static void work_fn(struct uk_work *work, void *arg)
+{
+	struct work_ctx *ctx = (struct work_ctx *) arg;
+	unsigned int i;
+
+	UK_WRITE_ONCE(ctx->running, 1);
+	for (i = 0; i < ctx->yields; i++)
+		uk_sched_yield();
+
+	if (ctx->calls < WORK_ITEMS)
+		ctx->order[ctx->calls] = work - ctx->work;
+	ctx->calls++;
+	if (ctx->again) {
+		ctx->again--;
+		uk_work_schedule(work);
+	}
+	UK_WRITE_ONCE(ctx->done, 1);
+}
+
+static void work_ctx_init(struct work_ctx *ctx)
+{
+	unsigned int i;
+
+	*ctx = (struct work_ctx) { .calls = 0 };
+	for (i = 0; i < WORK_ITEMS; i++)
+		uk_work_init(&ctx->work[i], work_fn, ctx);
+}
+
+/* Lets the work thread run */
+static void work_run(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 16; i++)
+		uk_sched_yield();
+}
+
+UK_TESTCASE(uksched_work_testsuite, uksched_test_work_schedule)
+{
+	struct work_ctx ctx;
+
+	work_ctx_init(&ctx);
+
+	/* Scheduling pending work again has no effect */
+	UK_TEST_EXPECT_SNUM_EQ(uk_work_schedule(&ctx.work[0]), 1);
+	UK_TEST_EXPECT_ZERO(uk_work_schedule(&ctx.work[0]));
+	UK_TEST_EXPECT_SNUM_EQ(uk_work_pending(&ctx.work[0]), 1);
+	work_run();
+	UK_TEST_EXPECT_ZERO(uk_work_pending(&ctx.work[0]));
+	UK_TEST_EXPECT_SNUM_EQ(ctx.calls, 1);
+
+	/* The function may schedule its work again */
+	ctx.again = 2;
+	UK_TEST_EXPECT_SNUM_EQ(uk_work_schedule(&ctx.work[0]), 1);
+	work_run();
+	UK_TEST_EXPECT_SNUM_EQ(ctx.calls, 4);
+	UK_TEST_EXPECT_ZERO(uk_work_pending(&ctx.work[0]));
+}
+
+UK_TESTCASE(uksched_work_testsuite, uksched_test_work_order)
+{
+	struct work_ctx ctx;
+	unsigned int i;
+
+	work_ctx_init(&ctx);
+
+	/* Work runs in the order in which it was scheduled */
+	UK_TEST_EXPECT_SNUM_EQ(uk_work_schedule(&ctx.work[2]), 1);
+	UK_TEST_EXPECT_SNUM_EQ(uk_work_schedule(&ctx.work[0]), 1);
+	UK_TEST_EXPECT_SNUM_EQ(uk_work_schedule(&ctx.work[1]), 1);
+	work_run();
+	UK_TEST_EXPECT_SNUM_EQ(ctx.calls, WORK_ITEMS);
+	UK_TEST_EXPECT_SNUM_EQ(ctx.order[0], 2);
+	UK_TEST_EXPECT_SNUM_EQ(ctx.order[1], 0);
+	UK_TEST_EXPECT_SNUM_EQ(ctx.order[2], 1);
+	for (i = 0; i < WORK_ITEMS; i++)
+		UK_TEST_EXPECT_ZERO(uk_work_pending(&ctx.work[i]));
+}
+
+UK_TESTCASE(uksched_work_testsuite, uksched_test_work_cancel)
+{
+	struct work_ctx ctx;
+
+	work_ctx_init(&ctx);
+
+	/* Pending work is removed before its function runs */
+	UK_TEST_EXPECT_SNUM_EQ(uk_work_schedule(&ctx.work[0]), 1);
+	UK_TEST_EXPECT_SNUM_EQ(uk_work_cancel_sync(&ctx.work[0]), 1);
+	UK_TEST_EXPECT_ZERO(uk_work_pending(&ctx.work[0]));
+	work_run();
+	UK_TEST_EXPECT_ZERO(ctx.calls);
+
+	/* Canceling idle work has no effect */
+	UK_TEST_EXPECT_ZERO(uk_work_cancel_sync(&ctx.work[0]));
+
+	/* Canceling running work waits until its function returns */
+	ctx.yields = 8;
+	UK_TEST_EXPECT_SNUM_EQ(uk_work_schedule(&ctx.work[0]), 1);
+	while (!UK_READ_ONCE(ctx.running))
+		uk_sched_yield();
+	UK_TEST_EXPECT_ZERO(UK_READ_ONCE(ctx.done));
+	UK_TEST_EXPECT_ZERO(uk_work_cancel_sync(&ctx.work[0]));
+	UK_TEST_EXPECT_SNUM_EQ(UK_READ_ONCE(ctx.done), 1);
+	UK_TEST_EXPECT_SNUM_EQ(ctx.calls, 1);
+}
+
+uk_testsuite_register(uksched_work_testsuite, NULL);
@@ -43,6 +43,10 @@
 #include <uk/print.h>
 #include <uk/assert.h>
 #include <uk/arch/tls.h>
+#if CONFIG_HAVE_SMP
+#include <uk/bitmap.h>
+#endif /* CONFIG_HAVE_SMP */
+#include "stack.h"
 
 /* This library allocates a TLS according to the ukarch
  * layout and optionally reserves extra space for a libc TCB.
@@ -248,6 +252,10 @@ static void _uk_thread_struct_init(struct uk_thread *t,
 	UK_ASSERT(!is_uktls || tlsp);
 
 	memset(t, 0x0, sizeof(*t));
+#if CONFIG_HAVE_SMP
+	/* By default, a thread may run on any logical CPU */
+	uk_bitmap_fill(t->affinity, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+#endif /* CONFIG_HAVE_SMP */
 
 	t->ectx = ectx;
 	t->tlsp = tlsp;
@@ -381,7 +389,7 @@ static int _uk_thread_struct_init_alloc(struct uk_thread *t,
 	int rc;
 
 	if (a_stack && stack_len) {
-		stack = uk_malloc(a_stack, stack_len);
+		stack = _uk_thread_stack_alloc(a_stack, stack_len);
 		if (!stack) {
 			rc = -ENOMEM;
 			goto err_out;
@@ -455,7 +463,7 @@ err_free_tls:
 #endif /* LIBUKSCHED_HAVE_TCB */
 err_free_stack:
 	if (stack)
-		uk_free(a_stack, stack);
+		_uk_thread_stack_free(a_stack, stack);
 err_out:
 	return rc;
 }
@@ -481,7 +489,7 @@ void _uk_thread_struct_free_alloc(struct uk_thread *t)
 		t->_mem.uktls   = NULL;
 	}
 	if (t->_mem.stack_a && t->_mem.stack) {
-		uk_free(t->_mem.stack_a, t->_mem.stack);
+		_uk_thread_stack_free(t->_mem.stack_a, t->_mem.stack);
 		t->_mem.stack_a = NULL;
 		t->_mem.stack   = NULL;
 	}
@@ -843,24 +851,26 @@ void uk_thread_release(struct uk_thread *t)
 	if (tls_a   && tls)
 		uk_free(tls_a,   tls);
 	if (stack_a && stack)
-		uk_free(stack_a, stack);
+		_uk_thread_stack_free(stack_a, stack);
 	if (a)
 		uk_free(a, t);
 }
 
-static void uk_thread_block_until(struct uk_thread *thread, __snsec until)
+void uk_thread_block_until(struct uk_thread *thread, __snsec until)
 {
 	unsigned long flags;
 
 	UK_ASSERT(thread);
 
 	flags = ukplat_lcpu_save_irqf();
+	uk_thread_lock(thread);
 	thread->wakeup_time = until;
 	if (is_runnable(thread)) {
 		clear_runnable(thread);
 		if (thread->sched)
 			uk_sched_thread_blocked(thread);
 	}
+	uk_thread_unlock(thread);
 	ukplat_lcpu_restore_irqf(flags);
 }
 
@@ -885,11 +895,13 @@ void uk_thread_wakeup(struct uk_thread *thread)
 	unsigned long flags;
 
 	flags = ukplat_lcpu_save_irqf();
+	uk_thread_lock(thread);
 	if (!is_runnable(thread)) {
 		set_runnable(thread);
 		if (thread->sched)
 			uk_sched_thread_wokeup(thread);
 	}
 	thread->wakeup_time = 0LL;
+	uk_thread_unlock(thread);
 	ukplat_lcpu_restore_irqf(flags);
 }
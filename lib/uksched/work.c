@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Deferred work: functions that interrupt handlers move to thread context.
+ * A single kernel thread runs all scheduled work in FIFO order.
+ */
+#include <errno.h>
+#include <uk/arch/spinlock.h>
+#include <uk/assert.h>
+#include <uk/init.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/wait.h>
+#include <uk/work.h>
+
+UK_TAILQ_HEAD(uk_work_list, struct uk_work);
+
+static struct uk_work_list work_queue = UK_TAILQ_HEAD_INITIALIZER(work_queue);
+static __spinlock work_lock = UKARCH_SPINLOCK_INITIALIZER();
+static DEFINE_WAIT_QUEUE(work_thread_wq);
+
+/* Work whose function is running in the work thread */
+static struct uk_work *work_running;
+static DEFINE_WAIT_QUEUE(work_done_wq);
+
+/* Interrupt flags saved by work_thread_lock(), valid while it is held */
+static unsigned long work_thread_irqf;
+
+/*
+ * Lock functions for waiting on the work thread queues with `work_lock`
+ * held, so that work scheduled by an interrupt in between the check of
+ * the condition and going to sleep cannot be missed.
+ */
+static void work_thread_lock(__spinlock *lock)
+{
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(lock, flags);
+	work_thread_irqf = flags;
+}
+
+static void work_thread_unlock(__spinlock *lock)
+{
+	unsigned long flags = work_thread_irqf;
+
+	ukplat_spin_unlock_irqrestore(lock, flags);
+}
+
+int uk_work_schedule(struct uk_work *work)
+{
+	unsigned long flags;
+	int scheduled = 0;
+
+	UK_ASSERT(work);
+	UK_ASSERT(work->func);
+
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&work_lock);
+	if (!work->_pending) {
+		UK_TAILQ_INSERT_TAIL(&work_queue, work, _entry);
+		work->_pending = 1;
+		scheduled = 1;
+	}
+	ukarch_spin_unlock(&work_lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	if (scheduled)
+		uk_waitq_wake_up(&work_thread_wq);
+	return scheduled;
+}
+
+int uk_work_cancel_sync(struct uk_work *work)
+{
+	__spinlock *lock = &work_lock;
+	int pending;
+
+	UK_ASSERT(work);
+
+	work_thread_lock(lock);
+	pending = work->_pending;
+	if (pending) {
+		UK_TAILQ_REMOVE(&work_queue, work, _entry);
+		work->_pending = 0;
+	}
+	uk_waitq_wait_event_locked(&work_done_wq, work_running != work,
+				   work_thread_lock, work_thread_unlock, lock);
+	work_thread_unlock(lock);
+	return pending;
+}
+
+static __noreturn void work_thread_fn(void *arg __unused)
+{
+	__spinlock *lock = &work_lock;
+	struct uk_work *w;
+
+	work_thread_lock(lock);
+	for (;;) {
+		uk_waitq_wait_event_locked(&work_thread_wq,
+					   UK_TAILQ_FIRST(&work_queue),
+					   work_thread_lock,
+					   work_thread_unlock, lock);
+
+		while ((w = UK_TAILQ_FIRST(&work_queue))) {
+			UK_TAILQ_REMOVE(&work_queue, w, _entry);
+			w->_pending = 0;
+			work_running = w;
+			work_thread_unlock(lock);
+
+			w->func(w, w->arg);
+
+			work_thread_lock(lock);
+			work_running = NULL;
+			uk_waitq_wake_up(&work_done_wq);
+		}
+	}
+}
+
+static int uk_work_init_thread(void)
+{
+	struct uk_thread *t;
+
+	/* Work that is scheduled earlier waits for the thread */
+	t = uk_sched_thread_create(uk_sched_current(), work_thread_fn, NULL,
+				   "ukwork");
+	if (unlikely(!t)) {
+		uk_pr_err("Failed to create kernel work thread\n");
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+uk_early_initcall(uk_work_init_thread);
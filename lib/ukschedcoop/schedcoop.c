@@ -177,25 +177,35 @@ static __noreturn void idle_thread_fn(void *argp)
 {
 	struct schedcoop *c = (struct schedcoop *) argp;
 	__nsec now, wake_up_time;
+	unsigned long flags;
 
 	UK_ASSERT(c);
 
 	for (;;) {
 		uk_sched_thread_gc(&c->sched);
 
-		/* Read return time set by last schedule operation */
-		wake_up_time = (volatile __nsec) c->idle_return_time;
-		now = ukplat_monotonic_clock();
-
-		if (wake_up_time > now) {
-			if (wake_up_time)
-				ukplat_lcpu_halt_to(wake_up_time);
-			else
+		/* Interrupts may have woken up threads since the last
+		 * schedule operation. Check with interrupts disabled, so
+		 * that none gets lost before we halt.
+		 */
+		flags = ukplat_lcpu_save_irqf();
+		if (UK_TAILQ_EMPTY(&c->run_queue)) {
+			/* Read return time set by last schedule operation */
+			wake_up_time = (volatile __nsec) c->idle_return_time;
+			now = ukplat_monotonic_clock();
+
+			/* Without sleeping threads, only an interrupt
+			 * brings new work: no need for timer wakeups
+			 */
+			if (!wake_up_time)
 				ukplat_lcpu_halt_irq();
-
-			/* handle pending events if any */
-			ukplat_lcpu_irqs_handle_pending();
+			else if (wake_up_time > now)
+				ukplat_lcpu_halt_to(wake_up_time);
 		}
+		ukplat_lcpu_restore_irqf(flags);
+
+		/* handle pending events if any */
+		ukplat_lcpu_irqs_handle_pending();
 
 		/* try to schedule a thread that might now be available */
 		schedcoop_schedule(&c->sched);
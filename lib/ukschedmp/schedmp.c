@@ -0,0 +1,872 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Cooperative scheduler for multiple logical CPUs.
+ *
+ * Every logical CPU has its own run queue, sleep queue and idle thread. A
+ * thread that becomes runnable is queued on an idle CPU if there is one,
+ * otherwise on the CPU it ran on last. CPUs that run out of work steal
+ * runnable threads from the queues of other CPUs before they go idle.
+ *
+ * Locking: The state of a thread (runnable, sleeping) is serialized with
+ * the lock of the thread (see `uk_thread_lock()`), the queues of a CPU with
+ * the lock of the CPU. The thread lock is always taken before a CPU lock
+ * and never two CPU locks are held at the same time.
+ *
+ * A thread is queued on the CPU in `uk_thread.lcpu`. While a CPU executes a
+ * thread or switches away from its context, `uk_thread.on_lcpu` is set and
+ * the thread is not migrated. The CPU clears the flag after the switch and
+ * queues the thread if it got woken up in the meantime.
+ */
+#include <string.h>
+#include <uk/plat/config.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/memory.h>
+#include <uk/plat/time.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/spinlock.h>
+#include <uk/arch/atomic.h>
+#include <uk/bitops.h>
+#include <uk/bitmap.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/schedmp.h>
+#include <uk/essentials.h>
+
+/* Values of `uk_thread.queued` */
+#define SCHEDMP_QUEUE_NONE	0
+#define SCHEDMP_QUEUE_RUN	1
+#define SCHEDMP_QUEUE_SLEEP	2
+
+struct schedmp;
+
+struct schedmp_lcpu {
+	__spinlock lock;
+	__lcpuid id;
+	volatile int online;
+	volatile int idling;		/* halted by the idle thread */
+	volatile unsigned int nr_ready;	/* length of run_queue */
+	struct uk_thread_list run_queue;
+	struct uk_thread_list sleep_queue;
+
+	struct uk_thread *current;	/* thread executed by the CPU */
+	struct uk_thread *prev;		/* thread the CPU is switching away from */
+
+	struct uk_thread idle;
+	__snsec idle_return_time;
+	void *stack;			/* startup stack (secondary CPUs) */
+	struct schedmp *c;
+} __align(CACHE_LINE_SIZE);
+
+struct schedmp {
+	struct uk_sched sched;
+	__lcpuid lcpu_count;
+	struct schedmp_lcpu lcpu[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+};
+
+/* The scheduler manages all logical CPUs, so there is only one instance */
+static struct schedmp *schedmp_instance;
+
+static inline struct schedmp *uksched2schedmp(struct uk_sched *s)
+{
+	UK_ASSERT(s);
+
+	return __containerof(s, struct schedmp, sched);
+}
+
+static inline struct schedmp_lcpu *schedmp_lcpu_current(struct schedmp *c)
+{
+	return &c->lcpu[ukplat_lcpu_id()];
+}
+
+static inline int schedmp_allowed(struct uk_thread *t,
+				  struct schedmp_lcpu *l)
+{
+	return uk_test_bit(l->id, t->affinity);
+}
+
+/* Locks the CPU that the thread is queued on */
+static struct schedmp_lcpu *schedmp_lock_thread_lcpu(struct schedmp *c,
+						     struct uk_thread *t)
+{
+	struct schedmp_lcpu *l;
+
+	for (;;) {
+		l = &c->lcpu[UK_READ_ONCE(t->lcpu)];
+		ukarch_spin_lock(&l->lock);
+		if (likely(t->lcpu == l->id))
+			return l;
+		/* The thread was migrated in the meantime */
+		ukarch_spin_unlock(&l->lock);
+	}
+}
+
+static void schedmp_run_add(struct schedmp_lcpu *l, struct uk_thread *t)
+{
+	UK_ASSERT(t->queued == SCHEDMP_QUEUE_NONE);
+
+	t->lcpu = l->id;
+	t->queued = SCHEDMP_QUEUE_RUN;
+	UK_TAILQ_INSERT_TAIL(&l->run_queue, t, queue);
+	UK_WRITE_ONCE(l->nr_ready, l->nr_ready + 1);
+}
+
+static void schedmp_sleep_add(struct schedmp_lcpu *l, struct uk_thread *t)
+{
+	UK_ASSERT(t->queued == SCHEDMP_QUEUE_NONE);
+
+	t->lcpu = l->id;
+	t->queued = SCHEDMP_QUEUE_SLEEP;
+	UK_TAILQ_INSERT_TAIL(&l->sleep_queue, t, queue);
+}
+
+static void schedmp_queue_remove(struct schedmp_lcpu *l, struct uk_thread *t)
+{
+	UK_ASSERT(t->lcpu == l->id);
+
+	switch (t->queued) {
+	case SCHEDMP_QUEUE_RUN:
+		UK_TAILQ_REMOVE(&l->run_queue, t, queue);
+		UK_WRITE_ONCE(l->nr_ready, l->nr_ready - 1);
+		break;
+	case SCHEDMP_QUEUE_SLEEP:
+		UK_TAILQ_REMOVE(&l->sleep_queue, t, queue);
+		break;
+	default:
+		break;
+	}
+	t->queued = SCHEDMP_QUEUE_NONE;
+}
+
+/* Returns an idle CPU on which the thread may run, if any */
+static struct schedmp_lcpu *schedmp_find_idle(struct schedmp *c,
+					      struct uk_thread *t)
+{
+	struct schedmp_lcpu *l;
+	__lcpuid i;
+
+	for (i = 0; i < c->lcpu_count; i++) {
+		l = &c->lcpu[i];
+		if (l->online && l->idling && schedmp_allowed(t, l))
+			return l;
+	}
+	return NULL;
+}
+
+/*
+ * Selects the CPU for a thread that becomes runnable: `pref` if it is idle,
+ * otherwise any idle CPU, otherwise `pref`. Only CPUs that the thread may run
+ * on are considered.
+ */
+static struct schedmp_lcpu *schedmp_select(struct schedmp *c,
+					   struct uk_thread *t,
+					   struct schedmp_lcpu *pref)
+{
+	struct schedmp_lcpu *l;
+	__lcpuid i;
+
+	if (pref->idling && schedmp_allowed(t, pref))
+		return pref;
+
+	l = schedmp_find_idle(c, t);
+	if (l)
+		return l;
+
+	if (schedmp_allowed(t, pref))
+		return pref;
+
+	for (i = 0; i < c->lcpu_count; i++) {
+		l = &c->lcpu[i];
+		if (l->online && schedmp_allowed(t, l))
+			return l;
+	}
+
+	/* The affinity mask contains online CPUs only, so this is a
+	 * CPU that is still starting up
+	 */
+	return pref;
+}
+
+/* Wakes up a CPU after work was queued on it */
+static void schedmp_kick(struct schedmp_lcpu *l)
+{
+	__lcpuid id = l->id;
+
+	/* Order the queuing before reading the idle state. Pairs with the
+	 * barrier in idle_thread_fn().
+	 */
+	mb();
+	if (id != ukplat_lcpu_id() && UK_READ_ONCE(l->idling))
+		ukplat_lcpu_wakeup(&id, 1);
+}
+
+/*
+ * Completes the switch away from `l->prev`. The CPU does not use its
+ * context anymore, so the thread can be migrated or released from now on.
+ * Returns the thread if it may not run on this CPU anymore. It is taken off
+ * the queues of the CPU but still marked as being on it, and has to be
+ * handed to schedmp_migrate() once the lock of the CPU is dropped.
+ */
+static struct uk_thread *schedmp_finish_switch(struct schedmp_lcpu *l)
+{
+	struct uk_thread *p = l->prev;
+
+	if (!p)
+		return NULL;
+	l->prev = NULL;
+
+	if (p != &l->idle && !is_exited(p)) {
+		if (!schedmp_allowed(p, l)) {
+			schedmp_queue_remove(l, p);
+			return p;
+		}
+		/* Woken up while the switch was in progress */
+		if (p->queued == SCHEDMP_QUEUE_NONE && is_runnable(p))
+			schedmp_run_add(l, p);
+	}
+
+	/* Last access: an exited thread may be released from now on */
+	UK_WRITE_ONCE(p->on_lcpu, 0);
+	return NULL;
+}
+
+/*
+ * Moves a thread returned by schedmp_finish_switch() to a CPU in its
+ * affinity mask and kicks that CPU. The thread goes to the run queue if it
+ * is runnable and to the sleep queue if it waits with a timeout.
+ */
+static void schedmp_migrate(struct schedmp *c, struct schedmp_lcpu *l,
+			    struct uk_thread *t)
+{
+	struct schedmp_lcpu *target = NULL;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+	UK_ASSERT(t->on_lcpu);
+
+	uk_thread_lock(t);
+	if (!is_exited(t) && t->queued == SCHEDMP_QUEUE_NONE
+	    && (is_runnable(t) || t->wakeup_time > 0)) {
+		target = schedmp_select(c, t, l);
+		ukarch_spin_lock(&target->lock);
+		if (is_runnable(t))
+			schedmp_run_add(target, t);
+		else
+			schedmp_sleep_add(target, t);
+		l = target;
+	} else {
+		l = schedmp_lock_thread_lcpu(c, t);
+	}
+	uk_thread_unlock(t);
+
+	/* Last access: the lock of the CPU that the thread is queued on
+	 * keeps schedmp_thread_woken() from seeing the flag in between
+	 */
+	UK_WRITE_ONCE(t->on_lcpu, 0);
+	ukarch_spin_unlock(&l->lock);
+
+	if (target)
+		schedmp_kick(target);
+}
+
+/*
+ * Wakes up the expired threads of the sleep queue. Returns the time when
+ * the next timeout expires or 0 if no thread sleeps with a timeout.
+ */
+static __snsec schedmp_wakeup_sleepers(struct schedmp_lcpu *l)
+{
+	struct uk_thread *t, *tmp;
+	__snsec now, min_wakeup_time = 0;
+
+	now = ukplat_monotonic_clock();
+	UK_TAILQ_FOREACH_SAFE(t, &l->sleep_queue, queue, tmp) {
+		if (t->wakeup_time > now) {
+			if (!min_wakeup_time
+			    || t->wakeup_time < min_wakeup_time)
+				min_wakeup_time = t->wakeup_time;
+			continue;
+		}
+
+		/* The thread lock comes before the CPU lock. If the thread
+		 * is locked, it is probably being woken up right now.
+		 * Otherwise, we try again soon.
+		 */
+		if (!ukarch_spin_trylock(&t->lock)) {
+			min_wakeup_time = now;
+			continue;
+		}
+		schedmp_queue_remove(l, t);
+		set_runnable(t);
+		t->wakeup_time = 0;
+		if (!t->on_lcpu)
+			schedmp_run_add(l, t);
+		ukarch_spin_unlock(&t->lock);
+	}
+
+	return min_wakeup_time;
+}
+
+/* Takes the first runnable thread from the local run queue */
+static struct uk_thread *schedmp_dequeue(struct schedmp_lcpu *l)
+{
+	struct uk_thread *t;
+
+	UK_TAILQ_FOREACH(t, &l->run_queue, queue) {
+		UK_ASSERT(is_runnable(t));
+		UK_ASSERT(!t->on_lcpu);
+
+		/* Threads that may not run here wait to be stolen */
+		if (!schedmp_allowed(t, l))
+			continue;
+
+		schedmp_queue_remove(l, t);
+		return t;
+	}
+	return NULL;
+}
+
+/*
+ * Steals a runnable thread from another CPU. The caller must not hold the
+ * lock of `l`. The stolen thread is marked as being on `l`.
+ */
+static struct uk_thread *schedmp_steal(struct schedmp *c,
+				       struct schedmp_lcpu *l)
+{
+	struct schedmp_lcpu *v;
+	struct uk_thread *t;
+	__lcpuid i;
+
+	for (i = 1; i < c->lcpu_count; i++) {
+		v = &c->lcpu[(l->id + i) % c->lcpu_count];
+		if (!UK_READ_ONCE(v->nr_ready))
+			continue;
+
+		ukarch_spin_lock(&v->lock);
+		UK_TAILQ_FOREACH(t, &v->run_queue, queue) {
+			/* Skip the thread that `v` is switching away from */
+			if (t->on_lcpu || !schedmp_allowed(t, l))
+				continue;
+
+			schedmp_queue_remove(v, t);
+			t->lcpu = l->id;
+			t->on_lcpu = 1;
+			ukarch_spin_unlock(&v->lock);
+			return t;
+		}
+		ukarch_spin_unlock(&v->lock);
+	}
+	return NULL;
+}
+
+static inline int schedmp_can_continue(struct schedmp_lcpu *l,
+				       struct uk_thread *t)
+{
+	return is_runnable(t) && !is_exited(t) && schedmp_allowed(t, l);
+}
+
+static void schedmp_schedule(struct uk_sched *s)
+{
+	struct schedmp *c = uksched2schedmp(s);
+	struct uk_thread *prev, *next, *migrate;
+	struct schedmp_lcpu *l;
+	__snsec min_wakeup_time;
+	unsigned long flags;
+
+	if (unlikely(ukplat_lcpu_irqs_disabled()))
+		UK_CRASH("Must not call %s with IRQs disabled\n", __func__);
+
+	flags = ukplat_lcpu_save_irqf();
+	l = schedmp_lcpu_current(c);
+	prev = l->current;
+	UK_ASSERT(prev == uk_thread_current());
+
+	ukarch_spin_lock(&l->lock);
+	migrate = schedmp_finish_switch(l);
+	min_wakeup_time = schedmp_wakeup_sleepers(l);
+
+	next = schedmp_dequeue(l);
+	if (!next && (prev == &l->idle || !schedmp_can_continue(l, prev))) {
+		ukarch_spin_unlock(&l->lock);
+		next = schedmp_steal(c, l);
+		ukarch_spin_lock(&l->lock);
+
+		/* Terminated while we were taking it over */
+		if (next && unlikely(is_exited(next))) {
+			UK_WRITE_ONCE(next->on_lcpu, 0);
+			next = NULL;
+		}
+	}
+
+	if (next) {
+		UK_ASSERT(next != prev);
+
+		/* Put previous thread on the end of the list */
+		if (prev != &l->idle && is_runnable(prev) && !is_exited(prev))
+			schedmp_run_add(l, prev);
+	} else if (schedmp_can_continue(l, prev)) {
+		next = prev;
+	} else {
+		/* A thread that may not run here anymore is moved to
+		 * another CPU once the switch is complete (see
+		 * schedmp_finish_switch())
+		 */
+		if (prev != &l->idle && is_runnable(prev) && !is_exited(prev))
+			schedmp_run_add(l, prev);
+		next = &l->idle;
+	}
+	l->idle_return_time = min_wakeup_time;
+
+	if (prev != next) {
+		next->on_lcpu = 1;
+		l->current = next;
+		l->prev = prev;
+	}
+	ukarch_spin_unlock(&l->lock);
+	if (migrate)
+		schedmp_migrate(c, l, migrate);
+	ukplat_lcpu_restore_irqf(flags);
+
+	if (prev == next)
+		return;
+
+	/* Interrupting the switch is equivalent to having the next thread
+	 * interrupted at the return instruction. And therefore at safe point.
+	 */
+	uk_sched_thread_switch(next);
+
+	/* We are back, possibly on another CPU: let go of the thread that
+	 * was executed before
+	 */
+	flags = ukplat_lcpu_save_irqf();
+	l = schedmp_lcpu_current(c);
+	ukarch_spin_lock(&l->lock);
+	migrate = schedmp_finish_switch(l);
+	ukarch_spin_unlock(&l->lock);
+	if (migrate)
+		schedmp_migrate(c, l, migrate);
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+static int schedmp_thread_add(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedmp *c = uksched2schedmp(s);
+	struct schedmp_lcpu *l;
+
+	UK_ASSERT(t);
+	UK_ASSERT(!is_exited(t));
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	uk_thread_lock(t);
+	t->on_lcpu = 0;
+	t->queued = SCHEDMP_QUEUE_NONE;
+	t->lcpu = ukplat_lcpu_id();
+
+	/* Add to a run queue if runnable */
+	if (!is_runnable(t)) {
+		uk_thread_unlock(t);
+		return 0;
+	}
+
+	l = schedmp_select(c, t, schedmp_lcpu_current(c));
+	ukarch_spin_lock(&l->lock);
+	schedmp_run_add(l, t);
+	ukarch_spin_unlock(&l->lock);
+	uk_thread_unlock(t);
+
+	schedmp_kick(l);
+	return 0;
+}
+
+static void schedmp_thread_remove(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedmp *c = uksched2schedmp(s);
+	struct schedmp_lcpu *l;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	uk_thread_lock(t);
+	l = schedmp_lock_thread_lcpu(c, t);
+	schedmp_queue_remove(l, t);
+	ukarch_spin_unlock(&l->lock);
+	uk_thread_unlock(t);
+}
+
+/* Called with the thread locked */
+static void schedmp_thread_blocked(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedmp *c = uksched2schedmp(s);
+	struct schedmp_lcpu *l;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	l = schedmp_lock_thread_lcpu(c, t);
+	schedmp_queue_remove(l, t);
+	if (t->wakeup_time > 0)
+		schedmp_sleep_add(l, t);
+	ukarch_spin_unlock(&l->lock);
+}
+
+/* Called with the thread locked */
+static void schedmp_thread_woken(struct uk_sched *s, struct uk_thread *t)
+{
+	struct schedmp *c = uksched2schedmp(s);
+	struct schedmp_lcpu *l, *target;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	l = schedmp_lock_thread_lcpu(c, t);
+	if (t->queued == SCHEDMP_QUEUE_SLEEP)
+		schedmp_queue_remove(l, t);
+
+	/* The CPU that executes the thread or switches away from it takes
+	 * care of queuing it
+	 */
+	if (t->on_lcpu || t->queued != SCHEDMP_QUEUE_NONE) {
+		ukarch_spin_unlock(&l->lock);
+		return;
+	}
+
+	target = schedmp_select(c, t, l);
+	if (target != l) {
+		/* The thread is on no queue and locked, so nobody else can
+		 * change its placement in the meantime
+		 */
+		ukarch_spin_unlock(&l->lock);
+		ukarch_spin_lock(&target->lock);
+	}
+	schedmp_run_add(target, t);
+	ukarch_spin_unlock(&target->lock);
+
+	schedmp_kick(target);
+}
+
+static int schedmp_thread_set_affinity(struct uk_sched *s,
+				       struct uk_thread *t,
+				       const unsigned long *lcpus)
+{
+	struct schedmp *c = uksched2schedmp(s);
+	struct schedmp_lcpu *l, *target;
+	int queued;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	uk_thread_lock(t);
+	l = schedmp_lock_thread_lcpu(c, t);
+	memcpy(t->affinity, lcpus, sizeof(t->affinity));
+
+	/* A running thread leaves the CPU on its next yield */
+	if (t->on_lcpu || schedmp_allowed(t, l)) {
+		ukarch_spin_unlock(&l->lock);
+		uk_thread_unlock(t);
+		return 0;
+	}
+
+	/* Migrate a waiting or sleeping thread right away */
+	queued = t->queued;
+	schedmp_queue_remove(l, t);
+	ukarch_spin_unlock(&l->lock);
+
+	target = schedmp_select(c, t, l);
+	ukarch_spin_lock(&target->lock);
+	t->lcpu = target->id;
+	if (queued == SCHEDMP_QUEUE_RUN)
+		schedmp_run_add(target, t);
+	else if (queued == SCHEDMP_QUEUE_SLEEP)
+		schedmp_sleep_add(target, t);
+	ukarch_spin_unlock(&target->lock);
+	uk_thread_unlock(t);
+
+	/* The target has to pick up the thread or its timeout */
+	if (queued != SCHEDMP_QUEUE_NONE)
+		schedmp_kick(target);
+	return 0;
+}
+
+/*
+ * Tells if the run queue holds a thread that may run on the CPU. Threads
+ * that may not run here anymore are about to be moved to another CPU and
+ * must not keep the CPU from halting.
+ */
+static int schedmp_has_work(struct schedmp_lcpu *l)
+{
+	struct uk_thread *t;
+	int ret = 0;
+
+	if (!UK_READ_ONCE(l->nr_ready))
+		return 0;
+
+	ukarch_spin_lock(&l->lock);
+	UK_TAILQ_FOREACH(t, &l->run_queue, queue) {
+		if (schedmp_allowed(t, l)) {
+			ret = 1;
+			break;
+		}
+	}
+	ukarch_spin_unlock(&l->lock);
+
+	return ret;
+}
+
+static __noreturn void idle_thread_fn(void *argp)
+{
+	struct schedmp_lcpu *l = (struct schedmp_lcpu *) argp;
+	struct schedmp *c;
+	__snsec now, wake_up_time;
+	unsigned long flags;
+
+	UK_ASSERT(l);
+	c = l->c;
+
+	for (;;) {
+		uk_sched_thread_gc(&c->sched);
+
+		flags = ukplat_lcpu_save_irqf();
+		UK_WRITE_ONCE(l->idling, 1);
+		/* Pairs with the barrier in schedmp_kick() */
+		mb();
+		if (!schedmp_has_work(l)) {
+			/* Read return time set by last schedule operation */
+			wake_up_time = UK_READ_ONCE(l->idle_return_time);
+			now = ukplat_monotonic_clock();
+
+			if (!wake_up_time)
+				ukplat_lcpu_halt_irq();
+			else if (wake_up_time > now)
+				ukplat_lcpu_halt_to(wake_up_time);
+		}
+		UK_WRITE_ONCE(l->idling, 0);
+		ukplat_lcpu_restore_irqf(flags);
+
+		/* handle pending events if any */
+		ukplat_lcpu_irqs_handle_pending();
+
+		/* try to schedule a thread that might now be available */
+		schedmp_schedule(&c->sched);
+	}
+}
+
+/* Entry of the secondary CPUs: the startup context becomes the idle thread */
+static __noreturn void schedmp_lcpu_entry(void)
+{
+	struct schedmp *c = schedmp_instance;
+	struct schedmp_lcpu *l;
+
+	UK_ASSERT(c);
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	l = schedmp_lcpu_current(c);
+	l->idle.tlsp = ukplat_tlsp_get();
+	__uk_sched_thread_current[l->id] = &l->idle;
+
+	ukarch_spin_lock(&l->lock);
+	l->idle.on_lcpu = 1;
+	l->current = &l->idle;
+	UK_WRITE_ONCE(l->online, 1);
+	ukarch_spin_unlock(&l->lock);
+
+	uk_pr_debug("CPU %u: Entering scheduler\n", (unsigned int) l->id);
+	ukplat_lcpu_enable_irq();
+	idle_thread_fn(l);
+}
+
+static void schedmp_lcpus_start(struct schedmp *c)
+{
+	static __lcpuid lcpuid[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	static void *sp[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	static ukplat_lcpu_entry_t entry[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	unsigned int num = 0;
+	__lcpuid i;
+	int rc;
+
+	for (i = 1; i < c->lcpu_count; i++) {
+		lcpuid[num] = i;
+		sp[num] = (__u8 *) c->lcpu[i].stack + STACK_SIZE;
+		entry[num] = schedmp_lcpu_entry;
+		num++;
+	}
+	if (!num)
+		return;
+
+	uk_pr_info("Start %u secondary CPUs...\n", num);
+	rc = ukplat_lcpu_start(lcpuid, sp, entry, num);
+	if (unlikely(rc < 0))
+		uk_pr_err("Failed to start secondary CPUs: %d\n", rc);
+}
+
+static int schedmp_start(struct uk_sched *s, struct uk_thread *main)
+{
+	struct schedmp *c = uksched2schedmp(s);
+	struct schedmp_lcpu *l = schedmp_lcpu_current(c);
+
+	UK_ASSERT(main);
+	UK_ASSERT(main->sched == s);
+	UK_ASSERT(is_runnable(main));
+	UK_ASSERT(!is_exited(main));
+	UK_ASSERT(uk_thread_current() == main);
+
+	/* NOTE: We do not put `main` into the run queue.
+	 *       Current running threads will be added as
+	 *       soon as a different thread is scheduled.
+	 */
+	main->lcpu = l->id;
+	main->on_lcpu = 1;
+	l->current = main;
+
+	schedmp_lcpus_start(c);
+
+	ukplat_lcpu_enable_irq();
+
+	return 0;
+}
+
+static void schedmp_lcpu_free(struct uk_alloc *a, struct schedmp_lcpu *l)
+{
+	struct ukarch_ectx *ectx = l->idle.ectx;
+
+	l->idle.sched = NULL;
+	uk_thread_release(&l->idle);
+	if (ectx)
+		uk_free(a, ectx); /* TODO: TLS allocator */
+	if (l->stack)
+		uk_free(a, l->stack);
+}
+
+static int schedmp_lcpu_init(struct uk_alloc *a, struct schedmp *c,
+			     struct schedmp_lcpu *l, __lcpuid id)
+{
+	struct ukarch_ectx *idle_ectx;
+	int rc;
+
+	l->id = id;
+	l->c = c;
+	ukarch_spin_init(&l->lock);
+	UK_TAILQ_INIT(&l->run_queue);
+	UK_TAILQ_INIT(&l->sleep_queue);
+
+	idle_ectx = uk_memalign(a, /* TODO: use TLS allocator */
+				ukarch_ectx_align(),
+				ukarch_ectx_size());
+	if (!idle_ectx)
+		return -ENOMEM;
+
+	if (id == 0) {
+		/* The boot CPU enters the idle thread with a switch */
+		rc = uk_thread_init_fn1(&l->idle,
+					idle_thread_fn, (void *) l,
+					a, STACK_SIZE,
+					NULL, true,
+					idle_ectx,
+					"idle",
+					NULL,
+					NULL);
+		if (rc < 0)
+			goto err_free_ectx;
+	} else {
+		/* Secondary CPUs execute the idle thread on their startup
+		 * stack; the context is saved on the first switch
+		 */
+		l->stack = uk_memalign(a, __PAGE_SIZE, STACK_SIZE);
+		if (!l->stack) {
+			rc = -ENOMEM;
+			goto err_free_ectx;
+		}
+
+		rc = uk_thread_init_bare(&l->idle, 0x0, 0x0, 0x0, false,
+					 idle_ectx, "idle", NULL, NULL);
+		if (rc < 0)
+			goto err_free_stack;
+		set_runnable(&l->idle);
+	}
+
+	l->idle.sched = &c->sched;
+	l->idle.lcpu = id;
+	uk_bitmap_zero(l->idle.affinity, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	uk_set_bit(id, l->idle.affinity);
+	return 0;
+
+err_free_stack:
+	uk_free(a, l->stack);
+	l->stack = NULL;
+err_free_ectx:
+	uk_free(a, idle_ectx); /* TODO: TLS allocator */
+	return rc;
+}
+
+struct uk_sched *uk_schedmp_create(struct uk_alloc *a)
+{
+	struct schedmp *c = NULL;
+	__lcpuid i;
+	int rc;
+
+	UK_ASSERT(!schedmp_instance);
+
+	uk_pr_info("Initializing multi-core scheduler (%u CPUs)\n",
+		   (unsigned int) ukplat_lcpu_count());
+	c = uk_memalign(a, __alignof__(struct schedmp), sizeof(*c));
+	if (!c)
+		goto err_out;
+	memset(c, 0, sizeof(*c));
+
+	c->lcpu_count = ukplat_lcpu_count();
+	for (i = 0; i < c->lcpu_count; i++) {
+		rc = schedmp_lcpu_init(a, c, &c->lcpu[i], i);
+		if (rc < 0) {
+			uk_pr_err("Failed to initialize CPU %u: %d\n",
+				  (unsigned int) i, rc);
+			goto err_free_lcpus;
+		}
+	}
+	/* The boot CPU is already up */
+	c->lcpu[0].online = 1;
+
+	uk_sched_init(&c->sched,
+		      schedmp_start,
+		      schedmp_schedule,
+		      schedmp_thread_add,
+		      schedmp_thread_remove,
+		      schedmp_thread_blocked,
+		      schedmp_thread_woken,
+		      a);
+	c->sched.thread_set_affinity = schedmp_thread_set_affinity;
+
+	/* Add idle threads to the scheduler's thread list */
+	for (i = 0; i < c->lcpu_count; i++)
+		UK_TAILQ_INSERT_TAIL(&c->sched.thread_list,
+				     &c->lcpu[i].idle, thread_list);
+
+	schedmp_instance = c;
+	return &c->sched;
+
+err_free_lcpus:
+	while (i-- > 0)
+		schedmp_lcpu_free(a, &c->lcpu[i]);
+	uk_free(a, c);
+err_out:
+	return NULL;
+}
@@ -0,0 +1,224 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <uk/arch/atomic.h>
+#include <uk/bitmap.h>
+#include <uk/essentials.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/wait.h>
+#include <uk/test.h>
+
+#define BENCH_PINGPONG_ROUNDS	100000
+#define BENCH_FAN_ROUNDS	1000
+#define BENCH_FAN_WORK		20000	/* iterations per worker and round */
+
+/* Restricts a thread to one logical CPU or, with `lcpu < 0`, to all */
+static int bench_pin(struct uk_thread *t, int lcpu)
+{
+	unsigned long mask[UK_SCHED_LCPU_MASK_LONGS];
+
+	uk_bitmap_zero(mask, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	if (lcpu < 0)
+		uk_bitmap_set(mask, 0, ukplat_lcpu_count());
+	else
+		uk_bitmap_set(mask, lcpu, 1);
+	return uk_sched_thread_set_affinity(t, mask);
+}
+
+/*
+ * Ping-pong: two threads hand a token back and forth, each one sleeping
+ * on its own wait queue until it gets the token.
+ */
+struct bench_pingpong {
+	struct uk_waitq wq[2];
+	unsigned int turn;
+	unsigned int done;
+};
+
+struct bench_pingpong_player {
+	struct bench_pingpong *pp;
+	unsigned int id;
+};
+
+static __noreturn void bench_pingpong_fn(void *arg)
+{
+	struct bench_pingpong_player *p = (struct bench_pingpong_player *) arg;
+	struct bench_pingpong *pp = p->pp;
+	unsigned int i;
+
+	for (i = 0; i < BENCH_PINGPONG_ROUNDS; i++) {
+		uk_waitq_wait_event(&pp->wq[p->id],
+				    UK_READ_ONCE(pp->turn) == p->id);
+		UK_WRITE_ONCE(pp->turn, !p->id);
+		uk_waitq_wake_up(&pp->wq[!p->id]);
+	}
+
+	ukarch_inc(&pp->done);
+	uk_sched_thread_exit();
+}
+
+/* Returns the time per round trip in nanoseconds */
+static unsigned long bench_pingpong_run(int lcpu0, int lcpu1)
+{
+	struct bench_pingpong_player p[2];
+	struct bench_pingpong pp;
+	struct uk_thread *t[2];
+	__nsec start, elapsed;
+	unsigned int i;
+
+	uk_waitq_init(&pp.wq[0]);
+	uk_waitq_init(&pp.wq[1]);
+	pp.turn = 0;
+	pp.done = 0;
+
+	start = ukplat_monotonic_clock();
+	for (i = 0; i < 2; i++) {
+		p[i] = (struct bench_pingpong_player) { .pp = &pp, .id = i };
+		t[i] = uk_sched_thread_create(uk_sched_current(),
+					      bench_pingpong_fn, &p[i],
+					      "bench-pingpong");
+		if (!t[i])
+			return 0;
+		bench_pin(t[i], i ? lcpu1 : lcpu0);
+	}
+	while (UK_READ_ONCE(pp.done) < 2)
+		uk_sched_yield();
+	elapsed = ukplat_monotonic_clock() - start;
+
+	return (unsigned long) (elapsed / BENCH_PINGPONG_ROUNDS);
+}
+
+UK_TESTCASE(ukschedmp_benchsuite, ukschedmp_bench_pingpong)
+{
+	unsigned long ns;
+
+	ns = bench_pingpong_run(0, 0);
+	UK_TEST_EXPECT_NOT_ZERO(ns);
+	uk_test_printf("ping-pong on one CPU: %lu ns/round trip\n", ns);
+
+	if (ukplat_lcpu_count() < 2)
+		return;
+
+	ns = bench_pingpong_run(0, 1);
+	UK_TEST_EXPECT_NOT_ZERO(ns);
+	uk_test_printf("ping-pong across CPUs: %lu ns/round trip\n", ns);
+}
+
+/*
+ * Fan-out/fan-in: the test thread starts a round by waking all workers,
+ * each worker computes for a while and the last one to finish wakes the
+ * test thread up again.
+ */
+struct bench_fan {
+	struct uk_waitq start_wq;
+	struct uk_waitq done_wq;
+	unsigned int round;
+	unsigned int pending;
+	unsigned int exited;
+	unsigned long sink;
+};
+
+static __noreturn void bench_fan_fn(void *arg)
+{
+	struct bench_fan *f = (struct bench_fan *) arg;
+	unsigned long x = 1;
+	unsigned int round, i;
+
+	for (round = 1; round <= BENCH_FAN_ROUNDS; round++) {
+		uk_waitq_wait_event(&f->start_wq,
+				    UK_READ_ONCE(f->round) >= round);
+
+		for (i = 0; i < BENCH_FAN_WORK; i++)
+			x = x * 6364136223846793005UL + 1442695040888963407UL;
+
+		if (ukarch_dec(&f->pending) == 1)
+			uk_waitq_wake_up(&f->done_wq);
+	}
+
+	ukarch_fetch_add(&f->sink, x);
+	ukarch_inc(&f->exited);
+	uk_sched_thread_exit();
+}
+
+/* Returns the time per round in nanoseconds */
+static unsigned long bench_fan_run(unsigned int workers, int lcpu)
+{
+	struct bench_fan f = { 0 };
+	struct uk_thread *t;
+	__nsec start, elapsed;
+	unsigned int i;
+
+	uk_waitq_init(&f.start_wq);
+	uk_waitq_init(&f.done_wq);
+
+	for (i = 0; i < workers; i++) {
+		t = uk_sched_thread_create(uk_sched_current(), bench_fan_fn,
+					   &f, "bench-fan");
+		if (!t)
+			return 0;
+		bench_pin(t, lcpu);
+	}
+
+	start = ukplat_monotonic_clock();
+	for (i = 1; i <= BENCH_FAN_ROUNDS; i++) {
+		UK_WRITE_ONCE(f.pending, workers);
+		UK_WRITE_ONCE(f.round, i);
+		uk_waitq_wake_up(&f.start_wq);
+		uk_waitq_wait_event(&f.done_wq, !UK_READ_ONCE(f.pending));
+	}
+	elapsed = ukplat_monotonic_clock() - start;
+
+	while (UK_READ_ONCE(f.exited) < workers)
+		uk_sched_yield();
+
+	return (unsigned long) (elapsed / BENCH_FAN_ROUNDS);
+}
+
+UK_TESTCASE(ukschedmp_benchsuite, ukschedmp_bench_fan)
+{
+	unsigned int workers = ukplat_lcpu_count();
+	unsigned long one, all;
+
+	one = bench_fan_run(workers, 0);
+	UK_TEST_EXPECT_NOT_ZERO(one);
+	all = bench_fan_run(workers, -1);
+	UK_TEST_EXPECT_NOT_ZERO(all);
+
+	uk_test_printf("fan-out/fan-in, %u workers: %lu ns/round on one CPU, "
+		       "%lu ns/round on %u CPUs (speedup %lu.%02lu)\n",
+		       workers, one, all, ukplat_lcpu_count(),
+		       all ? one / all : 0UL,
+		       all ? (one * 100 / all) % 100 : 0UL);
+}
+
+uk_testsuite_register(ukschedmp_benchsuite, NULL);
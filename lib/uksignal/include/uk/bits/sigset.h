@@ -50,6 +50,7 @@ extern "C" {
 #define uk_sigcopyset(ptr1, ptr2) (*(ptr1) = *(ptr2))
 #define uk_sigandset(ptr1, ptr2)  (*(ptr1) &= *(ptr2))
 #define uk_sigorset(ptr1, ptr2)	  (*(ptr1) |= *(ptr2))
+#define uk_sigxorset(ptr1, ptr2)  (*(ptr1) ^= *(ptr2))
 #define uk_sigreverseset(ptr)	  (*(ptr) = ~(*(ptr)))
 #define uk_sigismember(ptr, signo) (*(ptr) & (1 << ((signo) - 1)))
 #define uk_sigisempty(ptr) (*(ptr) == 0)
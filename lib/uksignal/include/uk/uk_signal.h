@@ -37,6 +37,8 @@
 #ifndef __UK_UK_SIGNAL_H__
 #define __UK_UK_SIGNAL_H__
 
+#include <uk/config.h>
+#include <uk/essentials.h>
 #include <uk/list.h>
 #include <uk/bits/sigset.h>
 #include <signal.h>
@@ -67,6 +69,12 @@ struct uk_proc_sig {
 	struct sigaction sigaction[NSIG - 1];
 	/* list of uk_thread_sig from the threads of the proc */
 	struct uk_list_head thread_sig_list;
+	/*
+	 * per signal, list of uk_thread_sig from the threads that do not
+	 * block the signal; used to find a receiver without scanning
+	 * all threads
+	 */
+	struct uk_list_head unblocked[NSIG - 1];
 };
 
 extern struct uk_proc_sig uk_proc_sig;
@@ -105,6 +113,11 @@ struct uk_thread_sig {
 	struct uk_thread_sig_wait wait;
 	/* node for the thread_sig_list from the proc */
 	struct uk_list_head list_node;
+	/*
+	 * per signal, node for the unblocked list from the proc;
+	 * linked iff the signal is not in mask
+	 */
+	struct uk_list_head unblocked_node[NSIG - 1];
 };
 
 /* returns number of executed signal handlers */
@@ -137,6 +150,26 @@ static inline void uk_remove_proc_signal(int sig)
 	uk_sigdelset(&uk_proc_sig.pending, sig);
 }
 
+/*
+ * Sets the signal mask of a thread. Every change of a thread's mask must
+ * go through this function to keep the unblocked lists of the proc
+ * up to date.
+ */
+void uk_sig_set_mask(struct uk_thread_sig *th_sig, const sigset_t *mask);
+
+/*
+ * returns a thread that does not block sig, or NULL if all
+ * threads block it
+ */
+struct uk_thread_sig *uk_sig_get_unblocked(int sig);
+
+#if CONFIG_LIBUKSIGNAL_SIGNALFD
+/* Notifies signalfds that sig became pending */
+void uk_signalfd_notify(int sig);
+#else
+static inline void uk_signalfd_notify(int sig __unused) {}
+#endif
+
 /* maybe move to sched */
 struct uk_thread_sig *uk_crr_thread_sig_container(void);
 void uk_sig_init_siginfo(siginfo_t *siginfo, int sig);
@@ -44,7 +44,9 @@
 #include <uk/essentials.h>
 #include <uk/process.h>
 #include <unistd.h>
+#include <time.h>
 #include <uk/syscall.h>
+#include <uk/plat/time.h>
 
 /*
  * Tries to deliver a pending signal to the current thread
@@ -185,7 +187,7 @@ int sigsuspend(const sigset_t *mask)
 {
 	/* If the signals are ignored, this doesn't return <- POSIX */
 
-	sigset_t cleaned_mask, tmp;
+	sigset_t cleaned_mask, tmp, awaited_prev;
 	struct uk_thread_sig *ptr;
 
 	uk_sigcopyset(&cleaned_mask, mask);
@@ -193,6 +195,7 @@ int sigsuspend(const sigset_t *mask)
 
 	ptr = _UK_TH_SIG;
 
+	uk_sigcopyset(&awaited_prev, &ptr->wait.awaited);
 	uk_sigcopyset(&ptr->wait.awaited, &cleaned_mask);
 
 	/* we are waiting for all the signals that aren't blocked */
@@ -200,7 +203,7 @@ int sigsuspend(const sigset_t *mask)
 
 	/* change mask */
 	uk_sigcopyset(&tmp, &ptr->mask);
-	uk_sigcopyset(&ptr->mask, &cleaned_mask);
+	uk_sig_set_mask(ptr, &cleaned_mask);
 
 	while (1) {
 		/* try to deliver a pending signal */
@@ -214,6 +217,7 @@ int sigsuspend(const sigset_t *mask)
 	}
 
 	ptr->wait.status = UK_SIG_NOT_WAITING;
+	uk_sigcopyset(&ptr->wait.awaited, &awaited_prev);
 
 	/* execute handler */
 	uk_execute_handler(ptr->wait.received_signal);
@@ -223,7 +227,7 @@ int sigsuspend(const sigset_t *mask)
 	 * We restore the mask here because we are technically done with
 	 * sigsuspend and the mask must be restored at the end of sigsuspend
 	 */
-	uk_sigcopyset(&ptr->mask, &tmp);
+	uk_sig_set_mask(ptr, &tmp);
 
 	/* execute other pending signals */
 	uk_sig_handle_signals();
@@ -232,7 +236,18 @@ int sigsuspend(const sigset_t *mask)
 	return -1; /* always returns -1 and sets errno to EINTR */
 }
 
-int sigwait(const sigset_t *set, int *sig)
+/*
+ * Waits until one of the signals in set is pending and removes it.
+ * A zero deadline waits forever.
+ *
+ * The awaited signals are unblocked while waiting, so that kill() can
+ * pick this thread as receiver. Their handlers are not executed since
+ * uk_sig_handle_signals() is not run for awaited signals.
+ *
+ * Returns the signal number, -EAGAIN if the deadline has passed, or
+ * -EINVAL if set contains no signal that can be waited for
+ */
+static int uk_sig_wait(const sigset_t *set, siginfo_t *info, __nsec deadline)
 {
 	/*
 	 * If the signals are ignored, this doesn't return <- TODO: POSIX ??
@@ -245,23 +260,32 @@ int sigwait(const sigset_t *set, int *sig)
 	 * NOTE: this function is not signal safe
 	 */
 
-	int signals_executed;
-	sigset_t cleaned_set, awaited_save;
+	int signals_executed, ret = 0;
+	sigset_t cleaned_set, awaited_save, awaited_prev, mask_save, mask;
 	struct uk_thread_sig *ptr;
 
 	uk_sigcopyset(&cleaned_set, set);
 	uk_sigset_remove_unmaskable(&cleaned_set);
 
 	if (uk_sigisempty(&cleaned_set))
-		return EINVAL;
+		return -EINVAL;
 
 	ptr = _UK_TH_SIG;
 
+	/* we might be waiting inside a handler run by another waiting */
+	uk_sigcopyset(&awaited_prev, &ptr->wait.awaited);
 	uk_sigcopyset(&ptr->wait.awaited, &cleaned_set);
 
 	/* save awaited signals */
 	awaited_save = ptr->wait.awaited;
 
+	/* unblock awaited signals */
+	uk_sigcopyset(&mask_save, &ptr->mask);
+	uk_sigcopyset(&mask, &cleaned_set);
+	uk_sigreverseset(&mask);
+	uk_sigandset(&mask, &mask_save);
+	uk_sig_set_mask(ptr, &mask);
+
 	while (1) {
 		if (uk_get_awaited_signal())
 			break;
@@ -288,27 +312,90 @@ int sigwait(const sigset_t *set, int *sig)
 				break;
 		}
 
+		if (deadline && ukplat_monotonic_clock() >= deadline) {
+			ret = -EAGAIN;
+			break;
+		}
+
 		/* block, yield */
-		uk_thread_block(uk_thread_current());
+		uk_thread_block_until(uk_thread_current(), deadline);
 		ptr->wait.status = UK_SIG_WAITING;
 		uk_sched_yield();
 	}
 
 	ptr->wait.status = UK_SIG_NOT_WAITING;
+	uk_sigcopyset(&ptr->wait.awaited, &awaited_prev);
+	uk_sig_set_mask(ptr, &mask_save);
 
 	/* do not execute handler, set received signal */
-	*sig = ptr->wait.received_signal.si_signo;
+	if (!ret) {
+		ret = ptr->wait.received_signal.si_signo;
+		if (info)
+			*info = ptr->wait.received_signal;
+	}
 
 	/* execute other pending signals */
 	uk_sig_handle_signals();
 
-	return 0; /* returns positive errno */
+	return ret;
+}
+
+int sigwait(const sigset_t *set, int *sig)
+{
+	int ret;
+
+	ret = uk_sig_wait(set, NULL, 0);
+	if (ret < 0)
+		return -ret; /* returns positive errno */
+
+	*sig = ret;
+	return 0;
 }
 
+UK_SYSCALL_R_DEFINE(int, rt_sigtimedwait, const sigset_t *, set,
+		    siginfo_t *, info, const struct timespec *, timeout,
+		    size_t, sigsetsize)
+{
+	__nsec deadline = 0;
+
+	if (sigsetsize != sizeof(sigset_t))
+		return -EINVAL;
+
+	if (timeout) {
+		if (timeout->tv_sec < 0 || timeout->tv_nsec < 0 ||
+		    timeout->tv_nsec >= (long)ukarch_time_sec_to_nsec(1))
+			return -EINVAL;
+
+		/* a zero timeout polls: a deadline in the past */
+		deadline = ukplat_monotonic_clock() +
+			   ukarch_time_sec_to_nsec(timeout->tv_sec) +
+			   timeout->tv_nsec;
+		if (!deadline)
+			deadline = 1;
+	}
+
+	return uk_sig_wait(set, info, deadline);
+}
+
+#if UK_LIBC_SYSCALLS
+int sigtimedwait(const sigset_t *set, siginfo_t *info,
+		 const struct timespec *timeout)
+{
+	return uk_syscall_e_rt_sigtimedwait((long)set, (long)info,
+					    (long)timeout, sizeof(sigset_t));
+}
+
+int sigwaitinfo(const sigset_t *set, siginfo_t *info)
+{
+	return uk_syscall_e_rt_sigtimedwait((long)set, (long)info, 0,
+					    sizeof(sigset_t));
+}
+#endif /* UK_LIBC_SYSCALLS */
+
 /*
- * Search for a thread that does not have the signal blocked
- * If all of the threads have the signal blocked, add it to process
- * pending signals
+ * Deliver the signal to a thread that does not have it blocked, preferably
+ * the calling thread. If all of the threads have the signal blocked, add it
+ * to process pending signals
  */
 int kill(pid_t pid, int sig)
 {
@@ -318,12 +405,9 @@ int kill(pid_t pid, int sig)
 	 * has it unblocked or is waiting for it in sigwait(3), at least one
 	 * unblocked signal must be delivered to the sending thread before the
 	 * kill() returns.
-	 *
-	 * FIXME: we don't implement this ^
 	 */
 
 	siginfo_t siginfo;
-	struct uk_list_head *i;
 	struct uk_thread_sig *th_sig;
 
 
@@ -340,22 +424,33 @@ int kill(pid_t pid, int sig)
 	/* setup siginfo */
 	uk_sig_init_siginfo(&siginfo, sig);
 
-	uk_list_for_each(i, &uk_proc_sig.thread_sig_list) {
-		th_sig = uk_list_entry(i, struct uk_thread_sig, list_node);
+	th_sig = _UK_TH_SIG;
+	if (uk_sigismember(&th_sig->mask, sig))
+		th_sig = uk_sig_get_unblocked(sig);
 
-		if (uk_deliver_proc_signal(th_sig, &siginfo) > 0)
-			return 0;
+	if (!th_sig) {
+		/* didn't find any thread that could accept this signal */
+		uk_add_proc_signal(&siginfo);
+		uk_signalfd_notify(sig);
+		return 0;
 	}
 
-	/* didn't find any thread that could accept this signal */
-	uk_add_proc_signal(&siginfo);
+	if (uk_deliver_proc_signal(th_sig, &siginfo) > 0 &&
+	    th_sig == _UK_TH_SIG)
+		uk_sig_handle_signals();
 
 	return 0;
 }
 
 int killpg(int pgrp, int sig)
 {
-	if (pgrp != UNIKRAFT_PGID || pgrp != 0) {
+	if (pgrp < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* 0 stands for the process group of the caller */
+	if (pgrp != 0 && pgrp != uk_syscall_r_getpgrp()) {
 		errno = ESRCH;
 		return -1;
 	}
@@ -0,0 +1,476 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <vfscore/eventpoll.h>
+#include <vfscore/fs.h>
+#include <vfscore/file.h>
+#include <vfscore/dentry.h>
+#include <vfscore/vnode.h>
+#include <vfscore/mount.h>
+#include <vfscore/uio.h>
+#include <uk/uk_signal.h>
+#include <uk/syscall.h>
+#include <uk/essentials.h>
+#include <uk/alloc.h>
+#include <uk/list.h>
+#include <uk/wait.h>
+#include <uk/mutex.h>
+
+#include <sys/signalfd.h>
+#include <string.h>
+#include <errno.h>
+
+struct signalfd {
+	/** Signals accepted by this signalfd */
+	sigset_t mask;
+	/** Wait queue for blocked readers */
+	struct uk_waitq wq;
+	/** List of registered eventpolls */
+	struct uk_list_head ep_list;
+	/** Node in the list of all signalfds */
+	struct uk_list_head list_node;
+};
+
+static uint64_t s_inode;
+
+/*
+ * Protects the list of signalfds, their masks, wait queues, and eventpoll
+ * lists. Signals are notified with this lock held, so a reader that checks
+ * for pending signals with the lock held cannot miss a wakeup.
+ */
+static struct uk_mutex signalfd_lock = UK_MUTEX_INITIALIZER(signalfd_lock);
+static UK_LIST_HEAD(signalfd_list);
+
+static void signalfd_set_mask(struct signalfd *sfd, const sigset_t *mask)
+{
+	uk_sigcopyset(&sfd->mask, mask);
+
+	/* SIGKILL and SIGSTOP cannot be read from a signalfd */
+	uk_sigset_remove_unmaskable(&sfd->mask);
+}
+
+/* Returns non-zero if a signal from the mask is pending for the caller */
+static int signalfd_pending(struct signalfd *sfd)
+{
+	sigset_t pending;
+
+	uk_sigcopyset(&pending, &_UK_TH_SIG->pending);
+	uk_sigorset(&pending, &uk_proc_sig.pending);
+	uk_sigandset(&pending, &sfd->mask);
+
+	return !uk_sigisempty(&pending);
+}
+
+/*
+ * Removes a signal from the mask from the pending signals of the calling
+ * thread or, if there is none, of the process
+ */
+static int signalfd_dequeue(struct signalfd *sfd, siginfo_t *info)
+{
+	struct uk_thread_sig *ptr = _UK_TH_SIG;
+	struct uk_signal *signal;
+	siginfo_t *siginfo;
+
+	signal = uk_sig_th_get_pending_any(ptr, sfd->mask);
+	if (signal) {
+		*info = signal->info;
+
+		uk_list_del(&signal->list_node);
+		uk_sigdelset(&ptr->pending, info->si_signo);
+		uk_free(uk_alloc_get_default(), signal);
+		return 1;
+	}
+
+	siginfo = uk_sig_proc_get_pending_any(sfd->mask);
+	if (siginfo) {
+		*info = *siginfo;
+
+		uk_remove_proc_signal(info->si_signo);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void signalfd_signal_eventpoll(struct signalfd *sfd,
+				      unsigned int events)
+{
+	struct eventpoll_cb *ecb;
+	struct uk_list_head *itr;
+
+	uk_list_for_each(itr, &sfd->ep_list) {
+		ecb = uk_list_entry(itr, struct eventpoll_cb, cb_link);
+
+		UK_ASSERT(ecb->unregister);
+
+		eventpoll_signal(ecb, events);
+	}
+}
+
+void uk_signalfd_notify(int sig)
+{
+	struct signalfd *sfd;
+
+	/* Nobody to notify; the common case for signal delivery */
+	if (UK_READ_ONCE(signalfd_list.next) == &signalfd_list)
+		return;
+
+	uk_mutex_lock(&signalfd_lock);
+	uk_list_for_each_entry(sfd, &signalfd_list, list_node) {
+		if (!uk_sigismember(&sfd->mask, sig))
+			continue;
+
+		uk_waitq_wake_up(&sfd->wq);
+		signalfd_signal_eventpoll(sfd, EPOLLIN);
+	}
+	uk_mutex_unlock(&signalfd_lock);
+}
+
+static int signalfd_vfscore_close(struct vnode *vnode,
+				  struct vfscore_file *fp __unused)
+{
+	struct signalfd *sfd;
+
+	UK_ASSERT(vnode->v_data);
+	UK_ASSERT(vnode->v_type == VSIGFD);
+
+	sfd = (struct signalfd *)vnode->v_data;
+
+	uk_mutex_lock(&signalfd_lock);
+	uk_list_del(&sfd->list_node);
+	uk_mutex_unlock(&signalfd_lock);
+
+	uk_free(uk_alloc_get_default(), sfd);
+
+	vnode->v_data = NULL;
+	return 0;
+}
+
+static int signalfd_vfscore_read(struct vnode *vnode,
+				 struct vfscore_file *fp,
+				 struct uio *buf, int ioflag __unused)
+{
+	struct signalfd *sfd = (struct signalfd *)vnode->v_data;
+	struct uk_mutex *lock = &signalfd_lock;
+	struct signalfd_siginfo ssi;
+	siginfo_t info;
+	int ret;
+
+	UK_ASSERT(vnode->v_data);
+	UK_ASSERT(vnode->v_type == VSIGFD);
+
+	if (buf->uio_resid < (ssize_t)sizeof(ssi))
+		return EINVAL;
+
+	uk_mutex_lock(&signalfd_lock);
+	if (!signalfd_dequeue(sfd, &info)) {
+		/* Nothing pending. Block if the file descriptor is not
+		 * configured to non-blocking operation.
+		 */
+		if (fp->f_flags & O_NONBLOCK) {
+			uk_mutex_unlock(&signalfd_lock);
+			return EAGAIN;
+		}
+
+		uk_waitq_wait_event_mutex(&sfd->wq, signalfd_pending(sfd),
+					  lock);
+		ret = signalfd_dequeue(sfd, &info);
+		UK_ASSERT(ret);
+	}
+
+	/* Return as many signals as fit into the buffer */
+	do {
+		memset(&ssi, 0, sizeof(ssi));
+		ssi.ssi_signo = info.si_signo;
+		ssi.ssi_code = info.si_code;
+		ssi.ssi_pid = info.si_pid;
+
+		ret = vfscore_uiomove(&ssi, sizeof(ssi), buf);
+		if (unlikely(ret))
+			break;
+	} while (buf->uio_resid >= (ssize_t)sizeof(ssi) &&
+		 signalfd_dequeue(sfd, &info));
+	uk_mutex_unlock(&signalfd_lock);
+
+	return ret;
+}
+
+static void signalfd_unregister_eventpoll(struct eventpoll_cb *ecb)
+{
+	UK_ASSERT(ecb);
+
+	uk_mutex_lock(&signalfd_lock);
+	UK_ASSERT(!uk_list_empty(&ecb->cb_link));
+	uk_list_del(&ecb->cb_link);
+
+	ecb->data = NULL;
+	ecb->unregister = NULL;
+	uk_mutex_unlock(&signalfd_lock);
+}
+
+static int signalfd_vfscore_poll(struct vnode *vnode, unsigned int *revents,
+				 struct eventpoll_cb *ecb)
+{
+	struct signalfd *sfd = (struct signalfd *)vnode->v_data;
+
+	UK_ASSERT(vnode->v_data);
+	UK_ASSERT(vnode->v_type == VSIGFD);
+
+	uk_mutex_lock(&signalfd_lock);
+	if (!ecb->unregister) {
+		UK_ASSERT(uk_list_empty(&ecb->cb_link));
+		UK_ASSERT(!ecb->data);
+
+		/* This is the first time we see this cb. Add it to the
+		 * eventpoll list and set the unregister callback so
+		 * we remove it when the eventpoll is freed.
+		 */
+		uk_list_add_tail(&ecb->cb_link, &sfd->ep_list);
+
+		ecb->data = sfd;
+		ecb->unregister = signalfd_unregister_eventpoll;
+	}
+
+	/* As on Linux, readiness refers to the signals of the caller */
+	*revents = signalfd_pending(sfd) ? EPOLLIN : 0;
+	uk_mutex_unlock(&signalfd_lock);
+
+	return 0;
+}
+
+/* vnode operations */
+#define signalfd_vfscore_write ((vnop_write_t) vfscore_vop_einval)
+#define signalfd_vfscore_inactive ((vnop_inactive_t) vfscore_vop_einval)
+
+static struct vnops signalfd_vnops = {
+	.vop_close = signalfd_vfscore_close,
+	.vop_inactive = signalfd_vfscore_inactive,
+	.vop_read = signalfd_vfscore_read,
+	.vop_write = signalfd_vfscore_write,
+	.vop_poll = signalfd_vfscore_poll
+};
+
+/* file system operations */
+#define signalfd_vget ((vfsop_vget_t) vfscore_nullop)
+
+static struct vfsops signalfd_vfsops = {
+	.vfs_vget = signalfd_vget,
+	.vfs_vnops = &signalfd_vnops
+};
+
+/* bogus mount point used by all signalfd objects */
+static struct mount signalfd_mount = {
+	.m_op = &signalfd_vfsops
+};
+
+/* Changes the mask of an existing signalfd */
+static int signalfd_update(int fd, const sigset_t *mask)
+{
+	struct vfscore_file *fp;
+	struct signalfd *sfd;
+	struct vnode *vnode;
+	int ret;
+
+	fp = vfscore_get_file(fd);
+	if (!fp)
+		return -EBADF;
+
+	if (!fp->f_dentry) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	vnode = fp->f_dentry->d_vnode;
+	if (vnode->v_op != &signalfd_vnops) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	sfd = (struct signalfd *)vnode->v_data;
+
+	uk_mutex_lock(&signalfd_lock);
+	signalfd_set_mask(sfd, mask);
+
+	/* Signals of the new mask might be pending already */
+	uk_waitq_wake_up(&sfd->wq);
+	signalfd_signal_eventpoll(sfd, EPOLLIN);
+	uk_mutex_unlock(&signalfd_lock);
+
+	ret = fd;
+out:
+	vfscore_put_file(fp);
+	return ret;
+}
+
+static int do_signalfd(struct uk_alloc *a, int fd, const sigset_t *mask,
+		       int flags)
+{
+	int vfs_fd, ret;
+	struct signalfd *sfd;
+	struct vfscore_file *vfs_file;
+	struct dentry *vfs_dentry;
+	struct vnode *vfs_vnode;
+
+	if (flags & ~(SFD_CLOEXEC | SFD_NONBLOCK))
+		return -EINVAL;
+
+	if (!mask)
+		return -EFAULT;
+
+	if (fd != -1)
+		return signalfd_update(fd, mask);
+
+	/* Reserve a file descriptor number */
+	vfs_fd = vfscore_alloc_fd();
+	if (vfs_fd < 0) {
+		ret = -ENFILE;
+		goto ERR_EXIT;
+	}
+
+	/* Allocate file, vfs_file, and vnode */
+	sfd = uk_malloc(a, sizeof(struct signalfd));
+	if (!sfd) {
+		ret = -ENOMEM;
+		goto ERR_MALLOC_FILE;
+	}
+
+	vfs_file = uk_malloc(a, sizeof(struct vfscore_file));
+	if (!vfs_file) {
+		ret = -ENOMEM;
+		goto ERR_MALLOC_VFS_FILE;
+	}
+
+	ret = vfscore_vget(&signalfd_mount,
+			   __atomic_fetch_add(&s_inode, 1, __ATOMIC_RELAXED),
+			   &vfs_vnode);
+	UK_ASSERT(ret == 0); /* we should not find it in the cache */
+	if (!vfs_vnode) {
+		ret = -ENOMEM;
+		goto ERR_ALLOC_VNODE;
+	}
+
+	/*
+	 * It doesn't matter that all the dentries have the same path since
+	 * we never look them up.
+	 */
+	vfs_dentry = dentry_alloc(NULL, vfs_vnode, "/");
+	if (!vfs_dentry) {
+		ret = -ENOMEM;
+		goto ERR_ALLOC_DENTRY;
+	}
+
+	/* Initialize data structures */
+	vfs_file->fd = vfs_fd;
+	vfs_file->f_flags = UK_FREAD;
+	if (flags & SFD_NONBLOCK)
+		vfs_file->f_flags |= O_NONBLOCK;
+	vfs_file->f_count = 1;
+	vfs_file->f_data = sfd;
+	vfs_file->f_dentry = vfs_dentry;
+	vfs_file->f_vfs_flags = UK_VFSCORE_NOPOS;
+	vfs_file->f_offset = 0;
+
+	uk_mutex_init(&vfs_file->f_lock);
+	UK_INIT_LIST_HEAD(&vfs_file->f_ep);
+
+	vfs_vnode->v_data = sfd;
+	vfs_vnode->v_type = VSIGFD;
+
+	signalfd_set_mask(sfd, mask);
+	uk_waitq_init(&sfd->wq);
+	UK_INIT_LIST_HEAD(&sfd->ep_list);
+
+	uk_mutex_lock(&signalfd_lock);
+	uk_list_add_tail(&sfd->list_node, &signalfd_list);
+	uk_mutex_unlock(&signalfd_lock);
+
+	/* Store within the vfs structure */
+	ret = vfscore_install_fd(vfs_fd, vfs_file);
+	if (ret)
+		goto ERR_VFS_INSTALL;
+
+	/* Only the dentry should hold a reference; release ours */
+	vput(vfs_vnode);
+
+	return vfs_fd;
+
+ERR_VFS_INSTALL:
+	uk_mutex_lock(&signalfd_lock);
+	uk_list_del(&sfd->list_node);
+	uk_mutex_unlock(&signalfd_lock);
+	drele(vfs_dentry);
+ERR_ALLOC_DENTRY:
+	vput(vfs_vnode);
+ERR_ALLOC_VNODE:
+	uk_free(a, vfs_file);
+ERR_MALLOC_VFS_FILE:
+	uk_free(a, sfd);
+ERR_MALLOC_FILE:
+	vfscore_put_fd(vfs_fd);
+ERR_EXIT:
+	UK_ASSERT(ret < 0);
+	return ret;
+}
+
+UK_SYSCALL_R_DEFINE(int, signalfd4, int, fd, const sigset_t *, mask,
+		    size_t, sizemask, int, flags)
+{
+	if (sizemask != sizeof(sigset_t))
+		return -EINVAL;
+
+	return do_signalfd(uk_alloc_get_default(), fd, mask, flags);
+}
+
+UK_LLSYSCALL_R_DEFINE(int, signalfd, int, fd, const sigset_t *, mask,
+		      size_t, sizemask)
+{
+	if (sizemask != sizeof(sigset_t))
+		return -EINVAL;
+
+	return do_signalfd(uk_alloc_get_default(), fd, mask, 0);
+}
+
+#if UK_LIBC_SYSCALLS
+/* The actual system call implemented in Linux uses a different signature! We
+ * thus provide the libc call here directly.
+ */
+int signalfd(int fd, const sigset_t *mask, int flags)
+{
+	int ret;
+
+	ret = do_signalfd(uk_alloc_get_default(), fd, mask, flags);
+	if (ret < 0) {
+		errno = -ret;
+		ret = -1;
+	}
+
+	return ret;
+}
+#endif /* UK_LIBC_SYSCALLS */
@@ -0,0 +1,230 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/sched.h>
+#include <uk/syscall.h>
+#include <uk/thread.h>
+#include <uk/uk_signal.h>
+#include <uk/test.h>
+#if CONFIG_LIBUKSIGNAL_SIGNALFD
+#include <fcntl.h>
+#include <sys/signalfd.h>
+#endif /* CONFIG_LIBUKSIGNAL_SIGNALFD */
+
+static long sig_timedwait(const sigset_t *set, siginfo_t *info,
+			  const struct timespec *timeout)
+{
+	return uk_syscall_r_rt_sigtimedwait((long) set, (long) info,
+					    (long) timeout, sizeof(*set));
+}
+
+struct sig_waiter {
+	struct uk_thread *thread;
+	long rc;
+	int done;
+};
+
+static __noreturn void sig_waiter_fn(void *arg)
+{
+	struct sig_waiter *w = (struct sig_waiter *) arg;
+	struct timespec ts = { .tv_sec = 1 };
+	sigset_t set;
+
+	/* Keep the signal pending until we wait for it */
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR2);
+	sigprocmask(SIG_BLOCK, &set, NULL);
+
+	w->rc = sig_timedwait(&set, NULL, &ts);
+	UK_WRITE_ONCE(w->done, 1);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(uksignal_testsuite, uksignal_test_sigtimedwait)
+{
+	struct timespec ts = { 0 };
+	struct sig_waiter w = { 0 };
+	sigset_t set, old;
+	siginfo_t info;
+	__nsec start;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	UK_TEST_EXPECT_ZERO(sigprocmask(SIG_BLOCK, &set, &old));
+
+	/* A zero timeout polls */
+	UK_TEST_EXPECT_SNUM_EQ(sig_timedwait(&set, NULL, &ts), -EAGAIN);
+
+	/* Otherwise the call gives up after the timeout */
+	ts.tv_nsec = ukarch_time_msec_to_nsec(2);
+	start = ukplat_monotonic_clock();
+	UK_TEST_EXPECT_SNUM_EQ(sig_timedwait(&set, NULL, &ts), -EAGAIN);
+	UK_TEST_EXPECT_SNUM_GE(ukplat_monotonic_clock() - start,
+			       ukarch_time_msec_to_nsec(2));
+
+	/* A pending signal is returned right away, without its handler */
+	UK_TEST_EXPECT_ZERO(raise(SIGUSR1));
+	UK_TEST_EXPECT_SNUM_EQ(sig_timedwait(&set, &info, &ts), SIGUSR1);
+	UK_TEST_EXPECT_SNUM_EQ(info.si_signo, SIGUSR1);
+	UK_TEST_EXPECT_SNUM_EQ(sig_timedwait(&set, NULL, &ts), -EAGAIN);
+
+	/* Invalid arguments */
+	ts.tv_nsec = ukarch_time_sec_to_nsec(1);
+	UK_TEST_EXPECT_SNUM_EQ(sig_timedwait(&set, NULL, &ts), -EINVAL);
+	ts.tv_nsec = 0;
+	UK_TEST_EXPECT_SNUM_EQ(uk_syscall_r_rt_sigtimedwait((long) &set, 0,
+							    (long) &ts, 1),
+			       -EINVAL);
+	sigemptyset(&set);
+	sigaddset(&set, SIGKILL);
+	UK_TEST_EXPECT_SNUM_EQ(sig_timedwait(&set, NULL, &ts), -EINVAL);
+
+	UK_TEST_EXPECT_ZERO(sigprocmask(SIG_SETMASK, &old, NULL));
+
+	/* A signal sent to a waiting thread ends the wait */
+	w.thread = uk_sched_thread_create(uk_sched_current(), sig_waiter_fn,
+					  &w, "test-sig-waiter");
+	UK_TEST_EXPECT_NOT_NULL(w.thread);
+	while (!UK_READ_ONCE(w.done) && is_runnable(w.thread))
+		uk_sched_yield();
+
+	UK_TEST_EXPECT_ZERO(uk_sig_thread_kill(w.thread, SIGUSR2));
+	while (!UK_READ_ONCE(w.done))
+		uk_sched_yield();
+	UK_TEST_EXPECT_SNUM_EQ(w.rc, SIGUSR2);
+}
+
+#if CONFIG_LIBUKSIGNAL_SIGNALFD
+UK_TESTCASE(uksignal_testsuite, uksignal_test_signalfd_read)
+{
+	struct signalfd_siginfo ssi[3];
+	sigset_t set, old;
+	int fd;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	sigaddset(&set, SIGUSR2);
+	UK_TEST_EXPECT_ZERO(sigprocmask(SIG_BLOCK, &set, &old));
+
+	fd = signalfd(-1, &set, SFD_NONBLOCK);
+	UK_TEST_EXPECT_SNUM_GE(fd, 0);
+
+	/* Nothing pending */
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, ssi, sizeof(ssi)), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EAGAIN);
+
+	/* A single read returns as many signals as fit */
+	UK_TEST_EXPECT_ZERO(raise(SIGUSR1));
+	UK_TEST_EXPECT_ZERO(raise(SIGUSR2));
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, ssi, sizeof(ssi[0]) - 1), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, ssi, sizeof(ssi)),
+			       2 * sizeof(ssi[0]));
+	UK_TEST_EXPECT_SNUM_EQ(ssi[0].ssi_signo + ssi[1].ssi_signo,
+			       SIGUSR1 + SIGUSR2);
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, ssi, sizeof(ssi)), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EAGAIN);
+
+	/* Passing the fd again updates the mask */
+	sigdelset(&set, SIGUSR1);
+	UK_TEST_EXPECT_SNUM_EQ(signalfd(fd, &set, 0), fd);
+	UK_TEST_EXPECT_ZERO(raise(SIGUSR1));
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, ssi, sizeof(ssi)), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EAGAIN);
+
+	/* Consume the signal before it is unblocked */
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	UK_TEST_EXPECT_SNUM_EQ(sig_timedwait(&set, NULL, NULL), SIGUSR1);
+
+	close(fd);
+	UK_TEST_EXPECT_ZERO(sigprocmask(SIG_SETMASK, &old, NULL));
+}
+
+struct sfd_reader {
+	struct uk_thread *thread;
+	int fd;
+	ssize_t rc;
+	uint32_t signo;
+	int done;
+};
+
+static __noreturn void sfd_reader_fn(void *arg)
+{
+	struct sfd_reader *r = (struct sfd_reader *) arg;
+	struct signalfd_siginfo ssi;
+	sigset_t set;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &set, NULL);
+
+	r->rc = read(r->fd, &ssi, sizeof(ssi));
+	r->signo = ssi.ssi_signo;
+	UK_WRITE_ONCE(r->done, 1);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(uksignal_testsuite, uksignal_test_signalfd_block)
+{
+	struct sfd_reader r = { 0 };
+	sigset_t set;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	r.fd = signalfd(-1, &set, 0);
+	UK_TEST_EXPECT_SNUM_GE(r.fd, 0);
+
+	r.thread = uk_sched_thread_create(uk_sched_current(), sfd_reader_fn,
+					  &r, "test-sfd-reader");
+	UK_TEST_EXPECT_NOT_NULL(r.thread);
+	while (!UK_READ_ONCE(r.done) && is_runnable(r.thread))
+		uk_sched_yield();
+	UK_TEST_EXPECT_ZERO(UK_READ_ONCE(r.done));
+
+	/* A blocked reader wakes up when the signal becomes pending */
+	UK_TEST_EXPECT_ZERO(uk_sig_thread_kill(r.thread, SIGUSR1));
+	while (!UK_READ_ONCE(r.done))
+		uk_sched_yield();
+	UK_TEST_EXPECT_SNUM_EQ(r.rc, sizeof(struct signalfd_siginfo));
+	UK_TEST_EXPECT_SNUM_EQ(r.signo, SIGUSR1);
+
+	close(r.fd);
+}
+#endif /* CONFIG_LIBUKSIGNAL_SIGNALFD */
+
+uk_testsuite_register(uksignal_testsuite, NULL);
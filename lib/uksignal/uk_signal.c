@@ -63,6 +63,9 @@ static void uk_proc_sig_ctor(void)
 	}
 
 	UK_INIT_LIST_HEAD(&uk_proc_sig.thread_sig_list);
+
+	for (i = 0; i < NSIG - 1; ++i)
+		UK_INIT_LIST_HEAD(&uk_proc_sig.unblocked[i]);
 }
 
 UK_CTOR(uk_proc_sig_ctor);
@@ -70,6 +73,8 @@ UK_CTOR(uk_proc_sig_ctor);
 static int uk_thread_sig_init(struct uk_thread *thread,
 			      struct uk_thread *parent __unused)
 {
+	int i;
+
 	memset(&signals_container, 0, (sizeof(signals_container)));
 	sigemptyset(&signals_container.mask);
 
@@ -81,6 +86,11 @@ static int uk_thread_sig_init(struct uk_thread *thread,
 	UK_INIT_LIST_HEAD(&signals_container.pending_signals);
 
 	uk_list_add(&signals_container.list_node, &uk_proc_sig.thread_sig_list);
+
+	/* no signal is blocked yet */
+	for (i = 0; i < NSIG - 1; ++i)
+		uk_list_add_tail(&signals_container.unblocked_node[i],
+				 &uk_proc_sig.unblocked[i]);
 	return 0;
 }
 
@@ -89,12 +99,17 @@ static void uk_thread_sig_uninit(struct uk_thread *thread __maybe_unused)
 	/* Clear pending signals */
 	struct uk_list_head *i, *tmp;
 	struct uk_signal *signal;
+	int sig;
 
 	/* ensure that the signals_container on the TLS is really ours */
 	UK_ASSERT(signals_container.tid == thread);
 
 	uk_list_del(&signals_container.list_node);
 
+	for (sig = 1; sig < NSIG; ++sig)
+		if (!uk_sigismember(&signals_container.mask, sig))
+			uk_list_del(&signals_container.unblocked_node[sig - 1]);
+
 	uk_list_for_each_safe(i, tmp, &signals_container.pending_signals) {
 		signal = uk_list_entry(i, struct uk_signal, list_node);
 
@@ -130,8 +145,12 @@ int uk_sig_handle_signals(void)
 	if (ptr->wait.status != UK_SIG_NOT_WAITING)
 		return 0;
 
-	/* reverse mask */
+	/*
+	 * reverse mask; signals awaited by a sigwait on this thread are
+	 * unblocked but must be left to the waiting function
+	 */
 	uk_sigcopyset(&rmask, &ptr->mask);
+	uk_sigorset(&rmask, &ptr->wait.awaited);
 	uk_sigreverseset(&rmask);
 
 	/* calculate executable signals */
@@ -143,7 +162,7 @@ int uk_sig_handle_signals(void)
 					     struct uk_signal, list_node);
 
 		/* move it last if it's blocked */
-		if (uk_sigismember(&ptr->mask, signal->info.si_signo)) {
+		if (!uk_sigismember(&rmask, signal->info.si_signo)) {
 			uk_list_del(&signal->list_node);
 			uk_list_add_tail(&signal->list_node,
 					 &ptr->pending_signals);
@@ -200,6 +219,10 @@ uk_deliver_signal_unmasked(struct uk_thread_sig *th_sig, siginfo_t *sig)
 
 	uk_sigaddset(&th_sig->pending, sig->si_signo);
 
+	/* a blocked signal may be picked up by a signalfd */
+	if (uk_sigismember(&th_sig->mask, sig->si_signo))
+		uk_signalfd_notify(sig->si_signo);
+
 	/* check if we need to wake the thread */
 	if (th_sig->wait.status != UK_SIG_NOT_WAITING &&
 			th_sig->wait.status != UK_SIG_WAITING_SCHED) {
@@ -231,8 +254,9 @@ int uk_sig_thread_kill(struct uk_thread *tid, int sig)
 
 	/* check if we are sending this to ourself */
 	if (uk_thread_current() == ptr->tid) {
-		/* if it's not masked just run it */
-		if (!uk_sigismember(&ptr->mask, sig)) {
+		/* if it's not masked or awaited just run it */
+		if (!uk_sigismember(&ptr->mask, sig) &&
+		    !uk_sigismember(&ptr->wait.awaited, sig)) {
 			/* remove the signal from pending */
 			signal = uk_sig_th_get_pending(ptr, sig);
 
@@ -267,7 +291,9 @@ static inline void uk_deliver_signals_maskchange(void)
 
 	ptr = _UK_TH_SIG;
 
+	/* pending process signals that are no longer blocked */
 	uk_sigcopyset(&to_send, &ptr->mask);
+	uk_sigreverseset(&to_send);
 	uk_sigandset(&to_send, &uk_proc_sig.pending);
 
 	for (i = 1; i < NSIG; ++i) {
@@ -299,34 +325,35 @@ int uk_thread_sigmask(int how, const sigset_t *set, sigset_t *oldset)
 	 * since the mask is restored in execute_handler
 	 */
 
-	sigset_t *mask, tmp;
+	sigset_t mask, tmp;
 	struct uk_thread_sig *ptr;
 
 	ptr = _UK_TH_SIG;
-	mask = &(ptr->mask);
+	uk_sigcopyset(&mask, &ptr->mask);
 
 	if (oldset)
-		*oldset = *mask;
+		*oldset = mask;
 
 	if (set) {
 		switch (how) {
 		case SIG_BLOCK:
-			uk_sigorset(mask, set);
+			uk_sigorset(&mask, set);
 			break;
 		case SIG_UNBLOCK:
 			uk_sigcopyset(&tmp, set);
 			uk_sigreverseset(&tmp);
-			uk_sigandset(mask, &tmp);
+			uk_sigandset(&mask, &tmp);
 			break;
 		case SIG_SETMASK:
-			uk_sigcopyset(mask, set);
+			uk_sigcopyset(&mask, set);
 			break;
 		default:
 			errno = EINVAL;
 			return -1;
 		}
 
-		uk_sigset_remove_unmaskable(mask);
+		uk_sigset_remove_unmaskable(&mask);
+		uk_sig_set_mask(ptr, &mask);
 
 		/* Changed the mask, see if we can deliver
 		 * any pending signals
@@ -344,6 +371,40 @@ struct uk_thread_sig *uk_crr_thread_sig_container(void)
 	return &signals_container;
 }
 
+void uk_sig_set_mask(struct uk_thread_sig *th_sig, const sigset_t *mask)
+{
+	sigset_t changed;
+	int sig;
+
+	uk_sigcopyset(&changed, &th_sig->mask);
+	uk_sigxorset(&changed, mask);
+	uk_sigcopyset(&th_sig->mask, mask);
+
+	for (sig = 1; sig < NSIG && !uk_sigisempty(&changed); ++sig) {
+		if (!uk_sigismember(&changed, sig))
+			continue;
+		uk_sigdelset(&changed, sig);
+
+		if (uk_sigismember(mask, sig))
+			uk_list_del(&th_sig->unblocked_node[sig - 1]);
+		else
+			uk_list_add_tail(&th_sig->unblocked_node[sig - 1],
+					 &uk_proc_sig.unblocked[sig - 1]);
+	}
+}
+
+struct uk_thread_sig *uk_sig_get_unblocked(int sig)
+{
+	struct uk_list_head *node;
+
+	if (uk_list_empty(&uk_proc_sig.unblocked[sig - 1]))
+		return NULL;
+
+	node = uk_proc_sig.unblocked[sig - 1].next;
+	return (struct uk_thread_sig *)((char *)(node - (sig - 1)) -
+			__offsetof(struct uk_thread_sig, unblocked_node));
+}
+
 void uk_sig_init_siginfo(siginfo_t *siginfo, int sig)
 {
 	siginfo->si_signo = sig;
@@ -457,7 +518,7 @@ void uk_execute_handler(siginfo_t sig)
 	 * the handler and we were already inside a waiting function
 	 */
 
-	sigset_t tmp;
+	sigset_t tmp, mask;
 	struct sigaction *act;
 	struct uk_thread_sig *ptr;
 
@@ -486,7 +547,9 @@ void uk_execute_handler(siginfo_t sig)
 
 	/* change the mask */
 	uk_sigcopyset(&tmp, &ptr->mask);
-	uk_sigorset(&ptr->mask, &act->sa_mask);
+	uk_sigcopyset(&mask, &ptr->mask);
+	uk_sigorset(&mask, &act->sa_mask);
+	uk_sig_set_mask(ptr, &mask);
 
 	/* run the handler */
 	if (act->sa_flags & SA_SIGINFO)
@@ -501,5 +564,5 @@ void uk_execute_handler(siginfo_t sig)
 	}
 
 	/* restore the mask */
-	uk_sigcopyset(&ptr->mask, &tmp);
+	uk_sig_set_mask(ptr, &tmp);
 }
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __UK_TIMER_H__
+#define __UK_TIMER_H__
+
+#include <uk/config.h>
+#include <uk/arch/time.h>
+#include <uk/arch/atomic.h>
+#include <uk/list.h>
+#include <uk/essentials.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct uk_timer;
+
+/**
+ * Function called when a kernel timer expires. It is called from the timer
+ * interrupt with interrupts disabled, so it must not block. Functions of
+ * timers initialized with `uk_timer_init_thread()` are called from the
+ * kernel timer thread instead and may block briefly, e.g., on a mutex.
+ * The timer is no longer pending and may be re-armed by the function.
+ */
+typedef void (*uk_timer_func_t)(struct uk_timer *timer, void *arg);
+
+struct uk_timer {
+	/* Expiry time (monotonic clock) */
+	__nsec expires;
+	/* Tolerated delay after `expires`, used to coalesce interrupts */
+	__nsec slack;
+	uk_timer_func_t func;
+	void *arg;
+	unsigned int flags;
+
+	/* Internal, protected by the lock of the timer queue */
+	UK_TAILQ_ENTRY(struct uk_timer) _entry;
+	int _pending;
+};
+
+#define UK_TIMER_SLACK_DEFAULT	((__nsec) CONFIG_LIBUKTIME_TIMER_SLACK)
+
+/* The function is called from the kernel timer thread */
+#define UK_TIMERF_THREAD	0x1
+
+/**
+ * Initializes a kernel timer.
+ *
+ * @param timer
+ *   Timer to initialize
+ * @param func
+ *   Function to call when the timer expires
+ * @param arg
+ *   Argument passed to `func`
+ */
+static inline void uk_timer_init(struct uk_timer *timer,
+				 uk_timer_func_t func, void *arg)
+{
+	timer->expires = 0;
+	timer->slack = UK_TIMER_SLACK_DEFAULT;
+	timer->func = func;
+	timer->arg = arg;
+	timer->flags = 0;
+	timer->_pending = 0;
+}
+
+#if CONFIG_LIBUKSCHED
+/**
+ * Initializes a kernel timer whose function is called in thread context.
+ * This is needed for functions that signal threads or file descriptors.
+ */
+static inline void uk_timer_init_thread(struct uk_timer *timer,
+					uk_timer_func_t func, void *arg)
+{
+	uk_timer_init(timer, func, arg);
+	timer->flags = UK_TIMERF_THREAD;
+}
+#endif /* CONFIG_LIBUKSCHED */
+
+/**
+ * Sets the time that the timer may expire late. It takes effect with the
+ * next call of `uk_timer_arm()`. Use 0 for timers that have to be precise.
+ */
+static inline void uk_timer_set_slack(struct uk_timer *timer, __nsec slack)
+{
+	timer->slack = slack;
+}
+
+/**
+ * Returns non-zero if the timer is armed and its function was not called yet.
+ */
+static inline int uk_timer_pending(const struct uk_timer *timer)
+{
+	return UK_READ_ONCE(timer->_pending);
+}
+
+/**
+ * Arms the timer to expire at `expires` or at the latest `slack` later.
+ * A pending timer is re-armed.
+ *
+ * @param timer
+ *   Initialized timer
+ * @param expires
+ *   Monotonic clock time (see `ukplat_monotonic_clock()`); times in the past
+ *   let the timer expire with the next timer interrupt
+ */
+void uk_timer_arm(struct uk_timer *timer, __nsec expires);
+
+/**
+ * Disarms the timer. This does not wait for a callback that is running on
+ * another CPU.
+ *
+ * @return
+ *   1 if the timer was pending, 0 otherwise
+ */
+int uk_timer_cancel(struct uk_timer *timer);
+
+#if CONFIG_LIBUKSCHED
+/**
+ * Disarms a timer initialized with `uk_timer_init_thread()` and waits until
+ * its function has returned, if it is running. Afterwards, the timer may be
+ * freed unless the function re-armed it. Must be called from a thread that
+ * does not hold locks taken by the function.
+ *
+ * @return
+ *   1 if the timer was pending, 0 otherwise
+ */
+int uk_timer_cancel_sync(struct uk_timer *timer);
+#endif /* CONFIG_LIBUKSCHED */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_TIMER_H__ */
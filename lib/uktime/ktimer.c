@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Kernel timer queue. All timers are kept in a single queue, sorted by
+ * expiry time. Only the earliest deadline is programmed as one-shot timer
+ * interrupt, on the CPU that armed it. Every timer may expire up to its
+ * slack late, so the deadline is chosen as late as possible such that the
+ * next timers fire together. Timers that need thread context are handed
+ * over to the kernel timer thread on expiry.
+ */
+#include <errno.h>
+#include <uk/config.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/spinlock.h>
+#include <uk/plat/irq.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
+#include <uk/plat/time.h>
+#include <uk/init.h>
+#include <uk/print.h>
+#include <uk/assert.h>
+#include <uk/timer.h>
+#include <uk/essentials.h>
+#if CONFIG_LIBUKSCHED
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/wait.h>
+#endif /* CONFIG_LIBUKSCHED */
+
+/* Values of `_pending` */
+#define TIMER_QUEUED	1
+#define TIMER_DEFERRED	2
+
+UK_TAILQ_HEAD(uk_timer_list, struct uk_timer);
+
+static struct uk_timer_list timer_queue =
+	UK_TAILQ_HEAD_INITIALIZER(timer_queue);
+static __spinlock timer_lock = UKARCH_SPINLOCK_INITIALIZER();
+
+/* Deadline of the timer interrupt and the CPU that requested it */
+static __nsec timer_deadline;
+static unsigned int timer_lcpu;
+
+#if CONFIG_LIBUKSCHED
+/* Expired timers waiting for the timer thread */
+static struct uk_timer_list timer_deferred =
+	UK_TAILQ_HEAD_INITIALIZER(timer_deferred);
+static DEFINE_WAIT_QUEUE(timer_thread_wq);
+
+/* Timer whose function is running in the timer thread */
+static struct uk_timer *timer_running;
+static DEFINE_WAIT_QUEUE(timer_done_wq);
+#endif /* CONFIG_LIBUKSCHED */
+
+/* NOTE: The caller must hold the lock of the timer queue */
+static void timer_unlink(struct uk_timer *timer)
+{
+	if (timer->_pending == TIMER_QUEUED)
+		UK_TAILQ_REMOVE(&timer_queue, timer, _entry);
+#if CONFIG_LIBUKSCHED
+	else if (timer->_pending == TIMER_DEFERRED)
+		UK_TAILQ_REMOVE(&timer_deferred, timer, _entry);
+#endif /* CONFIG_LIBUKSCHED */
+	timer->_pending = 0;
+}
+
+static inline __nsec timer_latest(const struct uk_timer *t)
+{
+	/* Saturate for timers that are armed for "never" */
+	if (t->expires > (__nsec) -1 - t->slack)
+		return (__nsec) -1;
+	return t->expires + t->slack;
+}
+
+/*
+ * Returns the latest time at which the first timers can be expired
+ * together, or 0 if the queue is empty.
+ */
+static __nsec timer_queue_deadline(void)
+{
+	struct uk_timer *t;
+	__nsec deadline = 0;
+
+	UK_TAILQ_FOREACH(t, &timer_queue, _entry) {
+		if (deadline && t->expires > deadline)
+			break;
+		if (!deadline || timer_latest(t) < deadline)
+			deadline = timer_latest(t);
+	}
+	return deadline;
+}
+
+/* Requests the timer interrupt for `deadline` on the current CPU */
+static void timer_program(__nsec deadline)
+{
+	timer_deadline = deadline;
+	timer_lcpu = ukplat_lcpu_id();
+	ukplat_time_set_deadline(deadline);
+}
+
+void uk_timer_arm(struct uk_timer *timer, __nsec expires)
+{
+	struct uk_timer *t;
+	unsigned long flags;
+	__nsec deadline;
+
+	UK_ASSERT(timer);
+	UK_ASSERT(timer->func);
+
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&timer_lock);
+
+	timer_unlink(timer);
+	timer->expires = expires;
+	timer->_pending = TIMER_QUEUED;
+
+	/* Most timers are armed for the near future, but later than the
+	 * timers before them: search from the end. Timers with the same
+	 * expiry time fire in the order they were armed.
+	 */
+	UK_TAILQ_FOREACH_REVERSE(t, &timer_queue, uk_timer_list, _entry) {
+		if (t->expires <= expires)
+			break;
+	}
+	if (t)
+		UK_TAILQ_INSERT_AFTER(&timer_queue, t, timer, _entry);
+	else
+		UK_TAILQ_INSERT_HEAD(&timer_queue, timer, _entry);
+
+	/* A later deadline that is programmed already just causes an
+	 * interrupt for nothing
+	 */
+	deadline = timer_queue_deadline();
+	if (!timer_deadline || deadline < timer_deadline)
+		timer_program(deadline);
+
+	ukarch_spin_unlock(&timer_lock);
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+int uk_timer_cancel(struct uk_timer *timer)
+{
+	unsigned long flags;
+	int pending;
+
+	UK_ASSERT(timer);
+
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&timer_lock);
+
+	pending = !!timer->_pending;
+	timer_unlink(timer);
+
+	ukarch_spin_unlock(&timer_lock);
+	ukplat_lcpu_restore_irqf(flags);
+	return pending;
+}
+
+#if CONFIG_LIBUKSCHED
+/* Interrupt flags saved by timer_thread_lock(), valid while it is held */
+static unsigned long timer_thread_irqf;
+
+/*
+ * Lock functions for waiting on the timer thread queues with `timer_lock`
+ * held, so that an expiry in between the check of the condition and going
+ * to sleep cannot be missed.
+ */
+static void timer_thread_lock(__spinlock *lock)
+{
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(lock, flags);
+	timer_thread_irqf = flags;
+}
+
+static void timer_thread_unlock(__spinlock *lock)
+{
+	unsigned long flags = timer_thread_irqf;
+
+	ukplat_spin_unlock_irqrestore(lock, flags);
+}
+
+int uk_timer_cancel_sync(struct uk_timer *timer)
+{
+	__spinlock *lock = &timer_lock;
+	int pending;
+
+	UK_ASSERT(timer->flags & UK_TIMERF_THREAD);
+
+	pending = uk_timer_cancel(timer);
+	timer_thread_lock(lock);
+	uk_waitq_wait_event_locked(&timer_done_wq, timer_running != timer,
+				   timer_thread_lock, timer_thread_unlock,
+				   lock);
+	timer_thread_unlock(lock);
+	return pending;
+}
+
+static __noreturn void timer_thread_fn(void *arg __unused)
+{
+	__spinlock *lock = &timer_lock;
+	struct uk_timer *t;
+
+	timer_thread_lock(lock);
+	for (;;) {
+		uk_waitq_wait_event_locked(&timer_thread_wq,
+					   UK_TAILQ_FIRST(&timer_deferred),
+					   timer_thread_lock,
+					   timer_thread_unlock, lock);
+
+		while ((t = UK_TAILQ_FIRST(&timer_deferred))) {
+			UK_TAILQ_REMOVE(&timer_deferred, t, _entry);
+			t->_pending = 0;
+			timer_running = t;
+			timer_thread_unlock(lock);
+
+			t->func(t, t->arg);
+
+			timer_thread_lock(lock);
+			timer_running = NULL;
+			uk_waitq_wake_up(&timer_done_wq);
+		}
+	}
+}
+#endif /* CONFIG_LIBUKSCHED */
+
+static int uk_timer_irq_handler(void *arg __unused)
+{
+	struct uk_timer *t;
+	__nsec now, deadline;
+	int deferred __maybe_unused = 0;
+
+	ukarch_spin_lock(&timer_lock);
+
+	now = ukplat_monotonic_clock();
+	while ((t = UK_TAILQ_FIRST(&timer_queue)) && t->expires <= now) {
+		UK_TAILQ_REMOVE(&timer_queue, t, _entry);
+#if CONFIG_LIBUKSCHED
+		if (t->flags & UK_TIMERF_THREAD) {
+			UK_TAILQ_INSERT_TAIL(&timer_deferred, t, _entry);
+			t->_pending = TIMER_DEFERRED;
+			deferred = 1;
+			continue;
+		}
+#endif /* CONFIG_LIBUKSCHED */
+		t->_pending = 0;
+
+		/* The callback may arm timers */
+		ukarch_spin_unlock(&timer_lock);
+		t->func(t, t->arg);
+		ukarch_spin_lock(&timer_lock);
+	}
+
+	/* Take over the programming of the interrupt, unless another CPU
+	 * has requested it for the next deadline already. Then, we drop
+	 * our own request in case it was outdated.
+	 */
+	deadline = timer_queue_deadline();
+	if (timer_lcpu == ukplat_lcpu_id() || !timer_deadline
+	    || timer_deadline <= now || deadline < timer_deadline)
+		timer_program(deadline);
+	else
+		ukplat_time_set_deadline(0);
+
+	ukarch_spin_unlock(&timer_lock);
+
+#if CONFIG_LIBUKSCHED
+	if (deferred)
+		uk_waitq_wake_up(&timer_thread_wq);
+#endif /* CONFIG_LIBUKSCHED */
+
+	/* The timer IRQ is shared with the platform */
+	return 0;
+}
+
+static int uk_timer_irq_init(void)
+{
+	int rc;
+
+	rc = ukplat_irq_register(ukplat_time_get_irq(),
+				 uk_timer_irq_handler, NULL);
+	if (unlikely(rc < 0)) {
+		uk_pr_err("Failed to register kernel timer interrupt handler: %d\n",
+			  rc);
+		return rc;
+	}
+	return 0;
+}
+
+uk_early_initcall(uk_timer_irq_init);
+
+#if CONFIG_LIBUKSCHED
+static int uk_timer_thread_init(void)
+{
+	struct uk_thread *t;
+
+	t = uk_sched_thread_create(uk_sched_current(), timer_thread_fn, NULL,
+				   "uktimer");
+	if (unlikely(!t)) {
+		uk_pr_err("Failed to create kernel timer thread\n");
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+uk_lib_initcall(uk_timer_thread_init);
+#endif /* CONFIG_LIBUKSCHED */
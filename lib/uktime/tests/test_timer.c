@@ -0,0 +1,235 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/timer.h>
+#include <uk/test.h>
+#if CONFIG_LIBUKSCHED
+#include <uk/sched.h>
+#include <uk/thread.h>
+#endif /* CONFIG_LIBUKSCHED */
+
+#define KTIMER_WAIT_MS		100
+
+struct ktimer_ctx {
+	struct uk_timer timer;
+	/* Monotonic clock time at which the function was called */
+	__nsec fired;
+	/* Position in the order of expiry, starting at 1 */
+	unsigned int seq;
+	unsigned int calls;
+#if CONFIG_LIBUKSCHED
+	struct uk_thread *thread;
+#endif /* CONFIG_LIBUKSCHED */
+};
+
+static unsigned int ktimer_seq;
+
+static void ktimer_fn(struct uk_timer *timer __unused, void *arg)
+{
+	struct ktimer_ctx *ctx = (struct ktimer_ctx *) arg;
+
+	ctx->fired = ukplat_monotonic_clock();
+	ctx->seq = ++ktimer_seq;
+#if CONFIG_LIBUKSCHED
+	ctx->thread = uk_thread_current();
+#endif /* CONFIG_LIBUKSCHED */
+	UK_WRITE_ONCE(ctx->calls, ctx->calls + 1);
+}
+
+static void ktimer_init(struct ktimer_ctx *ctx, __nsec slack)
+{
+	*ctx = (struct ktimer_ctx) { .calls = 0 };
+	uk_timer_init(&ctx->timer, ktimer_fn, ctx);
+	uk_timer_set_slack(&ctx->timer, slack);
+}
+
+/*
+ * Waits for up to `ms` until the functions of the timers were called `calls`
+ * times each. The pending flag is no indicator for timer thread functions
+ * because it is cleared before the function runs.
+ */
+static void ktimer_wait(struct ktimer_ctx *ctx, unsigned int n,
+			unsigned int calls, unsigned long ms)
+{
+	__nsec until = ukplat_monotonic_clock() + ukarch_time_msec_to_nsec(ms);
+	unsigned int i;
+
+	do {
+		for (i = 0; i < n; i++)
+			if (UK_READ_ONCE(ctx[i].calls) < calls)
+				break;
+		if (i == n)
+			return;
+#if CONFIG_LIBUKSCHED
+		uk_sched_yield();
+#endif /* CONFIG_LIBUKSCHED */
+	} while (ukplat_monotonic_clock() < until);
+}
+
+UK_TESTCASE(uktime_timer_testsuite, uktime_test_timer_order)
+{
+	struct ktimer_ctx ctx[3];
+	__nsec now = ukplat_monotonic_clock();
+	unsigned int i;
+
+	ktimer_seq = 0;
+	for (i = 0; i < ARRAY_SIZE(ctx); i++)
+		ktimer_init(&ctx[i], 0);
+
+	/* Timers expire in the order of their deadlines, not of arming */
+	uk_timer_arm(&ctx[0].timer, now + ukarch_time_msec_to_nsec(3));
+	uk_timer_arm(&ctx[1].timer, now + ukarch_time_msec_to_nsec(1));
+	uk_timer_arm(&ctx[2].timer, now + ukarch_time_msec_to_nsec(2));
+	for (i = 0; i < ARRAY_SIZE(ctx); i++)
+		UK_TEST_EXPECT_NOT_ZERO(uk_timer_pending(&ctx[i].timer));
+
+	ktimer_wait(ctx, ARRAY_SIZE(ctx), 1, KTIMER_WAIT_MS);
+	UK_TEST_EXPECT_SNUM_EQ(ctx[1].seq, 1);
+	UK_TEST_EXPECT_SNUM_EQ(ctx[2].seq, 2);
+	UK_TEST_EXPECT_SNUM_EQ(ctx[0].seq, 3);
+
+	/* Each one exactly once and never early */
+	for (i = 0; i < ARRAY_SIZE(ctx); i++) {
+		UK_TEST_EXPECT_SNUM_EQ(ctx[i].calls, 1);
+		UK_TEST_EXPECT_SNUM_GE(ctx[i].fired, ctx[i].timer.expires);
+	}
+
+	/* Timers with the same deadline expire in the order of arming */
+	ktimer_seq = 0;
+	now = ukplat_monotonic_clock() + ukarch_time_msec_to_nsec(1);
+	for (i = 0; i < ARRAY_SIZE(ctx); i++)
+		uk_timer_arm(&ctx[i].timer, now);
+	ktimer_wait(ctx, ARRAY_SIZE(ctx), 2, KTIMER_WAIT_MS);
+	for (i = 0; i < ARRAY_SIZE(ctx); i++)
+		UK_TEST_EXPECT_SNUM_EQ(ctx[i].seq, i + 1);
+
+	/* A deadline in the past expires with the next interrupt */
+	uk_timer_arm(&ctx[0].timer, 0);
+	ktimer_wait(ctx, 1, 3, KTIMER_WAIT_MS);
+	UK_TEST_EXPECT_SNUM_EQ(ctx[0].calls, 3);
+}
+
+UK_TESTCASE(uktime_timer_testsuite, uktime_test_timer_cancel)
+{
+	struct ktimer_ctx ctx;
+	__nsec now = ukplat_monotonic_clock();
+
+	ktimer_init(&ctx, 0);
+	UK_TEST_EXPECT_ZERO(uk_timer_cancel(&ctx.timer));
+
+	uk_timer_arm(&ctx.timer, now + ukarch_time_msec_to_nsec(1));
+	UK_TEST_EXPECT_SNUM_EQ(uk_timer_cancel(&ctx.timer), 1);
+	UK_TEST_EXPECT_ZERO(uk_timer_pending(&ctx.timer));
+	UK_TEST_EXPECT_ZERO(uk_timer_cancel(&ctx.timer));
+
+	/* Re-arming a pending timer moves it instead of queuing it twice */
+	uk_timer_arm(&ctx.timer, now + ukarch_time_sec_to_nsec(10));
+	uk_timer_arm(&ctx.timer, now + ukarch_time_msec_to_nsec(2));
+	ktimer_wait(&ctx, 1, 1, KTIMER_WAIT_MS);
+	UK_TEST_EXPECT_SNUM_EQ(ctx.calls, 1);
+	UK_TEST_EXPECT_SNUM_GE(ctx.fired, now + ukarch_time_msec_to_nsec(2));
+	UK_TEST_EXPECT_SNUM_LT(ctx.fired, now + ukarch_time_sec_to_nsec(10));
+
+	/* A cancelled timer does not fire afterwards */
+	now = ukplat_monotonic_clock();
+	uk_timer_arm(&ctx.timer, now + ukarch_time_msec_to_nsec(1));
+	UK_TEST_EXPECT_SNUM_EQ(uk_timer_cancel(&ctx.timer), 1);
+	while (ukplat_monotonic_clock() < now + ukarch_time_msec_to_nsec(3))
+		;
+	UK_TEST_EXPECT_SNUM_EQ(ctx.calls, 1);
+}
+
+/*
+ * A timer that may expire late shares the interrupt of a later timer whose
+ * deadline lies within that slack. Both functions are called after the
+ * later deadline. The test keeps the CPU busy so that no other interrupt
+ * (e.g., a scheduler timeout) can expire the first timer on its own.
+ */
+UK_TESTCASE(uktime_timer_testsuite, uktime_test_timer_coalesce)
+{
+	__nsec slack = ukarch_time_msec_to_nsec(2);
+	__nsec now = ukplat_monotonic_clock();
+	struct ktimer_ctx ctx[2];
+
+	ktimer_seq = 0;
+	ktimer_init(&ctx[0], slack);
+	ktimer_init(&ctx[1], slack);
+	uk_timer_arm(&ctx[0].timer, now + ukarch_time_msec_to_nsec(1));
+	uk_timer_arm(&ctx[1].timer, now + ukarch_time_msec_to_nsec(2));
+
+	while (ukplat_monotonic_clock() < now + ukarch_time_msec_to_nsec(10)
+	       && !UK_READ_ONCE(ctx[1].calls))
+		;
+	UK_TEST_EXPECT_SNUM_EQ(ctx[0].calls, 1);
+	UK_TEST_EXPECT_SNUM_EQ(ctx[1].calls, 1);
+	UK_TEST_EXPECT_SNUM_EQ(ctx[0].seq, 1);
+	UK_TEST_EXPECT_SNUM_GE(ctx[0].fired, ctx[1].timer.expires);
+
+	/* Without slack, the first timer gets an interrupt of its own */
+	ktimer_init(&ctx[0], 0);
+	ktimer_init(&ctx[1], 0);
+	now = ukplat_monotonic_clock();
+	uk_timer_arm(&ctx[0].timer, now + ukarch_time_msec_to_nsec(1));
+	uk_timer_arm(&ctx[1].timer, now + ukarch_time_msec_to_nsec(5));
+	ktimer_wait(ctx, 2, 1, KTIMER_WAIT_MS);
+	UK_TEST_EXPECT_SNUM_LT(ctx[0].fired, ctx[1].timer.expires);
+	UK_TEST_EXPECT_SNUM_GE(ctx[1].fired, ctx[1].timer.expires);
+}
+
+#if CONFIG_LIBUKSCHED
+UK_TESTCASE(uktime_timer_testsuite, uktime_test_timer_thread)
+{
+	struct ktimer_ctx ctx;
+
+	ktimer_init(&ctx, 0);
+	uk_timer_init_thread(&ctx.timer, ktimer_fn, &ctx);
+
+	/* The function runs in the kernel timer thread */
+	uk_timer_arm(&ctx.timer, ukplat_monotonic_clock()
+			    + ukarch_time_msec_to_nsec(1));
+	ktimer_wait(&ctx, 1, 1, KTIMER_WAIT_MS);
+	UK_TEST_EXPECT_SNUM_EQ(ctx.calls, 1);
+	UK_TEST_EXPECT_NOT_NULL(ctx.thread);
+	UK_TEST_EXPECT_NOT_ZERO(ctx.thread != uk_thread_current());
+
+	/* Nothing to wait for after the function returned */
+	UK_TEST_EXPECT_ZERO(uk_timer_cancel_sync(&ctx.timer));
+
+	uk_timer_arm(&ctx.timer, ukplat_monotonic_clock()
+			    + ukarch_time_sec_to_nsec(10));
+	UK_TEST_EXPECT_SNUM_EQ(uk_timer_cancel_sync(&ctx.timer), 1);
+	UK_TEST_EXPECT_SNUM_EQ(ctx.calls, 1);
+}
+#endif /* CONFIG_LIBUKSCHED */
+
+uk_testsuite_register(uktime_timer_testsuite, NULL);
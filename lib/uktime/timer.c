@@ -32,47 +32,416 @@
 
 #include <errno.h>
 #include <time.h>
+
+/*
+ * POSIX interval timers on top of the kernel timer queue. Timer IDs are
+ * small integers, like on Linux. Notifications that need a thread
+ * (signals, SIGEV_THREAD) are delivered from the kernel timer thread.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <uk/config.h>
 #include <uk/essentials.h>
 #include <uk/print.h>
 #include <uk/syscall.h>
+#if CONFIG_LIBUKTIME_TIMER
+#include <uk/alloc.h>
+#include <uk/arch/spinlock.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/timer.h>
+#endif /* CONFIG_LIBUKTIME_TIMER */
+
+#if CONFIG_LIBUKTIME_TIMER
+struct posix_timer {
+	struct uk_timer timer;
+	clockid_t clockid;
+	struct sigevent sev;
+	/* Period, or 0 for one-shot timers */
+	__nsec interval;
+	/* Expirations missed before the last notification */
+	int overrun;
+	int armed;
+};
+
+static struct posix_timer *posix_timers[CONFIG_LIBUKTIME_TIMER_MAX];
+static __spinlock posix_timer_lock = UKARCH_SPINLOCK_INITIALIZER();
+
+static inline __nsec timespec_to_nsec(const struct timespec *ts)
+{
+	return ukarch_time_sec_to_nsec((__nsec) ts->tv_sec) + ts->tv_nsec;
+}
+
+static inline void nsec_to_timespec(__nsec ns, struct timespec *ts)
+{
+	ts->tv_sec = ukarch_time_nsec_to_sec(ns);
+	ts->tv_nsec = ukarch_time_subsec(ns);
+}
+
+static inline int timespec_valid(const struct timespec *ts)
+{
+	return ts->tv_sec >= 0 && ts->tv_nsec >= 0
+		&& ts->tv_nsec < (long) UKARCH_NSEC_PER_SEC;
+}
+
+/* Converts an absolute time of `clockid` to the monotonic clock */
+static __nsec posix_timer_abs_to_monotonic(clockid_t clockid, __nsec t)
+{
+	__nsec offset;
 
+	if (clockid != CLOCK_REALTIME)
+		return t;
 
-UK_SYSCALL_R_DEFINE(int, timer_create, clockid_t, clockid,
-		    struct sigevent *__restrict, sevp,
-		    timer_t *__restrict, timerid)
+	/* Changes of the wall clock after arming are not tracked */
+	offset = ukplat_wall_clock() - ukplat_monotonic_clock();
+	return (t > offset) ? t - offset : 0;
+}
+
+static void posix_timer_notify(const struct sigevent *sev)
+{
+	switch (sev->sigev_notify) {
+#if CONFIG_LIBUKSIGNAL
+	case SIGEV_SIGNAL:
+		kill(0, sev->sigev_signo);
+		break;
+#endif /* CONFIG_LIBUKSIGNAL */
+#if CONFIG_LIBUKSCHED
+	case SIGEV_THREAD:
+		sev->sigev_notify_function(sev->sigev_value);
+		break;
+#endif /* CONFIG_LIBUKSCHED */
+	default:
+		break;
+	}
+}
+
+static void posix_timer_expire(struct uk_timer *timer, void *arg)
+{
+	struct posix_timer *pt = (struct posix_timer *) arg;
+	struct sigevent sev;
+	unsigned long flags;
+	__nsec now, expires, missed = 0;
+
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&posix_timer_lock);
+
+	/* The timer was disarmed or set again in the meantime */
+	if (!pt->armed || uk_timer_pending(timer)) {
+		ukarch_spin_unlock(&posix_timer_lock);
+		ukplat_lcpu_restore_irqf(flags);
+		return;
+	}
+
+	if (pt->interval) {
+		now = ukplat_monotonic_clock();
+		expires = timer->expires + pt->interval;
+		if (expires <= now) {
+			missed = (now - expires) / pt->interval + 1;
+			expires += missed * pt->interval;
+		}
+		uk_timer_arm(timer, expires);
+	} else {
+		pt->armed = 0;
+	}
+	pt->overrun = (missed > INT_MAX) ? INT_MAX : (int) missed;
+	sev = pt->sev;
+
+	ukarch_spin_unlock(&posix_timer_lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	posix_timer_notify(&sev);
+}
+
+/* NOTE: The caller must hold `posix_timer_lock` */
+static struct posix_timer *posix_timer_get(int timerid)
+{
+	if (timerid < 0 || timerid >= CONFIG_LIBUKTIME_TIMER_MAX)
+		return NULL;
+	return posix_timers[timerid];
+}
+
+/* NOTE: The caller must hold `posix_timer_lock` */
+static void posix_timer_value(struct posix_timer *pt,
+			      struct itimerspec *value)
+{
+	__nsec now = ukplat_monotonic_clock();
+	__nsec remaining = 0;
+
+	if (pt->armed)
+		remaining = (pt->timer.expires > now)
+			    ? pt->timer.expires - now : 1;
+	nsec_to_timespec(remaining, &value->it_value);
+	nsec_to_timespec(pt->interval, &value->it_interval);
+}
+
+UK_LLSYSCALL_R_DEFINE(int, timer_create, clockid_t, clockid,
+		      struct sigevent *, sevp, int *, timerid)
+{
+	struct posix_timer *pt;
+	unsigned long flags;
+	int id;
+
+	if (unlikely(!timerid))
+		return -EFAULT;
+
+	switch (clockid) {
+	case CLOCK_REALTIME:
+	case CLOCK_MONOTONIC:
+	case CLOCK_BOOTTIME:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	pt = uk_calloc(uk_alloc_get_default(), 1, sizeof(*pt));
+	if (unlikely(!pt))
+		return -EAGAIN;
+
+	pt->clockid = clockid;
+	if (sevp) {
+		pt->sev = *sevp;
+	} else {
+		pt->sev.sigev_notify = SIGEV_SIGNAL;
+		pt->sev.sigev_signo = SIGALRM;
+	}
+
+	switch (pt->sev.sigev_notify) {
+	case SIGEV_NONE:
+		break;
+#if CONFIG_LIBUKSIGNAL
+	case SIGEV_SIGNAL:
+		if (unlikely(pt->sev.sigev_signo <= 0
+			     || pt->sev.sigev_signo >= NSIG)) {
+			uk_free(uk_alloc_get_default(), pt);
+			return -EINVAL;
+		}
+		break;
+#endif /* CONFIG_LIBUKSIGNAL */
+#if CONFIG_LIBUKSCHED
+	case SIGEV_THREAD:
+		if (unlikely(!pt->sev.sigev_notify_function)) {
+			uk_free(uk_alloc_get_default(), pt);
+			return -EINVAL;
+		}
+		break;
+#endif /* CONFIG_LIBUKSCHED */
+	default:
+		uk_free(uk_alloc_get_default(), pt);
+		return -ENOTSUP;
+	}
+
+#if CONFIG_LIBUKSCHED
+	uk_timer_init_thread(&pt->timer, posix_timer_expire, pt);
+#else /* !CONFIG_LIBUKSCHED */
+	uk_timer_init(&pt->timer, posix_timer_expire, pt);
+#endif /* !CONFIG_LIBUKSCHED */
+
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&posix_timer_lock);
+	for (id = 0; id < CONFIG_LIBUKTIME_TIMER_MAX; id++) {
+		if (!posix_timers[id]) {
+			posix_timers[id] = pt;
+			break;
+		}
+	}
+	ukarch_spin_unlock(&posix_timer_lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	if (unlikely(id == CONFIG_LIBUKTIME_TIMER_MAX)) {
+		uk_free(uk_alloc_get_default(), pt);
+		return -EAGAIN;
+	}
+
+	*timerid = id;
+	return 0;
+}
+
+UK_LLSYSCALL_R_DEFINE(int, timer_delete, int, timerid)
+{
+	struct posix_timer *pt;
+	unsigned long flags;
+
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&posix_timer_lock);
+	pt = posix_timer_get(timerid);
+	if (pt) {
+		posix_timers[timerid] = NULL;
+		pt->armed = 0;
+		uk_timer_cancel(&pt->timer);
+	}
+	ukarch_spin_unlock(&posix_timer_lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	if (unlikely(!pt))
+		return -EINVAL;
+
+#if CONFIG_LIBUKSCHED
+	/* The notification may still be on its way */
+	uk_timer_cancel_sync(&pt->timer);
+#endif /* CONFIG_LIBUKSCHED */
+	uk_free(uk_alloc_get_default(), pt);
+	return 0;
+}
+
+UK_LLSYSCALL_R_DEFINE(int, timer_settime, int, timerid, int, flags,
+		      const struct itimerspec *, new_value,
+		      struct itimerspec *, old_value)
+{
+	struct posix_timer *pt;
+	unsigned long irqf;
+	__nsec expires;
+
+	if (unlikely(!new_value))
+		return -EFAULT;
+	if (unlikely(!timespec_valid(&new_value->it_value)
+		     || !timespec_valid(&new_value->it_interval)))
+		return -EINVAL;
+
+	irqf = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&posix_timer_lock);
+
+	pt = posix_timer_get(timerid);
+	if (unlikely(!pt)) {
+		ukarch_spin_unlock(&posix_timer_lock);
+		ukplat_lcpu_restore_irqf(irqf);
+		return -EINVAL;
+	}
+
+	if (old_value)
+		posix_timer_value(pt, old_value);
+
+	uk_timer_cancel(&pt->timer);
+	pt->interval = timespec_to_nsec(&new_value->it_interval);
+	pt->overrun = 0;
+	pt->armed = new_value->it_value.tv_sec || new_value->it_value.tv_nsec;
+	if (pt->armed) {
+		expires = timespec_to_nsec(&new_value->it_value);
+		if (flags & TIMER_ABSTIME)
+			expires = posix_timer_abs_to_monotonic(pt->clockid,
+							       expires);
+		else
+			expires += ukplat_monotonic_clock();
+		uk_timer_arm(&pt->timer, expires);
+	}
+
+	ukarch_spin_unlock(&posix_timer_lock);
+	ukplat_lcpu_restore_irqf(irqf);
+	return 0;
+}
+
+UK_LLSYSCALL_R_DEFINE(int, timer_gettime, int, timerid,
+		      struct itimerspec *, curr_value)
+{
+	struct posix_timer *pt;
+	unsigned long flags;
+
+	if (unlikely(!curr_value))
+		return -EFAULT;
+
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&posix_timer_lock);
+	pt = posix_timer_get(timerid);
+	if (pt)
+		posix_timer_value(pt, curr_value);
+	ukarch_spin_unlock(&posix_timer_lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	return pt ? 0 : -EINVAL;
+}
+
+UK_LLSYSCALL_R_DEFINE(int, timer_getoverrun, int, timerid)
+{
+	struct posix_timer *pt;
+	unsigned long flags;
+	int overrun = -EINVAL;
+
+	flags = ukplat_lcpu_save_irqf();
+	ukarch_spin_lock(&posix_timer_lock);
+	pt = posix_timer_get(timerid);
+	if (pt)
+		overrun = pt->overrun;
+	ukarch_spin_unlock(&posix_timer_lock);
+	ukplat_lcpu_restore_irqf(flags);
+
+	return overrun;
+}
+
+#else /* !CONFIG_LIBUKTIME_TIMER */
+
+UK_LLSYSCALL_R_DEFINE(int, timer_create, clockid_t, clockid,
+		      struct sigevent *, sevp, int *, timerid)
 {
 	UK_WARN_STUBBED();
 	return -ENOTSUP;
 }
 
-UK_SYSCALL_R_DEFINE(int, timer_delete,
-		    timer_t, timerid)
+UK_LLSYSCALL_R_DEFINE(int, timer_delete, int, timerid)
 {
 	UK_WARN_STUBBED();
 	return -ENOTSUP;
 }
 
-UK_SYSCALL_R_DEFINE(int, timer_settime,
-		    timer_t, timerid,
-		    int, flags,
-		    const struct itimerspec *__restrict, new_value,
-		    struct itimerspec *__restrict, old_value)
+UK_LLSYSCALL_R_DEFINE(int, timer_settime, int, timerid, int, flags,
+		      const struct itimerspec *, new_value,
+		      struct itimerspec *, old_value)
 {
 	UK_WARN_STUBBED();
 	return -ENOTSUP;
 }
 
-UK_SYSCALL_R_DEFINE(int, timer_gettime,
-		    timer_t, timerid,
-		    struct itimerspec *, curr_value)
+UK_LLSYSCALL_R_DEFINE(int, timer_gettime, int, timerid,
+		      struct itimerspec *, curr_value)
 {
 	UK_WARN_STUBBED();
 	return -ENOTSUP;
 }
 
-UK_SYSCALL_R_DEFINE(int, timer_getoverrun,
-		    timer_t, timerid)
+UK_LLSYSCALL_R_DEFINE(int, timer_getoverrun, int, timerid)
 {
 	UK_WARN_STUBBED();
 	return -ENOTSUP;
 }
+#endif /* !CONFIG_LIBUKTIME_TIMER */
+
+#if UK_LIBC_SYSCALLS
+/* The system calls use integer IDs, the libc interface `timer_t` */
+int timer_create(clockid_t clockid, struct sigevent *__restrict sevp,
+		 timer_t *__restrict timerid)
+{
+	int id, rc;
+
+	rc = uk_syscall_e_timer_create((long) clockid, (long) sevp,
+				       (long) &id);
+	if (rc == 0)
+		*timerid = (timer_t) (intptr_t) id;
+	return rc;
+}
+
+int timer_delete(timer_t timerid)
+{
+	return uk_syscall_e_timer_delete((long) (intptr_t) timerid);
+}
+
+int timer_settime(timer_t timerid, int flags,
+		  const struct itimerspec *__restrict new_value,
+		  struct itimerspec *__restrict old_value)
+{
+	return uk_syscall_e_timer_settime((long) (intptr_t) timerid,
+					  (long) flags, (long) new_value,
+					  (long) old_value);
+}
+
+int timer_gettime(timer_t timerid, struct itimerspec *curr_value)
+{
+	return uk_syscall_e_timer_gettime((long) (intptr_t) timerid,
+					  (long) curr_value);
+}
+
+int timer_getoverrun(timer_t timerid)
+{
+	return uk_syscall_e_timer_getoverrun((long) (intptr_t) timerid);
+}
+#endif /* UK_LIBC_SYSCALLS */
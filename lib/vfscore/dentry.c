@@ -35,13 +35,21 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include <uk/config.h>
 #include <uk/list.h>
+#include <uk/plat/time.h>
 #include <vfscore/dentry.h>
 #include <vfscore/vnode.h>
 #include <uk/mutex.h>
 #include "vfs.h"
 
-#define DENTRY_BUCKETS 32
+#define DENTRY_BUCKETS (1 << CONFIG_LIBVFSCORE_DENTRY_HASH_ORDER)
+
+#if CONFIG_LIBVFSCORE_DENTRY_STATS
+#define DENTRY_STAT_INC(mp, field) ((mp)->m_dstats.field++)
+#else
+#define DENTRY_STAT_INC(mp, field) ((void)(mp))
+#endif
 
 static struct uk_hlist_head dentry_hash_table[DENTRY_BUCKETS];
 static UK_HLIST_HEAD(fake);
@@ -116,6 +124,7 @@ dentry_lookup(struct mount *mp, char *path)
 	uk_hlist_for_each_entry(dp, &dentry_hash_table[dentry_hash(mp, path)], d_link) {
 		if (dp->d_mount == mp && !strncmp(dp->d_path, path, PATH_MAX)) {
 			dp->d_refcnt++;
+			DENTRY_STAT_INC(mp, ds_hits);
 			uk_mutex_unlock(&dentry_hash_lock);
 			return dp;
 		}
@@ -124,6 +133,207 @@ dentry_lookup(struct mount *mp, char *path)
 	return NULL;                /* not found */
 }
 
+#if CONFIG_LIBVFSCORE_DENTRY_NEGATIVE
+/*
+ * A negative dentry remembers a path that the file system reported as
+ * nonexistent. Negative dentries are kept in their own hash table so
+ * that users of regular dentries never see an entry without a vnode.
+ * They are only created on mounts with a non-zero m_dneg_timeout, and
+ * expire after that time unless it is DNEG_NOEXPIRE.
+ *
+ * A negative entry for "/a/b" is only ever created while "/a" is a
+ * directory. It is dropped when "/a/b" is created, and together with
+ * everything below it when "/a/b" or one of its parents is renamed or
+ * removed, so that a cached ENOENT can never hide an ENOTDIR.
+ */
+struct dentry_neg {
+	struct uk_hlist_node dn_link;	/* link for hash list */
+	struct uk_list_head dn_lru;	/* link for LRU list */
+	struct mount	*dn_mount;
+	__nsec		dn_expires;	/* 0 if the entry does not expire */
+	char		dn_path[];	/* path in fs */
+};
+
+static struct uk_hlist_head dentry_neg_table[DENTRY_BUCKETS];
+static UK_LIST_HEAD(dentry_neg_lru);
+static unsigned int dentry_neg_count;
+
+static struct dentry_neg *
+dentry_neg_find(struct mount *mp, const char *path)
+{
+	struct dentry_neg *dn;
+
+	uk_hlist_for_each_entry(dn, &dentry_neg_table[dentry_hash(mp, path)],
+				dn_link) {
+		if (dn->dn_mount == mp && !strncmp(dn->dn_path, path, PATH_MAX))
+			return dn;
+	}
+	return NULL;
+}
+
+static void
+dentry_neg_free(struct dentry_neg *dn)
+{
+	uk_hlist_del(&dn->dn_link);
+	uk_list_del(&dn->dn_lru);
+	dentry_neg_count--;
+	free(dn);
+}
+
+/*
+ * Returns non-zero if @path is known not to exist on @mp.
+ */
+int
+dentry_neg_lookup(struct mount *mp, const char *path)
+{
+	struct dentry_neg *dn;
+
+	if (mp->m_dneg_timeout == DNEG_DISABLED)
+		return 0;
+
+	uk_mutex_lock(&dentry_hash_lock);
+	dn = dentry_neg_find(mp, path);
+	if (dn && dn->dn_expires &&
+	    dn->dn_expires <= ukplat_monotonic_clock()) {
+		dentry_neg_free(dn);
+		dn = NULL;
+	}
+	if (dn) {
+		/* Keep recently used entries at the tail */
+		uk_list_move_tail(&dn->dn_lru, &dentry_neg_lru);
+		DENTRY_STAT_INC(mp, ds_neg_hits);
+	}
+	uk_mutex_unlock(&dentry_hash_lock);
+	return dn != NULL;
+}
+
+void
+dentry_neg_add(struct mount *mp, const char *path)
+{
+	struct dentry_neg *dn;
+	size_t len = strlen(path) + 1;
+
+	if (mp->m_dneg_timeout == DNEG_DISABLED)
+		return;
+
+	dn = malloc(sizeof(*dn) + len);
+	if (!dn)
+		return; /* Caching is best effort */
+	dn->dn_mount = mp;
+	dn->dn_expires = 0;
+	if (mp->m_dneg_timeout != DNEG_NOEXPIRE)
+		dn->dn_expires = ukplat_monotonic_clock() + mp->m_dneg_timeout;
+	memcpy(dn->dn_path, path, len);
+
+	uk_mutex_lock(&dentry_hash_lock);
+	if (dentry_neg_find(mp, path)) {
+		uk_mutex_unlock(&dentry_hash_lock);
+		free(dn);
+		return;
+	}
+	if (dentry_neg_count >= CONFIG_LIBVFSCORE_DENTRY_NEGATIVE_MAX)
+		dentry_neg_free(uk_list_first_entry(&dentry_neg_lru,
+						    struct dentry_neg, dn_lru));
+	uk_hlist_add_head(&dn->dn_link,
+			  &dentry_neg_table[dentry_hash(mp, path)]);
+	uk_list_add_tail(&dn->dn_lru, &dentry_neg_lru);
+	dentry_neg_count++;
+	uk_mutex_unlock(&dentry_hash_lock);
+}
+
+/*
+ * Drops the negative entry for @name in directory @ddp, if any. Must
+ * be called with the directory vnode locked, right after @name was
+ * created, so that no concurrent lookup can re-add a stale entry.
+ */
+void
+dentry_neg_remove(struct dentry *ddp, const char *name)
+{
+	char path[PATH_MAX];
+	struct dentry_neg *dn;
+
+	if (ddp->d_mount->m_dneg_timeout == DNEG_DISABLED)
+		return;
+
+	strlcpy(path, ddp->d_path, sizeof(path));
+	if (path[strlen(path) - 1] != '/')
+		strlcat(path, "/", sizeof(path));
+	strlcat(path, name, sizeof(path));
+
+	uk_mutex_lock(&dentry_hash_lock);
+	dn = dentry_neg_find(ddp->d_mount, path);
+	if (dn)
+		dentry_neg_free(dn);
+	uk_mutex_unlock(&dentry_hash_lock);
+}
+
+/*
+ * Drops the negative entries for @path and everything below it. If
+ * @path is NULL, all negative entries of @mp are dropped.
+ */
+void
+dentry_neg_purge(struct mount *mp, const char *path)
+{
+	struct dentry_neg *dn, *next;
+	size_t len = 0;
+
+	if (mp->m_dneg_timeout == DNEG_DISABLED)
+		return;
+
+	if (path && path[0] == '/' && path[1] == '\0')
+		path = NULL;
+	if (path)
+		len = strlen(path);
+
+	uk_mutex_lock(&dentry_hash_lock);
+	uk_list_for_each_entry_safe(dn, next, &dentry_neg_lru, dn_lru) {
+		if (dn->dn_mount != mp)
+			continue;
+		if (path && (strncmp(dn->dn_path, path, len) ||
+			     (dn->dn_path[len] != '\0' &&
+			      dn->dn_path[len] != '/')))
+			continue;
+		dentry_neg_free(dn);
+	}
+	uk_mutex_unlock(&dentry_hash_lock);
+}
+#else /* !CONFIG_LIBVFSCORE_DENTRY_NEGATIVE */
+int
+dentry_neg_lookup(struct mount *mp __unused, const char *path __unused)
+{
+	return 0;
+}
+
+void
+dentry_neg_add(struct mount *mp __unused, const char *path __unused)
+{
+}
+
+void
+dentry_neg_remove(struct dentry *ddp __unused, const char *name __unused)
+{
+}
+
+void
+dentry_neg_purge(struct mount *mp __unused, const char *path __unused)
+{
+}
+#endif /* !CONFIG_LIBVFSCORE_DENTRY_NEGATIVE */
+
+void
+dentry_stats_get(struct mount *mp __maybe_unused, struct dentry_stats *dst)
+{
+	UK_ASSERT(dst);
+
+#if CONFIG_LIBVFSCORE_DENTRY_STATS
+	uk_mutex_lock(&dentry_hash_lock);
+	memcpy(dst, &mp->m_dstats, sizeof(*dst));
+	uk_mutex_unlock(&dentry_hash_lock);
+#else
+	memset(dst, 0, sizeof(*dst));
+#endif
+}
+
 static void dentry_children_remove(struct dentry *dp)
 {
 	struct dentry *entry = NULL;
@@ -247,5 +457,8 @@ dentry_init(void)
 
 	for (i = 0; i < DENTRY_BUCKETS; i++) {
 		UK_INIT_HLIST_HEAD(&dentry_hash_table[i]);
+#if CONFIG_LIBVFSCORE_DENTRY_NEGATIVE
+		UK_INIT_HLIST_HEAD(&dentry_neg_table[i]);
+#endif
 	}
 }
@@ -345,6 +345,35 @@ UK_LLSYSCALL_R_DEFINE(int, epoll_pwait, int, epfd, struct epoll_event *, events,
 			      sigmask, sigsetsize);
 }
 
+static int epoll_timeout_ns(const struct timespec *timeout, __nsec *ns)
+{
+	if (timeout->tv_sec < 0 || timeout->tv_nsec < 0 ||
+	    timeout->tv_nsec >= (long)ukarch_time_sec_to_nsec(1))
+		return -EINVAL;
+
+	*ns = ukarch_time_sec_to_nsec(timeout->tv_sec) + timeout->tv_nsec;
+	return 0;
+}
+
+UK_LLSYSCALL_R_DEFINE(int, epoll_pwait2, int, epfd,
+		      struct epoll_event *, events, int, maxevents,
+		      const struct timespec *, timeout,
+		      const sigset_t *, sigmask, size_t, sigsetsize)
+{
+	__nsec timeout_ns;
+	int ret;
+
+	if (timeout) {
+		ret = epoll_timeout_ns(timeout, &timeout_ns);
+		if (ret)
+			return ret;
+	}
+
+	return do_epoll_pwait(epfd, events, maxevents,
+			      (timeout) ? &timeout_ns : NULL,
+			      sigmask, sigsetsize);
+}
+
 #if UK_LIBC_SYSCALLS
 /* The actual system call implemented in Linux uses a different signature! We
  * thus provide the libc call here directly.
@@ -368,4 +397,28 @@ int epoll_pwait(int epfd, struct epoll_event * events, int maxevents,
 
 	return ret;
 }
+
+int epoll_pwait2(int epfd, struct epoll_event *events, int maxevents,
+		 const struct timespec *timeout, const sigset_t *sigmask)
+{
+	__nsec timeout_ns;
+	int ret;
+
+	if (timeout) {
+		ret = epoll_timeout_ns(timeout, &timeout_ns);
+		if (ret)
+			goto EXIT;
+	}
+
+	ret = do_epoll_pwait(epfd, events, maxevents,
+			     (timeout) ? &timeout_ns : NULL,
+			     sigmask, sizeof(sigset_t));
+EXIT:
+	if (ret < 0) {
+		errno = -ret;
+		ret = -1;
+	}
+
+	return ret;
+}
 #endif /* UK_LIBC_SYSCALLS */
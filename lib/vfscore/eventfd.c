@@ -37,6 +37,7 @@
 #include <vfscore/dentry.h>
 #include <vfscore/vnode.h>
 #include <vfscore/mount.h>
+#include <vfscore/eventfd.h>
 #include <uk/syscall.h>
 #include <uk/essentials.h>
 #include <uk/print.h>
@@ -47,12 +48,26 @@
 #include <inttypes.h>
 #include <errno.h>
 
+/* Largest value the counter can hold */
+#define EVENTFD_MAX	((uint64_t)-2)
+
+/*
+ * The counter is updated with atomic operations only. The lock is taken
+ * only when somebody needs to be notified: a thread that goes to sleep
+ * increments the matching waiter count with the lock held, and the event
+ * poll list is changed with the lock held as well. Threads that change the
+ * counter check both afterwards and skip the lock if nobody is interested.
+ */
 struct eventfd {
 	/** Current value of this eventfd */
 	uint64_t val;
 	/** Indicates if this fd is a semaphore */
 	unsigned int is_semaphore;
-	/** Lock to synchronize access */
+	/** Number of sleeping readers */
+	unsigned int r_waiting;
+	/** Number of sleeping writers */
+	unsigned int w_waiting;
+	/** Lock to synchronize sleeping and notification */
 	struct uk_mutex lock;
 	/** Wait queue for blocked writers (i.e., value would overflow) */
 	struct uk_waitq w_wq;
@@ -70,6 +85,8 @@ static void eventfd_init(struct eventfd *efd, unsigned int initval, int flags)
 {
 	efd->val = initval;
 	efd->is_semaphore = (flags & EFD_SEMAPHORE);
+	efd->r_waiting = 0;
+	efd->w_waiting = 0;
 	uk_waitq_init(&efd->w_wq);
 	uk_waitq_init(&efd->r_wq);
 	uk_mutex_init(&efd->lock);
@@ -78,18 +95,59 @@ static void eventfd_init(struct eventfd *efd, unsigned int initval, int flags)
 
 static unsigned int eventfd_events(struct eventfd *efd)
 {
+	uint64_t val = __atomic_load_n(&efd->val, __ATOMIC_SEQ_CST);
 	unsigned int events = 0;
 
-	if (efd->val > 0)
+	if (val > 0)
 		events |= EPOLLIN;
-	if (efd->val < (uint64_t)-1)
+	if (val < (uint64_t)-1)
 		events |= EPOLLOUT;
-	if (efd->val == (uint64_t)-1)
+	if (val == (uint64_t)-1)
 		events |= EPOLLERR;
 
 	return events;
 }
 
+/*
+ * Takes a value from the counter: 1 for semaphores, the whole counter
+ * otherwise. Returns 0 if the counter is zero.
+ */
+static uint64_t eventfd_take(struct eventfd *efd)
+{
+	uint64_t val, take;
+
+	val = __atomic_load_n(&efd->val, __ATOMIC_SEQ_CST);
+	do {
+		if (val == 0)
+			return 0;
+		take = (efd->is_semaphore) ? 1 : val;
+	} while (!__atomic_compare_exchange_n(&efd->val, &val, val - take, 0,
+					      __ATOMIC_SEQ_CST,
+					      __ATOMIC_SEQ_CST));
+
+	return take;
+}
+
+/*
+ * Adds `add` to the counter unless the counter would exceed EVENTFD_MAX.
+ * Returns 1 and the previous value in `old` on success, 0 otherwise.
+ */
+static int eventfd_add(struct eventfd *efd, uint64_t add, uint64_t *old)
+{
+	uint64_t val;
+
+	val = __atomic_load_n(&efd->val, __ATOMIC_SEQ_CST);
+	do {
+		if (add > EVENTFD_MAX - val)
+			return 0;
+	} while (!__atomic_compare_exchange_n(&efd->val, &val, val + add, 0,
+					      __ATOMIC_SEQ_CST,
+					      __ATOMIC_SEQ_CST));
+
+	*old = val;
+	return 1;
+}
+
 static void eventfd_signal_eventpoll(struct eventfd *efd, unsigned int events)
 {
 	struct eventpoll_cb *ecb;
@@ -104,6 +162,33 @@ static void eventfd_signal_eventpoll(struct eventfd *efd, unsigned int events)
 	}
 }
 
+/*
+ * Notifies the other side after the counter was changed. Sleeping threads
+ * are woken up only if `wake` is set, eventpolls are always signaled.
+ */
+static void eventfd_notify(struct eventfd *efd, struct uk_waitq *wq,
+			   unsigned int *waiting, int wake,
+			   unsigned int events)
+{
+	int sleepers;
+
+	/* Pairs with the barriers of sleeping threads and eventfd_poll(),
+	 * which change the waiter count or the eventpoll list before they
+	 * look at the counter
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	sleepers = wake && __atomic_load_n(waiting, __ATOMIC_SEQ_CST);
+	if (!sleepers &&
+	    UK_READ_ONCE(efd->ep_list.next) == &efd->ep_list)
+		return;
+
+	uk_mutex_lock(&efd->lock);
+	if (sleepers)
+		uk_waitq_wake_up(wq);
+	eventfd_signal_eventpoll(efd, events);
+	uk_mutex_unlock(&efd->lock);
+}
+
 static int eventfd_vfscore_close(struct vnode *vnode,
 				 struct vfscore_file *fp __unused)
 {
@@ -121,11 +206,11 @@ static int eventfd_vfscore_close(struct vnode *vnode,
 }
 
 static int eventfd_vfscore_read(struct vnode *vnode,
-				struct vfscore_file *fp __unused,
+				struct vfscore_file *fp,
 				struct uio *buf, int ioflag __unused)
 {
 	struct eventfd *efd = (struct eventfd *)vnode->v_data;
-	uint64_t *val;
+	uint64_t val;
 
 	UK_ASSERT(vnode->v_data);
 	UK_ASSERT(vnode->v_type == VEVENT);
@@ -142,39 +227,37 @@ static int eventfd_vfscore_read(struct vnode *vnode,
 	if (buf->uio_iov[0].iov_len < sizeof(uint64_t))
 		return EINVAL;
 
-	val = (uint64_t *)buf->uio_iov[0].iov_base;
-
-	uk_mutex_lock(&efd->lock);
-
-	/* Check if the value is 0. In this case, block if the file descriptor
-	 * is not configured to non-blocking operation.
-	 */
-	if ((fp->f_flags & O_NONBLOCK) && (efd->val == 0)) {
+	val = eventfd_take(efd);
+	if (!val) {
+		/* The value is 0. Block if the file descriptor is not
+		 * configured to non-blocking operation.
+		 */
+		if (fp->f_flags & O_NONBLOCK)
+			return EAGAIN;
+
+		uk_mutex_lock(&efd->lock);
+		__atomic_fetch_add(&efd->r_waiting, 1, __ATOMIC_SEQ_CST);
+		uk_waitq_wait_event_mutex(&efd->r_wq,
+					  (val = eventfd_take(efd)) != 0,
+					  &efd->lock);
+		__atomic_fetch_sub(&efd->r_waiting, 1, __ATOMIC_SEQ_CST);
 		uk_mutex_unlock(&efd->lock);
-		return EAGAIN;
 	}
 
-	uk_waitq_wait_event_mutex(&efd->r_wq, efd->val > 0, &efd->lock);
-
-	UK_ASSERT(efd->val > 0);
-
-	*val = (efd->is_semaphore) ? 1 : efd->val;
-	efd->val -= *val;
-
-	eventfd_signal_eventpoll(efd, EPOLLOUT);
-
-	uk_waitq_wake_up(&efd->w_wq);
+	UK_ASSERT(val > 0);
+	*((uint64_t *)buf->uio_iov[0].iov_base) = val;
+	buf->uio_resid -= sizeof(uint64_t);
 
-	uk_mutex_unlock(&efd->lock);
+	eventfd_notify(efd, &efd->w_wq, &efd->w_waiting, 1, EPOLLOUT);
 
 	return 0;
 }
 
 static int eventfd_vfscore_write(struct vnode *vnode,
-				 struct uio *buf, int ioflag __unused)
+				 struct uio *buf, int ioflag)
 {
 	struct eventfd *efd = (struct eventfd *)vnode->v_data;
-	uint64_t val;
+	uint64_t val, old;
 
 	UK_ASSERT(vnode->v_data);
 	UK_ASSERT(vnode->v_type == VEVENT);
@@ -195,28 +278,26 @@ static int eventfd_vfscore_write(struct vnode *vnode,
 	if (val == (uint64_t)-1)
 		return EINVAL;
 
-	uk_mutex_lock(&efd->lock);
-
-	/* Check if the addition would overflow. In this case, block if the
-	 * file descriptor is not configured to non-blocking operation.
-	 */
-
-	/* TODO: Non-blocking */
-
-	uk_waitq_wait_event_mutex(&efd->w_wq, efd->val < (uint64_t)-1 - val,
-				  &efd->lock);
-
-	UK_ASSERT(efd->val < (uint64_t)-1 - val);
-
-	/* Unblock readers if value is zero */
-	if (efd->val == 0)
-		uk_waitq_wake_up(&efd->r_wq);
-
-	efd->val += val;
-
-	eventfd_signal_eventpoll(efd, EPOLLIN);
+	if (!eventfd_add(efd, val, &old)) {
+		/* The addition would overflow. Block if the file descriptor
+		 * is not configured to non-blocking operation.
+		 */
+		if (ioflag & IO_NDELAY)
+			return EAGAIN;
+
+		uk_mutex_lock(&efd->lock);
+		__atomic_fetch_add(&efd->w_waiting, 1, __ATOMIC_SEQ_CST);
+		uk_waitq_wait_event_mutex(&efd->w_wq,
+					  eventfd_add(efd, val, &old),
+					  &efd->lock);
+		__atomic_fetch_sub(&efd->w_waiting, 1, __ATOMIC_SEQ_CST);
+		uk_mutex_unlock(&efd->lock);
+	}
 
-	uk_mutex_unlock(&efd->lock);
+	/* Readers can only be sleeping if the value was zero */
+	if (val)
+		eventfd_notify(efd, &efd->r_wq, &efd->r_waiting, old == 0,
+			       EPOLLIN);
 
 	buf->uio_resid = 0;
 	buf->uio_offset = sizeof(uint64_t);
@@ -247,9 +328,6 @@ static int eventfd_vfscore_poll(struct vnode *vnode, unsigned int *revents,
 	UK_ASSERT(vnode->v_type == VEVENT);
 
 	uk_mutex_lock(&efd->lock);
-
-	events = eventfd_events(efd);
-
 	uk_mutex_lock(&eventfd_global_lock);
 	if (!ecb->unregister) {
 		UK_ASSERT(uk_list_empty(&ecb->cb_link));
@@ -266,6 +344,10 @@ static int eventfd_vfscore_poll(struct vnode *vnode, unsigned int *revents,
 	}
 	uk_mutex_unlock(&eventfd_global_lock);
 
+	/* Read the counter only after registration, see eventfd_notify() */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	events = eventfd_events(efd);
+
 	uk_mutex_unlock(&efd->lock);
 
 	*revents = events;
@@ -305,7 +387,7 @@ static int do_eventfd(struct uk_alloc *a, unsigned int initval, int flags)
 	struct dentry *vfs_dentry;
 	struct vnode *vfs_vnode;
 
-	if (flags & ~(EFD_CLOEXEC | EFD_SEMAPHORE))
+	if (flags & ~(EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE))
 		return -EINVAL;
 
 	/* Reserve a file descriptor number */
@@ -349,6 +431,8 @@ static int do_eventfd(struct uk_alloc *a, unsigned int initval, int flags)
 	/* Initialize data structures */
 	vfs_file->fd = vfs_fd;
 	vfs_file->f_flags = UK_FREAD | UK_FWRITE;
+	if (flags & EFD_NONBLOCK)
+		vfs_file->f_flags |= O_NONBLOCK;
 	vfs_file->f_count = 1;
 	vfs_file->f_data = efd;
 	vfs_file->f_dentry = vfs_dentry;
@@ -415,3 +499,32 @@ int eventfd(unsigned int initval, int flags)
 	return ret;
 }
 #endif /* UK_LIBC_SYSCALLS */
+
+int uk_eventfd_signal(struct vfscore_file *fp, uint64_t val)
+{
+	struct eventfd *efd;
+	struct vnode *vnode;
+	uint64_t old;
+
+	UK_ASSERT(fp);
+
+	if (!fp->f_dentry)
+		return -EINVAL;
+
+	vnode = fp->f_dentry->d_vnode;
+	if (vnode->v_op != &eventfd_vnops)
+		return -EINVAL;
+
+	if (val == (uint64_t)-1)
+		return -EINVAL;
+
+	efd = (struct eventfd *)vnode->v_data;
+	if (!eventfd_add(efd, val, &old))
+		return -EAGAIN;
+
+	if (val)
+		eventfd_notify(efd, &efd->r_wq, &efd->r_waiting, old == 0,
+			       EPOLLIN);
+
+	return 0;
+}
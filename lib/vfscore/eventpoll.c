@@ -44,6 +44,18 @@
 
 #define EPOLLERR_SET (EPOLLERR | EPOLLHUP | EPOLLNVAL)
 
+/* Flags that do not select events */
+#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET | EPOLLEXCLUSIVE)
+
+/* Flags that may be combined with EPOLLEXCLUSIVE */
+#define EP_EXCLUSIVE_OK_BITS (EPOLLIN | EPOLLOUT | EPOLLRDNORM | \
+			      EPOLLRDBAND | EPOLLWRNORM | EPOLLWRBAND | \
+			      EPOLLERR | EPOLLHUP | EPOLLWAKEUP | EPOLLET | \
+			      EPOLLEXCLUSIVE)
+
+/* Initial number of buckets of the fd index */
+#define EP_HASH_MIN 16
+
 UK_TRACEPOINT(trace_ep_wait, "%p %p", void *, void *);
 UK_TRACEPOINT(trace_ep_wakeup, "%p %p %u", void *, void *, unsigned);
 
@@ -80,15 +92,79 @@ void eventpoll_fini(struct eventpoll *ep)
 	}
 
 	UK_ASSERT(uk_list_empty(&ep->fd_list));
+	UK_ASSERT(ep->fd_count == 0);
+
+	if (ep->fd_hash) {
+		UK_ASSERT(ep->a);
+		uk_free(ep->a, ep->fd_hash);
+		ep->fd_hash = NULL;
+		ep->fd_hash_size = 0;
+	}
+}
+
+static inline struct uk_hlist_head *efd_bucket(struct eventpoll *ep, int fd)
+{
+	UK_ASSERT(ep->fd_hash);
+
+	/* fd numbers are allocated densely from the lowest free one, so
+	 * their low bits already spread evenly
+	 */
+	return &ep->fd_hash[(unsigned int)fd & (ep->fd_hash_size - 1)];
+}
+
+/*
+ * Grows the fd index so that there are at least as many buckets as
+ * monitored fds. Failing to allocate is not fatal: lookups just get slower.
+ */
+static void ep_hash_grow(struct eventpoll *ep)
+{
+	struct uk_hlist_head *hash;
+	struct eventpoll_fd *efd;
+	struct uk_list_head *itr;
+	unsigned int size, i;
+
+	UK_ASSERT(ep->a);
+
+	if (ep->fd_count < ep->fd_hash_size)
+		return;
+
+	size = (ep->fd_hash_size) ? ep->fd_hash_size << 1 : EP_HASH_MIN;
+	hash = uk_malloc(ep->a, size * sizeof(*hash));
+	if (unlikely(!hash))
+		return;
+
+	for (i = 0; i < size; i++)
+		UK_INIT_HLIST_HEAD(&hash[i]);
+
+	if (ep->fd_hash)
+		uk_free(ep->a, ep->fd_hash);
+	ep->fd_hash = hash;
+	ep->fd_hash_size = size;
+
+	uk_list_for_each(itr, &ep->fd_list) {
+		efd = uk_list_entry(itr, struct eventpoll_fd, fd_link);
+		uk_hlist_add_head(&efd->fd_hnode, efd_bucket(ep, efd->fd));
+	}
 }
 
 static struct eventpoll_fd *efd_find(struct eventpoll *ep, int fd)
 {
 	struct eventpoll_fd *efd;
+	struct uk_hlist_node *hitr;
 	struct uk_list_head *itr;
 
 	UK_ASSERT(ep);
 
+	if (ep->fd_hash) {
+		uk_hlist_for_each(hitr, efd_bucket(ep, fd)) {
+			efd = uk_hlist_entry(hitr, struct eventpoll_fd,
+					     fd_hnode);
+			if (efd->fd == fd)
+				return efd;
+		}
+		return NULL;
+	}
+
 	uk_list_for_each(itr, &ep->fd_list) {
 		efd = uk_list_entry(itr, struct eventpoll_fd, fd_link);
 
@@ -99,6 +175,39 @@ static struct eventpoll_fd *efd_find(struct eventpoll *ep, int fd)
 	return NULL;
 }
 
+/*
+ * Returns the events that are reported for an fd. A one-shot fd that
+ * reported an event is disarmed until it is modified again and does not
+ * report anything, not even errors.
+ */
+static inline unsigned int efd_filter(struct eventpoll_fd *efd)
+{
+	unsigned int events = (unsigned int)efd->event.events;
+
+	if (!(events & ~EP_PRIVATE_BITS))
+		return 0;
+
+	return events | EPOLLERR_SET;
+}
+
+/*
+ * Puts an fd on the triggered list and wakes up waiters. Events of
+ * EPOLLEXCLUSIVE fds wake up only one waiter.
+ * NOTE: The caller must hold the fd_lock of the eventpoll
+ */
+static void efd_trigger(struct eventpoll_fd *efd)
+{
+	struct eventpoll *ep = efd->ep;
+
+	if (uk_list_empty(&efd->tr_link))
+		uk_list_add_tail(&efd->tr_link, &ep->tr_list);
+
+	if (efd->event.events & EPOLLEXCLUSIVE)
+		uk_waitq_wake_up_one(&ep->wq);
+	else
+		uk_waitq_wake_up(&ep->wq);
+}
+
 static int efd_poll(struct eventpoll_fd *efd, unsigned int *revents)
 {
 	struct vnode *vnode;
@@ -111,7 +220,7 @@ static int efd_poll(struct eventpoll_fd *efd, unsigned int *revents)
 	UK_ASSERT(efd->vfs_file);
 	vnode = efd->vfs_file->f_dentry->d_vnode;
 
-	filter = (unsigned int)efd->event.events | EPOLLERR_SET;
+	filter = efd_filter(efd);
 
 	UK_ASSERT(vnode->v_op->vop_poll);
 	ret = VOP_POLL(vnode, revents, &efd->cb);
@@ -127,6 +236,32 @@ static int efd_poll(struct eventpoll_fd *efd, unsigned int *revents)
 	return 0;
 }
 
+static void ecb_poll_only_unregister(struct eventpoll_cb *ecb __unused)
+{
+}
+
+unsigned int eventpoll_poll_file(struct vfscore_file *fp, unsigned int events)
+{
+	struct eventpoll_cb ecb = {
+		.unregister = ecb_poll_only_unregister,
+		.data = EVENTPOLL_CB_POLL_ONLY,
+		.cb_link = UK_LIST_HEAD_INIT(ecb.cb_link),
+	};
+	struct vnode *vnode;
+	unsigned int revents = 0;
+
+	UK_ASSERT(fp);
+	vnode = fp->f_dentry->d_vnode;
+
+	UK_ASSERT(vnode->v_op->vop_poll);
+	if (VOP_POLL(vnode, &revents, &ecb))
+		return EPOLLERR;
+
+	UK_ASSERT(ecb.unregister == ecb_poll_only_unregister);
+	UK_ASSERT(ecb.data == EVENTPOLL_CB_POLL_ONLY);
+	return revents & (events | EPOLLERR_SET);
+}
+
 void eventpoll_add_unsafe(struct eventpoll *ep, struct eventpoll_fd *efd)
 {
 	UK_ASSERT(ep);
@@ -142,6 +277,9 @@ void eventpoll_add_unsafe(struct eventpoll *ep, struct eventpoll_fd *efd)
 
 	uk_list_add_tail(&efd->f_link, &efd->vfs_file->f_ep);
 	uk_list_add_tail(&efd->fd_link, &ep->fd_list);
+	if (ep->fd_hash)
+		uk_hlist_add_head(&efd->fd_hnode, efd_bucket(ep, efd->fd));
+	ep->fd_count++;
 
 	trace_efd_add(ep, efd->fd, efd->vfs_file->f_dentry->d_vnode->v_type);
 }
@@ -159,6 +297,10 @@ int eventpoll_add(struct eventpoll *ep, int fd, struct vfscore_file *fp,
 	if (!event)
 		return -EINVAL;
 
+	if ((event->events & EPOLLEXCLUSIVE) &&
+	    (event->events & ~EP_EXCLUSIVE_OK_BITS))
+		return -EINVAL;
+
 	/*
 	 * Allocate and initialize a new eventpoll fd
 	 *
@@ -180,6 +322,8 @@ int eventpoll_add(struct eventpoll *ep, int fd, struct vfscore_file *fp,
 
 	uk_mutex_lock(&ep->fd_lock);
 
+	ep_hash_grow(ep);
+
 	/* fds must not be added multiple times */
 	if (efd_find(ep, fd)) {
 		ret = -EEXIST;
@@ -204,11 +348,7 @@ int eventpoll_add(struct eventpoll *ep, int fd, struct vfscore_file *fp,
 	if (revents & efd->event.events) {
 		trace_efd_signal(ep, efd->fd, revents,
 				 revents & efd->event.events);
-
-		if (uk_list_empty(&efd->tr_link))
-			uk_list_add_tail(&efd->tr_link, &ep->tr_list);
-
-		uk_waitq_wake_up(&ep->wq);
+		efd_trigger(efd);
 	}
 
 EXIT:
@@ -230,6 +370,10 @@ int eventpoll_mod(struct eventpoll *ep, int fd, const struct epoll_event *event)
 	if (!event)
 		return -EINVAL;
 
+	/* EPOLLEXCLUSIVE can only be set when adding an fd */
+	if (event->events & EPOLLEXCLUSIVE)
+		return -EINVAL;
+
 	uk_mutex_lock(&ep->fd_lock);
 
 	efd = efd_find(ep, fd);
@@ -238,6 +382,12 @@ int eventpoll_mod(struct eventpoll *ep, int fd, const struct epoll_event *event)
 		goto EXIT;
 	}
 
+	if (efd->event.events & EPOLLEXCLUSIVE) {
+		ret = -EINVAL;
+		goto EXIT;
+	}
+
+	/* This also re-arms a disarmed one-shot fd */
 	efd->event = *event;
 
 	/* We need to poll the fd here to check if the new configuration
@@ -251,11 +401,7 @@ int eventpoll_mod(struct eventpoll *ep, int fd, const struct epoll_event *event)
 	if (revents & efd->event.events) {
 		trace_efd_signal(ep, efd->fd, revents,
 				 revents & efd->event.events);
-
-		if (uk_list_empty(&efd->tr_link))
-			uk_list_add_tail(&efd->tr_link, &ep->tr_list);
-
-		uk_waitq_wake_up(&ep->wq);
+		efd_trigger(efd);
 	}
 
 EXIT:
@@ -276,6 +422,9 @@ void eventpoll_del_unsafe(struct eventpoll_fd *efd)
 	uk_list_del(&efd->f_link);
 	uk_list_del(&efd->tr_link);
 	uk_list_del(&efd->fd_link);
+	uk_hlist_del_init(&efd->fd_hnode);
+	UK_ASSERT(efd->ep->fd_count > 0);
+	efd->ep->fd_count--;
 
 	trace_efd_del(efd->ep, efd->fd);
 
@@ -353,10 +502,12 @@ int eventpoll_wait(struct eventpoll *ep, struct epoll_event *events,
 {
 	struct eventpoll_fd *efd;
 	struct uk_list_head *itr, *tmp;
+	UK_LIST_HEAD(reported);
 	unsigned int revents = 0;
 	__nsec deadline;
 	int timedout;
 	int ret, n = 0;
+	int more = 0;
 
 	UK_ASSERT(ep);
 
@@ -383,12 +534,14 @@ int eventpoll_wait(struct eventpoll *ep, struct epoll_event *events,
 		uk_list_for_each_safe(itr, tmp, &ep->tr_list) {
 			efd = uk_list_entry(itr, struct eventpoll_fd, tr_link);
 
-			if (n == maxevents)
+			if (n == maxevents) {
+				more = 1;
 				break;
+			}
 
 			ret = efd_poll(efd, &revents);
 			if (ret)
-				revents = EPOLLERR;
+				revents = EPOLLERR & efd_filter(efd);
 
 			if (revents) {
 				UK_ASSERT(events);
@@ -397,11 +550,26 @@ int eventpoll_wait(struct eventpoll *ep, struct epoll_event *events,
 				events[n].data = efd->event.data;
 				n++;
 
-				/* If the fd is edge-triggered we remove the fd
-				 * from the triggered list
-				 */
-				if (efd->event.events & EPOLLET)
+				if (efd->event.events & EPOLLONESHOT) {
+					/* Disarm the fd until it is modified
+					 * again
+					 */
+					efd->event.events &= EP_PRIVATE_BITS;
+					uk_list_del_init(&efd->tr_link);
+				} else if (efd->event.events & EPOLLET) {
+					/* If the fd is edge-triggered we
+					 * remove the fd from the triggered list
+					 */
 					uk_list_del_init(&efd->tr_link);
+				} else {
+					/* Level-triggered fds stay triggered.
+					 * Queue them behind the ones we did
+					 * not look at yet, so that a small
+					 * maxevents does not starve those.
+					 */
+					uk_list_move_tail(&efd->tr_link,
+							  &reported);
+				}
 			} else {
 				/* The fd is not actually ready so remove it
 				 * from the triggered list
@@ -410,12 +578,24 @@ int eventpoll_wait(struct eventpoll *ep, struct epoll_event *events,
 			}
 		}
 
-		if (n > 0)
+		uk_list_splice_tail_init(&reported, &ep->tr_list);
+
+		if (n > 0) {
+			/* Let another waiter pick up the events that did not
+			 * fit into our buffer
+			 */
+			if (more)
+				uk_waitq_wake_up_one(&ep->wq);
 			break;
+		}
 
 		trace_ep_wait(ep, uk_thread_current());
 
-		timedout = uk_waitq_wait_event_deadline_mutex(&ep->wq,
+		/* Waiters are exclusive so that EPOLLEXCLUSIVE events wake
+		 * up only one of them
+		 */
+		timedout = uk_waitq_wait_event_deadline_exclusive_mutex(
+				&ep->wq,
 				!uk_list_empty(&ep->tr_list) &&
 				!uk_list_empty(&ep->fd_list), deadline,
 				&ep->fd_lock);
@@ -442,18 +622,13 @@ void eventpoll_signal(struct eventpoll_cb *ecb, unsigned int revents)
 	UK_ASSERT(efd->ep);
 	ep = efd->ep;
 
-	filtered = revents & ((unsigned int)efd->event.events | EPOLLERR_SET);
-
 	uk_mutex_lock(&ep->fd_lock);
 
+	filtered = revents & efd_filter(efd);
 	trace_efd_signal(ep, efd->fd, revents, filtered);
 
-	if (filtered) {
-		if (uk_list_empty(&efd->tr_link))
-			uk_list_add_tail(&efd->tr_link, &ep->tr_list);
-
-		uk_waitq_wake_up(&ep->wq);
-	}
+	if (filtered)
+		efd_trigger(efd);
 
 	uk_mutex_unlock(&ep->fd_lock);
 }
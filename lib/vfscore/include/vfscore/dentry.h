@@ -38,6 +38,7 @@
 #include <uk/list.h>
 
 struct vnode;
+struct mount;
 
 struct dentry {
 	struct uk_hlist_node d_link;	/* link for hash list */
@@ -52,6 +53,15 @@ struct dentry {
 	struct uk_list_head d_child_link;
 };
 
+/*
+ * Dentry cache statistics, kept per mount point
+ */
+struct dentry_stats {
+	unsigned long	ds_hits;	/* lookups found in the dentry hash */
+	unsigned long	ds_neg_hits;	/* lookups found as negative entry */
+	unsigned long	ds_misses;	/* lookups passed to VOP_LOOKUP */
+};
+
 struct dentry *dentry_alloc(struct dentry *parent_dp, struct vnode *vp, const char *path);
 struct dentry *dentry_lookup(struct mount *mp, char *path);
 int dentry_move(struct dentry *dp, struct dentry *parent_dp, char *path);
@@ -59,4 +69,10 @@ void dentry_remove(struct dentry *dp);
 void dref(struct dentry *dp);
 void drele(struct dentry *dp);
 
+int dentry_neg_lookup(struct mount *mp, const char *path);
+void dentry_neg_add(struct mount *mp, const char *path);
+void dentry_neg_remove(struct dentry *ddp, const char *name);
+void dentry_neg_purge(struct mount *mp, const char *path);
+void dentry_stats_get(struct mount *mp, struct dentry_stats *dst);
+
 #endif /* _OSV_DENTRY_H */
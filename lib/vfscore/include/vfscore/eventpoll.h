@@ -65,13 +65,18 @@ struct eventpoll_cb {
 	 */
 	void (*unregister)(struct eventpoll_cb *ecb);
 
-	/* Optional context for driver */
+	/* Optional context for driver. It is EVENTPOLL_CB_POLL_ONLY for a
+	 * control block that is polled once and must not be registered.
+	 */
 	void *data;
 
 	/* Optional link for the driver to add this cb into a list */
 	struct uk_list_head cb_link;
 };
 
+/* Context of the control blocks used by eventpoll_poll_file() */
+#define EVENTPOLL_CB_POLL_ONLY ((void *)-1)
+
 /* Eventpoll file description */
 struct eventpoll_fd {
 	/* Context block for driver to implement asynchronous signaling */
@@ -95,6 +100,9 @@ struct eventpoll_fd {
 	/* Used to link into monitored fd list */
 	struct uk_list_head fd_link;
 
+	/* Used to link into the fd index of the eventpoll */
+	struct uk_hlist_node fd_hnode;
+
 	/* Used to link into triggered list which is scanned by
 	 * eventpoll_wait() to find pending events. Being in the list, does not
 	 * guarantee that events are still pending.
@@ -125,6 +133,7 @@ static inline void eventpoll_fd_init(struct eventpoll_fd *efd,
 	UK_INIT_LIST_HEAD(&efd->cb.cb_link);
 
 	UK_INIT_LIST_HEAD(&efd->fd_link);
+	UK_INIT_HLIST_NODE(&efd->fd_hnode);
 	UK_INIT_LIST_HEAD(&efd->tr_link);
 	UK_INIT_LIST_HEAD(&efd->f_link);
 }
@@ -143,6 +152,16 @@ struct eventpoll {
 	/* List of monitored fds */
 	struct uk_list_head fd_list;
 
+	/* Index of monitored fds by fd number with `fd_hash_size` buckets
+	 * (power of two). It is allocated on demand by eventpoll_add(); the
+	 * fd list is scanned instead as long as there is no index.
+	 */
+	struct uk_hlist_head *fd_hash;
+	unsigned int fd_hash_size;
+
+	/* Number of monitored fds */
+	unsigned int fd_count;
+
 	/* List of triggered fds */
 	struct uk_list_head tr_list;
 
@@ -164,6 +183,9 @@ static inline void eventpoll_init(struct eventpoll *ep, struct uk_alloc *a)
 
 	uk_mutex_init(&ep->fd_lock);
 	UK_INIT_LIST_HEAD(&ep->fd_list);
+	ep->fd_hash = NULL;
+	ep->fd_hash_size = 0;
+	ep->fd_count = 0;
 	UK_INIT_LIST_HEAD(&ep->tr_list);
 	uk_waitq_init(&ep->wq);
 }
@@ -183,6 +205,20 @@ void eventpoll_del_unsafe(struct eventpoll_fd *efd);
 
 int eventpoll_wait(struct eventpoll *ep, struct epoll_event *events,
 		   int maxevents, const __nsec *timeout);
+
+/* Number of file descriptors poll() and select() can wait for without
+ * allocating memory from the heap
+ */
+#define EVENTPOLL_STACK_FDS 8
+
+/* Polls the current state of a file without registering an eventpoll with
+ * the driver. The driver is passed a context block whose unregister
+ * callback is already set so that it considers the block registered.
+ * Returns the events out of `events` (plus error conditions) that are
+ * pending, or EPOLLERR if the file cannot be polled.
+ */
+unsigned int eventpoll_poll_file(struct vfscore_file *fp,
+				 unsigned int events);
 /* eventpoll_signal() must not be called from withing an IRQ context */
 void eventpoll_signal(struct eventpoll_cb *ecb, unsigned int revents);
 
@@ -37,6 +37,8 @@
 #include <sys/mount.h>
 #include <sys/statfs.h>
 #include <limits.h>
+#include <uk/config.h>
+#include <uk/arch/time.h>
 #include <uk/list.h>
 #include <vfscore/vnode.h>
 
@@ -55,9 +57,22 @@ struct mount {
 	void		*m_data;	/* private data for fs */
 	struct uk_list_head mnt_list;
 	fsid_t 		m_fsid; 	/* id that uniquely identifies the fs */
+	__nsec		m_dneg_timeout;	/* lifetime of negative dentries */
+#if CONFIG_LIBVFSCORE_DENTRY_STATS
+	struct dentry_stats m_dstats;	/* dentry cache statistics */
+#endif
 };
 
 
+/*
+ * Values of m_dneg_timeout. Negative dentries are only created on mounts
+ * whose file system opts in by setting m_dneg_timeout in VFS_MOUNT, either
+ * to a lifetime in nanoseconds or to DNEG_NOEXPIRE if all changes to the
+ * file system go through vfscore.
+ */
+#define DNEG_DISABLED	((__nsec) 0)
+#define DNEG_NOEXPIRE	((__nsec) -1)
+
 /*
  * Mount flags.
  */
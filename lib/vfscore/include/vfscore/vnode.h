@@ -63,6 +63,8 @@ enum vtype {
 	VFIFO,	    /* FIFO */
 	VEPOLL,	    /* Epoll */
 	VEVENT,	    /* Eventfd */
+	VTIMER,	    /* Timerfd */
+	VSIGFD,	    /* Signalfd */
 	VBAD
 };
 
@@ -141,6 +143,7 @@ struct vattr {
 
 #define IO_APPEND	0x0001
 #define IO_SYNC		0x0002
+#define IO_NDELAY	0x0004
 
 /*
  * ARC actions
@@ -38,10 +38,19 @@
 #include <stdlib.h>
 #include <sys/param.h>
 
+#include <uk/arch/atomic.h>
 #include <vfscore/dentry.h>
+#include <vfscore/mount.h>
 #include <vfscore/vnode.h>
 #include "vfs.h"
 
+/* Counted without dentry_hash_lock, hence atomically */
+#if CONFIG_LIBVFSCORE_DENTRY_STATS
+#define DENTRY_STAT_MISS(mp) ukarch_inc(&(mp)->m_dstats.ds_misses)
+#else
+#define DENTRY_STAT_MISS(mp) ((void)(mp))
+#endif
+
 static ssize_t
 read_link(struct vnode *vp, char *buf, size_t bufsz, ssize_t *sz)
 {
@@ -138,6 +147,12 @@ namei(const char *path, struct dentry **dpp)
 			*dpp = dp;
 			return 0;
 		}
+		/*
+		 * Only the full path is checked against the negative
+		 * dentries here; a missing parent is caught during the walk.
+		 */
+		if (dentry_neg_lookup(mp, node))
+			return ENOENT;
 		/*
 		 * Find target vnode, started from root directory.
 		 * This is done to attach the fs specific data to
@@ -180,9 +195,18 @@ namei(const char *path, struct dentry **dpp)
 			vn_lock(dvp);
 			dp = dentry_lookup(mp, node);
 			if (dp == NULL) {
+				if (dentry_neg_lookup(mp, node)) {
+					vn_unlock(dvp);
+					drele(ddp);
+					return ENOENT;
+				}
+
 				/* Find a vnode in this directory. */
+				DENTRY_STAT_MISS(mp);
 				error = VOP_LOOKUP(dvp, name, &vp);
 				if (error) {
+					if (error == ENOENT)
+						dentry_neg_add(mp, node);
 					vn_unlock(dvp);
 					drele(ddp);
 					return error;
@@ -286,8 +310,16 @@ namei_last_nofollow(char *path, struct dentry *ddp, struct dentry **dpp)
 	vn_lock(dvp);
 	dp = dentry_lookup(mp, node);
 	if (dp == NULL) {
+		if (dentry_neg_lookup(mp, node)) {
+			error = ENOENT;
+			goto out;
+		}
+
+		DENTRY_STAT_MISS(mp);
 		error = VOP_LOOKUP(dvp, name, &vp);
 		if (error != 0) {
+			if (error == ENOENT)
+				dentry_neg_add(mp, node);
 			goto out;
 		}
 
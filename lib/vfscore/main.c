@@ -1961,6 +1961,12 @@ UK_LLSYSCALL_R_DEFINE(int, fcntl, int, fd, unsigned int, cmd, int, arg)
 	case F_SETOWN:
 		uk_pr_warn_once("fcntl(F_SETOWN) stubbed\n");
 		break;
+	case F_GETPIPE_SZ:
+		error = vfscore_pipe_get_size(fp, &ret);
+		break;
+	case F_SETPIPE_SZ:
+		error = vfscore_pipe_set_size(fp, arg, &ret);
+		break;
 	default:
 		uk_pr_err("unsupported fcntl cmd 0x%x\n", cmd);
 		error = EINVAL;
@@ -1985,7 +1991,8 @@ int fcntl(int fd, int cmd, ...)
 
 	va_start(ap, cmd);
 	if (cmd == F_SETFD ||
-	    cmd == F_SETFL) {
+	    cmd == F_SETFL ||
+	    cmd == F_SETPIPE_SZ) {
 		arg = va_arg(ap, int);
 	}
 	va_end(ap);
@@ -161,7 +161,7 @@ UK_SYSCALL_R_DEFINE(int, mount, const char*, dev, const char*, dir,
 	/*
 	 * Create VFS mount entry.
 	 */
-	mp = malloc(sizeof(struct mount));
+	mp = calloc(1, sizeof(struct mount));
 	if (!mp) {
 		error = ENOMEM;
 		goto err1;
@@ -294,6 +294,12 @@ found:
 	if ((error = VFS_UNMOUNT(mp, flags)) != 0)
 		goto out;
 	uk_list_del_init(&mp->mnt_list);
+	dentry_neg_purge(mp, NULL);
+#if CONFIG_LIBVFSCORE_DENTRY_STATS
+	uk_pr_debug("VFS: %s dentry cache: %lu hits, %lu negative hits, %lu misses\n",
+		    mp->m_path, mp->m_dstats.ds_hits,
+		    mp->m_dstats.ds_neg_hits, mp->m_dstats.ds_misses);
+#endif
 
 #ifdef HAVE_BUFFERS
 	/* Flush all buffers */
@@ -492,14 +498,19 @@ void
 vfscore_mount_dump(void)
 {
 	struct mount *mp;
+	struct dentry_stats ds;
+
 	uk_mutex_lock(&mount_lock);
 
 	uk_pr_debug("vfscore_mount_dump\n");
-	uk_pr_debug("dev      count root\n");
-	uk_pr_debug("-------- ----- --------\n");
+	uk_pr_debug("dev      count     hits  neghits   misses root\n");
+	uk_pr_debug("-------- ----- -------- -------- -------- --------\n");
 
 	uk_list_for_each_entry(mp, &mount_list, mnt_list) {
-		uk_pr_debug("%8p %5d %s\n", mp->m_dev, mp->m_count, mp->m_path);
+		dentry_stats_get(mp, &ds);
+		uk_pr_debug("%8p %5d %8lu %8lu %8lu %s\n", mp->m_dev,
+			    mp->m_count, ds.ds_hits, ds.ds_neg_hits,
+			    ds.ds_misses, mp->m_path);
 	}
 	uk_mutex_unlock(&mount_lock);
 }
@@ -31,9 +31,12 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE
+
 #include <uk/config.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 #include <string.h>
 #include <vfscore/file.h>
 #include <vfscore/fs.h>
@@ -43,21 +46,69 @@
 #include <uk/wait.h>
 #include <uk/syscall.h>
 #include <sys/ioctl.h>
-#include <uk/syscall.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <uk/alloc.h>
+#include <uk/arch/atomic.h>
+#include <uk/essentials.h>
+#include "vfs.h"
+
+/* Default pipe capacity; we use the default size in Linux kernel */
+#define PIPE_DEF_SIZE	(1UL << CONFIG_LIBVFSCORE_PIPE_SIZE_ORDER)
+/* Largest capacity that can be set with F_SETPIPE_SZ (the default of
+ * Linux' /proc/sys/fs/pipe-max-size)
+ */
+#define PIPE_MAX_SIZE	MAX(1UL << 20, PIPE_DEF_SIZE)
 
-/* We use the default size in Linux kernel */
-#define PIPE_MAX_SIZE	(1 << CONFIG_LIBVFSCORE_PIPE_SIZE_ORDER)
+#define PIPE_PAGE_SIZE	__PAGE_SIZE
 
-struct pipe_buf {
-	/* The buffer */
+/*
+ * A page of pipe data. Data is appended by the writer at `len` and
+ * consumed by the reader at `off`.
+ */
+struct pipe_page {
+	/* The page, PIPE_PAGE_SIZE bytes */
 	char *data;
-	/* The buffer capacity, always a power of 2 */
-	unsigned long capacity;
+	/* First unread byte, only changed by the reader */
+	unsigned long off;
+	/* End of the data, only increased by the writer */
+	unsigned long len;
+	/* The writer may still append to the page. Pages moved in from
+	 * another pipe are not appended to.
+	 */
+	int merge;
+};
+
+/*
+ * The pipe buffer is a ring of page slots. Readers and writers are
+ * serialized among themselves by `rdlock` and `wrlock`, but the reading
+ * and the writing side do not share a lock: the writer owns `prod`, the
+ * reader owns `cons`, and each side only publishes its index with release
+ * semantics. Taking both locks freezes the ring (see pipe_buf_resize()).
+ */
+struct pipe_buf {
+	/* Ring of pages; the number of slots is always a power of 2 */
+	struct pipe_page *slots;
+	unsigned long nr_slots;
 	/* Producer index */
 	unsigned long prod;
 	/* Consumer index */
 	unsigned long cons;
 
+	/* Drained pages kept for reuse by the writer. This is a second
+	 * ring of `nr_slots` entries in the opposite direction: the reader
+	 * produces, the writer consumes.
+	 */
+	char **spare;
+	unsigned long spare_prod;
+	unsigned long spare_cons;
+
+	/* Total bytes written and read, for lock-free state queries */
+	unsigned long bytes_in;
+	unsigned long bytes_out;
+	/* Bytes the writer can still append to the last page */
+	unsigned long tail_room;
+
 	/* Read lock */
 	struct uk_mutex rdlock;
 	/* Write lock */
@@ -69,9 +120,11 @@ struct pipe_buf {
 	struct uk_waitq wrwq;
 };
 
-#define PIPE_BUF_IDX(buf, n)    ((n) & ((buf)->capacity - 1))
-#define PIPE_BUF_PROD_IDX(buf)  PIPE_BUF_IDX((buf), (buf)->prod)
-#define PIPE_BUF_CONS_IDX(buf)  PIPE_BUF_IDX((buf), (buf)->cons)
+#define PIPE_BUF_IDX(buf, n)    ((n) & ((buf)->nr_slots - 1))
+#define PIPE_BUF_SLOT(buf, n)   (&(buf)->slots[PIPE_BUF_IDX((buf), (n))])
+
+#define PIPE_LOAD(x)		__atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define PIPE_STORE(x, v)	__atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
 
 struct pipe_file {
 	/* Pipe buffer */
@@ -89,53 +142,112 @@ struct pipe_file {
 	struct uk_list_head eplist;
 };
 
+static struct vnops pipe_vnops;
 
-static struct pipe_buf *pipe_buf_alloc(int capacity)
+static unsigned long pipe_size_to_slots(unsigned long size)
 {
-	struct pipe_buf *pipe_buf;
+	unsigned long nr_slots = 1;
 
-	UK_ASSERT(POWER_OF_2(capacity));
+	while (nr_slots * PIPE_PAGE_SIZE < size)
+		nr_slots <<= 1;
+
+	return nr_slots;
+}
+
+static struct pipe_buf *pipe_buf_alloc(unsigned long capacity)
+{
+	struct pipe_buf *pipe_buf;
 
 	pipe_buf = malloc(sizeof(*pipe_buf));
 	if (!pipe_buf)
 		return NULL;
 
-	pipe_buf->data = malloc(capacity);
-	if (!pipe_buf->data) {
-		free(pipe_buf);
-		return NULL;
-	}
+	pipe_buf->nr_slots = pipe_size_to_slots(capacity);
+	pipe_buf->slots = calloc(pipe_buf->nr_slots, sizeof(struct pipe_page));
+	if (!pipe_buf->slots)
+		goto err_free_buf;
+
+	pipe_buf->spare = calloc(pipe_buf->nr_slots, sizeof(char *));
+	if (!pipe_buf->spare)
+		goto err_free_slots;
 
-	pipe_buf->capacity = capacity;
 	pipe_buf->cons = 0;
 	pipe_buf->prod = 0;
+	pipe_buf->spare_cons = 0;
+	pipe_buf->spare_prod = 0;
+	pipe_buf->bytes_in = 0;
+	pipe_buf->bytes_out = 0;
+	pipe_buf->tail_room = 0;
 	uk_mutex_init(&pipe_buf->rdlock);
 	uk_mutex_init(&pipe_buf->wrlock);
 	uk_waitq_init(&pipe_buf->rdwq);
 	uk_waitq_init(&pipe_buf->wrwq);
 
 	return pipe_buf;
+
+err_free_slots:
+	free(pipe_buf->slots);
+err_free_buf:
+	free(pipe_buf);
+	return NULL;
+}
+
+static char *pipe_page_alloc(void)
+{
+	return uk_palloc(uk_alloc_get_default(), 1);
+}
+
+static void pipe_page_free(char *page)
+{
+	uk_pfree(uk_alloc_get_default(), page, 1);
 }
 
 void pipe_buf_free(struct pipe_buf *pipe_buf)
 {
-	free(pipe_buf->data);
+	unsigned long i;
+
+	for (i = pipe_buf->cons; i != pipe_buf->prod; i++)
+		pipe_page_free(PIPE_BUF_SLOT(pipe_buf, i)->data);
+	for (i = pipe_buf->spare_cons; i != pipe_buf->spare_prod; i++)
+		pipe_page_free(pipe_buf->spare[PIPE_BUF_IDX(pipe_buf, i)]);
+
+	free(pipe_buf->spare);
+	free(pipe_buf->slots);
 	free(pipe_buf);
 }
 
 static unsigned long pipe_buf_get_available(const struct pipe_buf *pipe_buf)
 {
-	return pipe_buf->prod - pipe_buf->cons;
+	return PIPE_LOAD(pipe_buf->bytes_in) - PIPE_LOAD(pipe_buf->bytes_out);
 }
 
-static unsigned long pipe_buf_get_free_space(struct pipe_buf *pipe_buf)
+static unsigned long pipe_buf_get_capacity(const struct pipe_buf *pipe_buf)
 {
-	return pipe_buf->capacity - pipe_buf_get_available(pipe_buf);
+	return pipe_buf->nr_slots * PIPE_PAGE_SIZE;
+}
+
+static int pipe_buf_has_free_slot(struct pipe_buf *pipe_buf)
+{
+	return PIPE_LOAD(pipe_buf->prod) - PIPE_LOAD(pipe_buf->cons)
+		< UK_READ_ONCE(pipe_buf->nr_slots);
+}
+
+/*
+ * Writer side: Returns the number of bytes that can be written without
+ * blocking. Readers only make more room, so this is a lower bound.
+ */
+static unsigned long pipe_buf_get_room(struct pipe_buf *pipe_buf)
+{
+	unsigned long used = pipe_buf->prod - PIPE_LOAD(pipe_buf->cons);
+
+	return pipe_buf->tail_room
+		+ (pipe_buf->nr_slots - used) * PIPE_PAGE_SIZE;
 }
 
 static int pipe_buf_can_write(struct pipe_buf *pipe_buf)
 {
-	return pipe_buf_get_free_space(pipe_buf) > 0;
+	return UK_READ_ONCE(pipe_buf->tail_room) > 0 ||
+		pipe_buf_has_free_slot(pipe_buf);
 }
 
 static int pipe_buf_can_read(struct pipe_buf *pipe_buf)
@@ -148,83 +260,237 @@ static int pipe_file_can_read(struct pipe_file *pipe_file)
 	return pipe_buf_can_read(pipe_file->buf) || !(pipe_file->w_refcount);
 }
 
-static unsigned long pipe_buf_write(struct pipe_buf *pipe_buf,
-		struct iovec *iovec, size_t iovec_off)
+static int pipe_file_can_write(struct pipe_file *pipe_file)
 {
-	unsigned long prod_idx, to_write;
-	void *iovec_data = iovec->iov_base + iovec_off;
-	size_t iov_len = iovec->iov_len - iovec_off;
+	return pipe_buf_can_write(pipe_file->buf) || !(pipe_file->r_refcount);
+}
 
-	prod_idx = PIPE_BUF_PROD_IDX(pipe_buf);
-	to_write = MIN(pipe_buf_get_free_space(pipe_buf), iov_len);
-	if (to_write == 0)
-		goto out;
+/* Writer side: Takes a page for a new slot, preferably a recycled one */
+static char *pipe_buf_get_page(struct pipe_buf *pipe_buf)
+{
+	unsigned long sc = pipe_buf->spare_cons;
+	char *page;
 
-	/* Copy in one piece */
-	if (prod_idx + to_write <= pipe_buf->capacity)
-		memcpy(pipe_buf->data + prod_idx, iovec_data, to_write);
+	if (sc == PIPE_LOAD(pipe_buf->spare_prod))
+		return pipe_page_alloc();
 
-	else {
-		int first_copy_bytes, second_copy_bytes;
+	page = pipe_buf->spare[PIPE_BUF_IDX(pipe_buf, sc)];
+	PIPE_STORE(pipe_buf->spare_cons, sc + 1);
+	return page;
+}
 
-		/* Copy the first part */
-		first_copy_bytes = pipe_buf->capacity - prod_idx;
-		memcpy(pipe_buf->data + prod_idx,
-				iovec_data,
-				first_copy_bytes);
+/* Reader side: Recycles a drained page */
+static void pipe_buf_put_page(struct pipe_buf *pipe_buf, char *page)
+{
+	unsigned long sp = pipe_buf->spare_prod;
 
-		/* Copy the second part */
-		second_copy_bytes = prod_idx + to_write - pipe_buf->capacity;
-		memcpy(pipe_buf->data,
-				iovec_data + first_copy_bytes,
-				second_copy_bytes);
+	if (sp - PIPE_LOAD(pipe_buf->spare_cons) >= pipe_buf->nr_slots) {
+		pipe_page_free(page);
+		return;
 	}
 
-	/* Update producer */
-	pipe_buf->prod += to_write;
+	pipe_buf->spare[PIPE_BUF_IDX(pipe_buf, sp)] = page;
+	PIPE_STORE(pipe_buf->spare_prod, sp + 1);
+}
 
-out:
-	return to_write;
+/*
+ * Writer side: Publishes a page in a new slot. The caller must have
+ * checked that there is a free slot.
+ */
+static void pipe_buf_push_page(struct pipe_buf *pipe_buf, char *page,
+			       unsigned long off, unsigned long len, int merge)
+{
+	struct pipe_page *pg = PIPE_BUF_SLOT(pipe_buf, pipe_buf->prod);
+
+	UK_ASSERT(pipe_buf_has_free_slot(pipe_buf));
+	UK_ASSERT(off < len);
+
+	pg->data = page;
+	pg->off = off;
+	pg->len = len;
+	pg->merge = merge;
+
+	PIPE_STORE(pipe_buf->prod, pipe_buf->prod + 1);
+	PIPE_STORE(pipe_buf->bytes_in, pipe_buf->bytes_in + (len - off));
+	UK_WRITE_ONCE(pipe_buf->tail_room, merge ? PIPE_PAGE_SIZE - len : 0);
 }
 
-static unsigned long pipe_buf_read(struct pipe_buf *pipe_buf,
-		struct iovec *iovec, size_t iovec_off)
+/*
+ * Writer side: Copies up to `len` bytes into the pipe. Data is appended
+ * to the last page as long as it has room.
+ * Returns the number of bytes written or -ENOMEM.
+ */
+static long pipe_buf_write(struct pipe_buf *pipe_buf, const char *src,
+			   unsigned long len)
 {
-	unsigned long cons_idx, to_read;
-	void *iovec_data = iovec->iov_base + iovec_off;
-	size_t iov_len = iovec->iov_len - iovec_off;
+	struct pipe_page *pg;
+	unsigned long written = 0, n;
+	char *page;
+
+	while (written < len) {
+		if (pipe_buf->tail_room) {
+			/* The reader does not retire a page that is not full
+			 * as long as it is the last one, so we may append.
+			 */
+			pg = PIPE_BUF_SLOT(pipe_buf, pipe_buf->prod - 1);
+			n = MIN(pipe_buf->tail_room, len - written);
+			memcpy(pg->data + pg->len, src + written, n);
+			PIPE_STORE(pg->len, pg->len + n);
+			PIPE_STORE(pipe_buf->bytes_in, pipe_buf->bytes_in + n);
+			UK_WRITE_ONCE(pipe_buf->tail_room,
+				      pipe_buf->tail_room - n);
+		} else {
+			if (!pipe_buf_has_free_slot(pipe_buf))
+				break;
 
-	cons_idx = PIPE_BUF_CONS_IDX(pipe_buf);
-	to_read = MIN(pipe_buf_get_available(pipe_buf), iov_len);
-	if (to_read == 0)
-		goto out;
+			page = pipe_buf_get_page(pipe_buf);
+			if (unlikely(!page))
+				return (written) ? (long)written : -ENOMEM;
 
-	/* Copy in one piece */
-	if (cons_idx + to_read <= pipe_buf->capacity)
-		memcpy(iovec_data, pipe_buf->data + cons_idx, to_read);
+			n = MIN(PIPE_PAGE_SIZE, len - written);
+			memcpy(page, src + written, n);
+			pipe_buf_push_page(pipe_buf, page, 0, n, 1);
+		}
+		written += n;
+	}
 
-	else {
-		int first_copy_bytes;
-		int second_copy_bytes;
+	return written;
+}
 
-		/* Copy the first part */
-		first_copy_bytes = pipe_buf->capacity - pipe_buf->cons;
-		memcpy(iovec_data,
-				pipe_buf->data + cons_idx,
-				first_copy_bytes);
+/*
+ * Reader side: Returns the first page with unread data or NULL if the pipe
+ * is empty. Drained pages are retired on the way. `*complete` tells if the
+ * writer is done with the page, i.e., the page may be taken out of the
+ * pipe as a whole.
+ */
+static struct pipe_page *pipe_buf_peek(struct pipe_buf *pipe_buf,
+				       int *complete)
+{
+	unsigned long cons, prod, len;
+	struct pipe_page *pg;
+
+	for (;;) {
+		cons = pipe_buf->cons;
+		prod = PIPE_LOAD(pipe_buf->prod);
+		if (cons == prod)
+			return NULL;
+
+		/* The writer appends to the last page only before it
+		 * publishes a new slot, so loading `prod` before `len` gives
+		 * us the final length of all but the last page.
+		 */
+		pg = PIPE_BUF_SLOT(pipe_buf, cons);
+		len = PIPE_LOAD(pg->len);
+		if (pg->off < len) {
+			*complete = (cons + 1 != prod) ||
+				    (len == PIPE_PAGE_SIZE) || !pg->merge;
+			return pg;
+		}
 
-		/* Copy the second part */
-		second_copy_bytes = cons_idx + to_read - pipe_buf->capacity;
-		memcpy(iovec_data + first_copy_bytes,
-				pipe_buf->data,
-				second_copy_bytes);
+		/* The page is drained. Keep it while the writer may still
+		 * append to it.
+		 */
+		if (len < PIPE_PAGE_SIZE && pg->merge &&
+		    cons + 1 == PIPE_LOAD(pipe_buf->prod))
+			return NULL;
+		if (pg->off < PIPE_LOAD(pg->len))
+			continue;
+
+		pipe_buf_put_page(pipe_buf, pg->data);
+		PIPE_STORE(pipe_buf->cons, cons + 1);
 	}
+}
 
-	/* Update consumer */
-	pipe_buf->cons += to_read;
+/* Reader side: Consumes `n` bytes of the page returned by pipe_buf_peek() */
+static void pipe_buf_consume(struct pipe_buf *pipe_buf, struct pipe_page *pg,
+			     unsigned long n)
+{
+	pg->off += n;
+	PIPE_STORE(pipe_buf->bytes_out, pipe_buf->bytes_out + n);
+}
 
-out:
-	return to_read;
+/*
+ * Reader side: Takes the page returned by pipe_buf_peek() out of the pipe.
+ * The page must be complete.
+ */
+static void pipe_buf_take(struct pipe_buf *pipe_buf, struct pipe_page *pg)
+{
+	UK_ASSERT(pg == PIPE_BUF_SLOT(pipe_buf, pipe_buf->cons));
+
+	PIPE_STORE(pipe_buf->bytes_out,
+		   pipe_buf->bytes_out + (pg->len - pg->off));
+	PIPE_STORE(pipe_buf->cons, pipe_buf->cons + 1);
+}
+
+/* Reader side: Copies up to `len` bytes out of the pipe */
+static unsigned long pipe_buf_read(struct pipe_buf *pipe_buf, char *dst,
+				   unsigned long len)
+{
+	struct pipe_page *pg;
+	unsigned long read = 0, n;
+	int complete;
+
+	while (read < len) {
+		pg = pipe_buf_peek(pipe_buf, &complete);
+		if (!pg)
+			break;
+
+		n = MIN(PIPE_LOAD(pg->len) - pg->off, len - read);
+		memcpy(dst + read, pg->data + pg->off, n);
+		pipe_buf_consume(pipe_buf, pg, n);
+		read += n;
+	}
+
+	return read;
+}
+
+/*
+ * Changes the number of slots of the pipe. Fails with EBUSY if the data in
+ * the pipe does not fit into the new ring.
+ * NOTE: The caller must hold both the write and the read lock.
+ */
+static int pipe_buf_resize(struct pipe_buf *pipe_buf, unsigned long nr_slots)
+{
+	struct pipe_page *slots;
+	char **spare;
+	unsigned long i, sp;
+
+	if (nr_slots == pipe_buf->nr_slots)
+		return 0;
+	if (pipe_buf->prod - pipe_buf->cons > nr_slots)
+		return EBUSY;
+
+	slots = calloc(nr_slots, sizeof(*slots));
+	if (!slots)
+		return ENOMEM;
+	spare = calloc(nr_slots, sizeof(*spare));
+	if (!spare) {
+		free(slots);
+		return ENOMEM;
+	}
+
+	/* Slot indices are free-running, so pages keep their index */
+	for (i = pipe_buf->cons; i != pipe_buf->prod; i++)
+		slots[i & (nr_slots - 1)] = *PIPE_BUF_SLOT(pipe_buf, i);
+
+	sp = pipe_buf->spare_cons;
+	for (i = pipe_buf->spare_cons; i != pipe_buf->spare_prod; i++) {
+		if (sp - pipe_buf->spare_cons < nr_slots)
+			spare[sp++ & (nr_slots - 1)] =
+				pipe_buf->spare[PIPE_BUF_IDX(pipe_buf, i)];
+		else
+			pipe_page_free(pipe_buf->spare[PIPE_BUF_IDX(pipe_buf,
+								    i)]);
+	}
+
+	free(pipe_buf->slots);
+	free(pipe_buf->spare);
+	pipe_buf->slots = slots;
+	pipe_buf->spare = spare;
+	pipe_buf->spare_prod = sp;
+	UK_WRITE_ONCE(pipe_buf->nr_slots, nr_slots);
+
+	return 0;
 }
 
 struct pipe_file *pipe_file_alloc(int capacity, int flags)
@@ -276,6 +542,38 @@ pipe_file_event(struct pipe_file *pipe_file, unsigned int event)
 	uk_mutex_unlock(&pipe_file->eplock);
 }
 
+/*
+ * Readers and writers wait exclusively: new data or new space wakes up
+ * only one of them instead of the whole queue. A woken reader that leaves
+ * data behind hands the wakeup on to the next reader, see
+ * pipe_file_wake_next_reader(), and likewise for writers.
+ */
+static void pipe_file_wake_readers(struct pipe_file *pipe_file)
+{
+	uk_waitq_wake_up_one(&pipe_file->buf->rdwq);
+	pipe_file_event(pipe_file, EPOLLIN | EPOLLRDNORM);
+}
+
+static void pipe_file_wake_writers(struct pipe_file *pipe_file)
+{
+	uk_waitq_wake_up_one(&pipe_file->buf->wrwq);
+	pipe_file_event(pipe_file, EPOLLOUT | EPOLLWRNORM);
+}
+
+/* Called by a reader after it consumed data and dropped the read lock */
+static void pipe_file_wake_next_reader(struct pipe_file *pipe_file)
+{
+	if (pipe_buf_can_read(pipe_file->buf))
+		uk_waitq_wake_up_one(&pipe_file->buf->rdwq);
+}
+
+/* Called by a writer after it produced data and dropped the write lock */
+static void pipe_file_wake_next_writer(struct pipe_file *pipe_file)
+{
+	if (pipe_buf_can_write(pipe_file->buf))
+		uk_waitq_wake_up_one(&pipe_file->buf->wrwq);
+}
+
 static void
 pipe_file_unregister_eventpoll(struct eventpoll_cb *ecb)
 {
@@ -294,129 +592,173 @@ pipe_file_unregister_eventpoll(struct eventpoll_cb *ecb)
 	uk_mutex_unlock(&pipe_file->eplock);
 }
 
-static int pipe_write(struct vnode *vnode,
-		struct uio *buf, int ioflag __unused)
+/*
+ * Waits until data can be written to the pipe.
+ * NOTE: The caller must hold the write lock
+ */
+static int pipe_file_wait_write(struct pipe_file *pipe_file, bool nonblocking)
 {
-	struct pipe_file *pipe_file = vnode->v_data;
 	struct pipe_buf *pipe_buf = pipe_file->buf;
-	bool nonblocking = false; /* TODO handle nonblocking */
-	bool data_available = true;
-	int uio_idx = 0;
+
+	while (!pipe_buf_can_write(pipe_buf)) {
+		if (!pipe_file->r_refcount)
+			break;
+		if (nonblocking)
+			return EAGAIN;
+
+		uk_mutex_unlock(&pipe_buf->wrlock);
+		uk_waitq_wait_event_exclusive(&pipe_buf->wrwq,
+					      pipe_file_can_write(pipe_file));
+		uk_mutex_lock(&pipe_buf->wrlock);
+	}
 
 	if (!pipe_file->r_refcount) {
 		/* TODO before returning the error, send a SIGPIPE signal */
-		return -EPIPE;
+		return EPIPE;
 	}
 
-	uk_mutex_lock(&pipe_buf->wrlock);
-	while (data_available && uio_idx < buf->uio_iovcnt) {
-		struct iovec *iovec = &buf->uio_iov[uio_idx];
-		unsigned long off = 0;
+	return 0;
+}
 
-		while (off < iovec->iov_len) {
-			unsigned long written_bytes;
-
-			written_bytes = pipe_buf_write(pipe_buf, iovec, off);
-			if (written_bytes == 0) {
-				/* No data */
-				if (nonblocking) {
-					data_available = false;
-					break;
-
-				} else {
-					/* Wait until data available */
-					while (!pipe_buf_can_write(pipe_buf)) {
-						uk_mutex_unlock(&pipe_buf->wrlock);
-						uk_waitq_wait_event(&pipe_buf->wrwq,
-							pipe_buf_can_write(pipe_buf));
-						uk_mutex_lock(&pipe_buf->wrlock);
-					}
-				}
-
-			} else {
-				/* Update bytes written_bytes. */
-				buf->uio_resid -= written_bytes;
-
-				off += written_bytes;
-
-				/* wake some readers */
-				uk_waitq_wake_up(&pipe_buf->rdwq);
-				pipe_file_event(pipe_file,
-						EPOLLIN | EPOLLRDNORM);
-			}
-		}
+/*
+ * Waits until there is data in the pipe. Returns 0 with no data available
+ * if all writers are gone (end of file).
+ * NOTE: The caller must hold the read lock
+ */
+static int pipe_file_wait_read(struct pipe_file *pipe_file, bool nonblocking)
+{
+	struct pipe_buf *pipe_buf = pipe_file->buf;
 
-		uio_idx++;
+	while (!pipe_buf_can_read(pipe_buf)) {
+		if (!pipe_file->w_refcount)
+			break;
+		if (nonblocking)
+			return EAGAIN;
+
+		uk_mutex_unlock(&pipe_buf->rdlock);
+		uk_waitq_wait_event_exclusive(&pipe_buf->rdwq,
+					      pipe_file_can_read(pipe_file));
+		uk_mutex_lock(&pipe_buf->rdlock);
 	}
-	uk_mutex_unlock(&pipe_buf->wrlock);
 
 	return 0;
 }
 
-static int pipe_read(struct vnode *vnode,
-		struct vfscore_file *vfscore_file,
-		struct uio *buf, int ioflag __unused)
+static int pipe_write(struct vnode *vnode,
+		struct uio *buf, int ioflag)
 {
 	struct pipe_file *pipe_file = vnode->v_data;
 	struct pipe_buf *pipe_buf = pipe_file->buf;
-	bool nonblocking = (vfscore_file->f_flags & O_NONBLOCK);
-	bool data_available = true;
+	bool nonblocking = (ioflag & IO_NDELAY);
+	unsigned long pending = 0, written = 0;
 	int uio_idx = 0;
+	int error = 0;
+	long ret;
 
-	uk_mutex_lock(&pipe_buf->rdlock);
-	if (nonblocking && !pipe_buf_can_read(pipe_buf)) {
-		uk_mutex_unlock(&pipe_buf->rdlock);
-		return EAGAIN;
+	uk_mutex_lock(&pipe_buf->wrlock);
+
+	/* Writes of up to PIPE_BUF bytes are atomic: a non-blocking one
+	 * fails if the data does not fit into the pipe as a whole.
+	 */
+	if (nonblocking && buf->uio_resid <= PIPE_BUF &&
+	    pipe_file->r_refcount &&
+	    pipe_buf_get_room(pipe_buf) < (unsigned long)buf->uio_resid) {
+		error = EAGAIN;
+		goto out;
 	}
 
-	while (data_available && uio_idx < buf->uio_iovcnt) {
+	while (uio_idx < buf->uio_iovcnt) {
 		struct iovec *iovec = &buf->uio_iov[uio_idx];
 		unsigned long off = 0;
 
 		while (off < iovec->iov_len) {
-			unsigned long read_bytes;
+			ret = pipe_buf_write(pipe_buf,
+					     (char *)iovec->iov_base + off,
+					     iovec->iov_len - off);
+			if (ret < 0) {
+				error = -ret;
+				goto out;
+			}
+			if (ret > 0) {
+				/* Update bytes written */
+				buf->uio_resid -= ret;
+				off += ret;
+				pending += ret;
+				written += ret;
+				continue;
+			}
+
+			/* The pipe is full. Let readers make room before we
+			 * go to sleep.
+			 */
+			if (pending) {
+				pipe_file_wake_readers(pipe_file);
+				pending = 0;
+			}
+			error = pipe_file_wait_write(pipe_file, nonblocking);
+			if (error)
+				goto out;
+		}
+
+		uio_idx++;
+	}
+
+out:
+	uk_mutex_unlock(&pipe_buf->wrlock);
 
-			read_bytes = pipe_buf_read(pipe_buf, iovec, off);
-			if (read_bytes == 0) {
-				/* No data */
-				if (nonblocking) {
-					data_available = false;
-					break;
+	if (pending)
+		pipe_file_wake_readers(pipe_file);
+	if (written)
+		pipe_file_wake_next_writer(pipe_file);
 
-				} else {
-					/* Wait until data available */
-					while (!pipe_buf_can_read(pipe_buf)) {
-						uk_mutex_unlock(&pipe_buf->rdlock);
-						uk_waitq_wait_event(&pipe_buf->rdwq,
-							pipe_file_can_read(pipe_file));
+	/* A partial write is not an error */
+	if (written)
+		error = 0;
 
-						if (!pipe_file->w_refcount)
-							return 0;
+	return error;
+}
 
-						uk_mutex_lock(&pipe_buf->rdlock);
-					}
-				}
+static int pipe_read(struct vnode *vnode,
+		struct vfscore_file *vfscore_file,
+		struct uio *buf, int ioflag)
+{
+	struct pipe_file *pipe_file = vnode->v_data;
+	struct pipe_buf *pipe_buf = pipe_file->buf;
+	bool nonblocking = (vfscore_file->f_flags & O_NONBLOCK) ||
+			   (ioflag & IO_NDELAY);
+	unsigned long read_bytes = 0, n;
+	int uio_idx = 0;
+	int error;
 
-			} else {
-				/* Update bytes read */
-				buf->uio_resid -= read_bytes;
+	uk_mutex_lock(&pipe_buf->rdlock);
 
-				off += read_bytes;
+	/* Block only until some data is available */
+	error = pipe_file_wait_read(pipe_file, nonblocking);
+	if (error)
+		goto out;
 
-				/* wake some writers */
-				uk_waitq_wake_up(&pipe_buf->wrwq);
-				pipe_file_event(pipe_file,
-						EPOLLOUT | EPOLLWRNORM);
+	while (uio_idx < buf->uio_iovcnt) {
+		struct iovec *iovec = &buf->uio_iov[uio_idx];
 
-				break;
-			}
-		}
+		n = pipe_buf_read(pipe_buf, iovec->iov_base, iovec->iov_len);
+		buf->uio_resid -= n;
+		read_bytes += n;
+		if (n < iovec->iov_len)
+			break;
 
 		uio_idx++;
 	}
+
+out:
 	uk_mutex_unlock(&pipe_buf->rdlock);
 
-	return 0;
+	/* wake some writers */
+	if (read_bytes) {
+		pipe_file_wake_writers(pipe_file);
+		pipe_file_wake_next_reader(pipe_file);
+	}
+
+	return error;
 }
 
 static int pipe_close(struct vnode *vnode,
@@ -433,8 +775,20 @@ static int pipe_close(struct vnode *vnode,
 	if (vfscore_file->f_flags & UK_FWRITE)
 		pipe_file->w_refcount--;
 
-	if (!pipe_file->r_refcount && !pipe_file->w_refcount)
+	if (!pipe_file->r_refcount && !pipe_file->w_refcount) {
 		pipe_file_free(pipe_file);
+		return 0;
+	}
+
+	/* Wake up the other end so that it sees end of file or EPIPE */
+	if (!pipe_file->w_refcount) {
+		uk_waitq_wake_up(&pipe_file->buf->rdwq);
+		pipe_file_event(pipe_file, EPOLLHUP);
+	}
+	if (!pipe_file->r_refcount) {
+		uk_waitq_wake_up(&pipe_file->buf->wrwq);
+		pipe_file_event(pipe_file, EPOLLERR);
+	}
 
 	return 0;
 }
@@ -456,9 +810,7 @@ static int pipe_ioctl(struct vnode *vnode,
 
 	switch (com) {
 	case FIONREAD:
-		uk_mutex_lock(&pipe_buf->rdlock);
 		*((int *) data) = pipe_buf_get_available(pipe_buf);
-		uk_mutex_unlock(&pipe_buf->rdlock);
 		return 0;
 	default:
 		return -EINVAL;
@@ -473,15 +825,19 @@ get_pipe_file_events(struct pipe_file *pipe_file)
 
 	UK_ASSERT(pipe_file);
 
-	uk_mutex_lock(&pipe_buf->rdlock);
 	if (pipe_buf_can_read(pipe_buf))
 		events |= EPOLLIN | EPOLLRDNORM;
-	uk_mutex_unlock(&pipe_buf->rdlock);
 
-	uk_mutex_lock(&pipe_buf->wrlock);
 	if (pipe_buf_can_write(pipe_buf))
 		events |= EPOLLOUT | EPOLLWRNORM;
-	uk_mutex_unlock(&pipe_buf->wrlock);
+
+	/* The polled end itself holds a reference, so these can only be
+	 * seen by the opposite end
+	 */
+	if (!pipe_file->w_refcount)
+		events |= EPOLLHUP;
+	if (!pipe_file->r_refcount)
+		events |= EPOLLERR;
 
 	return events;
 }
@@ -658,7 +1014,7 @@ UK_SYSCALL_R_DEFINE(int, pipe, int*, pipefd)
 	struct pipe_file *pipe_file;
 
 	/* Allocate pipe internal structure. */
-	pipe_file = pipe_file_alloc(PIPE_MAX_SIZE, 0);
+	pipe_file = pipe_file_alloc(PIPE_DEF_SIZE, 0);
 	if (!pipe_file) {
 		ret = -ENOMEM;
 		goto ERR_EXIT;
@@ -707,6 +1063,403 @@ UK_SYSCALL_R_DEFINE(int, pipe2, int*, pipefd, int, flags)
 	return 0;
 }
 
+/* Returns the pipe behind a file or NULL if the file is not a pipe */
+static struct pipe_file *pipe_file_get(struct vfscore_file *fp)
+{
+	struct vnode *vnode;
+
+	if (!fp->f_dentry)
+		return NULL;
+
+	vnode = fp->f_dentry->d_vnode;
+	if (vnode->v_op != &pipe_vnops)
+		return NULL;
+
+	return vnode->v_data;
+}
+
+int vfscore_pipe_get_size(struct vfscore_file *fp, int *size)
+{
+	struct pipe_file *pipe_file = pipe_file_get(fp);
+
+	if (!pipe_file)
+		return EBADF;
+
+	*size = pipe_buf_get_capacity(pipe_file->buf);
+	return 0;
+}
+
+int vfscore_pipe_set_size(struct vfscore_file *fp, int size, int *new_size)
+{
+	struct pipe_file *pipe_file = pipe_file_get(fp);
+	struct pipe_buf *pipe_buf;
+	unsigned long nr_slots;
+	int error;
+
+	if (!pipe_file)
+		return EBADF;
+	if (size < 0 || (unsigned long)size > PIPE_MAX_SIZE)
+		return (size < 0) ? EINVAL : EPERM;
+
+	nr_slots = pipe_size_to_slots(size);
+	pipe_buf = pipe_file->buf;
+
+	uk_mutex_lock(&pipe_buf->wrlock);
+	uk_mutex_lock(&pipe_buf->rdlock);
+	error = pipe_buf_resize(pipe_buf, nr_slots);
+	uk_mutex_unlock(&pipe_buf->rdlock);
+	uk_mutex_unlock(&pipe_buf->wrlock);
+	if (error)
+		return error;
+
+	/* A bigger pipe may have room for blocked writers now */
+	pipe_file_wake_writers(pipe_file);
+
+	*new_size = pipe_buf_get_capacity(pipe_buf);
+	return 0;
+}
+
+/*
+ * Moves data from one pipe to another. Complete pages are handed over to
+ * the output pipe as they are, everything else is copied.
+ */
+static ssize_t pipe_splice_pipe(struct pipe_file *in, struct pipe_file *out,
+				size_t len, bool nonblocking)
+{
+	struct pipe_buf *inbuf = in->buf;
+	struct pipe_buf *outbuf = out->buf;
+	struct pipe_page *pg;
+	unsigned long avail, off, end;
+	char *page;
+	ssize_t moved = 0;
+	long ret;
+	int complete;
+	int error;
+
+	if (in == out)
+		return -EINVAL;
+
+	uk_mutex_lock(&inbuf->rdlock);
+	error = pipe_file_wait_read(in, nonblocking);
+	if (error || !pipe_buf_can_read(inbuf))
+		goto out_rdunlock;
+
+	uk_mutex_lock(&outbuf->wrlock);
+	error = pipe_file_wait_write(out, nonblocking);
+	if (error)
+		goto out_wrunlock;
+
+	while ((size_t)moved < len) {
+		pg = pipe_buf_peek(inbuf, &complete);
+		if (!pg)
+			break;
+
+		avail = PIPE_LOAD(pg->len) - pg->off;
+		if (complete && avail <= len - moved &&
+		    pipe_buf_has_free_slot(outbuf)) {
+			/* Once taken, the slot belongs to the writer of the
+			 * input pipe, which may reuse it right away
+			 */
+			page = pg->data;
+			off = pg->off;
+			end = pg->len;
+			pipe_buf_take(inbuf, pg);
+			pipe_buf_push_page(outbuf, page, off, end, 0);
+			moved += avail;
+			continue;
+		}
+
+		ret = pipe_buf_write(outbuf, pg->data + pg->off,
+				     MIN(avail, len - moved));
+		if (ret <= 0) {
+			if (ret < 0 && !moved)
+				error = -ret;
+			break;
+		}
+		pipe_buf_consume(inbuf, pg, ret);
+		moved += ret;
+	}
+
+out_wrunlock:
+	uk_mutex_unlock(&outbuf->wrlock);
+out_rdunlock:
+	uk_mutex_unlock(&inbuf->rdlock);
+
+	if (moved) {
+		pipe_file_wake_readers(out);
+		pipe_file_wake_writers(in);
+		pipe_file_wake_next_reader(in);
+		pipe_file_wake_next_writer(out);
+		return moved;
+	}
+
+	return -error;
+}
+
+/*
+ * Reads from a file straight into the pages of a pipe. Only regular files
+ * are read repeatedly: other files might block on the second read.
+ */
+static ssize_t pipe_splice_from_file(struct vfscore_file *in, off_t *off,
+				     struct pipe_file *out, size_t len,
+				     bool nonblocking)
+{
+	struct pipe_buf *outbuf = out->buf;
+	struct pipe_page *pg = NULL;
+	struct iovec iov;
+	ssize_t moved = 0;
+	size_t count;
+	char *page;
+	int error;
+
+	uk_mutex_lock(&outbuf->wrlock);
+	error = pipe_file_wait_write(out, nonblocking);
+	if (error)
+		goto out;
+
+	while ((size_t)moved < len) {
+		if (outbuf->tail_room) {
+			pg = PIPE_BUF_SLOT(outbuf, outbuf->prod - 1);
+			page = NULL;
+			iov.iov_base = pg->data + pg->len;
+			iov.iov_len = outbuf->tail_room;
+		} else if (pipe_buf_has_free_slot(outbuf)) {
+			page = pipe_buf_get_page(outbuf);
+			if (unlikely(!page)) {
+				error = ENOMEM;
+				break;
+			}
+			iov.iov_base = page;
+			iov.iov_len = PIPE_PAGE_SIZE;
+		} else {
+			break;
+		}
+		iov.iov_len = MIN(iov.iov_len, len - moved);
+
+		error = sys_read(in, &iov, 1, off ? *off : -1, &count);
+		if (error || !count) {
+			if (page)
+				pipe_page_free(page);
+			break;
+		}
+
+		if (page) {
+			pipe_buf_push_page(outbuf, page, 0, count, 1);
+		} else {
+			PIPE_STORE(pg->len, pg->len + count);
+			PIPE_STORE(outbuf->bytes_in, outbuf->bytes_in + count);
+			UK_WRITE_ONCE(outbuf->tail_room,
+				      outbuf->tail_room - count);
+		}
+
+		moved += count;
+		if (off)
+			*off += count;
+
+		if (count < iov.iov_len ||
+		    in->f_dentry->d_vnode->v_type != VREG)
+			break;
+	}
+
+out:
+	uk_mutex_unlock(&outbuf->wrlock);
+
+	if (moved) {
+		pipe_file_wake_readers(out);
+		pipe_file_wake_next_writer(out);
+		return moved;
+	}
+
+	return -error;
+}
+
+/* Writes to a file straight from the pages of a pipe */
+static ssize_t pipe_splice_to_file(struct pipe_file *in,
+				   struct vfscore_file *out, off_t *off,
+				   size_t len, bool nonblocking)
+{
+	struct pipe_buf *inbuf = in->buf;
+	struct pipe_page *pg;
+	struct iovec iov;
+	ssize_t moved = 0;
+	size_t count;
+	int complete;
+	int error;
+
+	uk_mutex_lock(&inbuf->rdlock);
+	error = pipe_file_wait_read(in, nonblocking);
+	if (error)
+		goto out;
+
+	while ((size_t)moved < len) {
+		pg = pipe_buf_peek(inbuf, &complete);
+		if (!pg)
+			break;
+
+		iov.iov_base = pg->data + pg->off;
+		iov.iov_len = MIN(PIPE_LOAD(pg->len) - pg->off, len - moved);
+
+		error = sys_write(out, &iov, 1, off ? *off : -1, &count);
+		if (error || !count)
+			break;
+
+		pipe_buf_consume(inbuf, pg, count);
+		moved += count;
+		if (off)
+			*off += count;
+
+		if (count < iov.iov_len)
+			break;
+	}
+
+out:
+	uk_mutex_unlock(&inbuf->rdlock);
+
+	if (moved) {
+		pipe_file_wake_writers(in);
+		pipe_file_wake_next_reader(in);
+		return moved;
+	}
+
+	return -error;
+}
+
+UK_SYSCALL_R_DEFINE(ssize_t, splice, int, fd_in, off_t *, off_in,
+		    int, fd_out, off_t *, off_out, size_t, len,
+		    unsigned int, flags)
+{
+	struct vfscore_file *in, *out;
+	struct pipe_file *pipe_in, *pipe_out;
+	bool nonblocking = (flags & SPLICE_F_NONBLOCK);
+	off_t off;
+	ssize_t ret;
+	int error;
+
+	error = fget(fd_in, &in);
+	if (error)
+		return -error;
+
+	error = fget(fd_out, &out);
+	if (error) {
+		ret = -error;
+		goto out_in;
+	}
+
+	if (!(in->f_flags & UK_FREAD) || !(out->f_flags & UK_FWRITE)) {
+		ret = -EBADF;
+		goto out_out;
+	}
+
+	pipe_in = pipe_file_get(in);
+	pipe_out = pipe_file_get(out);
+	if ((pipe_in && off_in) || (pipe_out && off_out)) {
+		ret = -ESPIPE;
+		goto out_out;
+	}
+
+	if (!len) {
+		ret = 0;
+		goto out_out;
+	}
+
+	if (pipe_in && pipe_out) {
+		nonblocking |= (in->f_flags & O_NONBLOCK) ||
+			       (out->f_flags & O_NONBLOCK);
+		ret = pipe_splice_pipe(pipe_in, pipe_out, len, nonblocking);
+	} else if (pipe_out) {
+		if (off_in && *off_in < 0) {
+			ret = -EINVAL;
+			goto out_out;
+		}
+		off = off_in ? *off_in : 0;
+		nonblocking |= (out->f_flags & O_NONBLOCK);
+		ret = pipe_splice_from_file(in, off_in ? &off : NULL,
+					    pipe_out, len, nonblocking);
+		if (off_in)
+			*off_in = off;
+	} else if (pipe_in) {
+		if (off_out && *off_out < 0) {
+			ret = -EINVAL;
+			goto out_out;
+		}
+		off = off_out ? *off_out : 0;
+		nonblocking |= (in->f_flags & O_NONBLOCK);
+		ret = pipe_splice_to_file(pipe_in, out, off_out ? &off : NULL,
+					  len, nonblocking);
+		if (off_out)
+			*off_out = off;
+	} else {
+		ret = -EINVAL;
+	}
+
+out_out:
+	fdrop(out);
+out_in:
+	fdrop(in);
+	return ret;
+}
+
+/*
+ * NOTE: Pages of the caller are not mapped into the pipe; the data is
+ * copied. Without page pinning, a gifted page could still be changed by
+ * the caller while it is queued in the pipe.
+ */
+UK_SYSCALL_R_DEFINE(ssize_t, vmsplice, int, fd, const struct iovec *, iov,
+		    size_t, nr_segs, unsigned int, flags)
+{
+	struct vfscore_file *fp;
+	struct vnode *vnode;
+	struct uio uio;
+	ssize_t total = 0;
+	int ioflag = 0;
+	size_t i;
+	int error;
+
+	if (nr_segs > UIO_MAXIOV)
+		return -EINVAL;
+
+	for (i = 0; i < nr_segs; i++) {
+		if (iov[i].iov_len > (size_t)(SSIZE_MAX - total))
+			return -EINVAL;
+		total += iov[i].iov_len;
+	}
+	uio.uio_resid = total;
+
+	error = fget(fd, &fp);
+	if (error)
+		return -error;
+
+	if (!pipe_file_get(fp)) {
+		error = EBADF;
+		goto out;
+	}
+
+	if (!total)
+		goto out;
+
+	vnode = fp->f_dentry->d_vnode;
+	uio.uio_iov = (struct iovec *)iov;
+	uio.uio_iovcnt = nr_segs;
+	uio.uio_offset = 0;
+
+	if ((flags & SPLICE_F_NONBLOCK) || (fp->f_flags & O_NONBLOCK))
+		ioflag |= IO_NDELAY;
+
+	if (fp->f_flags & UK_FWRITE) {
+		uio.uio_rw = UIO_WRITE;
+		error = pipe_write(vnode, &uio, ioflag);
+	} else {
+		uio.uio_rw = UIO_READ;
+		error = pipe_read(vnode, fp, &uio, ioflag);
+	}
+
+out:
+	fdrop(fp);
+	if (error)
+		return -error;
+	return total - uio.uio_resid;
+}
+
 /* TODO maybe find a better place for this when it will be implemented */
 int mkfifo(const char *path __unused, mode_t mode __unused)
 {
@@ -45,20 +45,31 @@
 static int do_ppoll(struct pollfd *fds, nfds_t nfds, const __nsec *timeout,
 		    const sigset_t *sigmask, size_t sigsetsize __unused)
 {
+	struct eventpoll_fd efds_stack[EVENTPOLL_STACK_FDS];
+	struct epoll_event events_stack[EVENTPOLL_STACK_FDS];
+	struct eventpoll_fd *efds = efds_stack;
+	struct epoll_event *events = events_stack;
 	struct epoll_event e;
-	struct epoll_event *events = NULL;
 	struct eventpoll ep;
-	struct eventpoll_fd *efd;
 	struct vfscore_file *fp;
-	int ret, i, fd, num_fds = (int)nfds;
+	unsigned int revents;
+	int ret, i, n, fd, num_fds = (int)nfds;
 
 	if (nfds > INT_MAX)
 		return -EINVAL;
 
-	eventpoll_init(&ep, uk_alloc_get_default());
+	/* TODO: Implement atomic masking of signals */
+	if (sigmask)
+		uk_pr_warn_once("%s: signal masking not implemented.",
+				__func__);
 
-	/* Register fds in eventpoll */
+	/* Fast path: Poll the current state of all fds without registering
+	 * with the drivers. We only have to set up an eventpoll if nothing
+	 * is ready and we have to sleep.
+	 */
+	ret = 0;
 	for (i = 0; i < num_fds; i++) {
+		fds[i].revents = 0;
 		fd = fds[i].fd;
 
 		/* A negative fd means we should ignore it */
@@ -66,15 +77,46 @@ static int do_ppoll(struct pollfd *fds, nfds_t nfds, const __nsec *timeout,
 			continue;
 
 		fp = vfscore_get_file(fd);
-		if (!fp) {
-			ret = -EBADF;
-			goto EXIT;
+		if (!fp)
+			return -EBADF;
+
+		revents = eventpoll_poll_file(fp, (unsigned int)fds[i].events);
+		vfscore_put_file(fp);
+
+		if (revents) {
+			fds[i].revents = (short)revents;
+			ret++;
 		}
+	}
+
+	if (ret > 0 || (timeout && *timeout == 0))
+		return ret;
+
+	/* Slow path: Set up a temporary eventpoll. The fds and events are
+	 * taken from the stack for small sets and otherwise from a single
+	 * allocation. The eventpoll thus must not free them.
+	 */
+	if (num_fds > EVENTPOLL_STACK_FDS) {
+		efds = uk_malloc(uk_alloc_get_default(),
+				 num_fds * (sizeof(*efds) + sizeof(*events)));
+		if (!efds)
+			return -ENOMEM;
+
+		events = (struct epoll_event *)&efds[num_fds];
+	}
+
+	eventpoll_init(&ep, NULL);
+
+	/* Register fds in eventpoll */
+	for (i = 0, n = 0; i < num_fds; i++) {
+		fd = fds[i].fd;
 
-		efd = uk_malloc(uk_alloc_get_default(), sizeof(*efd));
-		if (!efd) {
-			vfscore_put_file(fp);
-			ret = -ENOMEM;
+		if (fd < 0)
+			continue;
+
+		fp = vfscore_get_file(fd);
+		if (!fp) {
+			ret = -EBADF;
 			goto EXIT;
 		}
 
@@ -84,57 +126,39 @@ static int do_ppoll(struct pollfd *fds, nfds_t nfds, const __nsec *timeout,
 		 */
 		e.data.ptr = &fds[i].revents;
 		e.events = fds[i].events;
-		eventpoll_fd_init(efd, fp, fd, &e);
-		eventpoll_add_unsafe(&ep, efd);
+		eventpoll_fd_init(&efds[n], fp, fd, &e);
+		eventpoll_add_unsafe(&ep, &efds[n]);
 
 		/* We must add the fd to triggered list so it is
 		 * checked in eventpoll_wait(). This is ok because the
 		 * method will ignore the fd if it has no events
-		 * pending.
+		 * pending. The first poll also registers the eventpoll with
+		 * the driver.
 		 */
-		uk_list_add_tail(&efd->tr_link, &ep.tr_list);
+		uk_list_add_tail(&efds[n].tr_link, &ep.tr_list);
 
 		vfscore_put_file(fp);
+		n++;
 	}
 
-	/* We may call poll with no fds to just do a precise wait */
-	if (num_fds > 0) {
-		events = uk_calloc(uk_alloc_get_default(), num_fds,
-				   sizeof(struct epoll_event));
-		if (!events) {
-			ret = -ENOMEM;
-			goto EXIT;
-		}
-	}
-
-	/* TODO: Implement atomic masking of signals */
-	if (sigmask)
-		uk_pr_warn_once("%s: signal masking not implemented.",
-				__func__);
-
-	ret = eventpoll_wait(&ep, events, num_fds, timeout);
+	ret = eventpoll_wait(&ep, events, n, timeout);
 	if (ret < 0)
-		goto ERR_FREE_EVENTS;
-
-	for (i = 0; i < num_fds; i++) {
-		fds[i].revents = 0;
-	}
+		goto EXIT;
 
-	UK_ASSERT(ret <= num_fds);
+	UK_ASSERT(ret <= n);
 
 	for (i = 0; i < ret; i++) {
 		UK_ASSERT(events[i].events);
 		UK_ASSERT(events[i].data.ptr);
 
 		/* We have a pointer to revents of the corresponding pollfd */
-		*((int*)events[i].data.ptr) = events[i].events;
+		*((short *)events[i].data.ptr) = (short)events[i].events;
 	}
 
-ERR_FREE_EVENTS:
-	if (events)
-		uk_free(uk_alloc_get_default(), events);
 EXIT:
 	eventpoll_fini(&ep);
+	if (efds != efds_stack)
+		uk_free(uk_alloc_get_default(), efds);
 	return ret;
 }
 
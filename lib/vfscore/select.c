@@ -49,127 +49,199 @@
 #define POLLOUT_SET (EPOLLWRNORM | EPOLLWRBAND | EPOLLOUT | EPOLLERR)
 #define POLLEX_SET (EPOLLPRI)
 
+static unsigned int select_events(int fd, const fd_set *readfds,
+				  const fd_set *writefds,
+				  const fd_set *exceptfds)
+{
+	unsigned int events = 0;
+
+	if (readfds && FD_ISSET(fd, readfds))
+		events |= POLLIN_SET;
+
+	if (writefds && FD_ISSET(fd, writefds))
+		events |= POLLOUT_SET;
+
+	if (exceptfds && FD_ISSET(fd, exceptfds))
+		events |= POLLEX_SET;
+
+	return events;
+}
+
+/* Reports the events in the result sets; returns the number of set bits */
+static int select_report(int fd, unsigned int revents, fd_set *readfds,
+			 fd_set *writefds, fd_set *exceptfds)
+{
+	int ret = 0;
+
+	if (readfds && (revents & POLLIN_SET)) {
+		FD_SET(fd, readfds);
+		ret++;
+	}
+	if (writefds && (revents & POLLOUT_SET)) {
+		FD_SET(fd, writefds);
+		ret++;
+	}
+	if (exceptfds && (revents & POLLEX_SET)) {
+		FD_SET(fd, exceptfds);
+		ret++;
+	}
+
+	return ret;
+}
+
 static int do_pselect(int nfds, fd_set *readfds, fd_set *writefds,
 		      fd_set *exceptfds, const __nsec *timeout,
 		      const sigset_t *sigmask, size_t sigsetsize __unused)
 {
+	struct eventpoll_fd efds_stack[EVENTPOLL_STACK_FDS];
+	struct epoll_event events_stack[EVENTPOLL_STACK_FDS];
+	struct eventpoll_fd *efds = efds_stack;
+	struct epoll_event *events = events_stack;
 	struct epoll_event e = {0};
-	struct epoll_event *events = NULL;
+	fd_set rfds, wfds, xfds, rres, wres, xres;
+	fd_set *rin = NULL, *win = NULL, *xin = NULL;
+	fd_set *rout = NULL, *wout = NULL, *xout = NULL;
 	struct eventpoll ep;
-	struct eventpoll_fd *efd;
 	struct vfscore_file *fp;
+	unsigned int revents;
 	int num_fds = 0;
-	int ret, i;
+	int ret, i, n;
 
 	if (nfds < 0)
 		return -EINVAL;
 
-	eventpoll_init(&ep, uk_alloc_get_default());
+	/* Our fd table does not go beyond FD_SETSIZE */
+	if (nfds > FD_SETSIZE)
+		nfds = FD_SETSIZE;
 
-	/* Register fds in eventpoll */
+	/* TODO: Implement atomic masking of signals */
+	if (sigmask)
+		uk_pr_warn_once("%s: signal masking not implemented.",
+				__func__);
+
+	/* The sets are overwritten with the result, but only on success.
+	 * Collect the result separately until then and keep the requested
+	 * events in case we have to wait.
+	 */
+	if (readfds) {
+		rfds = *readfds;
+		rin = &rfds;
+		FD_ZERO(&rres);
+		rout = &rres;
+	}
+	if (writefds) {
+		wfds = *writefds;
+		win = &wfds;
+		FD_ZERO(&wres);
+		wout = &wres;
+	}
+	if (exceptfds) {
+		xfds = *exceptfds;
+		xin = &xfds;
+		FD_ZERO(&xres);
+		xout = &xres;
+	}
+
+	/* Fast path: Poll the current state of all fds without registering
+	 * with the drivers. We only have to set up an eventpoll if nothing
+	 * is ready and we have to sleep.
+	 */
+	ret = 0;
 	for (i = 0; i < nfds; i++) {
-		if (readfds && FD_ISSET(i, readfds))
-			e.events |= POLLIN_SET;
-
-		if (writefds && FD_ISSET(i, writefds))
-			e.events |= POLLOUT_SET;
-
-		if (exceptfds && FD_ISSET(i, exceptfds))
-			e.events |= POLLEX_SET;
-
-		if (e.events) {
-			fp = vfscore_get_file(i);
-			if (!fp) {
-				ret = -EBADF;
-				goto EXIT;
-			}
-
-			efd = uk_malloc(uk_alloc_get_default(), sizeof(*efd));
-			if (!efd) {
-				vfscore_put_file(fp);
-				ret = -ENOMEM;
-				goto EXIT;
-			}
-
-			/* We can use the unsafe method of adding the fd to the
-			 * eventpoll because we know that nobody except us
-			 * may access the eventpoll.
-			 */
-			e.data.fd = i;
-			eventpoll_fd_init(efd, fp, i, &e);
-			eventpoll_add_unsafe(&ep, efd);
-
-			/* We must add the fd to triggered list so it is
-			 * checked in eventpoll_wait(). This is ok because the
-			 * method will ignore the fd if it has no events
-			 * pending.
-			 */
-			uk_list_add_tail(&efd->tr_link, &ep.tr_list);
-
-			vfscore_put_file(fp);
-
-			num_fds++;
-			e.events = 0;
-		}
+		e.events = select_events(i, rin, win, xin);
+		if (!e.events)
+			continue;
+
+		fp = vfscore_get_file(i);
+		if (!fp)
+			return -EBADF;
+
+		revents = eventpoll_poll_file(fp, e.events);
+		vfscore_put_file(fp);
+
+		ret += select_report(i, revents, rout, wout, xout);
+		num_fds++;
 	}
 
-	/* We may call select with no fds to just do a precise wait */
-	if (num_fds > 0) {
-		events = uk_calloc(uk_alloc_get_default(), num_fds,
-				   sizeof(struct epoll_event));
-		if (!events) {
-			ret = -ENOMEM;
-			goto EXIT;
-		}
+	if (ret > 0 || (timeout && *timeout == 0))
+		goto OUT;
+
+	/* Slow path: Set up a temporary eventpoll. The fds and events are
+	 * taken from the stack for small sets and otherwise from a single
+	 * allocation. The eventpoll thus must not free them.
+	 */
+	if (num_fds > EVENTPOLL_STACK_FDS) {
+		efds = uk_malloc(uk_alloc_get_default(),
+				 num_fds * (sizeof(*efds) + sizeof(*events)));
+		if (!efds)
+			return -ENOMEM;
+
+		events = (struct epoll_event *)&efds[num_fds];
 	}
 
-	/* TODO: Implement atomic masking of signals */
-	if (sigmask)
-		uk_pr_warn_once("%s: signal masking not implemented.",
-				__func__);
+	eventpoll_init(&ep, NULL);
 
-	ret = eventpoll_wait(&ep, events, num_fds, timeout);
-	if (ret < 0)
-		goto ERR_FREE_EVENTS;
+	/* Register fds in eventpoll */
+	for (i = 0, n = 0; i < nfds && n < num_fds; i++) {
+		e.events = select_events(i, rin, win, xin);
+		if (!e.events)
+			continue;
+
+		fp = vfscore_get_file(i);
+		if (!fp) {
+			ret = -EBADF;
+			goto EXIT;
+		}
 
-	if (readfds)
-		FD_ZERO(readfds);
-	if (writefds)
-		FD_ZERO(writefds);
-	if (exceptfds)
-		FD_ZERO(exceptfds);
+		/* We can use the unsafe method of adding the fd to the
+		 * eventpoll because we know that nobody except us
+		 * may access the eventpoll.
+		 */
+		e.data.fd = i;
+		eventpoll_fd_init(&efds[n], fp, i, &e);
+		eventpoll_add_unsafe(&ep, &efds[n]);
+
+		/* We must add the fd to triggered list so it is
+		 * checked in eventpoll_wait(). This is ok because the
+		 * method will ignore the fd if it has no events
+		 * pending. The first poll also registers the eventpoll with
+		 * the driver.
+		 */
+		uk_list_add_tail(&efds[n].tr_link, &ep.tr_list);
+
+		vfscore_put_file(fp);
+		n++;
+	}
 
-	/* Timeout */
-	if (ret == 0)
-		goto ERR_FREE_EVENTS;
+	ret = eventpoll_wait(&ep, events, n, timeout);
+	if (ret <= 0)
+		goto EXIT;
 
-	UK_ASSERT(ret <= num_fds);
-	num_fds = ret;
+	UK_ASSERT(ret <= n);
+	n = ret;
 
 	ret = 0;
-	for (i = 0; i < num_fds; i++) {
+	for (i = 0; i < n; i++) {
 		UK_ASSERT(events[i].events);
 		UK_ASSERT(events[i].data.fd < nfds);
 
-		if (readfds && (events[i].events & POLLIN_SET)) {
-			FD_SET(events[i].data.fd, readfds);
-			ret++;
-		}
-		if (writefds && (events[i].events & POLLOUT_SET)) {
-			FD_SET(events[i].data.fd, writefds);
-			ret++;
-		}
-		if (exceptfds && (events[i].events & POLLEX_SET)) {
-			FD_SET(events[i].data.fd, exceptfds);
-			ret++;
-		}
+		ret += select_report(events[i].data.fd, events[i].events,
+				     rout, wout, xout);
 	}
 
-ERR_FREE_EVENTS:
-	if (events)
-		uk_free(uk_alloc_get_default(), events);
 EXIT:
 	eventpoll_fini(&ep);
+	if (efds != efds_stack)
+		uk_free(uk_alloc_get_default(), efds);
+	if (ret < 0)
+		return ret;
+OUT:
+	if (readfds)
+		*readfds = rres;
+	if (writefds)
+		*writefds = wres;
+	if (exceptfds)
+		*exceptfds = xres;
 	return ret;
 }
 
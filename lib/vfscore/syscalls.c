@@ -132,6 +132,8 @@ sys_open(char *path, int flags, mode_t mode, struct vfscore_file **fpp)
 			mode &= ~S_IFMT;
 			mode |= S_IFREG;
 			error = VOP_CREATE(ddp->d_vnode, filename, mode);
+			if (!error)
+				dentry_neg_remove(ddp, filename);
 			vn_unlock(ddp->d_vnode);
 			drele(ddp);
 
@@ -581,6 +583,8 @@ sys_mkdir(char *path, mode_t mode)
 	mode |= S_IFDIR;
 
 	error = VOP_MKDIR(ddp->d_vnode, name, mode);
+	if (!error)
+		dentry_neg_remove(ddp, name);
  out:
 	vn_unlock(ddp->d_vnode);
 	drele(ddp);
@@ -620,6 +624,8 @@ sys_rmdir(char *path)
 
 	vn_lock(ddp->d_vnode);
 	error = VOP_RMDIR(ddp->d_vnode, vp, name);
+	if (!error)
+		dentry_neg_purge(dp->d_mount, dp->d_path);
 	vn_unlock(ddp->d_vnode);
 
 	vn_unlock(vp);
@@ -670,6 +676,8 @@ sys_mknod(char *path, mode_t mode)
 		error = VOP_MKDIR(ddp->d_vnode, name, mode);
 	else
 		error = VOP_CREATE(ddp->d_vnode, name, mode);
+	if (!error)
+		dentry_neg_remove(ddp, name);
  out:
 	vn_unlock(ddp->d_vnode);
 	drele(ddp);
@@ -839,6 +847,13 @@ sys_rename(char *src, char *dest)
 	if (error)
 		goto err3;
 
+	/* Negative entries below the source or a replaced target are stale */
+	dentry_neg_purge(dp1->d_mount, dp1->d_path);
+	if (dp2)
+		dentry_neg_purge(dp2->d_mount, dp2->d_path);
+	else
+		dentry_neg_remove(ddp2, dname);
+
 	error = dentry_move(dp1, ddp2, dname);
 
 	if (dp2)
@@ -913,6 +928,8 @@ sys_symlink(const char *oldpath, const char *newpath)
 		goto out;
 	}
 	error = VOP_SYMLINK(newdirdp->d_vnode, name, op);
+	if (!error)
+		dentry_neg_remove(newdirdp, name);
 
 out:
 	if (newdirdp != NULL) {
@@ -975,6 +992,8 @@ sys_link(char *oldpath, char *newpath)
 	}
 
 	error = VOP_LINK(newdirdp->d_vnode, vp, name);
+	if (!error)
+		dentry_neg_remove(newdirdp, name);
  out1:
 	vn_unlock(newdirdp->d_vnode);
 	drele(newdirdp);
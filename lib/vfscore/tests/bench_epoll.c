@@ -0,0 +1,198 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/test.h>
+
+/*
+ * A c10k-style event loop, scaled down to the size of the file descriptor
+ * table: one epoll set watches many pipes of which only a few are active at
+ * a time. Per-operation costs must not grow with the size of the set.
+ */
+#define BENCH_CONNS_MAX		480	/* two fds per pipe */
+#define BENCH_ACTIVE		4	/* pipes made readable per round */
+#define BENCH_ROUNDS		20000
+#define BENCH_CTL_ROUNDS	20
+
+struct bench_conns {
+	int epfd;
+	unsigned int n;
+	int fds[BENCH_CONNS_MAX][2];
+};
+
+static struct bench_conns conns;
+
+static unsigned long bench_rand(unsigned long *seed)
+{
+	*seed = *seed * 6364136223846793005UL + 1442695040888963407UL;
+	return *seed >> 33;
+}
+
+static void bench_conns_close(struct bench_conns *c)
+{
+	unsigned int i;
+
+	for (i = 0; i < c->n; i++) {
+		close(c->fds[i][0]);
+		close(c->fds[i][1]);
+	}
+	if (c->epfd >= 0)
+		close(c->epfd);
+	c->n = 0;
+	c->epfd = -1;
+}
+
+static int bench_conns_open(struct bench_conns *c, unsigned int n)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+
+	c->n = 0;
+	c->epfd = epoll_create1(0);
+	if (c->epfd < 0)
+		return -errno;
+
+	for (c->n = 0; c->n < n; c->n++) {
+		if (pipe(c->fds[c->n]))
+			goto err;
+		ev.data.u32 = c->n;
+		if (epoll_ctl(c->epfd, EPOLL_CTL_ADD, c->fds[c->n][0], &ev)) {
+			c->n++;
+			goto err;
+		}
+	}
+	return 0;
+
+err:
+	bench_conns_close(c);
+	return -errno;
+}
+
+/*
+ * Re-registers all fds with MOD, DEL and ADD. Returns the time per
+ * operation in nanoseconds.
+ */
+static unsigned long bench_ctl_run(struct bench_conns *c)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	__nsec start, elapsed;
+	unsigned int r, i;
+	int rc = 0;
+
+	start = ukplat_monotonic_clock();
+	for (r = 0; r < BENCH_CTL_ROUNDS; r++) {
+		for (i = 0; i < c->n; i++) {
+			ev.data.u32 = i;
+			rc |= epoll_ctl(c->epfd, EPOLL_CTL_MOD,
+					c->fds[i][0], &ev);
+			rc |= epoll_ctl(c->epfd, EPOLL_CTL_DEL,
+					c->fds[i][0], NULL);
+			rc |= epoll_ctl(c->epfd, EPOLL_CTL_ADD,
+					c->fds[i][0], &ev);
+		}
+	}
+	elapsed = ukplat_monotonic_clock() - start;
+
+	if (rc)
+		return 0;
+	return (unsigned long) (elapsed / (3UL * BENCH_CTL_ROUNDS * c->n));
+}
+
+/*
+ * Makes a few random pipes readable, waits for them and drains them.
+ * Returns the time per round in nanoseconds.
+ */
+static unsigned long bench_wait_run(struct bench_conns *c)
+{
+	struct epoll_event out[BENCH_ACTIVE];
+	unsigned long seed = 1, events = 0;
+	unsigned int r, i, drained;
+	__nsec start, elapsed;
+	char buf[BENCH_ACTIVE];
+	ssize_t ret;
+	int n;
+
+	start = ukplat_monotonic_clock();
+	for (r = 0; r < BENCH_ROUNDS; r++) {
+		for (i = 0; i < BENCH_ACTIVE; i++) {
+			ret = write(c->fds[bench_rand(&seed) % c->n][1], "x", 1);
+			if (ret != 1)
+				return 0;
+		}
+
+		/* The same pipe may have been picked more than once */
+		for (drained = 0; drained < BENCH_ACTIVE; ) {
+			n = epoll_wait(c->epfd, out, ARRAY_SIZE(out), 0);
+			if (n <= 0)
+				return 0;
+			for (i = 0; i < (unsigned int) n; i++) {
+				ret = read(c->fds[out[i].data.u32][0], buf,
+					   sizeof(buf));
+				if (ret <= 0)
+					return 0;
+				drained += ret;
+			}
+			events += n;
+		}
+	}
+	elapsed = ukplat_monotonic_clock() - start;
+
+	if (!events)
+		return 0;
+	return (unsigned long) (elapsed / BENCH_ROUNDS);
+}
+
+UK_TESTCASE(vfscore_epoll_benchsuite, vfscore_bench_epoll)
+{
+	static const unsigned int sizes[] = { 16, 128, BENCH_CONNS_MAX };
+	unsigned long ctl_ns, wait_ns;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		UK_TEST_EXPECT_ZERO(bench_conns_open(&conns, sizes[i]));
+		if (!conns.n)
+			return;
+
+		ctl_ns = bench_ctl_run(&conns);
+		UK_TEST_EXPECT_NOT_ZERO(ctl_ns);
+		wait_ns = bench_wait_run(&conns);
+		UK_TEST_EXPECT_NOT_ZERO(wait_ns);
+
+		uk_test_printf("epoll, %u pipes: %lu ns/epoll_ctl, "
+			       "%lu ns/round with %u active pipes\n",
+			       conns.n, ctl_ns, wait_ns, BENCH_ACTIVE);
+		bench_conns_close(&conns);
+	}
+}
+
+uk_testsuite_register(vfscore_epoll_benchsuite, NULL);
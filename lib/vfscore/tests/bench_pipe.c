@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <uk/arch/atomic.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+
+#define PIPE_BENCH_BYTES	(16UL << 20)
+#define PIPE_BENCH_MAXCHUNK	(64UL << 10)
+
+static char pipe_wbuf[PIPE_BENCH_MAXCHUNK];
+static char pipe_rbuf[PIPE_BENCH_MAXCHUNK];
+
+struct pipe_bench {
+	int fd;
+	unsigned long chunk;
+	int done;
+};
+
+static __noreturn void pipe_bench_writer(void *arg)
+{
+	struct pipe_bench *b = (struct pipe_bench *) arg;
+	unsigned long written = 0;
+	ssize_t ret;
+
+	while (written < PIPE_BENCH_BYTES) {
+		ret = write(b->fd, pipe_wbuf, b->chunk);
+		if (ret <= 0)
+			break;
+		written += ret;
+	}
+
+	UK_WRITE_ONCE(b->done, 1);
+	uk_sched_thread_exit();
+}
+
+/* Streams data through a pipe, returns the throughput in KiB/s */
+static unsigned long pipe_bench_run(unsigned long chunk)
+{
+	struct pipe_bench b = { .chunk = chunk };
+	struct uk_thread *t;
+	unsigned long total = 0;
+	__nsec start, elapsed;
+	ssize_t ret;
+	int fds[2];
+
+	if (pipe(fds))
+		return 0;
+	b.fd = fds[1];
+
+	start = ukplat_monotonic_clock();
+	t = uk_sched_thread_create(uk_sched_current(), pipe_bench_writer, &b,
+				   "bench-pipe-writer");
+	if (!t)
+		goto out;
+
+	while (total < PIPE_BENCH_BYTES) {
+		ret = read(fds[0], pipe_rbuf, chunk);
+		if (ret <= 0)
+			break;
+		total += ret;
+	}
+	elapsed = ukplat_monotonic_clock() - start;
+
+	while (!UK_READ_ONCE(b.done))
+		uk_sched_yield();
+
+out:
+	close(fds[0]);
+	close(fds[1]);
+	if (total != PIPE_BENCH_BYTES || !elapsed)
+		return 0;
+	return (unsigned long)((total >> 10) * 1000000000ULL / elapsed);
+}
+
+UK_TESTCASE(vfscore_pipe_benchsuite, vfscore_bench_pipe)
+{
+	static const unsigned long chunks[] = { 4UL << 10, 64UL << 10 };
+	unsigned long kibps;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(chunks); i++) {
+		kibps = pipe_bench_run(chunks[i]);
+		UK_TEST_EXPECT_SNUM_GT(kibps, 0);
+
+		uk_test_printf("pipe: %lu KiB chunks: %lu MiB/s\n",
+			       chunks[i] >> 10, kibps >> 10);
+	}
+}
+
+uk_testsuite_register(vfscore_pipe_benchsuite, NULL);
@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/syscall.h>
+#include <uk/test.h>
+#include <vfscore/dentry.h>
+#include <vfscore/mount.h>
+#include "../vfs.h"
+
+#define DTEST_DIR	"/dentry_test"
+#define DTEST_PATH(name) DTEST_DIR "/" name
+
+static struct mount *dtest_mp;
+
+#if CONFIG_LIBVFSCORE_DENTRY_STATS
+static struct dentry_stats dtest_last;
+
+static void dtest_stats_reset(void)
+{
+	dentry_stats_get(dtest_mp, &dtest_last);
+}
+
+/* Checks the counter changes since the last check or reset */
+#define DTEST_EXPECT_STATS(hits, neg_hits, misses)			\
+	do {								\
+		struct dentry_stats ds;					\
+									\
+		dentry_stats_get(dtest_mp, &ds);			\
+		UK_TEST_EXPECT_SNUM_EQ(ds.ds_hits - dtest_last.ds_hits,	\
+				       hits);				\
+		UK_TEST_EXPECT_SNUM_EQ(ds.ds_neg_hits			\
+				       - dtest_last.ds_neg_hits,	\
+				       neg_hits);			\
+		UK_TEST_EXPECT_SNUM_EQ(ds.ds_misses			\
+				       - dtest_last.ds_misses,		\
+				       misses);				\
+		dtest_last = ds;					\
+	} while (0)
+#else /* !CONFIG_LIBVFSCORE_DENTRY_STATS */
+static void dtest_stats_reset(void)
+{
+}
+
+#define DTEST_EXPECT_STATS(hits, neg_hits, misses) do { } while (0)
+#endif /* !CONFIG_LIBVFSCORE_DENTRY_STATS */
+
+/* Returns 1 if the file exists, 0 if it does not, or a negative errno */
+static int dtest_exists(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) == 0)
+		return 1;
+	return errno == ENOENT ? 0 : -errno;
+}
+
+static int dtest_creat(const char *path)
+{
+	int fd;
+
+	fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0)
+		return -1;
+	close(fd);
+	return 0;
+}
+
+/* Mounts a ramfs of its own, which keeps negative dentries */
+static int dtest_init(struct uk_testsuite *suite __unused)
+{
+	char *p;
+
+	/* Provide a root file system if there is none */
+	if (vfs_findroot("/", &dtest_mp, &p) &&
+	    mount("", "/", "ramfs", 0, NULL))
+		return -1;
+	if (mkdir(DTEST_DIR, 0755) && errno != EEXIST)
+		return -1;
+	if (mount("", DTEST_DIR, "ramfs", 0, NULL))
+		return -1;
+	if (vfs_findroot(DTEST_PATH(""), &dtest_mp, &p))
+		return -1;
+
+	UK_ASSERT(dtest_mp->m_dneg_timeout == DNEG_NOEXPIRE);
+	return 0;
+}
+
+UK_TESTCASE(vfscore_dentry_testsuite, vfscore_test_dentry_lookup)
+{
+	int fd;
+
+	dtest_stats_reset();
+
+	/* The first lookup of a missing file reaches the file system */
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("a")));
+	DTEST_EXPECT_STATS(0, 0, 1);
+
+	/* The second one is answered by the negative dentry */
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("a")));
+	DTEST_EXPECT_STATS(0, 1, 0);
+
+	/* A lookup of a file in use is answered by its dentry */
+	fd = open(DTEST_PATH("a"), O_CREAT | O_EXCL | O_RDWR, 0644);
+	UK_TEST_EXPECT_SNUM_GE(fd, 0);
+	dtest_stats_reset();
+	UK_TEST_EXPECT_SNUM_EQ(dtest_exists(DTEST_PATH("a")), 1);
+	DTEST_EXPECT_STATS(1, 0, 0);
+	close(fd);
+}
+
+UK_TESTCASE(vfscore_dentry_testsuite, vfscore_test_dentry_create)
+{
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("c")));
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("d")));
+
+	/* Creating a file or directory drops its negative dentry */
+	UK_TEST_EXPECT_ZERO(dtest_creat(DTEST_PATH("c")));
+	UK_TEST_EXPECT_ZERO(mkdir(DTEST_PATH("d"), 0755));
+	dtest_stats_reset();
+	UK_TEST_EXPECT_SNUM_EQ(dtest_exists(DTEST_PATH("c")), 1);
+	UK_TEST_EXPECT_SNUM_EQ(dtest_exists(DTEST_PATH("d")), 1);
+	DTEST_EXPECT_STATS(0, 0, 2);
+
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("d/x")));
+	UK_TEST_EXPECT_ZERO(dtest_creat(DTEST_PATH("d/x")));
+	UK_TEST_EXPECT_SNUM_EQ(dtest_exists(DTEST_PATH("d/x")), 1);
+}
+
+UK_TESTCASE(vfscore_dentry_testsuite, vfscore_test_dentry_rename)
+{
+	/* Renaming a file to a missing path drops its negative dentry */
+	UK_TEST_EXPECT_ZERO(dtest_creat(DTEST_PATH("r1")));
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("r2")));
+	UK_TEST_EXPECT_ZERO(uk_syscall_r_rename((long) DTEST_PATH("r1"),
+					       (long) DTEST_PATH("r2")));
+	UK_TEST_EXPECT_SNUM_EQ(dtest_exists(DTEST_PATH("r2")), 1);
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("r1")));
+
+	/*
+	 * Renaming a directory drops the negative dentries below it, which
+	 * would otherwise hide the files of a directory renamed to its name
+	 */
+	UK_TEST_EXPECT_ZERO(mkdir(DTEST_PATH("e"), 0755));
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("e/x")));
+	UK_TEST_EXPECT_ZERO(uk_syscall_r_rename((long) DTEST_PATH("e"),
+					       (long) DTEST_PATH("f")));
+	UK_TEST_EXPECT_ZERO(mkdir(DTEST_PATH("g"), 0755));
+	UK_TEST_EXPECT_ZERO(dtest_creat(DTEST_PATH("g/x")));
+	UK_TEST_EXPECT_ZERO(uk_syscall_r_rename((long) DTEST_PATH("g"),
+					       (long) DTEST_PATH("e")));
+	UK_TEST_EXPECT_SNUM_EQ(dtest_exists(DTEST_PATH("e/x")), 1);
+}
+
+#if CONFIG_LIBVFSCORE_DENTRY_STATS
+UK_TESTCASE(vfscore_dentry_testsuite, vfscore_test_dentry_timeout)
+{
+	__nsec until;
+
+	/* Negative dentries expire after the timeout of the mount */
+	dtest_mp->m_dneg_timeout = ukarch_time_msec_to_nsec(50);
+	dtest_stats_reset();
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("t1")));
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("t1")));
+	DTEST_EXPECT_STATS(0, 1, 1);
+	until = ukplat_monotonic_clock() + ukarch_time_msec_to_nsec(100);
+	while (ukplat_monotonic_clock() < until)
+		;
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("t1")));
+	DTEST_EXPECT_STATS(0, 0, 1);
+
+	/* Without a timeout, the mount does not keep negative dentries */
+	dtest_mp->m_dneg_timeout = DNEG_DISABLED;
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("t2")));
+	UK_TEST_EXPECT_ZERO(dtest_exists(DTEST_PATH("t2")));
+	DTEST_EXPECT_STATS(0, 0, 2);
+
+	dtest_mp->m_dneg_timeout = DNEG_NOEXPIRE;
+}
+#endif /* CONFIG_LIBVFSCORE_DENTRY_STATS */
+
+uk_testsuite_register(vfscore_dentry_testsuite, dtest_init);
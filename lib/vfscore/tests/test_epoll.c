@@ -0,0 +1,198 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <uk/essentials.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+
+#define EPOLL_WAITERS		2
+
+UK_TESTCASE(vfscore_epoll_testsuite, vfscore_test_epoll_oneshot)
+{
+	struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT };
+	struct epoll_event out[2];
+	int fds[2];
+	int epfd;
+
+	UK_TEST_EXPECT_ZERO(pipe(fds));
+	epfd = epoll_create1(0);
+	UK_TEST_EXPECT_SNUM_GE(epfd, 0);
+
+	ev.data.fd = fds[0];
+	UK_TEST_EXPECT_ZERO(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev));
+	UK_TEST_EXPECT_SNUM_EQ(write(fds[1], "x", 1), 1);
+
+	/* The event is reported once although the data is not consumed */
+	UK_TEST_EXPECT_SNUM_EQ(epoll_wait(epfd, out, ARRAY_SIZE(out), 0), 1);
+	UK_TEST_EXPECT_SNUM_EQ(out[0].data.fd, fds[0]);
+	UK_TEST_EXPECT_SNUM_EQ(epoll_wait(epfd, out, ARRAY_SIZE(out), 0), 0);
+
+	/* Further events do not re-arm the fd */
+	UK_TEST_EXPECT_SNUM_EQ(write(fds[1], "x", 1), 1);
+	UK_TEST_EXPECT_SNUM_EQ(epoll_wait(epfd, out, ARRAY_SIZE(out), 0), 0);
+
+	/* EPOLL_CTL_MOD does */
+	UK_TEST_EXPECT_ZERO(epoll_ctl(epfd, EPOLL_CTL_MOD, fds[0], &ev));
+	UK_TEST_EXPECT_SNUM_EQ(epoll_wait(epfd, out, ARRAY_SIZE(out), 0), 1);
+	UK_TEST_EXPECT_SNUM_EQ(epoll_wait(epfd, out, ARRAY_SIZE(out), 0), 0);
+
+	close(epfd);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+UK_TESTCASE(vfscore_epoll_testsuite, vfscore_test_epoll_exclusive_ctl)
+{
+	struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE };
+	int fds[2];
+	int epfd;
+
+	UK_TEST_EXPECT_ZERO(pipe(fds));
+	epfd = epoll_create1(0);
+	UK_TEST_EXPECT_SNUM_GE(epfd, 0);
+
+	/* EPOLLEXCLUSIVE does not combine with EPOLLONESHOT */
+	ev.events |= EPOLLONESHOT;
+	UK_TEST_EXPECT_SNUM_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EINVAL);
+
+	/* It can only be set when adding an fd */
+	ev.events = EPOLLIN;
+	UK_TEST_EXPECT_ZERO(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev));
+	ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+	UK_TEST_EXPECT_SNUM_EQ(epoll_ctl(epfd, EPOLL_CTL_MOD, fds[0], &ev), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EINVAL);
+
+	/* and an exclusive fd cannot be modified */
+	UK_TEST_EXPECT_ZERO(epoll_ctl(epfd, EPOLL_CTL_DEL, fds[0], NULL));
+	UK_TEST_EXPECT_ZERO(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev));
+	ev.events = EPOLLIN;
+	UK_TEST_EXPECT_SNUM_EQ(epoll_ctl(epfd, EPOLL_CTL_MOD, fds[0], &ev), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EINVAL);
+
+	close(epfd);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+struct epoll_waiter {
+	int epfd;
+	struct uk_thread *thread;
+	int rc;
+	int done;
+};
+
+static __noreturn void epoll_waiter_fn(void *arg)
+{
+	struct epoll_waiter *w = (struct epoll_waiter *) arg;
+	struct epoll_event ev;
+
+	w->rc = epoll_wait(w->epfd, &ev, 1, -1);
+	UK_WRITE_ONCE(w->done, 1);
+	uk_sched_thread_exit();
+}
+
+/* Lets woken waiters run and returns how many of them returned so far */
+static int epoll_waiters_done(struct epoll_waiter *w)
+{
+	int i, done = 0;
+
+	for (i = 0; i < 16; i++)
+		uk_sched_yield();
+	for (i = 0; i < EPOLL_WAITERS; i++)
+		if (UK_READ_ONCE(w[i].done))
+			done++;
+
+	return done;
+}
+
+/* Returns how many of the blocked waiters a single event wakes up */
+static int epoll_wake_count(unsigned int events)
+{
+	struct epoll_event ev = { .events = events };
+	struct epoll_waiter w[EPOLL_WAITERS];
+	int fds[2];
+	int epfd, i, woken;
+
+	if (pipe(fds))
+		return -errno;
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		return -errno;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ev))
+		return -errno;
+
+	for (i = 0; i < EPOLL_WAITERS; i++) {
+		w[i].epfd = epfd;
+		w[i].rc = -1;
+		w[i].done = 0;
+		w[i].thread = uk_sched_thread_create(uk_sched_current(),
+						     epoll_waiter_fn, &w[i],
+						     "test-epoll-waiter");
+		if (!w[i].thread)
+			return -ENOMEM;
+	}
+	for (i = 0; i < EPOLL_WAITERS; i++)
+		while (!UK_READ_ONCE(w[i].done) && is_runnable(w[i].thread))
+			uk_sched_yield();
+
+	if (write(fds[1], "x", 1) != 1)
+		return -errno;
+	woken = epoll_waiters_done(w);
+
+	/* Release the remaining waiters */
+	while (epoll_waiters_done(w) < EPOLL_WAITERS)
+		if (write(fds[1], "x", 1) != 1)
+			return -errno;
+
+	for (i = 0; i < EPOLL_WAITERS; i++)
+		if (w[i].rc != 1)
+			return -EIO;
+
+	close(epfd);
+	close(fds[0]);
+	close(fds[1]);
+	return woken;
+}
+
+UK_TESTCASE(vfscore_epoll_testsuite, vfscore_test_epoll_exclusive_wake)
+{
+	/* A level-triggered event wakes up all waiters... */
+	UK_TEST_EXPECT_SNUM_EQ(epoll_wake_count(EPOLLIN), EPOLL_WAITERS);
+
+	/* ...unless the fd was added with EPOLLEXCLUSIVE */
+	UK_TEST_EXPECT_SNUM_EQ(epoll_wake_count(EPOLLIN | EPOLLEXCLUSIVE), 1);
+}
+
+uk_testsuite_register(vfscore_epoll_testsuite, NULL);
@@ -0,0 +1,196 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <uk/essentials.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/test.h>
+#include <vfscore/eventfd.h>
+#include <vfscore/file.h>
+
+/* Largest value the counter can hold */
+#define EVENTFD_TEST_MAX	((uint64_t)-2)
+
+static ssize_t eventfd_test_write(int fd, uint64_t val)
+{
+	return write(fd, &val, sizeof(val));
+}
+
+/* Returns the value read, 0 if the read failed */
+static uint64_t eventfd_test_read(int fd)
+{
+	uint64_t val;
+
+	if (read(fd, &val, sizeof(val)) != sizeof(val))
+		return 0;
+	return val;
+}
+
+/* Calls uk_eventfd_signal() on the open file of fd */
+static int eventfd_test_signal(int fd, uint64_t val)
+{
+	struct vfscore_file *fp;
+	int rc;
+
+	fp = vfscore_get_file(fd);
+	if (!fp)
+		return -EBADF;
+	rc = uk_eventfd_signal(fp, val);
+	fdrop(fp);
+	return rc;
+}
+
+UK_TESTCASE(vfscore_eventfd_testsuite, vfscore_test_eventfd_counter)
+{
+	int fd;
+
+	fd = eventfd(3, EFD_NONBLOCK);
+	UK_TEST_EXPECT_SNUM_GE(fd, 0);
+
+	/* A read takes the whole counter */
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_write(fd, 2), sizeof(uint64_t));
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_read(fd), 5);
+	UK_TEST_EXPECT_ZERO(eventfd_test_read(fd));
+	UK_TEST_EXPECT_SNUM_EQ(errno, EAGAIN);
+
+	/* The counter stops short of the largest 64-bit value */
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_write(fd, EVENTFD_TEST_MAX),
+			       sizeof(uint64_t));
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_write(fd, 1), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EAGAIN);
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_write(fd, (uint64_t)-1), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_read(fd), EVENTFD_TEST_MAX);
+
+	close(fd);
+}
+
+UK_TESTCASE(vfscore_eventfd_testsuite, vfscore_test_eventfd_semaphore)
+{
+	int fd;
+
+	fd = eventfd(2, EFD_NONBLOCK | EFD_SEMAPHORE);
+	UK_TEST_EXPECT_SNUM_GE(fd, 0);
+
+	/* A read takes one at a time */
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_read(fd), 1);
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_read(fd), 1);
+	UK_TEST_EXPECT_ZERO(eventfd_test_read(fd));
+	UK_TEST_EXPECT_SNUM_EQ(errno, EAGAIN);
+
+	close(fd);
+}
+
+UK_TESTCASE(vfscore_eventfd_testsuite, vfscore_test_eventfd_signal)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	int fd, epfd, fds[2];
+
+	fd = eventfd(0, EFD_NONBLOCK);
+	UK_TEST_EXPECT_SNUM_GE(fd, 0);
+	epfd = epoll_create1(0);
+	UK_TEST_EXPECT_SNUM_GE(epfd, 0);
+	UK_TEST_EXPECT_ZERO(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev));
+	UK_TEST_EXPECT_ZERO(epoll_wait(epfd, &ev, 1, 0));
+
+	/* Signaling adds to the counter and notifies eventpolls */
+	UK_TEST_EXPECT_ZERO(eventfd_test_signal(fd, 4));
+	UK_TEST_EXPECT_ZERO(eventfd_test_signal(fd, 3));
+	UK_TEST_EXPECT_SNUM_EQ(epoll_wait(epfd, &ev, 1, 0), 1);
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_read(fd), 7);
+
+	/* It never blocks on overflow */
+	UK_TEST_EXPECT_ZERO(eventfd_test_signal(fd, EVENTFD_TEST_MAX));
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_signal(fd, 1), -EAGAIN);
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_signal(fd, (uint64_t)-1),
+			       -EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_read(fd), EVENTFD_TEST_MAX);
+
+	/* Other files are refused */
+	UK_TEST_EXPECT_ZERO(pipe(fds));
+	UK_TEST_EXPECT_SNUM_EQ(eventfd_test_signal(fds[1], 1), -EINVAL);
+
+	close(fds[0]);
+	close(fds[1]);
+	close(epfd);
+	close(fd);
+}
+
+struct eventfd_reader {
+	int fd;
+	uint64_t val;
+	int done;
+};
+
+static __noreturn void eventfd_reader_fn(void *arg)
+{
+	struct eventfd_reader *r = (struct eventfd_reader *) arg;
+
+	r->val = eventfd_test_read(r->fd);
+	UK_WRITE_ONCE(r->done, 1);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(vfscore_eventfd_testsuite, vfscore_test_eventfd_wakeup)
+{
+	struct eventfd_reader r = { .done = 0 };
+	struct uk_thread *t;
+	int i;
+
+	r.fd = eventfd(0, 0);
+	UK_TEST_EXPECT_SNUM_GE(r.fd, 0);
+
+	t = uk_sched_thread_create(uk_sched_current(), eventfd_reader_fn, &r,
+				   "test-eventfd-reader");
+	UK_TEST_EXPECT_NOT_NULL(t);
+	if (!t)
+		return;
+
+	/* Let the reader block on the empty counter */
+	while (!UK_READ_ONCE(r.done) && is_runnable(t))
+		uk_sched_yield();
+	UK_TEST_EXPECT_ZERO(UK_READ_ONCE(r.done));
+
+	/* A signal wakes it up with the value */
+	UK_TEST_EXPECT_ZERO(eventfd_test_signal(r.fd, 9));
+	for (i = 0; i < 16 && !UK_READ_ONCE(r.done); i++)
+		uk_sched_yield();
+	UK_TEST_EXPECT_SNUM_EQ(UK_READ_ONCE(r.done), 1);
+	UK_TEST_EXPECT_SNUM_EQ(r.val, 9);
+
+	close(r.fd);
+}
+
+uk_testsuite_register(vfscore_eventfd_testsuite, NULL);
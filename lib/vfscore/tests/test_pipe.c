@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <uk/arch/limits.h>
+#include <uk/essentials.h>
+#include <uk/test.h>
+
+#define PIPE_TEST_PAGES		4
+
+static char pipe_wbuf[PIPE_TEST_PAGES * __PAGE_SIZE];
+static char pipe_rbuf[PIPE_TEST_PAGES * __PAGE_SIZE];
+
+static void pipe_pattern(char *buf, unsigned long len, unsigned long seed)
+{
+	unsigned long i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (char)(seed + i * 7);
+}
+
+UK_TESTCASE(vfscore_pipe_testsuite, vfscore_test_pipe_splice)
+{
+	const unsigned long len = PIPE_TEST_PAGES * __PAGE_SIZE;
+	int in[2], out[2];
+
+	UK_TEST_EXPECT_ZERO(pipe(in));
+	UK_TEST_EXPECT_ZERO(pipe(out));
+
+	pipe_pattern(pipe_wbuf, len, 1);
+	UK_TEST_EXPECT_SNUM_EQ(write(in[1], pipe_wbuf, len), len);
+
+	/* Complete pages are handed over to the other pipe */
+	UK_TEST_EXPECT_SNUM_EQ(splice(in[0], NULL, out[1], NULL, len, 0),
+			       len);
+
+	/* Refill the input pipe, which reuses the slots just taken */
+	pipe_pattern(pipe_wbuf, len, 2);
+	UK_TEST_EXPECT_SNUM_EQ(write(in[1], pipe_wbuf, len), len);
+
+	pipe_pattern(pipe_wbuf, len, 1);
+	UK_TEST_EXPECT_SNUM_EQ(read(out[0], pipe_rbuf, len), len);
+	UK_TEST_EXPECT_ZERO(memcmp(pipe_rbuf, pipe_wbuf, len));
+
+	pipe_pattern(pipe_wbuf, len, 2);
+	UK_TEST_EXPECT_SNUM_EQ(read(in[0], pipe_rbuf, len), len);
+	UK_TEST_EXPECT_ZERO(memcmp(pipe_rbuf, pipe_wbuf, len));
+
+	close(in[0]);
+	close(in[1]);
+	close(out[0]);
+	close(out[1]);
+}
+
+UK_TESTCASE(vfscore_pipe_testsuite, vfscore_test_pipe_nonblock_atomic)
+{
+	int fds[2], size;
+	ssize_t ret;
+
+	UK_TEST_EXPECT_ZERO(pipe(fds));
+	UK_TEST_EXPECT_ZERO(fcntl(fds[1], F_SETFL, O_NONBLOCK));
+	size = fcntl(fds[1], F_SETPIPE_SZ, PIPE_TEST_PAGES * __PAGE_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(size, PIPE_TEST_PAGES * __PAGE_SIZE);
+
+	/* Leave room for 10 bytes */
+	pipe_pattern(pipe_wbuf, size, 1);
+	UK_TEST_EXPECT_SNUM_EQ(write(fds[1], pipe_wbuf, size - 10),
+			       size - 10);
+
+	/* Writes of up to PIPE_BUF bytes are all-or-nothing... */
+	errno = 0;
+	ret = write(fds[1], pipe_wbuf, 100);
+	UK_TEST_EXPECT_SNUM_EQ(ret, -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EAGAIN);
+	errno = 0;
+	ret = write(fds[1], pipe_wbuf, PIPE_BUF);
+	UK_TEST_EXPECT_SNUM_EQ(ret, -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EAGAIN);
+
+	/* ...larger ones may be partial */
+	ret = write(fds[1], pipe_wbuf, PIPE_BUF + 1);
+	UK_TEST_EXPECT_SNUM_EQ(ret, 10);
+
+	UK_TEST_EXPECT_SNUM_EQ(read(fds[0], pipe_rbuf, size), size);
+	UK_TEST_EXPECT_ZERO(memcmp(pipe_rbuf, pipe_wbuf, size - 10));
+	UK_TEST_EXPECT_ZERO(memcmp(pipe_rbuf + size - 10, pipe_wbuf, 10));
+
+	/* Once drained, the whole write fits again */
+	UK_TEST_EXPECT_SNUM_EQ(write(fds[1], pipe_wbuf, 100), 100);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+uk_testsuite_register(vfscore_pipe_testsuite, NULL);
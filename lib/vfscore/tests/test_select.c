@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <uk/test.h>
+
+UK_TESTCASE(vfscore_select_testsuite, vfscore_test_select_ready)
+{
+	struct timeval tv = { 0 };
+	fd_set rfds, wfds;
+	int fds[2];
+	int rc;
+
+	UK_TEST_EXPECT_ZERO(pipe(fds));
+
+	FD_ZERO(&rfds);
+	FD_ZERO(&wfds);
+	FD_SET(fds[0], &rfds);
+	FD_SET(fds[1], &wfds);
+
+	/* Only the write end is ready */
+	rc = select(fds[1] + 1, &rfds, &wfds, NULL, &tv);
+	UK_TEST_EXPECT_SNUM_EQ(rc, 1);
+	UK_TEST_EXPECT_ZERO(FD_ISSET(fds[0], &rfds));
+	UK_TEST_EXPECT_SNUM_GT(FD_ISSET(fds[1], &wfds), 0);
+
+	UK_TEST_EXPECT_SNUM_EQ(write(fds[1], "x", 1), 1);
+	FD_SET(fds[0], &rfds);
+	FD_ZERO(&wfds);
+	rc = select(fds[1] + 1, &rfds, &wfds, NULL, &tv);
+	UK_TEST_EXPECT_SNUM_EQ(rc, 1);
+	UK_TEST_EXPECT_SNUM_GT(FD_ISSET(fds[0], &rfds), 0);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+UK_TESTCASE(vfscore_select_testsuite, vfscore_test_select_ebadf)
+{
+	struct timeval tv = { 0 };
+	fd_set rfds, saved;
+	int fds[2];
+	int rc;
+
+	UK_TEST_EXPECT_ZERO(pipe(fds));
+	UK_TEST_EXPECT_SNUM_EQ(write(fds[1], "x", 1), 1);
+
+	/* The ready fd comes before a closed one */
+	FD_ZERO(&rfds);
+	FD_SET(fds[0], &rfds);
+	FD_SET(fds[1] + 1, &rfds);
+	saved = rfds;
+
+	rc = select(fds[1] + 2, &rfds, NULL, NULL, &tv);
+	UK_TEST_EXPECT_SNUM_EQ(rc, -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EBADF);
+
+	/* The caller's set is left alone on failure */
+	UK_TEST_EXPECT_ZERO(memcmp(&rfds, &saved, sizeof(rfds)));
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+uk_testsuite_register(vfscore_select_testsuite, NULL);
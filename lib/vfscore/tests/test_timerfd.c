@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <uk/arch/time.h>
+#include <uk/plat/time.h>
+#include <uk/test.h>
+
+#define TIMERFD_INTERVAL_MS	1
+
+static void spin_ms(unsigned long ms)
+{
+	__nsec until = ukplat_monotonic_clock() + ukarch_time_msec_to_nsec(ms);
+
+	/* Keep the CPU without yielding so that expiries pile up */
+	while (ukplat_monotonic_clock() < until)
+		;
+}
+
+UK_TESTCASE(vfscore_timerfd_testsuite, vfscore_test_timerfd_oneshot)
+{
+	struct itimerspec its = {
+		.it_value = { .tv_nsec = ukarch_time_msec_to_nsec(1) },
+	};
+	uint64_t ticks = 0;
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	UK_TEST_EXPECT_SNUM_GE(fd, 0);
+
+	/* A disarmed timer has not expired */
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, &ticks, sizeof(ticks)), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EAGAIN);
+
+	UK_TEST_EXPECT_ZERO(fcntl(fd, F_SETFL, 0));
+	UK_TEST_EXPECT_ZERO(timerfd_settime(fd, 0, &its, NULL));
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, &ticks, sizeof(ticks)),
+			       sizeof(ticks));
+	UK_TEST_EXPECT_SNUM_EQ(ticks, 1);
+
+	/* The timer disarmed itself and the counter was reset */
+	UK_TEST_EXPECT_ZERO(fcntl(fd, F_SETFL, O_NONBLOCK));
+	UK_TEST_EXPECT_ZERO(timerfd_gettime(fd, &its));
+	UK_TEST_EXPECT_ZERO(its.it_value.tv_sec);
+	UK_TEST_EXPECT_ZERO(its.it_value.tv_nsec);
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, &ticks, sizeof(ticks)), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EAGAIN);
+
+	close(fd);
+}
+
+UK_TESTCASE(vfscore_timerfd_testsuite, vfscore_test_timerfd_overrun)
+{
+	struct itimerspec its = {
+		.it_interval = {
+			.tv_nsec = ukarch_time_msec_to_nsec(TIMERFD_INTERVAL_MS)
+		},
+		.it_value = {
+			.tv_nsec = ukarch_time_msec_to_nsec(TIMERFD_INTERVAL_MS)
+		},
+	};
+	uint64_t ticks = 0;
+	__nsec start, elapsed;
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	UK_TEST_EXPECT_SNUM_GE(fd, 0);
+
+	start = ukplat_monotonic_clock();
+	UK_TEST_EXPECT_ZERO(timerfd_settime(fd, 0, &its, NULL));
+
+	/* All periods that passed without a read are counted, including
+	 * the ones that expired while the timer thread could not run.
+	 */
+	spin_ms(10 * TIMERFD_INTERVAL_MS);
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, &ticks, sizeof(ticks)),
+			       sizeof(ticks));
+	elapsed = ukplat_monotonic_clock() - start;
+	UK_TEST_EXPECT_SNUM_GE(ticks, 9);
+	UK_TEST_EXPECT_SNUM_LE(ticks,
+			       elapsed / ukarch_time_msec_to_nsec(
+					TIMERFD_INTERVAL_MS) + 1);
+
+	/* Disarming stops the counting */
+	its.it_value.tv_nsec = 0;
+	UK_TEST_EXPECT_ZERO(timerfd_settime(fd, 0, &its, NULL));
+	UK_TEST_EXPECT_ZERO(fcntl(fd, F_SETFL, O_NONBLOCK));
+	spin_ms(2 * TIMERFD_INTERVAL_MS);
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, &ticks, sizeof(ticks)), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EAGAIN);
+
+	close(fd);
+}
+
+uk_testsuite_register(vfscore_timerfd_testsuite, NULL);
@@ -0,0 +1,504 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <vfscore/eventpoll.h>
+#include <vfscore/fs.h>
+#include <vfscore/file.h>
+#include <vfscore/dentry.h>
+#include <vfscore/vnode.h>
+#include <vfscore/mount.h>
+#include <uk/syscall.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/wait.h>
+#include <uk/mutex.h>
+#include <uk/timer.h>
+#include <uk/plat/time.h>
+
+#include <sys/timerfd.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+
+struct timerfd {
+	/** Kernel timer, its function runs in thread context */
+	struct uk_timer timer;
+	/** Clock that absolute expiry times refer to */
+	clockid_t clockid;
+	/** Period, or 0 for one-shot timers */
+	__nsec interval;
+	/** Indicates if the timer is set */
+	int armed;
+	/** Number of expirations since the last read */
+	uint64_t ticks;
+	/** Lock to synchronize access */
+	struct uk_mutex lock;
+	/** Wait queue for blocked readers (i.e., no expirations) */
+	struct uk_waitq r_wq;
+	/** List of registered eventpolls. */
+	struct uk_list_head ep_list;
+};
+
+static uint64_t t_inode;
+static struct uk_mutex timerfd_global_lock =
+	UK_MUTEX_INITIALIZER(timerfd_global_lock);
+
+static inline __nsec timespec_to_nsec(const struct timespec *ts)
+{
+	return ukarch_time_sec_to_nsec((__nsec) ts->tv_sec) + ts->tv_nsec;
+}
+
+static inline void nsec_to_timespec(__nsec ns, struct timespec *ts)
+{
+	ts->tv_sec = ukarch_time_nsec_to_sec(ns);
+	ts->tv_nsec = ukarch_time_subsec(ns);
+}
+
+static inline int timespec_valid(const struct timespec *ts)
+{
+	return ts->tv_sec >= 0 && ts->tv_nsec >= 0
+		&& ts->tv_nsec < (long) UKARCH_NSEC_PER_SEC;
+}
+
+static void timerfd_signal_eventpoll(struct timerfd *tfd, unsigned int events)
+{
+	struct eventpoll_cb *ecb;
+	struct uk_list_head *itr;
+
+	uk_list_for_each(itr, &tfd->ep_list) {
+		ecb = uk_list_entry(itr, struct eventpoll_cb, cb_link);
+
+		UK_ASSERT(ecb->unregister);
+
+		eventpoll_signal(ecb, events);
+	}
+}
+
+static void timerfd_expire(struct uk_timer *timer, void *arg)
+{
+	struct timerfd *tfd = (struct timerfd *)arg;
+	__nsec now, expires;
+	uint64_t missed = 0;
+
+	uk_mutex_lock(&tfd->lock);
+
+	/* The timer was disarmed or set again in the meantime */
+	if (!tfd->armed || uk_timer_pending(timer))
+		goto out;
+
+	if (tfd->interval) {
+		now = ukplat_monotonic_clock();
+		expires = timer->expires + tfd->interval;
+		if (expires <= now) {
+			missed = (now - expires) / tfd->interval + 1;
+			expires += missed * tfd->interval;
+		}
+		uk_timer_arm(timer, expires);
+	} else {
+		tfd->armed = 0;
+	}
+
+	tfd->ticks += 1 + missed;
+
+	uk_waitq_wake_up(&tfd->r_wq);
+	timerfd_signal_eventpoll(tfd, EPOLLIN);
+out:
+	uk_mutex_unlock(&tfd->lock);
+}
+
+static void timerfd_init(struct timerfd *tfd, clockid_t clockid)
+{
+	uk_timer_init_thread(&tfd->timer, timerfd_expire, tfd);
+	tfd->clockid = clockid;
+	tfd->interval = 0;
+	tfd->armed = 0;
+	tfd->ticks = 0;
+	uk_waitq_init(&tfd->r_wq);
+	uk_mutex_init(&tfd->lock);
+	UK_INIT_LIST_HEAD(&tfd->ep_list);
+}
+
+static int timerfd_vfscore_close(struct vnode *vnode,
+				 struct vfscore_file *fp __unused)
+{
+	struct timerfd *tfd;
+
+	UK_ASSERT(vnode->v_data);
+	UK_ASSERT(vnode->v_type == VTIMER);
+
+	tfd = (struct timerfd *)vnode->v_data;
+
+	uk_mutex_lock(&tfd->lock);
+	tfd->armed = 0;
+	uk_mutex_unlock(&tfd->lock);
+
+	/* Wait for an expiry that is being processed */
+	uk_timer_cancel_sync(&tfd->timer);
+
+	uk_free(uk_alloc_get_default(), tfd);
+
+	vnode->v_data = NULL;
+	return 0;
+}
+
+static int timerfd_vfscore_read(struct vnode *vnode,
+				struct vfscore_file *fp,
+				struct uio *buf, int ioflag __unused)
+{
+	struct timerfd *tfd = (struct timerfd *)vnode->v_data;
+	uint64_t *val;
+
+	UK_ASSERT(vnode->v_data);
+	UK_ASSERT(vnode->v_type == VTIMER);
+
+	if (buf->uio_offset != 0)
+		return EINVAL;
+
+	if (buf->uio_iovcnt != 1)
+		return EINVAL;
+
+	if (!buf->uio_iov[0].iov_base)
+		return EINVAL;
+
+	if (buf->uio_iov[0].iov_len < sizeof(uint64_t))
+		return EINVAL;
+
+	val = (uint64_t *)buf->uio_iov[0].iov_base;
+
+	uk_mutex_lock(&tfd->lock);
+
+	/* Block until the timer expires, unless the file descriptor is
+	 * configured to non-blocking operation.
+	 */
+	if ((fp->f_flags & O_NONBLOCK) && (tfd->ticks == 0)) {
+		uk_mutex_unlock(&tfd->lock);
+		return EAGAIN;
+	}
+
+	uk_waitq_wait_event_mutex(&tfd->r_wq, tfd->ticks > 0, &tfd->lock);
+
+	*val = tfd->ticks;
+	tfd->ticks = 0;
+
+	uk_mutex_unlock(&tfd->lock);
+
+	buf->uio_resid -= sizeof(uint64_t);
+	buf->uio_offset = sizeof(uint64_t);
+
+	return 0;
+}
+
+static void timerfd_unregister_eventpoll(struct eventpoll_cb *ecb)
+{
+	UK_ASSERT(ecb);
+
+	uk_mutex_lock(&timerfd_global_lock);
+	UK_ASSERT(!uk_list_empty(&ecb->cb_link));
+	uk_list_del(&ecb->cb_link);
+
+	ecb->data = NULL;
+	ecb->unregister = NULL;
+	uk_mutex_unlock(&timerfd_global_lock);
+}
+
+static int timerfd_vfscore_poll(struct vnode *vnode, unsigned int *revents,
+				struct eventpoll_cb *ecb)
+{
+	struct timerfd *tfd = (struct timerfd *)vnode->v_data;
+	unsigned int events = 0;
+
+	UK_ASSERT(vnode->v_data);
+	UK_ASSERT(vnode->v_type == VTIMER);
+
+	uk_mutex_lock(&tfd->lock);
+
+	if (tfd->ticks > 0)
+		events |= EPOLLIN;
+
+	uk_mutex_lock(&timerfd_global_lock);
+	if (!ecb->unregister) {
+		UK_ASSERT(uk_list_empty(&ecb->cb_link));
+		UK_ASSERT(!ecb->data);
+
+		/* This is the first time we see this cb. Add it to the
+		 * eventpoll list and set the unregister callback so
+		 * we remove it when the eventpoll is freed.
+		 */
+		uk_list_add_tail(&ecb->cb_link, &tfd->ep_list);
+
+		ecb->data = tfd;
+		ecb->unregister = timerfd_unregister_eventpoll;
+	}
+	uk_mutex_unlock(&timerfd_global_lock);
+
+	uk_mutex_unlock(&tfd->lock);
+
+	*revents = events;
+
+	return 0;
+}
+
+/* vnode operations */
+#define timerfd_vfscore_inactive ((vnop_inactive_t) vfscore_vop_einval)
+#define timerfd_vfscore_write ((vnop_write_t) vfscore_vop_einval)
+
+static struct vnops timerfd_vnops = {
+	.vop_close = timerfd_vfscore_close,
+	.vop_inactive = timerfd_vfscore_inactive,
+	.vop_read = timerfd_vfscore_read,
+	.vop_write = timerfd_vfscore_write,
+	.vop_poll = timerfd_vfscore_poll
+};
+
+/* file system operations */
+#define timerfd_vget ((vfsop_vget_t) vfscore_nullop)
+
+static struct vfsops timerfd_vfsops = {
+	.vfs_vget = timerfd_vget,
+	.vfs_vnops = &timerfd_vnops
+};
+
+/* bogus mount point used by all timerfd objects */
+static struct mount timerfd_mount = {
+	.m_op = &timerfd_vfsops
+};
+
+static int do_timerfd_create(struct uk_alloc *a, int clockid, int flags)
+{
+	int vfs_fd, ret;
+	struct timerfd *tfd;
+	struct vfscore_file *vfs_file;
+	struct dentry *vfs_dentry;
+	struct vnode *vfs_vnode;
+
+	if (flags & ~(TFD_CLOEXEC | TFD_NONBLOCK))
+		return -EINVAL;
+
+	switch (clockid) {
+	case CLOCK_REALTIME:
+	case CLOCK_MONOTONIC:
+	case CLOCK_BOOTTIME:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	/* Reserve a file descriptor number */
+	vfs_fd = vfscore_alloc_fd();
+	if (vfs_fd < 0) {
+		ret = -ENFILE;
+		goto ERR_EXIT;
+	}
+
+	/* Allocate file, vfs_file, and vnode */
+	tfd = uk_malloc(a, sizeof(struct timerfd));
+	if (!tfd) {
+		ret = -ENOMEM;
+		goto ERR_MALLOC_FILE;
+	}
+
+	vfs_file = uk_malloc(a, sizeof(struct vfscore_file));
+	if (!vfs_file) {
+		ret = -ENOMEM;
+		goto ERR_MALLOC_VFS_FILE;
+	}
+
+	/* TODO: Synchronize inode increment */
+	ret = vfscore_vget(&timerfd_mount, t_inode++, &vfs_vnode);
+	UK_ASSERT(ret == 0); /* we should not find it in the cache */
+	if (!vfs_vnode) {
+		ret = -ENOMEM;
+		goto ERR_ALLOC_VNODE;
+	}
+
+	/*
+	 * It doesn't matter that all the dentries have the same path since
+	 * we never look them up.
+	 */
+	vfs_dentry = dentry_alloc(NULL, vfs_vnode, "/");
+	if (!vfs_dentry) {
+		ret = -ENOMEM;
+		goto ERR_ALLOC_DENTRY;
+	}
+
+	/* Initialize data structures */
+	vfs_file->fd = vfs_fd;
+	vfs_file->f_flags = UK_FREAD;
+	if (flags & TFD_NONBLOCK)
+		vfs_file->f_flags |= O_NONBLOCK;
+	vfs_file->f_count = 1;
+	vfs_file->f_data = tfd;
+	vfs_file->f_dentry = vfs_dentry;
+	vfs_file->f_vfs_flags = UK_VFSCORE_NOPOS;
+	vfs_file->f_offset = 0;
+
+	uk_mutex_init(&vfs_file->f_lock);
+	UK_INIT_LIST_HEAD(&vfs_file->f_ep);
+
+	vfs_vnode->v_data = tfd;
+	vfs_vnode->v_type = VTIMER;
+
+	timerfd_init(tfd, clockid);
+
+	/* Store within the vfs structure */
+	ret = vfscore_install_fd(vfs_fd, vfs_file);
+	if (ret)
+		goto ERR_VFS_INSTALL;
+
+	/* Only the dentry should hold a reference; release ours */
+	vput(vfs_vnode);
+
+	return vfs_fd;
+
+ERR_VFS_INSTALL:
+	drele(vfs_dentry);
+ERR_ALLOC_DENTRY:
+	vput(vfs_vnode);
+ERR_ALLOC_VNODE:
+	uk_free(a, vfs_file);
+ERR_MALLOC_VFS_FILE:
+	uk_free(a, tfd);
+ERR_MALLOC_FILE:
+	vfscore_put_fd(vfs_fd);
+ERR_EXIT:
+	UK_ASSERT(ret < 0);
+	return ret;
+}
+
+static int is_timerfd_file(struct vfscore_file *fp)
+{
+	return (fp->f_dentry->d_vnode->v_op == &timerfd_vnops);
+}
+
+/* NOTE: The caller must hold the lock of the timerfd */
+static void timerfd_value(struct timerfd *tfd, struct itimerspec *value)
+{
+	__nsec now = ukplat_monotonic_clock();
+	__nsec remaining = 0;
+
+	if (tfd->armed)
+		remaining = (tfd->timer.expires > now)
+			    ? tfd->timer.expires - now : 1;
+	nsec_to_timespec(remaining, &value->it_value);
+	nsec_to_timespec(tfd->interval, &value->it_interval);
+}
+
+UK_SYSCALL_R_DEFINE(int, timerfd_create, int, clockid, int, flags)
+{
+	return do_timerfd_create(uk_alloc_get_default(), clockid, flags);
+}
+
+UK_SYSCALL_R_DEFINE(int, timerfd_settime, int, fd, int, flags,
+		    const struct itimerspec *, new_value,
+		    struct itimerspec *, old_value)
+{
+	struct vfscore_file *fp;
+	struct timerfd *tfd;
+	__nsec expires, offset;
+
+	if (flags & ~(TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET))
+		return -EINVAL;
+
+	if (!new_value)
+		return -EFAULT;
+
+	if (!timespec_valid(&new_value->it_value) ||
+	    !timespec_valid(&new_value->it_interval))
+		return -EINVAL;
+
+	fp = vfscore_get_file(fd);
+	if (!fp)
+		return -EBADF;
+
+	if (!is_timerfd_file(fp)) {
+		vfscore_put_file(fp);
+		return -EINVAL;
+	}
+
+	tfd = (struct timerfd *)fp->f_dentry->d_vnode->v_data;
+
+	uk_mutex_lock(&tfd->lock);
+
+	if (old_value)
+		timerfd_value(tfd, old_value);
+
+	/* Setting the timer discards expirations that were not read yet.
+	 * The wall clock is not set at runtime, so TFD_TIMER_CANCEL_ON_SET
+	 * never triggers.
+	 */
+	uk_timer_cancel(&tfd->timer);
+	tfd->ticks = 0;
+	tfd->interval = timespec_to_nsec(&new_value->it_interval);
+	tfd->armed = new_value->it_value.tv_sec ||
+		     new_value->it_value.tv_nsec;
+	if (tfd->armed) {
+		expires = timespec_to_nsec(&new_value->it_value);
+		if (!(flags & TFD_TIMER_ABSTIME)) {
+			expires += ukplat_monotonic_clock();
+		} else if (tfd->clockid == CLOCK_REALTIME) {
+			offset = ukplat_wall_clock() - ukplat_monotonic_clock();
+			expires = (expires > offset) ? expires - offset : 0;
+		}
+		uk_timer_arm(&tfd->timer, expires);
+	}
+
+	uk_mutex_unlock(&tfd->lock);
+
+	vfscore_put_file(fp);
+	return 0;
+}
+
+UK_SYSCALL_R_DEFINE(int, timerfd_gettime, int, fd,
+		    struct itimerspec *, curr_value)
+{
+	struct vfscore_file *fp;
+	struct timerfd *tfd;
+
+	if (!curr_value)
+		return -EFAULT;
+
+	fp = vfscore_get_file(fd);
+	if (!fp)
+		return -EBADF;
+
+	if (!is_timerfd_file(fp)) {
+		vfscore_put_file(fp);
+		return -EINVAL;
+	}
+
+	tfd = (struct timerfd *)fp->f_dentry->d_vnode->v_data;
+
+	uk_mutex_lock(&tfd->lock);
+	timerfd_value(tfd, curr_value);
+	uk_mutex_unlock(&tfd->lock);
+
+	vfscore_put_file(fp);
+	return 0;
+}
@@ -55,9 +55,9 @@ enum vtype iftovt_tab[16] = {
 	VNON, VFIFO, VCHR, VNON, VDIR, VNON, VBLK, VNON,
 	VREG, VNON, VLNK, VNON, VSOCK, VNON, VNON, VBAD,
 };
-int vttoif_tab[10] = {
+int vttoif_tab[11] = {
 	0, S_IFREG, S_IFDIR, S_IFBLK, S_IFCHR, S_IFLNK,
-	S_IFSOCK, S_IFIFO, S_IFMT, S_IFMT
+	S_IFSOCK, S_IFIFO, S_IFMT, S_IFMT, S_IFMT
 };
 
 /*
@@ -449,8 +449,9 @@ vnode_dump(void)
 	int i;
 	struct vnode *vp;
 	struct mount *mp;
-	char type[][6] = { "VNON ", "VREG ", "VDIR ", "VBLK ", "VCHR ",
-			   "VLNK ", "VSOCK", "VFIFO", "VEPOLL", "VEVENT"};
+	char type[][7] = { "VNON ", "VREG ", "VDIR ", "VBLK ", "VCHR ",
+			   "VLNK ", "VSOCK", "VFIFO", "VEPOLL", "VEVENT",
+			   "VTIMER", "VSIGFD"};
 
 	VNODE_LOCK();
 
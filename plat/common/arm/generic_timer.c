@@ -218,6 +218,24 @@ static inline __nsec generic_timer_monotonic_ticks(uint64_t *ticks)
 	return ticks_to_ns(*ticks - boot_ticks);
 }
 
+/*
+ * Program the timer interrupt of the current CPU for `until_ns`. A deadline
+ * in the past raises the interrupt right away.
+ */
+void generic_timer_arm(uint64_t until_ns)
+{
+	uint64_t now_ns, now_ticks, until_ticks;
+
+	now_ns = generic_timer_monotonic_ticks(&now_ticks);
+	until_ticks = now_ticks;
+	if (now_ns < until_ns)
+		until_ticks += ns_to_ticks(until_ns - now_ns);
+
+	generic_timer_update_compare(until_ticks);
+	generic_timer_enable();
+	generic_timer_unmask_irq();
+}
+
 /*
  * Returns early if any interrupts are serviced, or if the requested delay is
  * too short. Must be called with interrupts disabled, will enable interrupts
@@ -231,20 +249,10 @@ static inline __nsec generic_timer_monotonic_ticks(uint64_t *ticks)
  */
 void generic_timer_cpu_block_until(uint64_t until_ns)
 {
-	uint64_t now_ns, now_ticks, until_ticks;
-
 	UK_ASSERT(ukplat_lcpu_irqs_disabled());
 
-	/* Record current ns */
-	now_ns = generic_timer_monotonic_ticks(&now_ticks);
-
-	if (now_ns < until_ns) {
-		/* Calculate until_ticks for timer */
-		until_ticks = now_ticks
-			+ ns_to_ticks(until_ns - now_ns);
-		generic_timer_update_compare(until_ticks);
-		generic_timer_enable();
-		generic_timer_unmask_irq();
+	if (generic_timer_monotonic() < until_ns) {
+		generic_timer_arm(until_ns);
 		__asm__ __volatile__("wfi");
 
 		/* Give the IRQ handler a chance to handle whatever woke
@@ -292,9 +300,12 @@ int generic_timer_irq_handler(void *arg __unused)
 {
 	/*
 	 * We just mask the IRQ here, the scheduler will call
-	 * generic_timer_cpu_block_until, and then unmask the IRQ.
+	 * generic_timer_cpu_block_until, and then unmask the IRQ. The
+	 * handlers that run before us may have programmed a new deadline
+	 * already (see ukplat_time_set_deadline()), which deasserts the IRQ.
 	 */
-	generic_timer_mask_irq();
+	if (get_el0(cntv_ctl) & GT_TIMER_IRQ_STATUS)
+		generic_timer_mask_irq();
 
 	/* Yes, we handled the irq. */
 	return 1;
@@ -36,7 +36,6 @@
 #include <uk/plat/time.h>
 #include <uk/plat/lcpu.h>
 #include <uk/plat/irq.h>
-#include <uk/bitops.h>
 #include <uk/plat/common/cpu.h>
 #include <ofw/gic_fdt.h>
 #include <uk/plat/common/irq.h>
@@ -94,15 +93,32 @@ uint32_t generic_timer_get_frequency(int fdt_timer)
 	return fdt32_to_cpu(fdt_freq[0]);
 }
 
-unsigned long sched_have_pending_events;
+/* Deadlines requested with ukplat_time_set_deadline(), per logical CPU */
+static __nsec timer_deadline[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+
+void ukplat_time_set_deadline(__nsec deadline)
+{
+	unsigned long flags;
+
+	flags = ukplat_lcpu_save_irqf();
+	timer_deadline[ukplat_lcpu_id()] = deadline;
+	if (deadline)
+		generic_timer_arm(deadline);
+	ukplat_lcpu_restore_irqf(flags);
+}
 
 void time_block_until(__nsec until)
 {
-	while (ukplat_monotonic_clock() < until) {
-		generic_timer_cpu_block_until(until);
-		if (__uk_test_and_clear_bit(0, &sched_have_pending_events))
-			break;
-	}
+	__nsec deadline = timer_deadline[ukplat_lcpu_id()];
+
+	/* Wake up for the kernel timers if they expire first */
+	generic_timer_cpu_block_until((deadline && deadline < until) ?
+				      deadline : until);
+
+	/* The one-shot timer fired for `until` */
+	deadline = timer_deadline[ukplat_lcpu_id()];
+	if (deadline && deadline > until)
+		generic_timer_arm(deadline);
 }
 
 __nsec ukplat_time_get_ticks(void)
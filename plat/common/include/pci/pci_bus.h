@@ -69,6 +69,7 @@
 #include <uk/bus.h>
 #include <uk/alloc.h>
 #include <uk/ctors.h>
+#include <uk/config.h>
 
 /**
  * A structure describing an ID for a PCI driver. Each driver provides a
@@ -152,6 +153,11 @@ struct pci_device {
 
 	unsigned long base;
 	unsigned long irq;
+
+#if CONFIG_KVM_PCI_MSIX
+	/* MSI-X table, set while MSI-X is enabled */
+	volatile uint32_t *msix_table;
+#endif
 };
 
 
@@ -291,6 +297,71 @@ static struct pci_bus_handler ph __unused;
 #define PCI_MIN_GNT		0x3e	/* 8 bits */
 #define PCI_MAX_LAT		0x3f	/* 8 bits */
 
+#define PCI_STATUS_CAP_LIST	0x10	/* Support capability list */
+
+/* Capability list */
+#define PCI_CAP_LIST_ID		0	/* Capability ID */
+#define PCI_CAP_LIST_NEXT	1	/* Next capability in the list */
+#define PCI_CAP_ID_MSIX		0x11	/* MSI-X */
+
+/* MSI-X capability */
+#define PCI_MSIX_FLAGS		2	/* Message control, 16 bits */
+#define  PCI_MSIX_FLAGS_QSIZE	0x07ff	/* Table size - 1 */
+#define  PCI_MSIX_FLAGS_MASKALL	0x4000	/* Mask all vectors */
+#define  PCI_MSIX_FLAGS_ENABLE	0x8000	/* MSI-X enable */
+#define PCI_MSIX_TABLE		4	/* Table offset and BAR indicator */
+#define  PCI_MSIX_TABLE_BIR	0x00000007
+#define  PCI_MSIX_TABLE_OFFSET	0xfffffff8
+
+/* MSI-X table entry */
+#define PCI_MSIX_ENTRY_SIZE		16
+#define PCI_MSIX_ENTRY_LOWER_ADDR	0
+#define PCI_MSIX_ENTRY_UPPER_ADDR	4
+#define PCI_MSIX_ENTRY_DATA		8
+#define PCI_MSIX_ENTRY_VECTOR_CTRL	12
+#define  PCI_MSIX_ENTRY_CTRL_MASKBIT	0x1
+
+#define PCI_BASE_ADDRESS_SPACE_IO	0x01
+#define PCI_BASE_ADDRESS_MEM_TYPE_64	0x04
+#define PCI_BASE_ADDRESS_MEM_MASK	(~0x0fUL)
+
 struct pci_driver *pci_find_driver(struct pci_device_id *id);
 
+/* Access the configuration space of a device, in 32-bit words */
+uint32_t arch_pci_conf_read(const struct pci_address *addr, uint8_t offset);
+void arch_pci_conf_write(const struct pci_address *addr, uint8_t offset,
+			 uint32_t val);
+
+#if CONFIG_KVM_PCI_MSIX
+/* Returns a pointer to access device memory, NULL if it is not mapped */
+volatile void *arch_pci_mmio_map(uint64_t paddr, size_t len);
+
+/**
+ * Return the number of MSI-X vectors supported by a device, 0 if the device
+ * does not support MSI-X.
+ */
+unsigned int pci_msix_table_size(struct pci_device *dev);
+
+/**
+ * Enable MSI-X for a device. An IRQ is allocated for each of the first
+ * `count` MSI-X table entries and returned in `irqs`. Interrupt handlers
+ * are registered with ukplat_irq_register() on these IRQs. The legacy
+ * INTx interrupt of the device is disabled.
+ *
+ * @return
+ *	- 0: Success
+ *	- (-ENOTSUP): MSI-X not supported by the device or the platform
+ *	- (-ENOSPC): Not enough free IRQs
+ */
+int pci_msix_enable(struct pci_device *dev, unsigned int *irqs,
+		    unsigned int count);
+
+/**
+ * Disable MSI-X for a device and release the IRQs allocated by
+ * pci_msix_enable(). Interrupts are delivered over INTx again.
+ */
+void pci_msix_disable(struct pci_device *dev, unsigned int *irqs,
+		      unsigned int count);
+#endif /* CONFIG_KVM_PCI_MSIX */
+
 #endif /* __UKPLAT_COMMON_PCI_BUS_H__ */
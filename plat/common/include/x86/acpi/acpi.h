@@ -73,4 +73,10 @@ int acpi_init(void);
  */
 int acpi_get_version(void);
 
+/**
+ * Return the Multiple APIC Descriptor Table (MADT). Must only be called if
+ * acpi_init() succeeded.
+ */
+struct MADT *acpi_get_madt(void);
+
 #endif /* __PLAT_CMN_X86_ACPI_H__ */
@@ -50,6 +50,19 @@ struct MADTEntryHeader {
 	__u8 Length;
 } __packed;
 
+/* Values of MADTEntryHeader.Type */
+#define MADT_TYPE_LAPIC			0x0
+#define MADT_TYPE_IOAPIC		0x1
+#define MADT_TYPE_INT_SRC_OVERRIDE	0x2
+#define MADT_TYPE_NMI_SRC		0x3
+#define MADT_TYPE_LAPIC_NMI		0x4
+#define MADT_TYPE_LAPIC_ADDR_OVERRIDE	0x5
+#define MADT_TYPE_LAPIC_X2APIC		0x9
+
+/* Flags of the processor local (x2)APIC structures */
+#define MADT_LAPIC_FLAGS_ENABLED	0x1
+#define MADT_LAPIC_FLAGS_ONLINE_CAPABLE	0x2
+
 /*
  * The following structures are declared according to the ACPI
  * specification version 6.3.
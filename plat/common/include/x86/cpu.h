@@ -51,6 +51,14 @@ static inline void cpuid(__u32 fn, __u32 subfn,
 
 unsigned long read_cr2(void);
 
+static inline unsigned long read_cr3(void)
+{
+	unsigned long cr3;
+
+	asm volatile("mov %%cr3, %0" : "=r"(cr3));
+	return cr3;
+}
+
 static inline void write_cr3(unsigned long cr3)
 {
 	asm volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
@@ -54,6 +54,7 @@
 /*
  * Basic CPU control in CR0
  */
+#define X86_CR0_PE              (1 << 0)    /* Protection Enable */
 #define X86_CR0_MP              (1 << 1)    /* Monitor Coprocessor */
 #define X86_CR0_EM              (1 << 2)    /* Emulation */
 #define X86_CR0_TS              (1 << 3)    /* Task Switched */
@@ -84,10 +85,39 @@
 #define X86_XCR0_AVX            (1 << 2)
 #define X86_XCR0_PKRU		(1 << 9)
 
+/*
+ * Intel CPU features in CPUID leaf 1 ECX
+ */
+#define X86_CPUID1_ECX_X2APIC   (1 << 21)
+#define X86_CPUID1_ECX_TSC_DEADLINE (1 << 24)
+#define X86_CPUID1_ECX_HYPERVISOR (1 << 31)
+
+/*
+ * Intel CPU features in CPUID leaf 1 EDX
+ */
+#define X86_CPUID1_EDX_APIC     (1 << 9)
+
+/*
+ * Extended processor features in CPUID leaf 0x80000001 EDX
+ */
+#define X86_CPUID_80000001_EDX_PDPE1GB (1 << 26)
+
+/*
+ * Advanced power management features in CPUID leaf 0x80000007 EDX
+ */
+#define X86_CPUID_80000007_EDX_INVTSC (1 << 8)
+
 /*
  * Model-specific register addresses
  */
+/* local APIC base address and mode */
+#define X86_MSR_APIC_BASE	0x0000001b
+/* TSC value at which the local APIC timer fires in TSC-deadline mode */
+#define X86_MSR_TSC_DEADLINE	0x000006e0
+/* first x2APIC register, the xAPIC MMIO offset divided by 16 is added */
+#define X86_MSR_X2APIC_BASE	0x00000800
 #define X86_MSR_FS_BASE         0xc0000100
+#define X86_MSR_GS_BASE         0xc0000101
 /* extended feature register */
 #define X86_MSR_EFER		0xc0000080
 /* legacy mode SYSCALL target */
@@ -109,4 +139,8 @@
 #define X86_EFER_FFXSR		(1 << 14)
 #define X86_EFER_TCE		(1 << 15)
 
+/* MSR APIC_BASE bits */
+#define X86_APIC_BASE_EXTD	(1 << 10)
+#define X86_APIC_BASE_EN	(1 << 11)
+
 #endif /* __PLAT_CMN_X86_CPU_DEFS_H__ */
@@ -29,6 +29,7 @@
 #ifndef __PLAT_CMN_X86_IRQ_H__
 #define __PLAT_CMN_X86_IRQ_H__
 
+#include <uk/config.h>
 #include <x86/cpu_defs.h>
 
 #ifdef __X64_32__
@@ -90,6 +91,14 @@ static inline int irqs_disabled(void)
 #define local_irq_enable()       __sti()
 #define local_irq_enable_halt()  __sti_hlt()
 
+/* IRQs 0-15 are wired to the i8259 */
+#define __MAX_LEGACY_IRQ	16
+
+#if CONFIG_KVM_PCI_MSIX
+/* IRQs 16-47 are delivered as MSI through the local APIC */
+#define __MAX_IRQ	48
+#else
 #define __MAX_IRQ	16
+#endif
 
 #endif /* __PLAT_CMN_X86_IRQ_H__ */
@@ -57,6 +57,11 @@
 #define TRAP_virt_error          20
 #define TRAP_security_error      21
 
+/* Page fault error code bits */
+#define X86_PF_EC_P              (1 << 0)  /* protection violation */
+#define X86_PF_EC_WR             (1 << 1)  /* write access */
+#define X86_PF_EC_ID             (1 << 4)  /* instruction fetch */
+
 #define ASM_TRAP_SYM(trapname)   asm_trap_##trapname
 
 #ifndef __ASSEMBLY__
@@ -52,9 +52,13 @@
  */
 
 #include <string.h>
+#include <errno.h>
 #include <uk/print.h>
 #include <uk/plat/common/cpu.h>
 #include <pci/pci_bus.h>
+#if CONFIG_KVM_PCI_MSIX
+#include <kvm/intctrl.h>
+#endif
 
 extern int arch_pci_probe(struct uk_alloc *pha);
 
@@ -117,6 +121,203 @@ struct pci_driver *pci_find_driver(struct pci_device_id *id)
 	return NULL; /* no driver found */
 }
 
+#if CONFIG_KVM_PCI_MSIX
+/* Upper bound of capabilities, guards against loops in the list */
+#define PCI_FIND_CAP_TTL	48
+
+static uint8_t pci_find_cap(struct pci_device *dev, uint8_t cap_id)
+{
+	uint32_t val;
+	uint8_t pos;
+	int ttl = PCI_FIND_CAP_TTL;
+
+	val = arch_pci_conf_read(&dev->addr, PCI_STATUS_OFFSET);
+	if (!((val >> 16) & PCI_STATUS_CAP_LIST))
+		return 0;
+
+	pos = arch_pci_conf_read(&dev->addr, PCI_CAPABILITIES_PTR) & 0xfc;
+	while (pos && ttl--) {
+		val = arch_pci_conf_read(&dev->addr, pos);
+		if ((val & 0xff) == cap_id)
+			return pos;
+		pos = (val >> 8) & 0xfc;
+	}
+	return 0;
+}
+
+/* Message control is the upper half of the first capability word */
+static inline uint16_t pci_msix_flags(struct pci_device *dev, uint8_t cap)
+{
+	return arch_pci_conf_read(&dev->addr, cap) >> 16;
+}
+
+static inline void pci_msix_flags_set(struct pci_device *dev, uint8_t cap,
+				      uint16_t flags)
+{
+	uint32_t val;
+
+	val = arch_pci_conf_read(&dev->addr, cap);
+	arch_pci_conf_write(&dev->addr, cap,
+			    (val & 0xffff) | ((uint32_t) flags << 16));
+}
+
+static void pci_intx_disable(struct pci_device *dev, int disable)
+{
+	uint32_t val;
+
+	/* The upper half is the status register, where 1s clear bits */
+	val = arch_pci_conf_read(&dev->addr, PCI_COMMAND) & 0xffff;
+	if (disable)
+		val |= PCI_COMMAND_INTX_DISABLE;
+	else
+		val &= ~PCI_COMMAND_INTX_DISABLE;
+	arch_pci_conf_write(&dev->addr, PCI_COMMAND, val);
+}
+
+static volatile uint32_t *pci_msix_map_table(struct pci_device *dev,
+					     uint8_t cap, unsigned int size)
+{
+	uint32_t table, bar;
+	uint64_t paddr;
+	uint8_t bir;
+
+	table = arch_pci_conf_read(&dev->addr, cap + PCI_MSIX_TABLE);
+	bir = table & PCI_MSIX_TABLE_BIR;
+	if (bir > 5)
+		return NULL;
+
+	bar = arch_pci_conf_read(&dev->addr, PCI_BASE_ADDRESS_0 + bir * 4);
+	if (bar & PCI_BASE_ADDRESS_SPACE_IO)
+		return NULL;
+
+	paddr = bar & PCI_BASE_ADDRESS_MEM_MASK;
+	if ((bar & PCI_BASE_ADDRESS_MEM_TYPE_64) && bir < 5)
+		paddr |= (uint64_t) arch_pci_conf_read(&dev->addr,
+				PCI_BASE_ADDRESS_0 + (bir + 1) * 4) << 32;
+	paddr += table & PCI_MSIX_TABLE_OFFSET;
+
+	return (volatile uint32_t *) arch_pci_mmio_map(paddr,
+					size * PCI_MSIX_ENTRY_SIZE);
+}
+
+static inline volatile uint32_t *pci_msix_entry(volatile uint32_t *table,
+						unsigned int entry,
+						unsigned int reg)
+{
+	return &table[(entry * PCI_MSIX_ENTRY_SIZE + reg) / 4];
+}
+
+unsigned int pci_msix_table_size(struct pci_device *dev)
+{
+	uint8_t cap;
+
+	UK_ASSERT(dev);
+
+	cap = pci_find_cap(dev, PCI_CAP_ID_MSIX);
+	if (!cap)
+		return 0;
+
+	return (pci_msix_flags(dev, cap) & PCI_MSIX_FLAGS_QSIZE) + 1;
+}
+
+int pci_msix_enable(struct pci_device *dev, unsigned int *irqs,
+		    unsigned int count)
+{
+	volatile uint32_t *table;
+	unsigned int i, size;
+	uint64_t msg_addr;
+	uint32_t msg_data;
+	uint16_t flags;
+	uint8_t cap;
+	int rc;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(irqs);
+	UK_ASSERT(!dev->msix_table);
+
+	cap = pci_find_cap(dev, PCI_CAP_ID_MSIX);
+	if (!cap)
+		return -ENOTSUP;
+
+	flags = pci_msix_flags(dev, cap);
+	size = (flags & PCI_MSIX_FLAGS_QSIZE) + 1;
+	if (count > size)
+		return -ENOSPC;
+
+	table = pci_msix_map_table(dev, cap, size);
+	if (!table) {
+		uk_pr_warn("PCI %02x:%02x.%02x: MSI-X table not accessible\n",
+			   (int) dev->addr.bus, (int) dev->addr.devid,
+			   (int) dev->addr.function);
+		return -ENOTSUP;
+	}
+
+	/* Keep all vectors masked while the table is programmed */
+	flags |= PCI_MSIX_FLAGS_ENABLE | PCI_MSIX_FLAGS_MASKALL;
+	pci_msix_flags_set(dev, cap, flags);
+
+	for (i = 0; i < count; i++) {
+		rc = intctrl_msi_alloc(&irqs[i], &msg_addr, &msg_data);
+		if (rc < 0)
+			goto err_free;
+
+		*pci_msix_entry(table, i, PCI_MSIX_ENTRY_LOWER_ADDR) =
+			(uint32_t) msg_addr;
+		*pci_msix_entry(table, i, PCI_MSIX_ENTRY_UPPER_ADDR) =
+			(uint32_t) (msg_addr >> 32);
+		*pci_msix_entry(table, i, PCI_MSIX_ENTRY_DATA) = msg_data;
+		*pci_msix_entry(table, i, PCI_MSIX_ENTRY_VECTOR_CTRL) = 0;
+	}
+
+	pci_intx_disable(dev, 1);
+	flags &= ~PCI_MSIX_FLAGS_MASKALL;
+	pci_msix_flags_set(dev, cap, flags);
+	dev->msix_table = table;
+
+	uk_pr_info("PCI %02x:%02x.%02x: Enabled %u MSI-X vectors\n",
+		   (int) dev->addr.bus, (int) dev->addr.devid,
+		   (int) dev->addr.function, count);
+	return 0;
+
+err_free:
+	while (i--) {
+		*pci_msix_entry(table, i, PCI_MSIX_ENTRY_VECTOR_CTRL) =
+			PCI_MSIX_ENTRY_CTRL_MASKBIT;
+		intctrl_msi_free(irqs[i]);
+	}
+	flags &= ~(PCI_MSIX_FLAGS_ENABLE | PCI_MSIX_FLAGS_MASKALL);
+	pci_msix_flags_set(dev, cap, flags);
+	return rc;
+}
+
+void pci_msix_disable(struct pci_device *dev, unsigned int *irqs,
+		      unsigned int count)
+{
+	uint16_t flags;
+	unsigned int i;
+	uint8_t cap;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->msix_table);
+
+	cap = pci_find_cap(dev, PCI_CAP_ID_MSIX);
+	UK_ASSERT(cap);
+
+	for (i = 0; i < count; i++) {
+		*pci_msix_entry(dev->msix_table, i,
+				PCI_MSIX_ENTRY_VECTOR_CTRL) =
+			PCI_MSIX_ENTRY_CTRL_MASKBIT;
+		intctrl_msi_free(irqs[i]);
+	}
+
+	flags = pci_msix_flags(dev, cap);
+	flags &= ~(PCI_MSIX_FLAGS_ENABLE | PCI_MSIX_FLAGS_MASKALL);
+	pci_msix_flags_set(dev, cap, flags);
+	pci_intx_disable(dev, 0);
+	dev->msix_table = NULL;
+}
+#endif /* CONFIG_KVM_PCI_MSIX */
+
 static int pci_probe(void)
 {
 	return arch_pci_probe(ph.a);
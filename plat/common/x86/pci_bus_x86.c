@@ -65,6 +65,42 @@
 		*(ret) = (type) _conf_data;				\
 	} while (0)
 
+static inline uint32_t pci_conf_addr(const struct pci_address *addr,
+				     uint8_t offset)
+{
+	return (PCI_ENABLE_BIT)
+		| (addr->bus << PCI_BUS_SHIFT)
+		| (addr->devid << PCI_DEVICE_SHIFT)
+		| (addr->function << PCI_FUNCTION_SHIFT)
+		| (offset & ~0x3);
+}
+
+uint32_t arch_pci_conf_read(const struct pci_address *addr, uint8_t offset)
+{
+	outl(PCI_CONFIG_ADDR, pci_conf_addr(addr, offset));
+	return inl(PCI_CONFIG_DATA);
+}
+
+void arch_pci_conf_write(const struct pci_address *addr, uint8_t offset,
+			 uint32_t val)
+{
+	outl(PCI_CONFIG_ADDR, pci_conf_addr(addr, offset));
+	outl(PCI_CONFIG_DATA, val);
+}
+
+#if CONFIG_KVM_PCI_MSIX
+/* The boot page tables map the 32-bit PCI memory hole uncached */
+#define PCI_MMIO_HOLE_START	0xc0000000ULL
+#define PCI_MMIO_HOLE_END	0x100000000ULL
+
+volatile void *arch_pci_mmio_map(uint64_t paddr, size_t len)
+{
+	if (paddr < PCI_MMIO_HOLE_START || paddr + len > PCI_MMIO_HOLE_END)
+		return NULL;
+	return (volatile void *) paddr;
+}
+#endif
+
 static inline int pci_driver_add_device(struct pci_driver *drv,
 					struct pci_address *addr,
 					struct pci_device_id *devid)
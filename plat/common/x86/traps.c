@@ -38,6 +38,10 @@
 #include <uk/print.h>
 #include <uk/assert.h>
 #include <uk/asmdump.h>
+#if CONFIG_HAVE_PAGING
+#include <uk/event.h>
+#include <uk/plat/paging.h>
+#endif /* CONFIG_HAVE_PAGING */
 
 /* A general word of caution when writing trap handlers. The platform trap
  * entry code is set up to properly save general-purpose registers (e.g., rsi,
@@ -113,10 +117,39 @@ void do_gp_fault(struct __regs *regs, long error_code)
 	UK_CRASH("Crashing\n");
 }
 
+#if CONFIG_HAVE_PAGING
+UK_EVENT(UKPLAT_EVENT_PAGE_FAULT);
+
+static int page_fault_raise(struct __regs *regs, unsigned long addr,
+			    unsigned long error_code)
+{
+	struct ukplat_page_fault_ctx ctx = {
+		.regs = regs,
+		.addr = addr,
+		.flags = 0,
+	};
+
+	if (error_code & X86_PF_EC_P)
+		ctx.flags |= UKPLAT_PAGE_FAULT_PRESENT;
+	if (error_code & X86_PF_EC_WR)
+		ctx.flags |= UKPLAT_PAGE_FAULT_WRITE;
+	if (error_code & X86_PF_EC_ID)
+		ctx.flags |= UKPLAT_PAGE_FAULT_EXEC;
+
+	return uk_raise_event(UKPLAT_EVENT_PAGE_FAULT, &ctx);
+}
+#endif /* CONFIG_HAVE_PAGING */
+
 void do_page_fault(struct __regs *regs, unsigned long error_code)
 {
 	unsigned long addr = read_cr2();
 
+#if CONFIG_HAVE_PAGING
+	/* Give the owners of the memory a chance to resolve the fault */
+	if (page_fault_raise(regs, addr, error_code) == UK_EVENT_HANDLED)
+		return;
+#endif /* CONFIG_HAVE_PAGING */
+
 	fault_prologue();
 	uk_pr_crit("Page fault at linear address %lx, rip %lx, "
 		   "regs %p, sp %lx, our_sp %p, code %lx\n",
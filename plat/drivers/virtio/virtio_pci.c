@@ -60,8 +60,32 @@ struct virtio_pci_dev {
 	__u64 pci_isr_addr;
 	/* Pci device information */
 	struct pci_device *pdev;
+	/* Offset of the device specific configuration */
+	__u16 config_off;
+#if CONFIG_KVM_PCI_MSIX
+	/* MSI-X vectors: one for configuration changes, one per queue */
+	struct virtio_pci_msix_vec *msix_vecs;
+	unsigned int *msix_irqs;
+	__u16 msix_count;
+#endif
 };
 
+#if CONFIG_KVM_PCI_MSIX
+/* Vector index of configuration change interrupts */
+#define VPCI_MSIX_CONFIG_VEC	0
+/* Vector index of the interrupts of a queue */
+#define VPCI_MSIX_QUEUE_VEC(id)	((id) + 1)
+
+/**
+ * Argument of the interrupt handler of an MSI-X vector.
+ */
+struct virtio_pci_msix_vec {
+	struct virtio_pci_dev *vpdev;
+	/* Queue signaled by this vector, NULL if not set up */
+	struct virtqueue *vq;
+};
+#endif
+
 /**
  * Fetch the virtio pci information from the virtio device.
  * @param vdev
@@ -150,6 +174,101 @@ static int virtio_pci_handle(void *arg)
 	return rc;
 }
 
+#if CONFIG_KVM_PCI_MSIX
+static int virtio_pci_msix_config_handle(void *arg)
+{
+	struct virtio_pci_msix_vec *v = (struct virtio_pci_msix_vec *) arg;
+
+	UK_ASSERT(v);
+	uk_pr_warn("Unsupported config change interrupt received on virtio-pci device %p\n",
+		   v->vpdev);
+	return 1;
+}
+
+static int virtio_pci_msix_vq_handle(void *arg)
+{
+	struct virtio_pci_msix_vec *v = (struct virtio_pci_msix_vec *) arg;
+
+	UK_ASSERT(v);
+
+	/*
+	 * The vector belongs to this queue only: there is no ISR to read
+	 * and no other queue to check.
+	 */
+	if (likely(v->vq))
+		virtqueue_ring_interrupt(v->vq);
+	return 1;
+}
+
+/*
+ * Enable MSI-X with a vector for configuration changes and one vector for
+ * each queue. Returns a negative value if the device has to fall back to
+ * its shared INTx line.
+ */
+static int vpci_legacy_msix_setup(struct virtio_pci_dev *vpdev, __u16 num_vqs)
+{
+	unsigned int count = VPCI_MSIX_QUEUE_VEC(num_vqs);
+	unsigned int i;
+	__u16 vector;
+	int rc;
+
+	/* Vectors are kept when the queues are searched again */
+	if (vpdev->msix_vecs)
+		return (vpdev->msix_count >= count) ? 0 : -ENOSPC;
+
+	if (pci_msix_table_size(vpdev->pdev) < count)
+		return -ENOTSUP;
+
+	vpdev->msix_vecs = uk_calloc(a, count, sizeof(*vpdev->msix_vecs));
+	vpdev->msix_irqs = uk_calloc(a, count, sizeof(*vpdev->msix_irqs));
+	if (!vpdev->msix_vecs || !vpdev->msix_irqs) {
+		rc = -ENOMEM;
+		goto err_free;
+	}
+
+	rc = pci_msix_enable(vpdev->pdev, vpdev->msix_irqs, count);
+	if (rc < 0)
+		goto err_free;
+
+	for (i = 0; i < count; i++) {
+		vpdev->msix_vecs[i].vpdev = vpdev;
+		rc = ukplat_irq_register(vpdev->msix_irqs[i],
+					 (i == VPCI_MSIX_CONFIG_VEC)
+					 ? virtio_pci_msix_config_handle
+					 : virtio_pci_msix_vq_handle,
+					 &vpdev->msix_vecs[i]);
+		if (rc < 0) {
+			/* Handlers cannot be unregistered: keep MSI-X */
+			uk_pr_err("Failed to register MSI-X interrupt: %d\n",
+				  rc);
+			return rc;
+		}
+	}
+	vpdev->msix_count = count;
+
+	/* The device specific configuration moved */
+	vpdev->config_off = VIRTIO_PCI_CONFIG_OFF_MSIX;
+
+	virtio_cwrite16((void *) (unsigned long) vpdev->pci_base_addr,
+			VIRTIO_MSI_CONFIG_VECTOR, VPCI_MSIX_CONFIG_VEC);
+	vector = virtio_cread16((void *) (unsigned long) vpdev->pci_base_addr,
+				VIRTIO_MSI_CONFIG_VECTOR);
+	if (vector == VIRTIO_MSI_NO_VECTOR)
+		uk_pr_warn("Failed to assign MSI-X config vector\n");
+
+	return 0;
+
+err_free:
+	if (vpdev->msix_irqs)
+		uk_free(a, vpdev->msix_irqs);
+	if (vpdev->msix_vecs)
+		uk_free(a, vpdev->msix_vecs);
+	vpdev->msix_irqs = NULL;
+	vpdev->msix_vecs = NULL;
+	return rc;
+}
+#endif /* CONFIG_KVM_PCI_MSIX */
+
 static struct virtqueue *vpci_legacy_vq_setup(struct virtio_dev *vdev,
 					      __u16 queue_id,
 					      __u16 num_desc,
@@ -181,6 +300,21 @@ static struct virtqueue *vpci_legacy_vq_setup(struct virtio_dev *vdev,
 			VIRTIO_PCI_QUEUE_PFN,
 			addr >> VIRTIO_PCI_QUEUE_ADDR_SHIFT);
 
+#if CONFIG_KVM_PCI_MSIX
+	if (vpdev->msix_vecs) {
+		__u16 vector = VPCI_MSIX_QUEUE_VEC(queue_id);
+
+		UK_ASSERT(vector < vpdev->msix_count);
+		vpdev->msix_vecs[vector].vq = vq;
+		virtio_cwrite16((void *)(unsigned long)vpdev->pci_base_addr,
+				VIRTIO_MSI_QUEUE_VECTOR, vector);
+		if (virtio_cread16((void *)(unsigned long)vpdev->pci_base_addr,
+				   VIRTIO_MSI_QUEUE_VECTOR) != vector)
+			uk_pr_warn("Failed to assign MSI-X vector to queue %"__PRIu16"\n",
+				   queue_id);
+	}
+#endif
+
 	flags = ukplat_lcpu_save_irqf();
 	UK_TAILQ_INSERT_TAIL(&vpdev->vdev.vqs, vq, next);
 	ukplat_lcpu_restore_irqf(flags);
@@ -206,6 +340,13 @@ static void vpci_legacy_vq_release(struct virtio_dev *vdev,
 			VIRTIO_PCI_QUEUE_PFN, 0);
 
 	flags = ukplat_lcpu_save_irqf();
+#if CONFIG_KVM_PCI_MSIX
+	if (vpdev->msix_vecs) {
+		virtio_cwrite16((void *)(unsigned long)vpdev->pci_base_addr,
+				VIRTIO_MSI_QUEUE_VECTOR, VIRTIO_MSI_NO_VECTOR);
+		vpdev->msix_vecs[VPCI_MSIX_QUEUE_VEC(vq->queue_id)].vq = NULL;
+	}
+#endif
 	UK_TAILQ_REMOVE(&vpdev->vdev.vqs, vq, next);
 	ukplat_lcpu_restore_irqf(flags);
 
@@ -221,11 +362,21 @@ static int vpci_legacy_pci_vq_find(struct virtio_dev *vdev, __u16 num_vqs,
 	UK_ASSERT(vdev);
 	vpdev = to_virtiopcidev(vdev);
 
-	/* Registering the interrupt for the queue */
-	rc = ukplat_irq_register(vpdev->pdev->irq, virtio_pci_handle, vpdev);
-	if (rc != 0) {
-		uk_pr_err("Failed to register the interrupt\n");
+#if CONFIG_KVM_PCI_MSIX
+	/* Prefer a dedicated MSI-X vector for each queue */
+	rc = vpci_legacy_msix_setup(vpdev, num_vqs);
+	if (rc < 0 && vpdev->msix_vecs)
 		return rc;
+	if (rc < 0)
+#endif
+	{
+		/* Registering the interrupt for the queue */
+		rc = ukplat_irq_register(vpdev->pdev->irq, virtio_pci_handle,
+					 vpdev);
+		if (rc != 0) {
+			uk_pr_err("Failed to register the interrupt\n");
+			return rc;
+		}
 	}
 
 	for (i = 0; i < num_vqs; i++) {
@@ -252,7 +403,7 @@ static int vpci_legacy_pci_config_set(struct virtio_dev *vdev, __u16 offset,
 	vpdev = to_virtiopcidev(vdev);
 
 	_virtio_cwrite_bytes((void *)(unsigned long)vpdev->pci_base_addr,
-			     VIRTIO_PCI_CONFIG_OFF + offset, buf, len, 1);
+			     vpdev->config_off + offset, buf, len, 1);
 
 	return 0;
 }
@@ -270,12 +421,12 @@ static int vpci_legacy_pci_config_get(struct virtio_dev *vdev, __u16 offset,
 	if (type_len == len && type_len <= 4) {
 		_virtio_cread_bytes(
 				(void *) (unsigned long)vpdev->pci_base_addr,
-				VIRTIO_PCI_CONFIG_OFF + offset, buf, len,
+				vpdev->config_off + offset, buf, len,
 				type_len);
 	} else {
 		rc = virtio_cread_bytes_many(
 				(void *) (unsigned long)vpdev->pci_base_addr,
-				VIRTIO_PCI_CONFIG_OFF + offset,	buf, len);
+				vpdev->config_off + offset,	buf, len);
 		if (rc != (int)len)
 			return -EFAULT;
 	}
@@ -372,6 +523,7 @@ static int virtio_pci_legacy_add_dev(struct pci_device *pci_dev,
 	}
 
 	vpci_dev->pci_isr_addr = vpci_dev->pci_base_addr + VIRTIO_PCI_ISR;
+	vpci_dev->config_off = VIRTIO_PCI_CONFIG_OFF;
 
 	/* Setting the configuration operation */
 	vpci_dev->vdev.cops = &vpci_legacy_ops;
@@ -394,7 +546,7 @@ static int virtio_pci_add_dev(struct pci_device *pci_dev)
 
 	UK_ASSERT(pci_dev != NULL);
 
-	vpci_dev = uk_malloc(a, sizeof(*vpci_dev));
+	vpci_dev = uk_calloc(a, 1, sizeof(*vpci_dev));
 	if (!vpci_dev) {
 		uk_pr_err("Failed to allocate virtio-pci device\n");
 		return -ENOMEM;
@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PLAT_KVM_X86_LAPIC_H__
+#define __PLAT_KVM_X86_LAPIC_H__
+
+#include <uk/arch/types.h>
+
+/* Interrupt vectors of the local APIC, outside of the i8259 range */
+#define LAPIC_TIMER_VECTOR	0xef
+#define LAPIC_IPI_VECTOR	0xf0
+#define LAPIC_SPURIOUS_VECTOR	0xff
+
+/*
+ * Minimum delta to sleep using the local APIC timer. Shorter delays are
+ * spun away by the caller.
+ */
+#define LAPIC_TIMER_MIN_DELTA	1000
+
+/*
+ * Enable the local APIC, in x2APIC mode if supported and in xAPIC mode
+ * otherwise, and set up its timer, in TSC-deadline mode if supported and in
+ * one-shot mode otherwise.
+ * Must be called after tscclock_init().
+ *
+ * Returns 0 on success, -ENOTSUP if there is no usable local APIC.
+ */
+int lapic_timer_init(void);
+
+/* Returns non-zero if the local APIC was enabled by lapic_timer_init(). */
+int lapic_enabled(void);
+
+/* Returns the APIC ID of the current CPU, the local APIC must be enabled. */
+__u32 lapic_id(void);
+
+/* Signal the end of an interrupt delivered through the local APIC. */
+void lapic_eoi(void);
+
+/* Returns non-zero if lapic_timer_init() succeeded. */
+int lapic_timer_available(void);
+
+/*
+ * Program the local APIC timer to interrupt the CPU after delta_ns
+ * nanoseconds. Longer delays are cut short; the interrupt only wakes up
+ * the CPU, so the caller has to re-arm the timer.
+ */
+void lapic_timer_arm(__u64 delta_ns);
+
+/*
+ * Enable the local APIC and its timer on a secondary CPU, in the modes
+ * picked by lapic_timer_init() on the boot CPU.
+ */
+int lapic_lcpu_init(void);
+
+/* Send LAPIC_IPI_VECTOR style fixed interrupts to other CPUs. */
+void lapic_ipi_send(__u32 apic_id, __u8 vector);
+void lapic_ipi_send_allbutself(__u8 vector);
+
+/*
+ * INIT and STARTUP IPIs to bring up a secondary CPU. The CPU starts in real
+ * mode at physical address page << 12.
+ */
+void lapic_ipi_init(__u32 apic_id);
+void lapic_ipi_startup(__u32 apic_id, __u8 page);
+
+#endif /* __PLAT_KVM_X86_LAPIC_H__ */
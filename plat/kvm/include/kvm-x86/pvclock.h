@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PLAT_KVM_X86_PVCLOCK_H__
+#define __PLAT_KVM_X86_PVCLOCK_H__
+
+#include <uk/arch/types.h>
+
+/*
+ * Register the kvmclock time information of the boot CPU with the
+ * hypervisor, if it advertises kvmclock.
+ *
+ * Returns 0 on success, -ENOTSUP if kvmclock is not available.
+ */
+int pvclock_init(void);
+
+/*
+ * Register the kvmclock time information of a secondary CPU. Does nothing
+ * if pvclock_init() did not succeed.
+ */
+void pvclock_lcpu_init(void);
+
+/* Returns non-zero if pvclock_init() succeeded. */
+int pvclock_enabled(void);
+
+/* Returns nanoseconds since pvclock_init(), read from kvmclock. */
+__u64 pvclock_monotonic(void);
+
+/* Returns the current wall clock time in nanoseconds since the epoch. */
+__u64 pvclock_wall_clock(void);
+
+/* Returns the TSC frequency in Hz that kvmclock scales the TSC with. */
+__u64 pvclock_tsc_frequency(void);
+
+/*
+ * Returns non-zero if the hypervisor guarantees that the TSC is
+ * synchronized across CPUs and runs at a constant rate, so that it can
+ * be read directly instead of kvmclock.
+ */
+int pvclock_tsc_stable(void);
+
+#endif /* __PLAT_KVM_X86_PVCLOCK_H__ */
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PLAT_KVM_X86_SMP_H__
+#define __PLAT_KVM_X86_SMP_H__
+
+/*
+ * Physical address the real mode startup code of the secondary CPUs is
+ * copied to. It has to be page aligned and below 1MB.
+ */
+#define LCPU_START16_ADDR	0x8000
+
+/* Offsets in struct lcpu, for use in assembly code */
+#define LCPU_SELF_OFFSET	0x00
+#define LCPU_ID_OFFSET		0x08 /* UKPLAT_LCPU_ID_OFFSET */
+#define LCPU_SP_OFFSET		0x10
+
+#ifndef __ASSEMBLY__
+#include <uk/arch/lcpu.h>
+#include <uk/arch/spinlock.h>
+#include <uk/plat/lcpu.h>
+#include <uk/essentials.h>
+
+#define LCPU_STATE_OFFLINE	0 /* not started, or failed to start */
+#define LCPU_STATE_INIT		1 /* running its initialization */
+#define LCPU_STATE_IDLE		2 /* halted in the platform idle loop */
+#define LCPU_STATE_BUSY		3 /* running an entry or a queued function */
+
+/* Maximum number of functions queued by ukplat_lcpu_run() per CPU */
+#define LCPU_FUNC_QUEUE_LEN	16
+
+/*
+ * Per-CPU data. The GS base of each CPU points to its own struct lcpu, so
+ * the current CPU is found with a single memory access.
+ */
+struct lcpu {
+	struct lcpu *self;
+	__lcpuid id;
+	__u32 apic_id;
+	/* Initial stack, entry function and TLS pointer of the CPU */
+	void *sp;
+	ukplat_lcpu_entry_t entry;
+	__uptr tlsp;
+	/* Tops of the interrupt stacks (IST1-IST3) */
+	void *intr_sp;
+	void *trap_sp;
+	void *nmi_sp;
+
+	volatile int state;
+
+	/* Functions queued by ukplat_lcpu_run(), run from the IPI handler */
+	__spinlock fn_lock;
+	unsigned int fn_head;
+	unsigned int fn_tail;
+	struct ukplat_lcpu_func *fn_queue[LCPU_FUNC_QUEUE_LEN];
+} __align(CACHE_LINE_SIZE);
+
+UK_CTASSERT(__offsetof(struct lcpu, self) == LCPU_SELF_OFFSET);
+UK_CTASSERT(__offsetof(struct lcpu, id) == LCPU_ID_OFFSET);
+UK_CTASSERT(LCPU_ID_OFFSET == UKPLAT_LCPU_ID_OFFSET);
+UK_CTASSERT(__offsetof(struct lcpu, sp) == LCPU_SP_OFFSET);
+
+static inline struct lcpu *lcpu_get_current(void)
+{
+	struct lcpu *this;
+
+	__asm__ __volatile__("movq %%gs:%c1, %0"
+			     : "=r" (this) : "i" (LCPU_SELF_OFFSET));
+	return this;
+}
+
+/*
+ * Set up the per-CPU data of the boot CPU. Must be called before anything
+ * else that depends on the current CPU.
+ */
+void lcpu_init(void);
+
+/*
+ * Discover the secondary CPUs from the ACPI MADT. Must be called after
+ * acpi_init(). Without MADT only the boot CPU is used.
+ */
+int lcpu_mp_init(void);
+
+/* Handler of LAPIC_IPI_VECTOR, called from the interrupt vector. */
+void lcpu_ipi_handle(struct __regs *regs);
+
+/*
+ * Load the descriptor tables of a secondary CPU, with its own TSS and
+ * interrupt stacks.
+ */
+void traps_lcpu_init(unsigned int lcpuidx, void *intr_sp, void *trap_sp,
+		     void *nmi_sp);
+
+#endif /* !__ASSEMBLY__ */
+#endif /* __PLAT_KVM_X86_SMP_H__ */
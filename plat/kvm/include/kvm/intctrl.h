@@ -30,7 +30,21 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <uk/config.h>
+#include <uk/arch/types.h>
+
 void intctrl_init(void);
 void intctrl_clear_irq(unsigned int irq);
 void intctrl_mask_irq(unsigned int irq);
 void intctrl_ack_irq(unsigned int irq);
+
+#if CONFIG_KVM_PCI_MSIX
+/*
+ * Allocate an IRQ that is raised by a message signaled interrupt. The
+ * message address and data to be programmed into the device are returned.
+ * Returns 0 on success, -ENOTSUP if MSIs are not available and -ENOSPC
+ * if there is no free IRQ.
+ */
+int intctrl_msi_alloc(unsigned int *irq, __u64 *msg_addr, __u32 *msg_data);
+void intctrl_msi_free(unsigned int irq);
+#endif
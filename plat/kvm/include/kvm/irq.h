@@ -38,4 +38,10 @@
 
 void _ukplat_irq_handle(unsigned long irq);
 
+/*
+ * Calls the handlers registered for an IRQ without acknowledging it at the
+ * interrupt controller. Returns 1 if a handler took care of it, 0 otherwise.
+ */
+int _ukplat_irq_dispatch(unsigned long irq);
+
 #endif /* __KVM_IRQ_H_ */
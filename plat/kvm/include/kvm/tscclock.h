@@ -34,7 +34,9 @@
 #define __KVM_TSCCLOCK_H__
 
 int tscclock_init(void);
+void tscclock_lcpu_init(void);
 __u64 tscclock_monotonic(void);
+__u64 tscclock_frequency(void);
 __u64 tscclock_epochoffset(void);
 
 #endif /* __KVM_TSCCLOCK_H__ */
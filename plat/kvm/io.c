@@ -30,14 +30,42 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <uk/config.h>
 #include <uk/plat/io.h>
+#if CONFIG_KVM_PAGING
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/plat/paging.h>
+#include <kvm-x86/paging.h>
+#endif /* CONFIG_KVM_PAGING */
 
 /**
  * TODO:
  * For our kvm platform, the guest virtual address == guest physical address.
  * We may have to reconsider this implementation when condition changes.
+ *
+ * The exception are the ranges behind the direct map, e.g., lazily committed
+ * thread stacks, whose pages are looked up in the page tables. Buffers there
+ * are only physically contiguous within a page, so DMA must be set up page
+ * by page (e.g., with uk_sglist).
  */
 __phys_addr ukplat_virt_to_phys(const volatile void *address)
 {
+#if CONFIG_KVM_PAGING
+	__phys_addr paddr;
+
+	if (likely((__uptr) address < PAGING_DIRECT_MAP_END))
+		return (__phys_addr)address;
+
+	if (ukplat_page_lookup((const void *)address, &paddr) < 0) {
+		/* Commit pages that are mapped on first access */
+		(void) *(const volatile char *)address;
+		if (unlikely(ukplat_page_lookup((const void *)address,
+						&paddr) < 0))
+			UK_CRASH("No physical address for %p\n", address);
+	}
+	return paddr;
+#else /* CONFIG_KVM_PAGING */
 	return (__phys_addr)address;
+#endif /* CONFIG_KVM_PAGING */
 }
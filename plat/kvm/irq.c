@@ -29,14 +29,12 @@
 #include <uk/alloc.h>
 #include <uk/list.h>
 #include <uk/plat/lcpu.h>
-#include <uk/plat/time.h>
 #include <uk/plat/common/cpu.h>
 #include <uk/plat/common/irq.h>
 #include <kvm/irq.h>
 #include <kvm/intctrl.h>
 #include <uk/assert.h>
 #include <errno.h>
-#include <uk/bitops.h>
 
 static struct uk_alloc *allocator;
 
@@ -73,42 +71,32 @@ int ukplat_irq_register(unsigned long irq, irq_handler_func_t func, void *arg)
 	return 0;
 }
 
-/*
- * TODO: This is a temporary solution used to identify non TSC clock
- * interrupts in order to stop waiting for interrupts with deadline.
- */
-extern unsigned long sched_have_pending_events;
-
-void _ukplat_irq_handle(unsigned long irq)
+int _ukplat_irq_dispatch(unsigned long irq)
 {
 	struct irq_handler *h;
 
 	UK_SLIST_FOREACH(h, &irq_handlers[irq], entries) {
-		if (irq != ukplat_time_get_irq())
-			/* ukplat_time_get_irq() gives the IRQ reserved for a timer,
-			 * responsible to wake up cpu from halt, so it can check if
-			 * it has something to do. Effectively it is OS ticks.
-			 *
-			 * If interrupt comes not from the timer, the
-			 * chances are some work have just
-			 * arrived. Let's kick the scheduler out of
-			 * the halting loop, and let it take care of
-			 * that work.
-			 */
-			__uk_test_and_set_bit(0, &sched_have_pending_events);
-
 		if (h->func(h->arg) == 1)
-			goto exit_ack;
+			return 1;
 	}
+	return 0;
+}
+
+void _ukplat_irq_handle(unsigned long irq)
+{
+	/*
+	 * Returning from the interrupt ends a halt of the CPU, so the
+	 * scheduler checks for work that the handlers have produced.
+	 */
+	if (!_ukplat_irq_dispatch(irq))
+		uk_pr_crit("Unhandled irq=%lu\n", irq);
+
 	/*
 	 * Acknowledge interrupts even in the case when there was no handler for
 	 * it. We do this to (1) compensate potential spurious interrupts of
 	 * devices, and (2) to minimize impact on drivers that share one
 	 * interrupt line that would then stay disabled.
 	 */
-	uk_pr_crit("Unhandled irq=%lu\n", irq);
-
-exit_ack:
 	intctrl_ack_irq(irq);
 }
 
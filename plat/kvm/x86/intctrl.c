@@ -23,8 +23,14 @@
 /* Taken from solo5 platform_intr.c */
 
 #include <stdint.h>
+#include <errno.h>
 #include <x86/cpu.h>
+#include <x86/irq.h>
 #include <kvm/intctrl.h>
+#if CONFIG_KVM_PCI_MSIX
+#include <uk/plat/lcpu.h>
+#include <kvm-x86/lapic.h>
+#endif
 
 #define PIC1             0x20    /* IO base address for master PIC */
 #define PIC2             0xA0    /* IO base address for slave PIC */
@@ -88,6 +94,12 @@ void intctrl_init(void)
 
 void intctrl_ack_irq(unsigned int irq)
 {
+#if CONFIG_KVM_PCI_MSIX
+	if (irq >= __MAX_LEGACY_IRQ) {
+		lapic_eoi();
+		return;
+	}
+#endif
 	if (!IRQ_ON_MASTER(irq))
 		outb(PIC2_COMMAND, PIC_EOI);
 
@@ -98,6 +110,10 @@ void intctrl_mask_irq(unsigned int irq)
 {
 	__u16 port;
 
+	/* MSIs are masked at the device */
+	if (irq >= __MAX_LEGACY_IRQ)
+		return;
+
 	port = IRQ_PORT(irq);
 	outb(port, inb(port) | (1 << IRQ_OFFSET(irq)));
 }
@@ -106,6 +122,56 @@ void intctrl_clear_irq(unsigned int irq)
 {
 	__u16 port;
 
+	if (irq >= __MAX_LEGACY_IRQ)
+		return;
+
 	port = IRQ_PORT(irq);
 	outb(port, inb(port) & ~(1 << IRQ_OFFSET(irq)));
 }
+
+#if CONFIG_KVM_PCI_MSIX
+/* MSI destination address, local APIC ID in bits 12-19 */
+#define MSI_ADDR_BASE		0xfee00000
+#define MSI_ADDR_DEST_SHIFT	12
+
+/* Allocated MSI IRQs, bit n corresponds to IRQ __MAX_LEGACY_IRQ + n */
+static __u32 msi_irqs;
+
+int intctrl_msi_alloc(unsigned int *irq, __u64 *msg_addr, __u32 *msg_data)
+{
+	unsigned long flags;
+	unsigned int n;
+
+	if (!lapic_enabled())
+		return -ENOTSUP;
+
+	flags = ukplat_lcpu_save_irqf();
+	for (n = 0; n < __MAX_IRQ - __MAX_LEGACY_IRQ; n++) {
+		if (!(msi_irqs & (1U << n))) {
+			msi_irqs |= (1U << n);
+			break;
+		}
+	}
+	ukplat_lcpu_restore_irqf(flags);
+
+	if (n == __MAX_IRQ - __MAX_LEGACY_IRQ)
+		return -ENOSPC;
+
+	*irq = __MAX_LEGACY_IRQ + n;
+	/* Fixed delivery, edge triggered, vectors are 32 + IRQ like i8259 */
+	*msg_addr = MSI_ADDR_BASE | (lapic_id() << MSI_ADDR_DEST_SHIFT);
+	*msg_data = 32 + *irq;
+	return 0;
+}
+
+void intctrl_msi_free(unsigned int irq)
+{
+	unsigned long flags;
+
+	UK_ASSERT(irq >= __MAX_LEGACY_IRQ && irq < __MAX_IRQ);
+
+	flags = ukplat_lcpu_save_irqf();
+	msi_irqs &= ~(1U << (irq - __MAX_LEGACY_IRQ));
+	ukplat_lcpu_restore_irqf(flags);
+}
+#endif
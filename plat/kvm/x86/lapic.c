@@ -0,0 +1,368 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <uk/arch/time.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <x86/cpu.h>
+#include <kvm/irq.h>
+#include <kvm/tscclock.h>
+#include <kvm-x86/lapic.h>
+
+/* Local APIC registers (xAPIC MMIO offsets) */
+#define APIC_ID			0x020
+#define APIC_TPR		0x080
+#define APIC_EOI		0x0b0
+#define APIC_SVR		0x0f0
+#define APIC_ICR		0x300
+#define APIC_ICR_HI		0x310
+#define APIC_LVT_TIMER		0x320
+#define APIC_LVT_LINT0		0x350
+#define APIC_LVT_LINT1		0x360
+#define APIC_TIMER_ICR		0x380
+#define APIC_TIMER_CCR		0x390
+#define APIC_TIMER_DCR		0x3e0
+
+#define APIC_SVR_ENABLE		(1 << 8)
+#define APIC_LVT_DM_NMI		(0x4 << 8)
+#define APIC_LVT_DM_EXTINT	(0x7 << 8)
+#define APIC_LVT_MASKED		(1 << 16)
+#define APIC_LVT_TIMER_ONESHOT	(0x0 << 17)
+#define APIC_LVT_TIMER_TSCDL	(0x2 << 17)
+#define APIC_TIMER_DIV_1	0xb
+
+#define APIC_ICR_DM_FIXED	(0x0 << 8)
+#define APIC_ICR_DM_INIT	(0x5 << 8)
+#define APIC_ICR_DM_STARTUP	(0x6 << 8)
+#define APIC_ICR_BUSY		(1 << 12)
+#define APIC_ICR_ASSERT		(1 << 14)
+#define APIC_ICR_ALLBUTSELF	(0x3 << 18)
+#define APIC_ICR_XAPIC_DEST_SHIFT 24
+
+/*
+ * The xAPIC registers are only reachable through the 3GB-4GB range that
+ * the boot page tables map uncached.
+ */
+#define XAPIC_MMIO_START	0xc0000000UL
+#define XAPIC_MMIO_END		0x100000000UL
+
+/* Duration of the APIC timer calibration against the TSC */
+#define APIC_CALIBRATE_MS	10
+
+/* Cap for a single timer programming, ~18 minutes */
+#define LAPIC_TIMER_MAX_DELTA	(1ULL << 40)
+
+enum lapic_timer_mode {
+	LAPIC_TIMER_NONE = 0,
+	LAPIC_TIMER_ONESHOT,
+	LAPIC_TIMER_TSC_DEADLINE,
+};
+
+static enum lapic_timer_mode timer_mode = LAPIC_TIMER_NONE;
+
+/* Set when the local APIC was enabled, in x2APIC or xAPIC mode */
+static int lapic_on;
+
+/*
+ * Set when the local APIC was switched to x2APIC mode. Otherwise, the
+ * registers are accessed through the xAPIC MMIO window at xapic_base.
+ */
+static int x2apic_on;
+static __uptr xapic_base;
+
+/* Multiplier for converting nsecs to timer ticks. (32.32) fixed point. */
+static __u64 timer_mult;
+
+static inline __u32 lapic_read(unsigned int reg)
+{
+	if (x2apic_on)
+		return (__u32) rdmsrl(X86_MSR_X2APIC_BASE + (reg >> 4));
+
+	return *((volatile __u32 *) (xapic_base + reg));
+}
+
+static inline void lapic_write(unsigned int reg, __u32 val)
+{
+	if (x2apic_on)
+		wrmsr(X86_MSR_X2APIC_BASE + (reg >> 4), val, 0);
+	else
+		*((volatile __u32 *) (xapic_base + reg)) = val;
+}
+
+static inline __u64 ns_to_ticks(__u64 ns)
+{
+	return (__u64) (((unsigned __int128) ns * timer_mult) >> 32);
+}
+
+int lapic_enabled(void)
+{
+	return lapic_on;
+}
+
+__u32 lapic_id(void)
+{
+	UK_ASSERT(lapic_on);
+
+	if (x2apic_on)
+		return lapic_read(APIC_ID);
+	return lapic_read(APIC_ID) >> APIC_ICR_XAPIC_DEST_SHIFT;
+}
+
+void lapic_eoi(void)
+{
+	UK_ASSERT(lapic_on);
+
+	lapic_write(APIC_EOI, 0);
+}
+
+/*
+ * Called from the interrupt vector of the timer. The local APIC timer
+ * replaces the i8254, so the handlers of its IRQ are called.
+ */
+void lapic_timer_irq_handle(void)
+{
+	lapic_write(APIC_EOI, 0);
+	_ukplat_irq_dispatch(ukplat_time_get_irq());
+}
+
+/*
+ * Enable the local APIC of the current CPU, in x2APIC mode if supported.
+ * Only the boot CPU keeps the i8259 connected through LINT0 (virtual wire
+ * mode), the device interrupts are still delivered by it.
+ */
+static int lapic_enable(int extint)
+{
+	__u32 eax, ebx, ecx, edx;
+	__u64 base;
+
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(edx & X86_CPUID1_EDX_APIC))
+		return -ENOTSUP;
+
+	base = rdmsrl(X86_MSR_APIC_BASE);
+	if (!(base & X86_APIC_BASE_EN)) {
+		base |= X86_APIC_BASE_EN;
+		wrmsrl(X86_MSR_APIC_BASE, base);
+	}
+
+	if (ecx & X86_CPUID1_ECX_X2APIC) {
+		/* x2APIC mode can only be entered from enabled xAPIC mode */
+		wrmsrl(X86_MSR_APIC_BASE, base | X86_APIC_BASE_EXTD);
+		x2apic_on = 1;
+	} else {
+		xapic_base = base & ~0xfffUL;
+		if (xapic_base < XAPIC_MMIO_START
+		    || xapic_base >= XAPIC_MMIO_END)
+			return -ENOTSUP;
+	}
+
+	lapic_write(APIC_LVT_LINT0,
+		    extint ? APIC_LVT_DM_EXTINT : APIC_LVT_MASKED);
+	lapic_write(APIC_LVT_LINT1, APIC_LVT_DM_NMI);
+	lapic_write(APIC_TPR, 0);
+	lapic_write(APIC_SVR, APIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+	lapic_on = 1;
+	return 0;
+}
+
+/*
+ * Returns the frequency of the APIC timer at divider 1, taken from the
+ * hypervisor timing information leaf if available and measured against
+ * the TSC otherwise.
+ */
+static __u64 lapic_timer_frequency(__u64 tsc_freq)
+{
+	__u32 eax, ebx, ecx, edx;
+	__u64 tsc_start;
+	__u32 ticks;
+
+	cpuid(0x40000000, 0, &eax, &ebx, &ecx, &edx);
+	if (eax >= 0x40000010) {
+		cpuid(0x40000010, 0, &eax, &ebx, &ecx, &edx);
+		if (ebx)
+			return (__u64) ebx * 1000;
+	}
+
+	lapic_write(APIC_TIMER_DCR, APIC_TIMER_DIV_1);
+	lapic_write(APIC_LVT_TIMER, APIC_LVT_MASKED | LAPIC_TIMER_VECTOR);
+
+	tsc_start = rdtsc();
+	lapic_write(APIC_TIMER_ICR, 0xffffffff);
+	while (rdtsc() - tsc_start < tsc_freq * APIC_CALIBRATE_MS / 1000)
+		;
+	ticks = 0xffffffff - lapic_read(APIC_TIMER_CCR);
+	lapic_write(APIC_TIMER_ICR, 0);
+
+	return (__u64) ticks * 1000 / APIC_CALIBRATE_MS;
+}
+
+/* Program the timer of the current CPU for the selected timer mode */
+static void lapic_timer_setup(void)
+{
+	if (timer_mode == LAPIC_TIMER_TSC_DEADLINE) {
+		lapic_write(APIC_LVT_TIMER,
+			    APIC_LVT_TIMER_TSCDL | LAPIC_TIMER_VECTOR);
+	} else if (timer_mode == LAPIC_TIMER_ONESHOT) {
+		lapic_write(APIC_TIMER_DCR, APIC_TIMER_DIV_1);
+		lapic_write(APIC_LVT_TIMER,
+			    APIC_LVT_TIMER_ONESHOT | LAPIC_TIMER_VECTOR);
+	}
+}
+
+int lapic_timer_init(void)
+{
+	__u32 eax, ebx, ecx, edx;
+	__u64 tsc_freq, freq;
+
+	if (lapic_enable(1) < 0) {
+		uk_pr_info("No local APIC, using i8254 for timer interrupts\n");
+		return -ENOTSUP;
+	}
+	uk_pr_info("Local APIC in %s mode\n", x2apic_on ? "x2APIC" : "xAPIC");
+
+	tsc_freq = tscclock_frequency();
+	UK_ASSERT(tsc_freq);
+
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (ecx & X86_CPUID1_ECX_TSC_DEADLINE) {
+		freq = tsc_freq;
+		timer_mode = LAPIC_TIMER_TSC_DEADLINE;
+		uk_pr_info("Timer: local APIC in TSC-deadline mode\n");
+	} else {
+		freq = lapic_timer_frequency(tsc_freq);
+		if (unlikely(!freq)) {
+			uk_pr_warn("Failed to calibrate local APIC timer, using i8254 for timer interrupts\n");
+			return -ENOTSUP;
+		}
+		timer_mode = LAPIC_TIMER_ONESHOT;
+		uk_pr_info("Timer: local APIC in one-shot mode, frequency %llu Hz\n",
+			   (unsigned long long) freq);
+	}
+	lapic_timer_setup();
+
+	/*
+	 * (32.32) timer_mult = freq (32.32) / UKARCH_NSEC_PER_SEC (32.0),
+	 * split up to not overflow with frequencies above 4 GHz.
+	 */
+	timer_mult = ((freq / UKARCH_NSEC_PER_SEC) << 32)
+		     + ((freq % UKARCH_NSEC_PER_SEC) << 32) / UKARCH_NSEC_PER_SEC;
+	return 0;
+}
+
+int lapic_timer_available(void)
+{
+	return timer_mode != LAPIC_TIMER_NONE;
+}
+
+void lapic_timer_arm(__u64 delta_ns)
+{
+	__u64 ticks;
+
+	UK_ASSERT(lapic_timer_available());
+
+	ticks = ns_to_ticks(MIN(delta_ns, LAPIC_TIMER_MAX_DELTA));
+	if (!ticks)
+		ticks = 1;
+
+	if (timer_mode == LAPIC_TIMER_TSC_DEADLINE)
+		wrmsrl(X86_MSR_TSC_DEADLINE, rdtsc() + ticks);
+	else
+		lapic_write(APIC_TIMER_ICR, (__u32) MIN(ticks, 0xffffffffULL));
+}
+
+#if CONFIG_HAVE_SMP
+int lapic_lcpu_init(void)
+{
+	int rc;
+
+	/* Secondary CPUs use the mode that the boot CPU picked */
+	UK_ASSERT(lapic_on);
+
+	rc = lapic_enable(0);
+	if (unlikely(rc < 0))
+		return rc;
+
+	lapic_timer_setup();
+	return 0;
+}
+
+/*
+ * Write the interrupt command register. In xAPIC mode, the destination is
+ * in a separate register and the previous IPI has to be sent before.
+ */
+static void lapic_icr_write(__u32 apic_id, __u32 icr)
+{
+	unsigned long flags;
+
+	UK_ASSERT(lapic_on);
+
+	if (x2apic_on) {
+		/*
+		 * x2APIC MSR writes are not serializing, make our stores
+		 * visible to the destination first.
+		 */
+		mb();
+		wrmsr(X86_MSR_X2APIC_BASE + (APIC_ICR >> 4), icr, apic_id);
+		return;
+	}
+
+	flags = ukplat_lcpu_save_irqf();
+	while (lapic_read(APIC_ICR) & APIC_ICR_BUSY)
+		ukarch_spinwait();
+	lapic_write(APIC_ICR_HI, apic_id << APIC_ICR_XAPIC_DEST_SHIFT);
+	lapic_write(APIC_ICR, icr);
+	ukplat_lcpu_restore_irqf(flags);
+}
+
+void lapic_ipi_send(__u32 apic_id, __u8 vector)
+{
+	lapic_icr_write(apic_id, APIC_ICR_DM_FIXED | APIC_ICR_ASSERT | vector);
+}
+
+void lapic_ipi_send_allbutself(__u8 vector)
+{
+	lapic_icr_write(0, APIC_ICR_ALLBUTSELF | APIC_ICR_DM_FIXED
+			   | APIC_ICR_ASSERT | vector);
+}
+
+void lapic_ipi_init(__u32 apic_id)
+{
+	lapic_icr_write(apic_id, APIC_ICR_DM_INIT | APIC_ICR_ASSERT);
+}
+
+void lapic_ipi_startup(__u32 apic_id, __u8 page)
+{
+	lapic_icr_write(apic_id, APIC_ICR_DM_STARTUP | APIC_ICR_ASSERT | page);
+}
+#endif /* CONFIG_HAVE_SMP */
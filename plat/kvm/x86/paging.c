@@ -0,0 +1,590 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Runtime page tables: at boot, the static tables of pagetable.S are replaced
+ * by a direct map of guest memory that uses the largest available page size.
+ * Afterwards, the tables are changed through ukplat_page_*(). Large pages are
+ * split into smaller ones when only a part of them is remapped, unmapped or
+ * protected.
+ */
+#include <errno.h>
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/arch/atomic.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/spinlock.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/memory.h>
+#include <uk/plat/paging.h>
+#include <uk/plat/spinlock.h>
+#include <x86/cpu.h>
+#include <kvm/config.h>
+#include <kvm-x86/paging.h>
+
+#define PTE_PRESENT		0x001UL
+#define PTE_RW			0x002UL
+#define PTE_PWT			0x008UL
+#define PTE_PCD			0x010UL
+#define PTE_PSE			0x080UL
+/* Ignored by the MMU: the table is kept when its range is unmapped */
+#define PTE_KEEP		0x200UL
+#define PTE_NX			(1UL << 63)
+#define PTE_ADDR_MASK		0x000ffffffffff000UL
+
+/* Table entries grant all access rights, the leaf entries restrict them */
+#define PTE_TABLE		(PTE_PRESENT | PTE_RW)
+
+#define PT_ENTRIES		512
+#define PT_LEVELS		4
+#define PT_LEVEL_SHIFT(lvl)	(__PAGE_SHIFT + 9 * (lvl))
+#define PT_LEVEL_SIZE(lvl)	(1UL << PT_LEVEL_SHIFT(lvl))
+#define PT_INDEX(va, lvl)	(((va) >> PT_LEVEL_SHIFT(lvl)) & (PT_ENTRIES - 1))
+
+/* We only manage the lower half of the 48-bit virtual address space */
+#define PT_VADDR_END		(1UL << 47)
+
+/* Ranges up to this number of pages are flushed from the TLB one by one */
+#define PT_FLUSH_PAGES_MAX	32
+
+/* 32-bit PCI hole with the xAPIC registers and the MSI-X tables */
+#define PT_MMIO_START		0xc0000000UL
+#define PT_MMIO_END		0x100000000UL
+
+enum pt_op {
+	PT_OP_MAP,
+	PT_OP_UNMAP,
+	PT_OP_SET_ATTR,
+	PT_OP_PREPARE,
+};
+
+struct pt_walk {
+	enum pt_op op;
+	/* Physical address that is mapped next (PT_OP_MAP) */
+	__phys_addr paddr;
+	/* Attribute bits of the leaf entries (PT_OP_MAP, PT_OP_SET_ATTR) */
+	__u64 attr;
+	/* Set if present entries were changed and the TLBs must be flushed */
+	int flush;
+	/* Tables that are freed once the TLBs have been flushed */
+	__u64 *released;
+};
+
+static __u64 *pt_root;
+/* Highest level with leaf entries: 1 for 2 MiB pages, 2 for 1 GiB pages */
+static unsigned int pt_leaf_max = 1;
+static __u64 pt_nx;
+static __spinlock pt_lock;
+/* Virtual addresses behind the direct map for ukplat_page_vaddr_alloc() */
+static __uptr pt_vaddr_next = PAGING_DIRECT_MAP_END;
+/* Free page-table pages, linked through their first entry */
+static __u64 *pt_free_list;
+
+static inline __u64 *pte_to_pt(__u64 pte)
+{
+	return (__u64 *) (pte & PTE_ADDR_MASK);
+}
+
+static __u64 pt_attr(unsigned long attr)
+{
+	__u64 pte = PTE_PRESENT;
+
+	if (attr & UKPLAT_PAGE_ATTR_PROT_WRITE)
+		pte |= PTE_RW;
+	if (!(attr & UKPLAT_PAGE_ATTR_PROT_EXEC))
+		pte |= pt_nx;
+	if (attr & UKPLAT_PAGE_ATTR_NOCACHE)
+		pte |= PTE_PCD | PTE_PWT;
+
+	return pte;
+}
+
+/* Called with pt_lock held. The tables are identity-mapped. */
+static __u64 *pt_alloc(void)
+{
+	struct uk_alloc *a;
+	__u64 *pt;
+
+	if (pt_free_list) {
+		pt = pt_free_list;
+		pt_free_list = (__u64 *) pt[0];
+	} else if ((a = ukplat_memallocator_get())) {
+		pt = uk_palloc(a, 1);
+		if (unlikely(!pt))
+			return NULL;
+	} else {
+		/*
+		 * There is no memory allocator yet during boot: take the
+		 * page from the beginning of the heap region.
+		 */
+		if (unlikely(_libkvmplat_cfg.heap.len < __PAGE_SIZE))
+			return NULL;
+		pt = (__u64 *) _libkvmplat_cfg.heap.start;
+		_libkvmplat_cfg.heap.start += __PAGE_SIZE;
+		_libkvmplat_cfg.heap.len   -= __PAGE_SIZE;
+	}
+
+	memset(pt, 0, __PAGE_SIZE);
+	return pt;
+}
+
+/*
+ * Releases a table and all tables below it. Other CPUs may still walk the
+ * tables through their paging-structure caches, so the pages are only
+ * returned to the free list after the TLB shootdown.
+ */
+static void pt_release(struct pt_walk *w, __u64 *pt, unsigned int lvl)
+{
+	unsigned int i;
+
+	if (lvl > 0) {
+		for (i = 0; i < PT_ENTRIES; i++) {
+			if ((pt[i] & PTE_PRESENT) && !(pt[i] & PTE_PSE))
+				pt_release(w, pte_to_pt(pt[i]), lvl - 1);
+		}
+	}
+
+	pt[0] = (__u64) w->released;
+	w->released = pt;
+}
+
+/* Replaces a large page with a table of pages of the next smaller size */
+static int pt_split(__u64 *pte, unsigned int lvl)
+{
+	__u64 *pt;
+	__u64 paddr, attr;
+	unsigned int i;
+
+	UK_ASSERT(lvl > 0 && (*pte & PTE_PSE));
+
+	pt = pt_alloc();
+	if (unlikely(!pt))
+		return -ENOMEM;
+
+	paddr = *pte & PTE_ADDR_MASK & ~(PT_LEVEL_SIZE(lvl) - 1);
+	attr = *pte & ~PTE_ADDR_MASK;
+	if (lvl == 1)
+		attr &= ~PTE_PSE;
+
+	for (i = 0; i < PT_ENTRIES; i++)
+		pt[i] = (paddr + i * PT_LEVEL_SIZE(lvl - 1)) | attr;
+
+	*pte = (__u64) pt | PTE_TABLE;
+	return 0;
+}
+
+static int pt_walk(struct pt_walk *w, __u64 *pt, unsigned int lvl,
+		   __uptr va, __sz len)
+{
+	__sz size = PT_LEVEL_SIZE(lvl);
+	__sz chunk;
+	__u64 *pte, *child;
+	int whole, leaf, rc;
+
+	for (; len; va += chunk, len -= chunk) {
+		pte = &pt[PT_INDEX(va, lvl)];
+		chunk = MIN(size - (va & (size - 1)), len);
+		whole = (chunk == size);
+		leaf = (lvl == 0 || (*pte & PTE_PSE));
+
+		switch (w->op) {
+		case PT_OP_MAP:
+			if (whole && lvl <= pt_leaf_max
+			    && !(w->paddr & (size - 1))
+			    && !(*pte & PTE_KEEP)) {
+				if (*pte & PTE_PRESENT) {
+					if (!leaf)
+						pt_release(w, pte_to_pt(*pte),
+							   lvl - 1);
+					w->flush = 1;
+				}
+				*pte = w->paddr | w->attr | (lvl ? PTE_PSE : 0);
+				w->paddr += chunk;
+				continue;
+			}
+			if (!(*pte & PTE_PRESENT)) {
+				child = pt_alloc();
+				if (unlikely(!child))
+					return -ENOMEM;
+				*pte = (__u64) child | PTE_TABLE;
+				leaf = 0;
+			}
+			break;
+		case PT_OP_UNMAP:
+			if (!(*pte & PTE_PRESENT))
+				continue;
+			if (whole && (leaf || !(*pte & PTE_KEEP))) {
+				if (!leaf)
+					pt_release(w, pte_to_pt(*pte), lvl - 1);
+				*pte = 0;
+				w->flush = 1;
+				continue;
+			}
+			break;
+		case PT_OP_SET_ATTR:
+			if (!(*pte & PTE_PRESENT))
+				return -ENOENT;
+			if (whole && leaf) {
+				*pte = (*pte & PTE_ADDR_MASK) | w->attr
+				       | (lvl ? PTE_PSE : 0);
+				w->flush = 1;
+				continue;
+			}
+			break;
+		case PT_OP_PREPARE:
+			if (!(*pte & PTE_PRESENT)) {
+				child = pt_alloc();
+				if (unlikely(!child))
+					return -ENOMEM;
+				*pte = (__u64) child | PTE_TABLE;
+			} else if (leaf) {
+				return -EEXIST;
+			}
+			*pte |= PTE_KEEP;
+			/* The leaf tables are not walked */
+			if (lvl == 1)
+				continue;
+			leaf = 0;
+			break;
+		}
+
+		/* Descend, splitting a large page that is partially covered */
+		UK_ASSERT(lvl > 0);
+		if (leaf) {
+			rc = pt_split(pte, lvl);
+			if (unlikely(rc))
+				return rc;
+			w->flush = 1;
+		}
+		rc = pt_walk(w, pte_to_pt(*pte), lvl - 1, va, chunk);
+		if (unlikely(rc))
+			return rc;
+	}
+
+	return 0;
+}
+
+static void pt_flush_local(__uptr va, __sz len)
+{
+	__uptr end = va + len;
+
+	/* invlpg also drops the paging-structure cache entries */
+	if (len > PT_FLUSH_PAGES_MAX * __PAGE_SIZE) {
+		write_cr3(read_cr3());
+		return;
+	}
+
+	for (; va < end; va += __PAGE_SIZE)
+		invlpg(va);
+}
+
+#if CONFIG_HAVE_SMP
+struct pt_shootdown {
+	struct ukplat_lcpu_func fn;
+	__uptr va;
+	__sz len;
+	unsigned int pending;
+};
+
+static void pt_shootdown_fn(struct __regs *regs __unused,
+			    struct ukplat_lcpu_func *fn)
+{
+	struct pt_shootdown *sd = __containerof(fn, struct pt_shootdown, fn);
+
+	pt_flush_local(sd->va, sd->len);
+	ukarch_dec(&sd->pending);
+}
+#endif /* CONFIG_HAVE_SMP */
+
+/*
+ * Flushes the range from the TLBs of all CPUs. The other CPUs are
+ * interrupted, so interrupts must be enabled on the calling CPU to not
+ * deadlock with a concurrent shootdown.
+ */
+static void pt_flush(__uptr va, __sz len)
+{
+#if CONFIG_HAVE_SMP
+	struct pt_shootdown sd = {
+		.fn = { .fn = pt_shootdown_fn },
+		.va = va,
+		.len = len,
+		.pending = 0,
+	};
+	unsigned long flags;
+	__lcpuid self, id;
+	int rc;
+
+	/* Do not migrate between the local flush and reading the CPU ID */
+	flags = ukplat_lcpu_save_irqf();
+	self = ukplat_lcpu_id();
+	pt_flush_local(va, len);
+	ukplat_lcpu_restore_irqf(flags);
+
+	for (id = 0; id < ukplat_lcpu_count(); id++) {
+		if (id == self)
+			continue;
+
+		ukarch_inc(&sd.pending);
+		do {
+			rc = ukplat_lcpu_run(&id, 1, &sd.fn, 0);
+		} while (rc == -EAGAIN);
+		/* The CPU is offline or there are no IPIs */
+		if (rc < 0)
+			ukarch_dec(&sd.pending);
+	}
+
+	while (UK_READ_ONCE(sd.pending))
+		ukarch_spinwait();
+#else /* CONFIG_HAVE_SMP */
+	pt_flush_local(va, len);
+#endif /* CONFIG_HAVE_SMP */
+}
+
+static int pt_change(struct pt_walk *w, void *vaddr, __sz len)
+{
+	__uptr va = (__uptr) vaddr;
+	unsigned long flags;
+	__u64 *pt;
+	int rc;
+
+	UK_ASSERT(pt_root);
+
+	if (unlikely(!len || ((va | len) & (__PAGE_SIZE - 1))))
+		return -EINVAL;
+	if (unlikely(va >= PT_VADDR_END || len > PT_VADDR_END - va))
+		return -EINVAL;
+
+	ukplat_spin_lock_irqsave(&pt_lock, flags);
+	rc = pt_walk(w, pt_root, PT_LEVELS - 1, va, len);
+	ukplat_spin_unlock_irqrestore(&pt_lock, flags);
+
+	/* Also on errors: the range may have been changed partially */
+	if (w->flush)
+		pt_flush(va, len);
+
+	if (w->released) {
+		ukplat_spin_lock_irqsave(&pt_lock, flags);
+		while ((pt = w->released)) {
+			w->released = (__u64 *) pt[0];
+			pt[0] = (__u64) pt_free_list;
+			pt_free_list = pt;
+		}
+		ukplat_spin_unlock_irqrestore(&pt_lock, flags);
+	}
+
+	return rc;
+}
+
+int ukplat_page_map(void *vaddr, __phys_addr paddr, __sz len,
+		    unsigned long attr)
+{
+	struct pt_walk w = {
+		.op = PT_OP_MAP,
+		.paddr = paddr,
+		.attr = pt_attr(attr),
+	};
+
+	if (unlikely(paddr & (__PAGE_SIZE - 1)))
+		return -EINVAL;
+
+	return pt_change(&w, vaddr, len);
+}
+
+int ukplat_page_unmap(void *vaddr, __sz len)
+{
+	struct pt_walk w = {
+		.op = PT_OP_UNMAP,
+	};
+
+	return pt_change(&w, vaddr, len);
+}
+
+int ukplat_page_set_attr(void *vaddr, __sz len, unsigned long attr)
+{
+	struct pt_walk w = {
+		.op = PT_OP_SET_ATTR,
+		.attr = pt_attr(attr),
+	};
+
+	return pt_change(&w, vaddr, len);
+}
+
+int ukplat_page_prepare(void *vaddr, __sz len)
+{
+	struct pt_walk w = {
+		.op = PT_OP_PREPARE,
+	};
+
+	return pt_change(&w, vaddr, len);
+}
+
+int ukplat_page_map_prepared(void *vaddr, __phys_addr paddr,
+			     unsigned long attr)
+{
+	__uptr va = (__uptr) vaddr;
+	unsigned int lvl;
+	__u64 *pt, pte;
+
+	if (unlikely((va | paddr) & (__PAGE_SIZE - 1)))
+		return -EINVAL;
+	if (unlikely(va >= PT_VADDR_END))
+		return -EINVAL;
+
+	/*
+	 * Kept tables are never released, so they can be walked without
+	 * pt_lock. Mapping a page that was not present needs no TLB flush.
+	 */
+	for (pt = pt_root, lvl = PT_LEVELS - 1; lvl > 0;
+	     pt = pte_to_pt(pte), lvl--) {
+		pte = UK_READ_ONCE(pt[PT_INDEX(va, lvl)]);
+		if (!(pte & PTE_KEEP))
+			return -ENOENT;
+	}
+
+	pte = paddr | pt_attr(attr);
+	if (ukarch_compare_exchange_sync(&pt[PT_INDEX(va, 0)], 0, pte) != pte)
+		return -EEXIST;
+	return 0;
+}
+
+int ukplat_page_lookup(const void *vaddr, __phys_addr *paddr)
+{
+	__uptr va = (__uptr) vaddr;
+	unsigned long flags;
+	unsigned int lvl;
+	__u64 *pt, pte;
+	int rc = -ENOENT;
+
+	UK_ASSERT(pt_root);
+	UK_ASSERT(paddr);
+
+	if (unlikely(va >= PT_VADDR_END))
+		return -ENOENT;
+
+	ukplat_spin_lock_irqsave(&pt_lock, flags);
+	for (pt = pt_root, lvl = PT_LEVELS - 1; ; pt = pte_to_pt(pte), lvl--) {
+		pte = pt[PT_INDEX(va, lvl)];
+		if (!(pte & PTE_PRESENT))
+			break;
+		if (lvl == 0 || (pte & PTE_PSE)) {
+			*paddr = (pte & PTE_ADDR_MASK & ~(PT_LEVEL_SIZE(lvl) - 1))
+				 + (va & (PT_LEVEL_SIZE(lvl) - 1));
+			rc = 0;
+			break;
+		}
+	}
+	ukplat_spin_unlock_irqrestore(&pt_lock, flags);
+
+	return rc;
+}
+
+void *ukplat_page_vaddr_alloc(__sz len)
+{
+	unsigned long flags;
+	__uptr va = 0;
+
+	/* Separate ranges never share a page table */
+	len = ALIGN_UP(len, PT_LEVEL_SIZE(1));
+	if (unlikely(!len))
+		return NULL;
+
+	ukplat_spin_lock_irqsave(&pt_lock, flags);
+	if (len <= PT_VADDR_END - pt_vaddr_next) {
+		va = pt_vaddr_next;
+		pt_vaddr_next += len;
+	}
+	ukplat_spin_unlock_irqrestore(&pt_lock, flags);
+
+	return (void *) va;
+}
+
+void paging_init(__uptr max_addr)
+{
+	__u32 eax, ebx, ecx, edx;
+	__u64 *boot_pt, *pt_low, *pd;
+	__uptr end;
+	int rc;
+
+	cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+	if (eax >= 0x80000001) {
+		cpuid(0x80000001, 0, &eax, &ebx, &ecx, &edx);
+		if (edx & X86_CPUID_80000001_EDX_PDPE1GB)
+			pt_leaf_max = 2;
+	}
+	if (rdmsrl(X86_MSR_EFER) & X86_EFER_NXE)
+		pt_nx = PTE_NX;
+
+	pt_root = pt_alloc();
+	pt_low = pt_alloc();
+	if (unlikely(!pt_root || !pt_low))
+		UK_CRASH("Not enough memory for page tables\n");
+
+	/*
+	 * Take over the 4 KiB pages of the first 2 MiB from the boot page
+	 * tables, which leave most of the first 1 MiB inaccessible.
+	 */
+	boot_pt = pte_to_pt(read_cr3());
+	boot_pt = pte_to_pt(boot_pt[0]);
+	boot_pt = pte_to_pt(boot_pt[0]);
+	boot_pt = pte_to_pt(boot_pt[0]);
+	memcpy(pt_low, boot_pt, __PAGE_SIZE);
+
+	/*
+	 * Like the boot page tables, we map memory in whole GiBs, which
+	 * covers the ACPI tables at the end of memory as well.
+	 */
+	end = ALIGN_UP(max_addr, PT_LEVEL_SIZE(2));
+	rc = ukplat_page_map((void *) PT_LEVEL_SIZE(1), PT_LEVEL_SIZE(1),
+			     end - PT_LEVEL_SIZE(1),
+			     UKPLAT_PAGE_ATTR_PROT_RW
+			     | UKPLAT_PAGE_ATTR_PROT_EXEC);
+	if (unlikely(rc))
+		UK_CRASH("Failed to build direct map: %d\n", rc);
+
+	pd = pte_to_pt(pte_to_pt(pt_root[0])[0]);
+	pd[0] = (__u64) pt_low | PTE_TABLE;
+
+#if CONFIG_KVM_LAPIC_TIMER
+	rc = ukplat_page_map((void *) PT_MMIO_START, PT_MMIO_START,
+			     PT_MMIO_END - PT_MMIO_START,
+			     UKPLAT_PAGE_ATTR_PROT_RW
+			     | UKPLAT_PAGE_ATTR_NOCACHE);
+	if (unlikely(rc))
+		UK_CRASH("Failed to map PCI hole: %d\n", rc);
+#endif /* CONFIG_KVM_LAPIC_TIMER */
+
+	write_cr3((unsigned long) pt_root);
+
+	uk_pr_info("Direct map with %s pages up to %p\n",
+		   (pt_leaf_max == 2) ? "1 GiB" : "2 MiB", (void *) end);
+}
@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * kvmclock: the hypervisor keeps a time information structure per CPU up to
+ * date, from which the guest computes the time as the system time of the
+ * last update plus the scaled TSC ticks since then. Unlike the raw TSC,
+ * this survives TSC rate changes on the host and live migration.
+ */
+#include <errno.h>
+#include <uk/arch/atomic.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/plat/io.h>
+#include <uk/plat/lcpu.h>
+#include <x86/cpu.h>
+#include <kvm-x86/pvclock.h>
+
+#define KVM_CPUID_SIGNATURE	0x40000000
+#define KVM_CPUID_FEATURES	0x40000001
+
+/* "KVMKVMKVM\0\0\0" in EBX, ECX, EDX */
+#define KVM_SIGNATURE_EBX	0x4b4d564b
+#define KVM_SIGNATURE_ECX	0x564b4d56
+#define KVM_SIGNATURE_EDX	0x0000004d
+
+#define KVM_FEATURE_CLOCKSOURCE2	(1 << 3)
+#define KVM_FEATURE_CLOCKSOURCE_STABLE	(1 << 24)
+
+#define MSR_KVM_WALL_CLOCK_NEW	0x4b564d00
+#define MSR_KVM_SYSTEM_TIME_NEW	0x4b564d01
+#define KVM_SYSTEM_TIME_ENABLE	0x1
+
+#define PVCLOCK_TSC_STABLE_BIT	(1 << 0)
+
+struct pvclock_vcpu_time_info {
+	/* Odd while the hypervisor updates the structure */
+	__u32 version;
+	__u32 pad0;
+	__u64 tsc_timestamp;
+	__u64 system_time;
+	__u32 tsc_to_system_mul;
+	__s8 tsc_shift;
+	__u8 flags;
+	__u8 pad[2];
+} __packed;
+
+struct pvclock_wall_clock {
+	__u32 version;
+	__u32 sec;
+	__u32 nsec;
+} __packed;
+
+/* Must not cross a page boundary, so give each CPU a cache line */
+static struct {
+	struct pvclock_vcpu_time_info ti;
+} __align64 pvclock_ti[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+
+static struct pvclock_wall_clock pvclock_wc;
+
+static int pvclock_on;
+static int pvclock_stable;
+
+/* kvmclock system time at pvclock_init() */
+static __u64 pvclock_base;
+
+#if CONFIG_HAVE_SMP
+/* Last returned time, to stay monotonic across CPUs without stable TSC */
+static __u64 pvclock_last;
+#endif /* CONFIG_HAVE_SMP */
+
+static inline __u64 pvclock_scale(__u64 delta, __u32 mul, __s8 shift)
+{
+	if (shift < 0)
+		delta >>= -shift;
+	else
+		delta <<= shift;
+	return mul64_32(delta, mul);
+}
+
+/* Returns the kvmclock system time of the current CPU */
+static __u64 pvclock_read(void)
+{
+	volatile struct pvclock_vcpu_time_info *ti;
+	__u32 version;
+	__u64 t;
+
+	ti = &pvclock_ti[ukplat_lcpu_id()].ti;
+	do {
+		version = ti->version;
+		/* Also keeps the TSC read from moving up */
+		rmb();
+		t = ti->system_time
+		    + pvclock_scale(rdtsc() - ti->tsc_timestamp,
+				    ti->tsc_to_system_mul, ti->tsc_shift);
+		rmb();
+	} while ((version & 1) || version != ti->version);
+
+	return t;
+}
+
+__u64 pvclock_monotonic(void)
+{
+	__u64 t = pvclock_read() - pvclock_base;
+#if CONFIG_HAVE_SMP
+	__u64 last;
+
+	if (pvclock_stable)
+		return t;
+
+	/* Another CPU may have returned a later time already */
+	last = __atomic_load_n(&pvclock_last, __ATOMIC_RELAXED);
+	do {
+		if (t <= last)
+			return last;
+	} while (!__atomic_compare_exchange_n(&pvclock_last, &last, t, 0,
+					      __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+#endif /* CONFIG_HAVE_SMP */
+	return t;
+}
+
+__u64 pvclock_wall_clock(void)
+{
+	volatile struct pvclock_wall_clock *wc = &pvclock_wc;
+	__u32 version;
+	__u64 boot;
+
+	/* The hypervisor updates the structure on every MSR write */
+	wrmsrl(MSR_KVM_WALL_CLOCK_NEW, ukplat_virt_to_phys(&pvclock_wc));
+	do {
+		version = wc->version;
+		rmb();
+		boot = ukarch_time_sec_to_nsec((__u64) wc->sec) + wc->nsec;
+		rmb();
+	} while ((version & 1) || version != wc->version);
+
+	/* The wall clock is the time at kvmclock system time 0 */
+	return boot + pvclock_read();
+}
+
+__u64 pvclock_tsc_frequency(void)
+{
+	struct pvclock_vcpu_time_info *ti = &pvclock_ti[ukplat_lcpu_id()].ti;
+	__u64 freq;
+
+	/* Invert ns = ((ticks << shift) * mul) >> 32 */
+	freq = (UKARCH_NSEC_PER_SEC << 32) / ti->tsc_to_system_mul;
+	if (ti->tsc_shift < 0)
+		freq <<= -ti->tsc_shift;
+	else
+		freq >>= ti->tsc_shift;
+	return freq;
+}
+
+int pvclock_enabled(void)
+{
+	return pvclock_on;
+}
+
+int pvclock_tsc_stable(void)
+{
+	return pvclock_stable;
+}
+
+static void pvclock_register(void)
+{
+	wrmsrl(MSR_KVM_SYSTEM_TIME_NEW,
+	       ukplat_virt_to_phys(&pvclock_ti[ukplat_lcpu_id()].ti)
+	       | KVM_SYSTEM_TIME_ENABLE);
+}
+
+int pvclock_init(void)
+{
+	__u32 eax, ebx, ecx, edx;
+	__u32 features;
+
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & X86_CPUID1_ECX_HYPERVISOR))
+		return -ENOTSUP;
+
+	cpuid(KVM_CPUID_SIGNATURE, 0, &eax, &ebx, &ecx, &edx);
+	if (ebx != KVM_SIGNATURE_EBX || ecx != KVM_SIGNATURE_ECX
+	    || edx != KVM_SIGNATURE_EDX || eax < KVM_CPUID_FEATURES)
+		return -ENOTSUP;
+
+	cpuid(KVM_CPUID_FEATURES, 0, &features, &ebx, &ecx, &edx);
+	if (!(features & KVM_FEATURE_CLOCKSOURCE2))
+		return -ENOTSUP;
+
+	pvclock_register();
+	pvclock_on = 1;
+
+	/* The hypervisor sets the flag in the first update */
+	pvclock_stable = (features & KVM_FEATURE_CLOCKSOURCE_STABLE)
+		&& (UK_READ_ONCE(pvclock_ti[ukplat_lcpu_id()].ti.flags)
+		    & PVCLOCK_TSC_STABLE_BIT);
+
+	pvclock_base = pvclock_read();
+	return 0;
+}
+
+void pvclock_lcpu_init(void)
+{
+	if (pvclock_on)
+		pvclock_register();
+}
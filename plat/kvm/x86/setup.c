@@ -41,9 +41,20 @@
 #include <uk/assert.h>
 #include <uk/essentials.h>
 #include <x86/acpi/acpi.h>
+#ifdef CONFIG_HAVE_SMP
+#include <kvm-x86/smp.h>
+#endif /* CONFIG_HAVE_SMP */
+#if CONFIG_KVM_PAGING
+#include <kvm-x86/paging.h>
+#endif /* CONFIG_KVM_PAGING */
 
 #define PLATFORM_MEM_START 0x100000
+#if CONFIG_KVM_PAGING
+/* The direct map uses the first entry of the PML4 */
+#define PLATFORM_MAX_MEM_ADDR 0x8000000000
+#else
 #define PLATFORM_MAX_MEM_ADDR 0x40000000
+#endif
 
 #define MAX_CMDLINE_SIZE 8192
 static char cmdline[MAX_CMDLINE_SIZE];
@@ -93,8 +104,8 @@ static inline void _mb_init_mem(struct multiboot_info *mi)
 	UK_ASSERT(offset < mi->mmap_length);
 
 	/*
-	 * Cap our memory size to PLATFORM_MAX_MEM_SIZE which boot.S defines
-	 * page tables for.
+	 * Cap our memory size to PLATFORM_MAX_MEM_SIZE which boot.S (or the
+	 * direct map with CONFIG_KVM_PAGING) defines page tables for.
 	 */
 	max_addr = m->addr + m->len;
 	if (max_addr > PLATFORM_MAX_MEM_ADDR)
@@ -261,6 +272,9 @@ void _libkvmplat_entry(void *arg)
 {
 	struct multiboot_info *mi = (struct multiboot_info *)arg;
 
+#ifdef CONFIG_HAVE_SMP
+	lcpu_init();
+#endif /* CONFIG_HAVE_SMP */
 	_libkvmplat_init_console();
 	traps_init();
 	intctrl_init();
@@ -276,6 +290,14 @@ void _libkvmplat_entry(void *arg)
 	_mb_init_mem(mi);
 	_mb_init_initrd(mi);
 
+#if CONFIG_KVM_PAGING
+	/*
+	 * The boot page tables only cover the first 1GB: switch to the
+	 * direct map before the boot stack at the end of memory is used.
+	 */
+	paging_init(_libkvmplat_cfg.bstack.end);
+#endif /* CONFIG_KVM_PAGING */
+
 	if (_libkvmplat_cfg.initrd.len)
 		uk_pr_info("        initrd: %p\n",
 			   (void *) _libkvmplat_cfg.initrd.start);
@@ -288,7 +310,8 @@ void _libkvmplat_entry(void *arg)
 		   (void *) _libkvmplat_cfg.bstack.start);
 
 #ifdef CONFIG_HAVE_SMP
-	acpi_init();
+	if (acpi_init() == 0)
+		lcpu_mp_init();
 #endif /* CONFIG_HAVE_SMP */
 
 #ifdef CONFIG_HAVE_SYSCALL
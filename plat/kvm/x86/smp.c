@@ -0,0 +1,557 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/limits.h>
+#include <uk/arch/time.h>
+#include <uk/arch/tls.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/plat/config.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/memory.h>
+#include <uk/plat/spinlock.h>
+#include <uk/plat/time.h>
+#include <uk/plat/tls.h>
+#include <x86/cpu.h>
+#include <x86/acpi/acpi.h>
+#include <kvm/tscclock.h>
+#include <kvm-x86/lapic.h>
+#include <kvm-x86/smp.h>
+
+/*
+ * Delays of the INIT-SIPI-SIPI sequence as recommended by the MP
+ * specification. The INIT delay is skipped in virtual machines, where the
+ * hypervisor resets the virtual CPU synchronously.
+ */
+#define LCPU_INIT_DELAY_MS	10
+#define LCPU_SIPI_DELAY_US	200
+
+/* Time for a secondary CPU to come up, generous for emulated CPUs */
+#define LCPU_START_TIMEOUT_MS	1000
+
+#define LCPU_NMI_STACK_SIZE	4096
+
+static struct lcpu lcpus[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+static __lcpuid lcpu_count = 1;
+
+/* Serializes ukplat_lcpu_start(), there is only one startup trampoline */
+static __spinlock lcpu_start_lock = UKARCH_SPINLOCK_INITIALIZER();
+static int lcpu_start_ready;
+
+/* Startup parameters, read by the startup code in smp_start.S */
+struct lcpu *lcpu_start_current;
+__u64 lcpu_start_cr0;
+__u64 lcpu_start_cr3;
+__u64 lcpu_start_cr4;
+__u64 lcpu_start_xcr0;
+
+extern char lcpu_start16[];
+extern char lcpu_start16_end[];
+
+void __noreturn lcpu_entry(struct lcpu *this);
+
+static __u32 lcpu_arch_apic_id(void)
+{
+	__u32 eax, ebx, ecx, edx;
+
+	/* The x2APIC ID is in the topology leaf, if there is one */
+	cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+	if (eax >= 0xb) {
+		cpuid(0xb, 0, &eax, &ebx, &ecx, &edx);
+		if (ebx)
+			return edx;
+	}
+
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	return ebx >> 24;
+}
+
+static void lcpu_setup(struct lcpu *lcpu, __lcpuid id, __u32 apic_id)
+{
+	lcpu->self = lcpu;
+	lcpu->id = id;
+	lcpu->apic_id = apic_id;
+	lcpu->state = LCPU_STATE_OFFLINE;
+	ukarch_spin_init(&lcpu->fn_lock);
+	lcpu->fn_head = 0;
+	lcpu->fn_tail = 0;
+}
+
+void lcpu_init(void)
+{
+	struct lcpu *this = &lcpus[0];
+
+	lcpu_setup(this, 0, lcpu_arch_apic_id());
+	this->state = LCPU_STATE_BUSY;
+
+	wrmsrl(X86_MSR_GS_BASE, (__u64) this);
+}
+
+static void lcpu_add(__u32 apic_id, unsigned int *ignored)
+{
+	__lcpuid i;
+
+	/* The boot CPU is already registered */
+	for (i = 0; i < lcpu_count; i++)
+		if (lcpus[i].apic_id == apic_id)
+			return;
+
+	if (lcpu_count == CONFIG_UKPLAT_LCPU_MAXCOUNT) {
+		(*ignored)++;
+		return;
+	}
+
+	lcpu_setup(&lcpus[lcpu_count], lcpu_count, apic_id);
+	lcpu_count++;
+}
+
+int lcpu_mp_init(void)
+{
+	struct MADT *madt;
+	struct MADTEntryHeader *h;
+	struct MADTType0Entry *lapic;
+	struct MADTType9Entry *x2apic;
+	unsigned int ignored = 0;
+	__sz off, len;
+	__u32 apic_id, flags;
+
+	if (!acpi_get_version()) {
+		uk_pr_warn("No ACPI MADT, only the boot CPU is used\n");
+		return -ENOENT;
+	}
+
+	madt = acpi_get_madt();
+	len = madt->h.Length - sizeof(*madt);
+	for (off = 0; off + sizeof(*h) <= len; off += h->Length) {
+		h = (struct MADTEntryHeader *) &madt->Entries[off];
+		if (unlikely(h->Length < sizeof(*h)))
+			break;
+
+		switch (h->Type) {
+		case MADT_TYPE_LAPIC:
+			lapic = (struct MADTType0Entry *) h;
+			apic_id = lapic->APICID;
+			flags = lapic->Flags;
+			break;
+		case MADT_TYPE_LAPIC_X2APIC:
+			x2apic = (struct MADTType9Entry *) h;
+			apic_id = x2apic->X2APICID;
+			flags = x2apic->Flags;
+			break;
+		default:
+			continue;
+		}
+
+		if (!(flags & (MADT_LAPIC_FLAGS_ENABLED
+			       | MADT_LAPIC_FLAGS_ONLINE_CAPABLE)))
+			continue;
+
+		lcpu_add(apic_id, &ignored);
+	}
+
+	if (ignored)
+		uk_pr_warn("Ignoring %u CPUs above the limit of %d\n",
+			   ignored, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	uk_pr_info("Found %u logical CPUs\n", (unsigned int) lcpu_count);
+	return 0;
+}
+
+__lcpuid ukplat_lcpu_count(void)
+{
+	return lcpu_count;
+}
+
+static struct lcpu *lcpu_get(__lcpuid id)
+{
+	if (unlikely(id >= lcpu_count))
+		return NULL;
+	return &lcpus[id];
+}
+
+static void __noreturn lcpu_idle(struct lcpu *this)
+{
+	ukplat_lcpu_disable_irq();
+	for (;;) {
+		this->state = LCPU_STATE_IDLE;
+		ukplat_lcpu_halt_irq();
+	}
+}
+
+/* Continues the startup of a secondary CPU, called from smp_start.S */
+void lcpu_entry(struct lcpu *this)
+{
+	int rc;
+
+	/* This releases lcpu_start_current */
+	this->state = LCPU_STATE_INIT;
+
+	ukplat_tlsp_set(this->tlsp);
+	traps_lcpu_init(this->id, this->intr_sp, this->trap_sp, this->nmi_sp);
+	tscclock_lcpu_init();
+
+	rc = lapic_lcpu_init();
+	if (unlikely(rc < 0)) {
+		uk_pr_err("CPU %u: Failed to enable local APIC: %d\n",
+			  (unsigned int) this->id, rc);
+		this->state = LCPU_STATE_OFFLINE;
+		for (;;)
+			ukplat_lcpu_halt();
+	}
+
+	if (this->entry) {
+		this->state = LCPU_STATE_BUSY;
+		this->entry();
+	}
+	lcpu_idle(this);
+}
+
+/*
+ * Copy the startup trampoline to low memory and record the CPU settings
+ * that the secondary CPUs take over.
+ */
+static void lcpu_start_prepare(void)
+{
+	__u32 lo, hi;
+	__sz len = lcpu_start16_end - lcpu_start16;
+
+	UK_ASSERT(len <= __PAGE_SIZE);
+	memcpy((void *) LCPU_START16_ADDR, lcpu_start16, len);
+
+	__asm__ __volatile__("movq %%cr0, %0" : "=r" (lcpu_start_cr0));
+	__asm__ __volatile__("movq %%cr3, %0" : "=r" (lcpu_start_cr3));
+	__asm__ __volatile__("movq %%cr4, %0" : "=r" (lcpu_start_cr4));
+	if (lcpu_start_cr4 & X86_CR4_OSXSAVE) {
+		__asm__ __volatile__("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+		lcpu_start_xcr0 = ((__u64) hi << 32) | lo;
+	}
+}
+
+static void lcpu_delay(__nsec delay)
+{
+	__nsec until = ukplat_monotonic_clock() + delay;
+
+	while (ukplat_monotonic_clock() < until)
+		ukarch_spinwait();
+}
+
+static int lcpu_wait_state(struct lcpu *lcpu, int state, __nsec timeout)
+{
+	__nsec until = ukplat_monotonic_clock() + timeout;
+
+	while (UK_READ_ONCE(lcpu->state) < state) {
+		if (ukplat_monotonic_clock() >= until)
+			return -ETIMEDOUT;
+		ukarch_spinwait();
+	}
+	return 0;
+}
+
+/*
+ * Allocate the interrupt stacks and the TLS of a secondary CPU. The TLS is
+ * initialized from the TLS template.
+ */
+static int lcpu_alloc(struct lcpu *lcpu)
+{
+	struct uk_alloc *a = ukplat_memallocator_get();
+	void *intr, *trap, *nmi, *tls;
+
+	if (unlikely(!a))
+		return -ENOMEM;
+
+	intr = uk_memalign(a, __PAGE_SIZE, STACK_SIZE);
+	trap = uk_memalign(a, __PAGE_SIZE, STACK_SIZE);
+	nmi = uk_memalign(a, __PAGE_SIZE, LCPU_NMI_STACK_SIZE);
+	tls = uk_memalign(a, ukarch_tls_area_align(), ukarch_tls_area_size());
+	if (unlikely(!intr || !trap || !nmi || !tls))
+		goto err_free;
+
+	ukarch_tls_area_copy(tls);
+	lcpu->tlsp = ukarch_tls_pointer(tls);
+	lcpu->intr_sp = (__u8 *) intr + STACK_SIZE;
+	lcpu->trap_sp = (__u8 *) trap + STACK_SIZE;
+	lcpu->nmi_sp = (__u8 *) nmi + LCPU_NMI_STACK_SIZE;
+	return 0;
+
+err_free:
+	if (tls)
+		uk_free(a, tls);
+	if (nmi)
+		uk_free(a, nmi);
+	if (trap)
+		uk_free(a, trap);
+	if (intr)
+		uk_free(a, intr);
+	return -ENOMEM;
+}
+
+static int lcpu_start_one(struct lcpu *lcpu, void *sp,
+			  ukplat_lcpu_entry_t entry)
+{
+	__u32 eax, ebx, ecx, edx;
+	int rc;
+
+	rc = lcpu_alloc(lcpu);
+	if (unlikely(rc < 0))
+		return rc;
+
+	lcpu->sp = sp;
+	lcpu->entry = entry;
+	lcpu_start_current = lcpu;
+
+	lapic_ipi_init(lcpu->apic_id);
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & X86_CPUID1_ECX_HYPERVISOR))
+		lcpu_delay(ukarch_time_msec_to_nsec(LCPU_INIT_DELAY_MS));
+
+	lapic_ipi_startup(lcpu->apic_id, LCPU_START16_ADDR >> 12);
+	rc = lcpu_wait_state(lcpu, LCPU_STATE_INIT,
+			     ukarch_time_usec_to_nsec(LCPU_SIPI_DELAY_US));
+	if (rc < 0) {
+		/* The first STARTUP IPI may get lost, send a second one */
+		lapic_ipi_startup(lcpu->apic_id, LCPU_START16_ADDR >> 12);
+	}
+
+	/*
+	 * On a timeout, the allocated resources are not released, as the
+	 * CPU may still come up later.
+	 */
+	rc = lcpu_wait_state(lcpu, LCPU_STATE_IDLE,
+			     ukarch_time_msec_to_nsec(LCPU_START_TIMEOUT_MS));
+	if (unlikely(rc < 0)) {
+		uk_pr_err("CPU %u (APIC ID %u) did not come up\n",
+			  (unsigned int) lcpu->id, lcpu->apic_id);
+		return rc;
+	}
+
+	uk_pr_debug("CPU %u (APIC ID %u) is up\n",
+		    (unsigned int) lcpu->id, lcpu->apic_id);
+	return 0;
+}
+
+int ukplat_lcpu_start(__lcpuid lcpuid[], void *sp[],
+		      ukplat_lcpu_entry_t entry[], unsigned int num)
+{
+	struct lcpu *lcpu;
+	unsigned int i;
+	int rc = 0;
+
+	UK_ASSERT(lcpuid);
+	UK_ASSERT(sp);
+
+	if (unlikely(!lapic_enabled()))
+		return -ENOTSUP;
+
+	ukarch_spin_lock(&lcpu_start_lock);
+	if (!lcpu_start_ready) {
+		lcpu_start_prepare();
+		lcpu_start_ready = 1;
+	}
+
+	for (i = 0; i < num; i++) {
+		lcpu = lcpu_get(lcpuid[i]);
+		if (unlikely(!lcpu || !sp[i])) {
+			rc = -EINVAL;
+			break;
+		}
+		if (unlikely(lcpu->state != LCPU_STATE_OFFLINE)) {
+			rc = -EALREADY;
+			break;
+		}
+
+		rc = lcpu_start_one(lcpu, sp[i], entry ? entry[i] : NULL);
+		if (unlikely(rc < 0))
+			break;
+	}
+	ukarch_spin_unlock(&lcpu_start_lock);
+
+	return rc;
+}
+
+int ukplat_lcpu_wait(__lcpuid lcpuid[], unsigned int num, __nsec timeout)
+{
+	struct lcpu *this = lcpu_get_current();
+	struct lcpu *lcpu;
+	__nsec until = 0;
+	unsigned int i;
+
+	if (!lcpuid)
+		num = lcpu_count;
+	if (timeout)
+		until = ukplat_monotonic_clock() + timeout;
+
+	for (i = 0; i < num; i++) {
+		if (lcpuid) {
+			lcpu = lcpu_get(lcpuid[i]);
+			if (unlikely(!lcpu || lcpu == this))
+				return -EINVAL;
+		} else {
+			lcpu = &lcpus[i];
+			if (lcpu == this || lcpu->state == LCPU_STATE_OFFLINE)
+				continue;
+		}
+
+		while (UK_READ_ONCE(lcpu->state) != LCPU_STATE_IDLE) {
+			if (until && ukplat_monotonic_clock() >= until)
+				return -ETIMEDOUT;
+			ukarch_spinwait();
+		}
+	}
+
+	return 0;
+}
+
+static int lcpu_fn_enqueue(struct lcpu *lcpu, struct ukplat_lcpu_func *fn)
+{
+	unsigned long flags;
+	int rc = 0;
+
+	ukplat_spin_lock_irqsave(&lcpu->fn_lock, flags);
+	if (lcpu->fn_tail - lcpu->fn_head == LCPU_FUNC_QUEUE_LEN)
+		rc = -EAGAIN;
+	else
+		lcpu->fn_queue[lcpu->fn_tail++ % LCPU_FUNC_QUEUE_LEN] = fn;
+	ukplat_spin_unlock_irqrestore(&lcpu->fn_lock, flags);
+
+	return rc;
+}
+
+static struct ukplat_lcpu_func *lcpu_fn_dequeue(struct lcpu *lcpu)
+{
+	struct ukplat_lcpu_func *fn = NULL;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	ukarch_spin_lock(&lcpu->fn_lock);
+	if (lcpu->fn_head != lcpu->fn_tail)
+		fn = lcpu->fn_queue[lcpu->fn_head++ % LCPU_FUNC_QUEUE_LEN];
+	ukarch_spin_unlock(&lcpu->fn_lock);
+
+	return fn;
+}
+
+/*
+ * The functions run in interrupt context without saving the FPU state of
+ * the interrupted code.
+ */
+void lcpu_ipi_handle(struct __regs *regs)
+{
+	struct lcpu *this = lcpu_get_current();
+	struct ukplat_lcpu_func *fn;
+	int state = this->state;
+
+	lapic_eoi();
+
+	while ((fn = lcpu_fn_dequeue(this))) {
+		this->state = LCPU_STATE_BUSY;
+		fn->fn(regs, fn);
+	}
+	this->state = state;
+}
+
+int ukplat_lcpu_run(__lcpuid lcpuid[], unsigned int num,
+		    struct ukplat_lcpu_func *fn, int flags)
+{
+	struct lcpu *this = lcpu_get_current();
+	struct lcpu *lcpu;
+	unsigned int i, queued = 0;
+	int rc;
+
+	UK_ASSERT(fn && fn->fn);
+
+	/* There are no run flags on x86 */
+	if (unlikely(flags))
+		return -EINVAL;
+	if (unlikely(!lapic_enabled()))
+		return -ENOTSUP;
+
+	if (!lcpuid) {
+		for (i = 0; i < lcpu_count; i++) {
+			lcpu = &lcpus[i];
+			if (lcpu == this || lcpu->state == LCPU_STATE_OFFLINE)
+				continue;
+
+			rc = lcpu_fn_enqueue(lcpu, fn);
+			if (unlikely(rc < 0))
+				return rc;
+			queued++;
+		}
+
+		/* A single broadcast instead of one IPI per CPU */
+		if (queued)
+			lapic_ipi_send_allbutself(LAPIC_IPI_VECTOR);
+		return 0;
+	}
+
+	for (i = 0; i < num; i++) {
+		lcpu = lcpu_get(lcpuid[i]);
+		if (unlikely(!lcpu || lcpu->state == LCPU_STATE_OFFLINE))
+			return -EINVAL;
+
+		rc = lcpu_fn_enqueue(lcpu, fn);
+		if (unlikely(rc < 0))
+			return rc;
+		lapic_ipi_send(lcpu->apic_id, LAPIC_IPI_VECTOR);
+	}
+
+	return 0;
+}
+
+int ukplat_lcpu_wakeup(__lcpuid lcpuid[], unsigned int num)
+{
+	struct lcpu *this = lcpu_get_current();
+	struct lcpu *lcpu;
+	unsigned int i;
+
+	if (unlikely(!lapic_enabled()))
+		return -ENOTSUP;
+
+	if (!lcpuid) {
+		if (lcpu_count > 1)
+			lapic_ipi_send_allbutself(LAPIC_IPI_VECTOR);
+		return 0;
+	}
+
+	for (i = 0; i < num; i++) {
+		lcpu = lcpu_get(lcpuid[i]);
+		if (unlikely(!lcpu))
+			return -EINVAL;
+		if (lcpu == this || lcpu->state == LCPU_STATE_OFFLINE)
+			continue;
+
+		lapic_ipi_send(lcpu->apic_id, LAPIC_IPI_VECTOR);
+	}
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <uk/arch/atomic.h>
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/plat/irq.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/test.h>
+#include <kvm-x86/lapic.h>
+
+/* Calls of the timer IRQ handlers since the test suite was set up */
+static unsigned int lapic_test_ticks;
+
+static int lapic_test_tick(void *arg __unused)
+{
+	ukarch_inc(&lapic_test_ticks);
+
+	/* Let the handler of the platform see the interrupt as well */
+	return 0;
+}
+
+static int lapic_test_init(struct uk_testsuite *suite __unused)
+{
+	return ukplat_irq_register(ukplat_time_get_irq(), lapic_test_tick,
+				   NULL);
+}
+
+UK_TESTCASE(kvm_lapic_testsuite, kvm_test_lapic_timer)
+{
+	__nsec start, end, timeout;
+	unsigned long flags;
+	unsigned int ticks;
+
+	UK_TEST_EXPECT_SNUM_EQ(lapic_enabled(), 1);
+	UK_TEST_EXPECT_SNUM_EQ(lapic_timer_available(), 1);
+	if (!lapic_timer_available())
+		return;
+
+	/* An armed timer interrupts a halted CPU after the delay */
+	flags = ukplat_lcpu_save_irqf();
+	ticks = ukarch_load_n(&lapic_test_ticks);
+	start = ukplat_monotonic_clock();
+	timeout = start + ukarch_time_msec_to_nsec(100);
+	lapic_timer_arm(ukarch_time_msec_to_nsec(2));
+	do {
+		ukplat_lcpu_halt_irq();
+		end = ukplat_monotonic_clock();
+	} while (ukarch_load_n(&lapic_test_ticks) == ticks && end < timeout);
+	ukplat_lcpu_restore_irqf(flags);
+
+	UK_TEST_EXPECT_SNUM_GT(ukarch_load_n(&lapic_test_ticks), ticks);
+	/* Leave room for the error of the timer frequency calibration */
+	UK_TEST_EXPECT_SNUM_GE(end - start, ukarch_time_msec_to_nsec(1));
+	UK_TEST_EXPECT_SNUM_LT(end - start, ukarch_time_msec_to_nsec(50));
+}
+
+UK_TESTCASE(kvm_lapic_testsuite, kvm_test_lapic_halt)
+{
+	__nsec until, end;
+	unsigned int ticks;
+
+	if (!lapic_timer_available())
+		return;
+
+	/*
+	 * A long sleep takes a single timer interrupt, while the i8254 PIT
+	 * can only be programmed for 55ms at a time
+	 */
+	ticks = ukarch_load_n(&lapic_test_ticks);
+	until = ukplat_monotonic_clock() + ukarch_time_msec_to_nsec(200);
+	do {
+		ukplat_lcpu_halt_to(until);
+		end = ukplat_monotonic_clock();
+	} while (end < until);
+
+	UK_TEST_EXPECT_SNUM_LE(ukarch_load_n(&lapic_test_ticks) - ticks, 2);
+	UK_TEST_EXPECT_SNUM_LT(end - until, ukarch_time_msec_to_nsec(10));
+}
+
+uk_testsuite_register(kvm_lapic_testsuite, lapic_test_init);
@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <uk/essentials.h>
+#include <uk/print.h>
+#include <uk/plat/irq.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/test.h>
+#include <x86/cpu.h>
+#include <x86/irq.h>
+#include <kvm/intctrl.h>
+#include <kvm-x86/lapic.h>
+#include <pci/pci_bus.h>
+
+#define APIC_MSR_BASE		0x1b
+#define  APIC_BASE_X2APIC	(1UL << 10)
+#define X2APIC_MSR_SELF_IPI	0x83f
+#define XAPIC_ICR_LOW		0xfee00300
+#define  XAPIC_ICR_SELF		(1U << 18)
+
+#define MSI_ADDR_BASE		0xfee00000
+#define MSI_IRQ_COUNT		(__MAX_IRQ - __MAX_LEGACY_IRQ)
+
+/* MSI IRQ the handler below answers for, 0 when the test is not running */
+static volatile unsigned int msix_test_irq;
+static volatile unsigned int msix_test_count;
+/* IRQs that the handler was registered for, there is no unregistering */
+static __u64 msix_test_registered;
+
+/* Raise a vector on this CPU, in whichever mode the local APIC runs */
+static void msix_test_self_ipi(__u8 vector)
+{
+	if (rdmsrl(APIC_MSR_BASE) & APIC_BASE_X2APIC)
+		wrmsrl(X2APIC_MSR_SELF_IPI, vector);
+	else
+		*(volatile __u32 *) XAPIC_ICR_LOW = XAPIC_ICR_SELF | vector;
+}
+
+static int msix_test_handler(void *arg)
+{
+	if (msix_test_irq != (unsigned int) (__uptr) arg)
+		return 0;
+
+	msix_test_count++;
+	return 1;
+}
+
+UK_TESTCASE(kvm_msix_testsuite, kvm_test_msix_alloc)
+{
+	unsigned int irqs[MSI_IRQ_COUNT], irq, n, i;
+	__u64 addr, seen = 0;
+	__u32 data;
+	int rc;
+
+	if (!lapic_enabled()) {
+		UK_TEST_EXPECT_SNUM_EQ(intctrl_msi_alloc(&irq, &addr, &data),
+				       -ENOTSUP);
+		return;
+	}
+
+	/* Devices hold on to some of the IRQs already */
+	for (n = 0; n < MSI_IRQ_COUNT; n++) {
+		rc = intctrl_msi_alloc(&irqs[n], &addr, &data);
+		if (rc) {
+			UK_TEST_EXPECT_SNUM_EQ(rc, -ENOSPC);
+			break;
+		}
+
+		UK_TEST_EXPECT(irqs[n] >= __MAX_LEGACY_IRQ);
+		UK_TEST_EXPECT(irqs[n] < __MAX_IRQ);
+		UK_TEST_EXPECT_ZERO(seen & (1ULL << irqs[n]));
+		seen |= 1ULL << irqs[n];
+
+		/* Fixed delivery to this CPU, on the vector of the IRQ */
+		UK_TEST_EXPECT_SNUM_EQ(addr,
+				       MSI_ADDR_BASE | (lapic_id() << 12));
+		UK_TEST_EXPECT_SNUM_EQ(data, 32 + irqs[n]);
+	}
+	UK_TEST_EXPECT(n > 0);
+	UK_TEST_EXPECT_SNUM_EQ(intctrl_msi_alloc(&irq, &addr, &data),
+			       -ENOSPC);
+
+	/* A freed IRQ is handed out again */
+	if (n > 0) {
+		intctrl_msi_free(irqs[n / 2]);
+		UK_TEST_EXPECT_ZERO(intctrl_msi_alloc(&irq, &addr, &data));
+		UK_TEST_EXPECT_SNUM_EQ(irq, irqs[n / 2]);
+	}
+
+	for (i = 0; i < n; i++)
+		intctrl_msi_free(irqs[i]);
+}
+
+UK_TESTCASE(kvm_msix_testsuite, kvm_test_msix_deliver)
+{
+	unsigned int irq;
+	__u64 addr, deadline;
+	__u32 data;
+
+	if (!lapic_enabled())
+		return;
+
+	UK_TEST_EXPECT_ZERO(intctrl_msi_alloc(&irq, &addr, &data));
+	if (!(msix_test_registered & (1ULL << irq))) {
+		UK_TEST_EXPECT_ZERO(ukplat_irq_register(irq, msix_test_handler,
+							(void *) (__uptr) irq));
+		msix_test_registered |= 1ULL << irq;
+	}
+
+	/*
+	 * Raise the vector of the message from the CPU itself. It goes through
+	 * the same gate and the same acknowledgement as a device message.
+	 */
+	msix_test_count = 0;
+	msix_test_irq = irq;
+	msix_test_self_ipi(data & 0xff);
+
+	deadline = ukplat_monotonic_clock() + ukarch_time_msec_to_nsec(10);
+	while (!msix_test_count && ukplat_monotonic_clock() < deadline)
+		;
+	UK_TEST_EXPECT_SNUM_EQ(msix_test_count, 1);
+
+	/* The end of interrupt lets the next message through */
+	msix_test_self_ipi(data & 0xff);
+	deadline = ukplat_monotonic_clock() + ukarch_time_msec_to_nsec(10);
+	while (msix_test_count < 2 && ukplat_monotonic_clock() < deadline)
+		;
+	UK_TEST_EXPECT_SNUM_EQ(msix_test_count, 2);
+
+	msix_test_irq = 0;
+	intctrl_msi_free(irq);
+}
+
+UK_TESTCASE(kvm_msix_testsuite, kvm_test_msix_pci)
+{
+	struct pci_device dev = { 0 };
+	unsigned int size;
+	uint32_t id;
+
+	/* Only the 32-bit PCI hole is mapped */
+	UK_TEST_EXPECT_NOT_NULL((void *) arch_pci_mmio_map(0xfebf0000, 4096));
+	UK_TEST_EXPECT_NULL((void *) arch_pci_mmio_map(0x100000, 4096));
+	UK_TEST_EXPECT_NULL((void *) arch_pci_mmio_map(0xfffff000, 8192));
+
+	/* MSI-X tables have at most 2048 entries */
+	for (dev.addr.devid = 0; dev.addr.devid < PCI_MAX_DEVICES;
+	     dev.addr.devid++) {
+		id = arch_pci_conf_read(&dev.addr, PCI_CONF_VENDOR_ID);
+		if ((id & PCI_CONF_VENDOR_ID_MASK) == PCI_INVALID_ID)
+			continue;
+
+		size = pci_msix_table_size(&dev);
+		UK_TEST_EXPECT(size <= PCI_MSIX_FLAGS_QSIZE + 1);
+		uk_pr_info("PCI 00:%02x.00: %u MSI-X vectors\n",
+			   (int) dev.addr.devid, size);
+	}
+}
+
+uk_testsuite_register(kvm_msix_testsuite, NULL);
@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/essentials.h>
+#include <uk/page.h>
+#include <uk/plat/paging.h>
+#include <uk/test.h>
+#include <kvm-x86/paging.h>
+
+/* Virtual memory at the end of the lower half, far behind the direct map */
+#define PAGING_TEST_VADDR	((1UL << 47) - (1UL << 30))
+#define PAGING_TEST_LARGE	(1UL << 21)
+
+static void *paging_test_va(unsigned long off)
+{
+	return (void *) (PAGING_TEST_VADDR + off);
+}
+
+UK_TESTCASE(kvm_paging_testsuite, kvm_test_paging_alias)
+{
+	char *page, *alias = paging_test_va(0);
+
+	page = uk_palloc(uk_alloc_get_default(), 1);
+	UK_TEST_EXPECT_NOT_NULL(page);
+	if (!page)
+		return;
+
+	/* Memory below the direct map end is mapped at its physical address */
+	UK_TEST_EXPECT_ZERO(ukplat_page_map(alias, (__phys_addr) page,
+					    __PAGE_SIZE,
+					    UKPLAT_PAGE_ATTR_PROT_RW));
+	memset(page, 0x5a, __PAGE_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(alias[0], 0x5a);
+	UK_TEST_EXPECT_SNUM_EQ(alias[__PAGE_SIZE - 1], 0x5a);
+	alias[1] = 0x33;
+	UK_TEST_EXPECT_SNUM_EQ(page[1], 0x33);
+
+	/* Unmapped pages have no attributes to change */
+	UK_TEST_EXPECT_ZERO(ukplat_page_unmap(alias, __PAGE_SIZE));
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_set_attr(alias, __PAGE_SIZE,
+					UKPLAT_PAGE_ATTR_PROT_READ), -ENOENT);
+	UK_TEST_EXPECT_SNUM_EQ(page[1], 0x33);
+
+	uk_pfree(uk_alloc_get_default(), page, 1);
+}
+
+UK_TESTCASE(kvm_paging_testsuite, kvm_test_paging_split)
+{
+	char *page, *alias = paging_test_va(PAGING_TEST_LARGE);
+	unsigned long off, hole;
+	__phys_addr base;
+
+	page = uk_palloc(uk_alloc_get_default(), 1);
+	UK_TEST_EXPECT_NOT_NULL(page);
+	if (!page)
+		return;
+
+	/* Map the 2 MiB around the page read-only, as a single large page */
+	base = ALIGN_DOWN((__phys_addr) page, PAGING_TEST_LARGE);
+	off = (__phys_addr) page - base;
+	UK_TEST_EXPECT_ZERO(ukplat_page_map(alias, base, PAGING_TEST_LARGE,
+					    UKPLAT_PAGE_ATTR_PROT_READ));
+	memset(page, 0xa5, __PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(memcmp(alias + off, page, __PAGE_SIZE));
+
+	/* Unmapping a page in the middle splits the large page */
+	hole = (off == __PAGE_SIZE) ? 2 * __PAGE_SIZE : __PAGE_SIZE;
+	UK_TEST_EXPECT_ZERO(ukplat_page_unmap(alias + hole, __PAGE_SIZE));
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_set_attr(alias + hole, __PAGE_SIZE,
+					UKPLAT_PAGE_ATTR_PROT_READ), -ENOENT);
+	UK_TEST_EXPECT_ZERO(memcmp(alias, (void *) base, __PAGE_SIZE));
+	UK_TEST_EXPECT_ZERO(memcmp(alias + hole + __PAGE_SIZE,
+				   (void *) (base + hole + __PAGE_SIZE),
+				   __PAGE_SIZE));
+
+	/* The other pages keep their mapping and can be changed one by one */
+	UK_TEST_EXPECT_ZERO(ukplat_page_set_attr(alias + off, __PAGE_SIZE,
+						 UKPLAT_PAGE_ATTR_PROT_RW));
+	alias[off] = 0x11;
+	UK_TEST_EXPECT_SNUM_EQ(page[0], 0x11);
+
+	/* Changes over a range with a hole stop at the hole */
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_set_attr(alias, PAGING_TEST_LARGE,
+					UKPLAT_PAGE_ATTR_PROT_READ), -ENOENT);
+
+	UK_TEST_EXPECT_ZERO(ukplat_page_unmap(alias, PAGING_TEST_LARGE));
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_set_attr(alias, __PAGE_SIZE,
+					UKPLAT_PAGE_ATTR_PROT_READ), -ENOENT);
+
+	uk_pfree(uk_alloc_get_default(), page, 1);
+}
+
+UK_TESTCASE(kvm_paging_testsuite, kvm_test_paging_einval)
+{
+	char *va = paging_test_va(0);
+
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_map(va + 1, 0, __PAGE_SIZE,
+					       UKPLAT_PAGE_ATTR_PROT_READ),
+			       -EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_map(va, 1, __PAGE_SIZE,
+					       UKPLAT_PAGE_ATTR_PROT_READ),
+			       -EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_unmap(va, __PAGE_SIZE - 1),
+			       -EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_unmap(va, 0), -EINVAL);
+
+	/* Non-canonical addresses cannot be mapped */
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_unmap((void *) (1UL << 47),
+						 __PAGE_SIZE), -EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_page_unmap(va, 1UL << 31), -EINVAL);
+}
+
+uk_testsuite_register(kvm_paging_testsuite, NULL);
@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <uk/test.h>
+#include <x86/cpu.h>
+#include <kvm-x86/pvclock.h>
+
+#define PVCLOCK_TEST_SPIN_MS	20
+
+/* 2020-01-01 00:00:00 UTC */
+#define PVCLOCK_TEST_EPOCH_MIN	1577836800ULL
+
+UK_TESTCASE(kvm_pvclock_testsuite, kvm_test_pvclock_monotonic)
+{
+	__u64 prev, now;
+	unsigned int i, backwards = 0;
+
+	if (!pvclock_enabled())
+		return;
+
+	prev = pvclock_monotonic();
+	for (i = 0; i < 100000; i++) {
+		now = pvclock_monotonic();
+		if (now < prev)
+			backwards++;
+		prev = now;
+	}
+	UK_TEST_EXPECT_ZERO(backwards);
+}
+
+UK_TESTCASE(kvm_pvclock_testsuite, kvm_test_pvclock_rate)
+{
+	__u64 tsc0, tsc1, pv0, pv1, mono0, mono1, freq;
+	__s64 diff;
+
+	if (!pvclock_enabled())
+		return;
+
+	freq = pvclock_tsc_frequency();
+	UK_TEST_EXPECT_SNUM_GE(freq, 100000000ULL);
+	UK_TEST_EXPECT_SNUM_LE(freq, 10000000000ULL);
+
+	tsc0 = rdtsc();
+	pv0 = pvclock_monotonic();
+	mono0 = ukplat_monotonic_clock();
+	do {
+		pv1 = pvclock_monotonic();
+	} while (pv1 - pv0 < ukarch_time_msec_to_nsec(PVCLOCK_TEST_SPIN_MS));
+	mono1 = ukplat_monotonic_clock();
+	tsc1 = rdtsc();
+
+	/* The TSC ticks at the frequency that kvmclock reports, +/- 1% */
+	diff = (__s64) ((tsc1 - tsc0) * UKARCH_NSEC_PER_SEC / (pv1 - pv0))
+	       - (__s64) freq;
+	UK_TEST_EXPECT_SNUM_LT(diff < 0 ? -diff : diff, freq / 100);
+
+	/* The platform clock follows kvmclock, whichever one it reads */
+	diff = (__s64) (mono1 - mono0) - (__s64) (pv1 - pv0);
+	UK_TEST_EXPECT_SNUM_LT(diff < 0 ? -diff : diff,
+			       ukarch_time_msec_to_nsec(1));
+}
+
+UK_TESTCASE(kvm_pvclock_testsuite, kvm_test_pvclock_wall_clock)
+{
+	__s64 diff;
+
+	if (!pvclock_enabled())
+		return;
+
+	/* The wall clock comes from the hypervisor, not from the RTC */
+	UK_TEST_EXPECT_SNUM_GE(ukarch_time_nsec_to_sec(pvclock_wall_clock()),
+			       PVCLOCK_TEST_EPOCH_MIN);
+	diff = (__s64) (ukplat_wall_clock() - pvclock_wall_clock());
+	UK_TEST_EXPECT_SNUM_LT(diff < 0 ? -diff : diff,
+			       ukarch_time_msec_to_nsec(10));
+}
+
+uk_testsuite_register(kvm_pvclock_testsuite, NULL);
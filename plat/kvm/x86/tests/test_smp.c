@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/*
+ * Copyright (c) 2022, The Unikraft Authors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <uk/arch/atomic.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#include <uk/test.h>
+#include <kvm-x86/smp.h>
+
+#define SMP_TEST_TIMEOUT_MS	1000
+
+struct smp_test_ctx {
+	struct ukplat_lcpu_func fn;
+	/* Number of calls per logical CPU */
+	unsigned int calls[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	/* Calls in which the per-CPU data did not match the CPU */
+	unsigned int mismatch;
+	unsigned int done;
+};
+
+static __thread __lcpuid smp_test_tls_id;
+
+static void smp_test_fn(struct __regs *regs __unused,
+			struct ukplat_lcpu_func *fn)
+{
+	struct smp_test_ctx *ctx = __containerof(fn, struct smp_test_ctx, fn);
+	struct lcpu *this = lcpu_get_current();
+	__lcpuid id = ukplat_lcpu_id();
+
+	if (this->self != this || this->id != id ||
+	    id >= ukplat_lcpu_count())
+		ukarch_inc(&ctx->mismatch);
+	else
+		ukarch_inc(&ctx->calls[id]);
+
+	/* Every CPU runs with a TLS of its own */
+	smp_test_tls_id = id;
+
+	ukarch_inc(&ctx->done);
+}
+
+static void smp_test_init(struct smp_test_ctx *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->fn.fn = smp_test_fn;
+}
+
+/* Waits until the function has been called the given number of times */
+static int smp_test_wait(struct smp_test_ctx *ctx, unsigned int done)
+{
+	__nsec until = ukplat_monotonic_clock()
+		       + ukarch_time_msec_to_nsec(SMP_TEST_TIMEOUT_MS);
+
+	while (ukarch_load_n(&ctx->done) < done) {
+		if (ukplat_monotonic_clock() >= until)
+			return -ETIMEDOUT;
+		ukarch_spinwait();
+	}
+	return 0;
+}
+
+UK_TESTCASE(kvm_smp_testsuite, kvm_test_smp_percpu)
+{
+	struct lcpu *this = lcpu_get_current();
+	__lcpuid count = ukplat_lcpu_count();
+
+	UK_TEST_EXPECT_SNUM_GE(count, 1);
+	UK_TEST_EXPECT_SNUM_LE(count, CONFIG_UKPLAT_LCPU_MAXCOUNT);
+	UK_TEST_EXPECT_SNUM_LT(ukplat_lcpu_id(), count);
+
+	/* The GS base points to the per-CPU data of the current CPU */
+	UK_TEST_EXPECT_PTR_EQ(this->self, this);
+	UK_TEST_EXPECT_SNUM_EQ(this->id, ukplat_lcpu_id());
+	UK_TEST_EXPECT_SNUM_EQ(((unsigned long) this) % CACHE_LINE_SIZE, 0);
+}
+
+UK_TESTCASE(kvm_smp_testsuite, kvm_test_smp_bringup)
+{
+	struct smp_test_ctx ctx;
+	__lcpuid count = ukplat_lcpu_count();
+	__lcpuid self = ukplat_lcpu_id();
+	__lcpuid i;
+
+	smp_test_tls_id = self;
+	smp_test_init(&ctx);
+
+	/* All discovered CPUs are online and run the function once */
+	UK_TEST_EXPECT_ZERO(ukplat_lcpu_run(NULL, 0, &ctx.fn, 0));
+	UK_TEST_EXPECT_ZERO(smp_test_wait(&ctx, count - 1));
+	UK_TEST_EXPECT_ZERO(ctx.mismatch);
+	for (i = 0; i < count; i++)
+		UK_TEST_EXPECT_SNUM_EQ(ctx.calls[i], i == self ? 0 : 1);
+
+	/* Writes to the TLS of the other CPUs did not change ours */
+	UK_TEST_EXPECT_SNUM_EQ(smp_test_tls_id, self);
+
+	UK_TEST_EXPECT_ZERO(ukplat_lcpu_wakeup(NULL, 0));
+}
+
+UK_TESTCASE(kvm_smp_testsuite, kvm_test_smp_run_one)
+{
+	struct smp_test_ctx ctx;
+	__lcpuid count = ukplat_lcpu_count();
+	__lcpuid self = ukplat_lcpu_id();
+	__lcpuid i, done = 0;
+
+	smp_test_init(&ctx);
+
+	/* Each function runs on the CPU it was sent to */
+	for (i = 0; i < count; i++) {
+		if (i == self)
+			continue;
+		UK_TEST_EXPECT_ZERO(ukplat_lcpu_run(&i, 1, &ctx.fn, 0));
+		UK_TEST_EXPECT_ZERO(smp_test_wait(&ctx, ++done));
+		UK_TEST_EXPECT_SNUM_EQ(ctx.calls[i], 1);
+	}
+	UK_TEST_EXPECT_ZERO(ctx.mismatch);
+
+	/* Invalid CPU IDs and run flags are rejected */
+	i = count;
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_lcpu_run(&i, 1, &ctx.fn, 0), -EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_lcpu_wakeup(&i, 1), -EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(ukplat_lcpu_run(NULL, 0, &ctx.fn, 1), -EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(ctx.done, done);
+}
+
+uk_testsuite_register(kvm_smp_testsuite, NULL);
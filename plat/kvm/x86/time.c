@@ -42,6 +42,9 @@
 #include <uk/plat/time.h>
 #include <uk/plat/irq.h>
 #include <kvm/tscclock.h>
+#if CONFIG_KVM_LAPIC_TIMER
+#include <kvm-x86/lapic.h>
+#endif
 #include <uk/assert.h>
 
 /* return ns since time_init() */
@@ -78,6 +81,11 @@ void ukplat_time_init(void)
 	rc = tscclock_init();
 	if (rc < 0)
 		UK_CRASH("Failed to initialize TSCCLOCK\n");
+
+#if CONFIG_KVM_LAPIC_TIMER
+	/* Falls back to the PIT on failure */
+	lapic_timer_init();
+#endif
 }
 
 void ukplat_time_fini(void)
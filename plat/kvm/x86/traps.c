@@ -30,8 +30,20 @@
 #include <uk/plat/config.h>
 #include <x86/desc.h>
 #include <kvm-x86/traps.h>
+#if CONFIG_KVM_LAPIC_TIMER
+#include <kvm-x86/lapic.h>
+#endif
+#if CONFIG_HAVE_SMP
+#include <uk/assert.h>
+#include <kvm-x86/smp.h>
+#endif
 
-static struct seg_desc32 cpu_gdt64[GDT_NUM_ENTRIES] __align64b;
+/*
+ * Every logical CPU has its own GDT, as the TSS descriptor is marked busy
+ * by LTR and the TSS holds the per-CPU interrupt stacks.
+ */
+static struct seg_desc32 cpu_gdt64[CONFIG_UKPLAT_LCPU_MAXCOUNT]
+				  [GDT_NUM_ENTRIES] __align64b;
 
 /*
  * The monitor (ukvm) or bootloader + bootstrap (virtio) starts us up with a
@@ -41,16 +53,17 @@ static struct seg_desc32 cpu_gdt64[GDT_NUM_ENTRIES] __align64b;
  * This is done primarily since we need to do LTR later in a predictable
  * fashion.
  */
-static void gdt_init(void)
+static void gdt_init(unsigned int lcpuidx)
 {
+	struct seg_desc32 *gdt = cpu_gdt64[lcpuidx];
 	volatile struct desc_table_ptr64 gdtptr;
 
-	memset(cpu_gdt64, 0, sizeof(cpu_gdt64));
-	cpu_gdt64[GDT_DESC_CODE].raw = GDT_DESC_CODE_VAL;
-	cpu_gdt64[GDT_DESC_DATA].raw = GDT_DESC_DATA_VAL;
+	memset(gdt, 0, sizeof(cpu_gdt64[lcpuidx]));
+	gdt[GDT_DESC_CODE].raw = GDT_DESC_CODE_VAL;
+	gdt[GDT_DESC_DATA].raw = GDT_DESC_DATA_VAL;
 
-	gdtptr.limit = sizeof(cpu_gdt64) - 1;
-	gdtptr.base = (__u64) &cpu_gdt64;
+	gdtptr.limit = sizeof(cpu_gdt64[lcpuidx]) - 1;
+	gdtptr.base = (__u64) gdt;
 	__asm__ __volatile__("lgdt (%0)" ::"r"(&gdtptr));
 	/*
 	 * TODO: Technically we should reload all segment registers here, in
@@ -59,31 +72,34 @@ static void gdt_init(void)
 	 */
 }
 
-static struct tss64 cpu_tss;
+static struct tss64 cpu_tss[CONFIG_UKPLAT_LCPU_MAXCOUNT];
 
+/* Interrupt stacks of the boot CPU */
 __section(".intrstack")  __align(STACK_SIZE)
 char cpu_intr_stack[STACK_SIZE];  /* IST1 */
 __section(".intrstack")  __align(STACK_SIZE)
 char cpu_trap_stack[STACK_SIZE];  /* IST2 */
 static char cpu_nmi_stack[4096];  /* IST3 */
 
-static void tss_init(void)
+static void tss_init(unsigned int lcpuidx, void *intr_sp, void *trap_sp,
+		     void *nmi_sp)
 {
-	struct seg_desc64 *td = (void *) &cpu_gdt64[GDT_DESC_TSS_LO];
+	struct tss64 *tss = &cpu_tss[lcpuidx];
+	struct seg_desc64 *td = (void *) &cpu_gdt64[lcpuidx][GDT_DESC_TSS_LO];
 
-	cpu_tss.ist[0] = (__u64) &cpu_intr_stack[sizeof(cpu_intr_stack)];
-	cpu_tss.ist[1] = (__u64) &cpu_trap_stack[sizeof(cpu_trap_stack)];
-	cpu_tss.ist[2] = (__u64) &cpu_nmi_stack[sizeof(cpu_nmi_stack)];
+	tss->ist[0] = (__u64) intr_sp;
+	tss->ist[1] = (__u64) trap_sp;
+	tss->ist[2] = (__u64) nmi_sp;
 
-	td->limit_lo = sizeof(cpu_tss);
-	td->base_lo = (__u64) &cpu_tss;
+	td->limit_lo = sizeof(*tss);
+	td->base_lo = (__u64) tss;
 	td->type = 0x9;
 	td->zero = 0;
 	td->dpl = 0;
 	td->p = 1;
 	td->limit_hi = 0;
 	td->gran = 0;
-	td->base_hi = (__u64) &cpu_tss >> 24;
+	td->base_hi = (__u64) tss >> 24;
 	td->zero1 = 0;
 
 	barrier();
@@ -173,6 +189,59 @@ static void idt_init(void)
 	FILL_IRQ_GATE(14, 1);
 	FILL_IRQ_GATE(15, 1);
 
+#if CONFIG_KVM_PCI_MSIX
+	/*
+	 * MSI vectors follow the i8259 vectors, also on IST1.
+	 */
+	FILL_IRQ_GATE(16, 1);
+	FILL_IRQ_GATE(17, 1);
+	FILL_IRQ_GATE(18, 1);
+	FILL_IRQ_GATE(19, 1);
+	FILL_IRQ_GATE(20, 1);
+	FILL_IRQ_GATE(21, 1);
+	FILL_IRQ_GATE(22, 1);
+	FILL_IRQ_GATE(23, 1);
+	FILL_IRQ_GATE(24, 1);
+	FILL_IRQ_GATE(25, 1);
+	FILL_IRQ_GATE(26, 1);
+	FILL_IRQ_GATE(27, 1);
+	FILL_IRQ_GATE(28, 1);
+	FILL_IRQ_GATE(29, 1);
+	FILL_IRQ_GATE(30, 1);
+	FILL_IRQ_GATE(31, 1);
+	FILL_IRQ_GATE(32, 1);
+	FILL_IRQ_GATE(33, 1);
+	FILL_IRQ_GATE(34, 1);
+	FILL_IRQ_GATE(35, 1);
+	FILL_IRQ_GATE(36, 1);
+	FILL_IRQ_GATE(37, 1);
+	FILL_IRQ_GATE(38, 1);
+	FILL_IRQ_GATE(39, 1);
+	FILL_IRQ_GATE(40, 1);
+	FILL_IRQ_GATE(41, 1);
+	FILL_IRQ_GATE(42, 1);
+	FILL_IRQ_GATE(43, 1);
+	FILL_IRQ_GATE(44, 1);
+	FILL_IRQ_GATE(45, 1);
+	FILL_IRQ_GATE(46, 1);
+	FILL_IRQ_GATE(47, 1);
+#endif
+
+#if CONFIG_KVM_LAPIC_TIMER
+	/*
+	 * Local APIC vectors. The timer also runs on IST1 (cpu_intr_stack).
+	 */
+	extern void cpu_lapic_timer(void);
+	extern void cpu_lapic_spurious(void);
+	idt_fillgate(LAPIC_TIMER_VECTOR, cpu_lapic_timer, 1);
+	idt_fillgate(LAPIC_SPURIOUS_VECTOR, cpu_lapic_spurious, 1);
+#endif
+
+#if CONFIG_HAVE_SMP
+	extern void cpu_lapic_ipi(void);
+	idt_fillgate(LAPIC_IPI_VECTOR, cpu_lapic_ipi, 1);
+#endif
+
 	idtptr.limit = sizeof(cpu_idt) - 1;
 	idtptr.base = (__u64) &cpu_idt;
 	__asm__ __volatile__("lidt (%0)" :: "r" (&idtptr));
@@ -180,11 +249,29 @@ static void idt_init(void)
 
 void traps_init(void)
 {
-	gdt_init();
-	tss_init();
+	gdt_init(0);
+	tss_init(0, &cpu_intr_stack[sizeof(cpu_intr_stack)],
+		 &cpu_trap_stack[sizeof(cpu_trap_stack)],
+		 &cpu_nmi_stack[sizeof(cpu_nmi_stack)]);
 	idt_init();
 }
 
+#if CONFIG_HAVE_SMP
+/*
+ * Set up the descriptor tables of a secondary CPU. The IDT filled by
+ * traps_init() is shared by all CPUs.
+ */
+void traps_lcpu_init(unsigned int lcpuidx, void *intr_sp, void *trap_sp,
+		     void *nmi_sp)
+{
+	UK_ASSERT(lcpuidx > 0 && lcpuidx < CONFIG_UKPLAT_LCPU_MAXCOUNT);
+
+	gdt_init(lcpuidx);
+	tss_init(lcpuidx, intr_sp, trap_sp, nmi_sp);
+	__asm__ __volatile__("lidt (%0)" :: "r" (&idtptr));
+}
+#endif /* CONFIG_HAVE_SMP */
+
 void traps_fini(void)
 {
 }
@@ -58,7 +58,13 @@
 #include <uk/timeconv.h>
 #include <uk/print.h>
 #include <uk/assert.h>
-#include <uk/bitops.h>
+#include <kvm/tscclock.h>
+#if CONFIG_KVM_LAPIC_TIMER
+#include <kvm-x86/lapic.h>
+#endif
+#if CONFIG_KVM_PVCLOCK
+#include <kvm-x86/pvclock.h>
+#endif
 
 #define TIMER_CNTR           0x40
 #define TIMER_MODE           0x43
@@ -98,13 +104,24 @@ static __u64 rtc_epochoffset;
  * TSC clock specific.
  */
 
-/* Base time values at the last call to tscclock_monotonic(). */
-static __u64 time_base;
+/*
+ * TSC value at the start of the monotonic clock. The clock is computed from
+ * it on every read without updating any state, so that it can be read
+ * concurrently from all CPUs.
+ */
 static __u64 tsc_base;
 
 /* Multiplier for converting TSC ticks to nsecs. (0.32) fixed point. */
 static __u32 tsc_mult;
 
+/* TSC frequency in Hz. */
+static __u64 tsc_freq;
+
+#if CONFIG_KVM_PVCLOCK
+/* Read the monotonic clock from kvmclock instead of the TSC */
+static int use_pvclock;
+#endif
+
 /*
  * Multiplier for converting nsecs to PIT ticks. (1.32) fixed point.
  *
@@ -198,17 +215,78 @@ static __u64 rtc_gettimeofday(void)
  */
 __u64 tscclock_monotonic(void)
 {
-	__u64 tsc_now, tsc_delta;
+#if CONFIG_KVM_PVCLOCK
+	if (use_pvclock)
+		return pvclock_monotonic();
+#endif
+	return mul64_32(rdtsc() - tsc_base, tsc_mult);
+}
 
-	/*
-	 * Update time_base (monotonic time) and tsc_base (TSC time).
-	 */
-	tsc_now = rdtsc();
-	tsc_delta = tsc_now - tsc_base;
-	time_base += mul64_32(tsc_delta, tsc_mult);
-	tsc_base = tsc_now;
+/*
+ * Calculate TSC scaling multiplier.
+ *
+ * (0.32) tsc_mult = UKARCH_NSEC_PER_SEC (32.32) / tsc_freq (32.0)
+ *
+ * FIXME: this will overflow with small TSC frequencies. We should
+ * probably calculate the TSC shift dynamically like solo5/hvt does.
+ */
+static void tscclock_set_frequency(__u64 freq)
+{
+	tsc_freq = freq;
+	tsc_mult = (UKARCH_NSEC_PER_SEC << 32) / tsc_freq;
+}
+
+#if CONFIG_KVM_PVCLOCK
+/* Returns non-zero if the TSC rate is constant across power states */
+static int tsc_invariant(void)
+{
+	__u32 eax, ebx, ecx, edx;
+
+	cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+	if (eax < 0x80000007)
+		return 0;
+
+	cpuid(0x80000007, 0, &eax, &ebx, &ecx, &edx);
+	return !!(edx & X86_CPUID_80000007_EDX_INVTSC);
+}
+
+/*
+ * Initialise the clock from kvmclock. This needs neither calibration nor
+ * the RTC. The TSC is still read directly if the hypervisor guarantees it
+ * to be stable, as this saves the retry loop of kvmclock on every read.
+ */
+static int tscclock_init_pvclock(void)
+{
+	int rc;
+
+	rc = pvclock_init();
+	if (rc < 0)
+		return rc;
+
+	tsc_base = rdtsc();
+	tscclock_set_frequency(pvclock_tsc_frequency());
+
+	if (pvclock_tsc_stable() && tsc_invariant()) {
+		uk_pr_info("Clock source: TSC (stable kvmclock), frequency %llu Hz\n",
+			   (unsigned long long) tsc_freq);
+	} else {
+		use_pvclock = 1;
+		uk_pr_info("Clock source: kvmclock\n");
+	}
+
+	rtc_epochoffset = pvclock_wall_clock() - tscclock_monotonic();
+	return 0;
+}
+#endif /* CONFIG_KVM_PVCLOCK */
 
-	return time_base;
+/*
+ * Initialise the clock on a secondary CPU.
+ */
+void tscclock_lcpu_init(void)
+{
+#if CONFIG_KVM_PVCLOCK
+	pvclock_lcpu_init();
+#endif
 }
 
 /*
@@ -216,7 +294,7 @@ __u64 tscclock_monotonic(void)
  */
 int tscclock_init(void)
 {
-	__u64 tsc_freq = 0, rtc_boot;
+	__u64 rtc_boot;
 	__u32 eax, ebx, ecx, edx;
 
 	/* Initialise i8254 timer channel 0 to mode 2 at CONFIG_HZ frequency */
@@ -224,6 +302,11 @@ int tscclock_init(void)
 	outb(TIMER_CNTR, (TIMER_HZ / CONFIG_HZ) & 0xff);
 	outb(TIMER_CNTR, (TIMER_HZ / CONFIG_HZ) >> 8);
 
+#if CONFIG_KVM_PVCLOCK
+	if (tscclock_init_pvclock() == 0)
+		goto out;
+#endif
+
 	/*
 	 * Read RTC "time at boot". This must be done just before tsc_base is
 	 * initialised in order to get a correct offset below.
@@ -256,36 +339,21 @@ int tscclock_init(void)
 		tsc_freq = (rdtsc() - tsc_base) * 10;
 	}
 
-	/*
-	 * Calculate TSC scaling multiplier.
-	 *
-	 * (0.32) tsc_mult = UKARCH_NSEC_PER_SEC (32.32) / tsc_freq (32.0)
-	 *
-	 * Warning, do not print anything between TSC calibration and the
-	 * setting of tsc_mult: if CONFIG_LIBUKDEBUG_PRINT_TIME is enabled
-	 * this will trigger a reset of tsc_base via tscclock_monotonic
-	 * and delay the clock starting point.
-	 *
-	 * FIXME: this will overflow with small TSC frequencies. We should
-	 * probably calculate the TSC shift dynamically like solo5/hvt does.
-	 */
-	tsc_mult = (UKARCH_NSEC_PER_SEC << 32) / tsc_freq;
+	tscclock_set_frequency(tsc_freq);
 
 	uk_pr_info("Clock source: TSC, frequency estimate is %llu Hz\n",
 		   (unsigned long long) tsc_freq);
 
 	/*
 	 * Monotonic time begins at tsc_base (first read of TSC before
-	 * calibration).
+	 * calibration). Compute RTC epoch offset by subtracting the monotonic
+	 * time from RTC time at boot.
 	 */
-	tscclock_monotonic();
-
-	/*
-	 * Compute RTC epoch offset by subtracting monotonic time_base from RTC
-	 * time at boot.
-	 */
-	rtc_epochoffset = rtc_boot - time_base;
+	rtc_epochoffset = rtc_boot - tscclock_monotonic();
 
+#if CONFIG_KVM_PVCLOCK
+out:
+#endif
 	/*
 	 * Initialise i8254 timer channel 0 to mode 4 (one shot).
 	 */
@@ -294,6 +362,14 @@ int tscclock_init(void)
 	return 0;
 }
 
+/*
+ * Return the TSC frequency in Hz, as calibrated by tscclock_init().
+ */
+__u64 tscclock_frequency(void)
+{
+	return tsc_freq;
+}
+
 /*
  * Return epoch offset (wall time offset to monotonic clock start).
  */
@@ -309,17 +385,11 @@ __u64 tscclock_epochoffset(void)
 #define PIT_MIN_DELTA	16
 
 /*
- * Returns early if any interrupts are serviced, or if the requested delay is
- * too short. Must be called with interrupts disabled, will enable interrupts
- * "atomically" during idle loop.
- *
- * This function must be called only from the scheduler. It will screw
- * your system if you do otherwise. And, there is no reason you
- * actually want to use it anywhere else. THIS IS NOT A YIELD or any
- * kind of mutex_lock. It will simply halt the cpu, not allowing any
- * other thread to execute.
+ * Program the timer interrupt of the current CPU for `until`. Deadlines that
+ * are too close are rounded up to the minimum delay that the timer can
+ * handle. Returns the nanoseconds until the programmed interrupt.
  */
-static void tscclock_cpu_block(__u64 until)
+static __u64 tscclock_timer_program(__u64 until)
 {
 	__u64 now, delta_ns;
 	__u64 delta_ticks;
@@ -328,31 +398,29 @@ static void tscclock_cpu_block(__u64 until)
 	UK_ASSERT(ukplat_lcpu_irqs_disabled());
 
 	now = ukplat_monotonic_clock();
+	delta_ns = (until > now) ? until - now : 0;
 
+#if CONFIG_KVM_LAPIC_TIMER
 	/*
-	 * Compute delta in PIT ticks. Return if it is less than minimum safe
-	 * amount of ticks.  Essentially this will cause us to spin until
-	 * the timeout.
+	 * Prefer the local APIC timer: it is programmed with a single MSR
+	 * write and is not limited to 55ms like the PIT.
 	 */
-	delta_ns = until - now;
-	delta_ticks = mul64_32(delta_ns, pit_mult);
-	if (delta_ticks < PIT_MIN_DELTA) {
-		/*
-		 * Since we are "spinning", quickly enable interrupts in
-		 * the hopes that we might get new work and can do something
-		 * else than spin.
-		 */
-		ukplat_lcpu_enable_irq();
-		nop(); /* ints are enabled 1 instr after sti */
-		ukplat_lcpu_disable_irq();
-		return;
+	if (lapic_timer_available()) {
+		if (delta_ns < LAPIC_TIMER_MIN_DELTA)
+			delta_ns = LAPIC_TIMER_MIN_DELTA;
+
+		lapic_timer_arm(delta_ns);
+		return delta_ns;
 	}
+#endif
 
 	/*
-	 * Program the timer to interrupt the CPU after the delay has expired.
-	 * Maximum timer delay is 65535 ticks.
+	 * Compute delta in PIT ticks. Maximum timer delay is 65535 ticks.
 	 */
-	if (delta_ticks > 65535)
+	delta_ticks = mul64_32(delta_ns, pit_mult);
+	if (delta_ticks < PIT_MIN_DELTA)
+		ticks = PIT_MIN_DELTA;
+	else if (delta_ticks > 65535)
 		ticks = 65535;
 	else
 		ticks = delta_ticks;
@@ -365,27 +433,79 @@ static void tscclock_cpu_block(__u64 until)
 	outb(TIMER_CNTR, ticks & 0xff);
 	outb(TIMER_CNTR, ticks >> 8);
 
-	/*
-	 * Wait for any interrupt. If we got an interrupt then just
-	 * return into the scheduler (this func is called _ONLY_ from
-	 * a scheduler, see the note above) which will check if there
-	 * is work to do and call us again here if not.
-	 *
-	 * TODO: It would be more efficient for longer sleeps to be
-	 * able to distinguish if the interrupt was the PIT interrupt
-	 * and no other, but this will do for now.
-	 */
-	ukplat_lcpu_halt_irq();
+	return ((__u64) ticks + 1) * UKARCH_NSEC_PER_SEC / TIMER_HZ;
 }
 
-unsigned long sched_have_pending_events;
+/* Shortest delay for which halting is worth programming the timer */
+static __u64 tscclock_timer_min_delta(void)
+{
+#if CONFIG_KVM_LAPIC_TIMER
+	if (lapic_timer_available())
+		return LAPIC_TIMER_MIN_DELTA;
+#endif
+	return PIT_MIN_DELTA * UKARCH_NSEC_PER_SEC / TIMER_HZ;
+}
+
+/* Deadlines requested with ukplat_time_set_deadline(), per logical CPU */
+static __nsec timer_deadline[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+
+void ukplat_time_set_deadline(__nsec deadline)
+{
+	unsigned long flags;
+
+	flags = ukplat_lcpu_save_irqf();
+	timer_deadline[ukplat_lcpu_id()] = deadline;
+	if (deadline)
+		tscclock_timer_program(deadline);
+	ukplat_lcpu_restore_irqf(flags);
+}
 
+/*
+ * Halts the CPU until the next interrupt, at the latest until `until`.
+ * Must be called with interrupts disabled, will enable interrupts
+ * "atomically" during the halt. Callers re-check for work and call us again.
+ *
+ * This function must be called only from the scheduler. It will screw
+ * your system if you do otherwise. And, there is no reason you
+ * actually want to use it anywhere else. THIS IS NOT A YIELD or any
+ * kind of mutex_lock. It will simply halt the cpu, not allowing any
+ * other thread to execute.
+ */
 void time_block_until(__snsec until)
 {
-	while ((__snsec) ukplat_monotonic_clock() < until) {
-		tscclock_cpu_block(until);
+	__nsec *deadline = &timer_deadline[ukplat_lcpu_id()];
+	__nsec now;
 
-		if (__uk_test_and_clear_bit(0, &sched_have_pending_events))
-			break;
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	now = ukplat_monotonic_clock();
+	if ((__snsec) now >= until)
+		return;
+
+	/* An earlier deadline of the kernel timers is already programmed */
+	if (*deadline && (__snsec) *deadline <= until)
+		goto halt;
+
+	if (until - now < tscclock_timer_min_delta()) {
+		/*
+		 * Too short to program the timer: since we are "spinning",
+		 * quickly enable interrupts in the hopes that we might get
+		 * new work and can do something else than spin.
+		 */
+		ukplat_lcpu_enable_irq();
+		nop(); /* ints are enabled 1 instr after sti */
+		ukplat_lcpu_disable_irq();
+		return;
 	}
+	tscclock_timer_program(until);
+
+halt:
+	ukplat_lcpu_halt_irq();
+
+	/*
+	 * A one-shot timer that fired for `until` does not cover the kernel
+	 * timers anymore.
+	 */
+	if (*deadline && (__snsec) *deadline > until)
+		tscclock_timer_program(*deadline);
 }
@@ -114,3 +114,15 @@ void ukplat_time_fini(void)
 {
 	sys_timer_delete(timerid);
 }
+
+uint32_t ukplat_time_get_irq(void)
+{
+	return TIMER_SIGNUM;
+}
+
+/* The periodic timer signal calls the timer handlers every tick, so
+ * deadlines are served with tick granularity.
+ */
+void ukplat_time_set_deadline(__nsec deadline __unused)
+{
+}